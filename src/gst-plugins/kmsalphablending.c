@@ -28,6 +28,8 @@
 
 #define PLUGIN_NAME "alphablending"
 
+#define DEFAULT_BLEND_THREADS 1
+
 #define KMS_ALPHA_BLENDING_LOCK(mixer) \
   (g_rec_mutex_lock (&( (KmsAlphaBlending *) (mixer))->priv->mutex))
 
@@ -88,6 +90,7 @@ enum
 {
   PROP_0,
   PROP_SET_MASTER,
+  PROP_BLEND_THREADS,
   N_PROPERTIES
 };
 
@@ -114,6 +117,7 @@ struct _KmsAlphaBlendingPrivate
   gint output_width, output_height;
   int master_port;
   int z_master;
+  guint blend_threads;
 };
 
 /* class initialization */
@@ -376,6 +380,13 @@ kms_alpha_blending_set_property (GObject * object, guint property_id,
       gst_structure_free (master);
       break;
     }
+    case PROP_BLEND_THREADS:
+      self->priv->blend_threads = g_value_get_uint (value);
+      if (self->priv->videomixer != NULL) {
+        g_object_set (self->priv->videomixer, "blend-threads",
+            self->priv->blend_threads, NULL);
+      }
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -404,6 +415,9 @@ kms_alpha_blending_get_property (GObject * object, guint property_id,
       gst_structure_free (data);
       break;
     }
+    case PROP_BLEND_THREADS:
+      g_value_set_uint (value, self->priv->blend_threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -871,8 +885,10 @@ kms_alpha_blending_handle_port (KmsBaseHub * mixer,
     GstElement *videorate_mixer;
 
     videorate_mixer = gst_element_factory_make ("videorate", NULL);
-    self->priv->videomixer = gst_element_factory_make ("compositor", NULL);
-    g_object_set (G_OBJECT (self->priv->videomixer), "background", 1, NULL);
+    self->priv->videomixer =
+        gst_element_factory_make ("kmsstripecompositor", NULL);
+    g_object_set (G_OBJECT (self->priv->videomixer), "background", 1,
+        "blend-threads", self->priv->blend_threads, NULL);
     self->priv->mixer_video_agnostic =
         gst_element_factory_make ("agnosticbin", NULL);
 
@@ -1031,6 +1047,11 @@ kms_alpha_blending_class_init (KmsAlphaBlendingClass * klass)
           "Set the master port",
           GST_TYPE_STRUCTURE, (GParamFlags) G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_BLEND_THREADS,
+      g_param_spec_uint ("blend-threads", "Blend threads",
+          "Threads blending horizontal stripes of the output, 0 for one per "
+          "CPU", 0, G_MAXINT, DEFAULT_BLEND_THREADS, G_PARAM_READWRITE));
+
   /* Signals initialization */
   kms_alpha_blending_signals[SIGNAL_SET_PORT_PROPERTIES] =
       g_signal_new ("set-port-properties",
@@ -1057,6 +1078,7 @@ kms_alpha_blending_init (KmsAlphaBlending * self)
   self->priv->z_master = 5;
   self->priv->output_height = 480;
   self->priv->output_width = 640;
+  self->priv->blend_threads = DEFAULT_BLEND_THREADS;
 
   self->priv->loop = kms_loop_new ();
 }
@@ -0,0 +1,291 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsaudiogate.h"
+
+#define GST_CAT_DEFAULT kms_audio_gate_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define PAD_DATA "kms-audio-gate"
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define FORMAT_S16 "S16LE"
+#define FORMAT_F32 "F32LE"
+#else
+#define FORMAT_S16 "S16BE"
+#define FORMAT_F32 "F32BE"
+#endif
+
+/* About -50 dBFS */
+#define SILENCE_S16 100
+#define SILENCE_F32 0.003f
+
+/* Voice stays above the threshold for many consecutive samples, so looking
+ * at one every SAMPLE_STRIDE is enough to tell it from silence. The stride is
+ * odd so that every channel of interleaved audio gets sampled */
+#define SAMPLE_STRIDE 13
+
+/* Silence needed to stop mixing an input, so that the end of words and the
+ * pauses between them are not cut */
+#define HANGOVER (300 * GST_MSECOND)
+
+/* Used for buffers without duration */
+#define DEFAULT_DURATION (20 * GST_MSECOND)
+
+typedef enum
+{
+  KMS_AUDIO_GATE_FORMAT_UNKNOWN,
+  KMS_AUDIO_GATE_FORMAT_S16,
+  KMS_AUDIO_GATE_FORMAT_F32
+} KmsAudioGateFormat;
+
+struct _KmsAudioGate
+{
+  gint ref;
+  gboolean enabled;             /* Atomic */
+  gint mixed;                   /* Atomic */
+};
+
+/* Only used from the streaming thread of the pad */
+typedef struct _KmsAudioGateInput
+{
+  KmsAudioGate *gate;
+  KmsAudioGateFormat format;
+  gboolean active;
+  GstClockTime silence;
+} KmsAudioGateInput;
+
+static void
+kms_audio_gate_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "audiogate", 0,
+        "Silent input gating for audio mixers");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+KmsAudioGate *
+kms_audio_gate_new (void)
+{
+  KmsAudioGate *gate;
+
+  kms_audio_gate_init ();
+
+  gate = g_slice_new0 (KmsAudioGate);
+  gate->ref = 1;
+  gate->enabled = TRUE;
+
+  return gate;
+}
+
+static void
+kms_audio_gate_unref (KmsAudioGate * gate)
+{
+  if (g_atomic_int_dec_and_test (&gate->ref)) {
+    g_slice_free (KmsAudioGate, gate);
+  }
+}
+
+void
+kms_audio_gate_free (KmsAudioGate * gate)
+{
+  if (gate == NULL) {
+    return;
+  }
+
+  kms_audio_gate_unref (gate);
+}
+
+static void
+kms_audio_gate_input_destroy (KmsAudioGateInput * input)
+{
+  if (input->active) {
+    g_atomic_int_add (&input->gate->mixed, -1);
+  }
+
+  kms_audio_gate_unref (input->gate);
+  g_slice_free (KmsAudioGateInput, input);
+}
+
+static KmsAudioGateFormat
+kms_audio_gate_parse_caps (GstCaps * caps)
+{
+  const gchar *format;
+
+  if (gst_caps_get_size (caps) == 0) {
+    return KMS_AUDIO_GATE_FORMAT_UNKNOWN;
+  }
+
+  format = gst_structure_get_string (gst_caps_get_structure (caps, 0),
+      "format");
+
+  if (g_strcmp0 (format, FORMAT_S16) == 0) {
+    return KMS_AUDIO_GATE_FORMAT_S16;
+  } else if (g_strcmp0 (format, FORMAT_F32) == 0) {
+    return KMS_AUDIO_GATE_FORMAT_F32;
+  }
+
+  return KMS_AUDIO_GATE_FORMAT_UNKNOWN;
+}
+
+/* Stops at the first sample above the threshold, so buffers with voice are
+ * usually not read to the end */
+static gboolean
+kms_audio_gate_is_silent (KmsAudioGateFormat format, GstBuffer * buffer)
+{
+  gboolean silent = TRUE;
+  GstMapInfo info;
+  gsize i, n;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP)) {
+    return TRUE;
+  }
+
+  if (format == KMS_AUDIO_GATE_FORMAT_UNKNOWN ||
+      !gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    return FALSE;
+  }
+
+  if (format == KMS_AUDIO_GATE_FORMAT_S16) {
+    const gint16 *samples = (const gint16 *) info.data;
+
+    n = info.size / sizeof (gint16);
+    for (i = 0; i < n && silent; i += SAMPLE_STRIDE) {
+      silent = ABS ((gint) samples[i]) < SILENCE_S16;
+    }
+  } else {
+    const gfloat *samples = (const gfloat *) info.data;
+
+    n = info.size / sizeof (gfloat);
+    for (i = 0; i < n && silent; i += SAMPLE_STRIDE) {
+      silent = ABS (samples[i]) < SILENCE_F32;
+    }
+  }
+
+  gst_buffer_unmap (buffer, &info);
+
+  return silent;
+}
+
+static GstPadProbeReturn
+kms_audio_gate_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsAudioGateInput * input)
+{
+  GstBuffer *buffer;
+  GstClockTime duration;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = gst_pad_probe_info_get_event (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      input->format = kms_audio_gate_parse_caps (caps);
+    }
+
+    return GST_PAD_PROBE_OK;
+  }
+
+  buffer = gst_pad_probe_info_get_buffer (info);
+
+  if (kms_audio_gate_is_silent (input->format, buffer)) {
+    duration = GST_BUFFER_DURATION (buffer);
+    input->silence += GST_CLOCK_TIME_IS_VALID (duration) ?
+        duration : DEFAULT_DURATION;
+  } else {
+    input->silence = 0;
+
+    if (!input->active) {
+      input->active = TRUE;
+      g_atomic_int_inc (&input->gate->mixed);
+      GST_TRACE_OBJECT (pad, "Voice, mixing it");
+    }
+  }
+
+  if (input->active && input->silence >= HANGOVER) {
+    input->active = FALSE;
+    g_atomic_int_add (&input->gate->mixed, -1);
+    GST_TRACE_OBJECT (pad, "Silent, not mixing it");
+  }
+
+  if (input->active || !g_atomic_int_get (&input->gate->enabled) ||
+      GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* The memory is shared, only the buffer metadata is copied */
+  buffer = gst_buffer_make_writable (buffer);
+  GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_GAP);
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+
+  return GST_PAD_PROBE_OK;
+}
+
+void
+kms_audio_gate_watch_pad (KmsAudioGate * gate, GstPad * pad)
+{
+  KmsAudioGateInput *input;
+  GstCaps *caps;
+
+  if (g_object_get_data (G_OBJECT (pad), PAD_DATA) != NULL) {
+    return;
+  }
+
+  input = g_slice_new0 (KmsAudioGateInput);
+  g_atomic_int_inc (&gate->ref);
+  input->gate = gate;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps != NULL) {
+    input->format = kms_audio_gate_parse_caps (caps);
+    gst_caps_unref (caps);
+  }
+
+  g_object_set_data_full (G_OBJECT (pad), PAD_DATA, input,
+      (GDestroyNotify) kms_audio_gate_input_destroy);
+
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) kms_audio_gate_probe, input, NULL);
+
+  GST_DEBUG_OBJECT (pad, "Gating silent audio");
+}
+
+void
+kms_audio_gate_set_enabled (KmsAudioGate * gate, gboolean enabled)
+{
+  g_atomic_int_set (&gate->enabled, enabled);
+}
+
+gboolean
+kms_audio_gate_get_enabled (KmsAudioGate * gate)
+{
+  return g_atomic_int_get (&gate->enabled);
+}
+
+guint
+kms_audio_gate_get_mixed (KmsAudioGate * gate)
+{
+  return MAX (g_atomic_int_get (&gate->mixed), 0);
+}
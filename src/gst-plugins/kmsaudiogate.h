@@ -0,0 +1,55 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_AUDIO_GATE_H_
+#define _KMS_AUDIO_GATE_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Keeps silent inputs out of the audio mixers of the hubs.
+ *
+ * Raw audio going into a mixer sink pad is checked for silence: buffers
+ * already flagged as gaps (DTX and comfort noise come out of the decoders
+ * that way) or whose peak, taken from a sparse subset of the samples, is
+ * below a low threshold. Once an input has been silent for a while its
+ * buffers are flagged as gaps too, and the mixers skip them instead of
+ * summing them. The first buffer with voice lets it in again.
+ *
+ * Only native endian S16 and F32 audio is checked, inputs with any other
+ * format are always mixed.
+ */
+typedef struct _KmsAudioGate KmsAudioGate;
+
+KmsAudioGate *kms_audio_gate_new (void);
+
+/* Pads keep the gate alive until they are finalized */
+void kms_audio_gate_free (KmsAudioGate * gate);
+
+/* Checks the audio that goes through @pad. Should be a mixer sink pad */
+void kms_audio_gate_watch_pad (KmsAudioGate * gate, GstPad * pad);
+
+/* When disabled silence is still tracked but no input is kept out */
+void kms_audio_gate_set_enabled (KmsAudioGate * gate, gboolean enabled);
+gboolean kms_audio_gate_get_enabled (KmsAudioGate * gate);
+
+/* Inputs with voice, the only ones summed while the gate is enabled */
+guint kms_audio_gate_get_mixed (KmsAudioGate * gate);
+
+G_END_DECLS
+#endif /* _KMS_AUDIO_GATE_H_ */
@@ -0,0 +1,451 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsaudiolevel.h"
+#include "kmsrtpwatcher.h"
+#include <commons/kmsloop.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <string.h>
+
+#define GST_CAT_DEFAULT kms_audio_level_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define EXTMAP_ATTR "extmap"
+
+#define SMOOTHING_SHIFT 2       /* Each new level weighs 1/4 */
+#define ACTIVE_LEVEL 40         /* -dBov */
+#define INACTIVE_LEVEL 50       /* -dBov */
+#define HANGOVER (500 * G_TIME_SPAN_MILLISECOND)
+#define SOURCE_TIMEOUT (2 * G_TIME_SPAN_SECOND)
+#define EXPIRE_INTERVAL 250     /* ms */
+
+typedef struct _KmsAudioLevelSource
+{
+  gint level;                   /* Smoothed, << SMOOTHING_SHIFT */
+  gboolean active;
+  gint64 last_seen;
+  gint64 last_voice;
+} KmsAudioLevelSource;
+
+typedef struct _KmsAudioLevelProbe
+{
+  KmsAudioLevel *audio_level;
+  gint id;                      /* Atomic, may change on renegotiations */
+} KmsAudioLevelProbe;
+
+struct _KmsAudioLevel
+{
+  GMutex mutex;
+  GHashTable *sources;          /* <SSRC, KmsAudioLevelSource> */
+  gboolean active;
+
+  KmsLoop *loop;
+  guint expire_source;          /* Armed while there are sources */
+
+  KmsAudioLevelFunc func;
+  gpointer user_data;
+};
+
+static void
+kms_audio_level_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "audiolevel", 0,
+        "RTP header extension audio levels");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+KmsAudioLevel *
+kms_audio_level_new (KmsLoop * loop, KmsAudioLevelFunc func,
+    gpointer user_data)
+{
+  KmsAudioLevel *self;
+
+  kms_audio_level_init ();
+
+  self = g_slice_new0 (KmsAudioLevel);
+  g_mutex_init (&self->mutex);
+  self->sources = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  self->func = func;
+  self->user_data = user_data;
+
+  if (loop != NULL) {
+    self->loop = g_object_ref (loop);
+  }
+
+  return self;
+}
+
+void
+kms_audio_level_free (KmsAudioLevel * self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  /* The owner is going away, a running expiration must not call it */
+  self->func = NULL;
+
+  if (self->expire_source != 0) {
+    kms_loop_remove (self->loop, self->expire_source);
+    self->expire_source = 0;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  /* Joins the loop thread when this is the last reference */
+  g_clear_object (&self->loop);
+
+  g_hash_table_unref (self->sources);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsAudioLevel, self);
+}
+
+guint8
+kms_audio_level_get_ext_id (const GstSDPMedia * media)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar *uri;
+    guint64 id;
+
+    if (g_strcmp0 (attr->key, EXTMAP_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <id>[/<direction>] <uri> [<attributes>] */
+    id = g_ascii_strtoull (attr->value, &uri, 10);
+    uri = strchr (uri, ' ');
+
+    if (uri == NULL || id < 1 || id > 14) {
+      continue;
+    }
+
+    while (*uri == ' ') {
+      uri++;
+    }
+
+    if (g_str_has_prefix (uri, KMS_AUDIO_LEVEL_EXT_URI) &&
+        (uri[strlen (KMS_AUDIO_LEVEL_EXT_URI)] == '\0' ||
+            uri[strlen (KMS_AUDIO_LEVEL_EXT_URI)] == ' ')) {
+      return id;
+    }
+  }
+
+  return 0;
+}
+
+/* Must be called with the mutex held */
+static gboolean
+kms_audio_level_any_active (KmsAudioLevel * self, gint64 now)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->sources);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsAudioLevelSource *source = value;
+
+    if (source->active && now - source->last_seen < SOURCE_TIMEOUT) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static gboolean kms_audio_level_expire (KmsAudioLevel * self);
+
+/* Must be called with the mutex held */
+static void
+kms_audio_level_arm_expiration (KmsAudioLevel * self)
+{
+  if (self->expire_source != 0) {
+    return;
+  }
+
+  /* Endpoints without the extension never get here nor start a thread */
+  if (self->loop == NULL) {
+    self->loop = kms_loop_new ();
+  }
+
+  self->expire_source = kms_loop_timeout_add_full (self->loop,
+      G_PRIORITY_DEFAULT, EXPIRE_INTERVAL,
+      (GSourceFunc) kms_audio_level_expire, self, NULL);
+}
+
+/* Senders using DTX, or gone, stop sending packets: without a timer their
+ * last level would be kept forever */
+static gboolean
+kms_audio_level_expire (KmsAudioLevel * self)
+{
+  KmsAudioLevelFunc func;
+  gpointer user_data;
+  GHashTableIter iter;
+  gpointer key, value;
+  gint64 now = g_get_monotonic_time ();
+  gboolean active, changed, keep;
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->sources);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    KmsAudioLevelSource *source = value;
+
+    if (now - source->last_seen >= SOURCE_TIMEOUT) {
+      GST_DEBUG ("Source with SSRC %u expired", GPOINTER_TO_UINT (key));
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+
+  active = kms_audio_level_any_active (self, now);
+  changed = active != self->active;
+  self->active = active;
+
+  keep = g_hash_table_size (self->sources) > 0;
+
+  if (!keep) {
+    self->expire_source = 0;
+  }
+
+  func = self->func;
+  user_data = self->user_data;
+
+  g_mutex_unlock (&self->mutex);
+
+  if (changed) {
+    GST_DEBUG ("Voice activity %s after sources expired",
+        active ? "started" : "stopped");
+
+    if (func != NULL) {
+      func (active, user_data);
+    }
+  }
+
+  return keep ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void
+kms_audio_level_update (KmsAudioLevel * self, guint32 ssrc, guint level,
+    gboolean voice)
+{
+  KmsAudioLevelFunc func;
+  gpointer user_data;
+  KmsAudioLevelSource *source;
+  gint64 now = g_get_monotonic_time ();
+  gboolean active, changed;
+  gint smoothed;
+
+  g_mutex_lock (&self->mutex);
+
+  source = g_hash_table_lookup (self->sources, GUINT_TO_POINTER (ssrc));
+
+  if (source == NULL) {
+    source = g_new0 (KmsAudioLevelSource, 1);
+    source->level = KMS_AUDIO_LEVEL_SILENCE << SMOOTHING_SHIFT;
+    g_hash_table_insert (self->sources, GUINT_TO_POINTER (ssrc), source);
+    kms_audio_level_arm_expiration (self);
+  }
+
+  source->level += ((gint) level - (source->level >> SMOOTHING_SHIFT));
+  smoothed = source->level >> SMOOTHING_SHIFT;
+  source->last_seen = now;
+
+  if (voice || smoothed <= ACTIVE_LEVEL) {
+    source->active = TRUE;
+    source->last_voice = now;
+  } else if (source->active && smoothed >= INACTIVE_LEVEL &&
+      now - source->last_voice > HANGOVER) {
+    source->active = FALSE;
+  }
+
+  active = kms_audio_level_any_active (self, now);
+  changed = active != self->active;
+  self->active = active;
+
+  func = self->func;
+  user_data = self->user_data;
+
+  g_mutex_unlock (&self->mutex);
+
+  if (changed) {
+    GST_DEBUG ("Voice activity %s (SSRC %u, level -%d dBov)",
+        active ? "started" : "stopped", ssrc, smoothed);
+
+    if (func != NULL) {
+      func (active, user_data);
+    }
+  }
+}
+
+static void
+kms_audio_level_parse (KmsAudioLevel * self, guint8 id, GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gpointer data;
+  guint size;
+  guint8 value;
+  guint32 ssrc;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    return;
+  }
+
+  if (!gst_rtp_buffer_get_extension_onebyte_header (&rtp, id, 0, &data,
+          &size) || size < 1) {
+    gst_rtp_buffer_unmap (&rtp);
+    return;
+  }
+
+  value = *(guint8 *) data;
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  kms_audio_level_update (self, ssrc, value & 0x7f, (value & 0x80) != 0);
+}
+
+static gboolean
+kms_audio_level_parse_list (GstBuffer ** buffer, guint idx,
+    KmsAudioLevelProbe * probe)
+{
+  kms_audio_level_parse (probe->audio_level, g_atomic_int_get (&probe->id),
+      *buffer);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_audio_level_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsAudioLevelProbe * probe)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_audio_level_parse (probe->audio_level, g_atomic_int_get (&probe->id),
+        gst_pad_probe_info_get_buffer (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach (gst_pad_probe_info_get_buffer_list (info),
+        (GstBufferListFunc) kms_audio_level_parse_list, probe);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+void
+kms_audio_level_watch_pad (KmsAudioLevel * self, GstPad * pad, guint8 id)
+{
+  KmsAudioLevelProbe *probe;
+
+  probe = kms_rtp_watcher_get_pad_data (pad,
+      (GstPadProbeCallback) kms_audio_level_probe);
+
+  if (probe != NULL) {
+    g_atomic_int_set (&probe->id, id);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (pad, "Parsing audio levels with extension id %u", id);
+
+  probe = g_new0 (KmsAudioLevelProbe, 1);
+  probe->audio_level = self;
+  probe->id = id;
+
+  if (!kms_rtp_watcher_add_pad_func (pad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          (GstPadProbeCallback) kms_audio_level_probe, probe, g_free)) {
+    g_free (probe);
+  }
+}
+
+void
+kms_audio_level_watch_connection (KmsAudioLevel * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media)
+{
+  GstPad *pad;
+  guint8 id;
+
+  if (g_strcmp0 (gst_sdp_media_get_media (remote_media), "audio") != 0) {
+    return;
+  }
+
+  id = kms_audio_level_get_ext_id (remote_media);
+
+  if (id == 0) {
+    GST_DEBUG ("Audio media does not send audio levels");
+    return;
+  }
+
+  pad = kms_i_rtp_connection_request_rtp_src (conn);
+
+  if (pad == NULL) {
+    return;
+  }
+
+  kms_audio_level_watch_pad (self, pad, id);
+  g_object_unref (pad);
+}
+
+guint
+kms_audio_level_get_level (KmsAudioLevel * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gint64 now = g_get_monotonic_time ();
+  guint level = KMS_AUDIO_LEVEL_SILENCE;
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->sources);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsAudioLevelSource *source = value;
+
+    if (now - source->last_seen < SOURCE_TIMEOUT) {
+      level = MIN (level, (guint) (source->level >> SMOOTHING_SHIFT));
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  return level;
+}
+
+gboolean
+kms_audio_level_is_active (KmsAudioLevel * self)
+{
+  gboolean active;
+
+  g_mutex_lock (&self->mutex);
+  active = kms_audio_level_any_active (self, g_get_monotonic_time ());
+  g_mutex_unlock (&self->mutex);
+
+  return active;
+}
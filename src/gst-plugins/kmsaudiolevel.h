@@ -0,0 +1,74 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_AUDIO_LEVEL_H_
+#define _KMS_AUDIO_LEVEL_H_
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+#include <commons/kmsirtpconnection.h>
+#include <commons/kmsloop.h>
+
+G_BEGIN_DECLS
+
+/* RFC 6464 client-to-mixer audio level header extension */
+#define KMS_AUDIO_LEVEL_EXT_URI "urn:ietf:params:rtp-hdrext:ssrc-audio-level"
+#define KMS_AUDIO_LEVEL_EXT_ID 1
+
+/* Levels are in -dBov, from 0 (loudest) to 127 (silence) */
+#define KMS_AUDIO_LEVEL_SILENCE 127
+
+/*
+ * Voice activity of the audio received by an endpoint, taken from the level
+ * each sender writes in the RTP header extension. Nothing is depayloaded nor
+ * decoded: packets are only looked at on the way out of the connections.
+ *
+ * Levels are smoothed per SSRC. A source becomes active when its level, or
+ * the voice flag set by the sender, shows speech, and inactive once it has
+ * been quiet for a while. Sources that stop sending are expired from a
+ * timer, which also reports the end of the activity they had.
+ */
+typedef struct _KmsAudioLevel KmsAudioLevel;
+
+/* Called from a streaming thread, or from @loop when sources expire, when the
+ * endpoint starts or stops receiving voice from any of its sources */
+typedef void (*KmsAudioLevelFunc) (gboolean active, gpointer user_data);
+
+/* @loop runs the expiration timer. When NULL, one is created the first time
+ * a level is received */
+KmsAudioLevel *kms_audio_level_new (KmsLoop * loop, KmsAudioLevelFunc func,
+    gpointer user_data);
+void kms_audio_level_free (KmsAudioLevel * self);
+
+/* Id of the extension declared in @media, 0 when it is not used */
+guint8 kms_audio_level_get_ext_id (const GstSDPMedia * media);
+
+/* Parses the levels received through @conn when @remote_media is an audio
+ * media declaring the extension, as a KmsRtpWatcherMediaFunc */
+void kms_audio_level_watch_connection (KmsAudioLevel * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media);
+
+/* Parses the levels carried with extension @id by the RTP leaving @pad */
+void kms_audio_level_watch_pad (KmsAudioLevel * self, GstPad * pad,
+    guint8 id);
+
+/* Smoothed level of the loudest source heard recently */
+guint kms_audio_level_get_level (KmsAudioLevel * self);
+gboolean kms_audio_level_is_active (KmsAudioLevel * self);
+
+G_END_DECLS
+#endif /* _KMS_AUDIO_LEVEL_H_ */
@@ -19,6 +19,10 @@
 #endif
 
 #include "kmscompositemixer.h"
+#include "kmshubdrain.h"
+#include "kmsaudiogate.h"
+#include <gst/app/gstappsrc.h>
+#include <commons/kms-core-marshal.h>
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kmshubport.h>
 #include <commons/kmsloop.h>
@@ -26,6 +30,15 @@
 #include <math.h>
 
 #define LATENCY 600             //ms
+#define BACKGROUND_FPS 15
+#define BACKGROUND_QUEUED_FRAMES 2
+#define DEFAULT_BLEND_THREADS 1
+
+#define QUALITY_CHECK_INTERVAL 1000     //ms
+#define QUALITY_LATE_MARGIN (50 * GST_MSECOND)
+#define QUALITY_LATE_PERCENT 10 /* Late output frames meaning overload */
+#define QUALITY_HOLD_CHECKS 2   /* Checks skipped while a change takes effect */
+#define QUALITY_RECOVER_CHECKS 5        /* Checks with headroom to step up */
 
 #define PLUGIN_NAME "compositemixer"
 
@@ -83,22 +96,96 @@ GST_STATIC_PAD_TEMPLATE (VIDEO_SRC_PAD_NAME_COMP,
     GST_STATIC_CAPS (KMS_AGNOSTIC_RAW_VIDEO_CAPS)
     );
 
+enum
+{
+  PROP_0,
+  PROP_VISIBLE_INPUTS,
+  PROP_BLENDED_INPUTS,
+  PROP_SKIP_DUPLICATES,
+  PROP_OUTPUT_FRAMES,
+  PROP_DUPLICATE_FRAMES,
+  PROP_ADAPTIVE_QUALITY,
+  PROP_QUALITY_LEVEL,
+  PROP_SKIP_SILENT_AUDIO,
+  PROP_MIXED_AUDIO_INPUTS,
+  PROP_BLEND_THREADS,
+  N_PROPERTIES
+};
+
+enum
+{
+  SIGNAL_SET_PORT_PROPERTIES,
+  SIGNAL_QUALITY_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint kms_composite_mixer_signals[LAST_SIGNAL] = { 0 };
+
+/* Steps taken under load, in order. Framerate and size are lowered in turns so
+ * neither of them drops too much before the other one is touched */
+typedef struct _KmsCompositeQuality
+{
+  gint scale_num, scale_den;    /* Output size, the tiles are scaled with it */
+  gint max_fps;                 /* 0 to keep the rate of the inputs */
+} KmsCompositeQuality;
+
+static const KmsCompositeQuality quality_levels[] = {
+  {1, 1, 0},
+  {1, 1, 20},
+  {3, 4, 20},
+  {3, 4, 15},
+  {1, 2, 15},
+  {1, 2, 10}
+};
+
 struct _KmsCompositeMixerPrivate
 {
   GstElement *videomixer;
   GstElement *audiomixer;
   GstElement *datamixer_sink;
   GstElement *datamixer_src;
-  GstElement *videotestsrc;
+  GstElement *background;
+  guint background_source;
   GHashTable *ports;
   GstElement *mixer_audio_agnostic;
   GstElement *mixer_video_agnostic;
   KmsLoop *loop;
+  KmsHubDrain *drain;
   GRecMutex mutex;
-  gint n_elems;
+  gint n_elems;                 /* Inputs with a tile: linked and not hidden */
   gint output_width, output_height;
+  guint blend_threads;
+
+  /* Set when a tile gets a new frame or the layout changes, an output frame
+   * composed while it is not set is a copy of the previous one */
+  gint damaged;
+  gboolean skip_duplicates;
+  guint64 output_frames;
+  guint64 duplicate_frames;
+
+  /* Load-adaptive quality. Counters are for the current check interval */
+  GstElement *output_filter;
+  gboolean adaptive_quality;
+  guint quality_source;
+  guint quality_level;
+  guint quality_hold;
+  guint quality_calm;
+  GstClockTime output_latency;
+  gint window_frames;
+  gint window_late;
+  gint window_qos;
+
+  KmsAudioGate *audio_gate;
 };
 
+/* Black frame pushed again on each background tick instead of drawing it */
+typedef struct _KmsCompositeBackground
+{
+  GstElement *appsrc;
+  GstBuffer *buffer;
+  volatile gint *enough_data;   /* Owned by appsrc, set by its callbacks */
+} KmsCompositeBackground;
+
 /* class initialization */
 
 G_DEFINE_TYPE_WITH_CODE (KmsCompositeMixer, kms_composite_mixer,
@@ -117,6 +204,8 @@ typedef struct _KmsCompositeMixerData
   gboolean input;
   gboolean removing;
   gboolean eos_managed;
+  gboolean hidden;
+  gulong hidden_probe_id;
   gulong probe_id;
   gulong link_probe_id;
   gulong latency_probe_id;
@@ -156,6 +245,17 @@ compare_port_data (gconstpointer a, gconstpointer b)
   return port_data_a->id - port_data_b->id;
 }
 
+/* Must be called with the lock held */
+static void
+kms_composite_mixer_get_output_size (KmsCompositeMixer * self, gint * width,
+    gint * height)
+{
+  const KmsCompositeQuality *q = &quality_levels[self->priv->quality_level];
+
+  *width = (self->priv->output_width * q->scale_num / q->scale_den) & ~1;
+  *height = (self->priv->output_height * q->scale_num / q->scale_den) & ~1;
+}
+
 static void
 kms_composite_mixer_recalculate_sizes (gpointer data)
 {
@@ -165,6 +265,8 @@ kms_composite_mixer_recalculate_sizes (gpointer data)
   GList *l;
   GList *values = g_hash_table_get_values (self->priv->ports);
 
+  g_atomic_int_set (&self->priv->damaged, TRUE);
+
   if (self->priv->n_elems <= 0) {
     return;
   }
@@ -177,13 +279,14 @@ kms_composite_mixer_recalculate_sizes (gpointer data)
 
   GST_DEBUG_OBJECT (self, "columns %d rows %d", n_columns, n_rows);
 
-  width = self->priv->output_width / n_columns;
-  height = self->priv->output_height / n_rows;
+  kms_composite_mixer_get_output_size (self, &width, &height);
+  width = width / n_columns;
+  height = height / n_rows;
 
   for (l = values; l != NULL; l = l->next) {
     KmsCompositeMixerData *port_data = l->data;
 
-    if (port_data->input == FALSE) {
+    if (port_data->input == FALSE || port_data->hidden) {
       continue;
     }
 
@@ -325,6 +428,8 @@ kms_composite_mixer_port_data_destroy (gpointer data)
   kms_base_hub_unlink_video_sink (KMS_BASE_HUB (self), port_data->id);
   kms_base_hub_unlink_audio_sink (KMS_BASE_HUB (self), port_data->id);
   kms_base_hub_unlink_data_sink (KMS_BASE_HUB (self), port_data->id);
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_VIDEO);
 
   if (port_data->input) {
     GstEvent *event;
@@ -352,10 +457,12 @@ kms_composite_mixer_port_data_destroy (gpointer data)
       event = gst_event_new_eos ();
       result = gst_pad_send_event (pad, event);
 
-      if (port_data->input && self->priv->n_elems > 0) {
+      if (port_data->input && !port_data->hidden && self->priv->n_elems > 0) {
         port_data->input = FALSE;
         self->priv->n_elems--;
         kms_composite_mixer_recalculate_sizes (self);
+      } else {
+        port_data->input = FALSE;
       }
       KMS_COMPOSITE_MIXER_UNLOCK (self);
 
@@ -395,23 +502,26 @@ kms_composite_mixer_port_data_destroy (gpointer data)
     }
     KMS_COMPOSITE_MIXER_UNLOCK (self);
 
-    gst_element_unlink (port_data->capsfilter, port_data->tee);
-    gst_element_unlink (port_data->tee, port_data->fakesink);
-
-    gst_bin_remove (GST_BIN (self), g_object_ref (port_data->capsfilter));
-    gst_element_set_state (port_data->capsfilter, GST_STATE_NULL);
-    g_object_unref (port_data->capsfilter);
-    port_data->capsfilter = NULL;
-
-    gst_bin_remove (GST_BIN (self), g_object_ref (port_data->tee));
-    gst_element_set_state (port_data->tee, GST_STATE_NULL);
-    g_object_unref (port_data->tee);
-    port_data->tee = NULL;
-
-    gst_bin_remove (GST_BIN (self), g_object_ref (port_data->fakesink));
-    gst_element_set_state (port_data->fakesink, GST_STATE_NULL);
-    g_object_unref (port_data->fakesink);
-    port_data->fakesink = NULL;
+    /* No video was received, so its branch may not have been created */
+    if (port_data->capsfilter != NULL) {
+      gst_element_unlink (port_data->capsfilter, port_data->tee);
+      gst_element_unlink (port_data->tee, port_data->fakesink);
+
+      gst_bin_remove (GST_BIN (self), g_object_ref (port_data->capsfilter));
+      gst_element_set_state (port_data->capsfilter, GST_STATE_NULL);
+      g_object_unref (port_data->capsfilter);
+      port_data->capsfilter = NULL;
+
+      gst_bin_remove (GST_BIN (self), g_object_ref (port_data->tee));
+      gst_element_set_state (port_data->tee, GST_STATE_NULL);
+      g_object_unref (port_data->tee);
+      port_data->tee = NULL;
+
+      gst_bin_remove (GST_BIN (self), g_object_ref (port_data->fakesink));
+      gst_element_set_state (port_data->fakesink, GST_STATE_NULL);
+      g_object_unref (port_data->fakesink);
+      port_data->fakesink = NULL;
+    }
   }
 
   padname = g_strdup_printf (AUDIO_SINK_PAD, port_data->id);
@@ -421,6 +531,408 @@ kms_composite_mixer_port_data_destroy (gpointer data)
   g_free (padname);
 }
 
+static GstPadProbeReturn
+kms_composite_mixer_mark_damaged (GstPad * pad, GstPadProbeInfo * info,
+    KmsCompositeMixer * self)
+{
+  g_atomic_int_set (&self->priv->damaged, TRUE);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Output frames composed without any new input frame are the same as the
+ * previous one. They are counted, and replaced by a gap when skip-duplicates
+ * is set */
+static GstPadProbeReturn
+kms_composite_mixer_check_duplicate (GstPad * pad, GstPadProbeInfo * info,
+    KmsCompositeMixer * self)
+{
+  GstBuffer *buffer;
+
+  __atomic_fetch_add (&self->priv->output_frames, 1, __ATOMIC_RELAXED);
+
+  if (g_atomic_int_compare_and_exchange (&self->priv->damaged, TRUE, FALSE)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  __atomic_fetch_add (&self->priv->duplicate_frames, 1, __ATOMIC_RELAXED);
+  buffer = gst_pad_probe_info_get_buffer (info);
+
+  if (g_atomic_int_get (&self->priv->skip_duplicates) &&
+      GST_BUFFER_PTS_IS_VALID (buffer)) {
+    gst_pad_push_event (pad, gst_event_new_gap (GST_BUFFER_PTS (buffer),
+            GST_BUFFER_DURATION (buffer)));
+
+    return GST_PAD_PROBE_DROP;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Output frames leaving later than the latency allows mean that composing
+ * does not keep up with the output rate */
+static GstPadProbeReturn
+kms_composite_mixer_check_lateness (GstPad * pad, GstPadProbeInfo * info,
+    KmsCompositeMixer * self)
+{
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  GstClockTime running_time, now, latency;
+  const GstSegment *segment;
+  GstEvent *event;
+  GstClock *clock;
+
+  latency = __atomic_load_n (&self->priv->output_latency, __ATOMIC_RELAXED);
+
+  /* Lateness is not known until the first check queries the latency */
+  if (!g_atomic_int_get (&self->priv->adaptive_quality) ||
+      !GST_CLOCK_TIME_IS_VALID (latency) || !GST_BUFFER_PTS_IS_VALID (buffer)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+
+  if (event == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_segment (event, &segment);
+  running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  gst_event_unref (event);
+
+  clock = gst_element_get_clock (GST_ELEMENT (self));
+
+  if (clock == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  now = gst_clock_get_time (clock) -
+      gst_element_get_base_time (GST_ELEMENT (self));
+  gst_object_unref (clock);
+
+  if (!GST_CLOCK_TIME_IS_VALID (running_time)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  g_atomic_int_inc (&self->priv->window_frames);
+
+  if (now > running_time + latency + QUALITY_LATE_MARGIN) {
+    g_atomic_int_inc (&self->priv->window_late);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Downstream elements that can not keep up, like encoders, report it with
+ * QoS events */
+static GstPadProbeReturn
+kms_composite_mixer_check_qos (GstPad * pad, GstPadProbeInfo * info,
+    KmsCompositeMixer * self)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  GstClockTimeDiff diff;
+  GstQOSType type;
+  gdouble proportion;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_QOS ||
+      !g_atomic_int_get (&self->priv->adaptive_quality)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_qos (event, &type, &proportion, &diff, NULL);
+
+  if (type == GST_QOS_TYPE_OVERFLOW && diff > 0) {
+    g_atomic_int_inc (&self->priv->window_qos);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Must be called with the lock held */
+static GstStructure *
+kms_composite_mixer_get_quality (KmsCompositeMixer * self)
+{
+  gint width, height;
+
+  kms_composite_mixer_get_output_size (self, &width, &height);
+
+  return gst_structure_new ("quality",
+      "level", G_TYPE_UINT, self->priv->quality_level,
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+      "max-framerate", G_TYPE_INT,
+      quality_levels[self->priv->quality_level].max_fps, NULL);
+}
+
+/* Must be called with the lock held */
+static void
+kms_composite_mixer_update_output_caps (KmsCompositeMixer * self)
+{
+  const KmsCompositeQuality *q = &quality_levels[self->priv->quality_level];
+  GstCaps *caps;
+  gint width, height;
+
+  if (self->priv->output_filter == NULL) {
+    return;
+  }
+
+  kms_composite_mixer_get_output_size (self, &width, &height);
+  caps = gst_caps_new_simple ("video/x-raw", "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height, NULL);
+
+  if (q->max_fps > 0) {
+    gst_caps_set_simple (caps, "framerate", GST_TYPE_FRACTION_RANGE, 0, 1,
+        q->max_fps, 1, NULL);
+  }
+
+  g_object_set (self->priv->output_filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+}
+
+/* Must be called with the lock held. Returns the quality to notify, if any */
+static GstStructure *
+kms_composite_mixer_set_quality_level (KmsCompositeMixer * self, guint level)
+{
+  if (level == self->priv->quality_level) {
+    return NULL;
+  }
+
+  GST_INFO_OBJECT (self, "Quality level %u -> %u", self->priv->quality_level,
+      level);
+
+  self->priv->quality_level = level;
+  self->priv->quality_hold = QUALITY_HOLD_CHECKS;
+  self->priv->quality_calm = 0;
+
+  kms_composite_mixer_recalculate_sizes (self);
+  kms_composite_mixer_update_output_caps (self);
+
+  return kms_composite_mixer_get_quality (self);
+}
+
+static void
+kms_composite_mixer_notify_quality (KmsCompositeMixer * self,
+    GstStructure * quality)
+{
+  if (quality == NULL) {
+    return;
+  }
+
+  g_signal_emit (self, kms_composite_mixer_signals[SIGNAL_QUALITY_CHANGED], 0,
+      quality);
+  gst_structure_free (quality);
+}
+
+static void
+kms_composite_mixer_update_output_latency (KmsCompositeMixer * self)
+{
+  GstClockTime min_latency;
+  GstElement *videomixer;
+  GstQuery *query;
+  gboolean live;
+
+  KMS_COMPOSITE_MIXER_LOCK (self);
+  videomixer = self->priv->videomixer != NULL ?
+      g_object_ref (self->priv->videomixer) : NULL;
+  KMS_COMPOSITE_MIXER_UNLOCK (self);
+
+  if (videomixer == NULL) {
+    return;
+  }
+
+  query = gst_query_new_latency ();
+
+  if (gst_element_query (videomixer, query)) {
+    gst_query_parse_latency (query, &live, &min_latency, NULL);
+    __atomic_store_n (&self->priv->output_latency, min_latency,
+        __ATOMIC_RELAXED);
+  }
+
+  gst_query_unref (query);
+  g_object_unref (videomixer);
+}
+
+/* Steps the quality down as soon as an interval shows overload, and back up
+ * after several intervals without late frames */
+static gboolean
+kms_composite_mixer_adapt_quality (GWeakRef * ref)
+{
+  KmsCompositeMixer *self = g_weak_ref_get (ref);
+  GstStructure *quality = NULL;
+  gint frames, late, qos;
+  guint level;
+
+  if (self == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  kms_composite_mixer_update_output_latency (self);
+
+  frames = g_atomic_int_and (&self->priv->window_frames, 0);
+  late = g_atomic_int_and (&self->priv->window_late, 0);
+  qos = g_atomic_int_and (&self->priv->window_qos, 0);
+
+  KMS_COMPOSITE_MIXER_LOCK (self);
+
+  level = self->priv->quality_level;
+
+  if (self->priv->quality_hold > 0) {
+    self->priv->quality_hold--;
+  } else if (qos > 0 || late * 100 > frames * QUALITY_LATE_PERCENT) {
+    GST_DEBUG_OBJECT (self, "Overloaded: %d of %d frames late, %d QoS events",
+        late, frames, qos);
+    self->priv->quality_calm = 0;
+
+    if (level + 1 < G_N_ELEMENTS (quality_levels)) {
+      quality = kms_composite_mixer_set_quality_level (self, level + 1);
+    }
+  } else if (late == 0 && level > 0 &&
+      ++self->priv->quality_calm >= QUALITY_RECOVER_CHECKS) {
+    quality = kms_composite_mixer_set_quality_level (self, level - 1);
+  }
+
+  KMS_COMPOSITE_MIXER_UNLOCK (self);
+
+  kms_composite_mixer_notify_quality (self, quality);
+  g_object_unref (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+kms_composite_mixer_free_weak_ref (GWeakRef * ref)
+{
+  g_weak_ref_clear (ref);
+  g_slice_free (GWeakRef, ref);
+}
+
+/* Must be called with the lock held. Returns the quality to notify, if any */
+static GstStructure *
+kms_composite_mixer_set_adaptive_quality (KmsCompositeMixer * self,
+    gboolean enable)
+{
+  GWeakRef *ref;
+
+  g_atomic_int_set (&self->priv->adaptive_quality, enable);
+
+  if (!enable) {
+    if (self->priv->quality_source != 0) {
+      kms_loop_remove (self->priv->loop, self->priv->quality_source);
+      self->priv->quality_source = 0;
+    }
+
+    return kms_composite_mixer_set_quality_level (self, 0);
+  }
+
+  if (self->priv->quality_source != 0) {
+    return NULL;
+  }
+
+  g_atomic_int_set (&self->priv->window_frames, 0);
+  g_atomic_int_set (&self->priv->window_late, 0);
+  g_atomic_int_set (&self->priv->window_qos, 0);
+  self->priv->quality_hold = 0;
+  self->priv->quality_calm = 0;
+
+  ref = g_slice_new (GWeakRef);
+  g_weak_ref_init (ref, self);
+
+  self->priv->quality_source = kms_loop_timeout_add_full (self->priv->loop,
+      G_PRIORITY_DEFAULT, QUALITY_CHECK_INTERVAL,
+      (GSourceFunc) kms_composite_mixer_adapt_quality, ref,
+      (GDestroyNotify) kms_composite_mixer_free_weak_ref);
+
+  return NULL;
+}
+
+static gboolean
+kms_composite_mixer_push_background (KmsCompositeBackground * bg)
+{
+  /* The compositor is not consuming, do not queue more frames */
+  if (g_atomic_int_get (bg->enough_data)) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Shallow copy, the frame memory is shared; appsrc sets the timestamps */
+  gst_app_src_push_buffer (GST_APP_SRC (bg->appsrc),
+      gst_buffer_copy (bg->buffer));
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+kms_composite_mixer_background_need_data (GstAppSrc * appsrc, guint length,
+    gpointer enough_data)
+{
+  g_atomic_int_set ((volatile gint *) enough_data, FALSE);
+}
+
+static void
+kms_composite_mixer_background_enough_data (GstAppSrc * appsrc,
+    gpointer enough_data)
+{
+  g_atomic_int_set ((volatile gint *) enough_data, TRUE);
+}
+
+static void
+kms_composite_mixer_destroy_background (KmsCompositeBackground * bg)
+{
+  g_object_unref (bg->appsrc);
+  gst_buffer_unref (bg->buffer);
+
+  g_slice_free (KmsCompositeBackground, bg);
+}
+
+/* Must be called with the lock held */
+static GstElement *
+kms_composite_mixer_create_background (KmsCompositeMixer * self)
+{
+  GstAppSrcCallbacks callbacks = { 0 };
+  KmsCompositeBackground *bg;
+  GstElement *appsrc;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  gsize luma;
+
+  caps = gst_caps_new_simple ("video/x-raw",
+      "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, self->priv->output_width,
+      "height", G_TYPE_INT, self->priv->output_height,
+      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+      "framerate", GST_TYPE_FRACTION, BACKGROUND_FPS, 1, NULL);
+
+  luma = self->priv->output_width * self->priv->output_height;
+
+  /* Up to BACKGROUND_QUEUED_FRAMES are queued if the compositor stalls */
+  appsrc = gst_element_factory_make ("appsrc", NULL);
+  g_object_set (appsrc, "is-live", TRUE, "do-timestamp", TRUE,
+      "format", GST_FORMAT_TIME, "block", FALSE, "caps", caps,
+      "max-bytes", (guint64) (luma * 3 / 2 * BACKGROUND_QUEUED_FRAMES), NULL);
+  gst_caps_unref (caps);
+
+  /* Drawn once, black in I420 */
+  buffer = gst_buffer_new_allocate (NULL, luma * 3 / 2, NULL);
+  gst_buffer_memset (buffer, 0, 16, luma);
+  gst_buffer_memset (buffer, luma, 128, luma / 2);
+  GST_BUFFER_DURATION (buffer) = GST_SECOND / BACKGROUND_FPS;
+
+  bg = g_slice_new0 (KmsCompositeBackground);
+  bg->appsrc = g_object_ref (appsrc);
+  bg->buffer = buffer;
+  bg->enough_data = g_new0 (gint, 1);
+
+  callbacks.need_data = kms_composite_mixer_background_need_data;
+  callbacks.enough_data = kms_composite_mixer_background_enough_data;
+  gst_app_src_set_callbacks (GST_APP_SRC (appsrc), &callbacks,
+      (gpointer) bg->enough_data, g_free);
+
+  self->priv->background_source = kms_loop_timeout_add_full (self->priv->loop,
+      G_PRIORITY_DEFAULT, 1000 / BACKGROUND_FPS,
+      (GSourceFunc) kms_composite_mixer_push_background, bg,
+      (GDestroyNotify) kms_composite_mixer_destroy_background);
+
+  return appsrc;
+}
+
 static GstPadProbeReturn
 link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
     KmsCompositeMixerData * data)
@@ -473,9 +985,16 @@ link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
       GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
       (GstPadProbeCallback) cb_latency, NULL, NULL);
 
+  gst_pad_add_probe (data->video_mixer_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_composite_mixer_mark_damaged, mixer, NULL);
+
   /*recalculate the output sizes */
-  mixer->priv->n_elems++;
-  kms_composite_mixer_recalculate_sizes (mixer);
+  if (data->hidden) {
+    g_object_set (data->video_mixer_pad, "alpha", 0.0, NULL);
+  } else {
+    mixer->priv->n_elems++;
+    kms_composite_mixer_recalculate_sizes (mixer);
+  }
 
   //Recalculate latency to avoid video freezes when an element stops to send media.
   gst_bin_recalculate_latency (GST_BIN (mixer));
@@ -517,31 +1036,78 @@ kms_composite_mixer_unhandle_port (KmsBaseHub * mixer, gint id)
       (kms_composite_mixer_parent_class))->unhandle_port (mixer, id);
 }
 
-static KmsCompositeMixerData *
-kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
+/* Hidden inputs are not blended, their frames are replaced by gaps so the
+ * compositor does not wait for them */
+static GstPadProbeReturn
+kms_composite_mixer_drop_hidden (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
 {
-  KmsCompositeMixerData *data;
-  GstPad *tee_src;
-  GstCaps *filtercaps;
-  gchar *padname;
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
 
-  data = kms_create_composite_mixer_data ();
-  data->mixer = mixer;
-  data->id = id;
-  data->input = FALSE;
-  data->removing = FALSE;
-  data->eos_managed = FALSE;
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    gst_pad_push_event (pad, gst_event_new_gap (GST_BUFFER_PTS (buffer),
+            GST_BUFFER_DURATION (buffer)));
+  }
 
+  return GST_PAD_PROBE_DROP;
+}
 
-  // Link AUDIO input
+/* Must be called with the lock held */
+static void
+kms_composite_mixer_update_hidden_probe (KmsCompositeMixerData * data)
+{
+  GstPad *pad;
 
-  padname = g_strdup_printf (AUDIO_SINK_PAD, data->id);
-  kms_base_hub_link_audio_sink (KMS_BASE_HUB (mixer), data->id,
-      mixer->priv->audiomixer, padname, FALSE);
-  g_free (padname);
+  if (data->capsfilter == NULL ||
+      data->hidden == (data->hidden_probe_id != 0)) {
+    return;
+  }
 
+  pad = gst_element_get_static_pad (data->capsfilter, "src");
 
-  // Link VIDEO input
+  if (data->hidden) {
+    data->hidden_probe_id = gst_pad_add_probe (pad,
+        GST_PAD_PROBE_TYPE_BUFFER, kms_composite_mixer_drop_hidden, NULL,
+        NULL);
+  } else {
+    gst_pad_remove_probe (pad, data->hidden_probe_id);
+    data->hidden_probe_id = 0;
+  }
+
+  g_object_unref (pad);
+}
+
+static void
+kms_composite_mixer_request_keyframe (GstElement * capsfilter)
+{
+  GstStructure *s;
+  GstPad *pad;
+
+  s = gst_structure_new ("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN,
+      TRUE, NULL);
+  pad = gst_element_get_static_pad (capsfilter, "sink");
+  gst_pad_send_event (pad, gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, s));
+  g_object_unref (pad);
+}
+
+/* Called from the streaming thread when the port starts sending video */
+static void
+kms_composite_mixer_create_video_branch (KmsHubDrain * drain, gint id,
+    KmsElementPadType type, KmsCompositeMixerData * data)
+{
+  KmsCompositeMixer *mixer = data->mixer;
+  GstPad *tee_src;
+  GstCaps *filtercaps;
+  gint width, height;
+
+  KMS_COMPOSITE_MIXER_LOCK (mixer);
+
+  if (data->removing || data->capsfilter != NULL) {
+    KMS_COMPOSITE_MIXER_UNLOCK (mixer);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (mixer, "Creating video branch of port %d", id);
 
   data->tee = gst_element_factory_make ("tee", NULL);
   data->fakesink = gst_element_factory_make ("fakesink", NULL);
@@ -559,18 +1125,14 @@ kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
   gst_element_sync_state_with_parent (data->tee);
   gst_element_sync_state_with_parent (data->fakesink);
 
+  kms_composite_mixer_get_output_size (mixer, &width, &height);
   filtercaps =
       gst_caps_new_simple ("video/x-raw",
-      "width", G_TYPE_INT, mixer->priv->output_width,
-      "height", G_TYPE_INT, mixer->priv->output_height,
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
       "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
   g_object_set (data->capsfilter, "caps", filtercaps, NULL);
   gst_caps_unref (filtercaps);
 
-  /*link basemixer -> video_agnostic */
-  kms_base_hub_link_video_sink (KMS_BASE_HUB (mixer), data->id,
-      data->capsfilter, "sink", FALSE);
-
   data->tee_sink_pad = gst_element_get_static_pad (data->tee, "sink");
   gst_element_link_pads (data->capsfilter, NULL, data->tee,
       GST_OBJECT_NAME (data->tee_sink_pad));
@@ -586,6 +1148,51 @@ kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
       (GstPadProbeCallback) link_to_videomixer,
       KMS_COMPOSITE_MIXER_REF (data), (GDestroyNotify) kms_ref_struct_unref);
 
+  kms_composite_mixer_update_hidden_probe (data);
+
+  /*link basemixer -> capsfilter */
+  kms_hub_drain_switch (drain, id, type, data->capsfilter, "sink");
+
+  KMS_COMPOSITE_MIXER_UNLOCK (mixer);
+}
+
+static KmsCompositeMixerData *
+kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
+{
+  KmsCompositeMixerData *data;
+  gchar *padname;
+
+  data = kms_create_composite_mixer_data ();
+  data->mixer = mixer;
+  data->id = id;
+  data->input = FALSE;
+  data->removing = FALSE;
+  data->eos_managed = FALSE;
+
+
+  // Link AUDIO input
+
+  padname = g_strdup_printf (AUDIO_SINK_PAD, data->id);
+  if (kms_base_hub_link_audio_sink (KMS_BASE_HUB (mixer), data->id,
+          mixer->priv->audiomixer, padname, FALSE)) {
+    GstPad *audiosink;
+
+    audiosink = gst_element_get_static_pad (mixer->priv->audiomixer, padname);
+    if (audiosink != NULL) {
+      kms_audio_gate_watch_pad (mixer->priv->audio_gate, audiosink);
+      gst_object_unref (audiosink);
+    }
+  }
+  g_free (padname);
+
+
+  // Link VIDEO input, its branch is created when video arrives
+
+  kms_hub_drain_link_full (mixer->priv->drain, data->id,
+      KMS_ELEMENT_PAD_TYPE_VIDEO,
+      (KmsHubDrainFunc) kms_composite_mixer_create_video_branch,
+      KMS_COMPOSITE_MIXER_REF (data), (GDestroyNotify) kms_ref_struct_unref);
+
 
   // Link DATA input
 
@@ -659,19 +1266,21 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
   KMS_COMPOSITE_MIXER_LOCK (self);
 
   if (self->priv->videomixer == NULL) {
-    self->priv->videomixer = gst_element_factory_make ("compositor", NULL);
+    self->priv->videomixer =
+        gst_element_factory_make ("kmsstripecompositor", NULL);
     g_object_set (G_OBJECT (self->priv->videomixer), "background",
         1 /*black */ , "start-time-selection", 1 /*first */ ,
-        "latency", LATENCY * GST_MSECOND, NULL);
+        "latency", LATENCY * GST_MSECOND, "blend-threads",
+        self->priv->blend_threads, NULL);
+    self->priv->output_filter = gst_element_factory_make ("capsfilter", NULL);
+    kms_composite_mixer_update_output_caps (self);
     self->priv->mixer_video_agnostic =
         gst_element_factory_make ("agnosticbin", NULL);
 
     gst_bin_add_many (GST_BIN (mixer), self->priv->videomixer,
-        self->priv->mixer_video_agnostic, NULL);
+        self->priv->output_filter, self->priv->mixer_video_agnostic, NULL);
 
-    if (self->priv->videotestsrc == NULL) {
-      GstElement *capsfilter;
-      GstCaps *filtercaps;
+    if (self->priv->background == NULL) {
       GstPad *pad;
       GstPadTemplate *sink_pad_template;
 
@@ -683,46 +1292,44 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
         GST_ERROR_OBJECT (self, "Error taking a new pad from videomixer");
       }
 
-      self->priv->videotestsrc =
-          gst_element_factory_make ("videotestsrc", NULL);
-      capsfilter = gst_element_factory_make ("capsfilter", NULL);
-      g_object_set (G_OBJECT (capsfilter), "caps-change-mode", 1, NULL);
-
-      g_object_set (self->priv->videotestsrc, "is-live", TRUE, "pattern",
-          /*black */ 2, NULL);
-
-      filtercaps =
-          gst_caps_new_simple ("video/x-raw",
-          "width", G_TYPE_INT, self->priv->output_width,
-          "height", G_TYPE_INT, self->priv->output_height,
-          "framerate", GST_TYPE_FRACTION, 15, 1, NULL);
-      g_object_set (G_OBJECT (capsfilter), "caps", filtercaps, NULL);
-      gst_caps_unref (filtercaps);
-
-      gst_bin_add_many (GST_BIN (self), self->priv->videotestsrc,
-          capsfilter, NULL);
+      self->priv->background = kms_composite_mixer_create_background (self);
 
-      gst_element_link (self->priv->videotestsrc, capsfilter);
+      gst_bin_add (GST_BIN (self), self->priv->background);
 
-      /*link capsfilter -> videomixer */
+      /*link background -> videomixer */
       pad = gst_element_request_pad (self->priv->videomixer, sink_pad_template,
           NULL, NULL);
 
       gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
           (GstPadProbeCallback) cb_latency, NULL, NULL);
 
-      gst_element_link_pads (capsfilter, NULL,
+      gst_element_link_pads (self->priv->background, NULL,
           self->priv->videomixer, GST_OBJECT_NAME (pad));
       g_object_set (pad, "xpos", 0, "ypos", 0, "alpha", 0.0, NULL);
       g_object_unref (pad);
 
-      gst_element_sync_state_with_parent (capsfilter);
-      gst_element_sync_state_with_parent (self->priv->videotestsrc);
+      gst_element_sync_state_with_parent (self->priv->background);
     }
     gst_element_sync_state_with_parent (self->priv->videomixer);
+    gst_element_sync_state_with_parent (self->priv->output_filter);
     gst_element_sync_state_with_parent (self->priv->mixer_video_agnostic);
 
-    gst_element_link (self->priv->videomixer, self->priv->mixer_video_agnostic);
+    gst_element_link_many (self->priv->videomixer, self->priv->output_filter,
+        self->priv->mixer_video_agnostic, NULL);
+
+    {
+      GstPad *src = gst_element_get_static_pad (self->priv->videomixer, "src");
+
+      gst_pad_add_probe (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) kms_composite_mixer_check_duplicate, self,
+          NULL);
+      gst_pad_add_probe (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) kms_composite_mixer_check_lateness, self,
+          NULL);
+      gst_pad_add_probe (src, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+          (GstPadProbeCallback) kms_composite_mixer_check_qos, self, NULL);
+      g_object_unref (src);
+    }
   }
 
   if (self->priv->audiomixer == NULL) {
@@ -764,6 +1371,165 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
   return port_id;
 }
 
+static void
+kms_composite_mixer_set_port_properties (KmsCompositeMixer * self,
+    GstStructure * properties)
+{
+  KmsCompositeMixerData *port_data;
+  GstElement *capsfilter = NULL;
+  gboolean hidden;
+  gint port;
+
+  if (!gst_structure_get (properties, "port", G_TYPE_INT, &port,
+          "hidden", G_TYPE_BOOLEAN, &hidden, NULL)) {
+    GST_WARNING_OBJECT (self, "Invalid properties structure received");
+    return;
+  }
+
+  KMS_COMPOSITE_MIXER_LOCK (self);
+
+  port_data = g_hash_table_lookup (self->priv->ports, &port);
+
+  if (port_data == NULL || port_data->removing ||
+      port_data->hidden == hidden) {
+    KMS_COMPOSITE_MIXER_UNLOCK (self);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (self, "%s port %d", hidden ? "Hiding" : "Showing", port);
+
+  port_data->hidden = hidden;
+  kms_composite_mixer_update_hidden_probe (port_data);
+
+  if (port_data->input) {
+    if (hidden) {
+      self->priv->n_elems--;
+      g_object_set (port_data->video_mixer_pad, "alpha", 0.0, NULL);
+    } else {
+      self->priv->n_elems++;
+    }
+
+    kms_composite_mixer_recalculate_sizes (self);
+  }
+
+  /* Frames were skipped while hidden, start again from a keyframe */
+  if (!hidden && port_data->capsfilter != NULL) {
+    capsfilter = g_object_ref (port_data->capsfilter);
+  }
+
+  KMS_COMPOSITE_MIXER_UNLOCK (self);
+
+  if (capsfilter != NULL) {
+    kms_composite_mixer_request_keyframe (capsfilter);
+    g_object_unref (capsfilter);
+  }
+}
+
+static void
+kms_composite_mixer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (object);
+
+  switch (property_id) {
+    case PROP_SKIP_DUPLICATES:
+      g_atomic_int_set (&self->priv->skip_duplicates,
+          g_value_get_boolean (value));
+      break;
+    case PROP_ADAPTIVE_QUALITY:{
+      GstStructure *quality;
+
+      KMS_COMPOSITE_MIXER_LOCK (self);
+      quality = kms_composite_mixer_set_adaptive_quality (self,
+          g_value_get_boolean (value));
+      KMS_COMPOSITE_MIXER_UNLOCK (self);
+      kms_composite_mixer_notify_quality (self, quality);
+      break;
+    }
+    case PROP_SKIP_SILENT_AUDIO:
+      kms_audio_gate_set_enabled (self->priv->audio_gate,
+          g_value_get_boolean (value));
+      break;
+    case PROP_BLEND_THREADS:
+      KMS_COMPOSITE_MIXER_LOCK (self);
+      self->priv->blend_threads = g_value_get_uint (value);
+      if (self->priv->videomixer != NULL) {
+        g_object_set (self->priv->videomixer, "blend-threads",
+            self->priv->blend_threads, NULL);
+      }
+      KMS_COMPOSITE_MIXER_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_composite_mixer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (object);
+  GHashTableIter iter;
+  gpointer v;
+  guint blended = 0;
+
+  KMS_COMPOSITE_MIXER_LOCK (self);
+
+  switch (property_id) {
+    case PROP_VISIBLE_INPUTS:
+      g_value_set_uint (value, MAX (self->priv->n_elems, 0));
+      break;
+    case PROP_BLENDED_INPUTS:
+      g_hash_table_iter_init (&iter, self->priv->ports);
+      while (g_hash_table_iter_next (&iter, NULL, &v)) {
+        KmsCompositeMixerData *port_data = v;
+
+        if (port_data->capsfilter != NULL && !port_data->hidden &&
+            !port_data->removing) {
+          blended++;
+        }
+      }
+      g_value_set_uint (value, blended);
+      break;
+    case PROP_SKIP_DUPLICATES:
+      g_value_set_boolean (value,
+          g_atomic_int_get (&self->priv->skip_duplicates));
+      break;
+    case PROP_OUTPUT_FRAMES:
+      g_value_set_uint64 (value, __atomic_load_n (&self->priv->output_frames,
+              __ATOMIC_RELAXED));
+      break;
+    case PROP_DUPLICATE_FRAMES:
+      g_value_set_uint64 (value,
+          __atomic_load_n (&self->priv->duplicate_frames, __ATOMIC_RELAXED));
+      break;
+    case PROP_ADAPTIVE_QUALITY:
+      g_value_set_boolean (value,
+          g_atomic_int_get (&self->priv->adaptive_quality));
+      break;
+    case PROP_QUALITY_LEVEL:
+      g_value_set_uint (value, self->priv->quality_level);
+      break;
+    case PROP_SKIP_SILENT_AUDIO:
+      g_value_set_boolean (value,
+          kms_audio_gate_get_enabled (self->priv->audio_gate));
+      break;
+    case PROP_MIXED_AUDIO_INPUTS:
+      g_value_set_uint (value,
+          kms_audio_gate_get_mixed (self->priv->audio_gate));
+      break;
+    case PROP_BLEND_THREADS:
+      g_value_set_uint (value, self->priv->blend_threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  KMS_COMPOSITE_MIXER_UNLOCK (self);
+}
+
 static void
 kms_composite_mixer_dispose (GObject * object)
 {
@@ -771,6 +1537,18 @@ kms_composite_mixer_dispose (GObject * object)
 
   KMS_COMPOSITE_MIXER_LOCK (self);
   g_hash_table_remove_all (self->priv->ports);
+  kms_hub_drain_free (self->priv->drain);
+  self->priv->drain = NULL;
+
+  if (self->priv->background_source != 0) {
+    kms_loop_remove (self->priv->loop, self->priv->background_source);
+    self->priv->background_source = 0;
+  }
+
+  if (self->priv->quality_source != 0) {
+    kms_loop_remove (self->priv->loop, self->priv->quality_source);
+    self->priv->quality_source = 0;
+  }
   KMS_COMPOSITE_MIXER_UNLOCK (self);
   g_clear_object (&self->priv->loop);
 
@@ -789,6 +1567,8 @@ kms_composite_mixer_finalize (GObject * object)
     self->priv->ports = NULL;
   }
 
+  kms_audio_gate_free (self->priv->audio_gate);
+
   G_OBJECT_CLASS (kms_composite_mixer_parent_class)->finalize (object);
 }
 
@@ -803,9 +1583,14 @@ kms_composite_mixer_class_init (KmsCompositeMixerClass * klass)
       "CompositeMixer", "Generic", "Mixer element that composes n input flows"
       " in one output flow", "David Fernandez <d.fernandezlop@gmail.com>");
 
+  gobject_class->set_property = kms_composite_mixer_set_property;
+  gobject_class->get_property = kms_composite_mixer_get_property;
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_composite_mixer_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_composite_mixer_finalize);
 
+  klass->set_port_properties =
+      GST_DEBUG_FUNCPTR (kms_composite_mixer_set_port_properties);
+
   base_hub_class->handle_port =
       GST_DEBUG_FUNCPTR (kms_composite_mixer_handle_port);
   base_hub_class->unhandle_port =
@@ -820,6 +1605,71 @@ kms_composite_mixer_class_init (KmsCompositeMixerClass * klass)
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&video_sink_factory));
 
+  g_object_class_install_property (gobject_class, PROP_VISIBLE_INPUTS,
+      g_param_spec_uint ("visible-inputs", "Visible inputs",
+          "Inputs that have a tile in the output", 0, G_MAXUINT, 0,
+          G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_BLENDED_INPUTS,
+      g_param_spec_uint ("blended-inputs", "Blended inputs",
+          "Inputs whose frames are being blended: they have sent video and "
+          "are not hidden. Decoding happens upstream and is not affected", 0,
+          G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SKIP_DUPLICATES,
+      g_param_spec_boolean ("skip-duplicates", "Skip duplicates",
+          "Replace output frames equal to the previous one by gaps instead "
+          "of sending them", FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_FRAMES,
+      g_param_spec_uint64 ("output-frames", "Output frames",
+          "Frames composed", 0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE_FRAMES,
+      g_param_spec_uint64 ("duplicate-frames", "Duplicate frames",
+          "Frames composed while no input had a new frame", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_QUALITY,
+      g_param_spec_boolean ("adaptive-quality", "Adaptive quality",
+          "Lower the output framerate and size while composing or encoding "
+          "can not keep up, and restore them when it can", FALSE,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_QUALITY_LEVEL,
+      g_param_spec_uint ("quality-level", "Quality level",
+          "Degradation steps applied to the output, 0 for none", 0,
+          G_N_ELEMENTS (quality_levels) - 1, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SKIP_SILENT_AUDIO,
+      g_param_spec_boolean ("skip-silent-audio", "Skip silent audio",
+          "Leave out of the audio mix the ports that have been silent for a "
+          "while, or send DTX or comfort noise", TRUE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MIXED_AUDIO_INPUTS,
+      g_param_spec_uint ("mixed-audio-inputs", "Mixed audio inputs",
+          "Number of ports whose audio has voice", 0, G_MAXUINT, 0,
+          G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_BLEND_THREADS,
+      g_param_spec_uint ("blend-threads", "Blend threads",
+          "Threads blending horizontal stripes of the output, 0 for one per "
+          "CPU", 0, G_MAXINT, DEFAULT_BLEND_THREADS, G_PARAM_READWRITE));
+
+  /* Signals initialization */
+  kms_composite_mixer_signals[SIGNAL_SET_PORT_PROPERTIES] =
+      g_signal_new ("set-port-properties",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_ACTION | G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (KmsCompositeMixerClass, set_port_properties), NULL, NULL,
+      __kms_core_marshal_VOID__BOXED, G_TYPE_NONE, 1, GST_TYPE_STRUCTURE);
+
+  kms_composite_mixer_signals[SIGNAL_QUALITY_CHANGED] =
+      g_signal_new ("quality-changed",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+      __kms_core_marshal_VOID__BOXED, G_TYPE_NONE, 1, GST_TYPE_STRUCTURE);
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsCompositeMixerPrivate));
 }
@@ -837,8 +1687,13 @@ kms_composite_mixer_init (KmsCompositeMixer * self)
   self->priv->output_height = 600;
   self->priv->output_width = 800;
   self->priv->n_elems = 0;
+  self->priv->damaged = TRUE;
+  self->priv->blend_threads = DEFAULT_BLEND_THREADS;
+  self->priv->output_latency = GST_CLOCK_TIME_NONE;
 
   self->priv->loop = kms_loop_new ();
+  self->priv->drain = kms_hub_drain_new (KMS_BASE_HUB (self));
+  self->priv->audio_gate = kms_audio_gate_new ();
 }
 
 gboolean
@@ -68,6 +68,10 @@ struct _KmsCompositeMixer
 struct _KmsCompositeMixerClass
 {
   KmsBaseHubClass parent_class;
+
+  /* Actions */
+  void (*set_port_properties) (KmsCompositeMixer * self,
+      GstStructure * properties);
 };
 
 GType kms_composite_mixer_get_type (void);
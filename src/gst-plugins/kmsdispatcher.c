@@ -21,6 +21,7 @@
 
 #include <commons/kms-core-marshal.h>
 #include "kmsdispatcher.h"
+#include "kmshubdrain.h"
 #include <commons/kmshubport.h>
 
 #define PLUGIN_NAME "dispatcher"
@@ -42,10 +43,15 @@ GST_DEBUG_CATEGORY_STATIC (kms_dispatcher_debug_category);
   )                                             \
 )
 
+#define NO_SOURCE (-1)
+
 struct _KmsDispatcherPrivate
 {
   GRecMutex mutex;
   GHashTable *ports;
+  KmsHubDrain *drain;
+
+  guint64 last_routing_duration;
 };
 
 typedef struct _KmsDispatcherPortData KmsDispatcherPortData;
@@ -54,8 +60,24 @@ struct _KmsDispatcherPortData
 {
   KmsDispatcher *dispatcher;
   gint id;
+
+  /* Each one is created the first time that media of the port is used as a
+   * source, until then its input goes to the drain */
   GstElement *audio_agnostic;
   GstElement *video_agnostic;
+
+  /* Port currently feeding this one, NO_SOURCE if none */
+  gint source;
+};
+
+typedef struct _KmsDispatcherBlockedPort KmsDispatcherBlockedPort;
+
+struct _KmsDispatcherBlockedPort
+{
+  GstPad *audio_pad;
+  GstPad *video_pad;
+  gulong audio_probe;
+  gulong video_probe;
 };
 
 /* class initialization */
@@ -68,9 +90,16 @@ G_DEFINE_TYPE_WITH_CODE (KmsDispatcher, kms_dispatcher,
 enum
 {
   SIGNAL_CONNECT,
+  SIGNAL_APPLY_ROUTING,
   LAST_SIGNAL
 };
 
+enum
+{
+  PROP_0,
+  PROP_LAST_ROUTING_DURATION
+};
+
 static guint obj_signals[LAST_SIGNAL] = { 0 };
 
 static void
@@ -89,21 +118,33 @@ create_gint (gint value)
 }
 
 static void
-kms_dispatcher_port_data_destroy (gpointer data)
+kms_dispatcher_release_agnostic (KmsDispatcher * self, GstElement * agnostic)
 {
-  KmsDispatcherPortData *port_data = (KmsDispatcherPortData *) data;
-  KmsDispatcher *self = port_data->dispatcher;
+  if (agnostic == NULL) {
+    return;
+  }
 
   KMS_DISPATCHER_LOCK (self);
-  gst_bin_remove_many (GST_BIN (self), port_data->audio_agnostic,
-      port_data->video_agnostic, NULL);
+  gst_bin_remove (GST_BIN (self), agnostic);
   KMS_DISPATCHER_UNLOCK (self);
 
-  gst_element_set_state (port_data->audio_agnostic, GST_STATE_NULL);
-  gst_element_set_state (port_data->video_agnostic, GST_STATE_NULL);
+  gst_element_set_state (agnostic, GST_STATE_NULL);
+  g_object_unref (agnostic);
+}
+
+static void
+kms_dispatcher_port_data_destroy (gpointer data)
+{
+  KmsDispatcherPortData *port_data = (KmsDispatcherPortData *) data;
+  KmsDispatcher *self = port_data->dispatcher;
+
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_AUDIO);
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_VIDEO);
 
-  g_clear_object (&port_data->audio_agnostic);
-  g_clear_object (&port_data->video_agnostic);
+  kms_dispatcher_release_agnostic (self, port_data->audio_agnostic);
+  kms_dispatcher_release_agnostic (self, port_data->video_agnostic);
 
   g_slice_free (KmsDispatcherPortData, data);
 }
@@ -114,23 +155,52 @@ kms_dispatcher_port_data_create (KmsDispatcher * self, gint id)
   KmsDispatcherPortData *data = g_slice_new0 (KmsDispatcherPortData);
 
   data->dispatcher = self;
-  data->audio_agnostic = gst_element_factory_make ("agnosticbin", NULL);
-  data->video_agnostic = gst_element_factory_make ("agnosticbin", NULL);
   data->id = id;
+  data->source = NO_SOURCE;
 
-  gst_bin_add_many (GST_BIN (self), g_object_ref (data->audio_agnostic),
-      g_object_ref (data->video_agnostic), NULL);
-  gst_element_sync_state_with_parent (data->audio_agnostic);
-  gst_element_sync_state_with_parent (data->video_agnostic);
-
-  kms_base_hub_link_video_sink (KMS_BASE_HUB (self), id,
-      data->video_agnostic, "sink", FALSE);
-  kms_base_hub_link_audio_sink (KMS_BASE_HUB (self), id,
-      data->audio_agnostic, "sink", FALSE);
+  kms_hub_drain_link (self->priv->drain, id, KMS_ELEMENT_PAD_TYPE_VIDEO);
+  kms_hub_drain_link (self->priv->drain, id, KMS_ELEMENT_PAD_TYPE_AUDIO);
 
   return data;
 }
 
+static GstElement *
+kms_dispatcher_create_agnostic (KmsDispatcher * self, gint id,
+    KmsElementPadType type)
+{
+  GstElement *agnostic = gst_element_factory_make ("agnosticbin", NULL);
+
+  gst_bin_add (GST_BIN (self), g_object_ref (agnostic));
+  gst_element_sync_state_with_parent (agnostic);
+
+  kms_hub_drain_switch (self->priv->drain, id, type, agnostic, "sink");
+
+  return agnostic;
+}
+
+/* Must be called with the lock held. Returns the agnosticbin of @type, which
+ * is created the first time that media of the port is used as a source */
+static GstElement *
+kms_dispatcher_port_data_ensure_source (KmsDispatcher * self,
+    KmsDispatcherPortData * data, KmsElementPadType type)
+{
+  GstElement **agnostic;
+
+  if (type == KMS_ELEMENT_PAD_TYPE_AUDIO) {
+    agnostic = &data->audio_agnostic;
+  } else {
+    agnostic = &data->video_agnostic;
+  }
+
+  if (*agnostic == NULL) {
+    GST_DEBUG_OBJECT (self, "Creating %s source branch of port %d",
+        type == KMS_ELEMENT_PAD_TYPE_AUDIO ? "audio" : "video", data->id);
+    *agnostic = kms_dispatcher_create_agnostic (self, data->id, type);
+  }
+
+  return *agnostic;
+}
+
 static void
 kms_dispatcher_dispose (GObject * object)
 {
@@ -144,6 +214,9 @@ kms_dispatcher_dispose (GObject * object)
     g_hash_table_unref (self->priv->ports);
     self->priv->ports = NULL;
   }
+
+  kms_hub_drain_free (self->priv->drain);
+  self->priv->drain = NULL;
   KMS_DISPATCHER_UNLOCK (self);
 
   G_OBJECT_CLASS (kms_dispatcher_parent_class)->dispose (object);
@@ -215,23 +288,27 @@ kms_dispatcher_connect (KmsDispatcher * self, guint source, guint sink)
 
   sink_port = g_hash_table_lookup (self->priv->ports, &sink);
   if (sink_port == NULL) {
-    GST_ERROR_OBJECT (self, "No sink port %u found", source);
+    GST_ERROR_OBJECT (self, "No sink port %u found", sink);
     goto end;
   }
 
   if (!kms_base_hub_link_audio_src (KMS_BASE_HUB (self), sink_port->id,
-          source_port->audio_agnostic, "src_%u", TRUE)) {
+          kms_dispatcher_port_data_ensure_source (self, source_port,
+              KMS_ELEMENT_PAD_TYPE_AUDIO), "src_%u", TRUE)) {
     GST_ERROR_OBJECT (self, "Can not connect audio port");
     goto end;
   }
 
   if (!kms_base_hub_link_video_src (KMS_BASE_HUB (self), sink_port->id,
-          source_port->video_agnostic, "src_%u", TRUE)) {
+          kms_dispatcher_port_data_ensure_source (self, source_port,
+              KMS_ELEMENT_PAD_TYPE_VIDEO), "src_%u", TRUE)) {
     GST_ERROR_OBJECT (self, "Can not connect video port");
     kms_base_hub_unlink_audio_src (KMS_BASE_HUB (self), sink_port->id);
+    sink_port->source = NO_SOURCE;
     goto end;
   }
 
+  sink_port->source = source_port->id;
   connected = TRUE;
 
 end:
@@ -240,6 +317,239 @@ end:
   return connected;
 }
 
+static GstPadProbeReturn
+kms_dispatcher_block_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
+{
+  /* Keep data out of the agnosticbin until the whole routing is applied */
+  return GST_PAD_PROBE_OK;
+}
+
+static gulong
+kms_dispatcher_block_pad (GstPad * pad)
+{
+  return gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+      kms_dispatcher_block_probe, NULL, NULL);
+}
+
+static void
+kms_dispatcher_blocked_port_destroy (gpointer data)
+{
+  KmsDispatcherBlockedPort *blocked = data;
+
+  gst_pad_remove_probe (blocked->audio_pad, blocked->audio_probe);
+  gst_pad_remove_probe (blocked->video_pad, blocked->video_probe);
+
+  g_object_unref (blocked->audio_pad);
+  g_object_unref (blocked->video_pad);
+
+  g_slice_free (KmsDispatcherBlockedPort, blocked);
+}
+
+static void
+kms_dispatcher_block_port (KmsDispatcher * self, GHashTable * blocked,
+    KmsDispatcherPortData * port_data)
+{
+  KmsDispatcherBlockedPort *b;
+
+  if (port_data == NULL || g_hash_table_contains (blocked, &port_data->id)) {
+    return;
+  }
+
+  b = g_slice_new0 (KmsDispatcherBlockedPort);
+  b->audio_pad =
+      gst_element_get_static_pad (kms_dispatcher_port_data_ensure_source (self,
+          port_data, KMS_ELEMENT_PAD_TYPE_AUDIO), "sink");
+  b->video_pad =
+      gst_element_get_static_pad (kms_dispatcher_port_data_ensure_source (self,
+          port_data, KMS_ELEMENT_PAD_TYPE_VIDEO), "sink");
+  b->audio_probe = kms_dispatcher_block_pad (b->audio_pad);
+  b->video_probe = kms_dispatcher_block_pad (b->video_pad);
+
+  g_hash_table_insert (blocked, create_gint (port_data->id), b);
+}
+
+static gboolean
+kms_dispatcher_route (KmsDispatcher * self, KmsDispatcherPortData * source_port,
+    KmsDispatcherPortData * sink_port)
+{
+  if (source_port == NULL) {
+    kms_base_hub_unlink_audio_src (KMS_BASE_HUB (self), sink_port->id);
+    kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), sink_port->id);
+    sink_port->source = NO_SOURCE;
+
+    return TRUE;
+  }
+
+  if (!kms_base_hub_link_audio_src (KMS_BASE_HUB (self), sink_port->id,
+          source_port->audio_agnostic, "src_%u", TRUE) ||
+      !kms_base_hub_link_video_src (KMS_BASE_HUB (self), sink_port->id,
+          source_port->video_agnostic, "src_%u", TRUE)) {
+    GST_ERROR_OBJECT (self, "Can not connect port %d to port %d",
+        source_port->id, sink_port->id);
+    kms_base_hub_unlink_audio_src (KMS_BASE_HUB (self), sink_port->id);
+    kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), sink_port->id);
+    sink_port->source = NO_SOURCE;
+
+    return FALSE;
+  }
+
+  sink_port->source = source_port->id;
+
+  return TRUE;
+}
+
+/*
+ * Applies several connections at once. @routes is an array of gint laid out
+ * as (sink, source) pairs, where a negative source disconnects the sink.
+ * Every port involved is validated before anything is changed, then the
+ * agnosticbins feeding the affected sinks are blocked while they are
+ * relinked, so that all the sinks switch over at the same time. If a sink
+ * can not be linked, the sinks already relinked get their previous source
+ * back before anything flows again, so the table is applied as a whole or
+ * not at all.
+ */
+static gboolean
+kms_dispatcher_apply_routing (KmsDispatcher * self, GArray * routes)
+{
+  KmsDispatcherPortData *source_port, *sink_port;
+  GHashTable *blocked, *sinks;
+  gboolean applied = TRUE;
+  gint *previous;
+  gint64 start;
+  guint i;
+
+  if (routes == NULL || routes->len % 2 != 0) {
+    GST_ERROR_OBJECT (self, "Routing table must contain (sink, source) pairs");
+    return FALSE;
+  }
+
+  KMS_DISPATCHER_LOCK (self);
+
+  sinks = g_hash_table_new (g_int_hash, g_int_equal);
+
+  for (i = 0; i < routes->len; i += 2) {
+    gint *sink = &g_array_index (routes, gint, i);
+    gint source = g_array_index (routes, gint, i + 1);
+
+    if (!g_hash_table_contains (self->priv->ports, sink)) {
+      GST_ERROR_OBJECT (self, "No sink port %d found", *sink);
+      applied = FALSE;
+      break;
+    }
+
+    if (source >= 0 && !g_hash_table_contains (self->priv->ports, &source)) {
+      GST_ERROR_OBJECT (self, "No source port %d found", source);
+      applied = FALSE;
+      break;
+    }
+
+    if (g_hash_table_contains (sinks, sink)) {
+      GST_ERROR_OBJECT (self, "Sink port %d routed more than once", *sink);
+      applied = FALSE;
+      break;
+    }
+
+    g_hash_table_add (sinks, sink);
+  }
+
+  g_hash_table_unref (sinks);
+
+  if (!applied) {
+    KMS_DISPATCHER_UNLOCK (self);
+    return FALSE;
+  }
+
+  start = g_get_monotonic_time ();
+
+  blocked = g_hash_table_new_full (g_int_hash, g_int_equal, destroy_gint,
+      kms_dispatcher_blocked_port_destroy);
+
+  /* Hold both the current and the new source of every sink */
+  for (i = 0; i < routes->len; i += 2) {
+    gint sink = g_array_index (routes, gint, i);
+    gint source = g_array_index (routes, gint, i + 1);
+
+    sink_port = g_hash_table_lookup (self->priv->ports, &sink);
+    kms_dispatcher_block_port (self, blocked,
+        g_hash_table_lookup (self->priv->ports, &sink_port->source));
+
+    if (source >= 0) {
+      kms_dispatcher_block_port (self, blocked,
+          g_hash_table_lookup (self->priv->ports, &source));
+    }
+  }
+
+  previous = g_new (gint, routes->len / 2);
+
+  for (i = 0; i < routes->len && applied; i += 2) {
+    gint sink = g_array_index (routes, gint, i);
+    gint source = g_array_index (routes, gint, i + 1);
+
+    sink_port = g_hash_table_lookup (self->priv->ports, &sink);
+    source_port = source >= 0 ?
+        g_hash_table_lookup (self->priv->ports, &source) : NULL;
+
+    previous[i / 2] = sink_port->source;
+
+    if (sink_port->source == source && source_port != NULL) {
+      continue;
+    }
+
+    applied = kms_dispatcher_route (self, source_port, sink_port);
+  }
+
+  /* Still blocked: put back the sinks visited, the failed one included */
+  while (!applied && i > 0) {
+    gint sink;
+
+    i -= 2;
+    sink = g_array_index (routes, gint, i);
+    sink_port = g_hash_table_lookup (self->priv->ports, &sink);
+
+    if (sink_port->source == previous[i / 2]) {
+      continue;
+    }
+
+    if (!kms_dispatcher_route (self, g_hash_table_lookup (self->priv->ports,
+                &previous[i / 2]), sink_port)) {
+      GST_ERROR_OBJECT (self, "Can not restore the source of port %d", sink);
+    }
+  }
+
+  g_free (previous);
+
+  /* Release every source in one pass */
+  g_hash_table_unref (blocked);
+
+  self->priv->last_routing_duration = g_get_monotonic_time () - start;
+
+  GST_DEBUG_OBJECT (self, "Applied %u routes in %" G_GUINT64_FORMAT " us",
+      routes->len / 2, self->priv->last_routing_duration);
+
+  KMS_DISPATCHER_UNLOCK (self);
+
+  return applied;
+}
+
+static void
+kms_dispatcher_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsDispatcher *self = KMS_DISPATCHER (object);
+
+  KMS_DISPATCHER_LOCK (self);
+  switch (property_id) {
+    case PROP_LAST_ROUTING_DURATION:
+      g_value_set_uint64 (value, self->priv->last_routing_duration);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  KMS_DISPATCHER_UNLOCK (self);
+}
+
 static void
 kms_dispatcher_class_init (KmsDispatcherClass * klass)
 {
@@ -251,9 +561,11 @@ kms_dispatcher_class_init (KmsDispatcherClass * klass)
       "media flow", "Santiago Carot-Nemesio <sancane at gmail dot com>");
 
   klass->connect = GST_DEBUG_FUNCPTR (kms_dispatcher_connect);
+  klass->apply_routing = GST_DEBUG_FUNCPTR (kms_dispatcher_apply_routing);
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_dispatcher_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_dispatcher_finalize);
+  gobject_class->get_property = GST_DEBUG_FUNCPTR (kms_dispatcher_get_property);
 
   base_hub_class->handle_port = GST_DEBUG_FUNCPTR (kms_dispatcher_handle_port);
   base_hub_class->unhandle_port =
@@ -268,6 +580,19 @@ kms_dispatcher_class_init (KmsDispatcherClass * klass)
       __kms_core_marshal_BOOLEAN__UINT_UINT, G_TYPE_BOOLEAN, 2, G_TYPE_UINT,
       G_TYPE_UINT);
 
+  obj_signals[SIGNAL_APPLY_ROUTING] =
+      g_signal_new ("apply-routing",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_ACTION | G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (KmsDispatcherClass, apply_routing), NULL, NULL,
+      g_cclosure_marshal_generic, G_TYPE_BOOLEAN, 1, G_TYPE_ARRAY);
+
+  g_object_class_install_property (gobject_class, PROP_LAST_ROUTING_DURATION,
+      g_param_spec_uint64 ("last-routing-duration",
+          "Last routing duration",
+          "Microseconds the sources were held while the last routing table "
+          "was applied", 0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsDispatcherPrivate));
 }
@@ -279,6 +604,8 @@ kms_dispatcher_init (KmsDispatcher * self)
   self->priv->ports = g_hash_table_new_full (g_int_hash, g_int_equal,
       destroy_gint, kms_dispatcher_port_data_destroy);
 
+  self->priv->drain = kms_hub_drain_new (KMS_BASE_HUB (self));
+
   g_rec_mutex_init (&self->priv->mutex);
 }
 
@@ -19,6 +19,7 @@
 #endif
 
 #include "kmsdispatcheronetomany.h"
+#include "kmshubdrain.h"
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kmshubport.h>
 
@@ -42,13 +43,17 @@ GST_DEBUG_CATEGORY_STATIC (kms_dispatcher_one_to_many_debug_category);
 )
 
 #define MAIN_PORT_NONE (-1)
+#define DEFAULT_GOP_CACHE_SIZE 0
 
 struct _KmsDispatcherOneToManyPrivate
 {
   GRecMutex mutex;
   GHashTable *ports;
+  KmsHubDrain *drain;
 
   gint main_port;
+  volatile guint gop_cache_size;
+  guint64 last_switch_duration;
 };
 
 typedef struct _KmsDispatcherOneToManyPortData KmsDispatcherOneToManyPortData;
@@ -57,14 +62,25 @@ struct _KmsDispatcherOneToManyPortData
 {
   KmsDispatcherOneToMany *mixer;
   gint id;
+
+  /* Each one is created the first time that media of the port is sent to the
+   * sinks, or cached, until then its input goes to the drain */
   GstElement *audio_agnostic;
   GstElement *video_agnostic;
+  gulong pad_added_id;
+
+  /* Encoded video received since the last keyframe */
+  GMutex gop_mutex;
+  GQueue gop;
+  gsize gop_size;
 };
 
 enum
 {
   PROP_0,
-  PROP_MAIN_PORT
+  PROP_MAIN_PORT,
+  PROP_GOP_CACHE_SIZE,
+  PROP_LAST_SWITCH_DURATION
 };
 
 /* class initialization */
@@ -74,6 +90,253 @@ G_DEFINE_TYPE_WITH_CODE (KmsDispatcherOneToMany, kms_dispatcher_one_to_many,
     GST_DEBUG_CATEGORY_INIT (kms_dispatcher_one_to_many_debug_category,
         PLUGIN_NAME, 0, "debug category for dispatcheronetomany element"));
 
+static void
+kms_dispatcher_one_to_many_port_data_clear_gop (KmsDispatcherOneToManyPortData
+    * data)
+{
+  g_queue_foreach (&data->gop, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (&data->gop);
+  data->gop_size = 0;
+}
+
+static GstPadProbeReturn
+kms_dispatcher_one_to_many_cache_gop_probe (GstPad * pad,
+    GstPadProbeInfo * info, KmsDispatcherOneToManyPortData * data)
+{
+  guint max_size = g_atomic_int_get (&data->mixer->priv->gop_cache_size);
+  GstBuffer *buffer;
+  gsize size;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    /* Cached buffers are only valid for the current stream */
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS ||
+        GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+      g_mutex_lock (&data->gop_mutex);
+      kms_dispatcher_one_to_many_port_data_clear_gop (data);
+      g_mutex_unlock (&data->gop_mutex);
+    }
+
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (max_size == 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  size = gst_buffer_get_size (buffer);
+
+  g_mutex_lock (&data->gop_mutex);
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    kms_dispatcher_one_to_many_port_data_clear_gop (data);
+  } else if (g_queue_is_empty (&data->gop)) {
+    /* Wait for a keyframe, deltas can not be decoded alone */
+    goto end;
+  }
+
+  if (data->gop_size + size > max_size) {
+    GST_DEBUG_OBJECT (data->mixer, "GOP of port %d exceeds %u bytes, not"
+        " cached until next keyframe", data->id, max_size);
+    kms_dispatcher_one_to_many_port_data_clear_gop (data);
+    goto end;
+  }
+
+  g_queue_push_tail (&data->gop, gst_buffer_ref (buffer));
+  data->gop_size += size;
+
+end:
+  g_mutex_unlock (&data->gop_mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Decoding order timestamp, presentation one when there is none */
+static GstClockTime
+kms_dispatcher_one_to_many_buffer_time (GstBuffer * buffer)
+{
+  if (GST_BUFFER_DTS_IS_VALID (buffer)) {
+    return GST_BUFFER_DTS (buffer);
+  }
+
+  return GST_BUFFER_PTS (buffer);
+}
+
+/*
+ * Runs on the streaming thread of the agnosticbin source pad, for the first
+ * buffer after a sink is linked. Sticky events have already been sent to
+ * the peer, so the cached GOP is chained to it right before this buffer.
+ *
+ * The GOP is cached on the sink pad of the agnosticbin, ahead of its queue,
+ * so it may already hold this buffer and the ones after it. Only the cached
+ * buffers older than this one are replayed, with their own timestamps.
+ */
+static GstPadProbeReturn
+kms_dispatcher_one_to_many_replay_gop_probe (GstPad * pad,
+    GstPadProbeInfo * info, KmsDispatcherOneToManyPortData * data)
+{
+  GstBuffer *current = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstCaps *caps = NULL, *src_caps = NULL;
+  GstClockTime current_time;
+  GstPad *sinkpad, *peer;
+  GstBuffer *buffer;
+  gboolean first = TRUE;
+  GQueue gop;
+  GList *l;
+
+  if (!GST_BUFFER_FLAG_IS_SET (current, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    /* The sink can start decoding right away */
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  current_time = kms_dispatcher_one_to_many_buffer_time (current);
+
+  if (!GST_CLOCK_TIME_IS_VALID (current_time)) {
+    GST_DEBUG_OBJECT (data->mixer, "Buffer without timestamps, GOP of port %d"
+        " not replayed", data->id);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  peer = gst_pad_get_peer (pad);
+
+  if (peer == NULL) {
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  g_queue_init (&gop);
+
+  g_mutex_lock (&data->gop_mutex);
+
+  for (l = data->gop.head; l != NULL; l = l->next) {
+    GstClockTime time = kms_dispatcher_one_to_many_buffer_time (l->data);
+
+    if (!GST_CLOCK_TIME_IS_VALID (time) || time >= current_time) {
+      break;
+    }
+
+    g_queue_push_tail (&gop, gst_buffer_ref (l->data));
+  }
+
+  g_mutex_unlock (&data->gop_mutex);
+
+  sinkpad = gst_element_get_static_pad (data->video_agnostic, "sink");
+
+  if (g_queue_is_empty (&gop)) {
+    goto end;
+  }
+
+  caps = gst_pad_get_current_caps (sinkpad);
+  src_caps = gst_pad_get_current_caps (pad);
+
+  /* Encoded buffers can only be replayed if agnosticbin does not transcode */
+  if (caps == NULL || src_caps == NULL || !gst_caps_is_equal (caps, src_caps)) {
+    GST_DEBUG_OBJECT (data->mixer, "Sink receives %" GST_PTR_FORMAT
+        ", GOP not replayed", src_caps);
+    goto end;
+  }
+
+  GST_DEBUG_OBJECT (data->mixer, "Replaying %u cached buffers of port %d",
+      g_queue_get_length (&gop), data->id);
+
+  while ((buffer = g_queue_pop_head (&gop)) != NULL) {
+    if (first) {
+      buffer = gst_buffer_make_writable (buffer);
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+      first = FALSE;
+    }
+
+    if (gst_pad_chain (peer, buffer) != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (data->mixer, "Cannot replay GOP of port %d", data->id);
+      break;
+    }
+  }
+
+end:
+  g_queue_foreach (&gop, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (&gop);
+
+  if (src_caps != NULL) {
+    gst_caps_unref (src_caps);
+  }
+
+  if (caps != NULL) {
+    gst_caps_unref (caps);
+  }
+
+  g_object_unref (sinkpad);
+  g_object_unref (peer);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Called each time a sink is linked to this source */
+static void
+kms_dispatcher_one_to_many_schedule_gop_replay (GstPad * pad, GstPad * peer,
+    KmsDispatcherOneToManyPortData * data)
+{
+  /* Pushing from here would race with the streaming thread */
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_dispatcher_one_to_many_replay_gop_probe, data,
+      NULL);
+}
+
+static void
+kms_dispatcher_one_to_many_video_pad_added (GstElement * agnostic,
+    GstPad * pad, KmsDispatcherOneToManyPortData * data)
+{
+  if (gst_pad_get_direction (pad) != GST_PAD_SRC) {
+    return;
+  }
+
+  g_signal_connect (pad, "linked",
+      G_CALLBACK (kms_dispatcher_one_to_many_schedule_gop_replay), data);
+}
+
+/* Must be called with the lock held. Returns the agnosticbin of @type */
+static GstElement *
+kms_dispatcher_one_to_many_port_data_ensure_source (KmsDispatcherOneToMany *
+    self, KmsDispatcherOneToManyPortData * data, KmsElementPadType type)
+{
+  GstElement **agnostic;
+  GstPad *sinkpad;
+
+  if (type == KMS_ELEMENT_PAD_TYPE_AUDIO) {
+    agnostic = &data->audio_agnostic;
+  } else {
+    agnostic = &data->video_agnostic;
+  }
+
+  if (*agnostic != NULL) {
+    return *agnostic;
+  }
+
+  GST_DEBUG_OBJECT (self, "Creating %s source branch of port %d",
+      type == KMS_ELEMENT_PAD_TYPE_AUDIO ? "audio" : "video", data->id);
+
+  *agnostic = gst_element_factory_make ("agnosticbin", NULL);
+
+  if (type == KMS_ELEMENT_PAD_TYPE_VIDEO) {
+    sinkpad = gst_element_get_static_pad (*agnostic, "sink");
+    gst_pad_add_probe (sinkpad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        (GstPadProbeCallback) kms_dispatcher_one_to_many_cache_gop_probe, data,
+        NULL);
+    g_object_unref (sinkpad);
+
+    data->pad_added_id = g_signal_connect (*agnostic, "pad-added",
+        G_CALLBACK (kms_dispatcher_one_to_many_video_pad_added), data);
+  }
+
+  gst_bin_add (GST_BIN (self), g_object_ref (*agnostic));
+  gst_element_sync_state_with_parent (*agnostic);
+
+  kms_hub_drain_switch (self->priv->drain, data->id, type, *agnostic, "sink");
+
+  return *agnostic;
+}
+
 static KmsDispatcherOneToManyPortData *
 kms_dispatcher_one_to_many_port_data_create (KmsDispatcherOneToMany * mixer,
     gint id)
@@ -82,23 +345,30 @@ kms_dispatcher_one_to_many_port_data_create (KmsDispatcherOneToMany * mixer,
       g_slice_new0 (KmsDispatcherOneToManyPortData);
 
   data->mixer = mixer;
-  data->audio_agnostic = gst_element_factory_make ("agnosticbin", NULL);
-  data->video_agnostic = gst_element_factory_make ("agnosticbin", NULL);
   data->id = id;
 
-  gst_bin_add_many (GST_BIN (mixer), g_object_ref (data->audio_agnostic),
-      g_object_ref (data->video_agnostic), NULL);
-  gst_element_sync_state_with_parent (data->audio_agnostic);
-  gst_element_sync_state_with_parent (data->video_agnostic);
+  g_mutex_init (&data->gop_mutex);
+  g_queue_init (&data->gop);
 
-  kms_base_hub_link_video_sink (KMS_BASE_HUB (mixer), id,
-      data->video_agnostic, "sink", FALSE);
-  kms_base_hub_link_audio_sink (KMS_BASE_HUB (mixer), id,
-      data->audio_agnostic, "sink", FALSE);
+  kms_hub_drain_link (mixer->priv->drain, id, KMS_ELEMENT_PAD_TYPE_VIDEO);
+  kms_hub_drain_link (mixer->priv->drain, id, KMS_ELEMENT_PAD_TYPE_AUDIO);
 
   return data;
 }
 
+static void
+kms_dispatcher_one_to_many_release_agnostic (KmsDispatcherOneToMany * self,
+    GstElement * agnostic)
+{
+  if (agnostic == NULL) {
+    return;
+  }
+
+  gst_bin_remove (GST_BIN (self), agnostic);
+  gst_element_set_state (agnostic, GST_STATE_NULL);
+  g_object_unref (agnostic);
+}
+
 static void
 kms_dispatcher_one_to_many_port_data_destroy (gpointer data)
 {
@@ -107,15 +377,26 @@ kms_dispatcher_one_to_many_port_data_destroy (gpointer data)
   KmsDispatcherOneToMany *self = port_data->mixer;
 
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
-  gst_bin_remove_many (GST_BIN (self), port_data->audio_agnostic,
-      port_data->video_agnostic, NULL);
-  KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 
-  gst_element_set_state (port_data->audio_agnostic, GST_STATE_NULL);
-  gst_element_set_state (port_data->video_agnostic, GST_STATE_NULL);
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_AUDIO);
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_VIDEO);
+
+  if (port_data->video_agnostic != NULL) {
+    g_signal_handler_disconnect (port_data->video_agnostic,
+        port_data->pad_added_id);
+  }
+
+  kms_dispatcher_one_to_many_release_agnostic (self,
+      port_data->audio_agnostic);
+  kms_dispatcher_one_to_many_release_agnostic (self,
+      port_data->video_agnostic);
 
-  g_clear_object (&port_data->audio_agnostic);
-  g_clear_object (&port_data->video_agnostic);
+  KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
+
+  kms_dispatcher_one_to_many_port_data_clear_gop (port_data);
+  g_mutex_clear (&port_data->gop_mutex);
 
   g_slice_free (KmsDispatcherOneToManyPortData, data);
 }
@@ -141,36 +422,108 @@ kms_dispatcher_one_to_many_link_port (KmsDispatcherOneToMany * self, gint to)
   KmsDispatcherOneToManyPortData *port_data;
 
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
-  if (self->priv->main_port < 0) {
+  port_data = g_hash_table_lookup (self->priv->ports, &self->priv->main_port);
+
+  if (port_data == NULL) {
     kms_base_hub_unlink_audio_src (KMS_BASE_HUB (self), to);
     kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), to);
   } else {
-    port_data = g_hash_table_lookup (self->priv->ports, &self->priv->main_port);
     kms_base_hub_link_audio_src (KMS_BASE_HUB (self), to,
-        port_data->audio_agnostic, "src_%u", TRUE);
+        kms_dispatcher_one_to_many_port_data_ensure_source (self, port_data,
+            KMS_ELEMENT_PAD_TYPE_AUDIO), "src_%u", TRUE);
     kms_base_hub_link_video_src (KMS_BASE_HUB (self), to,
-        port_data->video_agnostic, "src_%u", TRUE);
+        kms_dispatcher_one_to_many_port_data_ensure_source (self, port_data,
+            KMS_ELEMENT_PAD_TYPE_VIDEO), "src_%u", TRUE);
   }
 
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 }
 
-static void
-kms_dispatcher_one_to_many_change_main_port_it (gpointer key, gpointer value,
+static GstPadProbeReturn
+kms_dispatcher_one_to_many_block_probe (GstPad * pad, GstPadProbeInfo * info,
     gpointer data)
 {
-  KmsDispatcherOneToManyPortData *port_data = value;
+  /* Keep data out of the agnosticbin until every sink is relinked */
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_dispatcher_one_to_many_block_port (KmsDispatcherOneToMany * self, gint id,
+    GSList ** blocked)
+{
+  KmsDispatcherOneToManyPortData *port_data;
+  GstElement *agnostics[2];
+  guint i;
+
+  port_data = g_hash_table_lookup (self->priv->ports, &id);
+  if (port_data == NULL) {
+    return;
+  }
+
+  /* A new main port gets its branches before the sinks are relinked */
+  agnostics[0] = kms_dispatcher_one_to_many_port_data_ensure_source (self,
+      port_data, KMS_ELEMENT_PAD_TYPE_AUDIO);
+  agnostics[1] = kms_dispatcher_one_to_many_port_data_ensure_source (self,
+      port_data, KMS_ELEMENT_PAD_TYPE_VIDEO);
 
-  kms_dispatcher_one_to_many_link_port (port_data->mixer, port_data->id);
+  for (i = 0; i < G_N_ELEMENTS (agnostics); i++) {
+    GstPad *pad = gst_element_get_static_pad (agnostics[i], "sink");
+    gulong probe = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+        kms_dispatcher_one_to_many_block_probe, NULL, NULL);
+
+    g_object_set_data (G_OBJECT (pad), "kms-block-probe",
+        GSIZE_TO_POINTER (probe));
+    *blocked = g_slist_prepend (*blocked, pad);
+  }
+}
+
+static void
+kms_dispatcher_one_to_many_unblock_pad (GstPad * pad)
+{
+  gulong probe = GPOINTER_TO_SIZE (g_object_steal_data (G_OBJECT (pad),
+          "kms-block-probe"));
+
+  gst_pad_remove_probe (pad, probe);
+  g_object_unref (pad);
 }
 
+/*
+ * Relinks every sink to the current main port. The old and the new main
+ * sources are held while this happens so all the sinks switch at the same
+ * buffer instead of one by one.
+ */
 static void
-kms_dispatcher_one_to_many_change_main_port (KmsDispatcherOneToMany * self)
+kms_dispatcher_one_to_many_change_main_port (KmsDispatcherOneToMany * self,
+    gint old_main_port)
 {
+  KmsDispatcherOneToManyPortData *port_data;
+  GSList *blocked = NULL;
+  GHashTableIter iter;
+  gint64 start;
+
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
 
-  g_hash_table_foreach (self->priv->ports,
-      kms_dispatcher_one_to_many_change_main_port_it, NULL);
+  start = g_get_monotonic_time ();
+
+  kms_dispatcher_one_to_many_block_port (self, old_main_port, &blocked);
+  if (self->priv->main_port != old_main_port) {
+    kms_dispatcher_one_to_many_block_port (self, self->priv->main_port,
+        &blocked);
+  }
+
+  g_hash_table_iter_init (&iter, self->priv->ports);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & port_data)) {
+    kms_dispatcher_one_to_many_link_port (self, port_data->id);
+  }
+
+  g_slist_free_full (blocked,
+      (GDestroyNotify) kms_dispatcher_one_to_many_unblock_pad);
+
+  self->priv->last_switch_duration = g_get_monotonic_time () - start;
+
+  GST_DEBUG_OBJECT (self, "Switched %u sinks to port %d in %" G_GUINT64_FORMAT
+      " us", g_hash_table_size (self->priv->ports), self->priv->main_port,
+      self->priv->last_switch_duration);
 
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 }
@@ -186,7 +539,7 @@ kms_dispatcher_one_to_many_unhandle_port (KmsBaseHub * mixer, gint id)
 
   if (self->priv->main_port == id) {
     self->priv->main_port = MAIN_PORT_NONE;
-    kms_dispatcher_one_to_many_change_main_port (self);
+    kms_dispatcher_one_to_many_change_main_port (self, MAIN_PORT_NONE);
   }
 
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
@@ -215,6 +568,11 @@ kms_dispatcher_one_to_many_handle_port (KmsBaseHub * mixer,
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
   g_hash_table_insert (self->priv->ports, create_gint (port_id), port_data);
 
+  if (g_atomic_int_get (&self->priv->gop_cache_size) > 0) {
+    kms_dispatcher_one_to_many_port_data_ensure_source (self, port_data,
+        KMS_ELEMENT_PAD_TYPE_VIDEO);
+  }
+
   kms_dispatcher_one_to_many_link_port (self, port_id);
 
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
@@ -222,6 +580,25 @@ kms_dispatcher_one_to_many_handle_port (KmsBaseHub * mixer,
   return port_id;
 }
 
+/* Must be called with the lock held. Video of every port is cached so that
+ * any of them can be switched to without waiting for a keyframe */
+static void
+kms_dispatcher_one_to_many_ensure_gop_caches (KmsDispatcherOneToMany * self)
+{
+  KmsDispatcherOneToManyPortData *port_data;
+  GHashTableIter iter;
+
+  if (g_atomic_int_get (&self->priv->gop_cache_size) == 0) {
+    return;
+  }
+
+  g_hash_table_iter_init (&iter, self->priv->ports);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & port_data)) {
+    kms_dispatcher_one_to_many_port_data_ensure_source (self, port_data,
+        KMS_ELEMENT_PAD_TYPE_VIDEO);
+  }
+}
+
 static void
 kms_dispatcher_one_to_many_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec)
@@ -230,10 +607,17 @@ kms_dispatcher_one_to_many_set_property (GObject * object, guint property_id,
 
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
   switch (property_id) {
-    case PROP_MAIN_PORT:
+    case PROP_MAIN_PORT:{
+      gint old_main_port = self->priv->main_port;
+
       self->priv->main_port = g_value_get_int (value);
-      kms_dispatcher_one_to_many_change_main_port (self);
+      kms_dispatcher_one_to_many_change_main_port (self, old_main_port);
 
+      break;
+    }
+    case PROP_GOP_CACHE_SIZE:
+      g_atomic_int_set (&self->priv->gop_cache_size, g_value_get_uint (value));
+      kms_dispatcher_one_to_many_ensure_gop_caches (self);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -253,6 +637,12 @@ kms_dispatcher_one_to_many_get_property (GObject * object, guint property_id,
     case PROP_MAIN_PORT:
       g_value_set_int (value, self->priv->main_port);
       break;
+    case PROP_GOP_CACHE_SIZE:
+      g_value_set_uint (value, g_atomic_int_get (&self->priv->gop_cache_size));
+      break;
+    case PROP_LAST_SWITCH_DURATION:
+      g_value_set_uint64 (value, self->priv->last_switch_duration);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -267,6 +657,8 @@ kms_dispatcher_one_to_many_dispose (GObject * object)
 
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
   g_hash_table_remove_all (self->priv->ports);
+  kms_hub_drain_free (self->priv->drain);
+  self->priv->drain = NULL;
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 
   G_OBJECT_CLASS (kms_dispatcher_one_to_many_parent_class)->dispose (object);
@@ -318,6 +710,20 @@ kms_dispatcher_one_to_many_class_init (KmsDispatcherOneToManyClass * klass)
           "The selected main port, -1 indicates none.", -1, G_MAXINT,
           MAIN_PORT_NONE, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_GOP_CACHE_SIZE,
+      g_param_spec_uint ("gop-cache-size",
+          "GOP cache size",
+          "Maximum bytes of encoded video cached per source since its last "
+          "keyframe. They are replayed to newly linked sinks so they do not "
+          "wait for the next keyframe (0 = disabled)", 0, G_MAXUINT,
+          DEFAULT_GOP_CACHE_SIZE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LAST_SWITCH_DURATION,
+      g_param_spec_uint64 ("last-switch-duration",
+          "Last switch duration",
+          "Microseconds the sources were held while the sinks were relinked "
+          "to the last main port", 0, G_MAXUINT64, 0, G_PARAM_READABLE));
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsDispatcherOneToManyPrivate));
 }
@@ -331,7 +737,10 @@ kms_dispatcher_one_to_many_init (KmsDispatcherOneToMany * self)
   self->priv->ports = g_hash_table_new_full (g_int_hash, g_int_equal,
       release_gint, kms_dispatcher_one_to_many_port_data_destroy);
 
+  self->priv->drain = kms_hub_drain_new (KMS_BASE_HUB (self));
+
   self->priv->main_port = MAIN_PORT_NONE;
+  self->priv->gop_cache_size = DEFAULT_GOP_CACHE_SIZE;
 }
 
 gboolean
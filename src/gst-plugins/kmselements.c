@@ -19,12 +19,14 @@
 
 #include "kmshttpendpoint.h"
 #include "kmshttppostendpoint.h"
+#include "kmshttpgetendpoint.h"
 #include "kmsplayerendpoint.h"
 #include "kmsdispatcher.h"
 #include "kmsdispatcheronetomany.h"
 #include "kmsselectablemixer.h"
 #include "kmscompositemixer.h"
 #include "kmsalphablending.h"
+#include "kmsstripecompositor.h"
 
 static gboolean
 kurento_init (GstPlugin * kurento)
@@ -37,6 +39,10 @@ kurento_init (GstPlugin * kurento)
     return FALSE;
   }
 
+  if (!kms_http_get_endpoint_plugin_init (kurento)) {
+    return FALSE;
+  }
+
   if (!kms_player_endpoint_plugin_init (kurento)) {
     return FALSE;
   }
@@ -60,6 +66,10 @@ kurento_init (GstPlugin * kurento)
   if (!kms_alpha_blending_plugin_init (kurento))
     return FALSE;
 
+  if (!kms_stripe_compositor_plugin_init (kurento)) {
+    return FALSE;
+  }
+
   return TRUE;
 }
 
@@ -0,0 +1,645 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/pbutils/encoding-profile.h>
+#include <commons/kms-core-enumtypes.h>
+#include <commons/kmsrecordingprofile.h>
+
+#include "kmshttpgetendpoint.h"
+
+#define PLUGIN_NAME "httpgetendpoint"
+
+#define GET_PIPELINE "get-pipeline"
+
+GST_DEBUG_CATEGORY_STATIC (kms_http_get_endpoint_debug_category);
+#define GST_CAT_DEFAULT kms_http_get_endpoint_debug_category
+
+#define KMS_HTTP_GET_ENDPOINT_GET_PRIVATE(obj) (  \
+  G_TYPE_INSTANCE_GET_PRIVATE (                   \
+    (obj),                                        \
+    KMS_TYPE_HTTP_GET_ENDPOINT,                   \
+    KmsHttpGetEndpointPrivate                     \
+  )                                               \
+)
+
+#define DEFAULT_PROFILE KMS_RECORDING_PROFILE_WEBM
+#define DEFAULT_FRAGMENT_DURATION 1000  /* ms */
+
+struct _KmsHttpGetEndpointPrivate
+{
+  KmsRecordingProfile profile;
+  guint fragment_duration;
+
+  GstElement *video_appsink;
+  GstElement *audio_appsink;
+
+  /* Muxing pipeline sources, NULL while it is stopped */
+  GstElement *videosrc;
+  GstElement *audiosrc;
+
+  gboolean waiting_keyframe;
+  gboolean keyframe_requested;
+  GstClockTime first_ts;
+
+  /* Only used from the muxer's streaming thread */
+  gboolean media_started;
+};
+
+/* Object properties */
+enum
+{
+  PROP_0,
+  PROP_PROFILE,
+  PROP_FRAGMENT_DURATION,
+  PROP_CONTENT_TYPE,
+  N_PROPERTIES
+};
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
+/* Object signals */
+enum
+{
+  SIGNAL_NEW_CHUNK,
+  LAST_SIGNAL
+};
+
+static guint http_get_ep_signals[LAST_SIGNAL] = { 0 };
+
+G_DEFINE_TYPE_WITH_CODE (KmsHttpGetEndpoint, kms_http_get_endpoint,
+    KMS_TYPE_HTTP_ENDPOINT,
+    GST_DEBUG_CATEGORY_INIT (kms_http_get_endpoint_debug_category, PLUGIN_NAME,
+        0, "debug category for http get endpoint plugin"));
+
+static const gchar *
+kms_http_get_endpoint_get_content_type (KmsHttpGetEndpoint * self)
+{
+  switch (self->priv->profile) {
+    case KMS_RECORDING_PROFILE_WEBM:
+    case KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY:
+      return "video/webm";
+    case KMS_RECORDING_PROFILE_WEBM_AUDIO_ONLY:
+      return "audio/webm";
+    case KMS_RECORDING_PROFILE_MKV:
+    case KMS_RECORDING_PROFILE_MKV_VIDEO_ONLY:
+      return "video/x-matroska";
+    case KMS_RECORDING_PROFILE_MKV_AUDIO_ONLY:
+      return "audio/x-matroska";
+    case KMS_RECORDING_PROFILE_MP4:
+    case KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY:
+      return "video/mp4";
+    case KMS_RECORDING_PROFILE_MP4_AUDIO_ONLY:
+      return "audio/mp4";
+    default:
+      return NULL;
+  }
+}
+
+static GstElement *
+kms_http_get_endpoint_create_muxer (KmsHttpGetEndpoint * self)
+{
+  GstElement *mux;
+
+  switch (self->priv->profile) {
+    case KMS_RECORDING_PROFILE_WEBM:
+    case KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY:
+    case KMS_RECORDING_PROFILE_WEBM_AUDIO_ONLY:
+      mux = gst_element_factory_make ("webmmux", NULL);
+      g_object_set (mux, "streamable", TRUE, NULL);
+      return mux;
+    case KMS_RECORDING_PROFILE_MKV:
+    case KMS_RECORDING_PROFILE_MKV_VIDEO_ONLY:
+    case KMS_RECORDING_PROFILE_MKV_AUDIO_ONLY:
+      mux = gst_element_factory_make ("matroskamux", NULL);
+      g_object_set (mux, "streamable", TRUE, NULL);
+      return mux;
+    case KMS_RECORDING_PROFILE_MP4:
+    case KMS_RECORDING_PROFILE_MP4_VIDEO_ONLY:
+    case KMS_RECORDING_PROFILE_MP4_AUDIO_ONLY:
+      /* Fragmented mp4, moov is sent at the beginning */
+      mux = gst_element_factory_make ("mp4mux", NULL);
+      g_object_set (mux, "fragment-duration", self->priv->fragment_duration,
+          "streamable", TRUE, NULL);
+      return mux;
+    default:
+      GST_ERROR_OBJECT (self, "Profile %d can not be streamed",
+          self->priv->profile);
+      return NULL;
+  }
+}
+
+static GstCaps *
+kms_http_get_endpoint_get_caps_from_profile (KmsHttpGetEndpoint * self,
+    KmsElementPadType type)
+{
+  GstEncodingContainerProfile *cprof;
+  const GList *profiles, *l;
+  GstCaps *caps = NULL;
+
+  if (!kms_recording_profile_supports_type (self->priv->profile, type)) {
+    return NULL;
+  }
+
+  switch (type) {
+    case KMS_ELEMENT_PAD_TYPE_VIDEO:
+      cprof =
+          kms_recording_profile_create_profile (self->priv->profile, FALSE,
+          TRUE);
+      break;
+    case KMS_ELEMENT_PAD_TYPE_AUDIO:
+      cprof =
+          kms_recording_profile_create_profile (self->priv->profile, TRUE,
+          FALSE);
+      break;
+    default:
+      return NULL;
+  }
+
+  profiles = gst_encoding_container_profile_get_profiles (cprof);
+
+  for (l = profiles; l != NULL; l = l->next) {
+    GstEncodingProfile *prof = l->data;
+
+    if ((GST_IS_ENCODING_AUDIO_PROFILE (prof) &&
+            type == KMS_ELEMENT_PAD_TYPE_AUDIO) ||
+        (GST_IS_ENCODING_VIDEO_PROFILE (prof) &&
+            type == KMS_ELEMENT_PAD_TYPE_VIDEO)) {
+      caps = gst_encoding_profile_get_input_caps (prof);
+      break;
+    }
+  }
+
+  gst_encoding_profile_unref (cprof);
+  return caps;
+}
+
+static void
+kms_http_get_endpoint_update_caps (KmsHttpGetEndpoint * self)
+{
+  GstCaps *caps;
+
+  /* Agnosticbin encodes to the format the muxer is expecting */
+  caps = kms_http_get_endpoint_get_caps_from_profile (self,
+      KMS_ELEMENT_PAD_TYPE_VIDEO);
+  g_object_set (self->priv->video_appsink, "caps", caps, NULL);
+  if (caps != NULL) {
+    gst_caps_unref (caps);
+  }
+
+  caps = kms_http_get_endpoint_get_caps_from_profile (self,
+      KMS_ELEMENT_PAD_TYPE_AUDIO);
+  g_object_set (self->priv->audio_appsink, "caps", caps, NULL);
+  if (caps != NULL) {
+    gst_caps_unref (caps);
+  }
+}
+
+static void
+kms_http_get_endpoint_request_keyframe (KmsHttpGetEndpoint * self)
+{
+  GstStructure *s;
+  GstPad *pad;
+
+  GST_DEBUG_OBJECT (self, "Requesting keyframe");
+
+  s = gst_structure_new ("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN,
+      TRUE, NULL);
+  pad = gst_element_get_static_pad (self->priv->video_appsink, "sink");
+  gst_pad_push_event (pad, gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, s));
+  g_object_unref (pad);
+}
+
+static GstFlowReturn
+kms_http_get_endpoint_recv_sample (GstAppSink * appsink, gpointer user_data)
+{
+  KmsHttpGetEndpoint *self = KMS_HTTP_GET_ENDPOINT (user_data);
+  gboolean is_video = GST_ELEMENT (appsink) == self->priv->video_appsink;
+  gboolean request_keyframe = FALSE;
+  GstElement *appsrc = NULL;
+  GstClockTime offset;
+  GstCaps *caps, *current;
+  GstSample *sample;
+  GstBuffer *buffer;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL) {
+    return GST_FLOW_OK;
+  }
+
+  buffer = gst_sample_get_buffer (sample);
+  if (buffer == NULL) {
+    goto end;
+  }
+
+  KMS_ELEMENT_LOCK (self);
+
+  if (is_video) {
+    appsrc = self->priv->videosrc;
+  } else {
+    appsrc = self->priv->audiosrc;
+  }
+
+  if (appsrc == NULL) {
+    /* Nobody is connected or the profile does not use this media */
+    KMS_ELEMENT_UNLOCK (self);
+    goto end;
+  }
+
+  if (self->priv->waiting_keyframe) {
+    if (!is_video || GST_BUFFER_FLAG_IS_SET (buffer,
+            GST_BUFFER_FLAG_DELTA_UNIT)) {
+      /* Stream has to begin with a keyframe so clients can decode it */
+      request_keyframe = is_video && !self->priv->keyframe_requested;
+      self->priv->keyframe_requested = TRUE;
+      KMS_ELEMENT_UNLOCK (self);
+
+      if (request_keyframe) {
+        kms_http_get_endpoint_request_keyframe (self);
+      }
+
+      goto end;
+    }
+
+    self->priv->waiting_keyframe = FALSE;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->priv->first_ts)) {
+    self->priv->first_ts = GST_BUFFER_PTS_IS_VALID (buffer) ?
+        GST_BUFFER_PTS (buffer) : 0;
+  }
+
+  offset = self->priv->first_ts;
+  gst_object_ref (appsrc);
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  caps = gst_sample_get_caps (sample);
+  current = gst_app_src_get_caps (GST_APP_SRC (appsrc));
+
+  if (caps != NULL && (current == NULL || !gst_caps_is_equal (caps, current))) {
+    GST_DEBUG_OBJECT (appsrc, "Setting caps %" GST_PTR_FORMAT, caps);
+    gst_app_src_set_caps (GST_APP_SRC (appsrc), caps);
+  }
+
+  if (current != NULL) {
+    gst_caps_unref (current);
+  }
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer) && GST_BUFFER_PTS (buffer) < offset) {
+    /* Sent before the muxer was started */
+    gst_object_unref (appsrc);
+    goto end;
+  }
+
+  /* Muxer timeline starts when the first client connects */
+  buffer = gst_buffer_make_writable (gst_buffer_ref (buffer));
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    buffer->pts -= offset;
+  }
+
+  if (GST_BUFFER_DTS_IS_VALID (buffer)) {
+    buffer->dts = buffer->dts > offset ? buffer->dts - offset : 0;
+  }
+
+  /* Errors in the muxer must not stop the main pipeline */
+  if (gst_app_src_push_buffer (GST_APP_SRC (appsrc), buffer) != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "Buffer not accepted by %" GST_PTR_FORMAT, appsrc);
+  }
+
+  gst_object_unref (appsrc);
+
+end:
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+kms_http_get_endpoint_new_chunk (GstAppSink * appsink, gpointer user_data)
+{
+  KmsHttpGetEndpoint *self = KMS_HTTP_GET_ENDPOINT (user_data);
+  GstSample *sample;
+  GstBuffer *buffer;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL) {
+    return GST_FLOW_OK;
+  }
+
+  buffer = gst_sample_get_buffer (sample);
+  if (buffer == NULL) {
+    goto end;
+  }
+
+  gst_buffer_ref (buffer);
+
+  if (!self->priv->media_started &&
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER)) {
+    if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+      self->priv->media_started = TRUE;
+    } else {
+      /* Untimestamped data before the first frame is part of the header */
+      buffer = gst_buffer_make_writable (buffer);
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_HEADER);
+    }
+  }
+
+  g_signal_emit (self, http_get_ep_signals[SIGNAL_NEW_CHUNK], 0, buffer);
+  gst_buffer_unref (buffer);
+
+end:
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstElement *
+kms_http_get_endpoint_add_appsrc (KmsHttpGetEndpoint * self,
+    GstElement * pipeline, GstElement * mux, const gchar * pad_name)
+{
+  GstElement *appsrc;
+
+  appsrc = gst_element_factory_make ("appsrc", NULL);
+  g_object_set (appsrc, "is-live", TRUE, "do-timestamp", FALSE,
+      "min-latency", G_GUINT64_CONSTANT (0), "max-latency",
+      G_GUINT64_CONSTANT (0), "format", GST_FORMAT_TIME, "block", FALSE, NULL);
+
+  gst_bin_add (GST_BIN (pipeline), appsrc);
+
+  if (!gst_element_link_pads (appsrc, "src", mux, pad_name)) {
+    GST_ERROR_OBJECT (self, "Could not link %" GST_PTR_FORMAT " to %"
+        GST_PTR_FORMAT, appsrc, mux);
+  }
+
+  return appsrc;
+}
+
+static void
+kms_http_get_endpoint_init_pipeline (KmsHttpGetEndpoint * self)
+{
+  GstAppSinkCallbacks callbacks = { NULL };
+  GstElement *pipeline, *mux, *sink;
+  GstElement *videosrc = NULL, *audiosrc = NULL;
+  KmsRecordingProfile profile;
+
+  KMS_ELEMENT_LOCK (self);
+  profile = self->priv->profile;
+  mux = kms_http_get_endpoint_create_muxer (self);
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (mux == NULL) {
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION,
+        ("No muxer available for profile %d", profile), (NULL));
+    return;
+  }
+
+  pipeline = gst_pipeline_new (GET_PIPELINE);
+
+  sink = gst_element_factory_make ("appsink", NULL);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, "emit-signals", FALSE,
+      "enable-last-sample", FALSE, "qos", FALSE, NULL);
+
+  callbacks.new_sample = kms_http_get_endpoint_new_chunk;
+  gst_app_sink_set_callbacks (GST_APP_SINK (sink), &callbacks, self, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), mux, sink, NULL);
+  gst_element_link (mux, sink);
+
+  if (kms_recording_profile_supports_type (profile,
+          KMS_ELEMENT_PAD_TYPE_VIDEO)) {
+    videosrc =
+        kms_http_get_endpoint_add_appsrc (self, pipeline, mux, "video_%u");
+  }
+
+  if (kms_recording_profile_supports_type (profile,
+          KMS_ELEMENT_PAD_TYPE_AUDIO)) {
+    audiosrc =
+        kms_http_get_endpoint_add_appsrc (self, pipeline, mux, "audio_%u");
+  }
+
+  /* Samples are only pushed once the sources are published */
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  KMS_ELEMENT_LOCK (self);
+  KMS_HTTP_ENDPOINT (self)->pipeline = pipeline;
+  self->priv->videosrc = videosrc;
+  self->priv->audiosrc = audiosrc;
+  self->priv->waiting_keyframe = videosrc != NULL;
+  self->priv->keyframe_requested = FALSE;
+  self->priv->first_ts = GST_CLOCK_TIME_NONE;
+  self->priv->media_started = FALSE;
+  KMS_ELEMENT_UNLOCK (self);
+}
+
+/* Must be called without the lock held, recv_sample takes it while the
+ * pipeline is being stopped */
+static void
+kms_http_get_endpoint_release_pipeline (KmsHttpGetEndpoint * self)
+{
+  GstElement *pipeline;
+
+  KMS_ELEMENT_LOCK (self);
+  pipeline = KMS_HTTP_ENDPOINT (self)->pipeline;
+  self->priv->videosrc = NULL;
+  self->priv->audiosrc = NULL;
+  KMS_HTTP_ENDPOINT (self)->pipeline = NULL;
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (pipeline == NULL) {
+    return;
+  }
+
+  /* recv_sample keeps its own reference to the source it is pushing to */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+static void
+kms_http_get_endpoint_start (KmsHttpEndpoint * obj, gboolean start)
+{
+  KmsHttpGetEndpoint *self = KMS_HTTP_GET_ENDPOINT (obj);
+
+  GST_DEBUG_OBJECT (self, "%s muxing", start ? "Start" : "Stop");
+
+  KMS_ELEMENT_LOCK (self);
+  obj->start = start;
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (start) {
+    kms_http_get_endpoint_init_pipeline (self);
+  } else {
+    kms_http_get_endpoint_release_pipeline (self);
+  }
+}
+
+static GstElement *
+kms_http_get_endpoint_add_appsink (KmsHttpGetEndpoint * self,
+    KmsElementPadType type)
+{
+  GstAppSinkCallbacks callbacks = { NULL };
+  GstElement *appsink;
+  GstPad *sinkpad;
+
+  appsink = gst_element_factory_make ("appsink", NULL);
+  g_object_set (appsink, "emit-signals", FALSE, "async", FALSE,
+      "sync", FALSE, "qos", FALSE, "enable-last-sample", FALSE, NULL);
+
+  callbacks.new_sample = kms_http_get_endpoint_recv_sample;
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, self, NULL);
+
+  gst_bin_add (GST_BIN (self), appsink);
+
+  sinkpad = gst_element_get_static_pad (appsink, "sink");
+  kms_element_connect_sink_target_full (KMS_ELEMENT (self), sinkpad, type,
+      NULL, NULL, NULL);
+  g_object_unref (sinkpad);
+
+  gst_element_sync_state_with_parent (appsink);
+
+  return appsink;
+}
+
+static void
+kms_http_get_endpoint_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsHttpGetEndpoint *self = KMS_HTTP_GET_ENDPOINT (object);
+
+  KMS_ELEMENT_LOCK (KMS_ELEMENT (self));
+  switch (property_id) {
+    case PROP_PROFILE:
+      self->priv->profile = g_value_get_enum (value);
+      kms_http_get_endpoint_update_caps (self);
+      break;
+    case PROP_FRAGMENT_DURATION:
+      self->priv->fragment_duration = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  KMS_ELEMENT_UNLOCK (KMS_ELEMENT (self));
+}
+
+static void
+kms_http_get_endpoint_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsHttpGetEndpoint *self = KMS_HTTP_GET_ENDPOINT (object);
+
+  KMS_ELEMENT_LOCK (KMS_ELEMENT (self));
+  switch (property_id) {
+    case PROP_PROFILE:
+      g_value_set_enum (value, self->priv->profile);
+      break;
+    case PROP_FRAGMENT_DURATION:
+      g_value_set_uint (value, self->priv->fragment_duration);
+      break;
+    case PROP_CONTENT_TYPE:
+      g_value_set_string (value,
+          kms_http_get_endpoint_get_content_type (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  KMS_ELEMENT_UNLOCK (KMS_ELEMENT (self));
+}
+
+static void
+kms_http_get_endpoint_dispose (GObject * object)
+{
+  KmsHttpGetEndpoint *self = KMS_HTTP_GET_ENDPOINT (object);
+
+  kms_http_get_endpoint_release_pipeline (self);
+
+  G_OBJECT_CLASS (kms_http_get_endpoint_parent_class)->dispose (object);
+}
+
+static void
+kms_http_get_endpoint_class_init (KmsHttpGetEndpointClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  KmsHttpEndpointClass *http_class = KMS_HTTP_ENDPOINT_CLASS (klass);
+
+  gobject_class->set_property = kms_http_get_endpoint_set_property;
+  gobject_class->get_property = kms_http_get_endpoint_get_property;
+  gobject_class->dispose = kms_http_get_endpoint_dispose;
+
+  http_class->start = GST_DEBUG_FUNCPTR (kms_http_get_endpoint_start);
+
+  /* Install properties */
+  obj_properties[PROP_PROFILE] = g_param_spec_enum ("profile",
+      "Streaming profile",
+      "Container and codecs of the media served to the clients",
+      KMS_TYPE_RECORDING_PROFILE, DEFAULT_PROFILE,
+      G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY);
+
+  obj_properties[PROP_FRAGMENT_DURATION] =
+      g_param_spec_uint ("fragment-duration", "Fragment duration",
+      "Duration of each fragment in milliseconds, only used by mp4 profiles",
+      1, G_MAXUINT, DEFAULT_FRAGMENT_DURATION,
+      G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY);
+
+  obj_properties[PROP_CONTENT_TYPE] = g_param_spec_string ("content-type",
+      "Content type", "Content type of the served media", NULL,
+      G_PARAM_READABLE);
+
+  g_object_class_install_properties (gobject_class,
+      N_PROPERTIES, obj_properties);
+
+  /* set signals */
+  http_get_ep_signals[SIGNAL_NEW_CHUNK] =
+      g_signal_new ("new-chunk", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (KmsHttpGetEndpointClass, new_chunk),
+      NULL, NULL, g_cclosure_marshal_VOID__BOXED, G_TYPE_NONE, 1,
+      GST_TYPE_BUFFER | G_SIGNAL_TYPE_STATIC_SCOPE);
+
+  g_type_class_add_private (klass, sizeof (KmsHttpGetEndpointPrivate));
+}
+
+static void
+kms_http_get_endpoint_init (KmsHttpGetEndpoint * self)
+{
+  self->priv = KMS_HTTP_GET_ENDPOINT_GET_PRIVATE (self);
+  KMS_HTTP_ENDPOINT (self)->method = KMS_HTTP_ENDPOINT_METHOD_GET;
+
+  self->priv->profile = DEFAULT_PROFILE;
+  self->priv->fragment_duration = DEFAULT_FRAGMENT_DURATION;
+  self->priv->first_ts = GST_CLOCK_TIME_NONE;
+
+  self->priv->video_appsink =
+      kms_http_get_endpoint_add_appsink (self, KMS_ELEMENT_PAD_TYPE_VIDEO);
+  self->priv->audio_appsink =
+      kms_http_get_endpoint_add_appsink (self, KMS_ELEMENT_PAD_TYPE_AUDIO);
+
+  kms_http_get_endpoint_update_caps (self);
+}
+
+gboolean
+kms_http_get_endpoint_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_HTTP_GET_ENDPOINT);
+}
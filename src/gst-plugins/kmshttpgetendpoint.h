@@ -0,0 +1,76 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_HTTP_GET_ENDPOINT_H_
+#define _KMS_HTTP_GET_ENDPOINT_H_
+
+#include "kmshttpendpoint.h"
+
+G_BEGIN_DECLS
+#define KMS_TYPE_HTTP_GET_ENDPOINT \
+  (kms_http_get_endpoint_get_type())
+#define KMS_HTTP_GET_ENDPOINT(obj) (        \
+  G_TYPE_CHECK_INSTANCE_CAST(               \
+    (obj),                                  \
+    KMS_TYPE_HTTP_GET_ENDPOINT,             \
+    KmsHttpGetEndpoint                      \
+  )                                         \
+)
+#define KMS_HTTP_GET_ENDPOINT_CLASS(klass) (    \
+  G_TYPE_CHECK_CLASS_CAST (                     \
+    (klass),                                    \
+    KMS_TYPE_HTTP_GET_ENDPOINT,                 \
+    KmsHttpGetEndpointClass                     \
+  )                                             \
+)
+#define KMS_IS_HTTP_GET_ENDPOINT(obj) (         \
+  G_TYPE_CHECK_INSTANCE_TYPE (                  \
+    (obj),                                      \
+    KMS_TYPE_HTTP_GET_ENDPOINT                  \
+  )                                             \
+)
+#define KMS_IS_HTTP_GET_ENDPOINT_CLASS(klass) (   \
+  G_TYPE_CHECK_CLASS_TYPE(                        \
+    (klass),                                      \
+    KMS_TYPE_HTTP_GET_ENDPOINT                    \
+  )                                               \
+)
+typedef struct _KmsHttpGetEndpoint KmsHttpGetEndpoint;
+typedef struct _KmsHttpGetEndpointClass KmsHttpGetEndpointClass;
+typedef struct _KmsHttpGetEndpointPrivate KmsHttpGetEndpointPrivate;
+
+struct _KmsHttpGetEndpoint
+{
+  KmsHttpEndpoint parent;
+
+  /*< private > */
+  KmsHttpGetEndpointPrivate *priv;
+};
+
+struct _KmsHttpGetEndpointClass
+{
+  KmsHttpEndpointClass parent_class;
+
+  /* signals */
+  void (*new_chunk) (KmsHttpGetEndpoint * self, GstBuffer * buffer);
+};
+
+GType kms_http_get_endpoint_get_type (void);
+
+gboolean kms_http_get_endpoint_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* _KMS_HTTP_GET_ENDPOINT_H_ */
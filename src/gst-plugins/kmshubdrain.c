@@ -0,0 +1,408 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmshubdrain.h"
+
+#define GST_CAT_DEFAULT kms_hub_drain_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define DRAIN_PAD_NAME "sink_%u"
+
+struct _KmsHubDrain
+{
+  KmsBaseHub *hub;              /* Not owned, the drain lives in the hub */
+  GMutex mutex;
+
+  GstElement *funnel;
+  GstElement *fakesink;
+
+  guint n_audio;
+  guint n_video;
+};
+
+typedef struct _KmsHubDrainSwitch
+{
+  KmsHubDrain *drain;
+  gint id;
+  KmsElementPadType type;
+  GstElement *element;
+  gchar *pad_name;
+  GstPad *drain_pad;
+} KmsHubDrainSwitch;
+
+typedef struct _KmsHubDrainFirstData
+{
+  KmsHubDrain *drain;
+  gint id;
+  KmsElementPadType type;
+  KmsHubDrainFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsHubDrainFirstData;
+
+static void
+kms_hub_drain_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "hubdrain", 0,
+        "Shared sink for idle hub ports");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+KmsHubDrain *
+kms_hub_drain_new (KmsBaseHub * hub)
+{
+  KmsHubDrain *drain;
+
+  kms_hub_drain_init ();
+
+  drain = g_slice_new0 (KmsHubDrain);
+  drain->hub = hub;
+  g_mutex_init (&drain->mutex);
+
+  return drain;
+}
+
+void
+kms_hub_drain_free (KmsHubDrain * drain)
+{
+  if (drain == NULL) {
+    return;
+  }
+
+  if (drain->funnel != NULL) {
+    gst_bin_remove_many (GST_BIN (drain->hub), drain->funnel, drain->fakesink,
+        NULL);
+    gst_element_set_state (drain->funnel, GST_STATE_NULL);
+    gst_element_set_state (drain->fakesink, GST_STATE_NULL);
+    g_clear_object (&drain->funnel);
+    g_clear_object (&drain->fakesink);
+  }
+
+  g_mutex_clear (&drain->mutex);
+  g_slice_free (KmsHubDrain, drain);
+}
+
+/* Must be called with the mutex held */
+static gboolean
+kms_hub_drain_create_elements (KmsHubDrain * drain)
+{
+  if (drain->funnel != NULL) {
+    return TRUE;
+  }
+
+  drain->funnel = gst_element_factory_make ("funnel", NULL);
+  drain->fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  if (drain->funnel == NULL || drain->fakesink == NULL) {
+    GST_ERROR_OBJECT (drain->hub, "Can not create drain elements");
+    g_clear_object (&drain->funnel);
+    g_clear_object (&drain->fakesink);
+    return FALSE;
+  }
+
+  /* Streams of different ports must not make it renegotiate on each buffer */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (drain->funnel),
+          "forward-sticky-events") != NULL) {
+    g_object_set (drain->funnel, "forward-sticky-events", FALSE, NULL);
+  }
+
+  g_object_set (drain->fakesink, "async", FALSE, "sync", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (drain->hub), g_object_ref (drain->funnel),
+      g_object_ref (drain->fakesink), NULL);
+  gst_element_link (drain->funnel, drain->fakesink);
+  gst_element_sync_state_with_parent (drain->fakesink);
+  gst_element_sync_state_with_parent (drain->funnel);
+
+  return TRUE;
+}
+
+static gchar *
+kms_hub_drain_pad_name (gint id, KmsElementPadType type)
+{
+  /* Audio and video of a port get consecutive pads */
+  return g_strdup_printf (DRAIN_PAD_NAME,
+      id * 2 + (type == KMS_ELEMENT_PAD_TYPE_VIDEO ? 1 : 0));
+}
+
+static guint *
+kms_hub_drain_counter (KmsHubDrain * drain, KmsElementPadType type)
+{
+  return type == KMS_ELEMENT_PAD_TYPE_VIDEO ? &drain->n_video : &drain->n_audio;
+}
+
+static GstPadProbeReturn
+kms_hub_drain_first_data_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsHubDrainFirstData *data = user_data;
+
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) !=
+      GST_EVENT_STREAM_START) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  GST_DEBUG_OBJECT (data->drain->hub, "First stream of port %d", data->id);
+  data->func (data->drain, data->id, data->type, data->user_data);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+kms_hub_drain_first_data_destroy (KmsHubDrainFirstData * data)
+{
+  if (data->notify != NULL) {
+    data->notify (data->user_data);
+  }
+
+  g_slice_free (KmsHubDrainFirstData, data);
+}
+
+gboolean
+kms_hub_drain_link_full (KmsHubDrain * drain, gint id, KmsElementPadType type,
+    KmsHubDrainFunc func, gpointer user_data, GDestroyNotify notify)
+{
+  gboolean ret = FALSE;
+  GstPad *pad = NULL;
+  gchar *name;
+
+  g_return_val_if_fail (type == KMS_ELEMENT_PAD_TYPE_AUDIO ||
+      type == KMS_ELEMENT_PAD_TYPE_VIDEO, FALSE);
+
+  name = kms_hub_drain_pad_name (id, type);
+
+  g_mutex_lock (&drain->mutex);
+
+  if (kms_hub_drain_create_elements (drain)) {
+    pad = gst_element_get_request_pad (drain->funnel, name);
+  }
+
+  g_mutex_unlock (&drain->mutex);
+
+  if (pad == NULL) {
+    GST_ERROR_OBJECT (drain->hub, "Can not get drain pad for port %d", id);
+    goto end;
+  }
+
+  if (func != NULL) {
+    KmsHubDrainFirstData *data = g_slice_new0 (KmsHubDrainFirstData);
+
+    data->drain = drain;
+    data->id = id;
+    data->type = type;
+    data->func = func;
+    data->user_data = user_data;
+    data->notify = notify;
+    notify = NULL;
+
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        kms_hub_drain_first_data_probe, data,
+        (GDestroyNotify) kms_hub_drain_first_data_destroy);
+  }
+
+  /* The hub lock is taken here, do not hold the drain one */
+  if (type == KMS_ELEMENT_PAD_TYPE_VIDEO) {
+    ret = kms_base_hub_link_video_sink (drain->hub, id, drain->funnel, name,
+        FALSE);
+  } else {
+    ret = kms_base_hub_link_audio_sink (drain->hub, id, drain->funnel, name,
+        FALSE);
+  }
+
+  g_mutex_lock (&drain->mutex);
+
+  if (ret) {
+    (*kms_hub_drain_counter (drain, type))++;
+  } else {
+    GST_ERROR_OBJECT (drain->hub, "Can not link port %d to the drain", id);
+    gst_element_release_request_pad (drain->funnel, pad);
+  }
+
+  g_mutex_unlock (&drain->mutex);
+
+  g_object_unref (pad);
+
+end:
+  if (notify != NULL) {
+    notify (user_data);
+  }
+
+  g_free (name);
+
+  return ret;
+}
+
+gboolean
+kms_hub_drain_link (KmsHubDrain * drain, gint id, KmsElementPadType type)
+{
+  return kms_hub_drain_link_full (drain, id, type, NULL, NULL, NULL);
+}
+
+/* Must be called with the mutex held. Returns the drain pad of the port, if
+ * it is still linked to the drain */
+static GstPad *
+kms_hub_drain_get_pad (KmsHubDrain * drain, gint id, KmsElementPadType type)
+{
+  GstPad *pad;
+  gchar *name;
+
+  if (drain->funnel == NULL) {
+    return NULL;
+  }
+
+  name = kms_hub_drain_pad_name (id, type);
+  pad = gst_element_get_static_pad (drain->funnel, name);
+  g_free (name);
+
+  return pad;
+}
+
+void
+kms_hub_drain_unlink (KmsHubDrain * drain, gint id, KmsElementPadType type)
+{
+  GstPad *pad;
+
+  g_mutex_lock (&drain->mutex);
+
+  pad = kms_hub_drain_get_pad (drain, id, type);
+
+  if (pad != NULL) {
+    gst_element_release_request_pad (drain->funnel, pad);
+    g_object_unref (pad);
+    (*kms_hub_drain_counter (drain, type))--;
+  }
+
+  g_mutex_unlock (&drain->mutex);
+}
+
+static void
+kms_hub_drain_switch_destroy (KmsHubDrainSwitch * sw)
+{
+  g_object_unref (sw->element);
+  g_object_unref (sw->drain_pad);
+  g_free (sw->pad_name);
+
+  g_slice_free (KmsHubDrainSwitch, sw);
+}
+
+static GstPadProbeReturn
+kms_hub_drain_switch_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsHubDrainSwitch *sw = user_data;
+  KmsHubDrain *drain = sw->drain;
+  gboolean linked;
+
+  g_mutex_lock (&drain->mutex);
+  linked = GST_PAD_PARENT (sw->drain_pad) != NULL;
+  g_mutex_unlock (&drain->mutex);
+
+  if (!linked) {
+    GST_DEBUG_OBJECT (drain->hub, "Port %d unlinked before switching", sw->id);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  /* Nothing is being pushed to the drain, relinking now loses no data */
+  if (sw->type == KMS_ELEMENT_PAD_TYPE_VIDEO) {
+    linked = kms_base_hub_link_video_sink (drain->hub, sw->id, sw->element,
+        sw->pad_name, FALSE);
+  } else {
+    linked = kms_base_hub_link_audio_sink (drain->hub, sw->id, sw->element,
+        sw->pad_name, FALSE);
+  }
+
+  if (!linked) {
+    GST_ERROR_OBJECT (drain->hub, "Can not link port %d to %" GST_PTR_FORMAT,
+        sw->id, sw->element);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  g_mutex_lock (&drain->mutex);
+
+  if (GST_PAD_PARENT (sw->drain_pad) != NULL) {
+    gst_element_release_request_pad (drain->funnel, sw->drain_pad);
+    (*kms_hub_drain_counter (drain, sw->type))--;
+  }
+
+  g_mutex_unlock (&drain->mutex);
+
+  GST_DEBUG_OBJECT (drain->hub, "Port %d switched to %" GST_PTR_FORMAT,
+      sw->id, sw->element);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+gboolean
+kms_hub_drain_switch (KmsHubDrain * drain, gint id, KmsElementPadType type,
+    GstElement * element, const gchar * pad_name)
+{
+  KmsHubDrainSwitch *sw;
+  GstPad *pad, *peer;
+
+  g_mutex_lock (&drain->mutex);
+
+  pad = kms_hub_drain_get_pad (drain, id, type);
+
+  g_mutex_unlock (&drain->mutex);
+
+  if (pad == NULL) {
+    return FALSE;
+  }
+
+  peer = gst_pad_get_peer (pad);
+
+  if (peer == NULL) {
+    g_object_unref (pad);
+    return FALSE;
+  }
+
+  sw = g_slice_new0 (KmsHubDrainSwitch);
+  sw->drain = drain;
+  sw->id = id;
+  sw->type = type;
+  sw->element = g_object_ref (element);
+  sw->pad_name = g_strdup (pad_name);
+  sw->drain_pad = pad;
+
+  /* The peer is the pad pushing the input of the port into the hub, data
+   * can not find it unlinked while an idle probe runs on it */
+  gst_pad_add_probe (peer, GST_PAD_PROBE_TYPE_IDLE,
+      kms_hub_drain_switch_probe, sw,
+      (GDestroyNotify) kms_hub_drain_switch_destroy);
+  g_object_unref (peer);
+
+  return TRUE;
+}
+
+guint
+kms_hub_drain_get_n_linked (KmsHubDrain * drain, KmsElementPadType type)
+{
+  guint n;
+
+  g_mutex_lock (&drain->mutex);
+  n = *kms_hub_drain_counter (drain, type);
+  g_mutex_unlock (&drain->mutex);
+
+  return n;
+}
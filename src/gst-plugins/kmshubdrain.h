@@ -0,0 +1,66 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_HUB_DRAIN_H_
+#define _KMS_HUB_DRAIN_H_
+
+#include <commons/kmsbasehub.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Shared sink for the audio and video that hub ports send before the hub
+ * needs them.
+ *
+ * Instead of building the elements that handle the input of a port as soon
+ * as it is handled, hubs link it to the drain, which costs one pad, and build
+ * them on first use. The drain itself is one funnel and one fakesink per hub,
+ * created along with the first port linked to it.
+ */
+typedef struct _KmsHubDrain KmsHubDrain;
+
+/* Called from the streaming thread when the first stream-start of a port
+ * reaches the drain */
+typedef void (*KmsHubDrainFunc) (KmsHubDrain * drain, gint id,
+    KmsElementPadType type, gpointer user_data);
+
+KmsHubDrain *kms_hub_drain_new (KmsBaseHub * hub);
+void kms_hub_drain_free (KmsHubDrain * drain);
+
+/* Only audio and video are supported */
+gboolean kms_hub_drain_link (KmsHubDrain * drain, gint id,
+    KmsElementPadType type);
+gboolean kms_hub_drain_link_full (KmsHubDrain * drain, gint id,
+    KmsElementPadType type, KmsHubDrainFunc func, gpointer user_data,
+    GDestroyNotify notify);
+
+/* Releases the drain pad of a port that is being removed, if it was not
+ * switched to its own branch */
+void kms_hub_drain_unlink (KmsHubDrain * drain, gint id,
+    KmsElementPadType type);
+
+/* Moves the input of port @id from the drain to @pad_name of @element. It is
+ * done while no data is being pushed, so the port is never found unlinked;
+ * that may happen after returning, from the streaming thread. Returns FALSE
+ * if the port was not linked to the drain */
+gboolean kms_hub_drain_switch (KmsHubDrain * drain, gint id,
+    KmsElementPadType type, GstElement * element, const gchar * pad_name);
+
+/* Number of ports whose input of @type still goes to the drain */
+guint kms_hub_drain_get_n_linked (KmsHubDrain * drain, KmsElementPadType type);
+
+G_END_DECLS
+#endif /* _KMS_HUB_DRAIN_H_ */
@@ -0,0 +1,177 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmskeyframeindex.h"
+
+#define GST_CAT_DEFAULT kms_keyframe_index_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+/* Bounds the memory used: ~512 KiB per URI, URIs evicted oldest first */
+#define MAX_KEYFRAMES_PER_URI 65536
+#define MAX_URIS 128
+
+typedef struct _KmsKeyframe
+{
+  GstClockTime ts;
+  /* Next keyframe, once playback went through it without a gap. Until then
+   * there may be other keyframes after this one that are not indexed yet */
+  GstClockTime next;
+} KmsKeyframe;
+
+static GMutex mutex;
+static GHashTable *indexes = NULL;      /* <gchar *, GArray<KmsKeyframe>> */
+static GQueue uris = G_QUEUE_INIT;      /* Insertion order, for eviction */
+
+static void
+kms_keyframe_index_init (void)
+{
+  if (indexes != NULL) {
+    return;
+  }
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "keyframeindex", 0,
+      "Shared keyframe index");
+
+  indexes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_array_unref);
+}
+
+/* Returns the position of the first keyframe after @ts */
+static guint
+kms_keyframe_index_upper_bound (GArray * index, GstClockTime ts)
+{
+  guint low = 0, high = index->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+
+    if (g_array_index (index, KmsKeyframe, mid).ts <= ts) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+void
+kms_keyframe_index_add (const gchar * uri, GstClockTime stream_time,
+    GstClockTime previous)
+{
+  KmsKeyframe keyframe;
+  GArray *index;
+  guint pos;
+
+  if (uri == NULL || !GST_CLOCK_TIME_IS_VALID (stream_time)) {
+    return;
+  }
+
+  g_mutex_lock (&mutex);
+
+  kms_keyframe_index_init ();
+
+  index = g_hash_table_lookup (indexes, uri);
+
+  if (index == NULL) {
+    gchar *key = g_strdup (uri);
+
+    if (g_queue_get_length (&uris) >= MAX_URIS) {
+      gchar *oldest = g_queue_pop_head (&uris);
+
+      GST_DEBUG ("Evicting keyframe index of %s", oldest);
+      g_hash_table_remove (indexes, oldest);
+    }
+
+    index = g_array_new (FALSE, FALSE, sizeof (KmsKeyframe));
+    g_hash_table_insert (indexes, key, index);
+    g_queue_push_tail (&uris, key);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (previous) && previous < stream_time) {
+    pos = kms_keyframe_index_upper_bound (index, previous);
+
+    if (pos > 0 && g_array_index (index, KmsKeyframe, pos - 1).ts == previous) {
+      g_array_index (index, KmsKeyframe, pos - 1).next = stream_time;
+    }
+  }
+
+  pos = kms_keyframe_index_upper_bound (index, stream_time);
+
+  if (pos > 0 && g_array_index (index, KmsKeyframe, pos - 1).ts == stream_time) {
+    /* Already known */
+    goto end;
+  }
+
+  if (index->len >= MAX_KEYFRAMES_PER_URI) {
+    goto end;
+  }
+
+  keyframe.ts = stream_time;
+  keyframe.next = GST_CLOCK_TIME_NONE;
+  g_array_insert_val (index, pos, keyframe);
+
+  GST_LOG ("Keyframe at %" GST_TIME_FORMAT " indexed for %s (%u keyframes)",
+      GST_TIME_ARGS (stream_time), uri, index->len);
+
+end:
+  g_mutex_unlock (&mutex);
+}
+
+gboolean
+kms_keyframe_index_lookup (const gchar * uri, GstClockTime position,
+    GstClockTime * keyframe)
+{
+  gboolean found = FALSE;
+  GArray *index;
+  guint pos;
+
+  if (uri == NULL || !GST_CLOCK_TIME_IS_VALID (position)) {
+    return FALSE;
+  }
+
+  g_mutex_lock (&mutex);
+
+  if (indexes == NULL) {
+    goto end;
+  }
+
+  index = g_hash_table_lookup (indexes, uri);
+  if (index == NULL) {
+    goto end;
+  }
+
+  pos = kms_keyframe_index_upper_bound (index, position);
+  if (pos > 0) {
+    KmsKeyframe *k = &g_array_index (index, KmsKeyframe, pos - 1);
+
+    /* Only trust it if there is no unknown keyframe in between */
+    if (k->ts == position || (GST_CLOCK_TIME_IS_VALID (k->next)
+            && position < k->next)) {
+      *keyframe = k->ts;
+      found = TRUE;
+    }
+  }
+
+end:
+  g_mutex_unlock (&mutex);
+
+  return found;
+}
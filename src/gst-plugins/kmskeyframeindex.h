@@ -0,0 +1,41 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_KEYFRAME_INDEX_H__
+#define __KMS_KEYFRAME_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Process wide index of the video keyframes seen so far in each URI. It is
+ * filled while media is played, so every player of the same asset benefits
+ * from what the others have already decoded.
+ */
+
+/* @previous is the keyframe that preceded this one in the same uninterrupted
+ * playback, GST_CLOCK_TIME_NONE if unknown */
+void kms_keyframe_index_add (const gchar * uri, GstClockTime stream_time,
+    GstClockTime previous);
+
+/* Gets the keyframe at or before @position, only if it is known that there
+ * is no other keyframe between them */
+gboolean kms_keyframe_index_lookup (const gchar * uri, GstClockTime position,
+    GstClockTime * keyframe);
+
+G_END_DECLS
+#endif /* __KMS_KEYFRAME_INDEX_H__ */
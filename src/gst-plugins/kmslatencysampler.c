@@ -0,0 +1,315 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmslatencysampler.h"
+#include <commons/kmsutils.h>
+
+/* Values are stored in microseconds. Below 2 * SUB_BUCKETS each value has
+ * its own bucket, above that every power of two is split in SUB_BUCKETS */
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_MAGNITUDE 32        /* ~19 hours */
+#define N_BUCKETS ((MAX_MAGNITUDE + 1) * SUB_BUCKETS + SUB_BUCKETS)
+#define MAX_VALUE ((G_GUINT64_CONSTANT (1) << (MAX_MAGNITUDE + SUB_BUCKET_BITS + 1)) - 1)
+
+typedef struct _KmsSamplerProbeData
+{
+  gboolean valid;
+  KmsMediaType type;
+  guint every;
+  gint64 interval;              /* us */
+
+  /* Only accessed from the streaming thread of the pad */
+  guint count;
+  gint64 next;
+} KmsSamplerProbeData;
+
+struct _KmsLatencyHistogram
+{
+  volatile gint buckets[N_BUCKETS];
+  volatile gint count;
+};
+
+static gboolean
+kms_latency_sampler_take_sample (KmsSamplerProbeData * data)
+{
+  if (data->interval > 0) {
+    gint64 now = g_get_monotonic_time ();
+
+    if (now < data->next) {
+      return FALSE;
+    }
+
+    data->next = now + data->interval;
+    return TRUE;
+  }
+
+  if (data->every <= 1) {
+    return TRUE;
+  }
+
+  if (data->count++ % data->every != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+kms_latency_sampler_mark_first (GstBuffer ** buffer, guint idx,
+    KmsSamplerProbeData * data)
+{
+  *buffer = gst_buffer_make_writable (*buffer);
+  kms_buffer_add_buffer_latency_meta (*buffer, kms_utils_get_time_nsecs (),
+      data->valid, data->type);
+
+  /* One meta per list is enough */
+  return FALSE;
+}
+
+static GstPadProbeReturn
+kms_latency_sampler_meta_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsSamplerProbeData *data = user_data;
+
+  if (!kms_latency_sampler_take_sample (data)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    buffer = gst_buffer_make_writable (buffer);
+    kms_buffer_add_buffer_latency_meta (buffer, kms_utils_get_time_nsecs (),
+        data->valid, data->type);
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list,
+        (GstBufferListFunc) kms_latency_sampler_mark_first, data);
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_sampler_probe_data_destroy (KmsSamplerProbeData * data)
+{
+  g_slice_free (KmsSamplerProbeData, data);
+}
+
+gulong
+kms_latency_sampler_add_meta_probe (GstPad * pad, gboolean is_valid,
+    KmsMediaType type, guint every, GstClockTime interval)
+{
+  KmsSamplerProbeData *data;
+
+  data = g_slice_new0 (KmsSamplerProbeData);
+  data->valid = is_valid;
+  data->type = type;
+  data->every = every;
+  data->interval = GST_TIME_AS_USECONDS (interval);
+
+  return gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      kms_latency_sampler_meta_probe, data,
+      (GDestroyNotify) kms_sampler_probe_data_destroy);
+}
+
+void
+kms_latency_sampler_install_properties (GObjectClass * klass, guint every_id,
+    guint interval_id)
+{
+  g_object_class_install_property (klass, every_id,
+      g_param_spec_uint (KMS_LATENCY_SAMPLE_EVERY, "Latency sample every",
+          "When the interval is 0, one of every N buffers of each stream is "
+          "sampled for latency stats", 0, G_MAXUINT,
+          KMS_LATENCY_SAMPLE_EVERY_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (klass, interval_id,
+      g_param_spec_uint (KMS_LATENCY_SAMPLE_INTERVAL,
+          "Latency sample interval",
+          "Time (ms) between the buffers of each stream sampled for latency "
+          "stats, 0 to sample by count. Applies when stats get enabled",
+          0, G_MAXUINT, KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+gulong
+kms_latency_sampler_add_element_meta_probe (GstPad * pad, gboolean is_valid,
+    KmsMediaType type)
+{
+  guint every = KMS_LATENCY_SAMPLE_EVERY_DEFAULT;
+  guint interval = KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND;
+  GstObject *parent;
+
+  parent = gst_object_get_parent (GST_OBJECT (pad));
+
+  while (parent != NULL) {
+    GstObject *next;
+
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (parent),
+            KMS_LATENCY_SAMPLE_INTERVAL) != NULL) {
+      g_object_get (parent, KMS_LATENCY_SAMPLE_EVERY, &every,
+          KMS_LATENCY_SAMPLE_INTERVAL, &interval, NULL);
+      gst_object_unref (parent);
+      break;
+    }
+
+    next = gst_object_get_parent (parent);
+    gst_object_unref (parent);
+    parent = next;
+  }
+
+  return kms_latency_sampler_add_meta_probe (pad, is_valid, type, every,
+      interval * GST_MSECOND);
+}
+
+KmsLatencyHistogram *
+kms_latency_histogram_new (void)
+{
+  return g_slice_new0 (KmsLatencyHistogram);
+}
+
+void
+kms_latency_histogram_free (KmsLatencyHistogram * self)
+{
+  if (self != NULL) {
+    g_slice_free (KmsLatencyHistogram, self);
+  }
+}
+
+static guint
+kms_latency_histogram_bucket (guint64 value)
+{
+  guint magnitude = 0;
+  gint msb;
+
+  if (value > MAX_VALUE) {
+    value = MAX_VALUE;
+  }
+
+  msb = g_bit_nth_msf (value >> 32, -1);
+  msb = (msb >= 0) ? msb + 32 : g_bit_nth_msf ((guint32) value, -1);
+
+  if (msb > SUB_BUCKET_BITS) {
+    magnitude = msb - SUB_BUCKET_BITS;
+  }
+
+  /* (value >> magnitude) is in [SUB_BUCKETS, 2 * SUB_BUCKETS) here, unless
+   * magnitude is 0, so consecutive magnitudes do not overlap */
+  return magnitude * SUB_BUCKETS + (guint) (value >> magnitude);
+}
+
+/* Middle of the range of values stored in @bucket, in microseconds */
+static guint64
+kms_latency_histogram_bucket_value (guint bucket)
+{
+  guint magnitude, sub;
+
+  if (bucket < 2 * SUB_BUCKETS) {
+    return bucket;
+  }
+
+  magnitude = bucket / SUB_BUCKETS - 1;
+  sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+
+  return ((guint64) sub << magnitude) +
+      (((G_GUINT64_CONSTANT (1) << magnitude) - 1) >> 1);
+}
+
+void
+kms_latency_histogram_record (KmsLatencyHistogram * self,
+    GstClockTimeDiff latency)
+{
+  guint64 value = latency > 0 ? GST_TIME_AS_USECONDS (latency) : 0;
+
+  g_atomic_int_inc (&self->buckets[kms_latency_histogram_bucket (value)]);
+  g_atomic_int_inc (&self->count);
+}
+
+void
+kms_latency_histogram_reset (KmsLatencyHistogram * self)
+{
+  guint i;
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    g_atomic_int_set (&self->buckets[i], 0);
+  }
+
+  g_atomic_int_set (&self->count, 0);
+}
+
+guint64
+kms_latency_histogram_get_count (KmsLatencyHistogram * self)
+{
+  return (guint) g_atomic_int_get (&self->count);
+}
+
+GstClockTime
+kms_latency_histogram_get_percentile (KmsLatencyHistogram * self,
+    gdouble percentile)
+{
+  guint64 counts[N_BUCKETS];
+  guint64 total = 0, target, acc = 0;
+  guint i;
+
+  /* Take a copy, recording may go on while reading */
+  for (i = 0; i < N_BUCKETS; i++) {
+    counts[i] = (guint) g_atomic_int_get (&self->buckets[i]);
+    total += counts[i];
+  }
+
+  if (total == 0) {
+    return 0;
+  }
+
+  percentile = CLAMP (percentile, 0.0, 100.0);
+  target = (guint64) (percentile * total / 100.0 + 0.5);
+  target = CLAMP (target, 1, total);
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    acc += counts[i];
+
+    if (acc >= target) {
+      break;
+    }
+  }
+
+  return kms_latency_histogram_bucket_value (MIN (i, N_BUCKETS - 1)) *
+      GST_USECOND;
+}
+
+GstStructure *
+kms_latency_histogram_to_structure (KmsLatencyHistogram * self,
+    const gchar * name)
+{
+  return gst_structure_new (name,
+      "samples", G_TYPE_UINT64, kms_latency_histogram_get_count (self),
+      "p50", G_TYPE_UINT64, kms_latency_histogram_get_percentile (self, 50.0),
+      "p95", G_TYPE_UINT64, kms_latency_histogram_get_percentile (self, 95.0),
+      "p99", G_TYPE_UINT64, kms_latency_histogram_get_percentile (self, 99.0),
+      NULL);
+}
@@ -0,0 +1,85 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_LATENCY_SAMPLER_H_
+#define _KMS_LATENCY_SAMPLER_H_
+
+#include <gst/gst.h>
+#include <commons/kmsstats.h>
+
+G_BEGIN_DECLS
+
+/* Stats field with one kms_latency_histogram_to_structure () per stream */
+#define KMS_LATENCY_PERCENTILES_FIELD "latency-percentiles"
+
+/* Sampling used when latency stats are enabled, unless the element says
+ * otherwise: one buffer per window on each pad, which bounds the cost to 50
+ * metas per second per stream */
+#define KMS_LATENCY_SAMPLE_EVERY_DEFAULT 0
+#define KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT (20 * GST_MSECOND)
+
+/* Element properties with the sampling of its streams. The interval is in
+ * milliseconds */
+#define KMS_LATENCY_SAMPLE_EVERY "latency-sample-every"
+#define KMS_LATENCY_SAMPLE_INTERVAL "latency-sample-interval"
+
+void kms_latency_sampler_install_properties (GObjectClass * klass,
+    guint every_id, guint interval_id);
+
+/*
+ * Like kms_stats_add_buffer_latency_meta_probe () but only the sampled
+ * buffers get a latency meta, the rest go through untouched, so the
+ * notification probes downstream only do work for the sampled ones.
+ *
+ * When @interval is not 0, the first buffer of each @interval is sampled.
+ * Otherwise one of every @every buffers is, 1 meaning all of them.
+ */
+gulong kms_latency_sampler_add_meta_probe (GstPad * pad, gboolean is_valid,
+    KmsMediaType type, guint every, GstClockTime interval);
+
+/* Samples as set in the properties of the closest element containing @pad
+ * that has them, or with the defaults if there is none */
+gulong kms_latency_sampler_add_element_meta_probe (GstPad * pad,
+    gboolean is_valid, KmsMediaType type);
+
+/*
+ * Log-linear histogram of latencies, with a relative error below 1/16.
+ * Recording is lock-free, so it can be done from any streaming thread.
+ * It is cumulative: percentiles cover every latency recorded since the last
+ * kms_latency_histogram_reset (), which callers do when stats get enabled.
+ */
+typedef struct _KmsLatencyHistogram KmsLatencyHistogram;
+
+KmsLatencyHistogram *kms_latency_histogram_new (void);
+void kms_latency_histogram_free (KmsLatencyHistogram * self);
+
+void kms_latency_histogram_record (KmsLatencyHistogram * self,
+    GstClockTimeDiff latency);
+void kms_latency_histogram_reset (KmsLatencyHistogram * self);
+
+guint64 kms_latency_histogram_get_count (KmsLatencyHistogram * self);
+
+/* @percentile in [0, 100]. Returns 0 when there are no samples */
+GstClockTime kms_latency_histogram_get_percentile (KmsLatencyHistogram * self,
+    gdouble percentile);
+
+/* Returns a structure named @name with "samples" and the "p50", "p95" and
+ * "p99" latencies in nanoseconds, all of them as guint64 */
+GstStructure *kms_latency_histogram_to_structure (KmsLatencyHistogram * self,
+    const gchar * name);
+
+G_END_DECLS
+#endif /* _KMS_LATENCY_SAMPLER_H_ */
@@ -24,8 +24,14 @@
 #include <commons/kmselement.h>
 #include <commons/kmsagnosticcaps.h>
 #include "kmsplayerendpoint.h"
+#include "kmsplayerseekmode.h"
+#include "kmskeyframeindex.h"
+#include "kmsthreadcpu.h"
+#include "kmsstatssnapshot.h"
+#include "kmslatencysampler.h"
 #include <commons/kmsloop.h>
 #include <kms-elements-marshal.h>
+#include "kms-elements-enumtypes.h"
 
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
@@ -46,8 +52,11 @@ G_DEFINE_QUARK (PTS_KEY, pts);
 
 #define NETWORK_CACHE_DEFAULT 2000
 #define PORT_RANGE_DEFAULT "0-0"
+#define SEEK_MODE_DEFAULT KMS_PLAYER_SEEK_MODE_ACCURATE
 #define IS_PREROLL TRUE
 
+#define PLAYER_STATS_FIELD "player-stats"
+
 GST_DEBUG_CATEGORY_STATIC (kms_player_endpoint_debug_category);
 #define GST_CAT_DEFAULT kms_player_endpoint_debug_category
 
@@ -74,9 +83,23 @@ typedef struct _KmsPlayerStats
   gboolean enabled;
   GstElement *src;
   gulong meta_id;
+  guint sample_every;
+  guint sample_interval;        /* ms */
   KmsList *probes;              /* <Gstpad, KmsStatsProbe> */
 } KmsPlayerStats;
 
+typedef struct _KmsPlayerSeekStats
+{
+  GMutex mutex;
+  volatile gint pending;        /* Waiting for the first frame of a seek */
+  GstClockTime start;
+  guint64 count;
+  guint64 index_hits;
+  guint64 measured;
+  GstClockTime last_latency;
+  GstClockTime total_latency;
+} KmsPlayerSeekStats;
+
 struct _KmsPlayerEndpointPrivate
 {
   GstElement *pipeline;
@@ -92,6 +115,11 @@ struct _KmsPlayerEndpointPrivate
   GstClockTime base_time_preroll;
 
   KmsPlayerStats stats;
+  KmsThreadCpu *cpu;
+
+  volatile gint seek_mode;
+  volatile gint has_video;
+  KmsPlayerSeekStats seek;
 };
 
 enum
@@ -103,6 +131,9 @@ enum
   PROP_NETWORK_CACHE,
   PROP_PORT_RANGE,
   PROP_PIPELINE,
+  PROP_SEEK_MODE,
+  PROP_LATENCY_SAMPLE_EVERY,
+  PROP_LATENCY_SAMPLE_INTERVAL,
   N_PROPERTIES
 };
 
@@ -132,6 +163,8 @@ typedef struct _KmsPtsData
   GstClockTime last_pts;
   GstClockTime last_pts_orig;
   gboolean pts_handled;
+
+  gboolean is_video;
 } KmsPtsData;
 
 static void
@@ -141,7 +174,7 @@ kms_pts_data_destroy (gpointer data)
 }
 
 static KmsPtsData *
-kms_pts_data_new ()
+kms_pts_data_new (gboolean is_video)
 {
   KmsPtsData *data;
 
@@ -152,6 +185,7 @@ kms_pts_data_new ()
   data->last_pts = GST_CLOCK_TIME_NONE;
   data->last_pts_orig = GST_CLOCK_TIME_NONE;
   data->pts_handled = FALSE;
+  data->is_video = is_video;
 
   return data;
 }
@@ -201,6 +235,16 @@ kms_player_endpoint_set_property (GObject * object, guint property_id,
       g_free (playerendpoint->priv->port_range);
       playerendpoint->priv->port_range = g_value_dup_string (value);
       break;
+    case PROP_SEEK_MODE:
+      g_atomic_int_set (&playerendpoint->priv->seek_mode,
+          g_value_get_enum (value));
+      break;
+    case PROP_LATENCY_SAMPLE_EVERY:
+      playerendpoint->priv->stats.sample_every = g_value_get_uint (value);
+      break;
+    case PROP_LATENCY_SAMPLE_INTERVAL:
+      playerendpoint->priv->stats.sample_interval = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -277,6 +321,16 @@ kms_player_endpoint_get_property (GObject * object, guint property_id,
     case PROP_PORT_RANGE:
       g_value_set_string (value, playerendpoint->priv->port_range);
       break;
+    case PROP_SEEK_MODE:
+      g_value_set_enum (value,
+          g_atomic_int_get (&playerendpoint->priv->seek_mode));
+      break;
+    case PROP_LATENCY_SAMPLE_EVERY:
+      g_value_set_uint (value, playerendpoint->priv->stats.sample_every);
+      break;
+    case PROP_LATENCY_SAMPLE_INTERVAL:
+      g_value_set_uint (value, playerendpoint->priv->stats.sample_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -327,8 +381,10 @@ kms_player_endpoint_enable_latency_probe (KmsPlayerEndpoint * self)
   }
 
   if (self->priv->stats.enabled) {
-    self->priv->stats.meta_id = kms_stats_add_buffer_latency_meta_probe (pad,
-        FALSE, 0);
+    /* The source is in the internal pipeline, not inside this element */
+    self->priv->stats.meta_id = kms_latency_sampler_add_meta_probe (pad,
+        FALSE, 0, self->priv->stats.sample_every,
+        self->priv->stats.sample_interval * GST_MSECOND);
   }
 
   g_object_unref (pad);
@@ -367,8 +423,10 @@ kms_player_endpoint_finalize (GObject * object)
   GST_DEBUG_OBJECT (self, "finalize");
 
   g_mutex_clear (&self->priv->base_time_mutex);
+  g_mutex_clear (&self->priv->seek.mutex);
   g_clear_object (&self->priv->stats.src);
   kms_list_unref (self->priv->stats.probes);
+  kms_thread_cpu_free (self->priv->cpu);
 
   g_free (self->priv->port_range);
   self->priv->port_range = NULL;
@@ -444,6 +502,27 @@ kms_player_endpoint_mark_reset_base_time_and_set_state (KmsPlayerEndpoint *
   return gst_element_set_state (self->priv->pipeline, state);
 }
 
+static void
+kms_player_endpoint_seek_frame_received (KmsPlayerEndpoint * self)
+{
+  KmsPlayerSeekStats *seek = &self->priv->seek;
+  GstClockTime latency;
+
+  if (!g_atomic_int_compare_and_exchange (&seek->pending, TRUE, FALSE)) {
+    return;
+  }
+
+  g_mutex_lock (&seek->mutex);
+  latency = gst_util_get_timestamp () - seek->start;
+  seek->last_latency = latency;
+  seek->total_latency += latency;
+  seek->measured++;
+  g_mutex_unlock (&seek->mutex);
+
+  GST_DEBUG_OBJECT (self, "First frame %" GST_TIME_FORMAT " after seek",
+      GST_TIME_ARGS (latency));
+}
+
 static GstFlowReturn
 process_sample (GstAppSink * appsink, GstAppSrc * appsrc, GstSample * sample,
     gboolean is_preroll)
@@ -478,6 +557,10 @@ process_sample (GstAppSink * appsink, GstAppSrc * appsrc, GstSample * sample,
   pts_data =
       (KmsPtsData *) g_object_get_qdata (G_OBJECT (appsink), pts_quark ());
 
+  if (pts_data->is_video || !g_atomic_int_get (&self->priv->has_video)) {
+    kms_player_endpoint_seek_frame_received (self);
+  }
+
   if (!GST_BUFFER_PTS_IS_VALID (buffer) && !GST_BUFFER_DTS_IS_VALID (buffer)) {
     if (pts_data->pts_handled) {
       GST_ERROR_OBJECT (appsink,
@@ -730,6 +813,85 @@ kms_player_end_point_remove_stat_probe (KmsPlayerEndpoint * self, GstPad * pad)
   KMS_ELEMENT_UNLOCK (self);
 }
 
+typedef struct _KmsKeyframeProbeData
+{
+  KmsPlayerEndpoint *self;
+  GstClockTime last_keyframe;
+} KmsKeyframeProbeData;
+
+static void
+kms_keyframe_probe_data_destroy (gpointer data)
+{
+  g_slice_free (KmsKeyframeProbeData, data);
+}
+
+static GstPadProbeReturn
+kms_player_endpoint_index_keyframe_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsKeyframeProbeData * data)
+{
+  GstClockTime stream_time;
+  GstBuffer *buffer;
+  GstEvent *event;
+  const GstSegment *segment;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    /* Keyframes are only consecutive within the same segment */
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_SEGMENT) {
+      data->last_keyframe = GST_CLOCK_TIME_NONE;
+    }
+
+    return GST_PAD_PROBE_OK;
+  }
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT) ||
+      !GST_BUFFER_PTS_IS_VALID (buffer)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+  if (event == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_segment (event, &segment);
+  stream_time = gst_segment_to_stream_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  gst_event_unref (event);
+
+  kms_keyframe_index_add (KMS_URI_ENDPOINT (data->self)->uri, stream_time,
+      data->last_keyframe);
+  data->last_keyframe = stream_time;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* @pad must carry encoded video, so keyframes are flagged */
+static void
+kms_player_endpoint_add_keyframe_probe (KmsPlayerEndpoint * self, GstPad * pad)
+{
+  KmsKeyframeProbeData *data;
+
+  if (KMS_URI_ENDPOINT (self)->uri == NULL ||
+      gst_uri_has_protocol (KMS_URI_ENDPOINT (self)->uri, "rtsp")) {
+    /* Live sources can not be seeked */
+    return;
+  }
+
+  data = g_slice_new0 (KmsKeyframeProbeData);
+  data->self = self;
+  data->last_keyframe = GST_CLOCK_TIME_NONE;
+
+  GST_DEBUG_OBJECT (self, "Indexing keyframes going through %" GST_PTR_FORMAT,
+      pad);
+
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) kms_player_endpoint_index_keyframe_probe, data,
+      kms_keyframe_probe_data_destroy);
+}
+
 static GstElement *
 kms_player_end_point_get_agnostic_for_pad (KmsPlayerEndpoint * self,
     GstPad * pad)
@@ -753,6 +915,11 @@ kms_player_end_point_get_agnostic_for_pad (KmsPlayerEndpoint * self,
     GST_DEBUG_OBJECT (pad, "Detected video caps");
     agnosticbin = kms_element_get_video_agnosticbin (KMS_ELEMENT (self));
     kms_player_end_point_add_stat_probe (self, pad, KMS_MEDIA_TYPE_VIDEO);
+    g_atomic_int_set (&self->priv->has_video, TRUE);
+
+    if (self->priv->use_encoded_media) {
+      kms_player_endpoint_add_keyframe_probe (self, pad);
+    }
   }
 
   gst_caps_unref (caps);
@@ -848,7 +1015,9 @@ kms_player_endpoint_uridecodebin_pad_added (GstElement * element, GstPad * pad,
         NULL);
 
     g_object_set_qdata_full (G_OBJECT (appsink), pts_quark (),
-        kms_pts_data_new (), kms_pts_data_destroy);
+        kms_pts_data_new (agnosticbin ==
+            kms_element_get_video_agnosticbin (KMS_ELEMENT (self))),
+        kms_pts_data_destroy);
 
     g_object_set_qdata (G_OBJECT (pad), appsink_quark (), appsink);
     g_object_set_qdata (G_OBJECT (pad), appsrc_quark (), appsrc);
@@ -952,7 +1121,9 @@ kms_player_endpoint_set_position (KmsPlayerEndpoint * self, gint64 position)
 {
   GstQuery *query;
   GstEvent *seek;
-  gboolean seekable = FALSE;
+  GstSeekFlags flags;
+  GstClockTime keyframe;
+  gboolean seekable = FALSE, indexed;
 
   query = gst_query_new_seeking (GST_FORMAT_TIME);
   if (!gst_element_query (self->priv->pipeline, query)) {
@@ -969,15 +1140,48 @@ kms_player_endpoint_set_position (KmsPlayerEndpoint * self, gint64 position)
     return FALSE;
   }
 
-  seek = gst_event_new_seek (1.0, GST_FORMAT_TIME,
-      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_ACCURATE,
+  indexed = kms_keyframe_index_lookup (KMS_URI_ENDPOINT (self)->uri, position,
+      &keyframe);
+
+  if (g_atomic_int_get (&self->priv->seek_mode) ==
+      KMS_PLAYER_SEEK_MODE_KEYFRAME) {
+    /* Start playing from the keyframe before the position, nothing needs */
+    /* to be decoded and dropped. A known keyframe saves the demuxer from */
+    /* looking for it */
+    flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+        GST_SEEK_FLAG_SNAP_BEFORE;
+    if (indexed) {
+      position = keyframe;
+    }
+  } else if (indexed && keyframe == position) {
+    /* Already accurate, skip decoding from the previous keyframe */
+    flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+  } else {
+    flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_TRICKMODE |
+        GST_SEEK_FLAG_ACCURATE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Seeking to %" GST_TIME_FORMAT " (%s)",
+      GST_TIME_ARGS (position), indexed ? "indexed keyframe" : "not indexed");
+
+  seek = gst_event_new_seek (1.0, GST_FORMAT_TIME, flags,
       /* start */ GST_SEEK_TYPE_SET, position,
       /* stop */ GST_SEEK_TYPE_SET, GST_CLOCK_TIME_NONE);
 
   kms_player_endpoint_mark_reset_base_time (self);
 
+  g_mutex_lock (&self->priv->seek.mutex);
+  self->priv->seek.start = gst_util_get_timestamp ();
+  self->priv->seek.count++;
+  if (indexed) {
+    self->priv->seek.index_hits++;
+  }
+  g_mutex_unlock (&self->priv->seek.mutex);
+  g_atomic_int_set (&self->priv->seek.pending, TRUE);
+
   if (!gst_element_send_event (self->priv->pipeline, seek)) {
     GST_WARNING_OBJECT (self, "Seek failed");
+    g_atomic_int_set (&self->priv->seek.pending, FALSE);
     return FALSE;
   }
 
@@ -1053,10 +1257,68 @@ kms_player_endpoint_collect_media_stats (KmsElement * obj, gboolean enable)
 
   KMS_ELEMENT_UNLOCK (self);
 
+  kms_thread_cpu_set_enabled (self->priv->cpu, enable);
+
   KMS_ELEMENT_CLASS
       (kms_player_endpoint_parent_class)->collect_media_stats (obj, enable);
 }
 
+static GstStructure *
+kms_player_endpoint_stats (KmsElement * obj, gchar * selector)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (obj);
+  KmsPlayerSeekStats *seek = &self->priv->seek;
+  GstStructure *stats, *p_stats;
+
+  /* chain up */
+  stats =
+      KMS_ELEMENT_CLASS (kms_player_endpoint_parent_class)->stats (obj,
+      selector);
+
+  g_mutex_lock (&seek->mutex);
+  p_stats = gst_structure_new (PLAYER_STATS_FIELD,
+      "seek-count", G_TYPE_UINT64, seek->count,
+      "keyframe-index-hits", G_TYPE_UINT64, seek->index_hits,
+      "last-seek-latency", G_TYPE_UINT64, seek->last_latency,
+      "avg-seek-latency", G_TYPE_UINT64, seek->measured > 0 ?
+      seek->total_latency / seek->measured : G_GUINT64_CONSTANT (0), NULL);
+  g_mutex_unlock (&seek->mutex);
+
+  gst_structure_set (stats, PLAYER_STATS_FIELD, GST_TYPE_STRUCTURE, p_stats,
+      NULL);
+  gst_structure_free (p_stats);
+
+  /* Includes the threads of the decoding pipeline */
+  kms_thread_cpu_add_stats (self->priv->cpu, stats);
+
+  return stats;
+}
+
+static void
+kms_player_endpoint_fill_snapshot (GstElement * element, KmsStatsSnapshot * snapshot)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (element);
+  guint64 cpu_time;
+  guint threads;
+
+  /* Includes the threads of the decoding pipeline */
+  if (kms_thread_cpu_get_time (self->priv->cpu, &cpu_time, &threads)) {
+    snapshot->values[KMS_STATS_COUNTER_CPU_TIME] = cpu_time;
+    snapshot->values[KMS_STATS_COUNTER_THREADS] = threads;
+  }
+}
+
+static void
+kms_player_endpoint_handle_message (GstBin * bin, GstMessage * message)
+{
+  KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (bin);
+
+  kms_thread_cpu_handle_message (self->priv->cpu, message);
+
+  GST_BIN_CLASS (kms_player_endpoint_parent_class)->handle_message (bin,
+      message);
+}
+
 static void
 kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
 {
@@ -1074,12 +1336,19 @@ kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
   gobject_class->set_property = kms_player_endpoint_set_property;
   gobject_class->get_property = kms_player_endpoint_get_property;
 
+  GST_BIN_CLASS (klass)->handle_message =
+      GST_DEBUG_FUNCPTR (kms_player_endpoint_handle_message);
+
   urienpoint_class->stopped = kms_player_endpoint_stopped;
   urienpoint_class->started = kms_player_endpoint_started;
   urienpoint_class->paused = kms_player_endpoint_paused;
 
   kms_element_class->collect_media_stats =
       GST_DEBUG_FUNCPTR (kms_player_endpoint_collect_media_stats);
+  kms_element_class->stats = GST_DEBUG_FUNCPTR (kms_player_endpoint_stats);
+
+  kms_stats_snapshot_set_fill_func (G_TYPE_FROM_CLASS (klass),
+      kms_player_endpoint_fill_snapshot);
 
   klass->set_position = kms_player_endpoint_set_position;
 
@@ -1116,6 +1385,16 @@ kms_player_endpoint_class_init (KmsPlayerEndpointClass * klass)
           "PlayerEndpoint's private pipeline",
           GST_TYPE_ELEMENT, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_SEEK_MODE,
+      g_param_spec_enum ("seek-mode", "Seek mode",
+          "How 'set-position' seeks: to the exact position, decoding from "
+          "the previous keyframe, or directly to that keyframe",
+          KMS_TYPE_PLAYER_SEEK_MODE, SEEK_MODE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  kms_latency_sampler_install_properties (gobject_class,
+      PROP_LATENCY_SAMPLE_EVERY, PROP_LATENCY_SAMPLE_INTERVAL);
+
   kms_player_endpoint_signals[SIGNAL_EOS] =
       g_signal_new ("eos",
       G_TYPE_FROM_CLASS (klass),
@@ -1234,6 +1513,8 @@ bus_sync_signal_handler (GstBus * bus, GstMessage * msg, gpointer data)
 {
   KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (data);
 
+  kms_thread_cpu_handle_message (self->priv->cpu, msg);
+
   if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS) {
     kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
         kms_player_endpoint_emit_EOS_signal, g_object_ref (self),
@@ -1291,9 +1572,25 @@ kms_player_endpoint_uridecodebin_element_added (GstBin * bin,
     GstElement * element, gpointer data)
 {
   KmsPlayerEndpoint *self = KMS_PLAYER_ENDPOINT (data);
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  if (GST_IS_BIN (element)) {
+    /* Look into decodebin for the video decoders */
+    g_signal_connect (element, "element-added",
+        G_CALLBACK (kms_player_endpoint_uridecodebin_element_added), self);
+  } else if (factory != NULL && gst_element_factory_list_is_type (factory,
+          GST_ELEMENT_FACTORY_TYPE_DECODER |
+          GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO)) {
+    GstPad *sinkpad = gst_element_get_static_pad (element, "sink");
+
+    if (sinkpad != NULL) {
+      kms_player_endpoint_add_keyframe_probe (self, sinkpad);
+      g_object_unref (sinkpad);
+    }
+  }
 
-  if (g_strcmp0 (gst_plugin_feature_get_name (GST_PLUGIN_FEATURE
-              (gst_element_get_factory (element))), RTSPSRC) == 0) {
+  if (factory != NULL && g_strcmp0 (gst_plugin_feature_get_name
+          (GST_PLUGIN_FEATURE (factory)), RTSPSRC) == 0) {
     g_object_set (G_OBJECT (element),
         "latency", self->priv->network_cache,
         "drop-on-latency", TRUE,
@@ -1369,9 +1666,15 @@ kms_player_endpoint_init (KmsPlayerEndpoint * self)
       gst_element_factory_make ("uridecodebin", NULL);
   self->priv->network_cache = NETWORK_CACHE_DEFAULT;
   self->priv->port_range = g_strdup (PORT_RANGE_DEFAULT);
+  self->priv->seek_mode = SEEK_MODE_DEFAULT;
+  self->priv->stats.sample_every = KMS_LATENCY_SAMPLE_EVERY_DEFAULT;
+  self->priv->stats.sample_interval =
+      KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND;
+  g_mutex_init (&self->priv->seek.mutex);
 
   self->priv->stats.probes = kms_list_new_full (g_direct_equal, g_object_unref,
       (GDestroyNotify) kms_stats_probe_destroy);
+  self->priv->cpu = kms_thread_cpu_new ();
 
   /* Connect to signals */
   g_signal_connect (self->priv->uridecodebin, "pad-added",
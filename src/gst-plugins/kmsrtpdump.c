@@ -0,0 +1,155 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrtpdump.h"
+#include <gst/base/gstbytereader.h>
+#include <gst/base/gstbytewriter.h>
+#include <string.h>
+
+#define FILE_MAGIC "#!rtpplay1.0 "
+/* The remote address is not known where the packets are taken */
+#define FILE_ADDRESS "0.0.0.0/0"
+#define FILE_LINE FILE_MAGIC FILE_ADDRESS "\n"
+#define MAX_FILE_LINE 64
+
+/* Start seconds and microseconds, source address, port and padding */
+#define FILE_HEADER_SIZE 16
+
+#define FIRST_RTCP_TYPE 192
+#define LAST_RTCP_TYPE 223
+
+GstBuffer *
+kms_rtp_dump_new_file_header (GstClockTime start)
+{
+  GstByteWriter writer;
+  guint64 usecs = GST_TIME_AS_USECONDS (start);
+
+  gst_byte_writer_init_with_size (&writer, MAX_FILE_LINE + FILE_HEADER_SIZE,
+      FALSE);
+  gst_byte_writer_put_data (&writer, (const guint8 *) FILE_LINE,
+      strlen (FILE_LINE));
+
+  gst_byte_writer_put_uint32_be (&writer, usecs / G_USEC_PER_SEC);
+  gst_byte_writer_put_uint32_be (&writer, usecs % G_USEC_PER_SEC);
+  gst_byte_writer_put_uint32_be (&writer, 0);
+  gst_byte_writer_put_uint16_be (&writer, 0);
+  gst_byte_writer_put_uint16_be (&writer, 0);
+
+  return gst_byte_writer_reset_and_get_buffer (&writer);
+}
+
+gboolean
+kms_rtp_dump_is_rtcp (const guint8 * data, gsize size)
+{
+  return size >= 2 && (data[0] >> 6) == 2 && data[1] >= FIRST_RTCP_TYPE &&
+      data[1] <= LAST_RTCP_TYPE;
+}
+
+GstBuffer *
+kms_rtp_dump_new_record (GstBuffer * packet, GstClockTime offset)
+{
+  gsize size = gst_buffer_get_size (packet);
+  GstBuffer *record;
+  GstMapInfo info;
+  gboolean rtcp;
+
+  if (size + KMS_RTP_DUMP_RECORD_HEADER_SIZE > G_MAXUINT16 ||
+      offset > KMS_RTP_DUMP_MAX_OFFSET) {
+    return NULL;
+  }
+
+  record = gst_buffer_new_allocate (NULL,
+      KMS_RTP_DUMP_RECORD_HEADER_SIZE + size, NULL);
+  gst_buffer_map (record, &info, GST_MAP_WRITE);
+
+  gst_buffer_extract (packet, 0, info.data + KMS_RTP_DUMP_RECORD_HEADER_SIZE,
+      size);
+  rtcp = kms_rtp_dump_is_rtcp (info.data + KMS_RTP_DUMP_RECORD_HEADER_SIZE,
+      size);
+
+  GST_WRITE_UINT16_BE (info.data, KMS_RTP_DUMP_RECORD_HEADER_SIZE + size);
+  GST_WRITE_UINT16_BE (info.data + 2, rtcp ? 0 : size);
+  GST_WRITE_UINT32_BE (info.data + 4, GST_TIME_AS_MSECONDS (offset));
+
+  gst_buffer_unmap (record, &info);
+
+  return record;
+}
+
+gboolean
+kms_rtp_dump_parse_file_header (const guint8 * data, gsize size,
+    gsize * header_size, GstClockTime * start, GError ** error)
+{
+  GstByteReader reader;
+  const guint8 *end;
+  guint32 secs, usecs;
+
+  if (size < strlen (FILE_MAGIC)) {
+    return FALSE;
+  }
+
+  if (memcmp (data, FILE_MAGIC, strlen (FILE_MAGIC)) != 0) {
+    g_set_error_literal (error, GST_STREAM_ERROR, GST_STREAM_ERROR_WRONG_TYPE,
+        "Not an rtpdump file");
+    return FALSE;
+  }
+
+  end = memchr (data, '\n', MIN (size, MAX_FILE_LINE));
+
+  if (end == NULL) {
+    if (size >= MAX_FILE_LINE) {
+      g_set_error_literal (error, GST_STREAM_ERROR, GST_STREAM_ERROR_DECODE,
+          "rtpdump file line too long");
+    }
+    return FALSE;
+  }
+
+  gst_byte_reader_init (&reader, data, size);
+  gst_byte_reader_skip_unchecked (&reader, end - data + 1);
+
+  if (!gst_byte_reader_get_uint32_be (&reader, &secs) ||
+      !gst_byte_reader_get_uint32_be (&reader, &usecs) ||
+      !gst_byte_reader_skip (&reader, 8)) {
+    return FALSE;
+  }
+
+  *header_size = gst_byte_reader_get_pos (&reader);
+  *start = secs * GST_SECOND + usecs * GST_USECOND;
+
+  return TRUE;
+}
+
+gboolean
+kms_rtp_dump_parse_record_header (const guint8 * data, gsize * size,
+    gboolean * rtcp, GstClockTime * offset)
+{
+  guint16 len = GST_READ_UINT16_BE (data);
+  guint16 plen = GST_READ_UINT16_BE (data + 2);
+
+  if (len < KMS_RTP_DUMP_RECORD_HEADER_SIZE) {
+    return FALSE;
+  }
+
+  *size = len - KMS_RTP_DUMP_RECORD_HEADER_SIZE;
+  *rtcp = plen == 0;
+  *offset = GST_READ_UINT32_BE (data + 4) * GST_MSECOND;
+
+  return TRUE;
+}
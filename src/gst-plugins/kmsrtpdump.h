@@ -0,0 +1,61 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_RTP_DUMP_H_
+#define _KMS_RTP_DUMP_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The rtpdump format of rtptools, which rtpplay and Wireshark read too.
+ *
+ * A text line and a binary header with the wall clock start time, then one
+ * record per packet: its length, its RTP length (0 for RTCP), and its arrival
+ * in milliseconds since the start, followed by the packet. All of it in
+ * network byte order. Records are only ever appended, so a file cut short is
+ * still valid up to its last complete record.
+ */
+
+#define KMS_RTP_DUMP_RECORD_HEADER_SIZE 8
+
+/* Arrival times can not go further than this from the start */
+#define KMS_RTP_DUMP_MAX_OFFSET (G_MAXUINT32 * GST_MSECOND)
+
+/* File header for a recording started at @start, in wall clock
+ * nanoseconds */
+GstBuffer *kms_rtp_dump_new_file_header (GstClockTime start);
+
+/* The record of @packet, arrived @offset after the start */
+GstBuffer *kms_rtp_dump_new_record (GstBuffer * packet, GstClockTime offset);
+
+/* Whether @data is an RTCP packet rather than RTP, as RFC 5761 tells them
+ * apart */
+gboolean kms_rtp_dump_is_rtcp (const guint8 * data, gsize size);
+
+/* Parses the file header at the start of @data. Returns FALSE until @size
+ * is enough, or if it is not an rtpdump file, which sets @error */
+gboolean kms_rtp_dump_parse_file_header (const guint8 * data, gsize size,
+    gsize * header_size, GstClockTime * start, GError ** error);
+
+/* Parses the KMS_RTP_DUMP_RECORD_HEADER_SIZE bytes at @data. @size is the
+ * length of the packet that follows. Returns FALSE if they make no sense */
+gboolean kms_rtp_dump_parse_record_header (const guint8 * data, gsize * size,
+    gboolean * rtcp, GstClockTime * offset);
+
+G_END_DECLS
+#endif /* _KMS_RTP_DUMP_H_ */
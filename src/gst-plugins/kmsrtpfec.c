@@ -0,0 +1,1242 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrtpfec.h"
+#include "kmsrtpwatcher.h"
+#include <gst/rtp/gstrtpbuffer.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GST_CAT_DEFAULT kms_rtp_fec_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define MID_ATTR "mid"
+#define RTPMAP_ATTR "rtpmap"
+#define FMTP_ATTR "fmtp"
+#define SSRC_ATTR "ssrc"
+#define SSRC_GROUP_ATTR "ssrc-group"
+#define FEC_GROUP "FEC-FR"
+#define REPAIR_WINDOW 200000    /* us */
+
+#define SINK_DATA "kms-rtp-fec-sink"
+#define ENCODER_DATA "kms-rtp-fec-encoder"
+
+#define FIRST_DYNAMIC_PT 96
+#define LAST_DYNAMIC_PT 127
+
+#define RTP_HEADER_SIZE 12
+
+/* FEC header with the first 15 bits of the mask, with 46 and with 109 */
+#define FEC_HEADER_SIZE 20
+#define FEC_LONG_HEADER_SIZE 24
+#define FEC_LONGEST_HEADER_SIZE 32
+#define MASK_SHORT_BITS 15
+
+/* Packets a 46 bits mask covers */
+#define MAX_BATCH 46
+
+/* Packets received kept per SSRC. A FEC packet is given up once the stream
+ * is MAX_REPAIR_AGE packets past the last one it protects */
+#define WINDOW_SIZE 256
+#define WINDOW_MASK (WINDOW_SIZE - 1)
+#define MAX_REPAIR_AGE 128
+#define MAX_REPAIRS 32
+
+typedef struct _KmsRtpFecEncoder
+{
+  guint32 fec_ssrc;
+  guint16 fec_seq;
+  gboolean started;
+  guint16 last_seq;
+  guint16 base;
+  GstBuffer *batch[MAX_BATCH];
+  guint16 seqs[MAX_BATCH];
+  guint len;
+} KmsRtpFecEncoder;
+
+typedef struct _KmsRtpFecRepair
+{
+  guint16 base;
+  guint64 mask;                 /* Bit i protects base + i */
+  guint16 last;
+  guint8 header[2];             /* P, X, CC, M and PT recovery */
+  guint16 length;
+  guint32 ts;
+  guint8 *payload;
+  gsize size;
+} KmsRtpFecRepair;
+
+typedef struct _KmsRtpFecDecoder
+{
+  guint32 ssrc;
+  gboolean started;
+  guint16 max_seq;
+  GstBuffer *packets[WINDOW_SIZE];
+  guint16 seqs[WINDOW_SIZE];
+  GQueue repairs;               /* Oldest first */
+} KmsRtpFecDecoder;
+
+struct _KmsRtpFec
+{
+  GMutex mutex;
+  guint overhead;
+
+  /* FEC payload type protecting each media payload type, 0 when none */
+  guint8 send_pts[128];
+  /* Payload types of the FEC received, and of the media it protects */
+  gboolean recv_fec_pts[128];
+  gboolean recv_media_pts[128];
+  gint active;                  /* Atomic, something was negotiated */
+
+  GHashTable *fec_ssrcs;        /* <media SSRC, FEC SSRC> */
+  GHashTable *encoders;         /* <media SSRC, KmsRtpFecEncoder> */
+  GHashTable *decoders;         /* <media SSRC, KmsRtpFecDecoder> */
+
+  guint64 protected;
+  guint64 fec_sent;
+  guint64 fec_received;
+  guint64 recovered;
+};
+
+static GQuark
+kms_rtp_fec_recovered_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (quark == 0) {
+    quark = g_quark_from_static_string (KMS_RTP_FEC_RECOVERED_DATA);
+  }
+
+  return quark;
+}
+
+static void
+kms_rtp_fec_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "rtpfec", 0,
+        "RTP forward error correction");
+    kms_rtp_fec_recovered_quark ();
+    g_once_init_leave (&done, 1);
+  }
+}
+
+static void
+kms_rtp_fec_encoder_clear (KmsRtpFecEncoder * enc)
+{
+  guint i;
+
+  for (i = 0; i < enc->len; i++) {
+    gst_buffer_unref (enc->batch[i]);
+  }
+
+  enc->len = 0;
+}
+
+static void
+kms_rtp_fec_encoder_free (KmsRtpFecEncoder * enc)
+{
+  kms_rtp_fec_encoder_clear (enc);
+  g_slice_free (KmsRtpFecEncoder, enc);
+}
+
+static void
+kms_rtp_fec_repair_free (KmsRtpFecRepair * repair)
+{
+  g_free (repair->payload);
+  g_slice_free (KmsRtpFecRepair, repair);
+}
+
+static void
+kms_rtp_fec_decoder_free (KmsRtpFecDecoder * dec)
+{
+  guint i;
+
+  for (i = 0; i < WINDOW_SIZE; i++) {
+    if (dec->packets[i] != NULL) {
+      gst_buffer_unref (dec->packets[i]);
+    }
+  }
+
+  g_queue_foreach (&dec->repairs, (GFunc) kms_rtp_fec_repair_free, NULL);
+  g_queue_clear (&dec->repairs);
+  g_slice_free (KmsRtpFecDecoder, dec);
+}
+
+KmsRtpFec *
+kms_rtp_fec_new (void)
+{
+  KmsRtpFec *self;
+
+  kms_rtp_fec_init ();
+
+  self = g_slice_new0 (KmsRtpFec);
+  g_mutex_init (&self->mutex);
+  self->overhead = KMS_RTP_FEC_DEFAULT_OVERHEAD;
+  self->fec_ssrcs = g_hash_table_new (NULL, NULL);
+  self->encoders = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) kms_rtp_fec_encoder_free);
+  self->decoders = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) kms_rtp_fec_decoder_free);
+
+  return self;
+}
+
+void
+kms_rtp_fec_free (KmsRtpFec * self)
+{
+  g_hash_table_unref (self->fec_ssrcs);
+  g_hash_table_unref (self->encoders);
+  g_hash_table_unref (self->decoders);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsRtpFec, self);
+}
+
+void
+kms_rtp_fec_set_overhead (KmsRtpFec * self, guint overhead)
+{
+  g_mutex_lock (&self->mutex);
+  self->overhead = MIN (overhead, KMS_RTP_FEC_MAX_OVERHEAD);
+
+  if (self->overhead == 0) {
+    g_hash_table_remove_all (self->encoders);
+  }
+  g_mutex_unlock (&self->mutex);
+}
+
+guint
+kms_rtp_fec_get_overhead (KmsRtpFec * self)
+{
+  guint overhead;
+
+  g_mutex_lock (&self->mutex);
+  overhead = self->overhead;
+  g_mutex_unlock (&self->mutex);
+
+  return overhead;
+}
+
+/* Session description */
+
+static gchar *
+kms_rtp_fec_get_encoding (const GstSDPMedia * media, const gchar * fmt)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar **tokens;
+    gchar *encoding = NULL;
+
+    if (g_strcmp0 (attr->key, RTPMAP_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <format> <encoding>/<clock rate>[/<channels>] */
+    tokens = g_strsplit_set (attr->value, " /", 3);
+
+    if (tokens[0] != NULL && tokens[1] != NULL &&
+        g_strcmp0 (tokens[0], fmt) == 0) {
+      encoding = g_strdup (tokens[1]);
+    }
+    g_strfreev (tokens);
+
+    if (encoding != NULL) {
+      return encoding;
+    }
+  }
+
+  return NULL;
+}
+
+static gint
+kms_rtp_fec_get_media_pt (const GstSDPMedia * media)
+{
+  guint i, len;
+
+  len = gst_sdp_media_formats_len (media);
+
+  for (i = 0; i < len; i++) {
+    const gchar *fmt = gst_sdp_media_get_format (media, i);
+    gchar *encoding = kms_rtp_fec_get_encoding (media, fmt);
+    gboolean found;
+
+    found = g_ascii_strcasecmp (encoding != NULL ? encoding : "",
+        KMS_RTP_FEC_ENCODING_NAME) == 0;
+    g_free (encoding);
+
+    if (found) {
+      return atoi (fmt);
+    }
+  }
+
+  return -1;
+}
+
+/* Formats carrying the media itself, not repairs of it */
+static gboolean
+kms_rtp_fec_is_codec (const GstSDPMedia * media, const gchar * fmt)
+{
+  static const gchar *repairs[] = {
+    KMS_RTP_FEC_ENCODING_NAME, "rtx", "red", "ulpfec", NULL
+  };
+  gchar *encoding = kms_rtp_fec_get_encoding (media, fmt);
+  gboolean codec = TRUE;
+  guint i;
+
+  for (i = 0; encoding != NULL && repairs[i] != NULL; i++) {
+    if (g_ascii_strcasecmp (encoding, repairs[i]) == 0) {
+      codec = FALSE;
+    }
+  }
+  g_free (encoding);
+
+  return codec && atoi (fmt) < 128;
+}
+
+static gint
+kms_rtp_fec_get_free_pt (const GstSDPMedia * media)
+{
+  gint pt;
+
+  for (pt = FIRST_DYNAMIC_PT; pt <= LAST_DYNAMIC_PT; pt++) {
+    guint i, len = gst_sdp_media_formats_len (media);
+    gboolean used = FALSE;
+
+    for (i = 0; i < len && !used; i++) {
+      used = atoi (gst_sdp_media_get_format (media, i)) == pt;
+    }
+
+    if (!used) {
+      return pt;
+    }
+  }
+
+  return -1;
+}
+
+static const GstSDPMedia *
+kms_rtp_fec_find_media (const GstSDPMessage * sdp,
+    const GstSDPMedia * local_media)
+{
+  const gchar *mid = gst_sdp_media_get_attribute_val (local_media, MID_ATTR);
+  guint i, len;
+
+  len = gst_sdp_message_medias_len (sdp);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media (sdp, i);
+
+    if (mid != NULL) {
+      if (g_strcmp0 (gst_sdp_media_get_attribute_val (media, MID_ATTR),
+              mid) == 0) {
+        return media;
+      }
+    } else if (g_strcmp0 (gst_sdp_media_get_media (media),
+            gst_sdp_media_get_media (local_media)) == 0) {
+      return media;
+    }
+  }
+
+  return NULL;
+}
+
+/* Must be called with the mutex held */
+static guint32
+kms_rtp_fec_get_fec_ssrc (KmsRtpFec * self, guint32 ssrc)
+{
+  guint32 fec_ssrc;
+
+  fec_ssrc = GPOINTER_TO_UINT (g_hash_table_lookup (self->fec_ssrcs,
+          GUINT_TO_POINTER (ssrc)));
+
+  if (fec_ssrc == 0) {
+    do {
+      fec_ssrc = g_random_int ();
+    } while (fec_ssrc == 0 || fec_ssrc == ssrc);
+
+    g_hash_table_insert (self->fec_ssrcs, GUINT_TO_POINTER (ssrc),
+        GUINT_TO_POINTER (fec_ssrc));
+  }
+
+  return fec_ssrc;
+}
+
+static void
+kms_rtp_fec_add_ssrc (KmsRtpFec * self, GstSDPMedia * media)
+{
+  const gchar *value = gst_sdp_media_get_attribute_val (media, SSRC_ATTR);
+  const gchar *cname;
+  guint32 ssrc, fec_ssrc;
+  gchar *attr;
+
+  /* <ssrc> <attribute>[:<value>] */
+  if (value == NULL) {
+    GST_DEBUG ("No SSRC declared, FEC is sent without its group");
+    return;
+  }
+
+  ssrc = strtoul (value, NULL, 10);
+
+  g_mutex_lock (&self->mutex);
+  fec_ssrc = kms_rtp_fec_get_fec_ssrc (self, ssrc);
+  g_mutex_unlock (&self->mutex);
+
+  cname = strstr (value, " cname:");
+
+  if (cname != NULL) {
+    attr = g_strdup_printf ("%u%s", fec_ssrc, cname);
+    gst_sdp_media_add_attribute (media, SSRC_ATTR, attr);
+    g_free (attr);
+  }
+
+  attr = g_strdup_printf ("%s %u %u", FEC_GROUP, ssrc, fec_ssrc);
+  gst_sdp_media_add_attribute (media, SSRC_GROUP_ATTR, attr);
+  g_free (attr);
+}
+
+void
+kms_rtp_fec_configure_media (KmsRtpFec * self,
+    const GstSDPMessage * remote_sdp, GstSDPMedia * local_media)
+{
+  gchar *value;
+  gint pt;
+
+  if (g_strcmp0 (gst_sdp_media_get_media (local_media), "video") != 0 ||
+      gst_sdp_media_get_port (local_media) == 0 ||
+      kms_rtp_fec_get_overhead (self) == 0 ||
+      kms_rtp_fec_get_media_pt (local_media) >= 0) {
+    return;
+  }
+
+  if (remote_sdp != NULL) {
+    const GstSDPMedia *remote_media;
+
+    remote_media = kms_rtp_fec_find_media (remote_sdp, local_media);
+
+    if (remote_media == NULL) {
+      return;
+    }
+
+    /* Answers keep the payload type offered */
+    pt = kms_rtp_fec_get_media_pt (remote_media);
+  } else {
+    pt = kms_rtp_fec_get_free_pt (local_media);
+  }
+
+  if (pt < 0) {
+    return;
+  }
+
+  value = g_strdup_printf ("%d", pt);
+  gst_sdp_media_add_format (local_media, value);
+  g_free (value);
+
+  value = g_strdup_printf ("%d %s/%d", pt, KMS_RTP_FEC_ENCODING_NAME,
+      KMS_RTP_FEC_CLOCK_RATE);
+  gst_sdp_media_add_attribute (local_media, RTPMAP_ATTR, value);
+  g_free (value);
+
+  value = g_strdup_printf ("%d repair-window=%d", pt, REPAIR_WINDOW);
+  gst_sdp_media_add_attribute (local_media, FMTP_ATTR, value);
+  g_free (value);
+
+  kms_rtp_fec_add_ssrc (self, local_media);
+}
+
+/* Must be called with the mutex held */
+static void
+kms_rtp_fec_read_groups (KmsRtpFec * self, const GstSDPMedia * media)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar **tokens;
+
+    if (g_strcmp0 (attr->key, SSRC_GROUP_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* FEC-FR <media SSRC> <FEC SSRC> */
+    tokens = g_strsplit (attr->value, " ", 3);
+
+    if (g_strcmp0 (tokens[0], FEC_GROUP) == 0 && tokens[1] != NULL &&
+        tokens[2] != NULL) {
+      g_hash_table_insert (self->fec_ssrcs,
+          GUINT_TO_POINTER (strtoul (tokens[1], NULL, 10)),
+          GUINT_TO_POINTER (strtoul (tokens[2], NULL, 10)));
+    }
+    g_strfreev (tokens);
+  }
+}
+
+void
+kms_rtp_fec_configure (KmsRtpFec * self, const GstSDPMedia * local_media,
+    const GstSDPMedia * remote_media)
+{
+  gint local_pt, remote_pt;
+  gboolean enabled;
+  guint i, len;
+
+  local_pt = kms_rtp_fec_get_media_pt (local_media);
+  remote_pt = kms_rtp_fec_get_media_pt (remote_media);
+  enabled = local_pt >= 0 && remote_pt >= 0;
+
+  GST_DEBUG ("FlexFEC %s, payload types sent: %d, received: %d",
+      enabled ? "enabled" : "disabled", remote_pt, local_pt);
+
+  g_mutex_lock (&self->mutex);
+
+  /* Packets are sent with the payload types of the remote description, and
+   * received with the ones of the local one */
+  len = gst_sdp_media_formats_len (remote_media);
+  for (i = 0; i < len; i++) {
+    const gchar *fmt = gst_sdp_media_get_format (remote_media, i);
+
+    if (kms_rtp_fec_is_codec (remote_media, fmt)) {
+      self->send_pts[atoi (fmt)] = enabled ? remote_pt : 0;
+    }
+  }
+
+  len = gst_sdp_media_formats_len (local_media);
+  for (i = 0; i < len; i++) {
+    const gchar *fmt = gst_sdp_media_get_format (local_media, i);
+
+    if (kms_rtp_fec_is_codec (local_media, fmt)) {
+      self->recv_media_pts[atoi (fmt)] = enabled;
+    }
+  }
+
+  if (local_pt >= 0 && local_pt < 128) {
+    self->recv_fec_pts[local_pt] = enabled;
+  }
+
+  kms_rtp_fec_read_groups (self, local_media);
+
+  if (enabled) {
+    g_atomic_int_set (&self->active, TRUE);
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/* Sending */
+
+static void
+kms_rtp_fec_write_mask (guint8 * data, guint64 mask, gboolean is_long)
+{
+  guint16 first = 0;
+  guint32 second = 0;
+  guint i;
+
+  for (i = 0; i < MASK_SHORT_BITS; i++) {
+    if (mask & (G_GUINT64_CONSTANT (1) << i)) {
+      first |= 1 << (MASK_SHORT_BITS - 1 - i);
+    }
+  }
+
+  if (!is_long) {
+    /* k bit, the mask ends here */
+    GST_WRITE_UINT16_BE (data, first | 0x8000);
+    return;
+  }
+
+  for (i = MASK_SHORT_BITS; i < MAX_BATCH; i++) {
+    if (mask & (G_GUINT64_CONSTANT (1) << i)) {
+      second |= 1U << (MAX_BATCH - 1 - i);
+    }
+  }
+
+  GST_WRITE_UINT16_BE (data, first);
+  GST_WRITE_UINT32_BE (data + 2, second | 0x80000000);
+}
+
+static void
+kms_rtp_fec_xor (guint8 * dest, const guint8 * src, gsize size)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    dest[i] ^= src[i];
+  }
+}
+
+/* One FEC packet protecting the packets first, first + step, ... of the
+ * batch */
+static GstBuffer *
+kms_rtp_fec_encoder_build (KmsRtpFecEncoder * enc, guint32 ssrc, guint8 pt,
+    guint first, guint step)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 header[2] = { 0, 0 };
+  guint16 length = 0;
+  guint32 ts = 0;
+  guint64 mask = 0;
+  gsize size = 0, header_size;
+  GstMapInfo info;
+  GstBuffer *fec;
+  guint8 *payload;
+  guint i;
+
+  for (i = first; i < enc->len; i += step) {
+    size = MAX (size, gst_buffer_get_size (enc->batch[i]) - RTP_HEADER_SIZE);
+    mask |= G_GUINT64_CONSTANT (1) << (guint16) (enc->seqs[i] - enc->base);
+  }
+
+  header_size = (mask >> MASK_SHORT_BITS) == 0 ? FEC_HEADER_SIZE :
+      FEC_LONG_HEADER_SIZE;
+
+  fec = gst_rtp_buffer_new_allocate (header_size + size, 0, 0);
+  gst_rtp_buffer_map (fec, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, pt);
+  gst_rtp_buffer_set_seq (&rtp, enc->fec_seq++);
+  gst_rtp_buffer_set_ssrc (&rtp, enc->fec_ssrc);
+
+  payload = gst_rtp_buffer_get_payload (&rtp);
+  memset (payload, 0, header_size + size);
+
+  for (i = first; i < enc->len; i += step) {
+    gst_buffer_map (enc->batch[i], &info, GST_MAP_READ);
+    header[0] ^= info.data[0];
+    header[1] ^= info.data[1];
+    length ^= info.size - RTP_HEADER_SIZE;
+    ts ^= GST_READ_UINT32_BE (info.data + 4);
+    kms_rtp_fec_xor (payload + header_size, info.data + RTP_HEADER_SIZE,
+        info.size - RTP_HEADER_SIZE);
+
+    if (i + step >= enc->len) {
+      /* Timestamp of the newest packet protected */
+      gst_rtp_buffer_set_timestamp (&rtp, GST_READ_UINT32_BE (info.data + 4));
+    }
+    gst_buffer_unmap (enc->batch[i], &info);
+  }
+
+  /* R and F unset: FEC packet with a flexible mask */
+  payload[0] = header[0] & 0x3f;
+  payload[1] = header[1];
+  GST_WRITE_UINT16_BE (payload + 2, length);
+  GST_WRITE_UINT32_BE (payload + 4, ts);
+  payload[8] = 1;               /* SSRCCount */
+  GST_WRITE_UINT32_BE (payload + 12, ssrc);
+  GST_WRITE_UINT16_BE (payload + 16, enc->base);
+  kms_rtp_fec_write_mask (payload + 18, mask,
+      header_size == FEC_LONG_HEADER_SIZE);
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  return fec;
+}
+
+/* Must be called with the mutex held */
+static void
+kms_rtp_fec_encoder_flush (KmsRtpFec * self, KmsRtpFecEncoder * enc,
+    guint32 ssrc, guint8 pt, GstBufferList * out)
+{
+  guint n, i;
+
+  /* Interleaved: FEC packet i protects the media packets i, i + n, ... */
+  n = CLAMP ((enc->len * self->overhead + 99) / 100, 1, enc->len);
+
+  for (i = 0; i < n; i++) {
+    gst_buffer_list_add (out, kms_rtp_fec_encoder_build (enc, ssrc, pt, i, n));
+  }
+
+  self->fec_sent += n;
+  kms_rtp_fec_encoder_clear (enc);
+}
+
+static void
+kms_rtp_fec_encode (KmsRtpFec * self, GstBuffer * buffer, GstBufferList * out)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsRtpFecEncoder *enc;
+  guint32 ssrc;
+  guint16 seq;
+  gboolean marker;
+  guint8 pt, fec_pt;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    return;
+  }
+
+  pt = gst_rtp_buffer_get_payload_type (&rtp);
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  seq = gst_rtp_buffer_get_seq (&rtp);
+  marker = gst_rtp_buffer_get_marker (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  g_mutex_lock (&self->mutex);
+
+  fec_pt = self->send_pts[pt];
+
+  if (fec_pt == 0 || self->overhead == 0) {
+    goto end;
+  }
+
+  enc = g_hash_table_lookup (self->encoders, GUINT_TO_POINTER (ssrc));
+
+  if (enc == NULL) {
+    enc = g_slice_new0 (KmsRtpFecEncoder);
+    enc->fec_ssrc = kms_rtp_fec_get_fec_ssrc (self, ssrc);
+    enc->fec_seq = g_random_int ();
+    g_hash_table_insert (self->encoders, GUINT_TO_POINTER (ssrc), enc);
+  }
+
+  if (enc->started && (gint16) (seq - enc->last_seq) <= 0) {
+    /* Retransmissions are not protected again */
+    goto end;
+  }
+
+  if (enc->len > 0 && (guint16) (seq - enc->base) >= MAX_BATCH) {
+    kms_rtp_fec_encoder_flush (self, enc, ssrc, fec_pt, out);
+  }
+
+  if (enc->len == 0) {
+    enc->base = seq;
+  }
+
+  enc->seqs[enc->len] = seq;
+  enc->batch[enc->len++] = gst_buffer_ref (buffer);
+  enc->started = TRUE;
+  enc->last_seq = seq;
+  self->protected++;
+
+  if (marker || enc->len == MAX_BATCH) {
+    kms_rtp_fec_encoder_flush (self, enc, ssrc, fec_pt, out);
+  }
+
+end:
+  g_mutex_unlock (&self->mutex);
+}
+
+static GstPadProbeReturn
+kms_rtp_fec_rtp_sink_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsRtpFec * self)
+{
+  GstBufferList *list, *out;
+  guint i, len;
+
+  if (!g_atomic_int_get (&self->active)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    out = gst_buffer_list_new ();
+    kms_rtp_fec_encode (self, buffer, out);
+
+    if (gst_buffer_list_length (out) == 0) {
+      gst_buffer_list_unref (out);
+      return GST_PAD_PROBE_OK;
+    }
+
+    /* A buffer probe cannot hand on a list, so the batch is pushed again as
+     * one, the FEC packets ahead of the packet closing it; receivers wait
+     * for them before repairing anything. It comes back here with nothing
+     * left to protect, and reaches the probes downstream in sending order */
+    gst_buffer_list_add (out, gst_buffer_ref (buffer));
+    gst_pad_push_list (pad, out);
+
+    return GST_PAD_PROBE_DROP;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    list = gst_pad_probe_info_get_buffer_list (info);
+    len = gst_buffer_list_length (list);
+    out = gst_buffer_list_new_sized (len);
+
+    for (i = 0; i < len; i++) {
+      GstBuffer *buffer = gst_buffer_list_get (list, i);
+
+      kms_rtp_fec_encode (self, buffer, out);
+      gst_buffer_list_add (out, gst_buffer_ref (buffer));
+    }
+
+    if (gst_buffer_list_length (out) == len) {
+      gst_buffer_list_unref (out);
+    } else {
+      gst_buffer_list_unref (list);
+      GST_PAD_PROBE_INFO_DATA (info) = out;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Receiving */
+
+static gboolean
+kms_rtp_fec_read_mask (const guint8 * data, gsize size, guint64 * mask,
+    gsize * header_size)
+{
+  guint16 first;
+  guint32 second;
+  guint64 third;
+  guint i;
+
+  first = GST_READ_UINT16_BE (data + 18);
+  *mask = 0;
+
+  for (i = 0; i < MASK_SHORT_BITS; i++) {
+    if (first & (1 << (MASK_SHORT_BITS - 1 - i))) {
+      *mask |= G_GUINT64_CONSTANT (1) << i;
+    }
+  }
+
+  if (first & 0x8000) {
+    *header_size = FEC_HEADER_SIZE;
+    return TRUE;
+  }
+
+  if (size < FEC_LONG_HEADER_SIZE) {
+    return FALSE;
+  }
+
+  second = GST_READ_UINT32_BE (data + 20);
+
+  for (i = MASK_SHORT_BITS; i < MAX_BATCH; i++) {
+    if (second & (1U << (MAX_BATCH - 1 - i))) {
+      *mask |= G_GUINT64_CONSTANT (1) << i;
+    }
+  }
+
+  if (second & 0x80000000) {
+    *header_size = FEC_LONG_HEADER_SIZE;
+    return TRUE;
+  }
+
+  if (size < FEC_LONGEST_HEADER_SIZE) {
+    return FALSE;
+  }
+
+  third = GST_READ_UINT64_BE (data + 24);
+
+  /* Packets further than 63 from the base are not kept track of */
+  if ((third & ((G_GUINT64_CONSTANT (1) << 45) - 1)) != 0) {
+    return FALSE;
+  }
+
+  for (i = MAX_BATCH; i < 64; i++) {
+    if (third & (G_GUINT64_CONSTANT (1) << (62 - (i - MAX_BATCH)))) {
+      *mask |= G_GUINT64_CONSTANT (1) << i;
+    }
+  }
+
+  *header_size = FEC_LONGEST_HEADER_SIZE;
+
+  return TRUE;
+}
+
+static KmsRtpFecRepair *
+kms_rtp_fec_repair_new (const guint8 * data, gsize size, guint32 * ssrc)
+{
+  KmsRtpFecRepair *repair;
+  gsize header_size;
+  guint64 mask;
+  guint i;
+
+  /* Retransmissions (R) and fixed masks (F) are not supported, and FEC
+   * packets protect a single SSRC */
+  if (size < FEC_HEADER_SIZE || (data[0] & 0xc0) != 0 || data[8] != 1) {
+    return NULL;
+  }
+
+  if (!kms_rtp_fec_read_mask (data, size, &mask, &header_size) || mask == 0) {
+    return NULL;
+  }
+
+  repair = g_slice_new0 (KmsRtpFecRepair);
+  repair->header[0] = data[0] & 0x3f;
+  repair->header[1] = data[1];
+  repair->length = GST_READ_UINT16_BE (data + 2);
+  repair->ts = GST_READ_UINT32_BE (data + 4);
+  repair->base = GST_READ_UINT16_BE (data + 16);
+  repair->mask = mask;
+  repair->size = size - header_size;
+  repair->payload = g_malloc (repair->size);
+  memcpy (repair->payload, data + header_size, repair->size);
+
+  for (i = 0; i < 64; i++) {
+    if (mask & (G_GUINT64_CONSTANT (1) << i)) {
+      repair->last = repair->base + i;
+    }
+  }
+
+  *ssrc = GST_READ_UINT32_BE (data + 12);
+
+  return repair;
+}
+
+static gboolean
+kms_rtp_fec_decoder_has (KmsRtpFecDecoder * dec, guint16 seq)
+{
+  guint idx = seq & WINDOW_MASK;
+
+  return dec->packets[idx] != NULL && dec->seqs[idx] == seq;
+}
+
+static void
+kms_rtp_fec_decoder_store (KmsRtpFecDecoder * dec, GstBuffer * buffer,
+    guint16 seq)
+{
+  guint idx = seq & WINDOW_MASK;
+
+  if (dec->packets[idx] != NULL) {
+    gst_buffer_unref (dec->packets[idx]);
+  }
+
+  dec->packets[idx] = buffer;
+  dec->seqs[idx] = seq;
+
+  if (!dec->started || (gint16) (seq - dec->max_seq) > 0) {
+    dec->max_seq = seq;
+    dec->started = TRUE;
+  }
+}
+
+static GstBuffer *
+kms_rtp_fec_decoder_recover (KmsRtpFecDecoder * dec, KmsRtpFecRepair * repair,
+    guint16 missing)
+{
+  guint8 header[2] = { repair->header[0], repair->header[1] };
+  guint16 length = repair->length;
+  guint32 ts = repair->ts;
+  GstMapInfo info;
+  GstBuffer *buffer;
+  guint i;
+
+  /* The payload of the repair is not needed any more */
+  for (i = 0; i < 64; i++) {
+    guint16 seq = repair->base + i;
+    GstBuffer *packet;
+    gboolean fits;
+
+    if (!(repair->mask & (G_GUINT64_CONSTANT (1) << i)) || seq == missing) {
+      continue;
+    }
+
+    packet = dec->packets[seq & WINDOW_MASK];
+    gst_buffer_map (packet, &info, GST_MAP_READ);
+    fits = info.size - RTP_HEADER_SIZE <= repair->size;
+
+    if (fits) {
+      header[0] ^= info.data[0];
+      header[1] ^= info.data[1];
+      length ^= info.size - RTP_HEADER_SIZE;
+      ts ^= GST_READ_UINT32_BE (info.data + 4);
+      kms_rtp_fec_xor (repair->payload, info.data + RTP_HEADER_SIZE,
+          info.size - RTP_HEADER_SIZE);
+    }
+    gst_buffer_unmap (packet, &info);
+
+    if (!fits) {
+      GST_WARNING ("FEC packet shorter than the packets it protects");
+      return NULL;
+    }
+  }
+
+  if (length > repair->size) {
+    GST_WARNING ("Wrong length recovered: %u", length);
+    return NULL;
+  }
+
+  buffer = gst_buffer_new_allocate (NULL, RTP_HEADER_SIZE + length, NULL);
+  gst_buffer_map (buffer, &info, GST_MAP_WRITE);
+  info.data[0] = 0x80 | (header[0] & 0x3f);
+  info.data[1] = header[1];
+  GST_WRITE_UINT16_BE (info.data + 2, missing);
+  GST_WRITE_UINT32_BE (info.data + 4, ts);
+  GST_WRITE_UINT32_BE (info.data + 8, dec->ssrc);
+  memcpy (info.data + RTP_HEADER_SIZE, repair->payload, length);
+  gst_buffer_unmap (buffer, &info);
+
+  gst_mini_object_set_qdata (GST_MINI_OBJECT (buffer),
+      kms_rtp_fec_recovered_quark (), GINT_TO_POINTER (TRUE), NULL);
+
+  return buffer;
+}
+
+/* Must be called with the mutex held. Recovered packets are appended to
+ * @recovered, oldest first */
+static void
+kms_rtp_fec_decoder_repair (KmsRtpFec * self, KmsRtpFecDecoder * dec,
+    GSList ** recovered)
+{
+  gboolean progress;
+
+  do {
+    GList *l = dec->repairs.head;
+
+    progress = FALSE;
+
+    while (l != NULL) {
+      KmsRtpFecRepair *repair = l->data;
+      GList *next = l->next;
+      guint16 missing = 0;
+      guint lost = 0, i;
+
+      for (i = 0; i < 64; i++) {
+        guint16 seq = repair->base + i;
+
+        if ((repair->mask & (G_GUINT64_CONSTANT (1) << i)) &&
+            !kms_rtp_fec_decoder_has (dec, seq)) {
+          missing = seq;
+          lost++;
+        }
+      }
+
+      /* A packet newer than any received may still be on its way */
+      if (lost == 1 && (gint16) (dec->max_seq - missing) > 0) {
+        GstBuffer *buffer = kms_rtp_fec_decoder_recover (dec, repair, missing);
+
+        if (buffer != NULL) {
+          GST_LOG ("Recovered packet %u of SSRC %u", missing, dec->ssrc);
+          kms_rtp_fec_decoder_store (dec, gst_buffer_ref (buffer), missing);
+          *recovered = g_slist_append (*recovered, buffer);
+          self->recovered++;
+          progress = TRUE;
+        }
+
+        lost = 0;
+      }
+
+      if (lost == 0 || (gint16) (dec->max_seq - repair->last) > MAX_REPAIR_AGE) {
+        g_queue_delete_link (&dec->repairs, l);
+        kms_rtp_fec_repair_free (repair);
+      }
+
+      l = next;
+    }
+  } while (progress);
+}
+
+/* Must be called with the mutex held */
+static KmsRtpFecDecoder *
+kms_rtp_fec_get_decoder (KmsRtpFec * self, guint32 ssrc)
+{
+  KmsRtpFecDecoder *dec;
+
+  dec = g_hash_table_lookup (self->decoders, GUINT_TO_POINTER (ssrc));
+
+  if (dec == NULL) {
+    dec = g_slice_new0 (KmsRtpFecDecoder);
+    dec->ssrc = ssrc;
+    g_queue_init (&dec->repairs);
+    g_hash_table_insert (self->decoders, GUINT_TO_POINTER (ssrc), dec);
+  }
+
+  return dec;
+}
+
+static GstPadProbeReturn
+kms_rtp_fec_rtp_src_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsRtpFec * self)
+{
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GSList *recovered = NULL, *l;
+  KmsRtpFecDecoder *dec;
+  gboolean is_fec = FALSE;
+  guint8 pt;
+
+  if (!g_atomic_int_get (&self->active) ||
+      gst_mini_object_get_qdata (GST_MINI_OBJECT (buffer),
+          kms_rtp_fec_recovered_quark ()) != NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  pt = gst_rtp_buffer_get_payload_type (&rtp);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->recv_fec_pts[pt]) {
+    KmsRtpFecRepair *repair;
+    guint32 ssrc;
+
+    is_fec = TRUE;
+    self->fec_received++;
+    repair = kms_rtp_fec_repair_new (gst_rtp_buffer_get_payload (&rtp),
+        gst_rtp_buffer_get_payload_len (&rtp), &ssrc);
+
+    if (repair != NULL) {
+      dec = kms_rtp_fec_get_decoder (self, ssrc);
+      g_queue_push_tail (&dec->repairs, repair);
+
+      if (g_queue_get_length (&dec->repairs) > MAX_REPAIRS) {
+        kms_rtp_fec_repair_free (g_queue_pop_head (&dec->repairs));
+      }
+
+      kms_rtp_fec_decoder_repair (self, dec, &recovered);
+    } else {
+      GST_DEBUG ("Unsupported FEC packet");
+    }
+  } else if (self->recv_media_pts[pt]) {
+    dec = kms_rtp_fec_get_decoder (self, gst_rtp_buffer_get_ssrc (&rtp));
+    kms_rtp_fec_decoder_store (dec, gst_buffer_ref (buffer),
+        gst_rtp_buffer_get_seq (&rtp));
+
+    if (!g_queue_is_empty (&dec->repairs)) {
+      kms_rtp_fec_decoder_repair (self, dec, &recovered);
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+  gst_rtp_buffer_unmap (&rtp);
+
+  /* Ahead of the packet that let them be recovered, they are older */
+  for (l = recovered; l != NULL; l = l->next) {
+    gst_pad_push (pad, l->data);
+  }
+  g_slist_free (recovered);
+
+  return is_fec ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+}
+
+/* Pads */
+
+static void
+kms_rtp_fec_rtp_sink_linked (GstPad * pad, GstPad * peer, KmsRtpFec * self)
+{
+  /* Upstream of @pad, so that the probes it has already see the FEC
+   * packets and the media packets once each */
+  kms_rtp_watcher_add_pad_func (peer,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) kms_rtp_fec_rtp_sink_probe, self, NULL);
+}
+
+void
+kms_rtp_fec_watch_rtp_sink (KmsRtpFec * self, GstPad * pad)
+{
+  GstPad *peer;
+
+  if (!kms_rtp_watcher_mark (pad, SINK_DATA)) {
+    return;
+  }
+
+  peer = gst_pad_get_peer (pad);
+
+  if (peer != NULL) {
+    kms_rtp_fec_rtp_sink_linked (pad, peer, self);
+    g_object_unref (peer);
+  } else {
+    g_signal_connect (pad, "linked",
+        G_CALLBACK (kms_rtp_fec_rtp_sink_linked), self);
+  }
+}
+
+static void
+kms_rtp_fec_encoder_pad_added (GstElement * encoder, GstPad * pad,
+    KmsRtpFec * self)
+{
+  if (GST_PAD_IS_SINK (pad) &&
+      g_str_has_prefix (GST_OBJECT_NAME (pad), "rtp_sink")) {
+    kms_rtp_fec_watch_rtp_sink (self, pad);
+  }
+}
+
+static void
+kms_rtp_fec_encoder_pad_foreach (const GValue * item, KmsRtpFec * self)
+{
+  GstPad *pad = g_value_get_object (item);
+
+  kms_rtp_fec_encoder_pad_added (GST_PAD_PARENT (pad), pad, self);
+}
+
+void
+kms_rtp_fec_watch_encoder (KmsRtpFec * self, GstElement * encoder)
+{
+  GstIterator *it;
+
+  if (!kms_rtp_watcher_mark (encoder, ENCODER_DATA)) {
+    return;
+  }
+
+  it = gst_element_iterate_sink_pads (encoder);
+  gst_iterator_foreach (it, (GstIteratorForeachFunction)
+      kms_rtp_fec_encoder_pad_foreach, self);
+  gst_iterator_free (it);
+
+  g_signal_connect (encoder, "pad-added",
+      G_CALLBACK (kms_rtp_fec_encoder_pad_added), self);
+}
+
+void
+kms_rtp_fec_watch_rtp_src (KmsRtpFec * self, GstPad * pad)
+{
+  kms_rtp_watcher_add_pad_func (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_rtp_fec_rtp_src_probe, self, NULL);
+}
+
+gboolean
+kms_rtp_fec_watch_connection (KmsRtpFec * self, KmsIRtpConnection * conn,
+    const GstSDPMedia * remote_media, const GstSDPMedia * local_media)
+{
+  GstPad *pad;
+
+  if (local_media == NULL ||
+      g_strcmp0 (gst_sdp_media_get_media (remote_media), "video") != 0) {
+    return FALSE;
+  }
+
+  kms_rtp_fec_configure (self, local_media, remote_media);
+
+  if (kms_rtp_fec_get_media_pt (local_media) < 0 ||
+      kms_rtp_fec_get_media_pt (remote_media) < 0) {
+    return FALSE;
+  }
+
+  pad = kms_i_rtp_connection_request_rtp_src (conn);
+
+  if (pad != NULL) {
+    kms_rtp_fec_watch_rtp_src (self, pad);
+    g_object_unref (pad);
+  }
+
+  return TRUE;
+}
+
+void
+kms_rtp_fec_add_stats (KmsRtpFec * self, GstStructure * stats)
+{
+  GstStructure *fec_stats;
+
+  g_mutex_lock (&self->mutex);
+  fec_stats = gst_structure_new (KMS_RTP_FEC_STATS_FIELD,
+      "overhead", G_TYPE_UINT, self->overhead,
+      "packets-protected", G_TYPE_UINT64, self->protected,
+      "fec-packets-sent", G_TYPE_UINT64, self->fec_sent,
+      "fec-packets-received", G_TYPE_UINT64, self->fec_received,
+      "packets-recovered", G_TYPE_UINT64, self->recovered, NULL);
+  g_mutex_unlock (&self->mutex);
+
+  gst_structure_set (stats, KMS_RTP_FEC_STATS_FIELD, GST_TYPE_STRUCTURE,
+      fec_stats, NULL);
+  gst_structure_free (fec_stats);
+}
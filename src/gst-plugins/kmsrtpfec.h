@@ -0,0 +1,97 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_RTP_FEC_H_
+#define _KMS_RTP_FEC_H_
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+#include <commons/kmsirtpconnection.h>
+
+G_BEGIN_DECLS
+
+/* draft-ietf-payload-flexible-fec-scheme-03, as sent by the browsers */
+#define KMS_RTP_FEC_ENCODING_NAME "flexfec-03"
+#define KMS_RTP_FEC_CLOCK_RATE 90000
+
+/* FEC packets per 100 media packets */
+#define KMS_RTP_FEC_DEFAULT_OVERHEAD 0
+#define KMS_RTP_FEC_MAX_OVERHEAD 100
+
+#define KMS_RTP_FEC_STATS_FIELD "fec-stats"
+
+/* Qdata set on the packets rebuilt from FEC, which were never received */
+#define KMS_RTP_FEC_RECOVERED_DATA "kms-rtp-fec-recovered"
+
+/*
+ * Forward error correction of the video of an endpoint, with FlexFEC.
+ *
+ * Sending: the video packets are grouped in batches that end with each frame,
+ * and each batch is protected by a number of FEC packets given by the
+ * overhead. FEC packets cover interleaved packets of the batch, so that a
+ * burst loses at most one packet of each, and are sent in their own SSRC
+ * right before the last packet of the batch. Media packets are not modified.
+ *
+ * Receiving: the video packets are kept for a short while on the way out of
+ * the connections, and the FEC packets of the remote peer rebuild the ones
+ * lost before they reach the jitter buffer. FEC packets go no further.
+ */
+typedef struct _KmsRtpFec KmsRtpFec;
+
+KmsRtpFec *kms_rtp_fec_new (void);
+void kms_rtp_fec_free (KmsRtpFec * self);
+
+/* FEC packets per 100 media packets. 0, the default, neither offers nor
+ * accepts FEC, and stops sending it */
+void kms_rtp_fec_set_overhead (KmsRtpFec * self, guint overhead);
+guint kms_rtp_fec_get_overhead (KmsRtpFec * self);
+
+/* Adds the FlexFEC format to the video @local_media, and the SSRC of the
+ * FEC stream when the media declares its own. Answers only get it when the
+ * remote offer has it */
+void kms_rtp_fec_configure_media (KmsRtpFec * self,
+    const GstSDPMessage * remote_sdp, GstSDPMedia * local_media);
+
+/* Takes the payload types and SSRCs to use from the negotiated video medias.
+ * FEC is only sent and recovered when both descriptions have it */
+void kms_rtp_fec_configure (KmsRtpFec * self, const GstSDPMedia * local_media,
+    const GstSDPMedia * remote_media);
+
+/* Configures the video @local_media and recovers the packets received
+ * through @conn. Returns TRUE when FEC is used in the media, then the pads
+ * the RTP packets sent go through are to be watched with
+ * kms_rtp_fec_watch_rtp_sink () or kms_rtp_fec_watch_encoder () */
+gboolean kms_rtp_fec_watch_connection (KmsRtpFec * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media);
+
+/* Protects the packets going through @pad. FEC packets are pushed through
+ * it too, right before the packet closing each batch. The probe sits on the
+ * peer of @pad, set once it is linked */
+void kms_rtp_fec_watch_rtp_sink (KmsRtpFec * self, GstPad * pad);
+
+/* Same for the "rtp_sink" pads of @encoder, present and future */
+void kms_rtp_fec_watch_encoder (KmsRtpFec * self, GstElement * encoder);
+
+/* Recovers the packets missing from the ones going out of @pad */
+void kms_rtp_fec_watch_rtp_src (KmsRtpFec * self, GstPad * pad);
+
+/* Adds a structure with the packets protected, the FEC packets sent and
+ * received, and the packets recovered */
+void kms_rtp_fec_add_stats (KmsRtpFec * self, GstStructure * stats);
+
+G_END_DECLS
+#endif /* _KMS_RTP_FEC_H_ */
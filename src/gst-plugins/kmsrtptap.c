@@ -0,0 +1,257 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrtptap.h"
+#include "kmsrtpfec.h"
+#include "kmsrtpwatcher.h"
+#include <gst/app/gstappsrc.h>
+
+#define GST_CAT_DEFAULT kms_rtp_tap_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+typedef struct _KmsRtpTapSink
+{
+  GstElement *appsrc;
+  gulong enough_data_id;
+  gulong need_data_id;
+  gint full;                    /* Atomic */
+  guint64 dropped;
+} KmsRtpTapSink;
+
+struct _KmsRtpTap
+{
+  GMutex mutex;
+  GSList *sinks;                /* <KmsRtpTapSink> */
+  gint n_sinks;                 /* Atomic, checked before taking the lock */
+};
+
+static GQuark
+kms_rtp_tap_recovered_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (quark == 0) {
+    quark = g_quark_from_static_string (KMS_RTP_FEC_RECOVERED_DATA);
+  }
+
+  return quark;
+}
+
+static void
+kms_rtp_tap_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "rtptap", 0,
+        "Copies of the RTP packets received");
+    kms_rtp_tap_recovered_quark ();
+    g_once_init_leave (&done, 1);
+  }
+}
+
+static void
+kms_rtp_tap_enough_data (GstElement * appsrc, KmsRtpTapSink * sink)
+{
+  g_atomic_int_set (&sink->full, TRUE);
+}
+
+static void
+kms_rtp_tap_need_data (GstElement * appsrc, guint length,
+    KmsRtpTapSink * sink)
+{
+  g_atomic_int_set (&sink->full, FALSE);
+}
+
+static KmsRtpTapSink *
+kms_rtp_tap_sink_new (GstElement * appsrc)
+{
+  KmsRtpTapSink *sink;
+
+  sink = g_slice_new0 (KmsRtpTapSink);
+  sink->appsrc = g_object_ref (appsrc);
+  sink->enough_data_id = g_signal_connect (appsrc, "enough-data",
+      G_CALLBACK (kms_rtp_tap_enough_data), sink);
+  sink->need_data_id = g_signal_connect (appsrc, "need-data",
+      G_CALLBACK (kms_rtp_tap_need_data), sink);
+
+  return sink;
+}
+
+static void
+kms_rtp_tap_sink_free (KmsRtpTapSink * sink)
+{
+  if (sink->dropped > 0) {
+    GST_INFO_OBJECT (sink->appsrc, "%" G_GUINT64_FORMAT
+        " packets dropped while full", sink->dropped);
+  }
+
+  g_signal_handler_disconnect (sink->appsrc, sink->enough_data_id);
+  g_signal_handler_disconnect (sink->appsrc, sink->need_data_id);
+  g_object_unref (sink->appsrc);
+  g_slice_free (KmsRtpTapSink, sink);
+}
+
+KmsRtpTap *
+kms_rtp_tap_new (void)
+{
+  KmsRtpTap *self;
+
+  kms_rtp_tap_init ();
+
+  self = g_slice_new0 (KmsRtpTap);
+  g_mutex_init (&self->mutex);
+
+  return self;
+}
+
+void
+kms_rtp_tap_free (KmsRtpTap * self)
+{
+  g_slist_free_full (self->sinks, (GDestroyNotify) kms_rtp_tap_sink_free);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsRtpTap, self);
+}
+
+void
+kms_rtp_tap_add (KmsRtpTap * self, GstElement * appsrc)
+{
+  g_return_if_fail (GST_IS_APP_SRC (appsrc));
+
+  g_mutex_lock (&self->mutex);
+  self->sinks = g_slist_append (self->sinks, kms_rtp_tap_sink_new (appsrc));
+  g_atomic_int_inc (&self->n_sinks);
+  g_mutex_unlock (&self->mutex);
+
+  GST_DEBUG_OBJECT (appsrc, "Tapping the packets received");
+}
+
+void
+kms_rtp_tap_remove (KmsRtpTap * self, GstElement * appsrc)
+{
+  KmsRtpTapSink *sink = NULL;
+  GSList *l;
+
+  g_mutex_lock (&self->mutex);
+
+  for (l = self->sinks; l != NULL; l = l->next) {
+    if (((KmsRtpTapSink *) l->data)->appsrc == appsrc) {
+      sink = l->data;
+      self->sinks = g_slist_delete_link (self->sinks, l);
+      g_atomic_int_add (&self->n_sinks, -1);
+      break;
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (sink != NULL) {
+    kms_rtp_tap_sink_free (sink);
+  }
+}
+
+static void
+kms_rtp_tap_push (KmsRtpTap * self, GstBuffer * buffer, GstClockTime arrival)
+{
+  GSList *l;
+
+  if (gst_mini_object_get_qdata (GST_MINI_OBJECT (buffer),
+          kms_rtp_tap_recovered_quark ()) != NULL) {
+    return;
+  }
+
+  for (l = self->sinks; l != NULL; l = l->next) {
+    KmsRtpTapSink *sink = l->data;
+    GstBuffer *copy;
+
+    if (g_atomic_int_get (&sink->full)) {
+      if (sink->dropped++ == 0) {
+        GST_WARNING_OBJECT (sink->appsrc, "Too far behind, dropping packets");
+      }
+      continue;
+    }
+
+    /* Only the memory, the metas of the packet are of no use here */
+    copy = gst_buffer_new ();
+    gst_buffer_copy_into (copy, buffer, GST_BUFFER_COPY_MEMORY, 0, -1);
+    GST_BUFFER_PTS (copy) = arrival;
+
+    gst_app_src_push_buffer (GST_APP_SRC (sink->appsrc), copy);
+  }
+}
+
+static gboolean
+kms_rtp_tap_push_list_item (GstBuffer ** buffer, guint idx, gpointer data)
+{
+  gpointer *args = data;
+
+  kms_rtp_tap_push (args[0], *buffer, *(GstClockTime *) args[1]);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_rtp_tap_probe (GstPad * pad, GstPadProbeInfo * info, KmsRtpTap * self)
+{
+  GstClockTime arrival;
+
+  if (g_atomic_int_get (&self->n_sinks) == 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  arrival = g_get_real_time () * GST_USECOND;
+
+  g_mutex_lock (&self->mutex);
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gpointer args[] = { self, &arrival };
+
+    gst_buffer_list_foreach (gst_pad_probe_info_get_buffer_list (info),
+        kms_rtp_tap_push_list_item, args);
+  } else {
+    kms_rtp_tap_push (self, gst_pad_probe_info_get_buffer (info), arrival);
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Takes the reference of @pad */
+static void
+kms_rtp_tap_watch_pad (KmsRtpTap * self, GstPad * pad)
+{
+  if (pad == NULL) {
+    return;
+  }
+
+  kms_rtp_watcher_add_pad_func (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) kms_rtp_tap_probe, self, NULL);
+  g_object_unref (pad);
+}
+
+void
+kms_rtp_tap_watch_connection (KmsRtpTap * self, KmsIRtpConnection * conn,
+    const GstSDPMedia * remote_media, const GstSDPMedia * local_media)
+{
+  kms_rtp_tap_watch_pad (self, kms_i_rtp_connection_request_rtp_src (conn));
+  kms_rtp_tap_watch_pad (self, kms_i_rtp_connection_request_rtcp_src (conn));
+}
@@ -0,0 +1,50 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_RTP_TAP_H_
+#define _KMS_RTP_TAP_H_
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+#include <commons/kmsirtpconnection.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Copies of the RTP and RTCP packets received by an endpoint, as they leave
+ * its connections: already decrypted, before anything else looks at them.
+ *
+ * The copies are pushed to the appsrc elements added to the tap, with the
+ * arrival time in their PTS as wall clock nanoseconds (g_get_real_time ()).
+ * They share the memory of the packets. An appsrc that reports enough data
+ * gets no more packets until it asks for data again; those are dropped.
+ * Nothing is done per packet while no appsrc is added.
+ */
+typedef struct _KmsRtpTap KmsRtpTap;
+
+KmsRtpTap *kms_rtp_tap_new (void);
+void kms_rtp_tap_free (KmsRtpTap * self);
+
+/* Watches @conn, as a KmsRtpWatcherMediaFunc */
+void kms_rtp_tap_watch_connection (KmsRtpTap * self, KmsIRtpConnection * conn,
+    const GstSDPMedia * remote_media, const GstSDPMedia * local_media);
+
+/* The packets received from now on are pushed to @appsrc too */
+void kms_rtp_tap_add (KmsRtpTap * self, GstElement * appsrc);
+void kms_rtp_tap_remove (KmsRtpTap * self, GstElement * appsrc);
+
+G_END_DECLS
+#endif /* _KMS_RTP_TAP_H_ */
@@ -0,0 +1,290 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsrtpwatcher.h"
+#include <commons/sdpagent/kmssdpagent.h>
+
+#define GST_CAT_DEFAULT kms_rtp_watcher_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define PAD_DATA "kms-rtp-watcher-pad"
+
+/* Features watching the same pad */
+#define MAX_PAD_FUNCS 8
+
+typedef struct _KmsRtpWatcherMedia
+{
+  KmsRtpWatcherMediaFunc func;
+  gpointer user_data;
+} KmsRtpWatcherMedia;
+
+typedef struct _KmsRtpWatcherPadFunc
+{
+  GstPadProbeType mask;
+  GstPadProbeCallback func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsRtpWatcherPadFunc;
+
+typedef struct _KmsRtpWatcherPad
+{
+  KmsRtpWatcherPadFunc funcs[MAX_PAD_FUNCS];
+  gint n_funcs;                 /* Atomic, slots are filled before it grows */
+} KmsRtpWatcherPad;
+
+struct _KmsRtpWatcher
+{
+  GArray *medias;               /* <KmsRtpWatcherMedia> */
+};
+
+/* Serializes the changes of the pads and marks of every watcher */
+static GMutex mutex;
+
+static void
+kms_rtp_watcher_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "rtpwatcher", 0,
+        "Connections watched by the endpoint features");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+KmsRtpWatcher *
+kms_rtp_watcher_new (void)
+{
+  KmsRtpWatcher *self;
+
+  kms_rtp_watcher_init ();
+
+  self = g_slice_new0 (KmsRtpWatcher);
+  self->medias = g_array_new (FALSE, FALSE, sizeof (KmsRtpWatcherMedia));
+
+  return self;
+}
+
+void
+kms_rtp_watcher_free (KmsRtpWatcher * self)
+{
+  g_array_free (self->medias, TRUE);
+  g_slice_free (KmsRtpWatcher, self);
+}
+
+void
+kms_rtp_watcher_add_media_func (KmsRtpWatcher * self,
+    KmsRtpWatcherMediaFunc func, gpointer user_data)
+{
+  KmsRtpWatcherMedia media = { func, user_data };
+
+  g_array_append_val (self->medias, media);
+}
+
+void
+kms_rtp_watcher_watch_session (KmsRtpWatcher * self, KmsBaseRtpSession * sess)
+{
+  KmsSdpSession *sdp_sess = KMS_SDP_SESSION (sess);
+  guint i, j, len, neg_len = 0;
+
+  if (sdp_sess->remote_sdp == NULL) {
+    return;
+  }
+
+  len = gst_sdp_message_medias_len (sdp_sess->remote_sdp);
+
+  if (sdp_sess->neg_sdp != NULL) {
+    neg_len = gst_sdp_message_medias_len (sdp_sess->neg_sdp);
+  }
+
+  for (i = 0; i < len; i++) {
+    const GstSDPMedia *remote_media =
+        gst_sdp_message_get_media (sdp_sess->remote_sdp, i);
+    const gchar *media_str = gst_sdp_media_get_media (remote_media);
+    const GstSDPMedia *local_media = NULL;
+    KmsSdpMediaHandler *handler;
+    KmsIRtpConnection *conn;
+
+    if ((g_strcmp0 (media_str, "audio") != 0 &&
+            g_strcmp0 (media_str, "video") != 0) ||
+        gst_sdp_media_get_port (remote_media) == 0) {
+      continue;
+    }
+
+    handler = kms_sdp_agent_get_handler_by_index (sdp_sess->agent, i);
+
+    if (handler == NULL) {
+      continue;
+    }
+
+    conn = kms_base_rtp_session_get_connection (sess, handler);
+    g_object_unref (handler);
+
+    if (conn == NULL) {
+      continue;
+    }
+
+    if (i < neg_len) {
+      local_media = gst_sdp_message_get_media (sdp_sess->neg_sdp, i);
+    }
+
+    for (j = 0; j < self->medias->len; j++) {
+      KmsRtpWatcherMedia *media =
+          &g_array_index (self->medias, KmsRtpWatcherMedia, j);
+
+      media->func (media->user_data, conn, remote_media, local_media);
+    }
+  }
+}
+
+/* Pads */
+
+static void
+kms_rtp_watcher_pad_free (KmsRtpWatcherPad * wpad)
+{
+  gint i;
+
+  for (i = 0; i < wpad->n_funcs; i++) {
+    KmsRtpWatcherPadFunc *pad_func = &wpad->funcs[i];
+
+    if (pad_func->notify != NULL) {
+      pad_func->notify (pad_func->user_data);
+    }
+  }
+
+  g_slice_free (KmsRtpWatcherPad, wpad);
+}
+
+static GstPadProbeReturn
+kms_rtp_watcher_pad_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsRtpWatcherPad * wpad)
+{
+  gint i, n_funcs = g_atomic_int_get (&wpad->n_funcs);
+
+  for (i = 0; i < n_funcs; i++) {
+    KmsRtpWatcherPadFunc *pad_func = &wpad->funcs[i];
+    GstPadProbeReturn ret;
+
+    if ((GST_PAD_PROBE_INFO_TYPE (info) & pad_func->mask) == 0) {
+      continue;
+    }
+
+    ret = pad_func->func (pad, info, pad_func->user_data);
+
+    if (ret != GST_PAD_PROBE_OK) {
+      return ret;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static KmsRtpWatcherPadFunc *
+kms_rtp_watcher_pad_lookup (KmsRtpWatcherPad * wpad, GstPadProbeCallback func)
+{
+  gint i;
+
+  for (i = 0; i < wpad->n_funcs; i++) {
+    if (wpad->funcs[i].func == func) {
+      return &wpad->funcs[i];
+    }
+  }
+
+  return NULL;
+}
+
+gboolean
+kms_rtp_watcher_add_pad_func (GstPad * pad, GstPadProbeType mask,
+    GstPadProbeCallback func, gpointer user_data, GDestroyNotify notify)
+{
+  KmsRtpWatcherPadFunc *pad_func;
+  KmsRtpWatcherPad *wpad;
+
+  kms_rtp_watcher_init ();
+
+  g_mutex_lock (&mutex);
+
+  wpad = g_object_get_data (G_OBJECT (pad), PAD_DATA);
+
+  if (wpad == NULL) {
+    wpad = g_slice_new0 (KmsRtpWatcherPad);
+    g_object_set_data_full (G_OBJECT (pad), PAD_DATA, wpad,
+        (GDestroyNotify) kms_rtp_watcher_pad_free);
+    gst_pad_add_probe (pad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+        (GstPadProbeCallback) kms_rtp_watcher_pad_probe, wpad, NULL);
+  } else if (kms_rtp_watcher_pad_lookup (wpad, func) != NULL) {
+    g_mutex_unlock (&mutex);
+    return FALSE;
+  }
+
+  if (wpad->n_funcs == MAX_PAD_FUNCS) {
+    g_mutex_unlock (&mutex);
+    GST_ERROR_OBJECT (pad, "Watched by too many functions");
+    return FALSE;
+  }
+
+  pad_func = &wpad->funcs[wpad->n_funcs];
+  pad_func->mask = mask;
+  pad_func->func = func;
+  pad_func->user_data = user_data;
+  pad_func->notify = notify;
+  g_atomic_int_inc (&wpad->n_funcs);
+
+  g_mutex_unlock (&mutex);
+
+  return TRUE;
+}
+
+gpointer
+kms_rtp_watcher_get_pad_data (GstPad * pad, GstPadProbeCallback func)
+{
+  KmsRtpWatcherPadFunc *pad_func = NULL;
+  KmsRtpWatcherPad *wpad;
+
+  g_mutex_lock (&mutex);
+
+  wpad = g_object_get_data (G_OBJECT (pad), PAD_DATA);
+
+  if (wpad != NULL) {
+    pad_func = kms_rtp_watcher_pad_lookup (wpad, func);
+  }
+
+  g_mutex_unlock (&mutex);
+
+  return pad_func != NULL ? pad_func->user_data : NULL;
+}
+
+gboolean
+kms_rtp_watcher_mark (gpointer object, const gchar * key)
+{
+  gboolean marked = FALSE;
+
+  g_mutex_lock (&mutex);
+
+  if (g_object_get_data (G_OBJECT (object), key) == NULL) {
+    g_object_set_data (G_OBJECT (object), key, GINT_TO_POINTER (TRUE));
+    marked = TRUE;
+  }
+
+  g_mutex_unlock (&mutex);
+
+  return marked;
+}
@@ -0,0 +1,71 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_RTP_WATCHER_H_
+#define _KMS_RTP_WATCHER_H_
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+#include <commons/kmsbasertpsession.h>
+#include <commons/kmsirtpconnection.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Connections of an endpoint, shared by the features that look at the RTP
+ * and RTCP going through them. Features add their functions once; the medias
+ * of a session are walked once for all of them, and each pad gets a single
+ * probe whatever the number of features watching it.
+ */
+typedef struct _KmsRtpWatcher KmsRtpWatcher;
+
+/* Called with @conn for each audio or video media in use. @local_media is
+ * the negotiated one, NULL when there is none */
+typedef void (*KmsRtpWatcherMediaFunc) (gpointer user_data,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media);
+
+KmsRtpWatcher *kms_rtp_watcher_new (void);
+void kms_rtp_watcher_free (KmsRtpWatcher * self);
+
+/* Functions are called in the order they were added, which is the order in
+ * which their pad functions see the packets. Must be added before the first
+ * session is watched */
+void kms_rtp_watcher_add_media_func (KmsRtpWatcher * self,
+    KmsRtpWatcherMediaFunc func, gpointer user_data);
+
+/* Calls the media functions for the connections of @sess. Must be called
+ * once the remote description is known, and again after each
+ * renegotiation */
+void kms_rtp_watcher_watch_session (KmsRtpWatcher * self,
+    KmsBaseRtpSession * sess);
+
+/* Calls @func with @user_data for the @mask data going through @pad, after
+ * the functions added to @pad before. Once one drops the data, the next ones
+ * do not see it. Bundled medias share the pads, and renegotiations find them
+ * again: when @func already watches @pad nothing is added and FALSE is
+ * returned. Otherwise @user_data is released with @notify along with @pad */
+gboolean kms_rtp_watcher_add_pad_func (GstPad * pad, GstPadProbeType mask,
+    GstPadProbeCallback func, gpointer user_data, GDestroyNotify notify);
+
+/* Data @func was added to @pad with, NULL when it does not watch it */
+gpointer kms_rtp_watcher_get_pad_data (GstPad * pad, GstPadProbeCallback func);
+
+/* Marks @object with @key. Returns FALSE if it already was */
+gboolean kms_rtp_watcher_mark (gpointer object, const gchar * key);
+
+G_END_DECLS
+#endif /* _KMS_RTP_WATCHER_H_ */
@@ -21,6 +21,8 @@
 
 #include <commons/kms-core-marshal.h>
 #include "kmsselectablemixer.h"
+#include "kmshubdrain.h"
+#include "kmsaudiogate.h"
 #include <commons/kmshubport.h>
 
 #define PLUGIN_NAME "selectablemixer"
@@ -46,6 +48,8 @@ struct _KmsSelectableMixerPrivate
 {
   GRecMutex mutex;
   GHashTable *ports;
+  KmsHubDrain *drain;
+  KmsAudioGate *audio_gate;
 };
 
 typedef struct _KmsSelectableMixerPortData KmsSelectableMixerPortData;
@@ -53,8 +57,12 @@ typedef struct _KmsSelectableMixerPortData KmsSelectableMixerPortData;
 struct _KmsSelectableMixerPortData
 {
   KmsSelectableMixer *mixer;
-  GstElement *audiomixer;
   gint id;
+
+  /* Each one is created the first time it is needed: the agnosticbins when
+   * the port is connected as a source of that media, the audiomixer when it
+   * is connected as an audio sink. Until then the input goes to the drain */
+  GstElement *audiomixer;
   GstElement *audio_agnostic;
   GstElement *video_agnostic;
 };
@@ -76,6 +84,14 @@ enum
 
 static guint obj_signals[LAST_SIGNAL] = { 0 };
 
+enum
+{
+  PROP_0,
+  PROP_SKIP_SILENT_AUDIO,
+  PROP_MIXED_AUDIO_INPUTS,
+  N_PROPERTIES
+};
+
 static void
 destroy_gint (gpointer data)
 {
@@ -198,6 +214,19 @@ disconnect_elements (GstElement * agnosticbin, GstElement * audiomixer)
   return disconnected;
 }
 
+static void
+kms_selectable_mixer_remove_element (KmsSelectableMixer * self,
+    GstElement ** element)
+{
+  if (*element == NULL) {
+    return;
+  }
+
+  gst_bin_remove (GST_BIN (self), *element);
+  gst_element_set_state (*element, GST_STATE_NULL);
+  g_clear_object (element);
+}
+
 static void
 kms_selectable_mixer_port_data_destroy (gpointer data)
 {
@@ -206,20 +235,20 @@ kms_selectable_mixer_port_data_destroy (gpointer data)
 
   KMS_SELECTABLE_MIXER_LOCK (self);
 
-  release_sink_pads (port_data->audiomixer);
-
-  gst_bin_remove_many (GST_BIN (self), port_data->audio_agnostic,
-      port_data->video_agnostic, port_data->audiomixer, NULL);
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_AUDIO);
+  kms_hub_drain_unlink (self->priv->drain, port_data->id,
+      KMS_ELEMENT_PAD_TYPE_VIDEO);
 
-  KMS_SELECTABLE_MIXER_LOCK (self);
+  if (port_data->audiomixer != NULL) {
+    release_sink_pads (port_data->audiomixer);
+  }
 
-  gst_element_set_state (port_data->audiomixer, GST_STATE_NULL);
-  gst_element_set_state (port_data->audio_agnostic, GST_STATE_NULL);
-  gst_element_set_state (port_data->video_agnostic, GST_STATE_NULL);
+  kms_selectable_mixer_remove_element (self, &port_data->audiomixer);
+  kms_selectable_mixer_remove_element (self, &port_data->audio_agnostic);
+  kms_selectable_mixer_remove_element (self, &port_data->video_agnostic);
 
-  g_clear_object (&port_data->audiomixer);
-  g_clear_object (&port_data->video_agnostic);
-  g_clear_object (&port_data->audio_agnostic);
+  KMS_SELECTABLE_MIXER_UNLOCK (self);
 
   g_slice_free (KmsSelectableMixerPortData, data);
 }
@@ -230,26 +259,68 @@ kms_selectable_mixer_port_data_create (KmsSelectableMixer * self, gint id)
   KmsSelectableMixerPortData *data = g_slice_new0 (KmsSelectableMixerPortData);
 
   data->mixer = self;
-  data->audiomixer = gst_element_factory_make ("audiomixerbin", NULL);
-  data->audio_agnostic = gst_element_factory_make ("agnosticbin", NULL);
-  data->video_agnostic = gst_element_factory_make ("agnosticbin", NULL);
   data->id = id;
 
-  gst_bin_add_many (GST_BIN (self), g_object_ref (data->audio_agnostic),
-      g_object_ref (data->video_agnostic), data->audiomixer, NULL);
+  kms_hub_drain_link (self->priv->drain, id, KMS_ELEMENT_PAD_TYPE_VIDEO);
+  kms_hub_drain_link (self->priv->drain, id, KMS_ELEMENT_PAD_TYPE_AUDIO);
+
+  return data;
+}
+
+/* Must be called with the lock held */
+static GstElement *
+kms_selectable_mixer_port_get_agnostic (KmsSelectableMixer * self,
+    KmsSelectableMixerPortData * data, KmsElementPadType type)
+{
+  GstElement **agnostic = type == KMS_ELEMENT_PAD_TYPE_VIDEO ?
+      &data->video_agnostic : &data->audio_agnostic;
+
+  if (*agnostic != NULL) {
+    return *agnostic;
+  }
+
+  GST_DEBUG_OBJECT (self, "Creating %s source branch of port %d",
+      type == KMS_ELEMENT_PAD_TYPE_VIDEO ? "video" : "audio", data->id);
+
+  *agnostic = gst_element_factory_make ("agnosticbin", NULL);
+  gst_bin_add (GST_BIN (self), g_object_ref (*agnostic));
+  gst_element_sync_state_with_parent (*agnostic);
+
+  kms_hub_drain_switch (self->priv->drain, data->id, type, *agnostic, "sink");
 
-  gst_element_sync_state_with_parent (data->audio_agnostic);
-  gst_element_sync_state_with_parent (data->video_agnostic);
+  return *agnostic;
+}
+
+static void
+kms_selectable_mixer_audiomixer_pad_added (GstElement * audiomixer,
+    GstPad * pad, KmsSelectableMixer * self)
+{
+  if (GST_PAD_IS_SINK (pad)) {
+    kms_audio_gate_watch_pad (self->priv->audio_gate, pad);
+  }
+}
+
+/* Must be called with the lock held */
+static GstElement *
+kms_selectable_mixer_port_get_audiomixer (KmsSelectableMixer * self,
+    KmsSelectableMixerPortData * data)
+{
+  if (data->audiomixer != NULL) {
+    return data->audiomixer;
+  }
+
+  GST_DEBUG_OBJECT (self, "Creating audio mixer of port %d", data->id);
+
+  data->audiomixer = gst_element_factory_make ("audiomixerbin", NULL);
+  g_signal_connect (data->audiomixer, "pad-added",
+      G_CALLBACK (kms_selectable_mixer_audiomixer_pad_added), self);
+  gst_bin_add (GST_BIN (self), g_object_ref (data->audiomixer));
   gst_element_sync_state_with_parent (data->audiomixer);
 
-  kms_base_hub_link_video_sink (KMS_BASE_HUB (self), id, data->video_agnostic,
-      "sink", FALSE);
-  kms_base_hub_link_audio_sink (KMS_BASE_HUB (self), id, data->audio_agnostic,
-      "sink", FALSE);
-  kms_base_hub_link_audio_src (KMS_BASE_HUB (self), id, data->audiomixer,
-      "src", FALSE);
+  kms_base_hub_link_audio_src (KMS_BASE_HUB (self), data->id,
+      data->audiomixer, "src", FALSE);
 
-  return data;
+  return data->audiomixer;
 }
 
 static void
@@ -267,6 +338,9 @@ kms_selectable_mixer_dispose (GObject * object)
     self->priv->ports = NULL;
   }
 
+  kms_hub_drain_free (self->priv->drain);
+  self->priv->drain = NULL;
+
   KMS_SELECTABLE_MIXER_UNLOCK (self);
 
   G_OBJECT_CLASS (kms_selectable_mixer_parent_class)->dispose (object);
@@ -280,10 +354,49 @@ kms_selectable_mixer_finalize (GObject * object)
   GST_DEBUG_OBJECT (self, "finalize");
 
   g_rec_mutex_clear (&self->priv->mutex);
+  kms_audio_gate_free (self->priv->audio_gate);
 
   G_OBJECT_CLASS (kms_selectable_mixer_parent_class)->finalize (object);
 }
 
+static void
+kms_selectable_mixer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsSelectableMixer *self = KMS_SELECTABLE_MIXER (object);
+
+  switch (property_id) {
+    case PROP_SKIP_SILENT_AUDIO:
+      kms_audio_gate_set_enabled (self->priv->audio_gate,
+          g_value_get_boolean (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_selectable_mixer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsSelectableMixer *self = KMS_SELECTABLE_MIXER (object);
+
+  switch (property_id) {
+    case PROP_SKIP_SILENT_AUDIO:
+      g_value_set_boolean (value,
+          kms_audio_gate_get_enabled (self->priv->audio_gate));
+      break;
+    case PROP_MIXED_AUDIO_INPUTS:
+      g_value_set_uint (value,
+          kms_audio_gate_get_mixed (self->priv->audio_gate));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
 static void
 kms_selectable_mixer_unhandle_port (KmsBaseHub * hub, gint id)
 {
@@ -347,7 +460,8 @@ kms_selectable_mixer_connect_video (KmsSelectableMixer * self, guint source,
 
   if (!(connected =
           kms_base_hub_link_video_src (KMS_BASE_HUB (self), sink_port->id,
-              source_port->video_agnostic, "src_%u", TRUE))) {
+              kms_selectable_mixer_port_get_agnostic (self, source_port,
+                  KMS_ELEMENT_PAD_TYPE_VIDEO), "src_%u", TRUE))) {
     GST_ERROR_OBJECT (self, "Can not connect video port");
   }
 
@@ -375,7 +489,9 @@ kms_selectable_mixer_connect_audio (KmsSelectableMixer * self, guint source,
   sink_port = g_hash_table_lookup (self->priv->ports, &sink);
   if (sink_port != NULL) {
     connected =
-        gst_element_link (source_port->audio_agnostic, sink_port->audiomixer);
+        gst_element_link (kms_selectable_mixer_port_get_agnostic (self,
+            source_port, KMS_ELEMENT_PAD_TYPE_AUDIO),
+        kms_selectable_mixer_port_get_audiomixer (self, sink_port));
   } else {
     GST_ERROR_OBJECT (self, "No sink port %u found", source);
   }
@@ -403,11 +519,15 @@ kms_selectable_mixer_disconnect_audio (KmsSelectableMixer * self, guint source,
   }
 
   sink_port = g_hash_table_lookup (self->priv->ports, &sink);
-  if (sink_port != NULL) {
+  if (sink_port == NULL) {
+    GST_ERROR_OBJECT (self, "No sink port %u found", source);
+  } else if (source_port->audio_agnostic != NULL &&
+      sink_port->audiomixer != NULL) {
     disconnected = disconnect_elements (source_port->audio_agnostic,
         sink_port->audiomixer);
   } else {
-    GST_ERROR_OBJECT (self, "No sink port %u found", source);
+    GST_DEBUG_OBJECT (self, "Audio of port %u never connected to port %u",
+        source, sink);
   }
 
 end:
@@ -436,12 +556,28 @@ kms_selectable_mixer_class_init (KmsSelectableMixerClass * klass)
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_selectable_mixer_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_selectable_mixer_finalize);
+  gobject_class->set_property =
+      GST_DEBUG_FUNCPTR (kms_selectable_mixer_set_property);
+  gobject_class->get_property =
+      GST_DEBUG_FUNCPTR (kms_selectable_mixer_get_property);
 
   base_hub_class->handle_port =
       GST_DEBUG_FUNCPTR (kms_selectable_mixer_handle_port);
   base_hub_class->unhandle_port =
       GST_DEBUG_FUNCPTR (kms_selectable_mixer_unhandle_port);
 
+  g_object_class_install_property (gobject_class, PROP_SKIP_SILENT_AUDIO,
+      g_param_spec_boolean ("skip-silent-audio", "Skip silent audio",
+          "Leave out of the audio mixes the sources that have been silent "
+          "for a while, or send DTX or comfort noise", TRUE,
+          G_PARAM_READWRITE));
+
+  /* A source connected to several sinks is counted once per sink */
+  g_object_class_install_property (gobject_class, PROP_MIXED_AUDIO_INPUTS,
+      g_param_spec_uint ("mixed-audio-inputs", "Mixed audio inputs",
+          "Number of audio connections whose source has voice", 0, G_MAXUINT,
+          0, G_PARAM_READABLE));
+
   /* Signals initialization */
   obj_signals[SIGNAL_CONNECT_VIDEO] =
       g_signal_new ("connect-video",
@@ -478,6 +614,9 @@ kms_selectable_mixer_init (KmsSelectableMixer * self)
   self->priv->ports = g_hash_table_new_full (g_int_hash, g_int_equal,
       destroy_gint, kms_selectable_mixer_port_data_destroy);
 
+  self->priv->drain = kms_hub_drain_new (KMS_BASE_HUB (self));
+  self->priv->audio_gate = kms_audio_gate_new ();
+
   g_rec_mutex_init (&self->priv->mutex);
 }
 
@@ -0,0 +1,228 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsstatssnapshot.h"
+
+#include <string.h>
+
+#define KMS_STATS_SNAPSHOT_FILL_FUNC_QUARK \
+  g_quark_from_static_string ("kms-stats-snapshot-fill-func")
+
+static const gchar *counter_names[KMS_STATS_N_COUNTERS] = {
+  "packets-received",
+  "bytes-received",
+  "packets-sent",
+  "bytes-sent",
+  "cpu-time",
+  "threads"
+};
+
+void
+kms_stats_snapshot_set_fill_func (GType type, KmsStatsSnapshotFillFunc func)
+{
+  /* Stored in the type instead of an interface, so that the plugin modules
+   * linking this helper do not register the same GType more than once */
+  g_type_set_qdata (type, KMS_STATS_SNAPSHOT_FILL_FUNC_QUARK, func);
+}
+
+static KmsStatsSnapshotFillFunc
+kms_stats_snapshot_get_fill_func (GType type, GQuark quark)
+{
+  gpointer func = NULL;
+
+  for (; type != 0 && func == NULL; type = g_type_parent (type)) {
+    func = g_type_get_qdata (type, quark);
+  }
+
+  return (KmsStatsSnapshotFillFunc) func;
+}
+
+/* Values reported last for an element, kept by each poller */
+typedef struct _KmsStatsSnapshotState
+{
+  GWeakRef element;             /* Detects addresses reused by new elements */
+  guint generation;
+  guint64 values[KMS_STATS_N_COUNTERS];
+} KmsStatsSnapshotState;
+
+struct _KmsStatsSnapshotPoller
+{
+  GMutex mutex;
+  GHashTable *states;           /* GstElement * -> KmsStatsSnapshotState */
+  guint generation;
+};
+
+static void
+kms_stats_snapshot_state_destroy (KmsStatsSnapshotState * state)
+{
+  g_weak_ref_clear (&state->element);
+  g_slice_free (KmsStatsSnapshotState, state);
+}
+
+KmsStatsSnapshotPoller *
+kms_stats_snapshot_poller_new (void)
+{
+  KmsStatsSnapshotPoller *self = g_slice_new0 (KmsStatsSnapshotPoller);
+
+  g_mutex_init (&self->mutex);
+  self->states = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) kms_stats_snapshot_state_destroy);
+
+  return self;
+}
+
+void
+kms_stats_snapshot_poller_free (KmsStatsSnapshotPoller * self)
+{
+  g_hash_table_unref (self->states);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsStatsSnapshotPoller, self);
+}
+
+static KmsStatsSnapshotState *
+kms_stats_snapshot_poller_get_state (KmsStatsSnapshotPoller * self,
+    GstElement * element)
+{
+  KmsStatsSnapshotState *state;
+  GstElement *current;
+
+  state = g_hash_table_lookup (self->states, element);
+
+  if (state != NULL) {
+    current = g_weak_ref_get (&state->element);
+
+    if (current != NULL) {
+      gst_object_unref (current);
+    }
+
+    if (current == element) {
+      return state;
+    }
+  }
+
+  /* Everything is reported as changed the first time an element is seen */
+  state = g_slice_new0 (KmsStatsSnapshotState);
+  g_weak_ref_init (&state->element, element);
+  g_hash_table_replace (self->states, element, state);
+
+  return state;
+}
+
+static void
+kms_stats_snapshot_poller_update_changed (KmsStatsSnapshotPoller * self,
+    KmsStatsSnapshot * snapshot)
+{
+  KmsStatsSnapshotState *state;
+  guint i;
+
+  state = kms_stats_snapshot_poller_get_state (self, snapshot->element);
+  state->generation = self->generation;
+  snapshot->changed = 0;
+
+  for (i = 0; i < KMS_STATS_N_COUNTERS; i++) {
+    if (snapshot->values[i] != state->values[i]) {
+      snapshot->changed |= KMS_STATS_COUNTER_MASK (i);
+      state->values[i] = snapshot->values[i];
+    }
+  }
+}
+
+static gboolean
+kms_stats_snapshot_state_is_stale (gpointer key, KmsStatsSnapshotState * state,
+    KmsStatsSnapshotPoller * self)
+{
+  return state->generation != self->generation;
+}
+
+guint
+kms_stats_snapshot_poller_collect (KmsStatsSnapshotPoller * self, GstBin * bin,
+    KmsStatsSnapshot * snapshots, guint n_snapshots)
+{
+  GQuark quark = KMS_STATS_SNAPSHOT_FILL_FUNC_QUARK;
+  guint i, n = 0, filled = 0;
+  GList *l;
+  gint64 now;
+
+  /* Children are only referenced while holding the lock, the fill funcs take
+   * their own locks and must not be called with the one of the bin */
+  GST_OBJECT_LOCK (bin);
+
+  for (l = GST_BIN_CHILDREN (bin); l != NULL && n < n_snapshots; l = l->next) {
+    if (kms_stats_snapshot_get_fill_func (G_OBJECT_TYPE (l->data),
+            quark) != NULL) {
+      snapshots[n++].element = gst_object_ref (l->data);
+    }
+  }
+
+  GST_OBJECT_UNLOCK (bin);
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&self->mutex);
+  self->generation++;
+
+  for (i = 0; i < n; i++) {
+    GstElement *element = snapshots[i].element;
+    KmsStatsSnapshotFillFunc func;
+
+    /* Entries with no changes are dropped, the rest are moved to the front */
+    snapshots[i].element = NULL;
+    func = kms_stats_snapshot_get_fill_func (G_OBJECT_TYPE (element), quark);
+
+    memset (snapshots[filled].values, 0, sizeof (snapshots[filled].values));
+    snapshots[filled].element = element;
+    snapshots[filled].timestamp = now;
+    func (element, &snapshots[filled]);
+    kms_stats_snapshot_poller_update_changed (self, &snapshots[filled]);
+
+    if (snapshots[filled].changed == 0) {
+      snapshots[filled].element = NULL;
+      gst_object_unref (element);
+      continue;
+    }
+
+    filled++;
+  }
+
+  /* Forget the elements that left the bin */
+  g_hash_table_foreach_remove (self->states,
+      (GHRFunc) kms_stats_snapshot_state_is_stale, self);
+
+  g_mutex_unlock (&self->mutex);
+
+  return filled;
+}
+
+void
+kms_stats_snapshot_clear (KmsStatsSnapshot * snapshot)
+{
+  if (snapshot->element != NULL) {
+    gst_object_unref (snapshot->element);
+    snapshot->element = NULL;
+  }
+}
+
+const gchar *
+kms_stats_snapshot_get_counter_name (KmsStatsCounter counter)
+{
+  g_return_val_if_fail (counter < KMS_STATS_N_COUNTERS, NULL);
+
+  return counter_names[counter];
+}
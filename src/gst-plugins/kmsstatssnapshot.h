@@ -0,0 +1,80 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_STATS_SNAPSHOT_H_
+#define _KMS_STATS_SNAPSHOT_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Flat stats path for pollers that need counters of many elements often.
+ *
+ * Unlike KmsElement::stats, nothing is allocated per request: each element
+ * writes its counters into a preallocated KmsStatsSnapshot, and all the
+ * elements of a bin are polled with a single
+ * kms_stats_snapshot_poller_collect () call. Each poller remembers the values
+ * it reported last, so several of them can poll the same elements.
+ */
+typedef enum
+{
+  KMS_STATS_COUNTER_PACKETS_RECEIVED,
+  KMS_STATS_COUNTER_BYTES_RECEIVED,
+  KMS_STATS_COUNTER_PACKETS_SENT,
+  KMS_STATS_COUNTER_BYTES_SENT,
+  KMS_STATS_COUNTER_CPU_TIME,       /* us, only while media stats are enabled */
+  KMS_STATS_COUNTER_THREADS,
+  KMS_STATS_N_COUNTERS
+} KmsStatsCounter;
+
+#define KMS_STATS_COUNTER_MASK(counter) (G_GUINT64_CONSTANT (1) << (counter))
+
+typedef struct _KmsStatsSnapshot
+{
+  GstElement *element;          /* Owned, see kms_stats_snapshot_clear () */
+  gint64 timestamp;             /* Monotonic time, in microseconds */
+  guint64 changed;              /* KMS_STATS_COUNTER_MASK of changed values */
+  guint64 values[KMS_STATS_N_COUNTERS];
+} KmsStatsSnapshot;
+
+typedef struct _KmsStatsSnapshotPoller KmsStatsSnapshotPoller;
+
+/* Adds the current counters of @element to @snapshot->values, which are
+ * zeroed before calling it */
+typedef void (*KmsStatsSnapshotFillFunc) (GstElement * element,
+    KmsStatsSnapshot * snapshot);
+
+/* Called from class_init. Subclasses of @type inherit @func */
+void kms_stats_snapshot_set_fill_func (GType type,
+    KmsStatsSnapshotFillFunc func);
+
+KmsStatsSnapshotPoller *kms_stats_snapshot_poller_new (void);
+void kms_stats_snapshot_poller_free (KmsStatsSnapshotPoller * poller);
+
+/* Fills the first entries of @snapshots, up to @n_snapshots, with the direct
+ * children of @bin that have a fill func and counters changed since the
+ * previous call with the same @poller. Returns the number of entries filled;
+ * they must be cleared by the caller. */
+guint kms_stats_snapshot_poller_collect (KmsStatsSnapshotPoller * poller,
+    GstBin * bin, KmsStatsSnapshot * snapshots, guint n_snapshots);
+
+void kms_stats_snapshot_clear (KmsStatsSnapshot * snapshot);
+
+const gchar *kms_stats_snapshot_get_counter_name (KmsStatsCounter counter);
+
+G_END_DECLS
+#endif /* _KMS_STATS_SNAPSHOT_H_ */
@@ -0,0 +1,630 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "kmsstripecompositor.h"
+#include "kmsstripecompositorbackground.h"
+#include "kms-elements-enumtypes.h"
+
+#define PLUGIN_NAME "kmsstripecompositor"
+
+GST_DEBUG_CATEGORY_STATIC (kms_stripe_compositor_debug_category);
+#define GST_CAT_DEFAULT kms_stripe_compositor_debug_category
+
+#define KMS_STRIPE_COMPOSITOR_GET_PRIVATE(obj) (  \
+  G_TYPE_INSTANCE_GET_PRIVATE (                   \
+    (obj),                                        \
+    KMS_TYPE_STRIPE_COMPOSITOR,                   \
+    KmsStripeCompositorPrivate                    \
+  )                                               \
+)
+
+#define KMS_STRIPE_COMPOSITOR_LOCK(obj) \
+  (g_mutex_lock (&KMS_STRIPE_COMPOSITOR (obj)->priv->mutex))
+#define KMS_STRIPE_COMPOSITOR_UNLOCK(obj) \
+  (g_mutex_unlock (&KMS_STRIPE_COMPOSITOR (obj)->priv->mutex))
+
+#define DEFAULT_PAD_XPOS 0
+#define DEFAULT_PAD_YPOS 0
+#define DEFAULT_PAD_ALPHA 1.0
+
+#define DEFAULT_BACKGROUND KMS_STRIPE_COMPOSITOR_BACKGROUND_BLACK
+#define DEFAULT_BLEND_THREADS 1
+
+/* Thinner stripes cost more in synchronization than they save in blending */
+#define MIN_STRIPE_HEIGHT 32
+
+/* Inputs are converted to the output format by the aggregator */
+#define SINK_FORMATS "{ AYUV, BGRA, ARGB, RGBA, ABGR, Y444, Y42B, YUY2, UYVY, " \
+  "YVYU, I420, YV12, NV12, NV21, Y41B, RGB, BGR, xRGB, xBGR, RGBx, BGRx }"
+#define SRC_FORMATS "{ AYUV, I420 }"
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (SINK_FORMATS))
+    );
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (SRC_FORMATS))
+    );
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_ALPHA
+};
+
+enum
+{
+  PROP_0,
+  PROP_BACKGROUND,
+  PROP_BLEND_THREADS,
+  N_PROPERTIES
+};
+
+struct _KmsStripeCompositorPrivate
+{
+  KmsStripeCompositorBackground background;     /* Atomic */
+  guint blend_threads;          /* Atomic, 0 means one per CPU */
+
+  /* Only used from the aggregator thread, and the workers while it waits */
+  GThreadPool *pool;
+  GMutex mutex;
+  GCond cond;
+  guint pending;
+};
+
+/* An input as it is blended in the frame being composed */
+typedef struct _KmsStripeLayer
+{
+  GstVideoFrame *frame;
+  gint xpos, ypos;
+  guint alpha;                  /* 0 to 255 */
+} KmsStripeLayer;
+
+typedef struct _KmsStripeJob
+{
+  GstVideoFrame *out;
+  KmsStripeCompositorBackground background;
+  KmsStripeLayer *layers;
+  guint n_layers;
+  gint y_start, y_end;
+} KmsStripeJob;
+
+G_DEFINE_TYPE (KmsStripeCompositorPad, kms_stripe_compositor_pad,
+    GST_TYPE_VIDEO_AGGREGATOR_PAD);
+
+G_DEFINE_TYPE_WITH_CODE (KmsStripeCompositor, kms_stripe_compositor,
+    GST_TYPE_VIDEO_AGGREGATOR,
+    GST_DEBUG_CATEGORY_INIT (kms_stripe_compositor_debug_category, PLUGIN_NAME,
+        0, "debug category for stripe compositor element"));
+
+static void
+kms_stripe_compositor_pad_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsStripeCompositorPad *pad = KMS_STRIPE_COMPOSITOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+
+  switch (property_id) {
+    case PROP_PAD_XPOS:
+      pad->xpos = g_value_get_int (value);
+      break;
+    case PROP_PAD_YPOS:
+      pad->ypos = g_value_get_int (value);
+      break;
+    case PROP_PAD_ALPHA:
+      pad->alpha = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+kms_stripe_compositor_pad_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsStripeCompositorPad *pad = KMS_STRIPE_COMPOSITOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+
+  switch (property_id) {
+    case PROP_PAD_XPOS:
+      g_value_set_int (value, pad->xpos);
+      break;
+    case PROP_PAD_YPOS:
+      g_value_set_int (value, pad->ypos);
+      break;
+    case PROP_PAD_ALPHA:
+      g_value_set_double (value, pad->alpha);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+kms_stripe_compositor_pad_class_init (KmsStripeCompositorPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = kms_stripe_compositor_pad_set_property;
+  gobject_class->get_property = kms_stripe_compositor_pad_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
+      g_param_spec_int ("xpos", "X Position", "X position of the picture",
+          G_MININT, G_MAXINT, DEFAULT_PAD_XPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_YPOS,
+      g_param_spec_int ("ypos", "Y Position", "Y position of the picture",
+          G_MININT, G_MAXINT, DEFAULT_PAD_YPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_ALPHA,
+      g_param_spec_double ("alpha", "Alpha", "Alpha of the picture", 0.0, 1.0,
+          DEFAULT_PAD_ALPHA,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+kms_stripe_compositor_pad_init (KmsStripeCompositorPad * pad)
+{
+  pad->xpos = DEFAULT_PAD_XPOS;
+  pad->ypos = DEFAULT_PAD_YPOS;
+  pad->alpha = DEFAULT_PAD_ALPHA;
+}
+
+static void
+kms_stripe_compositor_fill_background (GstVideoFrame * out,
+    KmsStripeCompositorBackground background, gint y_start, gint y_end)
+{
+  guint8 y = background == KMS_STRIPE_COMPOSITOR_BACKGROUND_WHITE ? 235 : 16;
+  gint comp;
+
+  if (GST_VIDEO_FRAME_FORMAT (out) == GST_VIDEO_FORMAT_AYUV) {
+    guint8 a = background == KMS_STRIPE_COMPOSITOR_BACKGROUND_TRANSPARENT ?
+        0x00 : 0xff;
+    gint width = GST_VIDEO_FRAME_WIDTH (out);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (out, 0);
+    guint8 *row = GST_VIDEO_FRAME_PLANE_DATA (out, 0);
+    gint r, x;
+
+    for (r = y_start; r < y_end; r++) {
+      guint8 *pixel = row + r * stride;
+
+      for (x = 0; x < width; x++, pixel += 4) {
+        pixel[0] = a;
+        pixel[1] = y;
+        pixel[2] = 128;
+        pixel[3] = 128;
+      }
+    }
+
+    return;
+  }
+
+  /* I420 has no alpha, a transparent background is black */
+  for (comp = 0; comp < 3; comp++) {
+    const GstVideoFormatInfo *finfo = out->info.finfo;
+    gint h_sub = GST_VIDEO_FORMAT_INFO_H_SUB (finfo, comp);
+    gint stride = GST_VIDEO_FRAME_COMP_STRIDE (out, comp);
+    guint8 *data = GST_VIDEO_FRAME_COMP_DATA (out, comp);
+    gint r, r_end;
+
+    r_end = MIN (GST_VIDEO_SUB_SCALE (h_sub, y_end),
+        GST_VIDEO_FRAME_COMP_HEIGHT (out, comp));
+
+    for (r = y_start >> h_sub; r < r_end; r++) {
+      memset (data + r * stride, comp == 0 ? y : 128,
+          GST_VIDEO_FRAME_COMP_WIDTH (out, comp));
+    }
+  }
+}
+
+static void
+kms_stripe_compositor_blend_ayuv (GstVideoFrame * out,
+    const KmsStripeLayer * layer, gint x0, gint x1, gint y0, gint y1)
+{
+  gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (layer->frame, 0);
+  gint dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE (out, 0);
+  const guint8 *src_data = GST_VIDEO_FRAME_PLANE_DATA (layer->frame, 0);
+  guint8 *dest_data = GST_VIDEO_FRAME_PLANE_DATA (out, 0);
+  gint r, x;
+
+  for (r = y0; r < y1; r++) {
+    const guint8 *src = src_data + (r - layer->ypos) * src_stride +
+        (x0 - layer->xpos) * 4;
+    guint8 *dest = dest_data + r * dest_stride + x0 * 4;
+
+    for (x = x0; x < x1; x++, src += 4, dest += 4) {
+      guint a = src[0] * layer->alpha / 255;
+
+      if (a == 0) {
+        continue;
+      }
+
+      if (a == 255) {
+        memcpy (dest, src, 4);
+        continue;
+      }
+
+      dest[0] = a + dest[0] * (255 - a) / 255;
+      dest[1] = (src[1] * a + dest[1] * (255 - a)) / 255;
+      dest[2] = (src[2] * a + dest[2] * (255 - a)) / 255;
+      dest[3] = (src[3] * a + dest[3] * (255 - a)) / 255;
+    }
+  }
+}
+
+static void
+kms_stripe_compositor_blend_i420 (GstVideoFrame * out,
+    const KmsStripeLayer * layer, gint x0, gint x1, gint y0, gint y1)
+{
+  const GstVideoFormatInfo *finfo = out->info.finfo;
+  gint comp;
+
+  for (comp = 0; comp < 3; comp++) {
+    gint w_sub = GST_VIDEO_FORMAT_INFO_W_SUB (finfo, comp);
+    gint h_sub = GST_VIDEO_FORMAT_INFO_H_SUB (finfo, comp);
+    gint src_stride = GST_VIDEO_FRAME_COMP_STRIDE (layer->frame, comp);
+    gint dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (out, comp);
+    const guint8 *src_data = GST_VIDEO_FRAME_COMP_DATA (layer->frame, comp);
+    guint8 *dest_data = GST_VIDEO_FRAME_COMP_DATA (out, comp);
+    gint dx0, dx1, dy0, dy1, sx, sy, r, x;
+
+    /* Stripes start at even rows, so chroma rows are never shared */
+    dx0 = x0 >> w_sub;
+    dx1 = MIN (GST_VIDEO_SUB_SCALE (w_sub, x1),
+        GST_VIDEO_FRAME_COMP_WIDTH (out, comp));
+    dy0 = y0 >> h_sub;
+    dy1 = MIN (GST_VIDEO_SUB_SCALE (h_sub, y1),
+        GST_VIDEO_FRAME_COMP_HEIGHT (out, comp));
+    sx = dx0 - (layer->xpos >> w_sub);
+    sy = dy0 - (layer->ypos >> h_sub);
+    dx1 = MIN (dx1, dx0 + GST_VIDEO_FRAME_COMP_WIDTH (layer->frame, comp) -
+        sx);
+    dy1 = MIN (dy1, dy0 + GST_VIDEO_FRAME_COMP_HEIGHT (layer->frame, comp) -
+        sy);
+
+    if (dx0 >= dx1) {
+      continue;
+    }
+
+    for (r = dy0; r < dy1; r++) {
+      const guint8 *src = src_data + (sy + r - dy0) * src_stride + sx;
+      guint8 *dest = dest_data + r * dest_stride + dx0;
+
+      if (layer->alpha == 255) {
+        memcpy (dest, src, dx1 - dx0);
+        continue;
+      }
+
+      for (x = dx0; x < dx1; x++, src++, dest++) {
+        *dest = (*src * layer->alpha + *dest * (255 - layer->alpha)) / 255;
+      }
+    }
+  }
+}
+
+static void
+kms_stripe_compositor_blend_stripe (KmsStripeJob * job)
+{
+  gint width = GST_VIDEO_FRAME_WIDTH (job->out);
+  guint i;
+
+  kms_stripe_compositor_fill_background (job->out, job->background,
+      job->y_start, job->y_end);
+
+  /* Layers are sorted by zorder, the last one is on top */
+  for (i = 0; i < job->n_layers; i++) {
+    const KmsStripeLayer *layer = &job->layers[i];
+    gint x0, x1, y0, y1;
+
+    x0 = MAX (layer->xpos, 0);
+    x1 = MIN (layer->xpos + GST_VIDEO_FRAME_WIDTH (layer->frame), width);
+    y0 = MAX (layer->ypos, job->y_start);
+    y1 = MIN (layer->ypos + GST_VIDEO_FRAME_HEIGHT (layer->frame), job->y_end);
+
+    if (x0 >= x1 || y0 >= y1) {
+      continue;
+    }
+
+    if (GST_VIDEO_FRAME_FORMAT (job->out) == GST_VIDEO_FORMAT_AYUV) {
+      kms_stripe_compositor_blend_ayuv (job->out, layer, x0, x1, y0, y1);
+    } else {
+      kms_stripe_compositor_blend_i420 (job->out, layer, x0, x1, y0, y1);
+    }
+  }
+}
+
+static void
+kms_stripe_compositor_worker (KmsStripeJob * job, KmsStripeCompositor * self)
+{
+  kms_stripe_compositor_blend_stripe (job);
+
+  KMS_STRIPE_COMPOSITOR_LOCK (self);
+  if (--self->priv->pending == 0) {
+    g_cond_signal (&self->priv->cond);
+  }
+  KMS_STRIPE_COMPOSITOR_UNLOCK (self);
+}
+
+static guint
+kms_stripe_compositor_get_threads (KmsStripeCompositor * self)
+{
+  guint threads = g_atomic_int_get (&self->priv->blend_threads);
+
+  return threads == 0 ? g_get_num_processors () : threads;
+}
+
+/* Only called from the aggregator thread */
+static gboolean
+kms_stripe_compositor_update_pool (KmsStripeCompositor * self, guint workers)
+{
+  GError *err = NULL;
+
+  if (self->priv->pool == NULL) {
+    self->priv->pool = g_thread_pool_new ((GFunc) kms_stripe_compositor_worker,
+        self, workers, TRUE, &err);
+  } else if ((guint) g_thread_pool_get_max_threads (self->priv->pool) !=
+      workers) {
+    g_thread_pool_set_max_threads (self->priv->pool, workers, &err);
+  } else {
+    return TRUE;
+  }
+
+  if (err != NULL) {
+    GST_WARNING_OBJECT (self, "Cannot start %u blending threads: %s", workers,
+        err->message);
+    g_error_free (err);
+  }
+
+  return self->priv->pool != NULL &&
+      g_thread_pool_get_num_threads (self->priv->pool) > 0;
+}
+
+/* Returns the visible inputs sorted by zorder, to be freed with g_free */
+static KmsStripeLayer *
+kms_stripe_compositor_get_layers (KmsStripeCompositor * self, guint * n_layers)
+{
+  KmsStripeLayer *layers;
+  GList *l;
+  guint n = 0;
+
+  GST_OBJECT_LOCK (self);
+
+  layers = g_new (KmsStripeLayer, GST_ELEMENT (self)->numsinkpads);
+
+  for (l = GST_ELEMENT (self)->sinkpads; l != NULL; l = l->next) {
+    GstVideoAggregatorPad *vpad = l->data;
+    KmsStripeCompositorPad *pad = KMS_STRIPE_COMPOSITOR_PAD (vpad);
+
+    if (vpad->aggregated_frame == NULL) {
+      continue;
+    }
+
+    GST_OBJECT_LOCK (pad);
+    layers[n].frame = vpad->aggregated_frame;
+    layers[n].xpos = pad->xpos;
+    layers[n].ypos = pad->ypos;
+    layers[n].alpha = (guint) (pad->alpha * 255.0 + 0.5);
+    GST_OBJECT_UNLOCK (pad);
+
+    if (layers[n].alpha > 0) {
+      n++;
+    }
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  *n_layers = n;
+
+  return layers;
+}
+
+static GstFlowReturn
+kms_stripe_compositor_aggregate_frames (GstVideoAggregator * vagg,
+    GstBuffer * outbuf)
+{
+  KmsStripeCompositor *self = KMS_STRIPE_COMPOSITOR (vagg);
+  gint height = GST_VIDEO_INFO_HEIGHT (&vagg->info);
+  KmsStripeLayer *layers;
+  KmsStripeJob *jobs;
+  GstVideoFrame out;
+  guint n_stripes, n_layers, i;
+  gint stripe_height;
+
+  if (!gst_video_frame_map (&out, &vagg->info, outbuf, GST_MAP_WRITE)) {
+    GST_ERROR_OBJECT (self, "Cannot map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  /* Frames stay valid until this function returns */
+  layers = kms_stripe_compositor_get_layers (self, &n_layers);
+
+  n_stripes = kms_stripe_compositor_get_threads (self);
+  n_stripes = MIN (n_stripes, MAX (height / MIN_STRIPE_HEIGHT, 1));
+
+  if (n_stripes > 1 &&
+      !kms_stripe_compositor_update_pool (self, n_stripes - 1)) {
+    n_stripes = 1;
+  }
+
+  /* Even heights, so that no chroma row is shared by two stripes */
+  stripe_height = ((height + n_stripes - 1) / n_stripes + 1) & ~1;
+  n_stripes = (height + stripe_height - 1) / stripe_height;
+
+  jobs = g_new (KmsStripeJob, n_stripes);
+
+  for (i = 0; i < n_stripes; i++) {
+    jobs[i].out = &out;
+    jobs[i].background = g_atomic_int_get (&self->priv->background);
+    jobs[i].layers = layers;
+    jobs[i].n_layers = n_layers;
+    jobs[i].y_start = i * stripe_height;
+    jobs[i].y_end = MIN (jobs[i].y_start + stripe_height, height);
+  }
+
+  self->priv->pending = n_stripes - 1;
+
+  for (i = 1; i < n_stripes; i++) {
+    g_thread_pool_push (self->priv->pool, &jobs[i], NULL);
+  }
+
+  /* This thread blends the first stripe instead of just waiting */
+  kms_stripe_compositor_blend_stripe (&jobs[0]);
+
+  KMS_STRIPE_COMPOSITOR_LOCK (self);
+  while (self->priv->pending > 0) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+  KMS_STRIPE_COMPOSITOR_UNLOCK (self);
+
+  g_free (jobs);
+  g_free (layers);
+  gst_video_frame_unmap (&out);
+
+  return GST_FLOW_OK;
+}
+
+static void
+kms_stripe_compositor_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsStripeCompositor *self = KMS_STRIPE_COMPOSITOR (object);
+
+  switch (property_id) {
+    case PROP_BACKGROUND:
+      g_atomic_int_set (&self->priv->background, g_value_get_enum (value));
+      break;
+    case PROP_BLEND_THREADS:
+      g_atomic_int_set (&self->priv->blend_threads, g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_stripe_compositor_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsStripeCompositor *self = KMS_STRIPE_COMPOSITOR (object);
+
+  switch (property_id) {
+    case PROP_BACKGROUND:
+      g_value_set_enum (value, g_atomic_int_get (&self->priv->background));
+      break;
+    case PROP_BLEND_THREADS:
+      g_value_set_uint (value, g_atomic_int_get (&self->priv->blend_threads));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_stripe_compositor_finalize (GObject * object)
+{
+  KmsStripeCompositor *self = KMS_STRIPE_COMPOSITOR (object);
+
+  if (self->priv->pool != NULL) {
+    g_thread_pool_free (self->priv->pool, FALSE, TRUE);
+  }
+
+  g_mutex_clear (&self->priv->mutex);
+  g_cond_clear (&self->priv->cond);
+
+  G_OBJECT_CLASS (kms_stripe_compositor_parent_class)->finalize (object);
+}
+
+static void
+kms_stripe_compositor_class_init (KmsStripeCompositorClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstAggregatorClass *agg_class = GST_AGGREGATOR_CLASS (klass);
+  GstVideoAggregatorClass *vagg_class = GST_VIDEO_AGGREGATOR_CLASS (klass);
+
+  gobject_class->set_property = kms_stripe_compositor_set_property;
+  gobject_class->get_property = kms_stripe_compositor_get_property;
+  gobject_class->finalize = kms_stripe_compositor_finalize;
+
+  agg_class->sinkpads_type = KMS_TYPE_STRIPE_COMPOSITOR_PAD;
+  vagg_class->aggregate_frames =
+      GST_DEBUG_FUNCPTR (kms_stripe_compositor_aggregate_frames);
+
+  g_object_class_install_property (gobject_class, PROP_BACKGROUND,
+      g_param_spec_enum ("background", "Background", "Background type",
+          KMS_TYPE_STRIPE_COMPOSITOR_BACKGROUND, DEFAULT_BACKGROUND,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BLEND_THREADS,
+      g_param_spec_uint ("blend-threads", "Blend threads",
+          "Threads blending horizontal stripes of each output frame, "
+          "0 for one per CPU", 0, G_MAXINT, DEFAULT_BLEND_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "Stripe compositor", "Filter/Editor/Video/Compositor",
+      "Composes video inputs blending stripes of the output in parallel",
+      "Kurento <kurento@googlegroups.com>");
+
+  g_type_class_add_private (klass, sizeof (KmsStripeCompositorPrivate));
+}
+
+static void
+kms_stripe_compositor_init (KmsStripeCompositor * self)
+{
+  self->priv = KMS_STRIPE_COMPOSITOR_GET_PRIVATE (self);
+
+  self->priv->background = DEFAULT_BACKGROUND;
+  self->priv->blend_threads = DEFAULT_BLEND_THREADS;
+
+  g_mutex_init (&self->priv->mutex);
+  g_cond_init (&self->priv->cond);
+}
+
+gboolean
+kms_stripe_compositor_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_STRIPE_COMPOSITOR);
+}
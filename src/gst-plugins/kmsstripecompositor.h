@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_STRIPE_COMPOSITOR_H_
+#define _KMS_STRIPE_COMPOSITOR_H_
+
+#include <gst/video/gstvideoaggregator.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_STRIPE_COMPOSITOR_PAD kms_stripe_compositor_pad_get_type()
+#define KMS_STRIPE_COMPOSITOR_PAD(obj) (      \
+  G_TYPE_CHECK_INSTANCE_CAST (                \
+    (obj),                                    \
+    KMS_TYPE_STRIPE_COMPOSITOR_PAD,           \
+    KmsStripeCompositorPad                    \
+  )                                           \
+)
+#define KMS_IS_STRIPE_COMPOSITOR_PAD(obj) (   \
+  G_TYPE_CHECK_INSTANCE_TYPE (                \
+    (obj),                                    \
+    KMS_TYPE_STRIPE_COMPOSITOR_PAD            \
+  )                                           \
+)
+#define KMS_TYPE_STRIPE_COMPOSITOR kms_stripe_compositor_get_type()
+#define KMS_STRIPE_COMPOSITOR(obj) (          \
+  G_TYPE_CHECK_INSTANCE_CAST (                \
+    (obj),                                    \
+    KMS_TYPE_STRIPE_COMPOSITOR,               \
+    KmsStripeCompositor                       \
+  )                                           \
+)
+#define KMS_STRIPE_COMPOSITOR_CLASS(klass) (  \
+  G_TYPE_CHECK_CLASS_CAST (                   \
+    (klass),                                  \
+    KMS_TYPE_STRIPE_COMPOSITOR,               \
+    KmsStripeCompositorClass                  \
+  )                                           \
+)
+#define KMS_IS_STRIPE_COMPOSITOR(obj) (       \
+  G_TYPE_CHECK_INSTANCE_TYPE (                \
+    (obj),                                    \
+    KMS_TYPE_STRIPE_COMPOSITOR                \
+  )                                           \
+)
+#define KMS_IS_STRIPE_COMPOSITOR_CLASS(klass) ( \
+  G_TYPE_CHECK_CLASS_TYPE ((klass),             \
+  KMS_TYPE_STRIPE_COMPOSITOR)                   \
+)
+
+typedef struct _KmsStripeCompositorPad KmsStripeCompositorPad;
+typedef struct _KmsStripeCompositorPadClass KmsStripeCompositorPadClass;
+typedef struct _KmsStripeCompositor KmsStripeCompositor;
+typedef struct _KmsStripeCompositorClass KmsStripeCompositorClass;
+typedef struct _KmsStripeCompositorPrivate KmsStripeCompositorPrivate;
+
+struct _KmsStripeCompositorPad
+{
+  GstVideoAggregatorPad parent;
+
+  /*< private > */
+  gint xpos, ypos;
+  gdouble alpha;
+};
+
+struct _KmsStripeCompositorPadClass
+{
+  GstVideoAggregatorPadClass parent_class;
+};
+
+/*
+ * Drop-in replacement of the GStreamer compositor for the mixers. Inputs are
+ * placed with the xpos, ypos, alpha and zorder pad properties, already scaled
+ * to their tile. Each output frame is split in horizontal stripes that are
+ * blended in parallel by a worker pool owned by the element, so that big
+ * layouts are not limited by the aggregator thread alone.
+ */
+struct _KmsStripeCompositor
+{
+  GstVideoAggregator parent;
+
+  /*< private > */
+  KmsStripeCompositorPrivate *priv;
+};
+
+struct _KmsStripeCompositorClass
+{
+  GstVideoAggregatorClass parent_class;
+};
+
+GType kms_stripe_compositor_pad_get_type (void);
+GType kms_stripe_compositor_get_type (void);
+
+gboolean kms_stripe_compositor_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* _KMS_STRIPE_COMPOSITOR_H_ */
@@ -0,0 +1,254 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsthreadcpu.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#define GST_CAT_DEFAULT kms_thread_cpu_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+typedef struct _KmsThreadCpuEntry
+{
+  clockid_t clock;
+  guint64 start;                /* Thread CPU time when it entered the task */
+} KmsThreadCpuEntry;
+
+struct _KmsThreadCpu
+{
+  GMutex mutex;
+  gboolean enabled;
+
+  GHashTable *threads;          /* <GThread *, KmsThreadCpuEntry> */
+
+  /* CPU time of the threads that already left their task */
+  guint64 finished;
+
+  /* Totals at the previous sample, to compute usage */
+  guint64 last_total;
+  gint64 last_sample;
+  guint64 enabled_total;
+};
+
+static void
+kms_thread_cpu_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "threadcpu", 0,
+        "Streaming thread CPU accounting");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+static guint64
+kms_thread_cpu_read_clock (clockid_t clock)
+{
+  struct timespec ts;
+
+  if (clock_gettime (clock, &ts) != 0) {
+    return 0;
+  }
+
+  return (guint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+KmsThreadCpu *
+kms_thread_cpu_new (void)
+{
+  KmsThreadCpu *self;
+
+  kms_thread_cpu_init ();
+
+  self = g_slice_new0 (KmsThreadCpu);
+  g_mutex_init (&self->mutex);
+  self->threads = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      g_free);
+
+  return self;
+}
+
+void
+kms_thread_cpu_free (KmsThreadCpu * self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  g_hash_table_unref (self->threads);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsThreadCpu, self);
+}
+
+/* Must be called with the mutex held */
+static guint64
+kms_thread_cpu_get_total (KmsThreadCpu * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint64 total = self->finished;
+
+  g_hash_table_iter_init (&iter, self->threads);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsThreadCpuEntry *entry = value;
+    guint64 now = kms_thread_cpu_read_clock (entry->clock);
+
+    if (now > entry->start) {
+      total += now - entry->start;
+    }
+  }
+
+  return total;
+}
+
+void
+kms_thread_cpu_set_enabled (KmsThreadCpu * self, gboolean enabled)
+{
+  g_mutex_lock (&self->mutex);
+
+  if (enabled && !self->enabled) {
+    self->enabled_total = kms_thread_cpu_get_total (self);
+    self->last_total = self->enabled_total;
+    self->last_sample = g_get_monotonic_time ();
+  }
+
+  self->enabled = enabled;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_thread_cpu_handle_message (KmsThreadCpu * self, GstMessage * msg)
+{
+  GstStreamStatusType type;
+  KmsThreadCpuEntry *entry;
+  GThread *thread;
+  clockid_t clock;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS) {
+    return;
+  }
+
+  gst_message_parse_stream_status (msg, &type, NULL);
+
+  if (type != GST_STREAM_STATUS_TYPE_ENTER &&
+      type != GST_STREAM_STATUS_TYPE_LEAVE) {
+    return;
+  }
+
+  /* Enter and leave are posted by the streaming thread itself. Threads are
+   * tracked even while accounting is disabled, it is done once per task and
+   * otherwise threads started before enabling it would be missed */
+  thread = g_thread_self ();
+
+  if (pthread_getcpuclockid (pthread_self (), &clock) != 0) {
+    GST_WARNING ("Can not get CPU clock of thread %p", (gpointer) thread);
+    return;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+    entry = g_new (KmsThreadCpuEntry, 1);
+    entry->clock = clock;
+    /* Pooled threads may have run other tasks before */
+    entry->start = kms_thread_cpu_read_clock (clock);
+    g_hash_table_insert (self->threads, thread, entry);
+    GST_TRACE ("Thread %p entered task of %s", (gpointer) thread,
+        GST_MESSAGE_SRC_NAME (msg));
+  } else {
+    entry = g_hash_table_lookup (self->threads, thread);
+
+    if (entry != NULL) {
+      guint64 now = kms_thread_cpu_read_clock (clock);
+
+      if (now > entry->start) {
+        self->finished += now - entry->start;
+      }
+
+      g_hash_table_remove (self->threads, thread);
+      GST_TRACE ("Thread %p left task of %s", (gpointer) thread,
+          GST_MESSAGE_SRC_NAME (msg));
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_thread_cpu_add_stats (KmsThreadCpu * self, GstStructure * stats)
+{
+  GstStructure *cpu_stats;
+  guint64 total;
+  gint64 now;
+  gdouble usage = 0.0;
+  guint threads;
+
+  g_mutex_lock (&self->mutex);
+
+  if (!self->enabled) {
+    g_mutex_unlock (&self->mutex);
+    return;
+  }
+
+  total = kms_thread_cpu_get_total (self);
+  now = g_get_monotonic_time ();
+
+  if (now > self->last_sample && total >= self->last_total) {
+    usage = (gdouble) (total - self->last_total) * G_USEC_PER_SEC /
+        (now - self->last_sample);
+  }
+
+  self->last_total = total;
+  self->last_sample = now;
+  threads = g_hash_table_size (self->threads);
+
+  cpu_stats = gst_structure_new (KMS_THREAD_CPU_STATS_FIELD,
+      "cpu-time", G_TYPE_UINT64, total - self->enabled_total,
+      "cpu-usage", G_TYPE_DOUBLE, usage, "threads", G_TYPE_UINT, threads, NULL);
+
+  g_mutex_unlock (&self->mutex);
+
+  gst_structure_set (stats, KMS_THREAD_CPU_STATS_FIELD, GST_TYPE_STRUCTURE,
+      cpu_stats, NULL);
+  gst_structure_free (cpu_stats);
+}
+
+gboolean
+kms_thread_cpu_get_time (KmsThreadCpu * self, guint64 * cpu_time,
+    guint * threads)
+{
+  g_mutex_lock (&self->mutex);
+
+  if (!self->enabled) {
+    g_mutex_unlock (&self->mutex);
+    return FALSE;
+  }
+
+  *cpu_time = kms_thread_cpu_get_total (self) - self->enabled_total;
+  *threads = g_hash_table_size (self->threads);
+
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
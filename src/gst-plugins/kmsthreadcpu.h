@@ -0,0 +1,61 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_THREAD_CPU_H_
+#define _KMS_THREAD_CPU_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define KMS_THREAD_CPU_STATS_FIELD "cpu-stats"
+
+/*
+ * CPU time used by the streaming threads of an element.
+ *
+ * Streaming threads announce themselves with stream-status messages posted
+ * from the thread itself when it enters and leaves its task. Feeding those
+ * messages to kms_thread_cpu_handle_message () is enough to know which threads
+ * belong to the element; their CPU clocks are only read when the stats are
+ * requested, so nothing is done per buffer.
+ */
+typedef struct _KmsThreadCpu KmsThreadCpu;
+
+KmsThreadCpu *kms_thread_cpu_new (void);
+void kms_thread_cpu_free (KmsThreadCpu * self);
+
+/* Nothing is reported until accounting is enabled. Usage is measured from
+ * the moment it is enabled */
+void kms_thread_cpu_set_enabled (KmsThreadCpu * self, gboolean enabled);
+
+/* Must be called synchronously, from the thread that posted the message:
+ * from GstBin::handle_message or from a bus sync handler */
+void kms_thread_cpu_handle_message (KmsThreadCpu * self, GstMessage * msg);
+
+/* Adds a KMS_THREAD_CPU_STATS_FIELD structure to @stats with:
+ *   "cpu-time": CPU time in microseconds since accounting was enabled
+ *   "cpu-usage": CPU microseconds per second since the previous call
+ *   "threads": streaming threads currently running */
+void kms_thread_cpu_add_stats (KmsThreadCpu * self, GstStructure * stats);
+
+/* Same "cpu-time" and "threads" without building a structure nor touching
+ * the usage of the next kms_thread_cpu_add_stats () call. Returns FALSE
+ * while accounting is disabled */
+gboolean kms_thread_cpu_get_time (KmsThreadCpu * self, guint64 * cpu_time,
+    guint * threads);
+
+G_END_DECLS
+#endif /* _KMS_THREAD_CPU_H_ */
@@ -20,6 +20,7 @@
 #endif
 
 #include <gst/gst.h>
+#include <gst/pbutils/encoding-profile.h>
 #include <commons/kms-core-enumtypes.h>
 #include <commons/kmsrecordingprofile.h>
 #include <commons/kmsutils.h>
@@ -200,6 +201,90 @@ kms_av_muxer_get_sink_pad_name (KmsRecordingProfile profile,
   }
 }
 
+static GstCaps *
+kms_av_muxer_get_format_caps (KmsAVMuxer * self, KmsElementPadType type)
+{
+  GstEncodingContainerProfile *cprof;
+  const GList *l;
+  GstCaps *caps = NULL;
+
+  cprof =
+      kms_recording_profile_create_profile (KMS_BASE_MEDIA_MUXER_GET_PROFILE
+      (self), type == KMS_ELEMENT_PAD_TYPE_AUDIO,
+      type == KMS_ELEMENT_PAD_TYPE_VIDEO);
+
+  for (l = gst_encoding_container_profile_get_profiles (cprof); l != NULL;
+      l = l->next) {
+    GstEncodingProfile *prof = l->data;
+
+    if ((GST_IS_ENCODING_AUDIO_PROFILE (prof) &&
+            type == KMS_ELEMENT_PAD_TYPE_AUDIO) ||
+        (GST_IS_ENCODING_VIDEO_PROFILE (prof) &&
+            type == KMS_ELEMENT_PAD_TYPE_VIDEO)) {
+      caps = gst_encoding_profile_get_format (prof);
+      break;
+    }
+  }
+
+  gst_encoding_profile_unref (cprof);
+
+  return caps;
+}
+
+/* The recorder takes encoded media as it arrives when it only differs from */
+/* the profile in the stream format, so a parser makes it suit the muxer */
+static GstElement *
+kms_av_muxer_create_parser (KmsAVMuxer * self, KmsElementPadType type)
+{
+  GList *factories, *parsers;
+  GstElement *parser = NULL;
+  GstCaps *caps;
+
+  caps = kms_av_muxer_get_format_caps (self, type);
+
+  if (caps == NULL) {
+    return NULL;
+  }
+
+  factories =
+      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_PARSER,
+      GST_RANK_MARGINAL);
+  parsers = gst_element_factory_list_filter (factories, caps, GST_PAD_SRC,
+      FALSE);
+  parsers = g_list_sort (parsers, gst_plugin_feature_rank_compare_func);
+
+  if (parsers != NULL) {
+    parser = gst_element_factory_create (parsers->data, NULL);
+  }
+
+  GST_DEBUG_OBJECT (self, "Parser for %" GST_PTR_FORMAT ": %" GST_PTR_FORMAT,
+      caps, parser);
+
+  gst_plugin_feature_list_free (parsers);
+  gst_plugin_feature_list_free (factories);
+  gst_caps_unref (caps);
+
+  return parser;
+}
+
+static gboolean
+kms_av_muxer_link_src (KmsAVMuxer * self, GstElement * appsrc,
+    KmsElementPadType type, const gchar * pad_name)
+{
+  GstElement *parser;
+
+  parser = kms_av_muxer_create_parser (self, type);
+
+  if (parser == NULL) {
+    return gst_element_link_pads (appsrc, "src", self->priv->mux, pad_name);
+  }
+
+  gst_bin_add (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)), parser);
+
+  return gst_element_link (appsrc, parser) &&
+      gst_element_link_pads (parser, "src", self->priv->mux, pad_name);
+}
+
 static void
 kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
 {
@@ -237,8 +322,8 @@ kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
       return;
     }
 
-    if (!gst_element_link_pads (self->priv->videosrc, "src", self->priv->mux,
-            pad_name)) {
+    if (!kms_av_muxer_link_src (self, self->priv->videosrc,
+            KMS_ELEMENT_PAD_TYPE_VIDEO, pad_name)) {
       GST_ERROR_OBJECT (self,
           "Could not link elements: %" GST_PTR_FORMAT ", %" GST_PTR_FORMAT,
           self->priv->videosrc, self->priv->mux);
@@ -256,8 +341,8 @@ kms_av_muxer_prepare_pipeline (KmsAVMuxer * self)
       return;
     }
 
-    if (!gst_element_link_pads (self->priv->audiosrc, "src", self->priv->mux,
-            pad_name)) {
+    if (!kms_av_muxer_link_src (self, self->priv->audiosrc,
+            KMS_ELEMENT_PAD_TYPE_AUDIO, pad_name)) {
       GST_ERROR_OBJECT (self,
           "Could not link elements: %" GST_PTR_FORMAT ", %" GST_PTR_FORMAT,
           self->priv->audiosrc, self->priv->mux);
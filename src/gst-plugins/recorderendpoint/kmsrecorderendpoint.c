@@ -40,12 +40,25 @@
 #include "kmsbasemediamuxer.h"
 #include "kmsavmuxer.h"
 #include "kmsksrmuxer.h"
+#include "kmsrtpdumpmuxer.h"
+#include "kmsrecorderpassthroughmode.h"
+#include "kms-recorder-enumtypes.h"
+#include "kmsthreadcpu.h"
+#include "kmsstatssnapshot.h"
+#include "kmslatencysampler.h"
 
 #define PLUGIN_NAME "recorderendpoint"
 
 #define RECORDER_DEFAULT_SUFFIX "_default"
 
 #define DEFAULT_RECORDING_PROFILE KMS_RECORDING_PROFILE_NONE
+#define DEFAULT_PASSTHROUGH_MODE KMS_RECORDER_PASSTHROUGH_MODE_FALLBACK
+#define DEFAULT_RTP_DUMP FALSE
+
+#define RECORDER_STREAMS_FIELD "recorder-streams"
+
+/* Pads crossed from a sink pad to the agnosticbin feeding it */
+#define MAX_SOURCE_DEPTH 8
 
 #define KMS_BASE_TIME_KEY "base-time-key"
 G_DEFINE_QUARK (KMS_BASE_TIME_KEY, base_time_key);
@@ -56,6 +69,9 @@ G_DEFINE_QUARK (KMS_PAD_ID_KEY, kms_pad_id_key);
 #define KMS_APPSRC_ID_KEY "kms-appsrc-id-key"
 G_DEFINE_QUARK (KMS_APPSRC_ID_KEY, kms_appsrc_id_key);
 
+#define REJECTED_PROBE_KEY "kms-rejected-probe-key"
+G_DEFINE_QUARK (REJECTED_PROBE_KEY, rejected_probe_key);
+
 GST_DEBUG_CATEGORY_STATIC (kms_recorder_endpoint_debug_category);
 #define GST_CAT_DEFAULT kms_recorder_endpoint_debug_category
 
@@ -92,6 +108,8 @@ enum
   PROP_0,
   PROP_DVR,
   PROP_PROFILE,
+  PROP_PASSTHROUGH_MODE,
+  PROP_RTP_DUMP,
   N_PROPERTIES
 };
 
@@ -122,17 +140,40 @@ typedef struct _KmsSinkPadData
   gboolean requested;
 } KmsSinkPadData;
 
+/* Stored in the latency meta of the buffers, like StreamE2EAvgStat, with the
+ * latency distribution besides the average */
+typedef struct _KmsRecorderE2EStat
+{
+  KmsRefStruct ref;
+  KmsMediaType type;
+  gdouble avg;
+  KmsLatencyHistogram *latency;
+} KmsRecorderE2EStat;
+
+/* How the media of a sink pad reaches the muxer */
+typedef struct _KmsRecorderStream
+{
+  KmsElementPadType type;
+  gchar *codec;
+  gchar *source_codec;          /* Received by the source, if known */
+  gboolean transcoded;
+  gboolean rejected;
+} KmsRecorderStream;
+
 typedef struct _KmsRecorderStats
 {
   gchar *id;
   gboolean enabled;
-  /* End-to-end average stream stats */
-  GHashTable *avg_e2e;          /* <"pad_name", StreamE2EAvgStat> */
+  /* End-to-end stream stats */
+  GHashTable *avg_e2e;          /* <"pad_name", KmsRecorderE2EStat> */
 } KmsRecorderStats;
 
 struct _KmsRecorderEndpointPrivate
 {
   KmsRecordingProfile profile;
+  KmsRecorderPassthroughMode passthrough_mode;
+  gboolean rtp_dump;            /* Set before the profile */
+  GHashTable *streams;          /* <"pad_name", KmsRecorderStream> */
   GstClockTime paused_time;
   GstClockTime paused_start;
   gboolean use_dvr;
@@ -145,6 +186,7 @@ struct _KmsRecorderEndpointPrivate
   GMutex srcs_mutex;
 
   KmsRecorderStats stats;
+  KmsThreadCpu *cpu;
 
   gboolean sent_eos;
   gboolean playing;
@@ -159,9 +201,46 @@ struct _KmsRecorderEndpointPrivate
 typedef struct _MarkBufferProbeData
 {
   gchar *id;
-  StreamE2EAvgStat *stat;
+  KmsRecorderE2EStat *stat;
 } MarkBufferProbeData;
 
+static void
+kms_recorder_e2e_stat_destroy (KmsRecorderE2EStat * stat)
+{
+  kms_latency_histogram_free (stat->latency);
+
+  g_slice_free (KmsRecorderE2EStat, stat);
+}
+
+static KmsRecorderE2EStat *
+kms_recorder_e2e_stat_new (KmsMediaType type)
+{
+  KmsRecorderE2EStat *stat;
+
+  stat = g_slice_new0 (KmsRecorderE2EStat);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (stat),
+      (GDestroyNotify) kms_recorder_e2e_stat_destroy);
+
+  stat->type = type;
+  stat->latency = kms_latency_histogram_new ();
+
+  return stat;
+}
+
+#define kms_recorder_e2e_stat_ref(stat) \
+  ((KmsRecorderE2EStat *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (stat)))
+#define kms_recorder_e2e_stat_unref(stat) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (stat))
+
+static void
+kms_recorder_stream_destroy (KmsRecorderStream * stream)
+{
+  g_free (stream->codec);
+  g_free (stream->source_codec);
+
+  g_slice_free (KmsRecorderStream, stream);
+}
+
 static KmsSinkPadData *
 sink_pad_data_new (KmsElementPadType type, const gchar * description,
     const gchar * name, gboolean requested)
@@ -200,7 +279,7 @@ static void
 mark_buffer_probe_data_destroy (MarkBufferProbeData * data)
 {
   g_free (data->id);
-  kms_stats_stream_e2e_avg_stat_unref (data->stat);
+  kms_recorder_e2e_stat_unref (data->stat);
 
   g_slice_free (MarkBufferProbeData, data);
 }
@@ -604,6 +683,8 @@ kms_recorder_endpoint_finalize (GObject * object)
   g_hash_table_unref (self->priv->sink_pad_data);
   g_slist_free_full (self->priv->pending_srcs, g_free);
   g_hash_table_unref (self->priv->stats.avg_e2e);
+  g_hash_table_unref (self->priv->streams);
+  kms_thread_cpu_free (self->priv->cpu);
 
   g_mutex_clear (&self->priv->base_time_lock);
 
@@ -624,7 +705,7 @@ add_mark_data_cb (GstPad * pad, KmsMediaType type, GstClockTimeDiff t,
     KmsList * meta_data, gpointer user_data)
 {
   MarkBufferProbeData *data = (MarkBufferProbeData *) user_data;
-  StreamE2EAvgStat *stat;
+  KmsRecorderE2EStat *stat;
 
   stat = kms_list_lookup (meta_data, data->id);
 
@@ -634,7 +715,7 @@ add_mark_data_cb (GstPad * pad, KmsMediaType type, GstClockTimeDiff t,
   } else {
     /* add mark data to this meta */
     kms_list_prepend (meta_data, g_strdup (data->id),
-        kms_stats_stream_e2e_avg_stat_ref (data->stat));
+        kms_recorder_e2e_stat_ref (data->stat));
   }
 }
 
@@ -643,7 +724,7 @@ connect_sink_func (const gchar * key, KmsSinkPadData * data,
     KmsRecorderEndpoint * self)
 {
   MarkBufferProbeData *markdata;
-  StreamE2EAvgStat *stat;
+  KmsRecorderE2EStat *stat;
   KmsMediaType type;
   GstPad *sinkpad;
   gchar *id;
@@ -675,13 +756,13 @@ connect_sink_func (const gchar * key, KmsSinkPadData * data,
   stat = g_hash_table_lookup (self->priv->stats.avg_e2e, id);
 
   if (stat == NULL) {
-    stat = kms_stats_stream_e2e_avg_stat_new (type);
+    stat = kms_recorder_e2e_stat_new (type);
     g_hash_table_insert (self->priv->stats.avg_e2e, g_strdup (id), stat);
   }
 
   markdata = mark_buffer_probe_data_new ();
   markdata->id = id;
-  markdata->stat = kms_stats_stream_e2e_avg_stat_ref (stat);
+  markdata->stat = kms_recorder_e2e_stat_ref (stat);
 
   kms_stats_add_buffer_latency_notification_probe (sinkpad, add_mark_data_cb,
       TRUE /* lock the data */ , markdata,
@@ -772,6 +853,11 @@ kms_recorder_endpoint_stopped (KmsUriEndpoint * obj, GError ** error)
 
   kms_recorder_endpoint_change_state (self, KMS_RECORDER_ENDPOINT_STOPPING);
 
+  if (self->priv->rtp_dump) {
+    kms_rtp_dump_muxer_set_recording (KMS_RTP_DUMP_MUXER (self->priv->mux),
+        FALSE);
+  }
+
   if (self->priv->playing) {
     self->priv->sent_eos = kms_recorder_endpoint_send_eos_to_appsrcs (self) > 0;
   }
@@ -855,6 +941,11 @@ kms_recorder_endpoint_started (KmsUriEndpoint * obj, GError ** error)
   kms_base_media_muxer_set_state (self->priv->mux, GST_STATE_PLAYING);
   KMS_ELEMENT_LOCK (self);
 
+  if (self->priv->rtp_dump) {
+    kms_rtp_dump_muxer_set_recording (KMS_RTP_DUMP_MUXER (self->priv->mux),
+        TRUE);
+  }
+
   BASE_TIME_LOCK (self);
 
   if (GST_CLOCK_TIME_IS_VALID (self->priv->paused_start)) {
@@ -906,6 +997,11 @@ kms_recorder_endpoint_paused (KmsUriEndpoint * obj, GError ** error)
 
   kms_recorder_endpoint_change_state (self, KMS_RECORDER_ENDPOINT_PAUSING);
 
+  if (self->priv->rtp_dump) {
+    kms_rtp_dump_muxer_set_recording (KMS_RTP_DUMP_MUXER (self->priv->mux),
+        FALSE);
+  }
+
   clk = kms_base_media_muxer_get_clock (self->priv->mux);
 
   if (clk) {
@@ -989,6 +1085,241 @@ end:
   gst_caps_unref (sinkcaps);
 }
 
+/* Sink pad of the recorder that targets @target */
+static GstPad *
+kms_recorder_endpoint_get_sink_ghost (GstPad * target)
+{
+  GstPad *peer, *ghost = NULL;
+
+  peer = gst_pad_get_peer (target);
+
+  if (peer == NULL) {
+    return NULL;
+  }
+
+  if (GST_IS_PROXY_PAD (peer)) {
+    ghost = GST_PAD (gst_proxy_pad_get_internal (GST_PROXY_PAD (peer)));
+  }
+
+  g_object_unref (peer);
+
+  return ghost;
+}
+
+static gboolean
+kms_recorder_endpoint_is_agnosticbin (GstElement * element)
+{
+  GstElementFactory *factory;
+
+  if (element == NULL) {
+    return FALSE;
+  }
+
+  factory = gst_element_get_factory (element);
+
+  return factory != NULL &&
+      g_strcmp0 (GST_OBJECT_NAME (factory), "agnosticbin") == 0;
+}
+
+static GstCaps *
+kms_recorder_endpoint_get_agnosticbin_input (GstElement * agnosticbin)
+{
+  GstCaps *caps = NULL;
+  GstPad *sinkpad, *peer;
+
+  sinkpad = gst_element_get_static_pad (agnosticbin, "sink");
+
+  if (sinkpad == NULL) {
+    return NULL;
+  }
+
+  /* While the agnosticbin handles new caps, only its peer has them */
+  peer = gst_pad_get_peer (sinkpad);
+
+  if (peer != NULL) {
+    caps = gst_pad_get_current_caps (peer);
+    g_object_unref (peer);
+  }
+
+  if (caps == NULL) {
+    caps = gst_pad_get_current_caps (sinkpad);
+  }
+
+  g_object_unref (sinkpad);
+
+  return caps;
+}
+
+/* Caps received by the agnosticbin that feeds @pad, a sink pad of the */
+/* recorder. NULL if they are not known yet or no agnosticbin is found */
+static GstCaps *
+kms_recorder_endpoint_get_source_caps (GstPad * pad)
+{
+  GstPad *upstream;
+  GstCaps *caps = NULL;
+  guint i;
+
+  upstream = gst_pad_get_peer (pad);
+
+  for (i = 0; upstream != NULL && i < MAX_SOURCE_DEPTH; i++) {
+    GstElement *parent = gst_pad_get_parent_element (upstream);
+    GstPad *next = NULL;
+
+    if (kms_recorder_endpoint_is_agnosticbin (parent)) {
+      caps = kms_recorder_endpoint_get_agnosticbin_input (parent);
+    } else if (GST_IS_GHOST_PAD (upstream)) {
+      next = gst_ghost_pad_get_target (GST_GHOST_PAD (upstream));
+    }
+
+    g_clear_object (&parent);
+    g_object_unref (upstream);
+    upstream = next;
+  }
+
+  g_clear_object (&upstream);
+
+  return caps;
+}
+
+static const gchar *
+kms_recorder_endpoint_get_codec (const GstCaps * caps)
+{
+  if (caps == NULL || gst_caps_get_size (caps) == 0) {
+    return NULL;
+  }
+
+  return gst_structure_get_name (gst_caps_get_structure (caps, 0));
+}
+
+/* Must be called with the element lock held */
+static KmsRecorderStream *
+kms_recorder_endpoint_get_stream (KmsRecorderEndpoint * self, GstPad * pad)
+{
+  KmsRecorderStream *stream;
+  gchar *name;
+
+  name = gst_pad_get_name (pad);
+  stream = g_hash_table_lookup (self->priv->streams, name);
+
+  if (stream == NULL) {
+    stream = g_slice_new0 (KmsRecorderStream);
+    stream->type = kms_element_get_pad_type (KMS_ELEMENT (self), pad);
+    g_hash_table_insert (self->priv->streams, name, stream);
+  } else {
+    g_free (name);
+  }
+
+  return stream;
+}
+
+/* Fails the stream of @pad, once, when the source would have to transcode */
+/* it and only passthrough is allowed. Returns TRUE if it was rejected */
+static gboolean
+kms_recorder_endpoint_reject_stream (KmsRecorderEndpoint * self,
+    GstPad * pad, const gchar * source_codec, const gchar * codec)
+{
+  KmsRecorderStream *stream;
+  gboolean post;
+
+  if (g_atomic_int_get (&self->priv->passthrough_mode) !=
+      KMS_RECORDER_PASSTHROUGH_MODE_STRICT) {
+    return FALSE;
+  }
+
+  KMS_ELEMENT_LOCK (self);
+  stream = kms_recorder_endpoint_get_stream (self, pad);
+  post = !stream->rejected;
+  stream->rejected = TRUE;
+  if (stream->source_codec == NULL) {
+    stream->source_codec = g_strdup (source_codec);
+  }
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (post) {
+    GST_ELEMENT_ERROR (self, STREAM, WRONG_TYPE,
+        ("Stream %s can not be recorded without transcoding",
+            GST_OBJECT_NAME (pad)),
+        ("Received %s, the recording profile needs %s", source_codec,
+            codec != NULL ? codec : "another format"));
+  }
+
+  return TRUE;
+}
+
+/* Records how the media of @pad, received with @caps, reaches the muxer. */
+/* Returns FALSE if it must not be recorded */
+static gboolean
+kms_recorder_endpoint_check_passthrough (KmsRecorderEndpoint * self,
+    GstPad * pad, GstCaps * caps)
+{
+  const gchar *codec, *source_codec;
+  KmsRecorderStream *stream;
+  GstCaps *source;
+  gboolean transcoded, ret = TRUE;
+
+  source = kms_recorder_endpoint_get_source_caps (pad);
+  codec = kms_recorder_endpoint_get_codec (caps);
+  source_codec = kms_recorder_endpoint_get_codec (source);
+
+  /* Whatever the fields, media of the same type goes through as it arrives */
+  transcoded = source_codec != NULL && g_strcmp0 (codec, source_codec) != 0;
+
+  GST_INFO_OBJECT (pad, "Recording %s received as %s: %s", codec,
+      source_codec != NULL ? source_codec : "unknown",
+      transcoded ? "transcoded" : "passthrough");
+
+  KMS_ELEMENT_LOCK (self);
+  stream = kms_recorder_endpoint_get_stream (self, pad);
+  g_free (stream->codec);
+  stream->codec = g_strdup (codec);
+  g_free (stream->source_codec);
+  stream->source_codec = g_strdup (source_codec);
+  stream->transcoded = transcoded;
+  if (!transcoded) {
+    stream->rejected = FALSE;
+  }
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (transcoded) {
+    ret = !kms_recorder_endpoint_reject_stream (self, pad, source_codec,
+        codec);
+  }
+
+  if (source != NULL) {
+    gst_caps_unref (source);
+  }
+
+  return ret;
+}
+
+static GstPadProbeReturn
+kms_recorder_endpoint_drop_buffer (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  return GST_PAD_PROBE_DROP;
+}
+
+/* Drops the media of a rejected stream until it gets acceptable caps */
+static void
+kms_recorder_endpoint_set_dropping (GstPad * pad, gboolean drop)
+{
+  gulong id;
+
+  id = GPOINTER_TO_SIZE (g_object_get_qdata (G_OBJECT (pad),
+          rejected_probe_key_quark ()));
+
+  if (drop && id == 0) {
+    id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_BUFFER_LIST, kms_recorder_endpoint_drop_buffer,
+        NULL, NULL);
+    g_object_set_qdata (G_OBJECT (pad), rejected_probe_key_quark (),
+        GSIZE_TO_POINTER (id));
+  } else if (!drop && id != 0) {
+    gst_pad_remove_probe (pad, id);
+    g_object_set_qdata (G_OBJECT (pad), rejected_probe_key_quark (), NULL);
+  }
+}
+
 static GstPadProbeReturn
 configure_pipeline_capabilities (GstPad * pad, GstPadProbeInfo * info,
     gpointer user_data)
@@ -996,6 +1327,7 @@ configure_pipeline_capabilities (GstPad * pad, GstPadProbeInfo * info,
   KmsRecorderEndpoint *self = KMS_RECORDER_ENDPOINT (user_data);
   GstEvent *event = gst_pad_probe_info_get_event (info);
   GstElement *appsrc, *appsink;
+  GstPad *ghost;
   GstCaps *caps;
 
   if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
@@ -1015,6 +1347,22 @@ configure_pipeline_capabilities (GstPad * pad, GstPadProbeInfo * info,
     GST_WARNING_OBJECT (pad, "Not fixed caps in event %" GST_PTR_FORMAT, event);
   }
 
+  /* Packets are recorded, not this media */
+  ghost = self->priv->rtp_dump ? NULL :
+      kms_recorder_endpoint_get_sink_ghost (pad);
+
+  if (ghost != NULL) {
+    gboolean record;
+
+    record = kms_recorder_endpoint_check_passthrough (self, ghost, caps);
+    g_object_unref (ghost);
+    kms_recorder_endpoint_set_dropping (pad, !record);
+
+    if (!record) {
+      return GST_PAD_PROBE_DROP;
+    }
+  }
+
   appsink = gst_pad_get_parent_element (pad);
   GST_DEBUG_OBJECT (appsink, "Setting caps: %" GST_PTR_FORMAT, caps);
 
@@ -1033,6 +1381,24 @@ configure_pipeline_capabilities (GstPad * pad, GstPadProbeInfo * info,
   return GST_PAD_PROBE_OK;
 }
 
+static void
+kms_recorder_endpoint_add_rtp_source (KmsRecorderEndpoint * self,
+    const gchar * id, GstPad * peer)
+{
+  GstElement *source;
+
+  source = gst_pad_get_parent_element (peer);
+
+  if (source == NULL || !kms_rtp_dump_muxer_add_source (KMS_RTP_DUMP_MUXER
+          (self->priv->mux), id, source)) {
+    GST_ELEMENT_ERROR (self, STREAM, WRONG_TYPE,
+        ("Only the packets of RTP endpoints can be recorded"),
+        ("Stream %s comes from %" GST_PTR_FORMAT, id, source));
+  }
+
+  g_clear_object (&source);
+}
+
 static GstPadLinkReturn
 link_sinkpad_cb (GstPad * pad, GstObject * parent, GstPad * peer)
 {
@@ -1094,6 +1460,10 @@ link_sinkpad_cb (GstPad * pad, GstObject * parent, GstPad * peer)
 
   gst_pad_set_element_private (pad, g_object_ref (appsrc));
 
+  if (self->priv->rtp_dump) {
+    kms_recorder_endpoint_add_rtp_source (self, id, peer);
+  }
+
   SRCS_LOCK (self);
   g_hash_table_insert (self->priv->srcs, id, g_object_ref (appsrc));
   SRCS_UNLOCK (self);
@@ -1140,6 +1510,11 @@ unlink_sinkpad_cb (GstPad * pad, GstObject * parent)
   appsrc = gst_pad_get_element_private (pad);
   gst_pad_set_element_private (pad, NULL);
 
+  if (self->priv->rtp_dump) {
+    kms_rtp_dump_muxer_remove_source (KMS_RTP_DUMP_MUXER (self->priv->mux),
+        id);
+  }
+
   if (appsrc) {
     g_object_unref (appsrc);
   }
@@ -1201,6 +1576,12 @@ kms_recorder_endpoint_add_appsink (KmsRecorderEndpoint * self,
   callbacks.new_preroll = NULL;
   callbacks.new_sample = recv_sample;
 
+  if (self->priv->rtp_dump) {
+    /* The media only keeps the source sending, its packets are recorded */
+    g_object_set (appsink, "max-buffers", 1, "drop", TRUE, NULL);
+    callbacks.new_sample = NULL;
+  }
+
   gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, NULL, NULL);
 
   gst_element_sync_state_with_parent (appsink);
@@ -1220,15 +1601,16 @@ kms_recorder_endpoint_latency_cb (GstPad * pad, KmsMediaType type,
   kms_list_iter_init (&iter, mdata);
   while (kms_list_iter_next (&iter, &key, &value)) {
     gchar *id = (gchar *) key;
-    StreamE2EAvgStat *stat;
+    KmsRecorderE2EStat *stat;
 
     if (!g_str_has_prefix (id, name)) {
       /* This element did not add this mark to the metada */
       continue;
     }
 
-    stat = (StreamE2EAvgStat *) value;
+    stat = (KmsRecorderE2EStat *) value;
     stat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (t, stat->avg);
+    kms_latency_histogram_record (stat->latency, t);
   }
 }
 
@@ -1317,7 +1699,11 @@ kms_recorder_endpoint_create_base_media_muxer (KmsRecorderEndpoint * self)
 {
   KmsBaseMediaMuxer *mux;
 
-  if (self->priv->profile == KMS_RECORDING_PROFILE_KSR) {
+  if (self->priv->rtp_dump) {
+    mux = KMS_BASE_MEDIA_MUXER (kms_rtp_dump_muxer_new
+        (KMS_BASE_MEDIA_MUXER_PROFILE, self->priv->profile,
+            KMS_BASE_MEDIA_MUXER_URI, KMS_URI_ENDPOINT (self)->uri, NULL));
+  } else if (self->priv->profile == KMS_RECORDING_PROFILE_KSR) {
     mux = KMS_BASE_MEDIA_MUXER (kms_ksr_muxer_new
         (KMS_BASE_MEDIA_MUXER_PROFILE, self->priv->profile,
             KMS_BASE_MEDIA_MUXER_URI, KMS_URI_ENDPOINT (self)->uri, NULL));
@@ -1369,6 +1755,17 @@ kms_recorder_endpoint_set_property (GObject * object, guint property_id,
     case PROP_DVR:
       self->priv->use_dvr = g_value_get_boolean (value);
       break;
+    case PROP_PASSTHROUGH_MODE:
+      g_atomic_int_set (&self->priv->passthrough_mode,
+          g_value_get_enum (value));
+      break;
+    case PROP_RTP_DUMP:
+      if (self->priv->profile == KMS_RECORDING_PROFILE_NONE) {
+        self->priv->rtp_dump = g_value_get_boolean (value);
+      } else {
+        GST_ERROR_OBJECT (self, "RTP dump must be configured before profile");
+      }
+      break;
     case PROP_PROFILE:{
       if (self->priv->profile == KMS_RECORDING_PROFILE_NONE) {
         self->priv->profile = g_value_get_enum (value);
@@ -1404,6 +1801,13 @@ kms_recorder_endpoint_get_property (GObject * object, guint property_id,
       g_value_set_enum (value, self->priv->profile);
       break;
     }
+    case PROP_PASSTHROUGH_MODE:
+      g_value_set_enum (value,
+          g_atomic_int_get (&self->priv->passthrough_mode));
+      break;
+    case PROP_RTP_DUMP:
+      g_value_set_boolean (value, self->priv->rtp_dump);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1411,6 +1815,35 @@ kms_recorder_endpoint_get_property (GObject * object, guint property_id,
   KMS_ELEMENT_UNLOCK (KMS_ELEMENT (self));
 }
 
+/* The muxing pipeline parses the media before muxing it, so encoded media */
+/* in other stream formats can be recorded as it arrives instead of making */
+/* the source transcode it */
+static GstCaps *
+kms_recorder_endpoint_widen_caps (GstCaps * caps)
+{
+  static const gchar *parsed_fields[] = {
+    "stream-format", "alignment", "profile", "level", NULL
+  };
+  guint i;
+
+  caps = gst_caps_make_writable (caps);
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *str = gst_caps_get_structure (caps, i);
+    guint j;
+
+    if (g_str_has_suffix (gst_structure_get_name (str), "/x-raw")) {
+      continue;
+    }
+
+    for (j = 0; parsed_fields[j] != NULL; j++) {
+      gst_structure_remove_field (str, parsed_fields[j]);
+    }
+  }
+
+  return caps;
+}
+
 static GstCaps *
 kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
     KmsElementPadType type)
@@ -1419,6 +1852,18 @@ kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
   const GList *profiles, *l;
   GstCaps *caps = NULL;
 
+  if (self->priv->rtp_dump) {
+    /* Anything the source receives, so that it does not transcode */
+    switch (type) {
+      case KMS_ELEMENT_PAD_TYPE_VIDEO:
+        return gst_caps_from_string (KMS_AGNOSTIC_VIDEO_CAPS);
+      case KMS_ELEMENT_PAD_TYPE_AUDIO:
+        return gst_caps_from_string (KMS_AGNOSTIC_AUDIO_CAPS);
+      default:
+        return NULL;
+    }
+  }
+
   switch (type) {
     case KMS_ELEMENT_PAD_TYPE_VIDEO:
       cprof =
@@ -1449,9 +1894,54 @@ kms_recorder_endpoint_get_caps_from_profile (KmsRecorderEndpoint * self,
   }
 
   gst_encoding_profile_unref (cprof);
+
+  if (caps != NULL && self->priv->profile != KMS_RECORDING_PROFILE_KSR) {
+    caps = kms_recorder_endpoint_widen_caps (caps);
+  }
+
   return caps;
 }
 
+/* Whether the source of @pad can send its media as it arrives, as far as */
+/* it is known. Rejects the stream otherwise */
+static gboolean
+kms_recorder_endpoint_can_passthrough (KmsRecorderEndpoint * self,
+    GstPad * pad, GstCaps * caps)
+{
+  const gchar *source_codec;
+  gboolean ret = FALSE;
+  GstCaps *source;
+  guint i;
+
+  if (g_atomic_int_get (&self->priv->passthrough_mode) !=
+      KMS_RECORDER_PASSTHROUGH_MODE_STRICT) {
+    return TRUE;
+  }
+
+  source = kms_recorder_endpoint_get_source_caps (pad);
+  source_codec = kms_recorder_endpoint_get_codec (source);
+
+  if (source_codec == NULL) {
+    g_clear_pointer (&source, gst_caps_unref);
+    return TRUE;
+  }
+
+  /* Same criteria as when the media arrives: only the format counts */
+  for (i = 0; i < gst_caps_get_size (caps) && !ret; i++) {
+    ret = gst_structure_has_name (gst_caps_get_structure (caps, i),
+        source_codec);
+  }
+
+  if (!ret) {
+    ret = !kms_recorder_endpoint_reject_stream (self, pad, source_codec,
+        kms_recorder_endpoint_get_codec (caps));
+  }
+
+  gst_caps_unref (source);
+
+  return ret;
+}
+
 static gboolean
 kms_recorder_endpoint_query_caps (KmsElement * element, GstPad * pad,
     GstQuery * query)
@@ -1507,6 +1997,14 @@ kms_recorder_endpoint_query_caps (KmsElement * element, GstPad * pad,
         "Can not get capabilities from pad's template. Using agnostic's' caps");
   }
 
+  if (caps != NULL && !kms_recorder_endpoint_can_passthrough (self, pad,
+          caps)) {
+    /* Leave the source without any format it could transcode to */
+    gst_caps_unref (result);
+    result = gst_caps_new_empty ();
+    goto filter_caps;
+  }
+
   if (caps == NULL) {
     GST_ERROR_OBJECT (self, "No caps from profile");
   } else {
@@ -1679,11 +2177,25 @@ kms_recorder_endpoint_collect_media_stats (KmsElement * obj, gboolean enable)
 
   KMS_ELEMENT_LOCK (self);
 
+  if (enable && !self->priv->stats.enabled) {
+    GHashTableIter iter;
+    gpointer value;
+
+    /* Percentiles only cover the time stats have been enabled */
+    g_hash_table_iter_init (&iter, self->priv->stats.avg_e2e);
+
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      kms_latency_histogram_reset (((KmsRecorderE2EStat *) value)->latency);
+    }
+  }
+
   self->priv->stats.enabled = enable;
   kms_recorder_endpoint_update_media_stats (self);
 
   KMS_ELEMENT_UNLOCK (self);
 
+  kms_thread_cpu_set_enabled (self->priv->cpu, enable);
+
   KMS_ELEMENT_CLASS
       (kms_recorder_endpoint_parent_class)->collect_media_stats (obj, enable);
 }
@@ -1702,7 +2214,7 @@ kms_element_get_e2e_latency_stats (KmsRecorderEndpoint * self, gchar * selector)
   g_hash_table_iter_init (&iter, self->priv->stats.avg_e2e);
 
   while (g_hash_table_iter_next (&iter, &key, &value)) {
-    StreamE2EAvgStat *avg = value;
+    KmsRecorderE2EStat *avg = value;
     GstStructure *pad_latency;
     gchar *padname, *id = key;
 
@@ -1739,6 +2251,92 @@ kms_element_get_e2e_latency_stats (KmsRecorderEndpoint * self, gchar * selector)
   return stats;
 }
 
+static GstStructure *
+kms_recorder_endpoint_get_latency_percentiles (KmsRecorderEndpoint * self)
+{
+  gpointer key, value;
+  GHashTableIter iter;
+  GstStructure *percentiles;
+
+  percentiles = gst_structure_new_empty (KMS_LATENCY_PERCENTILES_FIELD);
+
+  KMS_ELEMENT_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->stats.avg_e2e);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    KmsRecorderE2EStat *stat = value;
+    GstStructure *pad_percentiles;
+    gchar *padname;
+
+    if (kms_latency_histogram_get_count (stat->latency) == 0) {
+      continue;
+    }
+
+    padname = kms_element_get_padname_from_id (self, key);
+
+    if (padname == NULL) {
+      continue;
+    }
+
+    pad_percentiles = kms_latency_histogram_to_structure (stat->latency,
+        padname);
+    gst_structure_set (percentiles, padname, GST_TYPE_STRUCTURE,
+        pad_percentiles, NULL);
+    gst_structure_free (pad_percentiles);
+    g_free (padname);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  return percentiles;
+}
+
+static GstStructure *
+kms_recorder_endpoint_get_streams_stats (KmsRecorderEndpoint * self)
+{
+  GstStructure *streams;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  streams = gst_structure_new_empty (RECORDER_STREAMS_FIELD);
+
+  KMS_ELEMENT_LOCK (self);
+
+  g_hash_table_iter_init (&iter, self->priv->streams);
+
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    KmsRecorderStream *stream = value;
+    GstStructure *str;
+
+    if (stream->codec == NULL && !stream->rejected) {
+      /* No media received yet */
+      continue;
+    }
+
+    str = gst_structure_new (key, "type", G_TYPE_STRING,
+        stream->type == KMS_ELEMENT_PAD_TYPE_AUDIO ? AUDIO_STREAM_NAME :
+        VIDEO_STREAM_NAME, "transcoded", G_TYPE_BOOLEAN, stream->transcoded,
+        "rejected", G_TYPE_BOOLEAN, stream->rejected, NULL);
+
+    if (stream->codec != NULL) {
+      gst_structure_set (str, "codec", G_TYPE_STRING, stream->codec, NULL);
+    }
+
+    if (stream->source_codec != NULL) {
+      gst_structure_set (str, "source-codec", G_TYPE_STRING,
+          stream->source_codec, NULL);
+    }
+
+    gst_structure_set (streams, key, GST_TYPE_STRUCTURE, str, NULL);
+    gst_structure_free (str);
+  }
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  return streams;
+}
+
 static GstStructure *
 kms_recorder_endpoint_stats (KmsElement * obj, gchar * selector)
 {
@@ -1750,6 +2348,18 @@ kms_recorder_endpoint_stats (KmsElement * obj, gchar * selector)
       KMS_ELEMENT_CLASS (kms_recorder_endpoint_parent_class)->stats (obj,
       selector);
 
+  /* Includes the threads of the muxing pipeline */
+  kms_thread_cpu_add_stats (self->priv->cpu, stats);
+
+  l_stats = kms_recorder_endpoint_get_streams_stats (self);
+
+  if (gst_structure_n_fields (l_stats) > 0) {
+    gst_structure_set (stats, RECORDER_STREAMS_FIELD, GST_TYPE_STRUCTURE,
+        l_stats, NULL);
+  }
+
+  gst_structure_free (l_stats);
+
   if (!self->priv->stats.enabled) {
     return stats;
   }
@@ -1767,6 +2377,15 @@ kms_recorder_endpoint_stats (KmsElement * obj, gchar * selector)
       NULL);
   gst_structure_free (l_stats);
 
+  l_stats = kms_recorder_endpoint_get_latency_percentiles (self);
+
+  if (gst_structure_n_fields (l_stats) > 0) {
+    gst_structure_set (stats, KMS_LATENCY_PERCENTILES_FIELD,
+        GST_TYPE_STRUCTURE, l_stats, NULL);
+  }
+
+  gst_structure_free (l_stats);
+
   GST_DEBUG_OBJECT (self, "Stats: %" GST_PTR_FORMAT, stats);
 
   return stats;
@@ -1854,6 +2473,31 @@ end:
   return ret;
 }
 
+static void
+kms_recorder_endpoint_fill_snapshot (GstElement * element, KmsStatsSnapshot * snapshot)
+{
+  KmsRecorderEndpoint *self = KMS_RECORDER_ENDPOINT (element);
+  guint64 cpu_time;
+  guint threads;
+
+  /* Includes the threads of the muxing pipeline */
+  if (kms_thread_cpu_get_time (self->priv->cpu, &cpu_time, &threads)) {
+    snapshot->values[KMS_STATS_COUNTER_CPU_TIME] = cpu_time;
+    snapshot->values[KMS_STATS_COUNTER_THREADS] = threads;
+  }
+}
+
+static void
+kms_recorder_endpoint_handle_message (GstBin * bin, GstMessage * message)
+{
+  KmsRecorderEndpoint *self = KMS_RECORDER_ENDPOINT (bin);
+
+  kms_thread_cpu_handle_message (self->priv->cpu, message);
+
+  GST_BIN_CLASS (kms_recorder_endpoint_parent_class)->handle_message (bin,
+      message);
+}
+
 static void
 kms_recorder_endpoint_class_init (KmsRecorderEndpointClass * klass)
 {
@@ -1868,6 +2512,9 @@ kms_recorder_endpoint_class_init (KmsRecorderEndpointClass * klass)
   gobject_class->dispose = kms_recorder_endpoint_dispose;
   gobject_class->finalize = kms_recorder_endpoint_finalize;
 
+  GST_BIN_CLASS (klass)->handle_message =
+      GST_DEBUG_FUNCPTR (kms_recorder_endpoint_handle_message);
+
   urienpoint_class->stopped = kms_recorder_endpoint_stopped;
   urienpoint_class->started = kms_recorder_endpoint_started;
   urienpoint_class->paused = kms_recorder_endpoint_paused;
@@ -1878,6 +2525,9 @@ kms_recorder_endpoint_class_init (KmsRecorderEndpointClass * klass)
   kms_element_class->collect_media_stats =
       GST_DEBUG_FUNCPTR (kms_recorder_endpoint_collect_media_stats);
   kms_element_class->stats = GST_DEBUG_FUNCPTR (kms_recorder_endpoint_stats);
+
+  kms_stats_snapshot_set_fill_func (G_TYPE_FROM_CLASS (klass),
+      kms_recorder_endpoint_fill_snapshot);
   kms_element_class->request_new_sink_pad =
       GST_DEBUG_FUNCPTR (kms_recorder_endpoint_request_new_sink_pad);
   kms_element_class->release_requested_sink_pad =
@@ -1897,6 +2547,19 @@ kms_recorder_endpoint_class_init (KmsRecorderEndpointClass * klass)
       "The profile used for encapsulating the media",
       KMS_TYPE_RECORDING_PROFILE, DEFAULT_RECORDING_PROFILE, G_PARAM_READWRITE);
 
+  obj_properties[PROP_PASSTHROUGH_MODE] = g_param_spec_enum
+      ("passthrough-mode", "Passthrough mode",
+      "Whether streams the source would have to transcode are recorded "
+      "anyway or rejected with an error",
+      KMS_TYPE_RECORDER_PASSTHROUGH_MODE, DEFAULT_PASSTHROUGH_MODE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  obj_properties[PROP_RTP_DUMP] = g_param_spec_boolean ("rtp-dump",
+      "RTP dump",
+      "Write the RTP and RTCP packets received by the sources to an rtpdump "
+      "file instead of muxing their media. Must be set before the profile",
+      DEFAULT_RTP_DUMP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (gobject_class,
       N_PROPERTIES, obj_properties);
 
@@ -1959,6 +2622,8 @@ bus_sync_signal_handler (GstBus * bus, GstMessage * msg, gpointer data)
 {
   KmsRecorderEndpoint *self = KMS_RECORDER_ENDPOINT (data);
 
+  kms_thread_cpu_handle_message (self->priv->cpu, msg);
+
   if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
     ErrorData *data;
 
@@ -2022,6 +2687,10 @@ kms_recorder_endpoint_init (KmsRecorderEndpoint * self)
       g_object_unref);
 
   self->priv->profile = DEFAULT_RECORDING_PROFILE;
+  self->priv->passthrough_mode = DEFAULT_PASSTHROUGH_MODE;
+  self->priv->rtp_dump = DEFAULT_RTP_DUMP;
+  self->priv->streams = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) kms_recorder_stream_destroy);
 
   self->priv->paused_time = G_GUINT64_CONSTANT (0);
   self->priv->paused_start = GST_CLOCK_TIME_NONE;
@@ -2031,6 +2700,7 @@ kms_recorder_endpoint_init (KmsRecorderEndpoint * self)
 
   self->priv->stats.avg_e2e = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) kms_ref_struct_unref);
+  self->priv->cpu = kms_thread_cpu_new ();
 
   self->priv->pool = gst_task_pool_new ();
   gst_task_pool_prepare (self->priv->pool, &err);
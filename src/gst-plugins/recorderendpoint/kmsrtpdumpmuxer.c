@@ -0,0 +1,445 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#include "kmsrtpdumpmuxer.h"
+#include "kmsrtpdump.h"
+
+#define OBJECT_NAME "rtpdumpmuxer"
+
+#define parent_class kms_rtp_dump_muxer_parent_class
+
+GST_DEBUG_CATEGORY_STATIC (kms_rtp_dump_muxer_debug_category);
+#define GST_CAT_DEFAULT kms_rtp_dump_muxer_debug_category
+
+#define KMS_RTP_DUMP_MUXER_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (               \
+    (obj),                                    \
+    KMS_TYPE_RTP_DUMP_MUXER,                  \
+    KmsRtpDumpMuxerPrivate                    \
+  )                                           \
+)
+
+#define ADD_TAP_SIGNAL "add-rtp-tap"
+#define REMOVE_TAP_SIGNAL "remove-rtp-tap"
+
+/* Packets waiting to be written. The sources drop them beyond this */
+#define MAX_QUEUED_BYTES (4 * 1024 * 1024)
+
+/* Records are written to disk in blocks of this size */
+#define WRITE_BLOCK_SIZE (64 * 1024)
+#define FILE_SINK_BUFFER_MODE_FULL 0
+
+#define EOS_DATA "kms-rtp-dump-eos"
+
+struct _KmsRtpDumpMuxerPrivate
+{
+  GstElement *tap;
+  GstElement *sink;
+  GstElement *videosrc;
+  GstElement *audiosrc;
+  gboolean sink_signaled;
+
+  GHashTable *sources;          /* <stream id, source element> */
+  gboolean recording;
+  gboolean finished;
+
+  /* Streaming thread of the tap */
+  GstClockTime start;
+};
+
+G_DEFINE_TYPE_WITH_CODE (KmsRtpDumpMuxer, kms_rtp_dump_muxer,
+    KMS_TYPE_BASE_MEDIA_MUXER,
+    GST_DEBUG_CATEGORY_INIT (kms_rtp_dump_muxer_debug_category, OBJECT_NAME,
+        0, "debug category for muxing pipeline object"));
+
+/* Sources */
+
+static gboolean
+kms_rtp_dump_muxer_is_tapped (KmsRtpDumpMuxer * self, GstElement * source)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->priv->sources);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    if (value == source) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+kms_rtp_dump_muxer_tap (KmsRtpDumpMuxer * self, GstElement * source,
+    gboolean tap)
+{
+  GST_DEBUG_OBJECT (self, "%s packets of %" GST_PTR_FORMAT,
+      tap ? "Recording" : "No longer recording", source);
+
+  g_signal_emit_by_name (source, tap ? ADD_TAP_SIGNAL : REMOVE_TAP_SIGNAL,
+      self->priv->tap);
+}
+
+static void
+kms_rtp_dump_muxer_tap_all (KmsRtpDumpMuxer * self, gboolean tap)
+{
+  GList *sources, *l;
+
+  /* Several streams of the same source are tapped once */
+  sources = g_hash_table_get_values (self->priv->sources);
+
+  for (l = sources; l != NULL; l = l->next) {
+    if (g_list_find (sources, l->data) == l) {
+      kms_rtp_dump_muxer_tap (self, l->data, tap);
+    }
+  }
+
+  g_list_free (sources);
+}
+
+gboolean
+kms_rtp_dump_muxer_add_source (KmsRtpDumpMuxer * self, const gchar * id,
+    GstElement * source)
+{
+  g_return_val_if_fail (KMS_IS_RTP_DUMP_MUXER (self), FALSE);
+
+  if (g_signal_lookup (ADD_TAP_SIGNAL, G_OBJECT_TYPE (source)) == 0) {
+    GST_WARNING_OBJECT (self, "%" GST_PTR_FORMAT " does not receive RTP",
+        source);
+    return FALSE;
+  }
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+
+  if (self->priv->recording && !kms_rtp_dump_muxer_is_tapped (self, source)) {
+    kms_rtp_dump_muxer_tap (self, source, TRUE);
+  }
+
+  g_hash_table_insert (self->priv->sources, g_strdup (id),
+      g_object_ref (source));
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+
+  return TRUE;
+}
+
+void
+kms_rtp_dump_muxer_remove_source (KmsRtpDumpMuxer * self, const gchar * id)
+{
+  GstElement *source;
+
+  g_return_if_fail (KMS_IS_RTP_DUMP_MUXER (self));
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+
+  source = g_hash_table_lookup (self->priv->sources, id);
+
+  if (source != NULL) {
+    g_object_ref (source);
+    g_hash_table_remove (self->priv->sources, id);
+
+    if (self->priv->recording && !kms_rtp_dump_muxer_is_tapped (self, source)) {
+      kms_rtp_dump_muxer_tap (self, source, FALSE);
+    }
+
+    g_object_unref (source);
+  }
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+}
+
+void
+kms_rtp_dump_muxer_set_recording (KmsRtpDumpMuxer * self, gboolean recording)
+{
+  g_return_if_fail (KMS_IS_RTP_DUMP_MUXER (self));
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+
+  if (self->priv->finished) {
+    recording = FALSE;
+  }
+
+  if (self->priv->recording != recording) {
+    kms_rtp_dump_muxer_tap_all (self, recording);
+    self->priv->recording = recording;
+  }
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+}
+
+/* Records */
+
+static GstPadProbeReturn
+kms_rtp_dump_muxer_write_record (GstPad * pad, GstPadProbeInfo * info,
+    KmsRtpDumpMuxer * self)
+{
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  GstClockTime arrival = GST_BUFFER_PTS (buffer);
+  gboolean first = !GST_CLOCK_TIME_IS_VALID (self->priv->start);
+  GstBuffer *record;
+
+  if (first) {
+    self->priv->start = arrival;
+  }
+
+  record = kms_rtp_dump_new_record (buffer, arrival > self->priv->start ?
+      arrival - self->priv->start : 0);
+
+  if (record == NULL) {
+    GST_WARNING_OBJECT (self, "Packet of %" G_GSIZE_FORMAT
+        " bytes can not be recorded", gst_buffer_get_size (buffer));
+    return GST_PAD_PROBE_DROP;
+  }
+
+  if (first) {
+    record = gst_buffer_append (kms_rtp_dump_new_file_header (arrival), record);
+  }
+
+  gst_buffer_unref (buffer);
+  info->data = record;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Streams */
+
+static void
+kms_rtp_dump_muxer_check_eos (KmsRtpDumpMuxer * self)
+{
+  GstElement *srcs[] = { self->priv->videosrc, self->priv->audiosrc };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (srcs); i++) {
+    if (srcs[i] != NULL && g_object_get_data (G_OBJECT (srcs[i]),
+            EOS_DATA) == NULL) {
+      return;
+    }
+  }
+
+  if (self->priv->finished) {
+    return;
+  }
+
+  self->priv->finished = TRUE;
+
+  if (self->priv->recording) {
+    kms_rtp_dump_muxer_tap_all (self, FALSE);
+    self->priv->recording = FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "All streams finished, closing the file");
+  gst_app_src_end_of_stream (GST_APP_SRC (self->priv->tap));
+}
+
+static GstPadProbeReturn
+kms_rtp_dump_muxer_stream_eos (GstPad * pad, GstPadProbeInfo * info,
+    KmsRtpDumpMuxer * self)
+{
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_EOS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+  g_object_set_data (G_OBJECT (GST_PAD_PARENT (pad)), EOS_DATA,
+      GINT_TO_POINTER (TRUE));
+  kms_rtp_dump_muxer_check_eos (self);
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* The media of the streams is not written, they only let the recorder */
+/* drive the pipeline as it does with the other muxers */
+static GstElement *
+kms_rtp_dump_muxer_create_stream (KmsRtpDumpMuxer * self, const gchar * name)
+{
+  GstElement *appsrc, *fakesink;
+  GstPad *pad;
+
+  appsrc = gst_element_factory_make ("appsrc", name);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME, NULL);
+  g_object_set (fakesink, "async", FALSE, "sync", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)),
+      appsrc, fakesink, NULL);
+  gst_element_link (appsrc, fakesink);
+
+  pad = gst_element_get_static_pad (appsrc, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) kms_rtp_dump_muxer_stream_eos, self, NULL);
+  g_object_unref (pad);
+
+  gst_element_sync_state_with_parent (fakesink);
+  gst_element_sync_state_with_parent (appsrc);
+
+  return appsrc;
+}
+
+static GstElement *
+kms_rtp_dump_muxer_add_src (KmsBaseMediaMuxer * obj, KmsMediaType type,
+    const gchar * id)
+{
+  KmsRtpDumpMuxer *self = KMS_RTP_DUMP_MUXER (obj);
+  GstElement *sink = NULL, *appsrc = NULL;
+
+  KMS_BASE_MEDIA_MUXER_LOCK (self);
+
+  switch (type) {
+    case KMS_MEDIA_TYPE_AUDIO:
+      if (self->priv->audiosrc == NULL) {
+        self->priv->audiosrc =
+            kms_rtp_dump_muxer_create_stream (self, "audioSrc");
+      }
+      appsrc = self->priv->audiosrc;
+      break;
+    case KMS_MEDIA_TYPE_VIDEO:
+      if (self->priv->videosrc == NULL) {
+        self->priv->videosrc =
+            kms_rtp_dump_muxer_create_stream (self, "videoSrc");
+      }
+      appsrc = self->priv->videosrc;
+      break;
+    default:
+      GST_WARNING_OBJECT (obj, "Unsupported media type %u", type);
+  }
+
+  if (appsrc != NULL && !self->priv->sink_signaled) {
+    sink = g_object_ref (self->priv->sink);
+    self->priv->sink_signaled = TRUE;
+  }
+
+  KMS_BASE_MEDIA_MUXER_UNLOCK (self);
+
+  if (sink != NULL) {
+    KMS_BASE_MEDIA_MUXER_GET_CLASS (self)->emit_on_sink_added
+        (KMS_BASE_MEDIA_MUXER (self), sink);
+    g_object_unref (sink);
+  }
+
+  return appsrc;
+}
+
+static gboolean
+kms_rtp_dump_muxer_remove_src (KmsBaseMediaMuxer * obj, const gchar * id)
+{
+  /* Nothing to remove */
+  return FALSE;
+}
+
+static void
+kms_rtp_dump_muxer_finalize (GObject * obj)
+{
+  KmsRtpDumpMuxer *self = KMS_RTP_DUMP_MUXER (obj);
+
+  GST_DEBUG_OBJECT (self, "finalize");
+
+  kms_rtp_dump_muxer_set_recording (self, FALSE);
+  g_hash_table_unref (self->priv->sources);
+
+  G_OBJECT_CLASS (parent_class)->finalize (obj);
+}
+
+static void
+kms_rtp_dump_muxer_class_init (KmsRtpDumpMuxerClass * klass)
+{
+  KmsBaseMediaMuxerClass *basemediamuxerclass;
+  GObjectClass *objclass;
+
+  objclass = G_OBJECT_CLASS (klass);
+  objclass->finalize = kms_rtp_dump_muxer_finalize;
+
+  basemediamuxerclass = KMS_BASE_MEDIA_MUXER_CLASS (klass);
+  basemediamuxerclass->add_src = kms_rtp_dump_muxer_add_src;
+  basemediamuxerclass->remove_src = kms_rtp_dump_muxer_remove_src;
+
+  g_type_class_add_private (klass, sizeof (KmsRtpDumpMuxerPrivate));
+}
+
+static void
+kms_rtp_dump_muxer_init (KmsRtpDumpMuxer * self)
+{
+  self->priv = KMS_RTP_DUMP_MUXER_GET_PRIVATE (self);
+
+  self->priv->sources = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_object_unref);
+  self->priv->start = GST_CLOCK_TIME_NONE;
+}
+
+static void
+kms_rtp_dump_muxer_prepare_pipeline (KmsRtpDumpMuxer * self)
+{
+  GstPad *pad;
+
+  self->priv->tap = gst_element_factory_make ("appsrc", "rtpSrc");
+  self->priv->sink =
+      KMS_BASE_MEDIA_MUXER_GET_CLASS (self)->create_sink (KMS_BASE_MEDIA_MUXER
+      (self), KMS_BASE_MEDIA_MUXER_GET_URI (self));
+
+  /* Sources never wait for the file, they drop packets if it falls behind */
+  g_object_set (self->priv->tap, "is-live", TRUE, "block", FALSE,
+      "format", GST_FORMAT_TIME, "max-bytes", (guint64) MAX_QUEUED_BYTES,
+      NULL);
+  g_object_set (self->priv->sink, "async", FALSE, "sync", FALSE, NULL);
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (self->priv->sink),
+          "buffer-mode") != NULL) {
+    g_object_set (self->priv->sink, "buffer-mode", FILE_SINK_BUFFER_MODE_FULL,
+        "buffer-size", WRITE_BLOCK_SIZE, NULL);
+  }
+
+  gst_bin_add_many (GST_BIN (KMS_BASE_MEDIA_MUXER_GET_PIPELINE (self)),
+      self->priv->tap, self->priv->sink, NULL);
+
+  if (!gst_element_link (self->priv->tap, self->priv->sink)) {
+    GST_ERROR_OBJECT (self, "Could not link elements: %"
+        GST_PTR_FORMAT ", %" GST_PTR_FORMAT, self->priv->tap, self->priv->sink);
+  }
+
+  pad = gst_element_get_static_pad (self->priv->tap, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_rtp_dump_muxer_write_record, self, NULL);
+  g_object_unref (pad);
+}
+
+KmsRtpDumpMuxer *
+kms_rtp_dump_muxer_new (const char *optname1, ...)
+{
+  KmsRtpDumpMuxer *obj;
+  va_list ap;
+
+  va_start (ap, optname1);
+  obj = KMS_RTP_DUMP_MUXER (g_object_new_valist (KMS_TYPE_RTP_DUMP_MUXER,
+          optname1, ap));
+  va_end (ap);
+
+  kms_rtp_dump_muxer_prepare_pipeline (obj);
+
+  return obj;
+}
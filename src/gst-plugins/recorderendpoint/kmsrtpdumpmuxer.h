@@ -0,0 +1,85 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_RTP_DUMP_MUXER_H_
+#define _KMS_RTP_DUMP_MUXER_H_
+
+#include <gst/gst.h>
+#include "kmsbasemediamuxer.h"
+
+G_BEGIN_DECLS
+#define KMS_TYPE_RTP_DUMP_MUXER               \
+  (kms_rtp_dump_muxer_get_type())
+#define KMS_RTP_DUMP_MUXER_CAST(obj)          \
+  ((KmsRtpDumpMuxer *)(obj))
+#define KMS_RTP_DUMP_MUXER(obj)               \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),          \
+  KMS_TYPE_RTP_DUMP_MUXER,KmsRtpDumpMuxer))
+#define KMS_RTP_DUMP_MUXER_CLASS(klass)       \
+  (G_TYPE_CHECK_CLASS_CAST((klass),           \
+  KMS_TYPE_RTP_DUMP_MUXER,                    \
+  KmsRtpDumpMuxerClass))
+#define KMS_IS_RTP_DUMP_MUXER(obj)            \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),          \
+  KMS_TYPE_RTP_DUMP_MUXER))
+#define KMS_IS_RTP_DUMP_MUXER_CLASS(klass)    \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),           \
+  KMS_TYPE_RTP_DUMP_MUXER))
+
+typedef struct _KmsRtpDumpMuxer KmsRtpDumpMuxer;
+typedef struct _KmsRtpDumpMuxerClass KmsRtpDumpMuxerClass;
+typedef struct _KmsRtpDumpMuxerPrivate KmsRtpDumpMuxerPrivate;
+
+/*
+ * Writes the RTP and RTCP packets received by the sources of the recorder to
+ * an rtpdump file, as they arrived, instead of muxing their media.
+ *
+ * Only sources with an "add-rtp-tap" action signal can be recorded: they push
+ * their packets to an appsrc of the muxing pipeline. The streams added with
+ * kms_base_media_muxer_add_src () only drive the state of the pipeline; their
+ * media is not written.
+ */
+struct _KmsRtpDumpMuxer
+{
+  KmsBaseMediaMuxer parent;
+
+  /*< private > */
+  KmsRtpDumpMuxerPrivate *priv;
+};
+
+struct _KmsRtpDumpMuxerClass
+{
+  KmsBaseMediaMuxerClass parent_class;
+};
+
+GType kms_rtp_dump_muxer_get_type ();
+
+KmsRtpDumpMuxer * kms_rtp_dump_muxer_new (const char *optname1, ...);
+
+/* Records the packets received by @source, which feeds stream @id. Returns
+ * FALSE if @source can not be tapped */
+gboolean kms_rtp_dump_muxer_add_source (KmsRtpDumpMuxer * self,
+    const gchar * id, GstElement * source);
+void kms_rtp_dump_muxer_remove_source (KmsRtpDumpMuxer * self,
+    const gchar * id);
+
+/* Packets are only taken from the sources while recording. Recording stops
+ * for good once every stream has ended */
+void kms_rtp_dump_muxer_set_recording (KmsRtpDumpMuxer * self,
+    gboolean recording);
+
+G_END_DECLS
+#endif
@@ -83,6 +83,20 @@ kms_rtp_base_connection_set_remote_info_default (KmsRtpBaseConnection * self,
   }
 }
 
+static GstPad *
+kms_rtp_base_connection_get_rtp_sink_default (KmsRtpBaseConnection * self)
+{
+  KmsRtpBaseConnectionClass *klass =
+      KMS_RTP_BASE_CONNECTION_CLASS (G_OBJECT_GET_CLASS (self));
+
+  if (klass->get_rtp_sink == kms_rtp_base_connection_get_rtp_sink_default) {
+    GST_WARNING_OBJECT (self,
+        "%s does not reimplement 'get_rtp_sink'", G_OBJECT_CLASS_NAME (klass));
+  }
+
+  return NULL;
+}
+
 static void
 kms_rtp_base_connection_init (KmsRtpBaseConnection * self)
 {
@@ -131,6 +145,7 @@ kms_rtp_base_connection_class_init (KmsRtpBaseConnectionClass * klass)
   klass->get_rtp_port = kms_rtp_base_connection_get_rtp_port_default;
   klass->get_rtcp_port = kms_rtp_base_connection_get_rtcp_port_default;
   klass->set_remote_info = kms_rtp_base_connection_set_remote_info_default;
+  klass->get_rtp_sink = kms_rtp_base_connection_get_rtp_sink_default;
 
   klass->set_latency_callback =
       kms_rtp_base_connection_set_latency_callback_default;
@@ -169,6 +184,15 @@ kms_rtp_base_connection_set_remote_info (KmsRtpBaseConnection * self,
   klass->set_remote_info (self, host, rtp_port, rtcp_port);
 }
 
+GstPad *
+kms_rtp_base_connection_get_rtp_sink (KmsRtpBaseConnection * self)
+{
+  KmsRtpBaseConnectionClass *klass =
+      KMS_RTP_BASE_CONNECTION_CLASS (G_OBJECT_GET_CLASS (self));
+
+  return klass->get_rtp_sink (self);
+}
+
 void
 kms_rtp_base_connection_set_latency_callback (KmsIRtpConnection * self,
     BufferLatencyCallback cb, gpointer user_data)
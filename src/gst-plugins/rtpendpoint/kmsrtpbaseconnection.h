@@ -69,6 +69,7 @@ struct _KmsRtpBaseConnectionClass
       const gchar * host, gint rtp_port, gint rtcp_port);
   void (*set_latency_callback) (KmsIRtpConnection *self, BufferLatencyCallback cb, gpointer user_data);
   void (*collect_latency_stats) (KmsIRtpConnection *self, gboolean enable);
+  GstPad * (*get_rtp_sink) (KmsRtpBaseConnection * self);
 };
 
 GType kms_rtp_base_connection_get_type (void);
@@ -80,6 +81,9 @@ void kms_rtp_base_connection_set_remote_info (KmsRtpBaseConnection * self,
 
 void kms_rtp_base_connection_set_latency_callback (KmsIRtpConnection *self, BufferLatencyCallback cb, gpointer user_data);
 void kms_rtp_base_connection_collect_latency_stats (KmsIRtpConnection *self, gboolean enable);
+/* Pad the RTP packets to send go through before any encryption. Unlike
+ * request_rtp_sink, it never requests a new pad: NULL until linked */
+GstPad *kms_rtp_base_connection_get_rtp_sink (KmsRtpBaseConnection * self);
 void kms_rtp_base_connection_remove_probe (KmsRtpBaseConnection * self, GstElement * e, const gchar * pad_name, gulong id);
 G_END_DECLS
 #endif /* __KMS_RTP_BASE_CONNECTION_H__ */
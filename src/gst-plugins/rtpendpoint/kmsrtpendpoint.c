@@ -30,10 +30,16 @@
 #include <commons/sdpagent/kmssdprtpsavpfmediahandler.h>
 #include <commons/sdpagent/kmssdprtpavpfmediahandler.h>
 #include <commons/sdpagent/kmssdpsdesext.h>
+#include <commons/sdpagent/kmssdprtpavpmediahandler.h>
 #include <commons/kmsrefstruct.h>
 #include "kms-rtp-enumtypes.h"
 #include "kmsrtpsdescryptosuite.h"
 #include "kmsrandom.h"
+#include "kmsaudiolevel.h"
+#include "kmsrtpfec.h"
+#include "kmsrtptap.h"
+#include "kmsrtpwatcher.h"
+#include "kmslatencysampler.h"
 
 #include <stdlib.h> // atoi()
 
@@ -98,6 +104,14 @@ struct _KmsRtpEndpointPrivate
 
   /* COMEDIA (passive port discovery) */
   KmsComedia comedia;
+
+  KmsAudioLevel *audio_level;
+  KmsRtpFec *fec;
+  KmsRtpTap *rtp_tap;
+  KmsRtpWatcher *watcher;
+
+  guint latency_sample_every;
+  guint latency_sample_interval;        /* ms */
 };
 
 /* Signals and args */
@@ -105,6 +119,11 @@ enum
 {
   /* signals */
   SIGNAL_KEY_SOFT_LIMIT,
+  SIGNAL_VOICE_ACTIVITY_CHANGED,
+
+  /* actions */
+  ACTION_ADD_RTP_TAP,
+  ACTION_REMOVE_RTP_TAP,
 
   LAST_SIGNAL
 };
@@ -116,7 +135,12 @@ enum
   PROP_0,
   PROP_USE_SDES,
   PROP_MASTER_KEY,
-  PROP_CRYPTO_SUITE
+  PROP_CRYPTO_SUITE,
+  PROP_AUDIO_LEVEL,
+  PROP_VOICE_ACTIVITY,
+  PROP_FEC_OVERHEAD,
+  PROP_LATENCY_SAMPLE_EVERY,
+  PROP_LATENCY_SAMPLE_INTERVAL
 };
 
 static void
@@ -683,6 +707,18 @@ kms_rtp_endpoint_create_media_handler (KmsBaseSdpEndpoint * base_sdp,
         media);
   }
 
+  if (g_strcmp0 (media, "audio") == 0) {
+    GError *err = NULL;
+
+    if (!kms_sdp_rtp_avp_media_handler_add_extmap
+        (KMS_SDP_RTP_AVP_MEDIA_HANDLER (*handler), KMS_AUDIO_LEVEL_EXT_ID,
+            KMS_AUDIO_LEVEL_EXT_URI, &err)) {
+      GST_WARNING_OBJECT (base_sdp, "Can not offer audio levels: %s",
+          err->message);
+      g_error_free (err);
+    }
+  }
+
   /* Chain up */
   KMS_BASE_SDP_ENDPOINT_CLASS
       (kms_rtp_endpoint_parent_class)->create_media_handler (base_sdp, media,
@@ -772,6 +808,8 @@ kms_rtp_endpoint_configure_media (KmsBaseSdpEndpoint * base_sdp_endpoint,
         gst_sdp_media_get_media (media));
   }
 
+  kms_rtp_fec_configure_media (self->priv->fec, sess->remote_sdp, media);
+
   return TRUE;
 }
 
@@ -909,6 +947,29 @@ kms_rtp_endpoint_comedia_manager_create(KmsRtpEndpoint *self,
   g_object_unref (rtpsession);
 }
 
+static void
+kms_rtp_endpoint_fec_watch_connection (KmsRtpFec * fec,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media)
+{
+  GstPad *pad;
+
+  if (!kms_rtp_fec_watch_connection (fec, conn, remote_media, local_media)) {
+    return;
+  }
+
+  /* Protected before being encrypted, when SDES is used */
+  pad = kms_rtp_base_connection_get_rtp_sink (KMS_RTP_BASE_CONNECTION (conn));
+
+  if (pad == NULL) {
+    GST_WARNING_OBJECT (conn, "RTP sink not linked, video is not protected");
+    return;
+  }
+
+  kms_rtp_fec_watch_rtp_sink (fec, pad);
+  g_object_unref (pad);
+}
+
 static void
 kms_rtp_endpoint_start_transport_send (KmsBaseSdpEndpoint *base_sdp_endpoint,
     KmsSdpSession *sess, gboolean offerer)
@@ -994,6 +1055,44 @@ kms_rtp_endpoint_start_transport_send (KmsBaseSdpEndpoint *base_sdp_endpoint,
           media_con->address, (gint)rtp_port, (gint)rtcp_port);
     }
   }
+
+  kms_rtp_watcher_watch_session (self->priv->watcher,
+      KMS_BASE_RTP_SESSION (sess));
+}
+
+static void
+kms_rtp_endpoint_add_rtp_tap (KmsRtpEndpoint * self, GstElement * appsrc)
+{
+  kms_rtp_tap_add (self->priv->rtp_tap, appsrc);
+}
+
+static void
+kms_rtp_endpoint_remove_rtp_tap (KmsRtpEndpoint * self, GstElement * appsrc)
+{
+  kms_rtp_tap_remove (self->priv->rtp_tap, appsrc);
+}
+
+static GstStructure *
+kms_rtp_endpoint_stats (KmsElement * obj, gchar * selector)
+{
+  KmsRtpEndpoint *self = KMS_RTP_ENDPOINT (obj);
+  GstStructure *stats;
+
+  /* chain up */
+  stats = KMS_ELEMENT_CLASS (parent_class)->stats (obj, selector);
+
+  kms_rtp_fec_add_stats (self->priv->fec, stats);
+
+  return stats;
+}
+
+static void
+kms_rtp_endpoint_voice_activity_changed (gboolean active,
+    KmsRtpEndpoint * self)
+{
+  GST_DEBUG_OBJECT (self, "[VoiceActivityChanged] active: %d", active);
+
+  g_signal_emit (self, obj_signals[SIGNAL_VOICE_ACTIVITY_CHANGED], 0, active);
 }
 
 static void
@@ -1038,6 +1137,15 @@ kms_rtp_endpoint_set_property (GObject * object, guint prop_id,
       self->priv->use_sdes =
           self->priv->crypto != KMS_RTP_SDES_CRYPTO_SUITE_NONE;
       break;
+    case PROP_FEC_OVERHEAD:
+      kms_rtp_fec_set_overhead (self->priv->fec, g_value_get_uint (value));
+      break;
+    case PROP_LATENCY_SAMPLE_EVERY:
+      self->priv->latency_sample_every = g_value_get_uint (value);
+      break;
+    case PROP_LATENCY_SAMPLE_INTERVAL:
+      self->priv->latency_sample_interval = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1064,6 +1172,23 @@ kms_rtp_endpoint_get_property (GObject * object, guint prop_id,
     case PROP_CRYPTO_SUITE:
       g_value_set_enum (value, self->priv->crypto);
       break;
+    case PROP_AUDIO_LEVEL:
+      g_value_set_uint (value,
+          kms_audio_level_get_level (self->priv->audio_level));
+      break;
+    case PROP_VOICE_ACTIVITY:
+      g_value_set_boolean (value,
+          kms_audio_level_is_active (self->priv->audio_level));
+      break;
+    case PROP_FEC_OVERHEAD:
+      g_value_set_uint (value, kms_rtp_fec_get_overhead (self->priv->fec));
+      break;
+    case PROP_LATENCY_SAMPLE_EVERY:
+      g_value_set_uint (value, self->priv->latency_sample_every);
+      break;
+    case PROP_LATENCY_SAMPLE_INTERVAL:
+      g_value_set_uint (value, self->priv->latency_sample_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1085,6 +1210,11 @@ kms_rtp_endpoint_finalize (GObject * object)
   g_hash_table_unref (self->priv->comedia.rtp_conns);
   g_hash_table_unref (self->priv->comedia.signal_ids);
 
+  kms_audio_level_free (self->priv->audio_level);
+  kms_rtp_fec_free (self->priv->fec);
+  kms_rtp_tap_free (self->priv->rtp_tap);
+  kms_rtp_watcher_free (self->priv->watcher);
+
   /* chain up */
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -1095,6 +1225,7 @@ kms_rtp_endpoint_class_init (KmsRtpEndpointClass * klass)
   GObjectClass *gobject_class;
   KmsBaseSdpEndpointClass *base_sdp_endpoint_class;
   GstElementClass *gstelement_class;
+  KmsElementClass *kmselement_class;
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->set_property = kms_rtp_endpoint_set_property;
@@ -1121,6 +1252,12 @@ kms_rtp_endpoint_class_init (KmsRtpEndpointClass * klass)
 
   base_sdp_endpoint_class->configure_media = kms_rtp_endpoint_configure_media;
 
+  kmselement_class = KMS_ELEMENT_CLASS (klass);
+  kmselement_class->stats = GST_DEBUG_FUNCPTR (kms_rtp_endpoint_stats);
+
+  klass->add_rtp_tap = kms_rtp_endpoint_add_rtp_tap;
+  klass->remove_rtp_tap = kms_rtp_endpoint_remove_rtp_tap;
+
   g_object_class_install_property (gobject_class, PROP_USE_SDES,
       g_param_spec_boolean ("use-sdes",
           "Use SDES", "Set if Session Description Protocol Decurity"
@@ -1141,6 +1278,32 @@ kms_rtp_endpoint_class_init (KmsRtpEndpointClass * klass)
           KMS_TYPE_RTP_SDES_CRYPTO_SUITE, DEFAULT_CRYPTO_SUITE,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_AUDIO_LEVEL,
+      g_param_spec_uint ("audio-level",
+          "Audio level",
+          "Smoothed level of the received audio in -dBov, from 0 (loudest) "
+          "to 127 (silence), as sent in the RTP header extension",
+          0, KMS_AUDIO_LEVEL_SILENCE, KMS_AUDIO_LEVEL_SILENCE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VOICE_ACTIVITY,
+      g_param_spec_boolean ("voice-activity",
+          "Voice activity",
+          "Whether voice is being received", FALSE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FEC_OVERHEAD,
+      g_param_spec_uint ("fec-overhead",
+          "FEC overhead",
+          "FlexFEC packets sent per 100 video packets. 0 neither offers nor "
+          "accepts FEC. Must be set before negotiating",
+          0, KMS_RTP_FEC_MAX_OVERHEAD, KMS_RTP_FEC_DEFAULT_OVERHEAD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /* Read by the connections when latency stats get enabled */
+  kms_latency_sampler_install_properties (gobject_class,
+      PROP_LATENCY_SAMPLE_EVERY, PROP_LATENCY_SAMPLE_INTERVAL);
+
   obj_signals[SIGNAL_KEY_SOFT_LIMIT] =
       g_signal_new ("key-soft-limit",
       G_TYPE_FROM_CLASS (klass),
@@ -1148,6 +1311,28 @@ kms_rtp_endpoint_class_init (KmsRtpEndpointClass * klass)
       G_STRUCT_OFFSET (KmsRtpEndpointClass, key_soft_limit), NULL, NULL,
       g_cclosure_marshal_VOID__STRING, G_TYPE_NONE, 1, G_TYPE_STRING);
 
+  obj_signals[SIGNAL_VOICE_ACTIVITY_CHANGED] =
+      g_signal_new ("voice-activity-changed",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+      g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
+  /* Pushes a copy of the RTP and RTCP packets received, once decrypted, to
+   * the appsrc given, with the arrival time in their PTS */
+  obj_signals[ACTION_ADD_RTP_TAP] =
+      g_signal_new ("add-rtp-tap",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (KmsRtpEndpointClass, add_rtp_tap), NULL, NULL,
+      g_cclosure_marshal_VOID__OBJECT, G_TYPE_NONE, 1, GST_TYPE_ELEMENT);
+
+  obj_signals[ACTION_REMOVE_RTP_TAP] =
+      g_signal_new ("remove-rtp-tap",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (KmsRtpEndpointClass, remove_rtp_tap), NULL, NULL,
+      g_cclosure_marshal_VOID__OBJECT, G_TYPE_NONE, 1, GST_TYPE_ELEMENT);
+
   g_type_class_add_private (klass, sizeof (KmsRtpEndpointPrivate));
 }
 
@@ -1166,6 +1351,27 @@ kms_rtp_endpoint_init (KmsRtpEndpoint * self)
   self->priv->comedia.signal_ids = g_hash_table_new_full (NULL, NULL,
       g_object_unref, NULL);
 
+  self->priv->audio_level = kms_audio_level_new (NULL,
+      (KmsAudioLevelFunc) kms_rtp_endpoint_voice_activity_changed, self);
+  self->priv->fec = kms_rtp_fec_new ();
+  self->priv->rtp_tap = kms_rtp_tap_new ();
+
+  self->priv->watcher = kms_rtp_watcher_new ();
+  /* First, so that it gets the packets as they were received */
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_rtp_tap_watch_connection,
+      self->priv->rtp_tap);
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_audio_level_watch_connection,
+      self->priv->audio_level);
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_rtp_endpoint_fec_watch_connection,
+      self->priv->fec);
+
+  self->priv->latency_sample_every = KMS_LATENCY_SAMPLE_EVERY_DEFAULT;
+  self->priv->latency_sample_interval =
+      KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND;
+
   g_object_set (G_OBJECT (self), "bundle",
       FALSE, "rtcp-mux", FALSE, "rtcp-nack", TRUE, "rtcp-remb", TRUE,
       "max-video-recv-bandwidth", 0, NULL);
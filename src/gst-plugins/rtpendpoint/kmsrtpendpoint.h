@@ -56,6 +56,10 @@ struct _KmsRtpEndpointClass
 
   /* signals */
   void (*key_soft_limit) (KmsRtpEndpoint *obj, gchar *media);
+
+  /* actions */
+  void (*add_rtp_tap) (KmsRtpEndpoint *obj, GstElement *appsrc);
+  void (*remove_rtp_tap) (KmsRtpEndpoint *obj, GstElement *appsrc);
 };
 
 GType kms_rtp_endpoint_get_type (void);
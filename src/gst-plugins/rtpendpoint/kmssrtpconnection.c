@@ -17,6 +17,7 @@
 
 #include "kmssrtpconnection.h"
 #include "kmssocketutils.h"
+#include "kmslatencysampler.h"
 
 #define GST_CAT_DEFAULT kmsrtpconnection
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -177,6 +178,14 @@ kms_srtp_connection_request_rtp_sink (KmsIRtpConnection * base_rtp_conn)
   return gst_element_get_request_pad (self->priv->srtpenc, "rtp_sink_0");
 }
 
+static GstPad *
+kms_srtp_connection_get_rtp_sink (KmsRtpBaseConnection * base_conn)
+{
+  KmsSrtpConnection *self = KMS_SRTP_CONNECTION (base_conn);
+
+  return gst_element_get_static_pad (self->priv->srtpenc, "rtp_sink_0");
+}
+
 static GstPad *
 kms_srtp_connection_request_rtp_src (KmsIRtpConnection * base_rtp_conn)
 {
@@ -443,7 +452,7 @@ kms_srtp_connection_enable_latency_stats (KmsRtpBaseConnection * base)
   kms_rtp_base_connection_remove_probe (base, self->priv->rtp_udpsrc, "src",
       base->src_probe);
   pad = gst_element_get_static_pad (self->priv->rtp_udpsrc, "src");
-  base->src_probe = kms_stats_add_buffer_latency_meta_probe (pad, FALSE,
+  base->src_probe = kms_latency_sampler_add_element_meta_probe (pad, FALSE,
       0 /* No matter type at this point */ );
   g_object_unref (pad);
 
@@ -542,6 +551,7 @@ kms_srtp_connection_class_init (KmsSrtpConnectionClass * klass)
   base_conn_class->get_rtp_port = kms_srtp_connection_get_rtp_port;
   base_conn_class->get_rtcp_port = kms_srtp_connection_get_rtcp_port;
   base_conn_class->set_remote_info = kms_srtp_connection_set_remote_info;
+  base_conn_class->get_rtp_sink = kms_srtp_connection_get_rtp_sink;
 
   g_type_class_add_private (klass, sizeof (KmsSrtpConnectionPrivate));
 
@@ -165,3 +165,15 @@ kms_webrtc_data_channel_push_buffer (KmsWebRtcDataChannel * channel,
   return kms_webrtc_data_channel_bin_push_buffer (channel->priv->channel_bin,
       buffer, is_binary);
 }
+
+guint64
+kms_webrtc_data_channel_get_buffered_amount (KmsWebRtcDataChannel * channel)
+{
+  guint64 amount;
+
+  g_return_val_if_fail (channel != NULL, 0);
+
+  g_object_get (channel->priv->channel_bin, "buffered-amount", &amount, NULL);
+
+  return amount;
+}
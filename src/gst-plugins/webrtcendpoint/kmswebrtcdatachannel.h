@@ -75,6 +75,7 @@ KmsWebRtcDataChannel * kms_webrtc_data_channel_new (KmsWebRtcDataChannelBin *cha
 
 void kms_webrtc_data_channel_set_new_buffer_callback (KmsWebRtcDataChannel *channel, DataChannelNewBuffer cb, gpointer user_data, GDestroyNotify notify);
 GstFlowReturn kms_webrtc_data_channel_push_buffer (KmsWebRtcDataChannel *channel, GstBuffer *buffer, gboolean is_binary);
+guint64 kms_webrtc_data_channel_get_buffered_amount (KmsWebRtcDataChannel *channel);
 
 G_END_DECLS
 
@@ -51,6 +51,8 @@ G_DEFINE_TYPE_WITH_CODE (KmsWebRtcDataChannelBin, kms_webrtc_data_channel_bin,
 #define DEFAULT_NEGOTIATED FALSE
 #define DEFAULT_ID 0
 #define DEFAULT_LABEL ""
+#define DEFAULT_BUFFERED_AMOUNT_LOW_THRESHOLD 0
+#define DEFAULT_BUFFERED_AMOUNT_HIGH_THRESHOLD (1024 * 1024)    /* bytes */
 
 #define MAX_PACKETS_LIFE_TIME 65535
 #define MAX_PACKET_RETRANSMITS 65535
@@ -83,10 +85,19 @@ struct _KmsWebRtcDataChannelBinPrivate
   gboolean negotiated;
   guint16 id;
   gchar *label;
-  guint64 bytes_sent;
-  guint64 bytes_recv;
-  guint64 messages_sent;
-  guint64 messages_recv;
+
+  /* Updated without taking the lock, use atomic operations */
+  volatile gsize bytes_sent;
+  volatile gsize bytes_recv;
+  volatile gsize messages_sent;
+  volatile gsize messages_recv;
+
+  /* Bytes pushed to appsrc which have not been sent downstream yet */
+  volatile gsize buffered_amount;
+  volatile gint buffered_amount_high;
+  volatile gint buffered_amount_above_low;
+  volatile guint buffered_amount_low_threshold;
+  volatile guint buffered_amount_high_threshold;
 
   KmsWebRtcDataChannelState state;
 
@@ -106,6 +117,13 @@ struct _KmsWebRtcDataChannelBinPrivate
 #define KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK(obj) \
   (g_rec_mutex_unlock (&KMS_WEBRTC_DATA_CHANNEL_BIN_CAST ((obj))->priv->mutex))
 
+#define ATOMIC_COUNTER_ADD(counter, val) \
+  (g_atomic_pointer_add (&(counter), (gssize) (val)))
+#define ATOMIC_COUNTER_GET(counter) \
+  ((guint64) (gsize) g_atomic_pointer_get (&(counter)))
+#define ATOMIC_COUNTER_RESET(counter) \
+  (g_atomic_pointer_set (&(counter), NULL))
+
 #define KMS_WEBRTC_DATA_CHANNEL_RESET(obj) ({                  \
   ResetStreamFunc _reset_cb = NULL;                            \
   gpointer _reset_data;                                        \
@@ -137,6 +155,9 @@ enum
   PROP_BYTES_RECV,
   PROP_MESSAGES_SENT,
   PROP_MESSAGES_RECV,
+  PROP_BUFFERED_AMOUNT,
+  PROP_BUFFERED_AMOUNT_LOW_THRESHOLD,
+  PROP_BUFFERED_AMOUNT_HIGH_THRESHOLD,
 
   N_PROPERTIES
 };
@@ -147,6 +168,8 @@ enum
 {
   /* signals */
   SIGNAL_NEGOTIATED,
+  SIGNAL_BUFFERED_AMOUNT_LOW,
+  SIGNAL_BUFFERED_AMOUNT_HIGH,
 
   /* actions */
   REQUEST_OPEN,
@@ -312,6 +335,14 @@ kms_webrtc_data_channel_bin_set_property (GObject * object, guint property_id,
     case PROP_LABEL:
       kms_webrtc_data_channel_bin_set_label (self, g_value_dup_string (value));
       break;
+    case PROP_BUFFERED_AMOUNT_LOW_THRESHOLD:
+      g_atomic_int_set (&self->priv->buffered_amount_low_threshold,
+          g_value_get_uint (value));
+      break;
+    case PROP_BUFFERED_AMOUNT_HIGH_THRESHOLD:
+      g_atomic_int_set (&self->priv->buffered_amount_high_threshold,
+          g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -378,16 +409,30 @@ kms_webrtc_data_channel_bin_get_property (GObject * object, guint property_id,
       g_value_set_enum (value, self->priv->state);
       break;
     case PROP_BYTES_SENT:
-      g_value_set_uint64 (value, self->priv->bytes_sent);
+      g_value_set_uint64 (value, ATOMIC_COUNTER_GET (self->priv->bytes_sent));
       break;
     case PROP_BYTES_RECV:
-      g_value_set_uint64 (value, self->priv->bytes_recv);
+      g_value_set_uint64 (value, ATOMIC_COUNTER_GET (self->priv->bytes_recv));
       break;
     case PROP_MESSAGES_SENT:
-      g_value_set_uint64 (value, self->priv->messages_sent);
+      g_value_set_uint64 (value,
+          ATOMIC_COUNTER_GET (self->priv->messages_sent));
       break;
     case PROP_MESSAGES_RECV:
-      g_value_set_uint64 (value, self->priv->messages_recv);
+      g_value_set_uint64 (value,
+          ATOMIC_COUNTER_GET (self->priv->messages_recv));
+      break;
+    case PROP_BUFFERED_AMOUNT:
+      g_value_set_uint64 (value,
+          ATOMIC_COUNTER_GET (self->priv->buffered_amount));
+      break;
+    case PROP_BUFFERED_AMOUNT_LOW_THRESHOLD:
+      g_value_set_uint (value,
+          g_atomic_int_get (&self->priv->buffered_amount_low_threshold));
+      break;
+    case PROP_BUFFERED_AMOUNT_HIGH_THRESHOLD:
+      g_value_set_uint (value,
+          g_atomic_int_get (&self->priv->buffered_amount_high_threshold));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -420,6 +465,134 @@ kms_webrtc_data_channel_bin_finalize (GObject * object)
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+kms_webrtc_data_channel_bin_buffered_amount_inc (KmsWebRtcDataChannelBin *
+    self, gsize size)
+{
+  guint threshold;
+  gsize amount;
+
+  amount = (gsize) ATOMIC_COUNTER_ADD (self->priv->buffered_amount, size) +
+      size;
+
+  if (amount > g_atomic_int_get (&self->priv->buffered_amount_low_threshold)) {
+    g_atomic_int_set (&self->priv->buffered_amount_above_low, TRUE);
+  }
+
+  threshold = g_atomic_int_get (&self->priv->buffered_amount_high_threshold);
+
+  if (threshold == 0 || amount < threshold) {
+    return;
+  }
+
+  if (g_atomic_int_compare_and_exchange (&self->priv->buffered_amount_high,
+          FALSE, TRUE)) {
+    GST_DEBUG_OBJECT (self, "Buffered amount high (%" G_GSIZE_FORMAT
+        " bytes)", amount);
+    g_signal_emit (self, obj_signals[SIGNAL_BUFFERED_AMOUNT_HIGH], 0);
+  }
+}
+
+static void
+kms_webrtc_data_channel_bin_buffered_amount_dec (KmsWebRtcDataChannelBin *
+    self, gsize size, gboolean notify)
+{
+  gsize amount;
+
+  amount = (gsize) ATOMIC_COUNTER_ADD (self->priv->buffered_amount,
+      -(gssize) size) - size;
+
+  if (amount > g_atomic_int_get (&self->priv->buffered_amount_low_threshold)) {
+    return;
+  }
+
+  /* Only when going from above the threshold to at or below it, as the
+   * bufferedamountlow event of the W3C API */
+  if (!g_atomic_int_compare_and_exchange (&self->priv->
+          buffered_amount_above_low, TRUE, FALSE) || !notify) {
+    return;
+  }
+
+  g_atomic_int_set (&self->priv->buffered_amount_high, FALSE);
+
+  GST_DEBUG_OBJECT (self, "Buffered amount low (%" G_GSIZE_FORMAT " bytes)",
+      amount);
+  g_signal_emit (self, obj_signals[SIGNAL_BUFFERED_AMOUNT_LOW], 0);
+}
+
+/* The appsrc dropped what it had queued, which will never be sent */
+static void
+kms_webrtc_data_channel_bin_buffered_amount_reset (KmsWebRtcDataChannelBin *
+    self)
+{
+  ATOMIC_COUNTER_RESET (self->priv->buffered_amount);
+
+  /* Senders waiting for the amount to go down are told as well */
+  if (!g_atomic_int_compare_and_exchange (&self->priv->
+          buffered_amount_above_low, TRUE, FALSE)) {
+    return;
+  }
+
+  g_atomic_int_set (&self->priv->buffered_amount_high, FALSE);
+
+  GST_DEBUG_OBJECT (self, "Buffered amount low (queue dropped)");
+  g_signal_emit (self, obj_signals[SIGNAL_BUFFERED_AMOUNT_LOW], 0);
+}
+
+static GstPadProbeReturn
+kms_webrtc_data_channel_bin_appsrc_probe (GstPad * pad,
+    GstPadProbeInfo * info, gpointer user_data)
+{
+  KmsWebRtcDataChannelBin *self = KMS_WEBRTC_DATA_CHANNEL_BIN (user_data);
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_webrtc_data_channel_bin_buffered_amount_dec (self,
+        gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info)), TRUE);
+  } else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+      GST_EVENT_FLUSH_STOP) {
+    kms_webrtc_data_channel_bin_buffered_amount_reset (self);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstStateChangeReturn
+kms_webrtc_data_channel_bin_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    /* The appsrc is stopped, its queue is gone */
+    kms_webrtc_data_channel_bin_buffered_amount_reset
+        (KMS_WEBRTC_DATA_CHANNEL_BIN (element));
+  }
+
+  return ret;
+}
+
+static GstFlowReturn
+kms_webrtc_data_channel_bin_push_to_appsrc (KmsWebRtcDataChannelBin * self,
+    GstBuffer * buffer)
+{
+  gsize size = gst_buffer_get_size (buffer);
+  GstFlowReturn ret;
+
+  /* Account before pushing, the probe may run before push returns */
+  kms_webrtc_data_channel_bin_buffered_amount_inc (self, size);
+
+  ret = gst_app_src_push_buffer (GST_APP_SRC (self->priv->appsrc), buffer);
+
+  if (ret != GST_FLOW_OK) {
+    /* Never sent, so nothing was drained */
+    kms_webrtc_data_channel_bin_buffered_amount_dec (self, size, FALSE);
+  }
+
+  return ret;
+}
+
 static void
 kms_webrtc_data_channel_bin_request_open (KmsWebRtcDataChannelBin * self)
 {
@@ -483,7 +656,7 @@ kms_webrtc_data_channel_bin_request_open (KmsWebRtcDataChannelBin * self)
   gst_sctp_buffer_add_send_meta (gstbuf, KMS_DATA_CHANNEL_PPID_CONTROL, TRUE,
       GST_SCTP_SEND_META_PARTIAL_RELIABILITY_NONE, 0);
 
-  flow_ret = gst_app_src_push_buffer (GST_APP_SRC (self->priv->appsrc), gstbuf);
+  flow_ret = kms_webrtc_data_channel_bin_push_to_appsrc (self, gstbuf);
 
   if (flow_ret != GST_FLOW_OK) {
     GST_WARNING_OBJECT (self, "Failed to push data buffer: %s",
@@ -530,6 +703,9 @@ kms_webrtc_data_channel_bin_class_init (KmsWebRtcDataChannelBinClass * klass)
   gobject_class->get_property = kms_webrtc_data_channel_bin_get_property;
   gobject_class->finalize = kms_webrtc_data_channel_bin_finalize;
 
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (kms_webrtc_data_channel_bin_change_state);
+
   gst_element_class_set_details_simple (element_class,
       "SCTP data channel management",
       "SCTP/Bin/Data",
@@ -612,6 +788,27 @@ kms_webrtc_data_channel_bin_class_init (KmsWebRtcDataChannelBinClass * klass)
       "The number of messages received on this data channel", 0,
       G_MAXULONG, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
 
+  obj_properties[PROP_BUFFERED_AMOUNT] =
+      g_param_spec_uint64 ("buffered-amount", "Buffered amount",
+      "The amount of bytes queued to be sent on this data channel", 0,
+      G_MAXULONG, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_BUFFERED_AMOUNT_LOW_THRESHOLD] =
+      g_param_spec_uint ("buffered-amount-low-threshold",
+      "Buffered amount low threshold",
+      "Signal buffered-amount-low is emitted when the buffered amount "
+      "falls to this value or below", 0, G_MAXUINT,
+      DEFAULT_BUFFERED_AMOUNT_LOW_THRESHOLD,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  obj_properties[PROP_BUFFERED_AMOUNT_HIGH_THRESHOLD] =
+      g_param_spec_uint ("buffered-amount-high-threshold",
+      "Buffered amount high threshold",
+      "Signal buffered-amount-high is emitted when the buffered amount "
+      "reaches this value (0 = disabled)", 0, G_MAXUINT,
+      DEFAULT_BUFFERED_AMOUNT_HIGH_THRESHOLD,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (gobject_class, N_PROPERTIES,
       obj_properties);
 
@@ -622,6 +819,22 @@ kms_webrtc_data_channel_bin_class_init (KmsWebRtcDataChannelBinClass * klass)
       G_STRUCT_OFFSET (KmsWebRtcDataChannelBinClass, negotiated), NULL, NULL,
       g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
 
+  /* Emitted once the buffered amount reaches the high threshold. Producers
+   * should stop sending until buffered-amount-low is emitted */
+  obj_signals[SIGNAL_BUFFERED_AMOUNT_HIGH] =
+      g_signal_new ("buffered-amount-high",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (KmsWebRtcDataChannelBinClass, buffered_amount_high),
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
+  obj_signals[SIGNAL_BUFFERED_AMOUNT_LOW] =
+      g_signal_new ("buffered-amount-low",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (KmsWebRtcDataChannelBinClass, buffered_amount_low),
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
   obj_signals[REQUEST_OPEN] =
       g_signal_new ("request-open",
       G_TYPE_FROM_CLASS (klass),
@@ -656,7 +869,7 @@ kms_webrtc_data_channel_bin_send_data_channel_ack (KmsWebRtcDataChannelBin *
   gst_sctp_buffer_add_send_meta (gstbuf, KMS_DATA_CHANNEL_PPID_CONTROL, TRUE,
       GST_SCTP_SEND_META_PARTIAL_RELIABILITY_NONE, 0);
 
-  flow_ret = gst_app_src_push_buffer (GST_APP_SRC (self->priv->appsrc), gstbuf);
+  flow_ret = kms_webrtc_data_channel_bin_push_to_appsrc (self, gstbuf);
 
   if (flow_ret != GST_FLOW_OK) {
     GST_WARNING_OBJECT (self, "Failed to push data buffer: %s",
@@ -739,10 +952,10 @@ kms_webrtc_data_channel_bin_handle_open_request (KmsWebRtcDataChannelBin *
   self->priv->max_packet_life_time = -1;
   self->priv->max_packet_retransmits = -1;
   self->priv->negotiated = FALSE;
-  self->priv->messages_recv = G_GUINT64_CONSTANT (0);
-  self->priv->messages_sent = G_GUINT64_CONSTANT (0);
-  self->priv->bytes_recv = G_GUINT64_CONSTANT (0);
-  self->priv->bytes_sent = G_GUINT64_CONSTANT (0);
+  ATOMIC_COUNTER_RESET (self->priv->messages_recv);
+  ATOMIC_COUNTER_RESET (self->priv->messages_sent);
+  ATOMIC_COUNTER_RESET (self->priv->bytes_recv);
+  ATOMIC_COUNTER_RESET (self->priv->bytes_sent);
   self->priv->ctrl_bytes_sent = 0;
 
   kms_webrtc_data_channel_bin_set_label (self, label);
@@ -823,7 +1036,6 @@ new_data_callback (GstAppSink * appsink, KmsWebRtcDataChannelBin * self)
   GstBuffer *buffer;
   GstMapInfo info;
   guint16 ppid = 0;
-  gsize size = 0;
   GstMeta *meta;
 
   sample = gst_app_sink_pull_sample (GST_APP_SINK (self->priv->appsink));
@@ -836,12 +1048,6 @@ new_data_callback (GstAppSink * appsink, KmsWebRtcDataChannelBin * self)
     return GST_FLOW_ERROR;
   }
 
-  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
-    gst_sample_unref (sample);
-    GST_ERROR_OBJECT (self, "Can not read buffer");
-    return GST_FLOW_ERROR;
-  }
-
   while ((meta = gst_buffer_iterate_meta (buffer, &state))) {
     if (meta->info->api == meta_info->api) {
       GstSctpReceiveMeta *sctp_receive_meta = (GstSctpReceiveMeta *) meta;
@@ -853,8 +1059,16 @@ new_data_callback (GstAppSink * appsink, KmsWebRtcDataChannelBin * self)
 
   switch (ppid) {
     case KMS_DATA_CHANNEL_PPID_CONTROL:
+      /* Only control messages need to be parsed here */
+      if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+        gst_sample_unref (sample);
+        GST_ERROR_OBJECT (self, "Can not read buffer");
+        return GST_FLOW_ERROR;
+      }
+
       kms_webrtc_data_channel_bin_handle_control_message (self, info.data,
           info.size);
+      gst_buffer_unmap (buffer, &info);
       break;
     case KMS_DATA_CHANNEL_PPID_BINARY_PARTIAL:
       GST_WARNING_OBJECT (self,
@@ -868,13 +1082,10 @@ new_data_callback (GstAppSink * appsink, KmsWebRtcDataChannelBin * self)
       break;
     case KMS_DATA_CHANNEL_PPID_STRING:
     case KMS_DATA_CHANNEL_PPID_BINARY:
-      size = info.size;
+      ATOMIC_COUNTER_ADD (self->priv->bytes_recv, gst_buffer_get_size (buffer));
     case KMS_DATA_CHANNEL_PPID_STRING_EMPTY:
     case KMS_DATA_CHANNEL_PPID_BINARY_EMPTY:
-      KMS_WEBRTC_DATA_CHANNEL_BIN_LOCK (self);
-      self->priv->bytes_recv += size;
-      self->priv->messages_recv++;
-      KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
+      ATOMIC_COUNTER_ADD (self->priv->messages_recv, 1);
       notify = TRUE;
       break;
     default:
@@ -883,8 +1094,6 @@ new_data_callback (GstAppSink * appsink, KmsWebRtcDataChannelBin * self)
       break;
   }
 
-  gst_buffer_unmap (buffer, &info);
-
   if (reset) {
     KMS_WEBRTC_DATA_CHANNEL_RESET (self);
     ret = GST_FLOW_ERROR;
@@ -913,10 +1122,10 @@ kms_webrtc_data_channel_bin_init (KmsWebRtcDataChannelBin * self)
 
   self->priv = KMS_WEBRTC_DATA_CHANNEL_BIN_GET_PRIVATE (self);
 
-  self->priv->bytes_recv = G_GUINT64_CONSTANT (0);
-  self->priv->bytes_sent = G_GUINT64_CONSTANT (0);
-  self->priv->messages_recv = G_GUINT64_CONSTANT (0);
-  self->priv->messages_sent = G_GUINT64_CONSTANT (0);
+  self->priv->buffered_amount_low_threshold =
+      DEFAULT_BUFFERED_AMOUNT_LOW_THRESHOLD;
+  self->priv->buffered_amount_high_threshold =
+      DEFAULT_BUFFERED_AMOUNT_HIGH_THRESHOLD;
 
   g_rec_mutex_init (&self->priv->mutex);
   self->priv->state = KMS_WEB_RTC_DATA_CHANNEL_STATE_CLOSED;
@@ -956,6 +1165,9 @@ kms_webrtc_data_channel_bin_init (KmsWebRtcDataChannelBin * self)
   gst_element_add_pad (GST_ELEMENT (self), pad);
 
   target = gst_element_get_static_pad (self->priv->appsrc, "src");
+  gst_pad_add_probe (target,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+      kms_webrtc_data_channel_bin_appsrc_probe, self, NULL);
   pad_template = gst_static_pad_template_get (&src_template);
   pad = gst_ghost_pad_new_from_template ("src", target, pad_template);
   g_object_unref (pad_template);
@@ -1065,35 +1277,69 @@ kms_webrtc_data_channel_bin_get_ppid_from_meta (KmsWebRtcDataChannelBin * self,
   return TRUE;
 }
 
-GstFlowReturn
-kms_webrtc_data_channel_bin_push_buffer (KmsWebRtcDataChannelBin * self,
-    GstBuffer * buffer, gboolean is_binary)
+typedef struct _SendParams
 {
-  const GstMetaInfo *meta_info = GST_SCTP_RECEIVE_META_INFO;
-  GstSctpReceiveMeta *sctp_receive_meta = NULL;
+  gboolean ordered;
   GstSctpSendMetaPartiallyReliability pr;
-  gboolean is_empty, ordered;
-  KmsDataChannelPPID ppid;
-  GstBuffer *send_buffer;
-  guint64 bytes_sent = 0;
-  gpointer state = NULL;
-  GstFlowReturn ret;
-  guint32 pr_param = 0;
-  GstMapInfo info;
-  GstBuffer *buff;
-  GstMeta *meta;
+  guint32 pr_param;
+} SendParams;
 
-  if (self == NULL || !KMS_IS_WEBRTC_DATA_CHANNEL_BIN (self)) {
-    gst_buffer_unref (buffer);
-    g_return_val_if_reached (GST_FLOW_ERROR);
+static GstFlowReturn
+kms_webrtc_data_channel_bin_get_send_params (KmsWebRtcDataChannelBin * self,
+    SendParams * params)
+{
+  KMS_WEBRTC_DATA_CHANNEL_BIN_LOCK (self);
+
+  params->ordered = self->priv->ordered;
+
+  switch (self->priv->state) {
+    case KMS_WEB_RTC_DATA_CHANNEL_STATE_CLOSING:
+    case KMS_WEB_RTC_DATA_CHANNEL_STATE_CLOSED:
+      KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
+      return GST_FLOW_NOT_LINKED;
+    case KMS_WEB_RTC_DATA_CHANNEL_STATE_CONNECTING:
+      /* open request has been sent but no ack is received yet */
+      params->ordered = TRUE;
+    case KMS_WEB_RTC_DATA_CHANNEL_STATE_OPEN:
+      break;
+    default:
+      KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
+      GST_ERROR_OBJECT (self, "Channel is in an invalid state %u",
+          self->priv->state);
+      return GST_FLOW_ERROR;
   }
 
-  if (!gst_buffer_map (buffer, &info, GST_MAP_READ)) {
-    gst_buffer_unref (buffer);
-    GST_ERROR_OBJECT (self, "Can not read buffer");
-    return GST_FLOW_ERROR;
+  if (self->priv->max_packet_life_time == -1
+      && self->priv->max_packet_retransmits == -1) {
+    params->pr = GST_SCTP_SEND_META_PARTIAL_RELIABILITY_NONE;
+    params->pr_param = 0;
+  } else if (self->priv->max_packet_life_time != -1) {
+    params->pr = GST_SCTP_SEND_META_PARTIAL_RELIABILITY_TTL;
+    params->pr_param = self->priv->max_packet_life_time;
+  } else {                      /* if (self->priv->max_packet_retransmits != -1) */
+
+    params->pr = GST_SCTP_SEND_META_PARTIAL_RELIABILITY_RTX;
+    params->pr_param = self->priv->max_packet_retransmits;
   }
 
+  KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
+
+  return GST_FLOW_OK;
+}
+
+/* Takes ownership of @buffer. Returns the buffer ready to be pushed to the
+ * SCTP association or NULL if it can not be sent */
+static GstBuffer *
+kms_webrtc_data_channel_bin_prepare_buffer (KmsWebRtcDataChannelBin * self,
+    GstBuffer * buffer, gboolean is_binary, const SendParams * params)
+{
+  const GstMetaInfo *meta_info = GST_SCTP_RECEIVE_META_INFO;
+  GstSctpReceiveMeta *sctp_receive_meta = NULL;
+  KmsDataChannelPPID ppid;
+  gpointer state = NULL;
+  gboolean is_empty;
+  GstMeta *meta;
+
   while ((meta = gst_buffer_iterate_meta (buffer, &state))) {
     if (meta->info->api == meta_info->api) {
       sctp_receive_meta = (GstSctpReceiveMeta *) meta;
@@ -1101,17 +1347,14 @@ kms_webrtc_data_channel_bin_push_buffer (KmsWebRtcDataChannelBin * self,
     }
   }
 
-  bytes_sent = info.size;
-  is_empty = info.size == 0;
-
-  gst_buffer_unmap (buffer, &info);
+  is_empty = gst_buffer_get_size (buffer) == 0;
 
   if (sctp_receive_meta != NULL &&
       !kms_webrtc_data_channel_bin_get_ppid_from_meta (self,
           sctp_receive_meta, is_empty, &ppid)) {
     gst_buffer_unref (buffer);
 
-    return GST_FLOW_ERROR;
+    return NULL;
   } else if (is_binary) {
     if (is_empty) {
       ppid = KMS_DATA_CHANNEL_PPID_BINARY_EMPTY;
@@ -1131,66 +1374,63 @@ kms_webrtc_data_channel_bin_push_buffer (KmsWebRtcDataChannelBin * self,
 
     gst_buffer_unref (buffer);
     zero_byte = g_new0 (guint8, 1);
-    send_buffer = gst_buffer_new_wrapped (zero_byte, 1);
+    buffer = gst_buffer_new_wrapped (zero_byte, 1);
   } else {
-    send_buffer = buffer;
+    /* Buffer must be writable to add meta */
+    buffer = gst_buffer_make_writable (buffer);
   }
 
-  KMS_WEBRTC_DATA_CHANNEL_BIN_LOCK (self);
+  gst_sctp_buffer_add_send_meta (buffer, ppid, params->ordered, params->pr,
+      params->pr_param);
 
-  ordered = self->priv->ordered;
+  return buffer;
+}
 
-  switch (self->priv->state) {
-    case KMS_WEB_RTC_DATA_CHANNEL_STATE_CLOSING:
-    case KMS_WEB_RTC_DATA_CHANNEL_STATE_CLOSED:
-      KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
-      return GST_FLOW_NOT_LINKED;
-    case KMS_WEB_RTC_DATA_CHANNEL_STATE_CONNECTING:
-      /* open request has been sent but no ack is received yet */
-      ordered = TRUE;
-    case KMS_WEB_RTC_DATA_CHANNEL_STATE_OPEN:
-      break;
-    default:
-      KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
-      GST_ERROR_OBJECT (self, "Channel is in an invalid state %u",
-          self->priv->state);
-      gst_buffer_unref (send_buffer);
-      return GST_FLOW_ERROR;
-  }
+static GstFlowReturn
+kms_webrtc_data_channel_bin_send (KmsWebRtcDataChannelBin * self,
+    GstBuffer * buffer, gboolean is_binary, const SendParams * params)
+{
+  GstFlowReturn ret;
+  gsize size;
 
-  if (self->priv->max_packet_life_time == -1
-      && self->priv->max_packet_retransmits == -1) {
-    pr = GST_SCTP_SEND_META_PARTIAL_RELIABILITY_NONE;
-    pr_param = 0;
-  } else if (self->priv->max_packet_life_time != -1) {
-    pr = GST_SCTP_SEND_META_PARTIAL_RELIABILITY_TTL;
-    pr_param = self->priv->max_packet_life_time;
-  } else {                      /* if (self->priv->max_packet_retransmits != -1) */
+  size = gst_buffer_get_size (buffer);
+  buffer = kms_webrtc_data_channel_bin_prepare_buffer (self, buffer, is_binary,
+      params);
 
-    pr = GST_SCTP_SEND_META_PARTIAL_RELIABILITY_RTX;
-    pr_param = self->priv->max_packet_retransmits;
+  if (buffer == NULL) {
+    return GST_FLOW_ERROR;
   }
 
-  KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
-
-  /* Buffer must be writable to add meta */
-  buff = gst_buffer_make_writable (send_buffer);
+  ret = kms_webrtc_data_channel_bin_push_to_appsrc (self, buffer);
 
-  gst_sctp_buffer_add_send_meta (buff, ppid, ordered, pr, pr_param);
+  if (ret == GST_FLOW_OK) {
+    ATOMIC_COUNTER_ADD (self->priv->bytes_sent, size);
+    ATOMIC_COUNTER_ADD (self->priv->messages_sent, 1);
+  }
 
-  ret = gst_app_src_push_buffer (GST_APP_SRC (self->priv->appsrc), buff);
+  return ret;
+}
 
-  KMS_WEBRTC_DATA_CHANNEL_BIN_LOCK (self);
+GstFlowReturn
+kms_webrtc_data_channel_bin_push_buffer (KmsWebRtcDataChannelBin * self,
+    GstBuffer * buffer, gboolean is_binary)
+{
+  SendParams params;
+  GstFlowReturn ret;
 
-  if (bytes_sent > 0 && ret == GST_FLOW_OK) {
-    self->priv->bytes_sent += bytes_sent;
+  if (self == NULL || !KMS_IS_WEBRTC_DATA_CHANNEL_BIN (self)) {
+    gst_buffer_unref (buffer);
+    g_return_val_if_reached (GST_FLOW_ERROR);
   }
 
-  self->priv->messages_sent++;
+  ret = kms_webrtc_data_channel_bin_get_send_params (self, &params);
 
-  KMS_WEBRTC_DATA_CHANNEL_BIN_UNLOCK (self);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return ret;
+  }
 
-  return ret;
+  return kms_webrtc_data_channel_bin_send (self, buffer, is_binary, &params);
 }
 
 void
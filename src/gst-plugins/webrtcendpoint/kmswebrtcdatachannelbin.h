@@ -71,6 +71,8 @@ struct _KmsWebRtcDataChannelBinClass
 
   /* signals */
   void (*negotiated) (KmsWebRtcDataChannelBin *self);
+  void (*buffered_amount_low) (KmsWebRtcDataChannelBin *self);
+  void (*buffered_amount_high) (KmsWebRtcDataChannelBin *self);
 
   /* actions */
   void (*request_open) (KmsWebRtcDataChannelBin *self);
@@ -0,0 +1,91 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmswebrtcdatachannelmeta.h"
+
+GType
+kms_webrtc_data_channel_meta_api_get_type (void)
+{
+  static volatile GType type;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        gst_meta_api_type_register ("KmsWebRtcDataChannelMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+static gboolean
+kms_webrtc_data_channel_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  KmsWebRtcDataChannelMeta *channel_meta = (KmsWebRtcDataChannelMeta *) meta;
+
+  channel_meta->stream_id = 0;
+
+  return TRUE;
+}
+
+static gboolean
+kms_webrtc_data_channel_meta_transform (GstBuffer * transbuf, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  KmsWebRtcDataChannelMeta *channel_meta = (KmsWebRtcDataChannelMeta *) meta;
+
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    kms_buffer_add_webrtc_data_channel_meta (transbuf, channel_meta->stream_id);
+  }
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+kms_webrtc_data_channel_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register (KMS_WEBRTC_DATA_CHANNEL_META_API_TYPE,
+        "KmsWebRtcDataChannelMeta", sizeof (KmsWebRtcDataChannelMeta),
+        kms_webrtc_data_channel_meta_init, NULL,
+        kms_webrtc_data_channel_meta_transform);
+    g_once_init_leave (&meta_info, meta);
+  }
+
+  return meta_info;
+}
+
+KmsWebRtcDataChannelMeta *
+kms_buffer_add_webrtc_data_channel_meta (GstBuffer * buffer, guint16 stream_id)
+{
+  KmsWebRtcDataChannelMeta *channel_meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  channel_meta = (KmsWebRtcDataChannelMeta *) gst_buffer_add_meta (buffer,
+      KMS_WEBRTC_DATA_CHANNEL_META_INFO, NULL);
+  channel_meta->stream_id = stream_id;
+
+  return channel_meta;
+}
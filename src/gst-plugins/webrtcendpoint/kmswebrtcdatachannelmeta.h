@@ -0,0 +1,51 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_WEBRTC_DATA_CHANNEL_META_H__
+#define __KMS_WEBRTC_DATA_CHANNEL_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsWebRtcDataChannelMeta KmsWebRtcDataChannelMeta;
+
+/* Identifies the SCTP stream a data channel buffer belongs to, so that
+ * all the channels of a session can share the same data pads */
+struct _KmsWebRtcDataChannelMeta
+{
+  GstMeta meta;
+
+  guint16 stream_id;
+};
+
+GType kms_webrtc_data_channel_meta_api_get_type (void);
+#define KMS_WEBRTC_DATA_CHANNEL_META_API_TYPE \
+  (kms_webrtc_data_channel_meta_api_get_type())
+
+#define kms_buffer_get_webrtc_data_channel_meta(b) \
+  ((KmsWebRtcDataChannelMeta*)gst_buffer_get_meta((b), KMS_WEBRTC_DATA_CHANNEL_META_API_TYPE))
+
+const GstMetaInfo *kms_webrtc_data_channel_meta_get_info (void);
+#define KMS_WEBRTC_DATA_CHANNEL_META_INFO \
+  (kms_webrtc_data_channel_meta_get_info())
+
+KmsWebRtcDataChannelMeta * kms_buffer_add_webrtc_data_channel_meta (GstBuffer *buffer, guint16 stream_id);
+
+G_END_DECLS
+
+#endif /* __KMS_WEBRTC_DATA_CHANNEL_META_H__ */
@@ -21,16 +21,28 @@
 
 #include "kmswebrtcendpoint.h"
 #include "kmswebrtcsession.h"
+#include "kmswebrtcsimulcast.h"
+#include "kmswebrtctransportcc.h"
+#include "kmswebrtcrtxcache.h"
+#include "kmswebrtctransport.h"
 #include <commons/constants.h>
 #include <commons/kmsloop.h>
 #include <commons/kmsutils.h>
 #include <commons/sdp_utils.h>
 #include <commons/kmsrefstruct.h>
 #include <commons/sdpagent/kmssdprtpsavpfmediahandler.h>
+#include <commons/sdpagent/kmssdprtpavpmediahandler.h>
 #include <commons/sdpagent/kmssdpsctpmediahandler.h>
 #include "kms-webrtc-marshal.h"
 #include <glib/gstdio.h>
 #include "kms-webrtc-data-marshal.h"
+#include "kmsthreadcpu.h"
+#include "kmslatencysampler.h"
+#include "kmsstatssnapshot.h"
+#include "kmsaudiolevel.h"
+#include "kmsrtpfec.h"
+#include "kmsrtptap.h"
+#include "kmsrtpwatcher.h"
 
 #define KMS_WEBRTC_DATA_CHANNEL_PPID_STRING 51
 #define PLUGIN_NAME "webrtcendpoint"
@@ -66,6 +78,17 @@ enum
   PROP_PEM_CERTIFICATE,
   PROP_NETWORK_INTERFACES,
   PROP_EXTERNAL_ADDRESS,
+  PROP_AUDIO_LEVEL,
+  PROP_VOICE_ACTIVITY,
+  PROP_SIMULCAST_LAYER,
+  PROP_SIMULCAST_MAX_BITRATE,
+  PROP_SIMULCAST_LAYERS,
+  PROP_RTX_CACHE_TIME,
+  PROP_RTX_CACHE_SIZE,
+  PROP_RTX_CACHE_PROCESS_SIZE,
+  PROP_FEC_OVERHEAD,
+  PROP_LATENCY_SAMPLE_EVERY,
+  PROP_LATENCY_SAMPLE_INTERVAL,
   N_PROPERTIES
 };
 
@@ -80,9 +103,12 @@ enum
   SIGNAL_DATA_CHANNEL_OPENED,
   SIGNAL_DATA_CHANNEL_CLOSED,
   SIGNAL_NEW_SELECTED_PAIR_FULL,
+  SIGNAL_VOICE_ACTIVITY_CHANGED,
   ACTION_CREATE_DATA_CHANNEL,
   ACTION_DESTROY_DATA_CHANNEL,
   ACTION_GET_DATA_CHANNEL_SUPPORTED,
+  ACTION_ADD_RTP_TAP,
+  ACTION_REMOVE_RTP_TAP,
   LAST_SIGNAL
 };
 
@@ -99,6 +125,18 @@ struct _KmsWebrtcEndpointPrivate
   gchar *pem_certificate;
   gchar *network_interfaces;
   gchar *external_address;
+
+  KmsThreadCpu *cpu;
+
+  KmsAudioLevel *audio_level;
+  KmsWebrtcSimulcast *simulcast;
+  KmsWebrtcRtxCache *rtx_cache;
+  KmsRtpFec *fec;
+  KmsRtpTap *rtp_tap;
+  KmsRtpWatcher *watcher;
+
+  guint latency_sample_every;
+  guint latency_sample_interval;        /* ms */
 };
 
 /* Internal session management begin */
@@ -178,6 +216,16 @@ on_data_channel_closed (KmsWebrtcSession * sess, guint stream_id,
       0, sdp_sess->id_str, stream_id);
 }
 
+static void
+kms_webrtc_endpoint_voice_activity_changed (gboolean active,
+    KmsWebrtcEndpoint * self)
+{
+  GST_DEBUG_OBJECT (self, "[VoiceActivityChanged] active: %d", active);
+
+  g_signal_emit (self,
+      kms_webrtc_endpoint_signals[SIGNAL_VOICE_ACTIVITY_CHANGED], 0, active);
+}
+
 static void
 kms_webrtc_endpoint_link_pads (GstPad * src, GstPad * sink)
 {
@@ -366,12 +414,64 @@ kms_webrtc_endpoint_create_session_internal (KmsBaseSdpEndpoint * base_sdp,
 /* Internal session management end */
 
 /* Media handler management begin */
+static void
+kms_webrtc_endpoint_add_transport_cc_extmap (KmsBaseSdpEndpoint * base_sdp,
+    KmsSdpMediaHandler * handler)
+{
+  GError *err = NULL;
+
+  if (!kms_sdp_rtp_avp_media_handler_add_extmap
+      (KMS_SDP_RTP_AVP_MEDIA_HANDLER (handler),
+          KMS_WEBRTC_TRANSPORT_CC_EXT_ID, KMS_WEBRTC_TRANSPORT_CC_EXT_URI,
+          &err)) {
+    GST_WARNING_OBJECT (base_sdp, "Can not offer transport-cc: %s",
+        err->message);
+    g_error_free (err);
+  }
+}
+
 static void
 kms_webrtc_endpoint_create_media_handler (KmsBaseSdpEndpoint * base_sdp,
     const gchar * media, KmsSdpMediaHandler ** handler)
 {
-  if (g_strcmp0 (media, "audio") == 0 || g_strcmp0 (media, "video") == 0) {
+  if (g_strcmp0 (media, "audio") == 0) {
+    GError *err = NULL;
+
+    *handler = KMS_SDP_MEDIA_HANDLER (kms_sdp_rtp_savpf_media_handler_new ());
+
+    if (!kms_sdp_rtp_avp_media_handler_add_extmap
+        (KMS_SDP_RTP_AVP_MEDIA_HANDLER (*handler), KMS_AUDIO_LEVEL_EXT_ID,
+            KMS_AUDIO_LEVEL_EXT_URI, &err)) {
+      GST_WARNING_OBJECT (base_sdp, "Can not offer audio levels: %s",
+          err->message);
+      g_error_free (err);
+    }
+
+    kms_webrtc_endpoint_add_transport_cc_extmap (base_sdp, *handler);
+  } else if (g_strcmp0 (media, "video") == 0) {
+    GError *err = NULL;
+
     *handler = KMS_SDP_MEDIA_HANDLER (kms_sdp_rtp_savpf_media_handler_new ());
+
+    if (!kms_sdp_rtp_avp_media_handler_add_extmap
+        (KMS_SDP_RTP_AVP_MEDIA_HANDLER (*handler),
+            KMS_WEBRTC_SIMULCAST_RID_EXT_ID, KMS_WEBRTC_SIMULCAST_RID_EXT_URI,
+            &err)) {
+      GST_WARNING_OBJECT (base_sdp, "Can not receive simulcast: %s",
+          err->message);
+      g_clear_error (&err);
+    }
+
+    if (!kms_sdp_rtp_avp_media_handler_add_extmap
+        (KMS_SDP_RTP_AVP_MEDIA_HANDLER (*handler),
+            KMS_WEBRTC_SIMULCAST_RRID_EXT_ID,
+            KMS_WEBRTC_SIMULCAST_RRID_EXT_URI, &err)) {
+      GST_WARNING_OBJECT (base_sdp, "Can not map simulcast retransmissions: "
+          "%s", err->message);
+      g_error_free (err);
+    }
+
+    kms_webrtc_endpoint_add_transport_cc_extmap (base_sdp, *handler);
   } else if (g_strcmp0 (media, "application") == 0) {
     *handler = KMS_SDP_MEDIA_HANDLER (kms_sdp_sctp_media_handler_new ());
   }
@@ -406,11 +506,43 @@ kms_webrtc_endpoint_configure_media (KmsBaseSdpEndpoint *
     return FALSE;
   }
 
+  kms_webrtc_simulcast_answer_media (sess->remote_sdp, media);
+  kms_webrtc_transport_cc_configure_media (sess->remote_sdp, media);
+  kms_rtp_fec_configure_media (KMS_WEBRTC_ENDPOINT (base_sdp_endpoint)->
+      priv->fec, sess->remote_sdp, media);
+
   return kms_webrtc_session_set_crypto_info (webrtc_sess, handler, media);
 }
 
 /* Configure media SDP end */
 
+static void
+kms_webrtc_endpoint_fec_watch_connection (KmsRtpFec * fec,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media)
+{
+  KmsWebRtcTransport *tr = NULL;
+
+  if (!kms_rtp_fec_watch_connection (fec, conn, remote_media, local_media)) {
+    return;
+  }
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (conn),
+          "transport") == NULL) {
+    return;
+  }
+
+  g_object_get (conn, "transport", &tr, NULL);
+
+  if (tr == NULL) {
+    return;
+  }
+
+  /* Protected before being encrypted */
+  kms_rtp_fec_watch_encoder (fec, tr->sink->dtlssrtpenc);
+  g_object_unref (tr);
+}
+
 static void
 kms_webrtc_endpoint_start_transport_send (KmsBaseSdpEndpoint *
     base_sdp_endpoint, KmsSdpSession * sess, gboolean offerer)
@@ -423,6 +555,9 @@ kms_webrtc_endpoint_start_transport_send (KmsBaseSdpEndpoint *
       (base_sdp_endpoint, sess, offerer);
 
   kms_webrtc_session_start_transport_send (webrtc_sess, offerer);
+
+  kms_rtp_watcher_watch_session (KMS_WEBRTC_ENDPOINT
+      (base_sdp_endpoint)->priv->watcher, KMS_BASE_RTP_SESSION (sess));
 }
 
 /* ICE candidates management begin */
@@ -511,6 +646,34 @@ kms_webrtc_endpoint_set_property (GObject * object, guint prop_id,
       g_free (self->priv->external_address);
       self->priv->external_address = g_value_dup_string (value);
       break;
+    case PROP_SIMULCAST_LAYER:
+      kms_webrtc_simulcast_set_layer (self->priv->simulcast,
+          g_value_get_int (value));
+      break;
+    case PROP_SIMULCAST_MAX_BITRATE:
+      kms_webrtc_simulcast_set_max_bitrate (self->priv->simulcast,
+          g_value_get_uint (value));
+      break;
+    case PROP_RTX_CACHE_TIME:
+      kms_webrtc_rtx_cache_set_time (self->priv->rtx_cache,
+          g_value_get_uint (value));
+      break;
+    case PROP_RTX_CACHE_SIZE:
+      kms_webrtc_rtx_cache_set_size (self->priv->rtx_cache,
+          g_value_get_uint (value));
+      break;
+    case PROP_RTX_CACHE_PROCESS_SIZE:
+      kms_webrtc_rtx_cache_set_process_size (g_value_get_uint (value));
+      break;
+    case PROP_FEC_OVERHEAD:
+      kms_rtp_fec_set_overhead (self->priv->fec, g_value_get_uint (value));
+      break;
+    case PROP_LATENCY_SAMPLE_EVERY:
+      self->priv->latency_sample_every = g_value_get_uint (value);
+      break;
+    case PROP_LATENCY_SAMPLE_INTERVAL:
+      self->priv->latency_sample_interval = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -546,6 +709,47 @@ kms_webrtc_endpoint_get_property (GObject * object, guint prop_id,
     case PROP_EXTERNAL_ADDRESS:
       g_value_set_string (value, self->priv->external_address);
       break;
+    case PROP_AUDIO_LEVEL:
+      g_value_set_uint (value,
+          kms_audio_level_get_level (self->priv->audio_level));
+      break;
+    case PROP_VOICE_ACTIVITY:
+      g_value_set_boolean (value,
+          kms_audio_level_is_active (self->priv->audio_level));
+      break;
+    case PROP_SIMULCAST_LAYER:
+      g_value_set_int (value,
+          kms_webrtc_simulcast_get_layer (self->priv->simulcast));
+      break;
+    case PROP_SIMULCAST_MAX_BITRATE:
+      g_value_set_uint (value,
+          kms_webrtc_simulcast_get_max_bitrate (self->priv->simulcast));
+      break;
+    case PROP_SIMULCAST_LAYERS:
+      g_value_set_uint (value,
+          kms_webrtc_simulcast_get_layers (self->priv->simulcast));
+      break;
+    case PROP_RTX_CACHE_TIME:
+      g_value_set_uint (value,
+          kms_webrtc_rtx_cache_get_time (self->priv->rtx_cache));
+      break;
+    case PROP_RTX_CACHE_SIZE:
+      g_value_set_uint (value,
+          kms_webrtc_rtx_cache_get_size (self->priv->rtx_cache));
+      break;
+    case PROP_RTX_CACHE_PROCESS_SIZE:
+      g_value_set_uint (value, MIN (kms_webrtc_rtx_cache_get_process_size (),
+              G_MAXUINT));
+      break;
+    case PROP_FEC_OVERHEAD:
+      g_value_set_uint (value, kms_rtp_fec_get_overhead (self->priv->fec));
+      break;
+    case PROP_LATENCY_SAMPLE_EVERY:
+      g_value_set_uint (value, self->priv->latency_sample_every);
+      break;
+    case PROP_LATENCY_SAMPLE_INTERVAL:
+      g_value_set_uint (value, self->priv->latency_sample_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -586,6 +790,14 @@ kms_webrtc_endpoint_finalize (GObject * object)
 
   g_main_context_unref (self->priv->context);
 
+  kms_thread_cpu_free (self->priv->cpu);
+  kms_audio_level_free (self->priv->audio_level);
+  kms_webrtc_simulcast_free (self->priv->simulcast);
+  kms_webrtc_rtx_cache_free (self->priv->rtx_cache);
+  kms_rtp_fec_free (self->priv->fec);
+  kms_rtp_tap_free (self->priv->rtp_tap);
+  kms_rtp_watcher_free (self->priv->watcher);
+
   /* chain up */
   G_OBJECT_CLASS (kms_webrtc_endpoint_parent_class)->finalize (object);
 }
@@ -652,9 +864,25 @@ kms_webrtc_endpoint_get_data_channel_supported (KmsWebrtcEndpoint * self,
   return ret;
 }
 
+static void
+kms_webrtc_endpoint_add_rtp_tap (KmsWebrtcEndpoint * self,
+    GstElement * appsrc)
+{
+  kms_rtp_tap_add (self->priv->rtp_tap, appsrc);
+}
+
+static void
+kms_webrtc_endpoint_remove_rtp_tap (KmsWebrtcEndpoint * self,
+    GstElement * appsrc)
+{
+  kms_rtp_tap_remove (self->priv->rtp_tap, appsrc);
+}
+
 typedef struct _KmsSessStats
 {
   GstStructure *stats;
+  GstStructure *latency;
+  GstStructure *transport_cc;
   const gchar *selector;
 } KmsSessStats;
 
@@ -665,6 +893,8 @@ kms_base_rtp_endpoint_add_session_stats (gpointer key, gpointer value,
   KmsWebrtcSession *session = KMS_WEBRTC_SESSION (value);
 
   kms_webrtc_session_add_data_channels_stats (session, ss->stats, ss->selector);
+  kms_webrtc_session_add_latency_stats (session, ss->latency);
+  kms_webrtc_session_add_transport_cc_stats (session, ss->transport_cc);
 }
 
 static GstStructure *
@@ -680,15 +910,88 @@ kms_webrtc_endpoint_stats (KmsElement * obj, gchar * selector)
       KMS_ELEMENT_CLASS (kms_webrtc_endpoint_parent_class)->stats (obj,
       selector);
   ss.stats = stats;
+  ss.latency = gst_structure_new_empty (KMS_LATENCY_PERCENTILES_FIELD);
+  ss.transport_cc =
+      gst_structure_new_empty (KMS_WEBRTC_TRANSPORT_CC_STATS_FIELD);
   ss.selector = selector;
 
   sessions = kms_base_sdp_endpoint_get_sessions (KMS_BASE_SDP_ENDPOINT (self));
   g_hash_table_foreach (sessions,
       (GHFunc) kms_base_rtp_endpoint_add_session_stats, &ss);
 
+  if (gst_structure_n_fields (ss.latency) > 0) {
+    gst_structure_set (stats, KMS_LATENCY_PERCENTILES_FIELD,
+        GST_TYPE_STRUCTURE, ss.latency, NULL);
+  }
+
+  gst_structure_free (ss.latency);
+
+  if (gst_structure_n_fields (ss.transport_cc) > 0) {
+    gst_structure_set (stats, KMS_WEBRTC_TRANSPORT_CC_STATS_FIELD,
+        GST_TYPE_STRUCTURE, ss.transport_cc, NULL);
+  }
+
+  gst_structure_free (ss.transport_cc);
+
+  kms_webrtc_rtx_cache_add_stats (self->priv->rtx_cache, stats);
+  kms_rtp_fec_add_stats (self->priv->fec, stats);
+
+  kms_thread_cpu_add_stats (self->priv->cpu, stats);
+
   return stats;
 }
 
+static void
+kms_webrtc_endpoint_add_session_counters (gpointer key, gpointer value,
+    KmsStatsSnapshot * snapshot)
+{
+  kms_webrtc_session_add_transport_counters (KMS_WEBRTC_SESSION (value),
+      snapshot);
+}
+
+static void
+kms_webrtc_endpoint_fill_snapshot (GstElement * element,
+    KmsStatsSnapshot * snapshot)
+{
+  KmsWebrtcEndpoint *self = KMS_WEBRTC_ENDPOINT (element);
+  GHashTable *sessions;
+  guint64 cpu_time;
+  guint threads;
+
+  KMS_ELEMENT_LOCK (self);
+  sessions = kms_base_sdp_endpoint_get_sessions (KMS_BASE_SDP_ENDPOINT (self));
+  g_hash_table_foreach (sessions,
+      (GHFunc) kms_webrtc_endpoint_add_session_counters, snapshot);
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (kms_thread_cpu_get_time (self->priv->cpu, &cpu_time, &threads)) {
+    snapshot->values[KMS_STATS_COUNTER_CPU_TIME] = cpu_time;
+    snapshot->values[KMS_STATS_COUNTER_THREADS] = threads;
+  }
+}
+
+static void
+kms_webrtc_endpoint_collect_media_stats (KmsElement * obj, gboolean enable)
+{
+  KmsWebrtcEndpoint *self = KMS_WEBRTC_ENDPOINT (obj);
+
+  kms_thread_cpu_set_enabled (self->priv->cpu, enable);
+
+  KMS_ELEMENT_CLASS
+      (kms_webrtc_endpoint_parent_class)->collect_media_stats (obj, enable);
+}
+
+static void
+kms_webrtc_endpoint_handle_message (GstBin * bin, GstMessage * message)
+{
+  KmsWebrtcEndpoint *self = KMS_WEBRTC_ENDPOINT (bin);
+
+  kms_thread_cpu_handle_message (self->priv->cpu, message);
+
+  GST_BIN_CLASS (kms_webrtc_endpoint_parent_class)->handle_message (bin,
+      message);
+}
+
 static void
 kms_webrtc_endpoint_class_init (KmsWebrtcEndpointClass * klass)
 {
@@ -704,6 +1007,14 @@ kms_webrtc_endpoint_class_init (KmsWebrtcEndpointClass * klass)
 
   kmselement_class = KMS_ELEMENT_CLASS (klass);
   kmselement_class->stats = GST_DEBUG_FUNCPTR (kms_webrtc_endpoint_stats);
+  kmselement_class->collect_media_stats =
+      GST_DEBUG_FUNCPTR (kms_webrtc_endpoint_collect_media_stats);
+
+  GST_BIN_CLASS (klass)->handle_message =
+      GST_DEBUG_FUNCPTR (kms_webrtc_endpoint_handle_message);
+
+  kms_stats_snapshot_set_fill_func (G_TYPE_FROM_CLASS (klass),
+      kms_webrtc_endpoint_fill_snapshot);
 
   gst_element_class_set_details_simple (GST_ELEMENT_CLASS (klass),
       "WebrtcEndpoint",
@@ -731,6 +1042,8 @@ kms_webrtc_endpoint_class_init (KmsWebrtcEndpointClass * klass)
   klass->destroy_data_channel = kms_webrtc_endpoint_destroy_data_channel;
   klass->get_data_channel_supported =
       kms_webrtc_endpoint_get_data_channel_supported;
+  klass->add_rtp_tap = kms_webrtc_endpoint_add_rtp_tap;
+  klass->remove_rtp_tap = kms_webrtc_endpoint_remove_rtp_tap;
 
   g_object_class_install_property (gobject_class, PROP_STUN_SERVER_IP,
       g_param_spec_string ("stun-server",
@@ -771,6 +1084,75 @@ kms_webrtc_endpoint_class_init (KmsWebrtcEndpointClass * klass)
           "External (public) IP address of the media server",
           DEFAULT_EXTERNAL_ADDRESS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_AUDIO_LEVEL,
+      g_param_spec_uint ("audio-level",
+          "Audio level",
+          "Smoothed level of the received audio in -dBov, from 0 (loudest) "
+          "to 127 (silence), as sent in the RTP header extension",
+          0, KMS_AUDIO_LEVEL_SILENCE, KMS_AUDIO_LEVEL_SILENCE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_VOICE_ACTIVITY,
+      g_param_spec_boolean ("voice-activity",
+          "Voice activity",
+          "Whether voice is being received", FALSE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SIMULCAST_LAYER,
+      g_param_spec_int ("simulcast-layer",
+          "Simulcast layer",
+          "Simulcast layer forwarded, 0 being the one with the lowest "
+          "bitrate, or -1 to choose it from simulcast-max-bitrate",
+          KMS_WEBRTC_SIMULCAST_LAYER_AUTO, G_MAXINT,
+          KMS_WEBRTC_SIMULCAST_LAYER_AUTO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SIMULCAST_MAX_BITRATE,
+      g_param_spec_uint ("simulcast-max-bitrate",
+          "Simulcast max bitrate",
+          "Highest bitrate (bps) of the simulcast layer chosen automatically, "
+          "0 for no limit", 0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SIMULCAST_LAYERS,
+      g_param_spec_uint ("simulcast-layers",
+          "Simulcast layers",
+          "Simulcast layers being received, 0 without simulcast", 0,
+          G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_CACHE_TIME,
+      g_param_spec_uint ("rtx-cache-time",
+          "Retransmission cache time",
+          "Time (ms) sent packets are kept to answer NACKs, 0 disables it", 0,
+          G_MAXUINT, KMS_WEBRTC_RTX_CACHE_DEFAULT_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_CACHE_SIZE,
+      g_param_spec_uint ("rtx-cache-size",
+          "Retransmission cache size",
+          "Bytes of sent packets kept to answer NACKs", 0, G_MAXUINT,
+          KMS_WEBRTC_RTX_CACHE_DEFAULT_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_CACHE_PROCESS_SIZE,
+      g_param_spec_uint ("rtx-cache-process-size",
+          "Retransmission cache process size",
+          "Bytes of sent packets kept by all the endpoints of the process",
+          0, G_MAXUINT, KMS_WEBRTC_RTX_CACHE_DEFAULT_PROCESS_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FEC_OVERHEAD,
+      g_param_spec_uint ("fec-overhead",
+          "FEC overhead",
+          "FlexFEC packets sent per 100 video packets. 0 neither offers nor "
+          "accepts FEC. Must be set before negotiating",
+          0, KMS_RTP_FEC_MAX_OVERHEAD, KMS_RTP_FEC_DEFAULT_OVERHEAD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /* Read by the transports when latency stats get enabled */
+  kms_latency_sampler_install_properties (gobject_class,
+      PROP_LATENCY_SAMPLE_EVERY, PROP_LATENCY_SAMPLE_INTERVAL);
+
   /**
   * KmsWebrtcEndpoint::on-ice-candidate:
   * @self: the object which received the signal
@@ -823,6 +1205,19 @@ kms_webrtc_endpoint_class_init (KmsWebrtcEndpointClass * klass)
       G_TYPE_NONE, 5, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT,
       KMS_TYPE_ICE_CANDIDATE, KMS_TYPE_ICE_CANDIDATE);
 
+  /**
+   * KmsWebrtcEndpoint::voice-activity-changed
+   * @self: the object which received the signal
+   * @active: whether voice is being received
+   *
+   * Emitted from a streaming thread when the remote peer starts or stops
+   * talking, according to the audio levels it sends.
+   */
+  kms_webrtc_endpoint_signals[SIGNAL_VOICE_ACTIVITY_CHANGED] =
+      g_signal_new ("voice-activity-changed",
+      G_OBJECT_CLASS_TYPE (klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+      g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
   kms_webrtc_endpoint_signals[SIGNAL_ADD_ICE_CANDIDATE] =
       g_signal_new ("add-ice-candidate",
       G_TYPE_FROM_CLASS (klass),
@@ -888,6 +1283,29 @@ kms_webrtc_endpoint_class_init (KmsWebrtcEndpointClass * klass)
       NULL, NULL, __kms_webrtc_marshal_BOOLEAN__STRING, G_TYPE_BOOLEAN, 1,
       G_TYPE_STRING);
 
+  /**
+   * KmsWebrtcEndpoint::add-rtp-tap:
+   * @appsrc: the appsrc the packets are pushed to
+   *
+   * Pushes a copy of the RTP and RTCP packets received, once decrypted, to
+   * @appsrc, with the arrival time in their PTS.
+   */
+  kms_webrtc_endpoint_signals[ACTION_ADD_RTP_TAP] =
+      g_signal_new ("add-rtp-tap",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (KmsWebrtcEndpointClass, add_rtp_tap),
+      NULL, NULL, g_cclosure_marshal_VOID__OBJECT, G_TYPE_NONE, 1,
+      GST_TYPE_ELEMENT);
+
+  kms_webrtc_endpoint_signals[ACTION_REMOVE_RTP_TAP] =
+      g_signal_new ("remove-rtp-tap",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (KmsWebrtcEndpointClass, remove_rtp_tap),
+      NULL, NULL, g_cclosure_marshal_VOID__OBJECT, G_TYPE_NONE, 1,
+      GST_TYPE_ELEMENT);
+
   g_type_class_add_private (klass, sizeof (KmsWebrtcEndpointPrivate));
 }
 
@@ -908,6 +1326,36 @@ kms_webrtc_endpoint_init (KmsWebrtcEndpoint * self)
 
   self->priv->loop = kms_loop_new ();
   g_object_get (self->priv->loop, "context", &self->priv->context, NULL);
+
+  self->priv->cpu = kms_thread_cpu_new ();
+  self->priv->audio_level = kms_audio_level_new (self->priv->loop,
+      (KmsAudioLevelFunc) kms_webrtc_endpoint_voice_activity_changed, self);
+  self->priv->simulcast = kms_webrtc_simulcast_new (KMS_ELEMENT (self));
+  self->priv->rtx_cache = kms_webrtc_rtx_cache_new ();
+  self->priv->fec = kms_rtp_fec_new ();
+  self->priv->rtp_tap = kms_rtp_tap_new ();
+
+  self->priv->watcher = kms_rtp_watcher_new ();
+  /* First, so that it gets the packets as they were received */
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_rtp_tap_watch_connection,
+      self->priv->rtp_tap);
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_audio_level_watch_connection,
+      self->priv->audio_level);
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_webrtc_simulcast_watch_connection,
+      self->priv->simulcast);
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_webrtc_rtx_cache_watch_connection,
+      self->priv->rtx_cache);
+  kms_rtp_watcher_add_media_func (self->priv->watcher,
+      (KmsRtpWatcherMediaFunc) kms_webrtc_endpoint_fec_watch_connection,
+      self->priv->fec);
+
+  self->priv->latency_sample_every = KMS_LATENCY_SAMPLE_EVERY_DEFAULT;
+  self->priv->latency_sample_interval =
+      KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND;
 }
 
 gboolean
@@ -57,6 +57,8 @@ struct _KmsWebrtcEndpointClass
   gint (*create_data_channel) (KmsWebrtcEndpoint *self, const gchar *sess_id, gboolean ordered, gint max_packet_life_time, gint max_retransmits, const gchar * label, const gchar * protocol);
   void (*destroy_data_channel) (KmsWebrtcEndpoint *self, const gchar *sess_id, gint stream_id);
   gboolean (*get_data_channel_supported) (KmsWebrtcEndpoint * self, const gchar * sess_id);
+  void (*add_rtp_tap) (KmsWebrtcEndpoint * self, GstElement * appsrc);
+  void (*remove_rtp_tap) (KmsWebrtcEndpoint * self, GstElement * appsrc);
 
   /* Signals */
   void (*on_ice_candidate) (KmsWebrtcEndpoint * self, const gchar *sess_id,
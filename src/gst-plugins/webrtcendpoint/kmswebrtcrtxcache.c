@@ -0,0 +1,671 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmswebrtcrtxcache.h"
+#include "kmsrtpwatcher.h"
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#define GST_CAT_DEFAULT kms_webrtc_rtx_cache_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define CONNECTION_DATA "kms-webrtc-rtx-cache-connection"
+
+#define RTCP_FMT_NACK 1
+
+/* Slots per SSRC, a second of the highest bitrate video fits */
+#define RING_SIZE 2048
+#define RING_MASK (RING_SIZE - 1)
+
+/* The same packet is not sent again until its retransmission had time to
+ * arrive */
+#define RESEND_INTERVAL (20 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct _KmsRtxConnection
+{
+  KmsWebrtcRtxCache *cache;
+  GstPad *src;                  /* Retransmissions are pushed from here */
+  GstPad *sink;                 /* and go into the encoder through here */
+} KmsRtxConnection;
+
+typedef struct _KmsRtxPacket KmsRtxPacket;
+
+typedef struct _KmsRtxStream
+{
+  guint32 ssrc;
+  KmsRtxConnection *conn;
+  gint64 max_seq;               /* Unwrapped */
+  gint64 expired_seq;           /* Newest dropped for being too old */
+  KmsRtxPacket *slots[RING_SIZE];
+} KmsRtxStream;
+
+struct _KmsRtxPacket
+{
+  KmsRtxStream *stream;
+  gint64 seq;
+  gint64 time;
+  gint64 resent;
+  GstBuffer *buffer;
+  gsize size;
+};
+
+struct _KmsWebrtcRtxCache
+{
+  GMutex mutex;
+  GHashTable *streams;          /* <SSRC, KmsRtxStream> */
+  GPtrArray *conns;
+  GQueue packets;               /* Oldest first */
+  gsize bytes;
+
+  gint64 time;                  /* us */
+  gsize size;
+
+  guint64 hits;
+  guint64 misses;
+  guint64 too_old;
+};
+
+/* Shared by all the caches */
+static gssize process_bytes = 0;
+static gssize process_size = KMS_WEBRTC_RTX_CACHE_DEFAULT_PROCESS_SIZE;
+
+/* Accounts @size bytes to the process if they fit. Checking and adding in
+ * two steps would let concurrent caches go over the limit */
+static gboolean
+kms_webrtc_rtx_cache_process_reserve (gsize size)
+{
+  gssize bytes;
+
+  do {
+    bytes = (gssize) g_atomic_pointer_get (&process_bytes);
+
+    if (bytes + (gssize) size > (gssize) g_atomic_pointer_get (&process_size)) {
+      return FALSE;
+    }
+  } while (!g_atomic_pointer_compare_and_exchange (&process_bytes, bytes,
+          bytes + (gssize) size));
+
+  return TRUE;
+}
+
+static void
+kms_webrtc_rtx_cache_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "webrtcrtxcache", 0,
+        "WebRTC retransmission cache");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+static void
+kms_rtx_connection_free (KmsRtxConnection * conn)
+{
+  if (conn->src != NULL) {
+    gst_pad_set_active (conn->src, FALSE);
+    g_object_unref (conn->src);
+  }
+
+  g_clear_object (&conn->sink);
+  g_slice_free (KmsRtxConnection, conn);
+}
+
+static void
+kms_rtx_stream_free (KmsRtxStream * stream)
+{
+  g_slice_free (KmsRtxStream, stream);
+}
+
+KmsWebrtcRtxCache *
+kms_webrtc_rtx_cache_new (void)
+{
+  KmsWebrtcRtxCache *self;
+
+  kms_webrtc_rtx_cache_init ();
+
+  self = g_slice_new0 (KmsWebrtcRtxCache);
+  g_mutex_init (&self->mutex);
+  self->streams = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) kms_rtx_stream_free);
+  self->conns = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      kms_rtx_connection_free);
+  g_queue_init (&self->packets);
+  self->time = KMS_WEBRTC_RTX_CACHE_DEFAULT_TIME * G_TIME_SPAN_MILLISECOND;
+  self->size = KMS_WEBRTC_RTX_CACHE_DEFAULT_SIZE;
+
+  return self;
+}
+
+/* Must be called with the mutex held */
+static void
+kms_webrtc_rtx_cache_drop_oldest (KmsWebrtcRtxCache * self, gboolean expired)
+{
+  KmsRtxPacket *packet = g_queue_pop_head (&self->packets);
+  KmsRtxStream *stream = packet->stream;
+
+  if (stream->slots[packet->seq & RING_MASK] == packet) {
+    stream->slots[packet->seq & RING_MASK] = NULL;
+  }
+
+  if (expired) {
+    stream->expired_seq = MAX (stream->expired_seq, packet->seq);
+  }
+
+  self->bytes -= packet->size;
+  g_atomic_pointer_add (&process_bytes, -(gssize) packet->size);
+
+  gst_buffer_unref (packet->buffer);
+  g_slice_free (KmsRtxPacket, packet);
+}
+
+void
+kms_webrtc_rtx_cache_free (KmsWebrtcRtxCache * self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  while (!g_queue_is_empty (&self->packets)) {
+    kms_webrtc_rtx_cache_drop_oldest (self, FALSE);
+  }
+
+  g_hash_table_unref (self->streams);
+  g_ptr_array_unref (self->conns);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsWebrtcRtxCache, self);
+}
+
+/* Sending */
+
+static gint64
+kms_rtx_stream_unwrap (KmsRtxStream * stream, guint16 seq)
+{
+  return stream->max_seq + (gint16) (seq - (guint16) stream->max_seq);
+}
+
+/* Must be called with the mutex held */
+static KmsRtxStream *
+kms_webrtc_rtx_cache_get_stream (KmsWebrtcRtxCache * self, guint32 ssrc,
+    guint16 seq, KmsRtxConnection * conn)
+{
+  KmsRtxStream *stream;
+
+  stream = g_hash_table_lookup (self->streams, GUINT_TO_POINTER (ssrc));
+
+  if (stream == NULL) {
+    stream = g_slice_new0 (KmsRtxStream);
+    stream->ssrc = ssrc;
+    /* Keeps unwrapped numbers positive */
+    stream->max_seq = G_MAXUINT16 + 1 + seq;
+    stream->expired_seq = -1;
+    g_hash_table_insert (self->streams, GUINT_TO_POINTER (ssrc), stream);
+
+    GST_DEBUG ("Caching packets of SSRC %" G_GUINT32_FORMAT, ssrc);
+  }
+
+  stream->conn = conn;
+
+  return stream;
+}
+
+static void
+kms_webrtc_rtx_cache_store (KmsWebrtcRtxCache * self, KmsRtxConnection * conn,
+    GstBuffer * buffer, gint64 now)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsRtxStream *stream;
+  KmsRtxPacket *packet;
+  gsize size;
+  guint32 ssrc;
+  guint16 seq;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    return;
+  }
+
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  seq = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  size = gst_buffer_get_size (buffer);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->time == 0 || size > self->size) {
+    g_mutex_unlock (&self->mutex);
+    return;
+  }
+
+  while (!g_queue_is_empty (&self->packets) &&
+      ((KmsRtxPacket *) g_queue_peek_head (&self->packets))->time <
+      now - self->time) {
+    kms_webrtc_rtx_cache_drop_oldest (self, TRUE);
+  }
+
+  while (!g_queue_is_empty (&self->packets) &&
+      self->bytes + size > self->size) {
+    kms_webrtc_rtx_cache_drop_oldest (self, FALSE);
+  }
+
+  while (!kms_webrtc_rtx_cache_process_reserve (size)) {
+    if (g_queue_is_empty (&self->packets)) {
+      /* Other endpoints are using all of it */
+      g_mutex_unlock (&self->mutex);
+      return;
+    }
+
+    kms_webrtc_rtx_cache_drop_oldest (self, FALSE);
+  }
+
+  stream = kms_webrtc_rtx_cache_get_stream (self, ssrc, seq, conn);
+
+  packet = g_slice_new0 (KmsRtxPacket);
+  packet->stream = stream;
+  packet->seq = kms_rtx_stream_unwrap (stream, seq);
+  packet->time = now;
+  packet->buffer = gst_buffer_ref (buffer);
+  packet->size = size;
+
+  /* A replaced packet is freed when its time comes */
+  stream->slots[packet->seq & RING_MASK] = packet;
+  stream->max_seq = MAX (stream->max_seq, packet->seq);
+
+  g_queue_push_tail (&self->packets, packet);
+  self->bytes += size;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+static gboolean
+kms_webrtc_rtx_cache_store_list (GstBuffer ** buffer, guint idx,
+    KmsRtxConnection * conn)
+{
+  kms_webrtc_rtx_cache_store (conn->cache, conn, *buffer,
+      g_get_monotonic_time ());
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_webrtc_rtx_cache_rtp_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsRtxConnection * conn)
+{
+  if (pad == conn->sink) {
+    /* Retransmissions are already cached */
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_webrtc_rtx_cache_store (conn->cache, conn,
+        gst_pad_probe_info_get_buffer (info), g_get_monotonic_time ());
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach (gst_pad_probe_info_get_buffer_list (info),
+        (GstBufferListFunc) kms_webrtc_rtx_cache_store_list, conn);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Answering NACKs */
+
+/* Must be called with the mutex held */
+static void
+kms_webrtc_rtx_cache_lookup (KmsWebrtcRtxCache * self, KmsRtxStream * stream,
+    guint16 seq, gint64 now, GstBufferList * list)
+{
+  gint64 unwrapped = kms_rtx_stream_unwrap (stream, seq);
+  KmsRtxPacket *packet = stream->slots[unwrapped & RING_MASK];
+
+  if (packet == NULL || packet->seq != unwrapped) {
+    if (unwrapped <= stream->expired_seq) {
+      self->too_old++;
+    } else {
+      self->misses++;
+    }
+
+    GST_TRACE ("Packet %u of SSRC %" G_GUINT32_FORMAT " not cached", seq,
+        stream->ssrc);
+    return;
+  }
+
+  self->hits++;
+
+  if (packet->resent != 0 && now - packet->resent < RESEND_INTERVAL) {
+    return;
+  }
+
+  packet->resent = now;
+  gst_buffer_list_add (list, gst_buffer_ref (packet->buffer));
+}
+
+/* <sender SSRC> <media SSRC> (<PID> <BLP>)* */
+static void
+kms_webrtc_rtx_cache_process_nack (KmsWebrtcRtxCache * self,
+    const guint8 * packet, guint len, gint64 now, GHashTable * resend)
+{
+  KmsRtxStream *stream;
+  GstBufferList *list;
+  guint offset;
+
+  stream = g_hash_table_lookup (self->streams,
+      GUINT_TO_POINTER (GST_READ_UINT32_BE (packet + 8)));
+
+  if (stream == NULL || stream->conn == NULL ||
+      stream->conn->src == NULL) {
+    return;
+  }
+
+  list = g_hash_table_lookup (resend, stream->conn);
+
+  if (list == NULL) {
+    list = gst_buffer_list_new ();
+    g_hash_table_insert (resend, stream->conn, list);
+  }
+
+  for (offset = 12; offset + 4 <= len; offset += 4) {
+    guint16 pid = GST_READ_UINT16_BE (packet + offset);
+    guint16 blp = GST_READ_UINT16_BE (packet + offset + 2);
+    guint i;
+
+    kms_webrtc_rtx_cache_lookup (self, stream, pid, now, list);
+
+    for (i = 0; i < 16; i++) {
+      if (blp & (1 << i)) {
+        kms_webrtc_rtx_cache_lookup (self, stream, pid + i + 1, now, list);
+      }
+    }
+  }
+}
+
+static GstPadProbeReturn
+kms_webrtc_rtx_cache_rtcp_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsWebrtcRtxCache * self)
+{
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  GHashTableIter iter;
+  GHashTable *resend;
+  gpointer conn, list;
+  GstMapInfo map;
+  guint offset;
+  gint64 now;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  resend = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) gst_buffer_list_unref);
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&self->mutex);
+
+  for (offset = 0; offset + 4 <= map.size;) {
+    const guint8 *packet = map.data + offset;
+    guint len = (GST_READ_UINT16_BE (packet + 2) + 1) * 4;
+
+    if ((packet[0] >> 6) != 2 || offset + len > map.size) {
+      break;
+    }
+
+    if (packet[1] == GST_RTCP_TYPE_RTPFB &&
+        (packet[0] & 0x1f) == RTCP_FMT_NACK && len >= 16) {
+      kms_webrtc_rtx_cache_process_nack (self, packet, len, now, resend);
+    }
+
+    offset += len;
+  }
+
+  g_hash_table_iter_init (&iter, resend);
+
+  while (g_hash_table_iter_next (&iter, &conn, &list)) {
+    /* Pads are kept while the cache lives */
+    if (gst_buffer_list_length (list) > 0) {
+      g_object_ref (((KmsRtxConnection *) conn)->src);
+    } else {
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+  gst_buffer_unmap (buffer, &map);
+
+  g_hash_table_iter_init (&iter, resend);
+
+  while (g_hash_table_iter_next (&iter, &conn, &list)) {
+    GstPad *src = ((KmsRtxConnection *) conn)->src;
+
+    gst_pad_push_list (src, gst_buffer_list_ref (list));
+    g_object_unref (src);
+  }
+
+  g_hash_table_unref (resend);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Pads */
+
+static void
+kms_webrtc_rtx_cache_watch_rtp_sink (KmsRtxConnection * conn, GstPad * pad)
+{
+  if (!g_str_has_prefix (GST_OBJECT_NAME (pad), "rtp_sink")) {
+    return;
+  }
+
+  kms_rtp_watcher_add_pad_func (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) kms_webrtc_rtx_cache_rtp_probe, conn, NULL);
+}
+
+static void
+kms_webrtc_rtx_cache_rtp_sink_added (GstElement * element, GstPad * pad,
+    KmsRtxConnection * conn)
+{
+  if (GST_PAD_IS_SINK (pad)) {
+    kms_webrtc_rtx_cache_watch_rtp_sink (conn, pad);
+  }
+}
+
+static void
+kms_webrtc_rtx_cache_watch_rtp_sink_foreach (const GValue * item,
+    KmsRtxConnection * conn)
+{
+  kms_webrtc_rtx_cache_watch_rtp_sink (conn, g_value_get_object (item));
+}
+
+static GstPad *
+kms_webrtc_rtx_cache_create_src (GstPad * sink)
+{
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *stream_id;
+  GstPad *src;
+
+  src = gst_pad_new ("rtx_cache_src", GST_PAD_SRC);
+
+  if (gst_pad_link (src, sink) != GST_PAD_LINK_OK) {
+    GST_WARNING_OBJECT (sink, "Can not retransmit packets");
+    g_object_unref (src);
+    return NULL;
+  }
+
+  gst_pad_set_active (src, TRUE);
+
+  /* Sticky, sent again with the first retransmission if the encoder is not
+   * ready */
+  stream_id = g_strdup_printf ("rtx-cache-%p", src);
+  gst_pad_push_event (src, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  caps = gst_caps_new_empty_simple ("application/x-rtp");
+  gst_pad_push_event (src, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (src, gst_event_new_segment (&segment));
+
+  return src;
+}
+
+void
+kms_webrtc_rtx_cache_watch_pads (KmsWebrtcRtxCache * self, GstPad * rtp_sink,
+    GstPad * rtcp_src)
+{
+  KmsRtxConnection *rtx_conn;
+  GstElement *encoder;
+  GstIterator *it;
+
+  /* Lives as long as the cache, so do the pads it watches */
+  rtx_conn = g_slice_new0 (KmsRtxConnection);
+  rtx_conn->cache = self;
+  rtx_conn->sink = rtp_sink != NULL ? g_object_ref (rtp_sink) : NULL;
+
+  if (rtx_conn->sink != NULL) {
+    rtx_conn->src = kms_webrtc_rtx_cache_create_src (rtx_conn->sink);
+  }
+
+  g_mutex_lock (&self->mutex);
+  g_ptr_array_add (self->conns, rtx_conn);
+  g_mutex_unlock (&self->mutex);
+
+  if (rtx_conn->src == NULL) {
+    return;
+  }
+
+  encoder = gst_pad_get_parent_element (rtx_conn->sink);
+
+  if (encoder != NULL) {
+    it = gst_element_iterate_sink_pads (encoder);
+    gst_iterator_foreach (it, (GstIteratorForeachFunction)
+        kms_webrtc_rtx_cache_watch_rtp_sink_foreach, rtx_conn);
+    gst_iterator_free (it);
+
+    g_signal_connect (encoder, "pad-added",
+        G_CALLBACK (kms_webrtc_rtx_cache_rtp_sink_added), rtx_conn);
+    g_object_unref (encoder);
+  }
+
+  if (rtcp_src != NULL) {
+    kms_rtp_watcher_add_pad_func (rtcp_src, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) kms_webrtc_rtx_cache_rtcp_probe, self, NULL);
+  }
+}
+
+void
+kms_webrtc_rtx_cache_watch_connection (KmsWebrtcRtxCache * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media)
+{
+  GstPad *rtp_sink, *rtcp_src;
+
+  if (!kms_rtp_watcher_mark (conn, CONNECTION_DATA)) {
+    return;
+  }
+
+  rtp_sink = kms_i_rtp_connection_request_rtp_sink (conn);
+  rtcp_src = kms_i_rtp_connection_request_rtcp_src (conn);
+
+  kms_webrtc_rtx_cache_watch_pads (self, rtp_sink, rtcp_src);
+
+  g_clear_object (&rtp_sink);
+  g_clear_object (&rtcp_src);
+}
+
+void
+kms_webrtc_rtx_cache_set_time (KmsWebrtcRtxCache * self, guint time)
+{
+  g_mutex_lock (&self->mutex);
+  self->time = time * G_TIME_SPAN_MILLISECOND;
+
+  if (self->time == 0) {
+    while (!g_queue_is_empty (&self->packets)) {
+      kms_webrtc_rtx_cache_drop_oldest (self, FALSE);
+    }
+  }
+  g_mutex_unlock (&self->mutex);
+}
+
+guint
+kms_webrtc_rtx_cache_get_time (KmsWebrtcRtxCache * self)
+{
+  guint time;
+
+  g_mutex_lock (&self->mutex);
+  time = self->time / G_TIME_SPAN_MILLISECOND;
+  g_mutex_unlock (&self->mutex);
+
+  return time;
+}
+
+void
+kms_webrtc_rtx_cache_set_size (KmsWebrtcRtxCache * self, guint size)
+{
+  g_mutex_lock (&self->mutex);
+  self->size = size;
+
+  while (!g_queue_is_empty (&self->packets) && self->bytes > self->size) {
+    kms_webrtc_rtx_cache_drop_oldest (self, FALSE);
+  }
+  g_mutex_unlock (&self->mutex);
+}
+
+guint
+kms_webrtc_rtx_cache_get_size (KmsWebrtcRtxCache * self)
+{
+  guint size;
+
+  g_mutex_lock (&self->mutex);
+  size = self->size;
+  g_mutex_unlock (&self->mutex);
+
+  return size;
+}
+
+void
+kms_webrtc_rtx_cache_set_process_size (gsize size)
+{
+  /* Caches over it shrink as they store new packets */
+  g_atomic_pointer_set (&process_size, (gssize) size);
+}
+
+gsize
+kms_webrtc_rtx_cache_get_process_size (void)
+{
+  return (gsize) g_atomic_pointer_get (&process_size);
+}
+
+void
+kms_webrtc_rtx_cache_add_stats (KmsWebrtcRtxCache * self, GstStructure * stats)
+{
+  GstStructure *cache_stats;
+
+  g_mutex_lock (&self->mutex);
+  cache_stats = gst_structure_new (KMS_WEBRTC_RTX_CACHE_STATS_FIELD,
+      "hits", G_TYPE_UINT64, self->hits,
+      "misses", G_TYPE_UINT64, self->misses,
+      "too-old", G_TYPE_UINT64, self->too_old,
+      "packets", G_TYPE_UINT, g_queue_get_length (&self->packets),
+      "bytes", G_TYPE_UINT64, (guint64) self->bytes, NULL);
+  g_mutex_unlock (&self->mutex);
+
+  gst_structure_set (stats, KMS_WEBRTC_RTX_CACHE_STATS_FIELD,
+      GST_TYPE_STRUCTURE, cache_stats, NULL);
+  gst_structure_free (cache_stats);
+}
@@ -0,0 +1,78 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_WEBRTC_RTX_CACHE_H__
+#define __KMS_WEBRTC_RTX_CACHE_H__
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+#include <commons/kmsirtpconnection.h>
+
+G_BEGIN_DECLS
+
+#define KMS_WEBRTC_RTX_CACHE_STATS_FIELD "rtx-cache-stats"
+
+#define KMS_WEBRTC_RTX_CACHE_DEFAULT_TIME 1000          /* ms */
+#define KMS_WEBRTC_RTX_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+#define KMS_WEBRTC_RTX_CACHE_DEFAULT_PROCESS_SIZE (256 * 1024 * 1024)
+
+/*
+ * Retransmission cache of an endpoint. The RTP packets sent lately are kept,
+ * per SSRC, before they are encrypted, and the generic NACKs received for
+ * them are answered by sending them again, without reaching the encoders.
+ *
+ * Packets are kept for a time and within a size limit of the endpoint and a
+ * size limit shared by all the endpoints of the process. The oldest packets
+ * of the endpoint are dropped first.
+ */
+typedef struct _KmsWebrtcRtxCache KmsWebrtcRtxCache;
+
+KmsWebrtcRtxCache *kms_webrtc_rtx_cache_new (void);
+void kms_webrtc_rtx_cache_free (KmsWebrtcRtxCache * self);
+
+/* Starts caching the packets sent through @conn and answering the NACKs
+ * received through it, as a KmsRtpWatcherMediaFunc */
+void kms_webrtc_rtx_cache_watch_connection (KmsWebrtcRtxCache * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media);
+
+/* Same for a connection given its pads. Packets going into the RTP sink
+ * pads of the element of @rtp_sink are cached, retransmissions are pushed
+ * into @rtp_sink and NACKs are read from @rtcp_src */
+void kms_webrtc_rtx_cache_watch_pads (KmsWebrtcRtxCache * self,
+    GstPad * rtp_sink, GstPad * rtcp_src);
+
+/* Time packets are kept, in ms. 0 disables the cache */
+void kms_webrtc_rtx_cache_set_time (KmsWebrtcRtxCache * self, guint time);
+guint kms_webrtc_rtx_cache_get_time (KmsWebrtcRtxCache * self);
+
+/* Bytes kept by this cache */
+void kms_webrtc_rtx_cache_set_size (KmsWebrtcRtxCache * self, guint size);
+guint kms_webrtc_rtx_cache_get_size (KmsWebrtcRtxCache * self);
+
+/* Bytes kept by all the caches of the process. Only caches sharing this
+ * copy of the library are accounted together, so it is better set through
+ * the "rtx-cache-process-size" property of the endpoints using them */
+void kms_webrtc_rtx_cache_set_process_size (gsize size);
+gsize kms_webrtc_rtx_cache_get_process_size (void);
+
+/* Adds a structure with the hits, misses and requests for packets too old
+ * to be kept */
+void kms_webrtc_rtx_cache_add_stats (KmsWebrtcRtxCache * self,
+    GstStructure * stats);
+
+G_END_DECLS
+#endif /* __KMS_WEBRTC_RTX_CACHE_H__ */
@@ -24,6 +24,8 @@
 #include "kmswebrtcbundleconnection.h"
 #include "kmswebrtcsctpconnection.h"
 #include "kmswebrtcdatasessionbin.h"
+#include "kmswebrtcdatachannelmeta.h"
+#include "kmswebrtctransport.h"
 #include <commons/constants.h>
 #include <commons/kmsutils.h>
 #include <commons/sdp_utils.h>
@@ -59,7 +61,9 @@ G_DEFINE_TYPE (KmsWebrtcSession, kms_webrtc_session, KMS_TYPE_BASE_RTP_SESSION);
 
 #define IP_VERSION_6 6
 
-#define MAX_DATA_CHANNELS 1
+/* RFC 8831 recommends negotiating 65535 streams, but SCTP implementations
+ * usually limit them to 1024 per direction */
+#define MAX_DATA_CHANNELS 1024
 
 enum
 {
@@ -108,42 +112,31 @@ typedef struct _DataChannel
 {
   KmsRefStruct ref;
   KmsWebRtcDataChannel *chann;
-  GstElement *appsink;
   GstElement *appsrc;
+  guint stream_id;
 } DataChannel;
 
 static void
 data_channel_destroy (DataChannel * chann)
 {
+  g_object_unref (chann->appsrc);
+
   g_slice_free (DataChannel, chann);
 }
 
 static DataChannel *
-data_channel_new (guint stream_id, KmsWebRtcDataChannel * channel)
+data_channel_new (guint stream_id, KmsWebRtcDataChannel * channel,
+    GstElement * appsrc)
 {
   DataChannel *chann;
-  gchar *name;
 
   chann = g_slice_new (DataChannel);
   kms_ref_struct_init (KMS_REF_STRUCT_CAST (chann),
       (GDestroyNotify) data_channel_destroy);
 
-  name = g_strdup_printf ("appsrc_stream_%u", stream_id);
-  chann->appsrc = gst_element_factory_make ("appsrc", name);
-  g_free (name);
-
-  name = g_strdup_printf ("appsink_stream_%u", stream_id);
-  chann->appsink = gst_element_factory_make ("appsink", name);
-  g_free (name);
-
-  g_object_set (chann->appsink, "async", FALSE, "sync", FALSE,
-      "emit-signals", FALSE, "drop", FALSE, "enable-last-sample", FALSE, NULL);
-
-  g_object_set (chann->appsrc, "is-live", TRUE, "min-latency",
-      G_GINT64_CONSTANT (0), "do-timestamp", TRUE, "max-bytes", 0,
-      "emit-signals", FALSE, NULL);
-
   chann->chann = channel;
+  chann->appsrc = g_object_ref (appsrc);
+  chann->stream_id = stream_id;
 
   return chann;
 }
@@ -1072,9 +1065,42 @@ kms_webrtc_session_data_session_established_cb (KmsWebRtcDataSessionBin *
       connected);
 }
 
+static DataChannel *
+kms_webrtc_session_get_output_data_channel (KmsWebrtcSession * self,
+    GstBuffer * buffer)
+{
+  KmsWebRtcDataChannelMeta *meta;
+  DataChannel *channel = NULL;
+
+  meta = kms_buffer_get_webrtc_data_channel_meta (buffer);
+
+  /* Called for every buffer, it must not wait for negotiations */
+  g_rw_lock_reader_lock (&self->data_channels_lock);
+
+  if (meta != NULL) {
+    channel = (DataChannel *) g_hash_table_lookup (self->data_channels,
+        GUINT_TO_POINTER (meta->stream_id));
+  }
+
+  if (channel == NULL && self->default_data_channel >= 0) {
+    /* Data not coming from a known channel goes to the default one */
+    channel = (DataChannel *) g_hash_table_lookup (self->data_channels,
+        GINT_TO_POINTER (self->default_data_channel));
+  }
+
+  if (channel != NULL) {
+    kms_ref_struct_ref (KMS_REF_STRUCT_CAST (channel));
+  }
+
+  g_rw_lock_reader_unlock (&self->data_channels_lock);
+
+  return channel;
+}
+
 static GstFlowReturn
-new_sample_callback (GstAppSink * appsink, DataChannel * channel)
+new_sample_callback (GstAppSink * appsink, KmsWebrtcSession * self)
 {
+  DataChannel *channel;
   GstFlowReturn ret;
   GstSample *sample;
   GstBuffer *buffer;
@@ -1090,12 +1116,28 @@ new_sample_callback (GstAppSink * appsink, DataChannel * channel)
     return GST_FLOW_ERROR;
   }
 
+  channel = kms_webrtc_session_get_output_data_channel (self, buffer);
+
+  if (channel == NULL) {
+    GST_LOG_OBJECT (self, "No data channel to send %" GST_PTR_FORMAT, buffer);
+    gst_sample_unref (sample);
+
+    /* Channels can be opened later on, do not stop the data flow */
+    return GST_FLOW_OK;
+  }
+
   /* By default all data received in a pipeline is binary unless they are */
   /* sent by other data channel, in such cases, sctpencoders and decoders */
   /* will set the appropriate ppid meta to the buffer */
 
   ret = kms_webrtc_data_channel_push_buffer (channel->chann, buffer, FALSE);
   gst_sample_unref (sample);
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (channel));
+
+  if (ret == GST_FLOW_NOT_LINKED) {
+    /* Channel is closing, the rest of them are not affected */
+    ret = GST_FLOW_OK;
+  }
 
   return ret;
 }
@@ -1104,19 +1146,82 @@ static GstFlowReturn
 data_channel_buffer_received_cb (GObject * obj, GstBuffer * buffer,
     DataChannel * channel)
 {
+  /* Only the buffer structure is copied, not its memory */
+  buffer = gst_buffer_make_writable (gst_buffer_ref (buffer));
+  kms_buffer_add_webrtc_data_channel_meta (buffer, channel->stream_id);
+
   /* buffer is tranfser full */
-  return gst_app_src_push_buffer (GST_APP_SRC (channel->appsrc),
-      gst_buffer_ref (buffer));
+  return gst_app_src_push_buffer (GST_APP_SRC (channel->appsrc), buffer);
+}
+
+static void
+kms_webrtc_session_expose_data_pad (KmsWebrtcSession * self,
+    GstElement * element, const gchar * pad_name)
+{
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (element, pad_name);
+
+  if (self->add_pad_cb != NULL) {
+    self->add_pad_cb (self, pad, KMS_ELEMENT_PAD_TYPE_DATA, NULL,
+        self->cb_data);
+  }
+
+  g_object_unref (pad);
+}
+
+/* All the data channels of the session share the same appsrc and appsink,
+ * buffers are told apart by their KmsWebRtcDataChannelMeta. This way, the
+ * cost of opening a new channel does not include new elements or pads */
+static void
+kms_webrtc_session_create_data_pads (KmsWebrtcSession * self)
+{
+  GstAppSinkCallbacks callbacks;
+
+  if (self->data_appsrc != NULL) {
+    if (!self->data_sink_exposed) {
+      kms_webrtc_session_expose_data_pad (self, self->data_appsink, "sink");
+      self->data_sink_exposed = TRUE;
+    }
+
+    return;
+  }
+
+  self->data_appsrc = gst_element_factory_make ("appsrc", "appsrc_data");
+  self->data_appsink = gst_element_factory_make ("appsink", "appsink_data");
+
+  g_object_set (self->data_appsink, "async", FALSE, "sync", FALSE,
+      "emit-signals", FALSE, "drop", FALSE, "enable-last-sample", FALSE, NULL);
+
+  g_object_set (self->data_appsrc, "is-live", TRUE, "min-latency",
+      G_GINT64_CONSTANT (0), "do-timestamp", TRUE, "max-bytes", 0,
+      "emit-signals", FALSE, NULL);
+
+  callbacks.eos = NULL;
+  callbacks.new_preroll = NULL;
+  callbacks.new_sample =
+      (GstFlowReturn (*)(GstAppSink *, gpointer)) new_sample_callback;
+
+  gst_app_sink_set_callbacks (GST_APP_SINK (self->data_appsink), &callbacks,
+      self, NULL);
+
+  gst_bin_add_many (GST_BIN (self), self->data_appsrc, self->data_appsink,
+      NULL);
+
+  gst_element_sync_state_with_parent (self->data_appsink);
+  gst_element_sync_state_with_parent (self->data_appsrc);
+
+  kms_webrtc_session_expose_data_pad (self, self->data_appsrc, "src");
+  kms_webrtc_session_expose_data_pad (self, self->data_appsink, "sink");
+  self->data_sink_exposed = TRUE;
 }
 
 static void
 kms_webrtc_session_data_channel_opened_cb (KmsWebRtcDataSessionBin * session,
     guint stream_id, KmsWebrtcSession * self)
 {
-  GstAppSinkCallbacks callbacks;
   KmsWebRtcDataChannel *chann;
   DataChannel *channel;
-  GstPad *pad;
 
   GST_DEBUG_OBJECT (self, "Data channel with stream_id %u opened", stream_id);
 
@@ -1140,48 +1245,24 @@ kms_webrtc_session_data_channel_opened_cb (KmsWebRtcDataSessionBin * session,
     return;
   }
 
-  channel = data_channel_new (stream_id, chann);
+  kms_webrtc_session_create_data_pads (self);
+
+  channel = data_channel_new (stream_id, chann, self->data_appsrc);
 
+  g_rw_lock_writer_lock (&self->data_channels_lock);
   g_hash_table_insert (self->data_channels, GUINT_TO_POINTER (stream_id),
       channel);
 
-  callbacks.eos = NULL;
-  callbacks.new_preroll = NULL;
-  callbacks.new_sample =
-      (GstFlowReturn (*)(GstAppSink *, gpointer)) new_sample_callback;
-
-  gst_app_sink_set_callbacks (GST_APP_SINK (channel->appsink), &callbacks,
-      kms_ref_struct_ref (KMS_REF_STRUCT_CAST (channel)),
-      (GDestroyNotify) kms_ref_struct_unref);
+  if (self->default_data_channel < 0) {
+    self->default_data_channel = stream_id;
+  }
+  g_rw_lock_writer_unlock (&self->data_channels_lock);
 
   kms_webrtc_data_channel_set_new_buffer_callback (channel->chann,
       (DataChannelNewBuffer) data_channel_buffer_received_cb,
       kms_ref_struct_ref (KMS_REF_STRUCT_CAST (channel)),
       (GDestroyNotify) kms_ref_struct_unref);
 
-  gst_bin_add_many (GST_BIN (self), channel->appsrc, channel->appsink, NULL);
-
-  gst_element_sync_state_with_parent (channel->appsink);
-  gst_element_sync_state_with_parent (channel->appsrc);
-
-  pad = gst_element_get_static_pad (channel->appsrc, "src");
-
-  if (self->add_pad_cb != NULL) {
-    self->add_pad_cb (self, pad, KMS_ELEMENT_PAD_TYPE_DATA, NULL,
-        self->cb_data);
-  }
-
-  g_object_unref (pad);
-
-  pad = gst_element_get_static_pad (channel->appsink, "sink");
-
-  if (self->add_pad_cb != NULL) {
-    self->add_pad_cb (self, pad, KMS_ELEMENT_PAD_TYPE_DATA, NULL,
-        self->cb_data);
-  }
-
-  g_object_unref (pad);
-
   KMS_SDP_SESSION_UNLOCK (self);
 
   g_signal_emit (self, kms_webrtc_session_signals[SIGNAL_DATA_CHANNEL_OPENED],
@@ -1189,19 +1270,25 @@ kms_webrtc_session_data_channel_opened_cb (KmsWebRtcDataSessionBin * session,
 }
 
 static void
-kms_webrtc_session_remove_data_channel (KmsWebrtcSession * self,
-    DataChannel * channel, guint stream_id)
+kms_webrtc_session_remove_data_pads (KmsWebrtcSession * self)
 {
-  g_object_ref (channel->appsrc);
-  g_object_ref (channel->appsink);
+  GstPad *pad;
 
-  gst_element_set_state (channel->appsrc, GST_STATE_NULL);
-  gst_element_set_state (channel->appsink, GST_STATE_NULL);
+  if (!self->data_sink_exposed) {
+    return;
+  }
 
-  gst_bin_remove_many (GST_BIN (self), channel->appsrc, channel->appsink, NULL);
+  /* The source pad stays linked so it can be reused by new channels */
+  pad = gst_element_get_static_pad (self->data_appsink, "sink");
 
-  g_object_unref (channel->appsrc);
-  g_object_unref (channel->appsink);
+  if (self->remove_pad_cb != NULL) {
+    self->remove_pad_cb (self, pad, KMS_ELEMENT_PAD_TYPE_DATA, NULL,
+        self->cb_data);
+  }
+
+  g_object_unref (pad);
+
+  self->data_sink_exposed = FALSE;
 }
 
 static void
@@ -1209,7 +1296,6 @@ kms_webrtc_session_data_channel_closed_cb (KmsWebRtcDataSessionBin * session,
     guint stream_id, KmsWebrtcSession * self)
 {
   DataChannel *channel;
-  GstPad *pad;
 
   GST_DEBUG_OBJECT (self, "Data channel with stream_id %u closed", stream_id);
 
@@ -1223,21 +1309,28 @@ kms_webrtc_session_data_channel_closed_cb (KmsWebRtcDataSessionBin * session,
     return;
   }
 
+  g_rw_lock_writer_lock (&self->data_channels_lock);
   g_hash_table_steal (self->data_channels, GUINT_TO_POINTER (stream_id));
 
-  pad = gst_element_get_static_pad (channel->appsink, "sink");
+  if (self->default_data_channel == (gint) stream_id) {
+    GHashTableIter iter;
+    gpointer key;
 
-  if (self->remove_pad_cb != NULL) {
-    self->remove_pad_cb (self, pad, KMS_ELEMENT_PAD_TYPE_DATA, NULL,
-        self->cb_data);
+    self->default_data_channel = -1;
+    g_hash_table_iter_init (&iter, self->data_channels);
+
+    if (g_hash_table_iter_next (&iter, &key, NULL)) {
+      self->default_data_channel = GPOINTER_TO_INT (key);
+    }
   }
+  g_rw_lock_writer_unlock (&self->data_channels_lock);
 
-  g_object_unref (pad);
+  if (g_hash_table_size (self->data_channels) == 0) {
+    kms_webrtc_session_remove_data_pads (self);
+  }
 
   KMS_SDP_SESSION_UNLOCK (self);
 
-  kms_webrtc_session_remove_data_channel (self, channel, stream_id);
-
   kms_ref_struct_unref (KMS_REF_STRUCT_CAST (channel));
 
   g_signal_emit (self, kms_webrtc_session_signals[SIGNAL_DATA_CHANNEL_CLOSED],
@@ -1256,7 +1349,7 @@ configure_data_session (KmsWebrtcSession * self, const GstSDPMedia * media)
     return FALSE;
   }
 
-  if (len > MAX_DATA_CHANNELS) {
+  if (len > 1) {
     GST_WARNING_OBJECT (self,
         "Only one data session is supported over the same DTLS connection");
   }
@@ -1493,6 +1586,28 @@ kms_webrtc_session_configure_connection (KmsWebrtcSession * self,
   return TRUE;
 }
 
+static void
+kms_webrtc_session_configure_transport_cc (KmsWebRtcBaseConnection * conn,
+    const GstSDPMedia * neg_media)
+{
+  KmsWebRtcTransport *tr = NULL;
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (conn),
+          "transport") == NULL) {
+    return;
+  }
+
+  g_object_get (conn, "transport", &tr, NULL);
+
+  if (tr == NULL) {
+    return;
+  }
+
+  kms_webrtc_transport_cc_set_ext_id (tr->sink->transport_cc,
+      kms_webrtc_transport_cc_get_ext_id (neg_media));
+  g_object_unref (tr);
+}
+
 void
 kms_webrtc_session_start_transport_send (KmsWebrtcSession * self,
     gboolean offerer)
@@ -1566,6 +1681,7 @@ kms_webrtc_session_start_transport_send (KmsWebrtcSession * self,
 
     kms_webrtc_session_configure_connection (self, sdp_sess,
         KMS_I_RTP_CONNECTION (conn), neg_media, rem_media, offerer);
+    kms_webrtc_session_configure_transport_cc (conn, neg_media);
 
     gst_media_add_remote_candidates (self, index, rem_media, conn, ufrag, pwd);
 
@@ -1619,6 +1735,120 @@ kms_webrtc_session_add_data_channels_stats (KmsWebrtcSession * self,
   gst_structure_free (data_stats);
 }
 
+void
+kms_webrtc_session_add_latency_stats (KmsWebrtcSession * self,
+    GstStructure * stats)
+{
+  KmsBaseRtpSession *base_rtp_sess = KMS_BASE_RTP_SESSION (self);
+  GHashTableIter iter;
+  gpointer key, v;
+
+  KMS_SDP_SESSION_LOCK (self);
+
+  g_hash_table_iter_init (&iter, base_rtp_sess->conns);
+
+  while (g_hash_table_iter_next (&iter, &key, &v)) {
+    KmsWebRtcBaseConnection *conn = KMS_WEBRTC_BASE_CONNECTION (v);
+    KmsWebRtcTransport *tr = NULL;
+    GstStructure *latency;
+
+    if (!conn->stats_enabled || conn->name == NULL ||
+        g_object_class_find_property (G_OBJECT_GET_CLASS (conn),
+            "transport") == NULL) {
+      continue;
+    }
+
+    g_object_get (conn, "transport", &tr, NULL);
+
+    if (tr == NULL) {
+      continue;
+    }
+
+    latency = kms_webrtc_transport_get_latency_stats (tr, conn->name);
+    gst_structure_set (stats, conn->name, GST_TYPE_STRUCTURE, latency, NULL);
+    gst_structure_free (latency);
+    g_object_unref (tr);
+  }
+
+  KMS_SDP_SESSION_UNLOCK (self);
+}
+
+void
+kms_webrtc_session_add_transport_cc_stats (KmsWebrtcSession * self,
+    GstStructure * stats)
+{
+  KmsBaseRtpSession *base_rtp_sess = KMS_BASE_RTP_SESSION (self);
+  GHashTableIter iter;
+  gpointer key, v;
+
+  KMS_SDP_SESSION_LOCK (self);
+
+  g_hash_table_iter_init (&iter, base_rtp_sess->conns);
+
+  while (g_hash_table_iter_next (&iter, &key, &v)) {
+    KmsWebRtcBaseConnection *conn = KMS_WEBRTC_BASE_CONNECTION (v);
+    KmsWebRtcTransport *tr = NULL;
+
+    if (conn->name == NULL || g_object_class_find_property (G_OBJECT_GET_CLASS
+            (conn), "transport") == NULL) {
+      continue;
+    }
+
+    g_object_get (conn, "transport", &tr, NULL);
+
+    if (tr == NULL) {
+      continue;
+    }
+
+    kms_webrtc_transport_cc_add_stats (tr->sink->transport_cc, stats,
+        conn->name);
+    g_object_unref (tr);
+  }
+
+  KMS_SDP_SESSION_UNLOCK (self);
+}
+
+static void
+kms_webrtc_session_add_property_counters (GObject * conn,
+    const gchar * property, KmsStatsSnapshot * snapshot)
+{
+  KmsWebRtcTransport *tr = NULL;
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (conn),
+          property) == NULL) {
+    return;
+  }
+
+  g_object_get (conn, property, &tr, NULL);
+
+  if (tr != NULL) {
+    kms_webrtc_transport_add_counters (tr, snapshot);
+    g_object_unref (tr);
+  }
+}
+
+void
+kms_webrtc_session_add_transport_counters (KmsWebrtcSession * self,
+    KmsStatsSnapshot * snapshot)
+{
+  KmsBaseRtpSession *base_rtp_sess = KMS_BASE_RTP_SESSION (self);
+  GHashTableIter iter;
+  gpointer v;
+
+  KMS_SDP_SESSION_LOCK (self);
+
+  g_hash_table_iter_init (&iter, base_rtp_sess->conns);
+
+  while (g_hash_table_iter_next (&iter, NULL, &v)) {
+    kms_webrtc_session_add_property_counters (G_OBJECT (v), "transport",
+        snapshot);
+    kms_webrtc_session_add_property_counters (G_OBJECT (v), "rtcp-transport",
+        snapshot);
+  }
+
+  KMS_SDP_SESSION_UNLOCK (self);
+}
+
 static void
 kms_webrtc_session_parse_turn_url (KmsWebrtcSession * self)
 {
@@ -1794,6 +2024,7 @@ kms_webrtc_session_finalize (GObject * object)
 
   g_clear_object (&self->data_session);
   g_hash_table_unref (self->data_channels);
+  g_rw_lock_clear (&self->data_channels_lock);
 
   /* chain up */
   G_OBJECT_CLASS (kms_webrtc_session_parent_class)->finalize (object);
@@ -1900,6 +2131,8 @@ kms_webrtc_session_init (KmsWebrtcSession * self)
 
   self->data_channels = g_hash_table_new_full (g_direct_hash,
       g_direct_equal, NULL, (GDestroyNotify) kms_ref_struct_unref);
+  g_rw_lock_init (&self->data_channels_lock);
+  self->default_data_channel = -1;
 }
 
 void
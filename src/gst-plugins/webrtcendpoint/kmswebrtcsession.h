@@ -23,6 +23,7 @@
 #include "kmsicecandidate.h"
 #include "kmsicebaseagent.h"
 #include "kmswebrtcconnection.h"
+#include "kmsstatssnapshot.h"
 
 G_BEGIN_DECLS
 
@@ -80,6 +81,11 @@ struct _KmsWebrtcSession
 
   GstElement *data_session;
   GHashTable *data_channels;
+  GRWLock data_channels_lock;   /* Writers also hold the session lock */
+  GstElement *data_appsrc;
+  GstElement *data_appsink;
+  gboolean data_sink_exposed;
+  gint default_data_channel;
 
   KmsAddPad add_pad_cb;
   KmsRemovePad remove_pad_cb;
@@ -127,6 +133,9 @@ gchar * kms_webrtc_session_get_stream_id (KmsWebrtcSession * self, KmsSdpMediaHa
 void kms_webrtc_session_start_transport_send (KmsWebrtcSession * self, gboolean offerer);
 
 void kms_webrtc_session_add_data_channels_stats (KmsWebrtcSession * self, GstStructure * stats, const gchar * selector);
+void kms_webrtc_session_add_latency_stats (KmsWebrtcSession * self, GstStructure * stats);
+void kms_webrtc_session_add_transport_cc_stats (KmsWebrtcSession * self, GstStructure * stats);
+void kms_webrtc_session_add_transport_counters (KmsWebrtcSession * self, KmsStatsSnapshot * snapshot);
 
 void kms_webrtc_session_set_callbacks (KmsWebrtcSession * self, KmsWebrtcSessionCallbacks *cb, gpointer user_data, GDestroyNotify notify);
 
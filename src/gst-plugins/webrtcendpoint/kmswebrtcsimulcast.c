@@ -0,0 +1,1894 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmswebrtcsimulcast.h"
+#include "kmsrtpwatcher.h"
+#include <commons/kmselement.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+#include <string.h>
+
+#define GST_CAT_DEFAULT kms_webrtc_simulcast_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define RTCP_SINK_DATA "kms-webrtc-simulcast-rtcp-sink"
+#define ENCODER_DATA "kms-webrtc-simulcast-encoder"
+#define OUTPUT_DATA "kms-webrtc-simulcast-output"
+
+#define EXTMAP_ATTR "extmap"
+#define RID_ATTR "rid"
+#define SIMULCAST_ATTR "simulcast"
+#define SSRC_GROUP_ATTR "ssrc-group"
+#define SSRC_ATTR "ssrc"
+#define RTPMAP_ATTR "rtpmap"
+#define MID_ATTR "mid"
+
+#define FID_PREFIX "FID "
+#define RTX_ENCODING "rtx/"
+
+#define CLOCK_RATE 90000
+#define OUTPUT_LATENCY 100      /* ms, jitter buffer of each layer output */
+#define BITRATE_WINDOW (1 * G_TIME_SPAN_SECOND)
+#define LAYER_TIMEOUT (2 * G_TIME_SPAN_SECOND)
+#define PLI_INTERVAL (500 * G_TIME_SPAN_MILLISECOND)
+
+#define RTCP_FMT_NACK 1
+#define RTCP_FMT_PLI 1
+#define RTCP_FMT_FIR 4
+#define RTCP_FMT_AFB 15
+
+#define FORCE_KEY_UNIT_EVENT "GstForceKeyUnit"
+
+typedef enum
+{
+  KMS_SIMULCAST_CODEC_UNKNOWN,
+  KMS_SIMULCAST_CODEC_VP8,
+  KMS_SIMULCAST_CODEC_H264,
+  KMS_SIMULCAST_CODEC_RTX
+} KmsSimulcastCodec;
+
+typedef struct _KmsSimulcastStream KmsSimulcastStream;
+
+typedef struct _KmsSimulcastLayer
+{
+  KmsSimulcastStream *stream;
+  guint32 ssrc;                 /* 0 until a RID layer is received */
+  guint32 rtx_ssrc;             /* 0 until known, or without RTX */
+  gchar *rid;                   /* NULL in SSRC groups */
+  guint order;                  /* In the remote description */
+
+  guint64 bytes;                /* In the current window */
+  guint bitrate;                /* bps, in the last window */
+  gint64 last_seen;
+
+  /* This layer alone, as an output of the element */
+  GstPad *output;
+  gboolean output_tried;
+  guint8 output_pt;
+  gint64 output_last_pli;
+} KmsSimulcastLayer;
+
+struct _KmsSimulcastStream
+{
+  gchar *mid;
+  guint8 rid_ext_id;
+  guint8 rrid_ext_id;           /* Carried by the retransmissions */
+  GPtrArray *layers;
+  GHashTable *codecs;           /* <payload type, KmsSimulcastCodec> */
+
+  /* The forwarded layer, and the one waiting for a keyframe to replace it */
+  KmsSimulcastLayer *current;
+  KmsSimulcastLayer *target;
+
+  /* Output = input + delta for the forwarded layer */
+  guint32 out_ssrc;
+  guint32 out_rtx_ssrc;
+  gboolean started;
+  guint16 seq_delta;
+  guint32 ts_delta;
+  guint16 last_seq;
+  guint32 last_ts;
+  gint64 last_time;
+
+  gint64 window_start;
+  gint64 last_pli;
+
+  /* Keyframe requests are pushed from here */
+  GstPad *feedback;
+};
+
+struct _KmsWebrtcSimulcast
+{
+  GMutex mutex;
+  GPtrArray *streams;
+  GHashTable *ssrcs;            /* <SSRC, KmsSimulcastLayer> */
+  GHashTable *rtx_ssrcs;        /* <RTX SSRC, KmsSimulcastLayer> */
+  KmsElement *element;          /* Owner of the layer outputs, may be NULL */
+
+  gint layer;
+  guint max_bitrate;
+  guint32 local_ssrc;           /* Sender of our receiver reports */
+};
+
+static void
+kms_webrtc_simulcast_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "webrtcsimulcast", 0,
+        "Simulcast layer selection");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+static void
+kms_simulcast_layer_free (KmsSimulcastLayer * layer)
+{
+  if (layer->output != NULL) {
+    gst_pad_set_active (layer->output, FALSE);
+    g_object_unref (layer->output);
+  }
+
+  g_free (layer->rid);
+  g_slice_free (KmsSimulcastLayer, layer);
+}
+
+static KmsSimulcastStream *
+kms_simulcast_stream_new (const gchar * mid)
+{
+  KmsSimulcastStream *stream;
+
+  stream = g_slice_new0 (KmsSimulcastStream);
+  stream->mid = g_strdup (mid);
+  stream->layers =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      kms_simulcast_layer_free);
+  stream->codecs = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return stream;
+}
+
+static void
+kms_simulcast_stream_free (KmsSimulcastStream * stream)
+{
+  if (stream->feedback != NULL) {
+    gst_pad_set_active (stream->feedback, FALSE);
+    g_object_unref (stream->feedback);
+  }
+
+  g_ptr_array_unref (stream->layers);
+  g_hash_table_unref (stream->codecs);
+  g_free (stream->mid);
+  g_slice_free (KmsSimulcastStream, stream);
+}
+
+static void
+kms_simulcast_stream_add_layer (KmsSimulcastStream * stream, guint32 ssrc,
+    const gchar * rid)
+{
+  KmsSimulcastLayer *layer;
+
+  layer = g_slice_new0 (KmsSimulcastLayer);
+  layer->stream = stream;
+  layer->ssrc = ssrc;
+  layer->rid = g_strdup (rid);
+  layer->order = stream->layers->len;
+
+  g_ptr_array_add (stream->layers, layer);
+}
+
+KmsWebrtcSimulcast *
+kms_webrtc_simulcast_new (KmsElement * element)
+{
+  KmsWebrtcSimulcast *self;
+
+  kms_webrtc_simulcast_init ();
+
+  self = g_slice_new0 (KmsWebrtcSimulcast);
+  g_mutex_init (&self->mutex);
+  self->streams =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      kms_simulcast_stream_free);
+  self->ssrcs = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->rtx_ssrcs = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->element = element;
+  self->layer = KMS_WEBRTC_SIMULCAST_LAYER_AUTO;
+  self->local_ssrc = 1;
+
+  return self;
+}
+
+void
+kms_webrtc_simulcast_free (KmsWebrtcSimulcast * self)
+{
+  if (self == NULL) {
+    return;
+  }
+
+  g_hash_table_unref (self->ssrcs);
+  g_hash_table_unref (self->rtx_ssrcs);
+  g_ptr_array_unref (self->streams);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsWebrtcSimulcast, self);
+}
+
+/* Remote description */
+
+static guint8
+kms_webrtc_simulcast_get_ext_id (const GstSDPMedia * media, const gchar * uri)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar *value;
+    guint64 id;
+
+    if (g_strcmp0 (attr->key, EXTMAP_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <id>[/<direction>] <uri> [<attributes>] */
+    id = g_ascii_strtoull (attr->value, &value, 10);
+    value = strchr (value, ' ');
+
+    if (value == NULL || id < 1 || id > 14) {
+      continue;
+    }
+
+    while (*value == ' ') {
+      value++;
+    }
+
+    if (g_str_has_prefix (value, uri) && (value[strlen (uri)] == '\0' ||
+            value[strlen (uri)] == ' ')) {
+      return id;
+    }
+  }
+
+  return 0;
+}
+
+/* Ids of the RID streams sent by @media, NULL if it does not use them */
+static gchar **
+kms_webrtc_simulcast_get_send_rids (const GstSDPMedia * media)
+{
+  GPtrArray *rids;
+  guint i, len;
+
+  if (gst_sdp_media_get_attribute_val (media, SIMULCAST_ATTR) == NULL) {
+    return NULL;
+  }
+
+  rids = g_ptr_array_new ();
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar **tokens;
+
+    if (g_strcmp0 (attr->key, RID_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <id> <direction> [<restrictions>] */
+    tokens = g_strsplit (attr->value, " ", 3);
+
+    if (tokens[0] != NULL && tokens[1] != NULL &&
+        g_strcmp0 (tokens[1], "send") == 0) {
+      g_ptr_array_add (rids, g_strdup (tokens[0]));
+    }
+
+    g_strfreev (tokens);
+  }
+
+  if (rids->len == 0) {
+    g_ptr_array_free (rids, TRUE);
+    return NULL;
+  }
+
+  g_ptr_array_add (rids, NULL);
+
+  return (gchar **) g_ptr_array_free (rids, FALSE);
+}
+
+/* SSRCs of the legacy simulcast group of @media, NULL if there is none */
+static gchar **
+kms_webrtc_simulcast_get_sim_ssrcs (const GstSDPMedia * media)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar **tokens;
+
+    if (g_strcmp0 (attr->key, SSRC_GROUP_ATTR) != 0 || attr->value == NULL ||
+        !g_str_has_prefix (attr->value, "SIM ")) {
+      continue;
+    }
+
+    tokens = g_strsplit (attr->value + strlen ("SIM "), " ", -1);
+
+    if (g_strv_length (tokens) > 1) {
+      return tokens;
+    }
+
+    g_strfreev (tokens);
+  }
+
+  return NULL;
+}
+
+/* Retransmission SSRC paired with @ssrc in @media, 0 if there is none */
+static guint32
+kms_webrtc_simulcast_get_fid (const GstSDPMedia * media, guint32 ssrc)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar *rtx;
+
+    if (g_strcmp0 (attr->key, SSRC_GROUP_ATTR) != 0 || attr->value == NULL ||
+        !g_str_has_prefix (attr->value, FID_PREFIX)) {
+      continue;
+    }
+
+    /* FID <media SSRC> <retransmission SSRC> */
+    if (g_ascii_strtoull (attr->value + strlen (FID_PREFIX), &rtx, 10) ==
+        ssrc) {
+      return (guint32) g_ascii_strtoull (rtx, NULL, 10);
+    }
+  }
+
+  return 0;
+}
+
+static void
+kms_simulcast_stream_parse_codecs (KmsSimulcastStream * stream,
+    const GstSDPMedia * media)
+{
+  guint i, len;
+
+  g_hash_table_remove_all (stream->codecs);
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    KmsSimulcastCodec codec = KMS_SIMULCAST_CODEC_UNKNOWN;
+    gchar *name;
+    guint64 pt;
+
+    if (g_strcmp0 (attr->key, RTPMAP_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <payload type> <encoding name>/<clock rate>[/<parameters>] */
+    pt = g_ascii_strtoull (attr->value, &name, 10);
+
+    if (pt > 127) {
+      continue;
+    }
+
+    while (*name == ' ') {
+      name++;
+    }
+
+    if (g_ascii_strncasecmp (name, "VP8/", strlen ("VP8/")) == 0) {
+      codec = KMS_SIMULCAST_CODEC_VP8;
+    } else if (g_ascii_strncasecmp (name, "H264/", strlen ("H264/")) == 0) {
+      codec = KMS_SIMULCAST_CODEC_H264;
+    } else if (g_ascii_strncasecmp (name, RTX_ENCODING,
+            strlen (RTX_ENCODING)) == 0) {
+      codec = KMS_SIMULCAST_CODEC_RTX;
+    }
+
+    g_hash_table_insert (stream->codecs, GUINT_TO_POINTER (pt),
+        GINT_TO_POINTER (codec));
+  }
+}
+
+static KmsSimulcastStream *
+kms_webrtc_simulcast_parse_media (const GstSDPMedia * media)
+{
+  KmsSimulcastStream *stream;
+  const gchar *ssrc;
+  gchar **ids;
+  guint8 rid_ext_id;
+  guint i;
+
+  stream = kms_simulcast_stream_new (gst_sdp_media_get_attribute_val (media,
+          MID_ATTR));
+
+  ids = kms_webrtc_simulcast_get_sim_ssrcs (media);
+
+  if (ids != NULL) {
+    for (i = 0; ids[i] != NULL; i++) {
+      kms_simulcast_stream_add_layer (stream,
+          (guint32) g_ascii_strtoull (ids[i], NULL, 10), NULL);
+    }
+
+    for (i = 0; i < stream->layers->len; i++) {
+      KmsSimulcastLayer *layer = g_ptr_array_index (stream->layers, i);
+
+      layer->rtx_ssrc = kms_webrtc_simulcast_get_fid (media, layer->ssrc);
+    }
+
+    stream->out_ssrc = ((KmsSimulcastLayer *)
+        g_ptr_array_index (stream->layers, 0))->ssrc;
+    stream->out_rtx_ssrc = ((KmsSimulcastLayer *)
+        g_ptr_array_index (stream->layers, 0))->rtx_ssrc;
+    g_strfreev (ids);
+    kms_simulcast_stream_parse_codecs (stream, media);
+
+    return stream;
+  }
+
+  rid_ext_id = kms_webrtc_simulcast_get_ext_id (media,
+      KMS_WEBRTC_SIMULCAST_RID_EXT_URI);
+  ids = kms_webrtc_simulcast_get_send_rids (media);
+
+  if (ids == NULL || rid_ext_id == 0 || g_strv_length (ids) < 2) {
+    g_strfreev (ids);
+    kms_simulcast_stream_free (stream);
+    return NULL;
+  }
+
+  for (i = 0; ids[i] != NULL; i++) {
+    kms_simulcast_stream_add_layer (stream, 0, ids[i]);
+  }
+
+  stream->rid_ext_id = rid_ext_id;
+  stream->rrid_ext_id = kms_webrtc_simulcast_get_ext_id (media,
+      KMS_WEBRTC_SIMULCAST_RRID_EXT_URI);
+  g_strfreev (ids);
+  kms_simulcast_stream_parse_codecs (stream, media);
+
+  /* Announced SSRCs are the ones the rest of the endpoint expects */
+  ssrc = gst_sdp_media_get_attribute_val (media, SSRC_ATTR);
+  if (ssrc != NULL) {
+    stream->out_ssrc = (guint32) g_ascii_strtoull (ssrc, NULL, 10);
+    stream->out_rtx_ssrc = kms_webrtc_simulcast_get_fid (media,
+        stream->out_ssrc);
+  }
+
+  return stream;
+}
+
+void
+kms_webrtc_simulcast_answer_media (const GstSDPMessage * remote_sdp,
+    GstSDPMedia * local_media)
+{
+  const gchar *mid;
+  guint i, len;
+
+  mid = gst_sdp_media_get_attribute_val (local_media, MID_ATTR);
+
+  if (remote_sdp == NULL || mid == NULL ||
+      g_strcmp0 (gst_sdp_media_get_media (local_media), "video") != 0) {
+    return;
+  }
+
+  len = gst_sdp_message_medias_len (remote_sdp);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media (remote_sdp, i);
+    gchar **rids, *joined, *value;
+    guint j;
+
+    if (g_strcmp0 (gst_sdp_media_get_attribute_val (media, MID_ATTR),
+            mid) != 0) {
+      continue;
+    }
+
+    rids = kms_webrtc_simulcast_get_send_rids (media);
+
+    if (rids == NULL) {
+      return;
+    }
+
+    for (j = 0; rids[j] != NULL; j++) {
+      value = g_strdup_printf ("%s recv", rids[j]);
+      gst_sdp_media_add_attribute (local_media, RID_ATTR, value);
+      g_free (value);
+    }
+
+    joined = g_strjoinv (";", rids);
+    value = g_strconcat ("recv ", joined, NULL);
+    GST_DEBUG ("Receiving simulcast streams %s in media %s", joined, mid);
+    gst_sdp_media_add_attribute (local_media, SIMULCAST_ATTR, value);
+    g_free (joined);
+    g_free (value);
+
+    g_strfreev (rids);
+
+    return;
+  }
+}
+
+/* Layer selection, must be called with the mutex held */
+
+static gint
+kms_simulcast_layer_compare (KmsSimulcastLayer ** a, KmsSimulcastLayer ** b)
+{
+  if ((*a)->bitrate != (*b)->bitrate) {
+    return (*a)->bitrate < (*b)->bitrate ? -1 : 1;
+  }
+
+  return (gint) (*a)->order - (gint) (*b)->order;
+}
+
+/* Layers received lately, from the lowest bitrate to the highest */
+static GPtrArray *
+kms_simulcast_stream_rank (KmsSimulcastStream * stream, gint64 now)
+{
+  GPtrArray *ranked;
+  guint i;
+
+  ranked = g_ptr_array_sized_new (stream->layers->len);
+
+  for (i = 0; i < stream->layers->len; i++) {
+    KmsSimulcastLayer *layer = g_ptr_array_index (stream->layers, i);
+
+    if (layer->ssrc != 0 && now - layer->last_seen < LAYER_TIMEOUT) {
+      g_ptr_array_add (ranked, layer);
+    }
+  }
+
+  g_ptr_array_sort (ranked, (GCompareFunc) kms_simulcast_layer_compare);
+
+  return ranked;
+}
+
+static void
+kms_webrtc_simulcast_choose (KmsWebrtcSimulcast * self,
+    KmsSimulcastStream * stream, gint64 now)
+{
+  KmsSimulcastLayer *layer;
+  GPtrArray *ranked;
+  guint i, index;
+
+  ranked = kms_simulcast_stream_rank (stream, now);
+
+  if (ranked->len == 0) {
+    g_ptr_array_free (ranked, TRUE);
+    return;
+  }
+
+  if (self->layer >= 0) {
+    index = MIN ((guint) self->layer, ranked->len - 1);
+  } else if (self->max_bitrate == 0) {
+    index = ranked->len - 1;
+  } else {
+    index = 0;
+
+    for (i = 1; i < ranked->len; i++) {
+      layer = g_ptr_array_index (ranked, i);
+
+      if (layer->bitrate <= self->max_bitrate) {
+        index = i;
+      }
+    }
+  }
+
+  layer = g_ptr_array_index (ranked, index);
+  g_ptr_array_free (ranked, TRUE);
+
+  if (layer == stream->target || (stream->target == NULL &&
+          layer == stream->current)) {
+    return;
+  }
+
+  GST_DEBUG ("Media %s: switching to layer %u (SSRC %u, %u bps)",
+      stream->mid, index, layer->ssrc, layer->bitrate);
+
+  stream->target = layer == stream->current ? NULL : layer;
+  stream->last_pli = 0;
+}
+
+static void
+kms_simulcast_stream_update_bitrates (KmsSimulcastStream * stream, gint64 now)
+{
+  gint64 elapsed = now - stream->window_start;
+  guint i;
+
+  for (i = 0; i < stream->layers->len; i++) {
+    KmsSimulcastLayer *layer = g_ptr_array_index (stream->layers, i);
+
+    layer->bitrate = layer->bytes * 8 * G_USEC_PER_SEC / elapsed;
+    layer->bytes = 0;
+  }
+
+  stream->window_start = now;
+}
+
+/* The forwarded layer takes the SSRC of the output, and the layer that owned
+ * it, if any, takes the one of the forwarded layer. Translates both ways */
+static guint32
+kms_simulcast_stream_swap (KmsSimulcastStream * stream, guint32 ssrc)
+{
+  if (stream->current == NULL) {
+    return ssrc;
+  }
+
+  if (ssrc == stream->current->ssrc) {
+    return stream->out_ssrc;
+  } else if (ssrc == stream->out_ssrc) {
+    return stream->current->ssrc;
+  }
+
+  if (stream->current->rtx_ssrc == 0 || stream->out_rtx_ssrc == 0) {
+    return ssrc;
+  }
+
+  if (ssrc == stream->current->rtx_ssrc) {
+    return stream->out_rtx_ssrc;
+  } else if (ssrc == stream->out_rtx_ssrc) {
+    return stream->current->rtx_ssrc;
+  }
+
+  return ssrc;
+}
+
+static KmsSimulcastStream *
+kms_webrtc_simulcast_find_stream (KmsWebrtcSimulcast * self, guint32 ssrc)
+{
+  guint i;
+
+  for (i = 0; i < self->streams->len; i++) {
+    KmsSimulcastStream *stream = g_ptr_array_index (self->streams, i);
+
+    if (ssrc == stream->out_ssrc || (stream->current != NULL &&
+            ssrc == stream->current->ssrc)) {
+      return stream;
+    }
+
+    if (ssrc != 0 && (ssrc == stream->out_rtx_ssrc ||
+            (stream->current != NULL && ssrc == stream->current->rtx_ssrc))) {
+      return stream;
+    }
+  }
+
+  return NULL;
+}
+
+/* RTP */
+
+static gboolean
+kms_webrtc_simulcast_is_vp8_keyframe (const guint8 * data, guint size)
+{
+  guint offset = 1;
+
+  if (size < 1) {
+    return FALSE;
+  }
+
+  /* Only the first packet of the first partition has the header */
+  if ((data[0] & 0x10) == 0 || (data[0] & 0x0f) != 0) {
+    return FALSE;
+  }
+
+  if (data[0] & 0x80) {
+    guint8 ext;
+
+    if (size < 2) {
+      return FALSE;
+    }
+
+    ext = data[1];
+    offset++;
+
+    if (ext & 0x80) {
+      /* 7 or 15 bits picture id */
+      offset += (size > offset && (data[offset] & 0x80)) ? 2 : 1;
+    }
+    if (ext & 0x40) {
+      offset++;
+    }
+    if (ext & 0x30) {
+      offset++;
+    }
+  }
+
+  return size > offset && (data[offset] & 0x01) == 0;
+}
+
+static gboolean
+kms_webrtc_simulcast_is_h264_nal_keyframe (guint8 type)
+{
+  return type == 5 || type == 7;
+}
+
+static gboolean
+kms_webrtc_simulcast_is_h264_keyframe (const guint8 * data, guint size)
+{
+  guint8 type;
+  guint offset;
+
+  if (size < 1) {
+    return FALSE;
+  }
+
+  type = data[0] & 0x1f;
+
+  switch (type) {
+    case 24:
+      /* STAP-A: <size> <NAL unit> ... */
+      for (offset = 1; offset + 2 < size;
+          offset += 2 + GST_READ_UINT16_BE (data + offset)) {
+        if (kms_webrtc_simulcast_is_h264_nal_keyframe (data[offset + 2] &
+                0x1f)) {
+          return TRUE;
+        }
+      }
+      return FALSE;
+    case 28:
+      /* FU-A, start of the fragmented NAL unit */
+      return size > 1 && (data[1] & 0x80) &&
+          kms_webrtc_simulcast_is_h264_nal_keyframe (data[1] & 0x1f);
+    default:
+      return kms_webrtc_simulcast_is_h264_nal_keyframe (type);
+  }
+}
+
+static gboolean
+kms_webrtc_simulcast_is_keyframe (KmsSimulcastStream * stream,
+    GstRTPBuffer * rtp)
+{
+  KmsSimulcastCodec codec;
+  const guint8 *data = gst_rtp_buffer_get_payload (rtp);
+  guint size = gst_rtp_buffer_get_payload_len (rtp);
+
+  codec = GPOINTER_TO_INT (g_hash_table_lookup (stream->codecs,
+          GUINT_TO_POINTER (gst_rtp_buffer_get_payload_type (rtp))));
+
+  switch (codec) {
+    case KMS_SIMULCAST_CODEC_VP8:
+      return kms_webrtc_simulcast_is_vp8_keyframe (data, size);
+    case KMS_SIMULCAST_CODEC_H264:
+      return kms_webrtc_simulcast_is_h264_keyframe (data, size);
+    default:
+      /* Switching might show artifacts until the next keyframe */
+      return TRUE;
+  }
+}
+
+/* Finds the RID layer a new SSRC belongs to. Retransmissions carry the RID
+ * of the layer they repair in a different extension */
+static KmsSimulcastLayer *
+kms_webrtc_simulcast_learn_ssrc (KmsWebrtcSimulcast * self, GstRTPBuffer * rtp,
+    gboolean * rtx)
+{
+  guint8 pt = gst_rtp_buffer_get_payload_type (rtp);
+  guint32 ssrc = gst_rtp_buffer_get_ssrc (rtp);
+  guint i, j;
+
+  if (!gst_rtp_buffer_get_extension (rtp)) {
+    return NULL;
+  }
+
+  for (i = 0; i < self->streams->len; i++) {
+    KmsSimulcastStream *stream = g_ptr_array_index (self->streams, i);
+    gpointer codec, data;
+    guint8 ext_id;
+    guint size;
+
+    if (!g_hash_table_lookup_extended (stream->codecs, GUINT_TO_POINTER (pt),
+            NULL, &codec)) {
+      continue;
+    }
+
+    *rtx = GPOINTER_TO_INT (codec) == KMS_SIMULCAST_CODEC_RTX;
+    ext_id = *rtx ? stream->rrid_ext_id : stream->rid_ext_id;
+
+    if (ext_id == 0 || !gst_rtp_buffer_get_extension_onebyte_header (rtp,
+            ext_id, 0, &data, &size)) {
+      continue;
+    }
+
+    for (j = 0; j < stream->layers->len; j++) {
+      KmsSimulcastLayer *layer = g_ptr_array_index (stream->layers, j);
+
+      if ((*rtx ? layer->rtx_ssrc : layer->ssrc) != 0 ||
+          strlen (layer->rid) != size ||
+          strncmp (layer->rid, (const gchar *) data, size) != 0) {
+        continue;
+      }
+
+      if (*rtx) {
+        layer->rtx_ssrc = ssrc;
+        g_hash_table_insert (self->rtx_ssrcs, GUINT_TO_POINTER (ssrc), layer);
+
+        if (stream->out_rtx_ssrc == 0) {
+          stream->out_rtx_ssrc = ssrc;
+        }
+
+        GST_DEBUG ("Media %s: RID %s is repaired by SSRC %u", stream->mid,
+            layer->rid, ssrc);
+
+        return layer;
+      }
+
+      layer->ssrc = ssrc;
+      g_hash_table_insert (self->ssrcs, GUINT_TO_POINTER (ssrc), layer);
+
+      if (stream->out_ssrc == 0) {
+        stream->out_ssrc = ssrc;
+      }
+
+      GST_DEBUG ("Media %s: RID %s is SSRC %u", stream->mid, layer->rid, ssrc);
+
+      return layer;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+kms_simulcast_stream_switch (KmsSimulcastStream * stream,
+    KmsSimulcastLayer * layer, guint16 seq, guint32 ts, gint64 now)
+{
+  if (stream->started) {
+    guint32 elapsed = (now - stream->last_time) * CLOCK_RATE / G_USEC_PER_SEC;
+
+    stream->seq_delta = stream->last_seq + 1 - seq;
+    stream->ts_delta = stream->last_ts + MAX (elapsed, 1) - ts;
+  } else {
+    stream->seq_delta = 0;
+    stream->ts_delta = 0;
+    stream->last_seq = seq - 1;
+    stream->last_ts = ts;
+    stream->last_time = now;
+    stream->started = TRUE;
+  }
+
+  GST_DEBUG ("Media %s: forwarding SSRC %u", stream->mid, layer->ssrc);
+
+  stream->current = layer;
+  stream->target = NULL;
+}
+
+static GstBuffer *
+kms_webrtc_simulcast_create_pli (guint32 sender, guint32 media)
+{
+  guint8 *data = g_malloc (20);
+
+  /* Compound packets must start with a report, an empty one is enough */
+  data[0] = 0x80;
+  data[1] = GST_RTCP_TYPE_RR;
+  GST_WRITE_UINT16_BE (data + 2, 1);
+  GST_WRITE_UINT32_BE (data + 4, sender);
+
+  data[8] = 0x80 | RTCP_FMT_PLI;
+  data[9] = GST_RTCP_TYPE_PSFB;
+  GST_WRITE_UINT16_BE (data + 10, 2);
+  GST_WRITE_UINT32_BE (data + 12, sender);
+  GST_WRITE_UINT32_BE (data + 16, media);
+
+  return gst_buffer_new_wrapped (data, 20);
+}
+
+static void
+kms_webrtc_simulcast_request_keyframe (GstPad * feedback, guint32 sender,
+    guint32 ssrc)
+{
+  GST_TRACE_OBJECT (feedback, "Requesting keyframe for SSRC %u", ssrc);
+  gst_pad_push (feedback, kms_webrtc_simulcast_create_pli (sender, ssrc));
+  g_object_unref (feedback);
+}
+
+/* Layer outputs */
+
+/* Keyframe requests of the subscribers of a layer output */
+static gboolean
+kms_webrtc_simulcast_output_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  KmsWebrtcSimulcast *self = g_object_get_data (G_OBJECT (pad), OUTPUT_DATA);
+  KmsSimulcastLayer *layer = gst_pad_get_element_private (pad);
+  GstPad *feedback = NULL;
+  guint32 sender = 0, ssrc = 0;
+  gint64 now = g_get_monotonic_time ();
+
+  /* Nothing upstream but the probe, other events are not needed */
+  if (!gst_event_has_name (event, FORCE_KEY_UNIT_EVENT)) {
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  if (layer->stream->feedback != NULL &&
+      now - layer->output_last_pli >= PLI_INTERVAL) {
+    layer->output_last_pli = now;
+    feedback = g_object_ref (layer->stream->feedback);
+    sender = self->local_ssrc;
+    ssrc = layer->ssrc;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (feedback != NULL) {
+    kms_webrtc_simulcast_request_keyframe (feedback, sender, ssrc);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+/* Must be called with the mutex held. NULL for codecs not depayloaded */
+static GstCaps *
+kms_simulcast_stream_create_caps (KmsSimulcastStream * stream, guint8 pt)
+{
+  const gchar *encoding;
+
+  switch (GPOINTER_TO_INT (g_hash_table_lookup (stream->codecs,
+              GUINT_TO_POINTER (pt)))) {
+    case KMS_SIMULCAST_CODEC_VP8:
+      encoding = "VP8";
+      break;
+    case KMS_SIMULCAST_CODEC_H264:
+      encoding = "H264";
+      break;
+    default:
+      return NULL;
+  }
+
+  return gst_caps_new_simple ("application/x-rtp", "media", G_TYPE_STRING,
+      "video", "clock-rate", G_TYPE_INT, CLOCK_RATE, "encoding-name",
+      G_TYPE_STRING, encoding, "payload", G_TYPE_INT, pt, NULL);
+}
+
+/* Depayloads the layer into the output of the element for @description.
+ * Nothing is decoded, and only keyframes are requested for it */
+static GstPad *
+kms_webrtc_simulcast_create_output (KmsWebrtcSimulcast * self,
+    KmsSimulcastLayer * layer, const gchar * description, GstCaps * caps)
+{
+  GstElement *output, *jitterbuffer, *depayloader;
+  const gchar *encoding;
+  GstSegment segment;
+  GstPad *src, *sink;
+  gchar *name;
+
+  output = kms_element_get_video_output_element (self->element, description);
+
+  if (output == NULL) {
+    GST_WARNING_OBJECT (self->element, "No output for simulcast layer %s",
+        description);
+    return NULL;
+  }
+
+  encoding = gst_structure_get_string (gst_caps_get_structure (caps, 0),
+      "encoding-name");
+  jitterbuffer = gst_element_factory_make ("rtpjitterbuffer", NULL);
+  depayloader = gst_element_factory_make (g_strcmp0 (encoding, "VP8") == 0 ?
+      "rtpvp8depay" : "rtph264depay", NULL);
+
+  if (jitterbuffer == NULL || depayloader == NULL) {
+    GST_WARNING_OBJECT (self->element, "Can not depayload %s", encoding);
+    g_clear_object (&jitterbuffer);
+    g_clear_object (&depayloader);
+    return NULL;
+  }
+
+  g_object_set (jitterbuffer, "latency", OUTPUT_LATENCY, NULL);
+  gst_bin_add_many (GST_BIN (self->element), jitterbuffer, depayloader, NULL);
+
+  if (!gst_element_link_many (jitterbuffer, depayloader, output, NULL)) {
+    GST_WARNING_OBJECT (self->element, "Can not link simulcast layer %s",
+        description);
+    gst_bin_remove_many (GST_BIN (self->element), jitterbuffer, depayloader,
+        NULL);
+    return NULL;
+  }
+
+  gst_element_sync_state_with_parent (depayloader);
+  gst_element_sync_state_with_parent (jitterbuffer);
+
+  name = g_strdup_printf ("simulcast_%s", description);
+  src = gst_pad_new (name, GST_PAD_SRC);
+  g_free (name);
+
+  gst_pad_set_element_private (src, layer);
+  g_object_set_data (G_OBJECT (src), OUTPUT_DATA, self);
+  gst_pad_set_event_function (src, kms_webrtc_simulcast_output_event);
+
+  sink = gst_element_get_static_pad (jitterbuffer, "sink");
+  gst_pad_link (src, sink);
+  g_object_unref (sink);
+
+  gst_pad_set_active (src, TRUE);
+
+  name = g_strdup_printf ("simulcast-%s-%p", description, src);
+  gst_pad_push_event (src, gst_event_new_stream_start (name));
+  g_free (name);
+  gst_pad_push_event (src, gst_event_new_caps (caps));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (src, gst_event_new_segment (&segment));
+
+  GST_DEBUG_OBJECT (self->element, "Simulcast layer %s available as an "
+      "output", description);
+
+  return src;
+}
+
+/* Must be called with the mutex held. Returns the output to push @pt to, or
+ * sets @description when it has to be created */
+static GstPad *
+kms_webrtc_simulcast_get_output (KmsWebrtcSimulcast * self,
+    KmsSimulcastLayer * layer, guint8 pt, GstCaps ** caps,
+    gchar ** description)
+{
+  if (self->element == NULL) {
+    return NULL;
+  }
+
+  if (layer->output != NULL) {
+    if (pt != layer->output_pt) {
+      *caps = kms_simulcast_stream_create_caps (layer->stream, pt);
+
+      /* Not for the depayloader, e.g. FEC */
+      if (*caps == NULL) {
+        return NULL;
+      }
+
+      layer->output_pt = pt;
+    }
+
+    return g_object_ref (layer->output);
+  }
+
+  if (layer->output_tried) {
+    return NULL;
+  }
+
+  *caps = kms_simulcast_stream_create_caps (layer->stream, pt);
+
+  if (*caps == NULL) {
+    return NULL;
+  }
+
+  /* Only one attempt, even if it fails */
+  layer->output_tried = TRUE;
+  layer->output_pt = pt;
+  *description = layer->rid != NULL ? g_strdup (layer->rid) :
+      g_strdup_printf ("%u", layer->order);
+
+  return NULL;
+}
+
+static void
+kms_webrtc_simulcast_push_output (KmsWebrtcSimulcast * self,
+    KmsSimulcastLayer * layer, GstPad * output, GstCaps * caps,
+    gchar * description, GstBuffer * buffer)
+{
+  if (description != NULL) {
+    output = kms_webrtc_simulcast_create_output (self, layer, description,
+        caps);
+    g_free (description);
+
+    if (output == NULL) {
+      gst_caps_unref (caps);
+      return;
+    }
+
+    g_mutex_lock (&self->mutex);
+    layer->output = g_object_ref (output);
+    g_mutex_unlock (&self->mutex);
+  } else if (caps != NULL && output != NULL) {
+    gst_pad_push_event (output, gst_event_new_caps (caps));
+  }
+
+  if (caps != NULL) {
+    gst_caps_unref (caps);
+  }
+
+  if (output != NULL) {
+    gst_pad_push (output, gst_buffer_ref (buffer));
+    g_object_unref (output);
+  }
+}
+
+/* RTP */
+
+static void
+kms_webrtc_simulcast_rewrite (GstBuffer ** buffer, guint32 ssrc, guint16 seq,
+    guint32 ts)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  *buffer = gst_buffer_make_writable (*buffer);
+
+  if (gst_rtp_buffer_map (*buffer, GST_MAP_WRITE, &rtp)) {
+    gst_rtp_buffer_set_ssrc (&rtp, ssrc);
+    gst_rtp_buffer_set_seq (&rtp, seq);
+    gst_rtp_buffer_set_timestamp (&rtp, ts);
+    gst_rtp_buffer_unmap (&rtp);
+  }
+}
+
+/* Must be called with the mutex held. Retransmissions of the forwarded
+ * layer take the retransmission SSRC of the output, and the original
+ * sequence number they carry is translated like the one of the media.
+ * NACKs are only sent for the forwarded layer, so the rest are dropped */
+static gboolean
+kms_webrtc_simulcast_translate_rtx (KmsSimulcastLayer * layer,
+    GstRTPBuffer * rtp, guint32 * ssrc, guint16 * osn, guint32 * ts)
+{
+  KmsSimulcastStream *stream = layer->stream;
+
+  if (layer != stream->current || stream->out_rtx_ssrc == 0 ||
+      gst_rtp_buffer_get_payload_len (rtp) < 2) {
+    return FALSE;
+  }
+
+  *ssrc = stream->out_rtx_ssrc;
+  *osn = GST_READ_UINT16_BE (gst_rtp_buffer_get_payload (rtp)) +
+      stream->seq_delta;
+  *ts = gst_rtp_buffer_get_timestamp (rtp) + stream->ts_delta;
+
+  return TRUE;
+}
+
+static gboolean
+kms_webrtc_simulcast_process_rtx (KmsWebrtcSimulcast * self,
+    KmsSimulcastLayer * layer, GstRTPBuffer * rtp, GstBuffer ** buffer)
+{
+  guint32 ssrc = 0, ts = 0;
+  guint16 seq, osn = 0;
+  gboolean forward;
+
+  forward = kms_webrtc_simulcast_translate_rtx (layer, rtp, &ssrc, &osn, &ts);
+  seq = gst_rtp_buffer_get_seq (rtp);
+
+  g_mutex_unlock (&self->mutex);
+  gst_rtp_buffer_unmap (rtp);
+
+  if (!forward) {
+    return FALSE;
+  }
+
+  kms_webrtc_simulcast_rewrite (buffer, ssrc, seq, ts);
+
+  if (gst_rtp_buffer_map (*buffer, GST_MAP_WRITE, rtp)) {
+    GST_WRITE_UINT16_BE (gst_rtp_buffer_get_payload (rtp), osn);
+    gst_rtp_buffer_unmap (rtp);
+  }
+
+  return TRUE;
+}
+
+/* Returns FALSE if @buffer must be dropped */
+static gboolean
+kms_webrtc_simulcast_process_rtp (KmsWebrtcSimulcast * self,
+    GstBuffer ** buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsSimulcastStream *stream;
+  KmsSimulcastLayer *layer;
+  GstPad *feedback = NULL, *output;
+  GstCaps *output_caps = NULL;
+  gchar *description = NULL;
+  guint32 pli_ssrc = 0, sender = 0, ssrc, ts;
+  gboolean forward, rtx = FALSE;
+  gint64 now;
+  guint16 seq;
+
+  if (self->streams->len == 0 ||
+      !gst_rtp_buffer_map (*buffer, GST_MAP_READ, &rtp)) {
+    return TRUE;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  layer = g_hash_table_lookup (self->ssrcs, GUINT_TO_POINTER (ssrc));
+
+  if (layer == NULL) {
+    layer = g_hash_table_lookup (self->rtx_ssrcs, GUINT_TO_POINTER (ssrc));
+    rtx = layer != NULL;
+  }
+
+  if (layer == NULL) {
+    layer = kms_webrtc_simulcast_learn_ssrc (self, &rtp, &rtx);
+  }
+
+  /* Other medias of the bundle, or video without simulcast */
+  if (layer == NULL) {
+    g_mutex_unlock (&self->mutex);
+    gst_rtp_buffer_unmap (&rtp);
+    return TRUE;
+  }
+
+  if (rtx) {
+    return kms_webrtc_simulcast_process_rtx (self, layer, &rtp, buffer);
+  }
+
+  stream = layer->stream;
+  now = g_get_monotonic_time ();
+  seq = gst_rtp_buffer_get_seq (&rtp);
+  ts = gst_rtp_buffer_get_timestamp (&rtp);
+
+  layer->bytes += gst_buffer_get_size (*buffer);
+  layer->last_seen = now;
+
+  if (stream->window_start == 0) {
+    stream->window_start = now;
+  } else if (now - stream->window_start >= BITRATE_WINDOW) {
+    kms_simulcast_stream_update_bitrates (stream, now);
+    kms_webrtc_simulcast_choose (self, stream, now);
+  }
+
+  if (stream->current == NULL && stream->target == NULL) {
+    kms_webrtc_simulcast_choose (self, stream, now);
+  }
+
+  if (layer == stream->target &&
+      kms_webrtc_simulcast_is_keyframe (stream, &rtp)) {
+    kms_simulcast_stream_switch (stream, layer, seq, ts, now);
+  }
+
+  output = kms_webrtc_simulcast_get_output (self, layer,
+      gst_rtp_buffer_get_payload_type (&rtp), &output_caps, &description);
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (stream->target != NULL && stream->feedback != NULL &&
+      now - stream->last_pli >= PLI_INTERVAL) {
+    stream->last_pli = now;
+    pli_ssrc = stream->target->ssrc;
+    sender = self->local_ssrc;
+    feedback = g_object_ref (stream->feedback);
+  }
+
+  forward = layer == stream->current;
+
+  if (forward) {
+    guint16 out_seq = seq + stream->seq_delta;
+    guint32 out_ts = ts + stream->ts_delta;
+
+    if ((gint16) (out_seq - stream->last_seq) > 0) {
+      stream->last_seq = out_seq;
+    }
+    if ((gint32) (out_ts - stream->last_ts) > 0) {
+      stream->last_ts = out_ts;
+      stream->last_time = now;
+    }
+
+    ssrc = stream->out_ssrc;
+    seq = out_seq;
+    ts = out_ts;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (feedback != NULL) {
+    kms_webrtc_simulcast_request_keyframe (feedback, sender, pli_ssrc);
+  }
+
+  /* Every layer goes to its own output as it is received */
+  kms_webrtc_simulcast_push_output (self, layer, output, output_caps,
+      description, *buffer);
+
+  if (!forward) {
+    return FALSE;
+  }
+
+  kms_webrtc_simulcast_rewrite (buffer, ssrc, seq, ts);
+
+  return TRUE;
+}
+
+static gboolean
+kms_webrtc_simulcast_process_rtp_list (GstBuffer ** buffer, guint idx,
+    KmsWebrtcSimulcast * self)
+{
+  if (!kms_webrtc_simulcast_process_rtp (self, buffer)) {
+    gst_buffer_unref (*buffer);
+    *buffer = NULL;
+  }
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_webrtc_simulcast_rtp_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsWebrtcSimulcast * self)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    if (!kms_webrtc_simulcast_process_rtp (self, &buffer)) {
+      return GST_PAD_PROBE_DROP;
+    }
+
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list,
+        (GstBufferListFunc) kms_webrtc_simulcast_process_rtp_list, self);
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+
+    if (gst_buffer_list_length (list) == 0) {
+      return GST_PAD_PROBE_DROP;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* RTCP, must be called with the mutex held */
+
+/* Reports and keyframe requests sent by the publisher */
+static void
+kms_webrtc_simulcast_translate_incoming (KmsWebrtcSimulcast * self,
+    guint8 * packet, guint len)
+{
+  KmsSimulcastStream *stream;
+  guint32 ssrc;
+  guint count, pos, i;
+
+  switch (packet[1]) {
+    case GST_RTCP_TYPE_SR:
+      if (len < 28) {
+        return;
+      }
+
+      ssrc = GST_READ_UINT32_BE (packet + 4);
+      stream = kms_webrtc_simulcast_find_stream (self, ssrc);
+
+      if (stream == NULL || stream->current == NULL) {
+        return;
+      }
+
+      if (ssrc == stream->current->ssrc || (ssrc != 0 &&
+              ssrc == stream->current->rtx_ssrc)) {
+        GST_WRITE_UINT32_BE (packet + 16,
+            GST_READ_UINT32_BE (packet + 16) + stream->ts_delta);
+      }
+
+      GST_WRITE_UINT32_BE (packet + 4, kms_simulcast_stream_swap (stream,
+              ssrc));
+      break;
+    case GST_RTCP_TYPE_SDES:
+      /* <SSRC> <items> <end> <padding>, once per chunk */
+      count = packet[0] & 0x1f;
+      pos = 4;
+
+      for (i = 0; i < count && pos + 4 <= len; i++) {
+        ssrc = GST_READ_UINT32_BE (packet + pos);
+        stream = kms_webrtc_simulcast_find_stream (self, ssrc);
+
+        if (stream != NULL) {
+          GST_WRITE_UINT32_BE (packet + pos, kms_simulcast_stream_swap (stream,
+                  ssrc));
+        }
+
+        pos += 4;
+        while (pos + 1 < len && packet[pos] != 0) {
+          pos += 2 + packet[pos + 1];
+        }
+
+        /* Next chunk starts after the end item and the padding */
+        pos = (pos + 4) & ~3;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+kms_webrtc_simulcast_translate_blocks (KmsWebrtcSimulcast * self,
+    guint8 * packet, guint len, guint offset)
+{
+  guint count = packet[0] & 0x1f;
+  guint i;
+
+  /* <SSRC> <lost> <highest sequence number> <jitter> <LSR> <DLSR> */
+  for (i = 0; i < count && offset + 24 * (i + 1) <= len; i++) {
+    guint8 *block = packet + offset + 24 * i;
+    guint32 ssrc = GST_READ_UINT32_BE (block);
+    KmsSimulcastStream *stream;
+
+    stream = kms_webrtc_simulcast_find_stream (self, ssrc);
+
+    if (stream == NULL || stream->current == NULL) {
+      continue;
+    }
+
+    GST_WRITE_UINT32_BE (block, kms_simulcast_stream_swap (stream, ssrc));
+
+    if (ssrc == stream->out_ssrc) {
+      GST_WRITE_UINT16_BE (block + 10,
+          GST_READ_UINT16_BE (block + 10) - stream->seq_delta);
+    }
+  }
+}
+
+/* Keyframe requests go to the layer about to be forwarded */
+static guint32
+kms_webrtc_simulcast_translate_request (KmsWebrtcSimulcast * self,
+    guint32 ssrc)
+{
+  KmsSimulcastStream *stream = kms_webrtc_simulcast_find_stream (self, ssrc);
+
+  if (stream == NULL) {
+    return ssrc;
+  }
+
+  if (ssrc == stream->out_ssrc && stream->target != NULL) {
+    return stream->target->ssrc;
+  }
+
+  return kms_simulcast_stream_swap (stream, ssrc);
+}
+
+/* Reports and feedback sent to the publisher */
+static void
+kms_webrtc_simulcast_translate_outgoing (KmsWebrtcSimulcast * self,
+    guint8 * packet, guint len)
+{
+  KmsSimulcastStream *stream;
+  guint fmt = packet[0] & 0x1f;
+  guint32 ssrc;
+  guint pos;
+
+  if (len < 12) {
+    return;
+  }
+
+  switch (packet[1]) {
+    case GST_RTCP_TYPE_SR:
+      self->local_ssrc = GST_READ_UINT32_BE (packet + 4);
+      kms_webrtc_simulcast_translate_blocks (self, packet, len, 28);
+      break;
+    case GST_RTCP_TYPE_RR:
+      self->local_ssrc = GST_READ_UINT32_BE (packet + 4);
+      kms_webrtc_simulcast_translate_blocks (self, packet, len, 8);
+      break;
+    case GST_RTCP_TYPE_RTPFB:
+      ssrc = GST_READ_UINT32_BE (packet + 8);
+      stream = kms_webrtc_simulcast_find_stream (self, ssrc);
+
+      if (fmt != RTCP_FMT_NACK || stream == NULL || stream->current == NULL) {
+        break;
+      }
+
+      GST_WRITE_UINT32_BE (packet + 8, kms_simulcast_stream_swap (stream,
+              ssrc));
+
+      if (ssrc != stream->out_ssrc) {
+        break;
+      }
+
+      /* <packet id> <bitmask>, lost before a switch are not found anymore */
+      for (pos = 12; pos + 4 <= len; pos += 4) {
+        GST_WRITE_UINT16_BE (packet + pos,
+            GST_READ_UINT16_BE (packet + pos) - stream->seq_delta);
+      }
+      break;
+    case GST_RTCP_TYPE_PSFB:
+      if (fmt == RTCP_FMT_PLI) {
+        GST_WRITE_UINT32_BE (packet + 8,
+            kms_webrtc_simulcast_translate_request (self,
+                GST_READ_UINT32_BE (packet + 8)));
+      } else if (fmt == RTCP_FMT_FIR) {
+        /* <SSRC> <sequence number> <reserved> */
+        for (pos = 12; pos + 8 <= len; pos += 8) {
+          GST_WRITE_UINT32_BE (packet + pos,
+              kms_webrtc_simulcast_translate_request (self,
+                  GST_READ_UINT32_BE (packet + pos)));
+        }
+      } else if (fmt == RTCP_FMT_AFB && len >= 20 &&
+          memcmp (packet + 12, "REMB", 4) == 0) {
+        guint n = packet[16];
+
+        for (pos = 20; n > 0 && pos + 4 <= len; pos += 4, n--) {
+          ssrc = GST_READ_UINT32_BE (packet + pos);
+          stream = kms_webrtc_simulcast_find_stream (self, ssrc);
+
+          if (stream != NULL) {
+            GST_WRITE_UINT32_BE (packet + pos,
+                kms_simulcast_stream_swap (stream, ssrc));
+          }
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+kms_webrtc_simulcast_process_rtcp (KmsWebrtcSimulcast * self,
+    GstPadProbeInfo * info, gboolean incoming)
+{
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  GstMapInfo map;
+  guint offset;
+
+  if (self->streams->len == 0) {
+    return;
+  }
+
+  buffer = gst_buffer_make_writable (buffer);
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READWRITE)) {
+    return;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  for (offset = 0; offset + 4 <= map.size;) {
+    guint8 *packet = map.data + offset;
+    guint len = (GST_READ_UINT16_BE (packet + 2) + 1) * 4;
+
+    if ((packet[0] >> 6) != 2 || offset + len > map.size) {
+      break;
+    }
+
+    if (incoming) {
+      kms_webrtc_simulcast_translate_incoming (self, packet, len);
+    } else {
+      kms_webrtc_simulcast_translate_outgoing (self, packet, len);
+    }
+
+    offset += len;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  gst_buffer_unmap (buffer, &map);
+}
+
+static GstPadProbeReturn
+kms_webrtc_simulcast_incoming_rtcp_probe (GstPad * pad,
+    GstPadProbeInfo * info, KmsWebrtcSimulcast * self)
+{
+  kms_webrtc_simulcast_process_rtcp (self, info, TRUE);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+kms_webrtc_simulcast_outgoing_rtcp_probe (GstPad * pad,
+    GstPadProbeInfo * info, KmsWebrtcSimulcast * self)
+{
+  kms_webrtc_simulcast_process_rtcp (self, info, FALSE);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Pads */
+
+static void
+kms_webrtc_simulcast_watch_rtcp_sink (KmsWebrtcSimulcast * self, GstPad * pad)
+{
+  if (!g_str_has_prefix (GST_OBJECT_NAME (pad), "rtcp_sink") ||
+      !kms_rtp_watcher_mark (pad, RTCP_SINK_DATA)) {
+    return;
+  }
+
+  GST_DEBUG_OBJECT (pad, "Translating outgoing RTCP");
+
+  kms_rtp_watcher_add_pad_func (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_webrtc_simulcast_outgoing_rtcp_probe, self,
+      NULL);
+}
+
+static void
+kms_webrtc_simulcast_rtcp_sink_added (GstElement * element, GstPad * pad,
+    KmsWebrtcSimulcast * self)
+{
+  if (GST_PAD_IS_SINK (pad)) {
+    kms_webrtc_simulcast_watch_rtcp_sink (self, pad);
+  }
+}
+
+static void
+kms_webrtc_simulcast_watch_rtcp_sink_foreach (const GValue * item,
+    KmsWebrtcSimulcast * self)
+{
+  kms_webrtc_simulcast_watch_rtcp_sink (self, g_value_get_object (item));
+}
+
+/* Creates the pad used to request keyframes, and translates the RTCP sent
+ * through the encoder @sink belongs to */
+static GstPad *
+kms_webrtc_simulcast_create_feedback (KmsWebrtcSimulcast * self,
+    GstPad * sink)
+{
+  GstElement *encoder;
+  GstIterator *it;
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *stream_id;
+  GstPad *src;
+
+  src = gst_pad_new ("simulcast_feedback", GST_PAD_SRC);
+
+  if (gst_pad_link (src, sink) != GST_PAD_LINK_OK) {
+    GST_WARNING_OBJECT (sink, "Can not request keyframes");
+    g_object_unref (src);
+    return NULL;
+  }
+
+  gst_pad_set_active (src, TRUE);
+
+  /* Sticky, sent again with the first request if the encoder is not ready */
+  stream_id = g_strdup_printf ("simulcast-feedback-%p", src);
+  gst_pad_push_event (src, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  caps = gst_caps_new_empty_simple ("application/x-rtcp");
+  gst_pad_push_event (src, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (src, gst_event_new_segment (&segment));
+
+  /* Requests are already translated */
+  kms_rtp_watcher_mark (sink, RTCP_SINK_DATA);
+  encoder = gst_pad_get_parent_element (sink);
+
+  if (encoder != NULL) {
+    it = gst_element_iterate_sink_pads (encoder);
+    gst_iterator_foreach (it, (GstIteratorForeachFunction)
+        kms_webrtc_simulcast_watch_rtcp_sink_foreach, self);
+    gst_iterator_free (it);
+
+    if (kms_rtp_watcher_mark (encoder, ENCODER_DATA)) {
+      g_signal_connect (encoder, "pad-added",
+          G_CALLBACK (kms_webrtc_simulcast_rtcp_sink_added), self);
+    }
+
+    g_object_unref (encoder);
+  }
+
+  return src;
+}
+
+static void
+kms_webrtc_simulcast_watch_pads (KmsWebrtcSimulcast * self, GstPad * rtp_src,
+    GstPad * rtcp_src)
+{
+  if (rtp_src != NULL && kms_rtp_watcher_add_pad_func (rtp_src,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          (GstPadProbeCallback) kms_webrtc_simulcast_rtp_probe, self,
+          NULL)) {
+    GST_DEBUG_OBJECT (rtp_src, "Selecting simulcast layers");
+  }
+
+  if (rtcp_src != NULL) {
+    kms_rtp_watcher_add_pad_func (rtcp_src, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) kms_webrtc_simulcast_incoming_rtcp_probe, self,
+        NULL);
+  }
+}
+
+static KmsSimulcastStream *
+kms_webrtc_simulcast_lookup_mid (KmsWebrtcSimulcast * self, const gchar * mid)
+{
+  guint i;
+
+  for (i = 0; i < self->streams->len; i++) {
+    KmsSimulcastStream *stream = g_ptr_array_index (self->streams, i);
+
+    if (g_strcmp0 (stream->mid, mid) == 0) {
+      return stream;
+    }
+  }
+
+  return NULL;
+}
+
+/* Returns TRUE if @media was already being watched */
+static gboolean
+kms_webrtc_simulcast_update_media (KmsWebrtcSimulcast * self,
+    const GstSDPMedia * media)
+{
+  KmsSimulcastStream *known;
+
+  g_mutex_lock (&self->mutex);
+  known = kms_webrtc_simulcast_lookup_mid (self,
+      gst_sdp_media_get_attribute_val (media, MID_ATTR));
+
+  if (known != NULL) {
+    /* Same layers, payload types might have changed */
+    kms_simulcast_stream_parse_codecs (known, media);
+  }
+  g_mutex_unlock (&self->mutex);
+
+  return known != NULL;
+}
+
+static void
+kms_webrtc_simulcast_add_stream (KmsWebrtcSimulcast * self,
+    KmsSimulcastStream * stream, GstPad * rtp_src, GstPad * rtcp_src,
+    GstPad * rtcp_sink)
+{
+  guint i;
+
+  GST_INFO ("Receiving %u simulcast layers in media %s",
+      stream->layers->len, stream->mid);
+
+  if (rtcp_sink != NULL) {
+    stream->feedback = kms_webrtc_simulcast_create_feedback (self, rtcp_sink);
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  for (i = 0; i < stream->layers->len; i++) {
+    KmsSimulcastLayer *layer = g_ptr_array_index (stream->layers, i);
+
+    if (layer->ssrc != 0) {
+      g_hash_table_insert (self->ssrcs, GUINT_TO_POINTER (layer->ssrc),
+          layer);
+    }
+
+    if (layer->rtx_ssrc != 0) {
+      g_hash_table_insert (self->rtx_ssrcs,
+          GUINT_TO_POINTER (layer->rtx_ssrc), layer);
+    }
+  }
+
+  g_ptr_array_add (self->streams, stream);
+  g_mutex_unlock (&self->mutex);
+
+  kms_webrtc_simulcast_watch_pads (self, rtp_src, rtcp_src);
+}
+
+void
+kms_webrtc_simulcast_watch_media (KmsWebrtcSimulcast * self,
+    const GstSDPMedia * media, GstPad * rtp_src, GstPad * rtcp_src,
+    GstPad * rtcp_sink)
+{
+  KmsSimulcastStream *stream;
+
+  if (kms_webrtc_simulcast_update_media (self, media)) {
+    return;
+  }
+
+  stream = kms_webrtc_simulcast_parse_media (media);
+
+  if (stream != NULL) {
+    kms_webrtc_simulcast_add_stream (self, stream, rtp_src, rtcp_src,
+        rtcp_sink);
+  }
+}
+
+void
+kms_webrtc_simulcast_watch_connection (KmsWebrtcSimulcast * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media)
+{
+  GstPad *rtp_src, *rtcp_src, *rtcp_sink;
+  KmsSimulcastStream *stream;
+
+  if (g_strcmp0 (gst_sdp_media_get_media (remote_media), "video") != 0 ||
+      kms_webrtc_simulcast_update_media (self, remote_media)) {
+    return;
+  }
+
+  stream = kms_webrtc_simulcast_parse_media (remote_media);
+
+  if (stream == NULL) {
+    return;
+  }
+
+  rtp_src = kms_i_rtp_connection_request_rtp_src (conn);
+  rtcp_src = kms_i_rtp_connection_request_rtcp_src (conn);
+  rtcp_sink = kms_i_rtp_connection_request_rtcp_sink (conn);
+
+  kms_webrtc_simulcast_add_stream (self, stream, rtp_src, rtcp_src,
+      rtcp_sink);
+
+  g_clear_object (&rtp_src);
+  g_clear_object (&rtcp_src);
+  g_clear_object (&rtcp_sink);
+}
+
+static void
+kms_webrtc_simulcast_choose_all (KmsWebrtcSimulcast * self)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint i;
+
+  for (i = 0; i < self->streams->len; i++) {
+    kms_webrtc_simulcast_choose (self, g_ptr_array_index (self->streams, i),
+        now);
+  }
+}
+
+void
+kms_webrtc_simulcast_set_layer (KmsWebrtcSimulcast * self, gint layer)
+{
+  g_mutex_lock (&self->mutex);
+  self->layer = layer;
+  kms_webrtc_simulcast_choose_all (self);
+  g_mutex_unlock (&self->mutex);
+}
+
+gint
+kms_webrtc_simulcast_get_layer (KmsWebrtcSimulcast * self)
+{
+  gint layer;
+
+  g_mutex_lock (&self->mutex);
+  layer = self->layer;
+  g_mutex_unlock (&self->mutex);
+
+  return layer;
+}
+
+void
+kms_webrtc_simulcast_set_max_bitrate (KmsWebrtcSimulcast * self,
+    guint max_bitrate)
+{
+  g_mutex_lock (&self->mutex);
+  self->max_bitrate = max_bitrate;
+  kms_webrtc_simulcast_choose_all (self);
+  g_mutex_unlock (&self->mutex);
+}
+
+guint
+kms_webrtc_simulcast_get_max_bitrate (KmsWebrtcSimulcast * self)
+{
+  guint max_bitrate;
+
+  g_mutex_lock (&self->mutex);
+  max_bitrate = self->max_bitrate;
+  g_mutex_unlock (&self->mutex);
+
+  return max_bitrate;
+}
+
+guint
+kms_webrtc_simulcast_get_layers (KmsWebrtcSimulcast * self)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint i, layers = 0;
+
+  g_mutex_lock (&self->mutex);
+
+  for (i = 0; i < self->streams->len; i++) {
+    GPtrArray *ranked =
+        kms_simulcast_stream_rank (g_ptr_array_index (self->streams, i), now);
+
+    layers = MAX (layers, ranked->len);
+    g_ptr_array_free (ranked, TRUE);
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  return layers;
+}
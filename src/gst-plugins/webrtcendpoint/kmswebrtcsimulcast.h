@@ -0,0 +1,96 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_WEBRTC_SIMULCAST_H__
+#define __KMS_WEBRTC_SIMULCAST_H__
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+#include <commons/kmsirtpconnection.h>
+#include <commons/kmselement.h>
+
+G_BEGIN_DECLS
+
+/* RFC 8852 RTP stream identifier header extension */
+#define KMS_WEBRTC_SIMULCAST_RID_EXT_URI \
+  "urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id"
+#define KMS_WEBRTC_SIMULCAST_RID_EXT_ID 2
+
+/* RFC 8852 repaired RTP stream identifier, sent with retransmissions */
+#define KMS_WEBRTC_SIMULCAST_RRID_EXT_URI \
+  "urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id"
+#define KMS_WEBRTC_SIMULCAST_RRID_EXT_ID 3
+
+/* Let the bitrate limit choose the layer */
+#define KMS_WEBRTC_SIMULCAST_LAYER_AUTO -1
+
+/*
+ * Simulcast reception. Publishers may send several encodings of the same
+ * video, either as a legacy "a=ssrc-group:SIM" or as RID streams announced
+ * with "a=simulcast". Only one of them is forwarded to the rest of the
+ * pipeline, which sees a single stream with a stable SSRC and continuous
+ * sequence numbers and timestamps, so nothing is decoded nor encoded.
+ *
+ * Layers are ranked by their measured bitrate, 0 being the lowest. The
+ * forwarded layer only changes on a keyframe of the new one, which is
+ * requested with a PLI. Keyframe requests, NACKs and receiver reports sent
+ * for the forwarded stream are translated to the layer being forwarded.
+ * Retransmissions of that layer are translated the other way, those of the
+ * rest of layers are dropped.
+ *
+ * Each layer is also available on its own, depayloaded, as a video output of
+ * the element with its RID, or its position in the SSRC group, as
+ * description. Subscribers connected to one of them get that layer whatever
+ * the forwarded one is. Only keyframes are requested for them, lost packets
+ * are not retransmitted.
+ */
+typedef struct _KmsWebrtcSimulcast KmsWebrtcSimulcast;
+
+/* Layer outputs are added to @element, none when it is NULL */
+KmsWebrtcSimulcast *kms_webrtc_simulcast_new (KmsElement * element);
+void kms_webrtc_simulcast_free (KmsWebrtcSimulcast * self);
+
+/* Accepts the RID streams the remote offer sends for the video of
+ * @local_media, which must be an answer */
+void kms_webrtc_simulcast_answer_media (const GstSDPMessage * remote_sdp,
+    GstSDPMedia * local_media);
+
+/* Starts selecting layers in the video received through @conn when
+ * @remote_media is simulcast, as a KmsRtpWatcherMediaFunc */
+void kms_webrtc_simulcast_watch_connection (KmsWebrtcSimulcast * self,
+    KmsIRtpConnection * conn, const GstSDPMedia * remote_media,
+    const GstSDPMedia * local_media);
+
+/* Same for a single @media, given the pads of its connection. @rtcp_sink,
+ * used to request keyframes, may be NULL */
+void kms_webrtc_simulcast_watch_media (KmsWebrtcSimulcast * self,
+    const GstSDPMedia * media, GstPad * rtp_src, GstPad * rtcp_src,
+    GstPad * rtcp_sink);
+
+/* Layer to forward, or KMS_WEBRTC_SIMULCAST_LAYER_AUTO */
+void kms_webrtc_simulcast_set_layer (KmsWebrtcSimulcast * self, gint layer);
+gint kms_webrtc_simulcast_get_layer (KmsWebrtcSimulcast * self);
+
+/* Highest bitrate, in bps, of the layer chosen automatically. 0 for none */
+void kms_webrtc_simulcast_set_max_bitrate (KmsWebrtcSimulcast * self,
+    guint max_bitrate);
+guint kms_webrtc_simulcast_get_max_bitrate (KmsWebrtcSimulcast * self);
+
+/* Layers received lately in the stream with most of them */
+guint kms_webrtc_simulcast_get_layers (KmsWebrtcSimulcast * self);
+
+G_END_DECLS
+#endif /* __KMS_WEBRTC_SIMULCAST_H__ */
@@ -18,6 +18,7 @@
 #include <commons/kmsstats.h>
 
 #include "kmswebrtctransport.h"
+#include "kmslatencysampler.h"
 #include <stdlib.h>
 
 #define GST_CAT_DEFAULT kmswebrtctransport
@@ -31,6 +32,24 @@ G_DEFINE_TYPE_WITH_CODE (KmsWebRtcTransport, kms_webrtc_transport,
     GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
         GST_DEFAULT_NAME));
 
+typedef struct _KmsLatencyNotificationData
+{
+  KmsLatencyHistogram *latency;
+  BufferLatencyCallback cb;
+  gpointer user_data;
+  GDestroyNotify destroy_data;
+} KmsLatencyNotificationData;
+
+static void
+latency_notification_data_destroy (KmsLatencyNotificationData * data)
+{
+  if (data->destroy_data != NULL) {
+    data->destroy_data (data->user_data);
+  }
+
+  g_slice_free (KmsLatencyNotificationData, data);
+}
+
 static void
 element_remove_probe (GstElement * e, const gchar * pad_name, gulong id)
 {
@@ -45,6 +64,56 @@ element_remove_probe (GstElement * e, const gchar * pad_name, gulong id)
   g_object_unref (pad);
 }
 
+static gboolean
+count_buffer_bytes (GstBuffer ** buffer, guint idx, guint64 * bytes)
+{
+  *bytes += gst_buffer_get_size (*buffer);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+count_packets_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  KmsWebRtcTransportCounters *counters = user_data;
+  guint64 packets = 1, bytes = 0;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    bytes = gst_buffer_get_size (gst_pad_probe_info_get_buffer (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    packets = gst_buffer_list_length (list);
+    gst_buffer_list_foreach (list, (GstBufferListFunc) count_buffer_bytes,
+        &bytes);
+  }
+
+  __atomic_fetch_add (&counters->packets, packets, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&counters->bytes, bytes, __ATOMIC_RELAXED);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gulong
+element_add_count_probe (GstElement * e, const gchar * pad_name,
+    KmsWebRtcTransportCounters * counters)
+{
+  GstPad *pad;
+  gulong id;
+
+  if (e == NULL) {
+    return 0UL;
+  }
+
+  pad = gst_element_get_static_pad (e, pad_name);
+  id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      count_packets_probe, counters, NULL);
+  g_object_unref (pad);
+
+  return id;
+}
+
 static void
 kms_webrtc_transport_finalize (GObject * object)
 {
@@ -52,10 +121,14 @@ kms_webrtc_transport_finalize (GObject * object)
 
   element_remove_probe (self->src->src, "src", self->src_probe);
   element_remove_probe (self->sink->sink, "sink", self->sink_probe);
+  element_remove_probe (self->src->src, "src", self->src_count_probe);
+  element_remove_probe (self->sink->sink, "sink", self->sink_count_probe);
 
   g_clear_object (&self->src);
   g_clear_object (&self->sink);
 
+  kms_latency_histogram_free (self->latency);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -74,6 +147,35 @@ kms_webrtc_transport_init (KmsWebRtcTransport * self)
   self->src = KMS_WEBRTC_TRANSPORT_SRC (kms_webrtc_transport_src_nice_new ());
   self->sink =
       KMS_WEBRTC_TRANSPORT_SINK (kms_webrtc_transport_sink_nice_new ());
+  self->latency = kms_latency_histogram_new ();
+
+  self->src_count_probe = element_add_count_probe (self->src->src, "src",
+      &self->received);
+  self->sink_count_probe = element_add_count_probe (self->sink->sink, "sink",
+      &self->sent);
+}
+
+/* Feedback for the remote peer goes out through a pad of its own */
+static void
+kms_webrtc_transport_watch_transport_cc (KmsWebRtcTransport * tr)
+{
+  GstPad *rtp_src, *rtcp_src, *rtcp_sink;
+  gchar *name;
+
+  name = g_strdup_printf ("rtcp_sink_%d",
+      g_atomic_int_add (&tr->rtcp_id, 1));
+  rtcp_sink = gst_element_get_request_pad (tr->sink->dtlssrtpenc, name);
+  g_free (name);
+
+  rtp_src = gst_element_get_static_pad (tr->src->dtlssrtpdec, "rtp_src");
+  rtcp_src = gst_element_get_static_pad (tr->src->dtlssrtpdec, "rtcp_src");
+
+  kms_webrtc_transport_cc_watch_receiver (tr->sink->transport_cc, rtp_src,
+      rtcp_src, rtcp_sink);
+
+  g_clear_object (&rtp_src);
+  g_clear_object (&rtcp_src);
+  g_clear_object (&rtcp_sink);
 }
 
 KmsWebRtcTransport *
@@ -113,26 +215,53 @@ kms_webrtc_transport_new (KmsIceBaseAgent * agent,
   kms_webrtc_transport_sink_configure (tr->sink, agent, stream_id,
       component_id);
 
+  kms_webrtc_transport_watch_transport_cc (tr);
+
   return tr;
 }
 
+static void
+kms_webrtc_transport_latency_cb (GstPad * pad, KmsMediaType type,
+    GstClockTimeDiff t, KmsList * mdata, gpointer user_data)
+{
+  KmsLatencyNotificationData *data = user_data;
+
+  kms_latency_histogram_record (data->latency, t);
+
+  if (data->cb != NULL) {
+    data->cb (pad, type, t, mdata, data->user_data);
+  }
+}
+
 void
 kms_webrtc_transport_enable_latency_notification (KmsWebRtcTransport * tr,
     BufferLatencyCallback cb, gpointer user_data, GDestroyNotify destroy_data)
 {
+  KmsLatencyNotificationData *data;
   GstPad *pad;
 
+  /* Only sampled buffers carry the meta, so the notification probe, and the
+   * lock it takes, only does some work for them */
   element_remove_probe (tr->src->src, "src", tr->src_probe);
   pad = gst_element_get_static_pad (tr->src->src, "src");
-  tr->src_probe = kms_stats_add_buffer_latency_meta_probe (pad, FALSE,
+  tr->src_probe = kms_latency_sampler_add_element_meta_probe (pad, FALSE,
       0 /* No matter type at this point */ );
   g_object_unref (pad);
 
   element_remove_probe (tr->sink->sink, "sink", tr->sink_probe);
   pad = gst_element_get_static_pad (tr->sink->sink, "sink");
 
-  tr->sink_probe = kms_stats_add_buffer_latency_notification_probe (pad, cb,
-      TRUE /* Lock the data */ , user_data, destroy_data);
+  kms_latency_histogram_reset (tr->latency);
+
+  data = g_slice_new0 (KmsLatencyNotificationData);
+  data->latency = tr->latency;
+  data->cb = cb;
+  data->user_data = user_data;
+  data->destroy_data = destroy_data;
+
+  tr->sink_probe = kms_stats_add_buffer_latency_notification_probe (pad,
+      kms_webrtc_transport_latency_cb, TRUE /* Lock the data */ , data,
+      (GDestroyNotify) latency_notification_data_destroy);
   g_object_unref (pad);
 }
 
@@ -145,3 +274,24 @@ kms_webrtc_transport_disable_latency_notification (KmsWebRtcTransport * tr)
   element_remove_probe (tr->sink->sink, "sink", tr->sink_probe);
   tr->sink_probe = 0UL;
 }
+
+GstStructure *
+kms_webrtc_transport_get_latency_stats (KmsWebRtcTransport * tr,
+    const gchar * name)
+{
+  return kms_latency_histogram_to_structure (tr->latency, name);
+}
+
+void
+kms_webrtc_transport_add_counters (KmsWebRtcTransport * tr,
+    KmsStatsSnapshot * snapshot)
+{
+  snapshot->values[KMS_STATS_COUNTER_PACKETS_RECEIVED] +=
+      __atomic_load_n (&tr->received.packets, __ATOMIC_RELAXED);
+  snapshot->values[KMS_STATS_COUNTER_BYTES_RECEIVED] +=
+      __atomic_load_n (&tr->received.bytes, __ATOMIC_RELAXED);
+  snapshot->values[KMS_STATS_COUNTER_PACKETS_SENT] +=
+      __atomic_load_n (&tr->sent.packets, __ATOMIC_RELAXED);
+  snapshot->values[KMS_STATS_COUNTER_BYTES_SENT] +=
+      __atomic_load_n (&tr->sent.bytes, __ATOMIC_RELAXED);
+}
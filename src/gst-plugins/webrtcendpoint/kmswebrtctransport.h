@@ -22,6 +22,7 @@
 #include "kmsiceniceagent.h"
 #include "kmswebrtctransportsrcnice.h"
 #include "kmswebrtctransportsinknice.h"
+#include "kmsstatssnapshot.h"
 
 #include <gst/gst.h>
 
@@ -63,6 +64,12 @@ G_BEGIN_DECLS
 typedef struct _KmsWebRtcTransport KmsWebRtcTransport;
 typedef struct _KmsWebRtcTransportClass KmsWebRtcTransportClass;
 
+typedef struct _KmsWebRtcTransportCounters
+{
+  guint64 packets; /* atomic */
+  guint64 bytes; /* atomic */
+} KmsWebRtcTransportCounters;
+
 typedef struct _KmsWebRtcTransport
 {
   GObject parent;
@@ -77,6 +84,15 @@ typedef struct _KmsWebRtcTransport
 
   gulong src_probe;
   gulong sink_probe;
+
+  /* Latency of the sampled buffers received, see kmslatencysampler.h */
+  struct _KmsLatencyHistogram *latency;
+
+  /* Packets going through the ICE elements, always counted */
+  gulong src_count_probe;
+  gulong sink_count_probe;
+  KmsWebRtcTransportCounters received;
+  KmsWebRtcTransportCounters sent;
 } KmsWebRtcTransport;
 
 struct _KmsWebRtcTransportClass
@@ -93,6 +109,15 @@ void kms_webrtc_transport_enable_latency_notification (KmsWebRtcTransport * tr,
   BufferLatencyCallback cb, gpointer user_data, GDestroyNotify destroy_data);
 void kms_webrtc_transport_disable_latency_notification (KmsWebRtcTransport * tr);
 
+/* Returns a structure named @name with the latency percentiles measured
+ * since the notification was enabled */
+GstStructure *kms_webrtc_transport_get_latency_stats (KmsWebRtcTransport * tr,
+  const gchar * name);
+
+/* Adds the packets and bytes received and sent to @snapshot */
+void kms_webrtc_transport_add_counters (KmsWebRtcTransport * tr,
+  KmsStatsSnapshot * snapshot);
+
 G_END_DECLS
 
 #endif /* __KMS_WEBRTC_TRANSPORT_H__ */
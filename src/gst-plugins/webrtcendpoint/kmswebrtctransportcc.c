@@ -0,0 +1,1222 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmswebrtctransportcc.h"
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+#include <string.h>
+
+#define GST_CAT_DEFAULT kms_webrtc_transport_cc_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define PROBE_DATA "kms-webrtc-transport-cc-probe"
+
+#define EXTMAP_ATTR "extmap"
+#define RTCP_FB_ATTR "rtcp-fb"
+#define MID_ATTR "mid"
+#define TRANSPORT_CC_FB "transport-cc"
+
+#define RTCP_FMT_TRANSPORT_CC 15
+#define RTCP_FMT_AFB 15
+
+/* Sent packets remembered until their feedback arrives */
+#define HISTORY_SIZE 8192
+#define HISTORY_MASK (HISTORY_SIZE - 1)
+
+/* Receiving */
+#define FEEDBACK_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+#define MAX_ARRIVALS 1000
+#define DELTA_UNIT 250          /* us */
+#define REFERENCE_UNIT 64000    /* us */
+
+/* Delay-based estimator */
+#define BURST_TIME 5000         /* us */
+#define TRENDLINE_WINDOW 20
+#define TRENDLINE_SMOOTHING 0.9
+#define TRENDLINE_GAIN 4.0
+#define OVERUSE_TIME (10 * G_TIME_SPAN_MILLISECOND)
+#define INITIAL_THRESHOLD 12.5  /* ms */
+#define THRESHOLD_UP 0.0087
+#define THRESHOLD_DOWN 0.039
+
+/* Rate control */
+#define START_BITRATE 300000
+#define MIN_BITRATE 30000
+#define MAX_BITRATE 30000000
+#define DECREASE_FACTOR 0.85
+#define INCREASE_PER_SECOND 0.08
+#define DECREASE_INTERVAL (200 * G_TIME_SPAN_MILLISECOND)
+#define ACKED_WINDOW (500 * G_TIME_SPAN_MILLISECOND)
+#define HIGH_LOSS 0.1
+#define LOSS_INTERVAL (300 * G_TIME_SPAN_MILLISECOND)
+#define REMB_INTERVAL (200 * G_TIME_SPAN_MILLISECOND)
+
+#define MAX_SSRCS 8
+
+typedef enum
+{
+  KMS_TRANSPORT_CC_NORMAL,
+  KMS_TRANSPORT_CC_OVERUSE,
+  KMS_TRANSPORT_CC_UNDERUSE
+} KmsTransportCcState;
+
+typedef struct _KmsTransportCcPacket
+{
+  guint16 seq;
+  gboolean sent;
+  gint64 send_time;
+  guint size;
+} KmsTransportCcPacket;
+
+typedef struct _KmsTransportCcGroup
+{
+  gboolean valid;
+  gint64 first_send;
+  gint64 last_send;
+  gint64 last_arrival;
+} KmsTransportCcGroup;
+
+typedef struct _KmsTransportCcArrival
+{
+  gint64 seq;                   /* Unwrapped */
+  gint64 time;
+} KmsTransportCcArrival;
+
+struct _KmsWebrtcTransportCc
+{
+  gint ref;
+  gint ext_id;                  /* Atomic */
+
+  GMutex mutex;
+
+  /* Sending */
+  guint16 next_seq;
+  KmsTransportCcPacket history[HISTORY_SIZE];
+  guint32 ssrcs[MAX_SSRCS];
+  guint n_ssrcs;
+  guint64 packets_sent;
+
+  /* Estimator */
+  KmsTransportCcGroup group;
+  KmsTransportCcGroup prev_group;
+  gint64 first_arrival;
+  guint num_deltas;
+  gdouble accumulated_delay;
+  gdouble smoothed_delay;
+  gdouble window_x[TRENDLINE_WINDOW];
+  gdouble window_y[TRENDLINE_WINDOW];
+  guint window_len;
+  guint window_pos;
+  gdouble trend;
+  gdouble threshold;
+  gint64 last_threshold_update;
+  gint64 overuse_start;
+  guint overuse_count;
+  KmsTransportCcState state;
+
+  guint estimate;
+  guint acked_bitrate;
+  guint64 acked_bytes;
+  gint64 acked_start;
+  gdouble fraction_lost;
+  gint64 last_update;
+  gint64 last_decrease;
+  gint64 last_loss_decrease;
+  gint64 last_remb;
+  guint64 feedbacks_received;
+  guint64 packets_acked;
+  guint64 packets_lost;
+
+  /* Receiving */
+  GArray *arrivals;             /* KmsTransportCcArrival */
+  gint64 last_received;         /* Unwrapped, -1 before the first one */
+  guint32 remote_ssrc;
+  gint64 last_feedback;
+  guint8 feedback_count;
+  GstPad *feedback;
+};
+
+static void
+kms_webrtc_transport_cc_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, "webrtctransportcc", 0,
+        "Transport-wide congestion control");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+KmsWebrtcTransportCc *
+kms_webrtc_transport_cc_new (void)
+{
+  KmsWebrtcTransportCc *self;
+
+  kms_webrtc_transport_cc_init ();
+
+  self = g_slice_new0 (KmsWebrtcTransportCc);
+  self->ref = 1;
+  g_mutex_init (&self->mutex);
+  self->threshold = INITIAL_THRESHOLD;
+  self->arrivals = g_array_new (FALSE, FALSE, sizeof (KmsTransportCcArrival));
+  self->last_received = -1;
+
+  return self;
+}
+
+KmsWebrtcTransportCc *
+kms_webrtc_transport_cc_ref (KmsWebrtcTransportCc * self)
+{
+  g_atomic_int_inc (&self->ref);
+
+  return self;
+}
+
+void
+kms_webrtc_transport_cc_unref (KmsWebrtcTransportCc * self)
+{
+  if (self == NULL || !g_atomic_int_dec_and_test (&self->ref)) {
+    return;
+  }
+
+  if (self->feedback != NULL) {
+    gst_pad_set_active (self->feedback, FALSE);
+    g_object_unref (self->feedback);
+  }
+
+  g_array_unref (self->arrivals);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (KmsWebrtcTransportCc, self);
+}
+
+/* Session description */
+
+guint8
+kms_webrtc_transport_cc_get_ext_id (const GstSDPMedia * media)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar *uri;
+    guint64 id;
+
+    if (g_strcmp0 (attr->key, EXTMAP_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <id>[/<direction>] <uri> [<attributes>] */
+    id = g_ascii_strtoull (attr->value, &uri, 10);
+    uri = strchr (uri, ' ');
+
+    if (uri == NULL || id < 1 || id > 14) {
+      continue;
+    }
+
+    while (*uri == ' ') {
+      uri++;
+    }
+
+    if (g_str_has_prefix (uri, KMS_WEBRTC_TRANSPORT_CC_EXT_URI) &&
+        (uri[strlen (KMS_WEBRTC_TRANSPORT_CC_EXT_URI)] == '\0' ||
+            uri[strlen (KMS_WEBRTC_TRANSPORT_CC_EXT_URI)] == ' ')) {
+      return id;
+    }
+  }
+
+  return 0;
+}
+
+static gboolean
+kms_webrtc_transport_cc_media_has_feedback (const GstSDPMedia * media,
+    const gchar * fmt)
+{
+  guint i, len;
+
+  len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+    gchar **tokens;
+    gboolean found;
+
+    if (g_strcmp0 (attr->key, RTCP_FB_ATTR) != 0 || attr->value == NULL) {
+      continue;
+    }
+
+    /* <format> <feedback> */
+    tokens = g_strsplit (attr->value, " ", 2);
+    found = tokens[0] != NULL && tokens[1] != NULL &&
+        (g_strcmp0 (tokens[0], fmt) == 0 || g_strcmp0 (tokens[0], "*") == 0) &&
+        g_strcmp0 (tokens[1], TRANSPORT_CC_FB) == 0;
+    g_strfreev (tokens);
+
+    if (found) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static const GstSDPMedia *
+kms_webrtc_transport_cc_find_media (const GstSDPMessage * sdp,
+    const gchar * mid)
+{
+  guint i, len;
+
+  len = gst_sdp_message_medias_len (sdp);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media (sdp, i);
+
+    if (g_strcmp0 (gst_sdp_media_get_attribute_val (media, MID_ATTR),
+            mid) == 0) {
+      return media;
+    }
+  }
+
+  return NULL;
+}
+
+void
+kms_webrtc_transport_cc_configure_media (const GstSDPMessage * remote_sdp,
+    GstSDPMedia * local_media)
+{
+  const GstSDPMedia *remote_media = NULL;
+  const gchar *media_type;
+  guint i, len;
+
+  media_type = gst_sdp_media_get_media (local_media);
+
+  if (g_strcmp0 (media_type, "audio") != 0 &&
+      g_strcmp0 (media_type, "video") != 0) {
+    return;
+  }
+
+  if (remote_sdp != NULL) {
+    remote_media = kms_webrtc_transport_cc_find_media (remote_sdp,
+        gst_sdp_media_get_attribute_val (local_media, MID_ATTR));
+
+    if (remote_media == NULL) {
+      return;
+    }
+  }
+
+  len = gst_sdp_media_formats_len (local_media);
+
+  for (i = 0; i < len; i++) {
+    const gchar *fmt = gst_sdp_media_get_format (local_media, i);
+    gchar *value;
+
+    if (kms_webrtc_transport_cc_media_has_feedback (local_media, fmt) ||
+        (remote_media != NULL &&
+            !kms_webrtc_transport_cc_media_has_feedback (remote_media, fmt))) {
+      continue;
+    }
+
+    value = g_strdup_printf ("%s %s", fmt, TRANSPORT_CC_FB);
+    gst_sdp_media_add_attribute (local_media, RTCP_FB_ATTR, value);
+    g_free (value);
+  }
+}
+
+void
+kms_webrtc_transport_cc_set_ext_id (KmsWebrtcTransportCc * self, guint8 id)
+{
+  if (g_atomic_int_get (&self->ext_id) != id) {
+    GST_DEBUG ("Transport-wide sequence numbers with extension id %u", id);
+  }
+
+  g_atomic_int_set (&self->ext_id, id);
+}
+
+/* Delay-based estimator, must be called with the mutex held */
+
+static void
+kms_webrtc_transport_cc_detect (KmsWebrtcTransportCc * self, gdouble trend,
+    gint64 now)
+{
+  gdouble modified, abs_modified;
+  gint64 elapsed;
+
+  modified = MIN (self->num_deltas, 60) * trend * TRENDLINE_GAIN;
+  abs_modified = ABS (modified);
+
+  if (modified > self->threshold) {
+    if (self->overuse_start == 0) {
+      self->overuse_start = now;
+    }
+
+    self->overuse_count++;
+
+    if (now - self->overuse_start >= OVERUSE_TIME &&
+        self->overuse_count > 1 && trend >= self->trend) {
+      if (self->state != KMS_TRANSPORT_CC_OVERUSE) {
+        GST_DEBUG ("Overusing, trend %.2f above %.2f", modified,
+            self->threshold);
+      }
+
+      self->state = KMS_TRANSPORT_CC_OVERUSE;
+      self->overuse_start = 0;
+      self->overuse_count = 0;
+    }
+  } else {
+    self->state = modified < -self->threshold ?
+        KMS_TRANSPORT_CC_UNDERUSE : KMS_TRANSPORT_CC_NORMAL;
+    self->overuse_start = 0;
+    self->overuse_count = 0;
+  }
+
+  self->trend = trend;
+
+  /* The threshold follows the trend, slower upwards, and ignores spikes */
+  if (self->last_threshold_update == 0) {
+    self->last_threshold_update = now;
+  }
+
+  elapsed = MIN (now - self->last_threshold_update,
+      100 * G_TIME_SPAN_MILLISECOND);
+  self->last_threshold_update = now;
+
+  if (abs_modified > self->threshold + 15.0) {
+    return;
+  }
+
+  self->threshold += (abs_modified < self->threshold ? THRESHOLD_DOWN :
+      THRESHOLD_UP) * (abs_modified - self->threshold) *
+      (elapsed / (gdouble) G_TIME_SPAN_MILLISECOND);
+  self->threshold = CLAMP (self->threshold, 6.0, 600.0);
+}
+
+static void
+kms_webrtc_transport_cc_update_trendline (KmsWebrtcTransportCc * self,
+    gdouble delay, gint64 arrival, gint64 now)
+{
+  gdouble mean_x = 0.0, mean_y = 0.0, num = 0.0, den = 0.0;
+  guint i;
+
+  if (self->first_arrival == 0) {
+    self->first_arrival = arrival;
+  }
+
+  self->num_deltas = MIN (self->num_deltas + 1, 1000);
+  self->accumulated_delay += delay;
+  self->smoothed_delay = TRENDLINE_SMOOTHING * self->smoothed_delay +
+      (1.0 - TRENDLINE_SMOOTHING) * self->accumulated_delay;
+
+  self->window_x[self->window_pos] =
+      (arrival - self->first_arrival) / (gdouble) G_TIME_SPAN_MILLISECOND;
+  self->window_y[self->window_pos] = self->smoothed_delay;
+  self->window_pos = (self->window_pos + 1) % TRENDLINE_WINDOW;
+  self->window_len = MIN (self->window_len + 1, TRENDLINE_WINDOW);
+
+  if (self->window_len < TRENDLINE_WINDOW) {
+    return;
+  }
+
+  /* Least squares slope of the smoothed delay over the arrival time */
+  for (i = 0; i < TRENDLINE_WINDOW; i++) {
+    mean_x += self->window_x[i];
+    mean_y += self->window_y[i];
+  }
+
+  mean_x /= TRENDLINE_WINDOW;
+  mean_y /= TRENDLINE_WINDOW;
+
+  for (i = 0; i < TRENDLINE_WINDOW; i++) {
+    num += (self->window_x[i] - mean_x) * (self->window_y[i] - mean_y);
+    den += (self->window_x[i] - mean_x) * (self->window_x[i] - mean_x);
+  }
+
+  kms_webrtc_transport_cc_detect (self, den != 0.0 ? num / den : self->trend,
+      now);
+}
+
+/* Packets sent within a burst are compared as a group */
+static void
+kms_webrtc_transport_cc_on_arrival (KmsWebrtcTransportCc * self,
+    KmsTransportCcPacket * packet, gint64 arrival, gint64 now)
+{
+  KmsTransportCcGroup *group = &self->group;
+
+  if (self->acked_start == 0 || arrival < self->acked_start) {
+    self->acked_start = arrival;
+    self->acked_bytes = 0;
+  }
+
+  self->acked_bytes += packet->size;
+
+  if (arrival - self->acked_start >= ACKED_WINDOW) {
+    self->acked_bitrate = self->acked_bytes * 8 * G_USEC_PER_SEC /
+        (arrival - self->acked_start);
+    self->acked_start = arrival;
+    self->acked_bytes = 0;
+  }
+
+  if (group->valid && packet->send_time < group->first_send) {
+    /* Reordered on our side */
+    return;
+  }
+
+  if (group->valid && packet->send_time - group->first_send <= BURST_TIME) {
+    group->last_send = MAX (group->last_send, packet->send_time);
+    group->last_arrival = MAX (group->last_arrival, arrival);
+    return;
+  }
+
+  if (group->valid && self->prev_group.valid) {
+    gdouble send_delta = (group->last_send - self->prev_group.last_send) /
+        (gdouble) G_TIME_SPAN_MILLISECOND;
+    gdouble arrival_delta = (group->last_arrival -
+        self->prev_group.last_arrival) / (gdouble) G_TIME_SPAN_MILLISECOND;
+
+    kms_webrtc_transport_cc_update_trendline (self, arrival_delta - send_delta,
+        group->last_arrival, now);
+  }
+
+  if (group->valid) {
+    self->prev_group = *group;
+  }
+
+  group->valid = TRUE;
+  group->first_send = packet->send_time;
+  group->last_send = packet->send_time;
+  group->last_arrival = arrival;
+}
+
+static void
+kms_webrtc_transport_cc_update_estimate (KmsWebrtcTransportCc * self,
+    gint64 now)
+{
+  gdouble estimate;
+  gint64 elapsed;
+
+  if (self->estimate == 0) {
+    self->estimate = START_BITRATE;
+    self->last_update = now;
+  }
+
+  estimate = self->estimate;
+  elapsed = MIN (now - self->last_update, G_TIME_SPAN_SECOND);
+  self->last_update = now;
+
+  switch (self->state) {
+    case KMS_TRANSPORT_CC_OVERUSE:
+      if (now - self->last_decrease >= DECREASE_INTERVAL) {
+        gdouble decreased = DECREASE_FACTOR * (self->acked_bitrate > 0 ?
+            self->acked_bitrate : estimate);
+
+        estimate = MIN (estimate, decreased);
+        self->last_decrease = now;
+      }
+      break;
+    case KMS_TRANSPORT_CC_UNDERUSE:
+      /* Queues are draining, wait for them to be empty */
+      break;
+    default:
+      estimate += estimate * INCREASE_PER_SECOND * elapsed / G_TIME_SPAN_SECOND;
+
+      /* Do not go far beyond what the network has shown it can carry */
+      if (self->acked_bitrate > 0) {
+        estimate = MIN (estimate, 1.5 * self->acked_bitrate + 10000);
+      }
+      break;
+  }
+
+  if (self->fraction_lost > HIGH_LOSS &&
+      now - self->last_loss_decrease >= LOSS_INTERVAL) {
+    estimate *= 1.0 - 0.5 * self->fraction_lost;
+    self->last_loss_decrease = now;
+  }
+
+  self->estimate = CLAMP (estimate, MIN_BITRATE, MAX_BITRATE);
+}
+
+static guint32
+kms_webrtc_transport_cc_read_reference (const guint8 * data)
+{
+  return (data[0] << 16) | (data[1] << 8) | data[2];
+}
+
+/* <sender SSRC> <media SSRC> <base sequence number> <status count>
+ * <reference time> <feedback count> <chunks> <deltas> */
+static void
+kms_webrtc_transport_cc_parse_feedback (KmsWebrtcTransportCc * self,
+    const guint8 * packet, guint len, gint64 now)
+{
+  guint16 base, count, i, j;
+  guint received = 0, lost = 0;
+  guint8 *symbols;
+  gint64 arrival;
+  guint32 reference;
+  guint pos = 20;
+
+  if (len < 20) {
+    return;
+  }
+
+  base = GST_READ_UINT16_BE (packet + 12);
+  count = GST_READ_UINT16_BE (packet + 14);
+  reference = kms_webrtc_transport_cc_read_reference (packet + 16);
+
+  /* Signed 24 bits */
+  if (reference & 0x800000) {
+    arrival = ((gint64) reference - 0x1000000) * REFERENCE_UNIT;
+  } else {
+    arrival = (gint64) reference *REFERENCE_UNIT;
+  }
+
+  symbols = g_malloc0 (count);
+
+  for (i = 0; i < count && pos + 2 <= len;) {
+    guint16 chunk = GST_READ_UINT16_BE (packet + pos);
+
+    pos += 2;
+
+    if ((chunk & 0x8000) == 0) {
+      /* Run length */
+      for (j = 0; j < (chunk & 0x1fff) && i < count; j++) {
+        symbols[i++] = (chunk >> 13) & 0x03;
+      }
+    } else if ((chunk & 0x4000) == 0) {
+      /* 14 one bit symbols */
+      for (j = 0; j < 14 && i < count; j++) {
+        symbols[i++] = (chunk >> (13 - j)) & 0x01;
+      }
+    } else {
+      /* 7 two bits symbols */
+      for (j = 0; j < 7 && i < count; j++) {
+        symbols[i++] = (chunk >> (12 - 2 * j)) & 0x03;
+      }
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    guint16 seq = base + i;
+    KmsTransportCcPacket *sent = &self->history[seq & HISTORY_MASK];
+
+    if (symbols[i] == 1 && pos + 1 <= len) {
+      arrival += packet[pos] * DELTA_UNIT;
+      pos += 1;
+    } else if (symbols[i] == 2 && pos + 2 <= len) {
+      arrival += (gint16) GST_READ_UINT16_BE (packet + pos) * DELTA_UNIT;
+      pos += 2;
+    } else {
+      if (sent->sent && sent->seq == seq) {
+        lost++;
+      }
+      continue;
+    }
+
+    if (!sent->sent || sent->seq != seq) {
+      continue;
+    }
+
+    received++;
+    kms_webrtc_transport_cc_on_arrival (self, sent, arrival, now);
+  }
+
+  g_free (symbols);
+
+  self->packets_acked += received;
+  self->packets_lost += lost;
+
+  if (received + lost > 0) {
+    self->fraction_lost = 0.75 * self->fraction_lost +
+        0.25 * lost / (gdouble) (received + lost);
+  }
+
+  self->feedbacks_received++;
+  kms_webrtc_transport_cc_update_estimate (self, now);
+}
+
+/* Hands the estimate to the rest of the endpoint as if the remote peer had
+ * sent it */
+static GstMemory *
+kms_webrtc_transport_cc_create_remb (KmsWebrtcTransportCc * self,
+    guint32 sender)
+{
+  guint32 mantissa = self->estimate;
+  guint8 exp = 0, *data;
+  guint i, len;
+
+  while (mantissa > 0x3ffff) {
+    mantissa >>= 1;
+    exp++;
+  }
+
+  len = 20 + 4 * self->n_ssrcs;
+  data = g_malloc0 (len);
+
+  data[0] = 0x80 | RTCP_FMT_AFB;
+  data[1] = GST_RTCP_TYPE_PSFB;
+  GST_WRITE_UINT16_BE (data + 2, len / 4 - 1);
+  GST_WRITE_UINT32_BE (data + 4, sender);
+  memcpy (data + 12, "REMB", 4);
+  data[16] = self->n_ssrcs;
+  data[17] = (exp << 2) | ((mantissa >> 16) & 0x03);
+  GST_WRITE_UINT16_BE (data + 18, mantissa & 0xffff);
+
+  for (i = 0; i < self->n_ssrcs; i++) {
+    GST_WRITE_UINT32_BE (data + 20 + 4 * i, self->ssrcs[i]);
+  }
+
+  return gst_memory_new_wrapped (0, data, len, 0, len, data, g_free);
+}
+
+GstBuffer *
+kms_webrtc_transport_cc_process_rtcp (KmsWebrtcTransportCc * self,
+    GstBuffer * buffer, gint64 now)
+{
+  GstMemory *remb = NULL;
+  gboolean feedback = FALSE;
+  guint32 sender = 0;
+  GstMapInfo map;
+  guint offset;
+
+  if (g_atomic_int_get (&self->ext_id) == 0 ||
+      !gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    return buffer;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  for (offset = 0; offset + 4 <= map.size;) {
+    const guint8 *packet = map.data + offset;
+    guint len = (GST_READ_UINT16_BE (packet + 2) + 1) * 4;
+
+    if ((packet[0] >> 6) != 2 || offset + len > map.size) {
+      break;
+    }
+
+    if (packet[1] == GST_RTCP_TYPE_RTPFB &&
+        (packet[0] & 0x1f) == RTCP_FMT_TRANSPORT_CC && len >= 20) {
+      sender = GST_READ_UINT32_BE (packet + 4);
+      kms_webrtc_transport_cc_parse_feedback (self, packet, len, now);
+      feedback = TRUE;
+    }
+
+    offset += len;
+  }
+
+  if (feedback && self->n_ssrcs > 0 &&
+      now - self->last_remb >= REMB_INTERVAL) {
+    remb = kms_webrtc_transport_cc_create_remb (self, sender);
+    self->last_remb = now;
+  }
+
+  g_mutex_unlock (&self->mutex);
+  gst_buffer_unmap (buffer, &map);
+
+  if (remb != NULL) {
+    buffer = gst_buffer_make_writable (buffer);
+    gst_buffer_append_memory (buffer, remb);
+  }
+
+  return buffer;
+}
+
+static GstPadProbeReturn
+kms_webrtc_transport_cc_rtcp_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsWebrtcTransportCc * self)
+{
+  GST_PAD_PROBE_INFO_DATA (info) =
+      kms_webrtc_transport_cc_process_rtcp (self,
+      gst_pad_probe_info_get_buffer (info), g_get_monotonic_time ());
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Sending */
+
+void
+kms_webrtc_transport_cc_stamp (KmsWebrtcTransportCc * self, GstBuffer ** buffer,
+    gint64 now)
+{
+  guint8 id = g_atomic_int_get (&self->ext_id);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsTransportCcPacket *packet;
+  guint8 data[2];
+  gpointer ext;
+  guint ext_size;
+  guint32 ssrc;
+  guint16 seq;
+  guint i;
+
+  if (id == 0) {
+    return;
+  }
+
+  *buffer = gst_buffer_make_writable (*buffer);
+
+  if (!gst_rtp_buffer_map (*buffer, GST_MAP_READWRITE, &rtp)) {
+    return;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  seq = self->next_seq;
+  GST_WRITE_UINT16_BE (data, seq);
+
+  if (gst_rtp_buffer_get_extension_onebyte_header (&rtp, id, 0, &ext,
+          &ext_size) && ext_size == 2) {
+    /* Retransmissions get a new number */
+    memcpy (ext, data, 2);
+  } else if (!gst_rtp_buffer_add_extension_onebyte_header (&rtp, id, data, 2)) {
+    g_mutex_unlock (&self->mutex);
+    gst_rtp_buffer_unmap (&rtp);
+    return;
+  }
+
+  self->next_seq++;
+  self->packets_sent++;
+
+  packet = &self->history[seq & HISTORY_MASK];
+  packet->seq = seq;
+  packet->sent = TRUE;
+  packet->send_time = now;
+  packet->size = gst_buffer_get_size (*buffer);
+
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+
+  for (i = 0; i < self->n_ssrcs && self->ssrcs[i] != ssrc; i++);
+
+  if (i == self->n_ssrcs && self->n_ssrcs < MAX_SSRCS) {
+    self->ssrcs[self->n_ssrcs++] = ssrc;
+  }
+
+  g_mutex_unlock (&self->mutex);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static gboolean
+kms_webrtc_transport_cc_stamp_list (GstBuffer ** buffer, guint idx,
+    KmsWebrtcTransportCc * self)
+{
+  kms_webrtc_transport_cc_stamp (self, buffer, g_get_monotonic_time ());
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_webrtc_transport_cc_rtp_sink_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsWebrtcTransportCc * self)
+{
+  if (g_atomic_int_get (&self->ext_id) == 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    kms_webrtc_transport_cc_stamp (self, &buffer, g_get_monotonic_time ());
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list,
+        (GstBufferListFunc) kms_webrtc_transport_cc_stamp_list, self);
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+void
+kms_webrtc_transport_cc_watch_rtp_sink (KmsWebrtcTransportCc * self,
+    GstPad * pad)
+{
+  if (g_object_get_data (G_OBJECT (pad), PROBE_DATA) != NULL) {
+    return;
+  }
+
+  g_object_set_data (G_OBJECT (pad), PROBE_DATA, GINT_TO_POINTER (TRUE));
+
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) kms_webrtc_transport_cc_rtp_sink_probe,
+      kms_webrtc_transport_cc_ref (self),
+      (GDestroyNotify) kms_webrtc_transport_cc_unref);
+}
+
+/* Receiving */
+
+static gint
+kms_webrtc_transport_cc_compare_arrivals (const KmsTransportCcArrival * a,
+    const KmsTransportCcArrival * b)
+{
+  return a->seq < b->seq ? -1 : (a->seq > b->seq ? 1 : 0);
+}
+
+/* Must be called with the mutex held */
+static GstBuffer *
+kms_webrtc_transport_cc_create_feedback (KmsWebrtcTransportCc * self)
+{
+  KmsTransportCcArrival *arrivals;
+  GByteArray *chunks, *deltas;
+  guint8 *symbols, *data;
+  gint64 base, reference, prev;
+  guint count, len, pad, i, n;
+  guint32 sender;
+
+  g_array_sort (self->arrivals,
+      (GCompareFunc) kms_webrtc_transport_cc_compare_arrivals);
+  arrivals = (KmsTransportCcArrival *) self->arrivals->data;
+  n = self->arrivals->len;
+
+  base = arrivals[0].seq;
+  count = arrivals[n - 1].seq - base + 1;
+
+  if (count > 0xffff) {
+    return NULL;
+  }
+
+  symbols = g_malloc0 (count);
+  deltas = g_byte_array_new ();
+
+  reference = arrivals[0].time / REFERENCE_UNIT;
+  prev = reference * REFERENCE_UNIT;
+
+  for (i = 0; i < n; i++) {
+    guint index = arrivals[i].seq - base;
+    gint64 delta = (arrivals[i].time - prev) / DELTA_UNIT;
+    guint8 bytes[2];
+
+    if (symbols[index] != 0) {
+      /* Duplicated */
+      continue;
+    }
+
+    if (delta >= 0 && delta <= 0xff) {
+      symbols[index] = 1;
+      bytes[0] = delta;
+      g_byte_array_append (deltas, bytes, 1);
+    } else if (delta >= G_MININT16 && delta <= G_MAXINT16) {
+      symbols[index] = 2;
+      GST_WRITE_UINT16_BE (bytes, (gint16) delta);
+      g_byte_array_append (deltas, bytes, 2);
+    } else {
+      /* Reported as lost */
+      continue;
+    }
+
+    prev += delta * DELTA_UNIT;
+  }
+
+  /* Runs of the same symbol, 14 one bit symbols or 7 two bits ones */
+  chunks = g_byte_array_new ();
+
+  for (i = 0; i < count;) {
+    guint run, one_bit, j;
+    guint16 chunk;
+    guint8 bytes[2];
+
+    for (run = 1; i + run < count && run < 0x1fff &&
+        symbols[i + run] == symbols[i]; run++);
+    for (one_bit = 0; one_bit < 14 && i + one_bit < count &&
+        symbols[i + one_bit] < 2; one_bit++);
+
+    if (run >= 14 || (run >= 7 && one_bit < MIN (14, count - i))) {
+      chunk = (symbols[i] << 13) | run;
+      i += run;
+    } else if (one_bit == MIN (14, count - i)) {
+      chunk = 0x8000;
+
+      for (j = 0; j < one_bit; j++) {
+        chunk |= symbols[i + j] << (13 - j);
+      }
+
+      i += one_bit;
+    } else {
+      chunk = 0xc000;
+
+      for (j = 0; j < 7 && i < count; j++, i++) {
+        chunk |= symbols[i] << (12 - 2 * j);
+      }
+    }
+
+    GST_WRITE_UINT16_BE (bytes, chunk);
+    g_byte_array_append (chunks, bytes, 2);
+  }
+
+  len = 8 + 20 + chunks->len + deltas->len;
+  pad = (4 - len % 4) % 4;
+  len += pad;
+
+  data = g_malloc0 (len);
+  sender = self->n_ssrcs > 0 ? self->ssrcs[0] : 1;
+
+  /* Compound packets must start with a report, an empty one is enough */
+  data[0] = 0x80;
+  data[1] = GST_RTCP_TYPE_RR;
+  GST_WRITE_UINT16_BE (data + 2, 1);
+  GST_WRITE_UINT32_BE (data + 4, sender);
+
+  data[8] = (pad > 0 ? 0xa0 : 0x80) | RTCP_FMT_TRANSPORT_CC;
+  data[9] = GST_RTCP_TYPE_RTPFB;
+  GST_WRITE_UINT16_BE (data + 10, (len - 8) / 4 - 1);
+  GST_WRITE_UINT32_BE (data + 12, sender);
+  GST_WRITE_UINT32_BE (data + 16, self->remote_ssrc);
+  GST_WRITE_UINT16_BE (data + 20, base & 0xffff);
+  GST_WRITE_UINT16_BE (data + 22, count);
+  data[24] = (reference >> 16) & 0xff;
+  data[25] = (reference >> 8) & 0xff;
+  data[26] = reference & 0xff;
+  data[27] = self->feedback_count++;
+
+  memcpy (data + 28, chunks->data, chunks->len);
+  memcpy (data + 28 + chunks->len, deltas->data, deltas->len);
+
+  if (pad > 0) {
+    data[len - 1] = pad;
+  }
+
+  g_free (symbols);
+  g_byte_array_unref (chunks);
+  g_byte_array_unref (deltas);
+
+  return gst_buffer_new_wrapped (data, len);
+}
+
+GstBuffer *
+kms_webrtc_transport_cc_receive (KmsWebrtcTransportCc * self,
+    GstBuffer * buffer, gint64 now)
+{
+  guint8 id = g_atomic_int_get (&self->ext_id);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsTransportCcArrival arrival;
+  GstBuffer *feedback = NULL;
+  guint32 ssrc;
+  gpointer data;
+  guint size;
+  guint16 seq;
+
+  if (id == 0 || !gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    return NULL;
+  }
+
+  if (!gst_rtp_buffer_get_extension_onebyte_header (&rtp, id, 0, &data,
+          &size) || size < 2) {
+    gst_rtp_buffer_unmap (&rtp);
+    return NULL;
+  }
+
+  seq = GST_READ_UINT16_BE (data);
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  g_mutex_lock (&self->mutex);
+  self->remote_ssrc = ssrc;
+
+  if (self->last_received < 0) {
+    arrival.seq = seq;
+  } else {
+    arrival.seq = self->last_received +
+        (gint16) (seq - (guint16) self->last_received);
+  }
+
+  self->last_received = MAX (self->last_received, arrival.seq);
+  arrival.time = now;
+
+  if (self->arrivals->len < MAX_ARRIVALS) {
+    g_array_append_val (self->arrivals, arrival);
+  }
+
+  if (self->last_feedback == 0) {
+    self->last_feedback = now;
+  }
+
+  if (now - self->last_feedback >= FEEDBACK_INTERVAL) {
+    feedback = kms_webrtc_transport_cc_create_feedback (self);
+    g_array_set_size (self->arrivals, 0);
+    self->last_feedback = now;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  return feedback;
+}
+
+static void
+kms_webrtc_transport_cc_send_feedback (KmsWebrtcTransportCc * self,
+    GstBuffer * feedback)
+{
+  GstPad *feedback_pad = NULL;
+
+  g_mutex_lock (&self->mutex);
+  if (self->feedback != NULL) {
+    feedback_pad = g_object_ref (self->feedback);
+  }
+  g_mutex_unlock (&self->mutex);
+
+  if (feedback_pad == NULL) {
+    gst_buffer_unref (feedback);
+    return;
+  }
+
+  gst_pad_push (feedback_pad, feedback);
+  g_object_unref (feedback_pad);
+}
+
+static gboolean
+kms_webrtc_transport_cc_received_list (GstBuffer ** buffer, guint idx,
+    KmsWebrtcTransportCc * self)
+{
+  GstBuffer *feedback;
+
+  feedback = kms_webrtc_transport_cc_receive (self, *buffer,
+      g_get_monotonic_time ());
+
+  if (feedback != NULL) {
+    kms_webrtc_transport_cc_send_feedback (self, feedback);
+  }
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_webrtc_transport_cc_rtp_src_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsWebrtcTransportCc * self)
+{
+  GstBuffer *feedback;
+
+  if (g_atomic_int_get (&self->ext_id) == 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    feedback = kms_webrtc_transport_cc_receive (self,
+        gst_pad_probe_info_get_buffer (info), g_get_monotonic_time ());
+
+    if (feedback != NULL) {
+      kms_webrtc_transport_cc_send_feedback (self, feedback);
+    }
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach (gst_pad_probe_info_get_buffer_list (info),
+        (GstBufferListFunc) kms_webrtc_transport_cc_received_list, self);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPad *
+kms_webrtc_transport_cc_create_feedback_pad (GstPad * rtcp_sink)
+{
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *stream_id;
+  GstPad *src;
+
+  src = gst_pad_new ("transport_cc_feedback", GST_PAD_SRC);
+
+  if (gst_pad_link (src, rtcp_sink) != GST_PAD_LINK_OK) {
+    GST_WARNING_OBJECT (rtcp_sink, "Can not send transport-cc feedback");
+    g_object_unref (src);
+    return NULL;
+  }
+
+  gst_pad_set_active (src, TRUE);
+
+  /* Sticky, sent again with the first feedback if the encoder is not ready */
+  stream_id = g_strdup_printf ("transport-cc-feedback-%p", src);
+  gst_pad_push_event (src, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  caps = gst_caps_new_empty_simple ("application/x-rtcp");
+  gst_pad_push_event (src, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (src, gst_event_new_segment (&segment));
+
+  return src;
+}
+
+void
+kms_webrtc_transport_cc_watch_receiver (KmsWebrtcTransportCc * self,
+    GstPad * rtp_src, GstPad * rtcp_src, GstPad * rtcp_sink)
+{
+  if (rtcp_sink != NULL) {
+    g_mutex_lock (&self->mutex);
+    if (self->feedback == NULL) {
+      self->feedback = kms_webrtc_transport_cc_create_feedback_pad (rtcp_sink);
+    }
+    g_mutex_unlock (&self->mutex);
+  }
+
+  if (rtp_src != NULL) {
+    gst_pad_add_probe (rtp_src,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+        (GstPadProbeCallback) kms_webrtc_transport_cc_rtp_src_probe,
+        kms_webrtc_transport_cc_ref (self),
+        (GDestroyNotify) kms_webrtc_transport_cc_unref);
+  }
+
+  if (rtcp_src != NULL) {
+    gst_pad_add_probe (rtcp_src, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) kms_webrtc_transport_cc_rtcp_probe,
+        kms_webrtc_transport_cc_ref (self),
+        (GDestroyNotify) kms_webrtc_transport_cc_unref);
+  }
+}
+
+guint
+kms_webrtc_transport_cc_get_estimate (KmsWebrtcTransportCc * self)
+{
+  guint estimate;
+
+  g_mutex_lock (&self->mutex);
+  estimate = self->feedbacks_received > 0 ? self->estimate : 0;
+  g_mutex_unlock (&self->mutex);
+
+  return estimate;
+}
+
+void
+kms_webrtc_transport_cc_add_stats (KmsWebrtcTransportCc * self,
+    GstStructure * stats, const gchar * name)
+{
+  GstStructure *cc_stats;
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->feedbacks_received == 0) {
+    g_mutex_unlock (&self->mutex);
+    return;
+  }
+
+  cc_stats = gst_structure_new (name,
+      "estimated-bitrate", G_TYPE_UINT, self->estimate,
+      "acked-bitrate", G_TYPE_UINT, self->acked_bitrate,
+      "fraction-lost", G_TYPE_DOUBLE, self->fraction_lost,
+      "overusing", G_TYPE_BOOLEAN, self->state == KMS_TRANSPORT_CC_OVERUSE,
+      "packets-sent", G_TYPE_UINT64, self->packets_sent,
+      "packets-acked", G_TYPE_UINT64, self->packets_acked,
+      "packets-lost", G_TYPE_UINT64, self->packets_lost,
+      "feedback-packets", G_TYPE_UINT64, self->feedbacks_received, NULL);
+
+  g_mutex_unlock (&self->mutex);
+
+  gst_structure_set (stats, name, GST_TYPE_STRUCTURE, cc_stats, NULL);
+  gst_structure_free (cc_stats);
+}
@@ -0,0 +1,99 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_WEBRTC_TRANSPORT_CC_H__
+#define __KMS_WEBRTC_TRANSPORT_CC_H__
+
+#include <gst/gst.h>
+#include <gst/sdp/gstsdpmessage.h>
+
+G_BEGIN_DECLS
+
+/* Transport-wide sequence number header extension */
+#define KMS_WEBRTC_TRANSPORT_CC_EXT_URI \
+  "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+#define KMS_WEBRTC_TRANSPORT_CC_EXT_ID 5
+
+#define KMS_WEBRTC_TRANSPORT_CC_STATS_FIELD "transport-cc-stats"
+
+/*
+ * Transport-wide congestion control of a WebRTC transport.
+ *
+ * Sending: every outgoing RTP packet is stamped with a transport-wide
+ * sequence number before being encrypted, and the feedback of the remote
+ * peer tells when each one arrived. A delay-based estimator (delay gradient
+ * trendline, adaptive overuse threshold and AIMD rate control, bounded by
+ * the losses reported) turns that into an available bitrate. The estimate
+ * is handed to the rest of the endpoint as a REMB added to the incoming
+ * RTCP, so it drives the encoders the same way a receiver estimate does.
+ *
+ * Receiving: the arrival time of the stamped packets of the remote peer is
+ * reported back every 100 ms, so that its own estimator can work.
+ */
+typedef struct _KmsWebrtcTransportCc KmsWebrtcTransportCc;
+
+KmsWebrtcTransportCc *kms_webrtc_transport_cc_new (void);
+KmsWebrtcTransportCc *kms_webrtc_transport_cc_ref (KmsWebrtcTransportCc * self);
+void kms_webrtc_transport_cc_unref (KmsWebrtcTransportCc * self);
+
+/* Id of the extension declared in @media, 0 when it is not used */
+guint8 kms_webrtc_transport_cc_get_ext_id (const GstSDPMedia * media);
+
+/* Adds the transport-cc feedback to the formats of @local_media. Answers
+ * only get it for the formats the remote offer has it */
+void kms_webrtc_transport_cc_configure_media (const GstSDPMessage *
+    remote_sdp, GstSDPMedia * local_media);
+
+/* Stamping and feedback start once the negotiated id is known. 0 stops it */
+void kms_webrtc_transport_cc_set_ext_id (KmsWebrtcTransportCc * self,
+    guint8 id);
+
+/* Stamps the RTP packets going through @pad, which must link to the SRTP
+ * encoder */
+void kms_webrtc_transport_cc_watch_rtp_sink (KmsWebrtcTransportCc * self,
+    GstPad * pad);
+
+/* Records the arrival of the packets going out of @rtp_src and reads the
+ * feedback going out of @rtcp_src, both decrypted. Feedback for the remote
+ * peer is pushed to @rtcp_sink */
+void kms_webrtc_transport_cc_watch_receiver (KmsWebrtcTransportCc * self,
+    GstPad * rtp_src, GstPad * rtcp_src, GstPad * rtcp_sink);
+
+/* What the probes do for each packet, @now being the monotonic time in us */
+
+/* Stamps the outgoing RTP @buffer, if the extension is negotiated */
+void kms_webrtc_transport_cc_stamp (KmsWebrtcTransportCc * self,
+    GstBuffer ** buffer, gint64 now);
+
+/* Records the arrival of the incoming RTP @buffer. Returns the feedback for
+ * the remote peer when it is due, NULL otherwise */
+GstBuffer *kms_webrtc_transport_cc_receive (KmsWebrtcTransportCc * self,
+    GstBuffer * buffer, gint64 now);
+
+/* Reads the feedback in the incoming RTCP @buffer. Returns it with a REMB
+ * carrying the estimate appended when one is due */
+GstBuffer *kms_webrtc_transport_cc_process_rtcp (KmsWebrtcTransportCc * self,
+    GstBuffer * buffer, gint64 now);
+
+/* Current estimate in bps, 0 before the first feedback */
+guint kms_webrtc_transport_cc_get_estimate (KmsWebrtcTransportCc * self);
+
+/* Adds a structure named @name to @stats, if feedback has been received */
+void kms_webrtc_transport_cc_add_stats (KmsWebrtcTransportCc * self,
+    GstStructure * stats, const gchar * name);
+
+G_END_DECLS
+#endif /* __KMS_WEBRTC_TRANSPORT_CC_H__ */
@@ -36,6 +36,26 @@ static void
 kms_webrtc_transport_sink_init (KmsWebrtcTransportSink * self)
 {
   self->dtlssrtpenc = gst_element_factory_make ("dtlssrtpenc", NULL);
+  self->transport_cc = kms_webrtc_transport_cc_new ();
+}
+
+static void
+kms_webrtc_transport_sink_finalize (GObject * object)
+{
+  KmsWebrtcTransportSink *self = KMS_WEBRTC_TRANSPORT_SINK (object);
+
+  kms_webrtc_transport_cc_unref (self->transport_cc);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_webrtc_transport_sink_pad_added (GstElement * dtlssrtpenc, GstPad * pad,
+    KmsWebrtcTransportSink * self)
+{
+  if (g_str_has_prefix (GST_OBJECT_NAME (pad), "rtp_sink")) {
+    kms_webrtc_transport_cc_watch_rtp_sink (self->transport_cc, pad);
+  }
 }
 
 void
@@ -46,6 +66,9 @@ kms_webrtc_transport_sink_connect_elements (KmsWebrtcTransportSink * self)
   gst_bin_add_many (GST_BIN (self), self->dtlssrtpenc, self->sink, NULL);
   gst_element_link (self->dtlssrtpenc, self->sink);
 
+  g_signal_connect (self->dtlssrtpenc, "pad-added",
+      G_CALLBACK (kms_webrtc_transport_sink_pad_added), self);
+
   funnel = gst_bin_get_by_name (GST_BIN (self->dtlssrtpenc), FUNNEL_NAME);
   if (funnel != NULL) {
     g_object_set (funnel, "forward-sticky-events-mode", 0 /* never */ , NULL);
@@ -90,8 +113,11 @@ kms_webrtc_transport_sink_configure (KmsWebrtcTransportSink * self,
 static void
 kms_webrtc_transport_sink_class_init (KmsWebrtcTransportSinkClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
 
+  gobject_class->finalize = kms_webrtc_transport_sink_finalize;
+
   klass->configure = kms_webrtc_transport_sink_configure_default;
 
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
@@ -20,6 +20,7 @@
 
 #include <gst/gst.h>
 #include "kmsicebaseagent.h"
+#include "kmswebrtctransportcc.h"
 
 G_BEGIN_DECLS
 /* #defines don't like whitespacey bits */
@@ -44,6 +45,9 @@ struct _KmsWebrtcTransportSink
 
   GstElement *dtlssrtpenc;
   GstElement *sink;
+
+  /* Stamps the RTP going into dtlssrtpenc */
+  KmsWebrtcTransportCc *transport_cc;
 };
 
 struct _KmsWebrtcTransportSinkClass
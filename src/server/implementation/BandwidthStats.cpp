@@ -0,0 +1,71 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "BandwidthStats.hpp"
+#include "BandwidthEstimation.hpp"
+#include "StatsType.hpp"
+#include <commons/kmsutils.h>
+#include <webrtcendpoint/kmswebrtctransportcc.h>
+
+namespace kurento
+{
+
+void
+fillBandwidthEstimationReport (std::map <std::string, std::shared_ptr<Stats>>
+                               &report, const std::string &prefix,
+                               const GstStructure *stats, double timestamp,
+                               int64_t timestampMillis)
+{
+  const GstStructure *estimations;
+  gint i, n;
+
+  estimations = kms_utils_get_structure_by_name (stats,
+                KMS_WEBRTC_TRANSPORT_CC_STATS_FIELD);
+
+  if (estimations == nullptr) {
+    return;
+  }
+
+  n = gst_structure_n_fields (estimations);
+
+  for (i = 0; i < n; i++) {
+    const gchar *name = gst_structure_nth_field_name (estimations, i);
+    const GValue *value = gst_structure_get_value (estimations, name);
+    const GstStructure *conn;
+    guint estimated = 0, acked = 0;
+    guint64 feedbacks = 0;
+    gdouble lost = 0.0;
+    std::string id;
+
+    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
+      continue;
+    }
+
+    conn = gst_value_get_structure (value);
+    gst_structure_get (conn, "estimated-bitrate", G_TYPE_UINT, &estimated,
+                       "acked-bitrate", G_TYPE_UINT, &acked,
+                       "fraction-lost", G_TYPE_DOUBLE, &lost,
+                       "feedback-packets", G_TYPE_UINT64, &feedbacks, NULL);
+
+    id = prefix + name;
+    report[id] = std::make_shared <BandwidthEstimation> (id,
+                 std::make_shared <StatsType> (StatsType::transport), timestamp,
+                 timestampMillis, name, estimated, acked, lost, feedbacks);
+  }
+}
+
+} /* kurento */
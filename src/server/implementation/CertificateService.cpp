@@ -0,0 +1,369 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "CertificateService.hpp"
+#include "CertificateManager.hpp"
+#include <gst/gst.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+
+#define GST_CAT_DEFAULT kurento_certificate_service
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoCertificateService"
+
+#define FAILURE_RETRY_INTERVAL std::chrono::seconds (1)
+
+namespace kurento
+{
+
+CertificateService &
+CertificateService::getInstance ()
+{
+  static CertificateService instance;
+
+  return instance;
+}
+
+CertificateService::CertificateService () : rotationInterval (0)
+{
+  /* May be used from the static constructors of other files */
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+
+  rsa.type = KeyType::RSA;
+  rsa.name = "rsa";
+  ecdsa.type = KeyType::ECDSA;
+  ecdsa.name = "ecdsa";
+}
+
+CertificateService::~CertificateService ()
+{
+  stop ();
+}
+
+void
+CertificateService::start ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+
+  if (running || !configured) {
+    return;
+  }
+
+  running = true;
+  thread = std::thread (&CertificateService::run, this);
+}
+
+void
+CertificateService::stop ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+
+  if (!running) {
+    return;
+  }
+
+  running = false;
+  workCond.notify_all ();
+  readyCond.notify_all ();
+  lock.unlock ();
+
+  if (thread.joinable () ) {
+    thread.join ();
+  }
+}
+
+void
+CertificateService::configure (const std::string &cacheDir,
+                               std::chrono::seconds rotationInterval, unsigned int poolSize)
+{
+  std::unique_lock<std::mutex> lock (mutex);
+
+  if (configured) {
+    if (cacheDir != this->cacheDir || rotationInterval != this->rotationInterval
+        || poolSize != this->poolSize) {
+      GST_WARNING ("Certificate service already started with other settings,"
+                   " ignoring cache: '%s', rotation interval: %lds, pool size: %u",
+                   cacheDir.c_str (), (long) rotationInterval.count (), poolSize);
+    }
+
+    return;
+  }
+
+  GST_INFO ("Certificate cache: '%s', rotation interval: %lds, pool size: %u",
+            cacheDir.c_str (), (long) rotationInterval.count (), poolSize);
+
+  this->cacheDir = cacheDir;
+  this->rotationInterval = rotationInterval;
+  this->poolSize = poolSize;
+  configured = true;
+  lock.unlock ();
+
+  /* Started here, so that the first certificates already come from the
+   * cache when there is one */
+  start ();
+}
+
+std::string
+CertificateService::getCertificate (KeyType type)
+{
+  std::unique_lock<std::mutex> lock (mutex);
+  Entry &entry = (type == KeyType::RSA) ? rsa : ecdsa;
+
+  if (!entry.pool.empty () ) {
+    std::string certificate = entry.pool.front ();
+
+    entry.pool.pop_front ();
+    workCond.notify_all ();
+
+    return certificate;
+  }
+
+  if (!running) {
+    lock.unlock ();
+    GST_WARNING ("Service not running, generating %s certificate", entry.name);
+    return generate (type);
+  }
+
+  readyCond.wait (lock, [&] () {
+    return !entry.certificate.empty () || entry.failed || !running;
+  });
+
+  return entry.certificate;
+}
+
+bool
+CertificateService::needsWork (const Entry &entry) const
+{
+  if (entry.certificate.empty () ) {
+    return true;
+  }
+
+  if (!cacheDir.empty () && !entry.cacheSynced) {
+    return true;
+  }
+
+  if (rotationInterval.count () > 0 && !entry.certificate.empty ()
+      && std::chrono::system_clock::now () - entry.created >= rotationInterval) {
+    return true;
+  }
+
+  return entry.pool.size () < poolSize;
+}
+
+void
+CertificateService::refresh (Entry &entry, std::unique_lock<std::mutex> &lock)
+{
+  bool isDefault;
+  std::string certificate;
+
+  if (!cacheDir.empty () && !entry.cacheSynced) {
+    entry.cacheSynced = true;
+
+    if (loadFromCache (entry) ) {
+      entry.failed = false;
+      readyCond.notify_all ();
+      return;
+    }
+
+    if (!entry.certificate.empty () ) {
+      saveToCache (entry);
+      return;
+    }
+  }
+
+  isDefault = entry.certificate.empty () || (rotationInterval.count () > 0
+              && std::chrono::system_clock::now () - entry.created >= rotationInterval);
+
+  lock.unlock ();
+  GST_DEBUG ("Generating %s certificate (%s)", entry.name,
+             isDefault ? "default" : "pool");
+  certificate = generate (entry.type);
+  lock.lock ();
+
+  if (certificate.empty () ) {
+    GST_ERROR ("Cannot generate %s certificate", entry.name);
+    entry.failed = true;
+    readyCond.notify_all ();
+    workCond.wait_for (lock, FAILURE_RETRY_INTERVAL);
+    return;
+  }
+
+  if (!isDefault) {
+    entry.pool.push_back (certificate);
+    return;
+  }
+
+  entry.certificate = certificate;
+  entry.created = std::chrono::system_clock::now ();
+  entry.failed = false;
+
+  if (!cacheDir.empty () ) {
+    entry.cacheSynced = true;
+    saveToCache (entry);
+  }
+
+  readyCond.notify_all ();
+}
+
+void
+CertificateService::run ()
+{
+  std::unique_lock<std::mutex> lock (mutex);
+
+  GST_DEBUG ("Certificate service started");
+
+  while (running) {
+    if (needsWork (rsa) ) {
+      refresh (rsa, lock);
+      continue;
+    }
+
+    if (needsWork (ecdsa) ) {
+      refresh (ecdsa, lock);
+      continue;
+    }
+
+    if (rotationInterval.count () > 0) {
+      auto deadline = std::min (rsa.created, ecdsa.created) + rotationInterval;
+
+      workCond.wait_until (lock, deadline);
+    } else {
+      workCond.wait (lock);
+    }
+  }
+
+  GST_DEBUG ("Certificate service stopped");
+}
+
+std::string
+CertificateService::cacheFile (const Entry &entry) const
+{
+  return cacheDir + "/dtls-" + entry.name + ".pem";
+}
+
+bool
+CertificateService::loadFromCache (Entry &entry)
+{
+  boost::system::error_code ec;
+  std::string path = cacheFile (entry);
+  std::chrono::system_clock::time_point modified;
+  std::ifstream inFile;
+  std::stringstream strStream;
+  std::time_t mtime;
+
+  mtime = boost::filesystem::last_write_time (path, ec);
+
+  if (ec) {
+    GST_DEBUG ("No cached %s certificate in %s", entry.name, path.c_str () );
+    return false;
+  }
+
+  modified = std::chrono::system_clock::from_time_t (mtime);
+
+  if (rotationInterval.count () > 0
+      && std::chrono::system_clock::now () - modified >= rotationInterval) {
+    GST_INFO ("Cached %s certificate %s has expired", entry.name, path.c_str () );
+    return false;
+  }
+
+  inFile.open (path);
+  strStream << inFile.rdbuf ();
+
+  if (!CertificateManager::isCertificateValid (strStream.str () ) ) {
+    GST_WARNING ("Cached %s certificate %s is not valid", entry.name,
+                 path.c_str () );
+    return false;
+  }
+
+  GST_INFO ("Using cached %s certificate %s", entry.name, path.c_str () );
+  entry.certificate = strStream.str ();
+  entry.created = modified;
+
+  return true;
+}
+
+void
+CertificateService::saveToCache (const Entry &entry)
+{
+  boost::system::error_code ec;
+  std::string path = cacheFile (entry);
+  std::string tmpPath = path + ".tmp";
+  std::ofstream outFile;
+
+  boost::filesystem::create_directories (cacheDir, ec);
+
+  if (ec) {
+    GST_ERROR ("Cannot create certificate cache directory %s: %s",
+               cacheDir.c_str (), ec.message ().c_str () );
+    return;
+  }
+
+  outFile.open (tmpPath, std::ios::out | std::ios::trunc);
+
+  if (!outFile) {
+    GST_ERROR ("Cannot write certificate cache file %s", tmpPath.c_str () );
+    return;
+  }
+
+  /* The file contains a private key, keep it away from other users */
+  boost::filesystem::permissions (tmpPath, boost::filesystem::owner_read |
+                                  boost::filesystem::owner_write, ec);
+  outFile << entry.certificate;
+  outFile.close ();
+
+  if (!outFile) {
+    GST_ERROR ("Cannot write certificate cache file %s", tmpPath.c_str () );
+    boost::filesystem::remove (tmpPath, ec);
+    return;
+  }
+
+  boost::filesystem::rename (tmpPath, path, ec);
+
+  if (ec) {
+    GST_ERROR ("Cannot rename %s: %s", tmpPath.c_str (), ec.message ().c_str () );
+    boost::filesystem::remove (tmpPath, ec);
+    return;
+  }
+
+  GST_INFO ("Cached %s certificate in %s", entry.name, path.c_str () );
+}
+
+std::string
+CertificateService::generate (KeyType type)
+{
+  switch (type) {
+  case KeyType::RSA:
+    return CertificateManager::generateRSACertificate ();
+
+  case KeyType::ECDSA:
+    return CertificateManager::generateECDSACertificate ();
+  }
+
+  return "";
+}
+
+CertificateService::StaticConstructor CertificateService::staticConstructor;
+
+CertificateService::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef __CERTIFICATE_SERVICE_HPP__
+#define __CERTIFICATE_SERVICE_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace kurento
+{
+
+/*
+ * Generates DTLS certificates in a background thread so that creating a
+ * WebRtcEndpoint never waits for RSA/ECDSA key generation.
+ *
+ * One default certificate per key type is shared by all the endpoints. It is
+ * optionally persisted in a cache directory, so that a restarted process can
+ * reuse it, and regenerated once the rotation interval has elapsed. When a
+ * pool size is configured, a few extra certificates are kept ready so that
+ * endpoints can get a distinct certificate without blocking.
+ */
+class CertificateService
+{
+public:
+  enum class KeyType {
+    RSA,
+    ECDSA
+  };
+
+  static CertificateService &getInstance ();
+
+  /* Starts the background generation, once configured. Safe to call several
+   * times */
+  void start ();
+  void stop ();
+
+  /* Applies the configuration and starts the background generation. Only the
+   * first call has any effect */
+  void configure (const std::string &cacheDir,
+                  std::chrono::seconds rotationInterval, unsigned int poolSize);
+
+  /* Returns a pooled certificate if there is one available, or the default
+   * certificate otherwise. Only blocks if the default one is not ready yet */
+  std::string getCertificate (KeyType type);
+
+  ~CertificateService ();
+
+private:
+  struct Entry {
+    KeyType type;
+    const char *name;
+    std::string certificate;
+    std::chrono::system_clock::time_point created;
+    std::deque<std::string> pool;
+    bool failed = false;
+    bool cacheSynced = false;
+  };
+
+  CertificateService ();
+
+  void run ();
+  bool needsWork (const Entry &entry) const;
+  void refresh (Entry &entry, std::unique_lock<std::mutex> &lock);
+  bool loadFromCache (Entry &entry);
+  void saveToCache (const Entry &entry);
+  std::string cacheFile (const Entry &entry) const;
+  static std::string generate (KeyType type);
+
+  Entry rsa;
+  Entry ecdsa;
+
+  std::string cacheDir;
+  std::chrono::seconds rotationInterval;
+  unsigned int poolSize = 0;
+  bool configured = false;
+
+  bool running = false;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable workCond;
+  std::condition_variable readyCond;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+}
+
+#endif /* __CERTIFICATE_SERVICE_HPP__ */
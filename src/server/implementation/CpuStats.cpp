@@ -0,0 +1,53 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "CpuStats.hpp"
+#include "ElementCpuStats.hpp"
+#include "StatsType.hpp"
+#include <commons/kmsutils.h>
+#include <kmsthreadcpu.h>
+
+namespace kurento
+{
+
+void
+fillCpuStatsReport (std::map <std::string, std::shared_ptr<Stats>> &report,
+                    const std::string &id, const GstStructure *stats,
+                    double timestamp, int64_t timestampMillis)
+{
+  const GstStructure *cpu_stats;
+  guint64 cpuTime = 0;
+  gdouble cpuUsage = 0.0;
+  guint threads = 0;
+
+  cpu_stats = kms_utils_get_structure_by_name (stats,
+              KMS_THREAD_CPU_STATS_FIELD);
+
+  if (cpu_stats == nullptr) {
+    return;
+  }
+
+  gst_structure_get (cpu_stats, "cpu-time", G_TYPE_UINT64, &cpuTime,
+                     "cpu-usage", G_TYPE_DOUBLE, &cpuUsage,
+                     "threads", G_TYPE_UINT, &threads, NULL);
+
+  report[id] = std::make_shared <ElementCpuStats> (id,
+               std::make_shared <StatsType> (StatsType::element), timestamp,
+               timestampMillis, cpuTime, cpuUsage, threads);
+}
+
+} /* kurento */
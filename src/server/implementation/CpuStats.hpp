@@ -0,0 +1,43 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef __CPU_STATS_HPP__
+#define __CPU_STATS_HPP__
+
+#include <gst/gst.h>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace kurento
+{
+
+class Stats;
+
+/*
+ * Adds an ElementCpuStats entry, identified by @id, when the element reported
+ * the CPU used by its streaming threads.
+ */
+void fillCpuStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+                         &report, const std::string &id,
+                         const GstStructure *stats, double timestamp,
+                         int64_t timestampMillis);
+
+} /* kurento */
+
+#endif /* __CPU_STATS_HPP__ */
@@ -25,6 +25,7 @@
 
 #include "KmsHttpEPServer.h"
 #include "KmsHttpPost.h"
+#include "KmsHttpRing.h"
 #include "http-enumtypes.h"
 #include "http-marshal.h"
 
@@ -62,11 +63,23 @@ G_DEFINE_QUARK (KEY_PARAM_POST_CONTROLLER, key_param_post_controller)
 #define KEY_PARAM_TIMEOUT "kms-param-timeout"
 G_DEFINE_QUARK (KEY_PARAM_TIMEOUT, key_param_timeout)
 
+#define KEY_GET_STREAM "kms-get-stream"
+G_DEFINE_QUARK (KEY_GET_STREAM, key_get_stream)
+
 #define GST_CAT_DEFAULT kms_http_ep_server_debug_category
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define RESOLV_TIMEOUT 5000 /* 5 seconds */
 
+/* Chunks queued in a GET response that have not been written yet. A client
+ * that does not read fast enough stops getting new chunks and falls behind in
+ * the ring instead of making the server buffer data for it */
+#define GET_CLIENT_MAX_PENDING_CHUNKS 64
+
+/* Times a slow client can be moved ahead to the last keyframe before it is
+ * disconnected */
+#define GET_CLIENT_MAX_SKIPS 3
+
 #define KMS_HTTP_EP_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), KMS_TYPE_HTTP_EP_SERVER, KmsHttpEPServerPrivate))
 struct _KmsHttpEPServerPrivate {
   GHashTable *handlers;
@@ -77,6 +90,11 @@ struct _KmsHttpEPServerPrivate {
   gint port;
   GRand *rand;
   KmsLoop *loop;
+
+  /* Registrations waiting to be processed by the loop */
+  GMutex pending_mutex;
+  GQueue *pending_registrations;
+  gboolean registrations_scheduled;
 };
 
 static GType http_t = G_TYPE_INVALID;
@@ -121,6 +139,30 @@ enum {
 
 static guint obj_signals[LAST_SIGNAL] = { 0 };
 
+/* Muxed media of a GET end point, shared by all its clients */
+struct get_stream {
+  gint ref;
+  KmsHttpEPServer *server;
+  KmsLoop *loop;
+  GstElement *httpep;
+  KmsHttpRing *ring;
+  GSList *clients;
+  gulong chunk_handler_id;
+  gint flush_scheduled;
+  gboolean closed;
+};
+
+struct get_client {
+  struct get_stream *stream;
+  SoupMessage *msg;
+  KmsHttpRingCursor *cursor;
+  gulong wrote_chunk_handler_id;
+  gulong finished_handler_id;
+  guint pending;
+  guint skips;
+  gboolean dropped;
+};
+
 struct tmp_data {
   KmsHttpEPServerNotifyCallback cb;
   GDestroyNotify notify;
@@ -430,7 +472,7 @@ uninstall_http_post_signals (GstElement *httpep)
 static void
 add_access_control_headers (SoupMessage *msg)
 {
-  soup_message_headers_append (msg->response_headers, "Allow", "POST");
+  soup_message_headers_append (msg->response_headers, "Allow", "GET, POST");
 
   /* We allow access from all domains. This is generally not appropriate */
   /* TODO: Provide a configuration file containing all allowed domains */
@@ -461,6 +503,260 @@ kms_http_ep_server_post_handler (KmsHttpEPServer *self, SoupMessage *msg,
   g_object_set (G_OBJECT (post_obj), "soup-message", msg, NULL);
 }
 
+static struct get_stream *
+get_stream_ref (struct get_stream *stream)
+{
+  g_atomic_int_inc (&stream->ref);
+
+  return stream;
+}
+
+static void
+get_stream_unref (struct get_stream *stream)
+{
+  if (!g_atomic_int_dec_and_test (&stream->ref) ) {
+    return;
+  }
+
+  kms_http_ring_unref (stream->ring);
+  g_object_unref (stream->loop);
+  g_slice_free (struct get_stream, stream);
+}
+
+static void
+get_client_destroy (struct get_client *client)
+{
+  g_signal_handler_disconnect (client->msg, client->wrote_chunk_handler_id);
+  g_signal_handler_disconnect (client->msg, client->finished_handler_id);
+  kms_http_ring_cursor_free (client->cursor);
+  g_object_unref (client->msg);
+  g_slice_free (struct get_client, client);
+}
+
+static void
+get_client_flush (struct get_client *client)
+{
+  KmsHttpEPServer *self = client->stream->server;
+  gboolean wake_up = FALSE;
+
+  while (!client->dropped && client->pending < GET_CLIENT_MAX_PENDING_CHUNKS) {
+    KmsHttpChunk *chunk;
+    SoupBuffer *buffer;
+    gboolean skipped;
+
+    chunk = kms_http_ring_cursor_next (client->cursor, &skipped);
+
+    if (skipped && ++client->skips > GET_CLIENT_MAX_SKIPS) {
+      GST_WARNING ("Client %p is too slow, disconnecting it",
+                   (gpointer) client->msg);
+      client->dropped = TRUE;
+      soup_message_body_complete (client->msg->response_body);
+      wake_up = TRUE;
+
+      if (chunk != nullptr) {
+        kms_http_chunk_unref (chunk);
+      }
+
+      break;
+    }
+
+    if (chunk == nullptr) {
+      break;
+    }
+
+    if (kms_http_chunk_get_size (chunk) == 0) {
+      /* An empty chunk would end the chunked response */
+      kms_http_chunk_unref (chunk);
+      continue;
+    }
+
+    /* The response references the chunk, muxed data is never copied */
+    buffer = soup_buffer_new_with_owner (kms_http_chunk_get_data (chunk),
+                                         kms_http_chunk_get_size (chunk), chunk,
+                                         (GDestroyNotify) kms_http_chunk_unref);
+    soup_message_body_append_buffer (client->msg->response_body, buffer);
+    soup_buffer_free (buffer);
+
+    client->pending++;
+    wake_up = TRUE;
+  }
+
+  if (wake_up) {
+    soup_server_unpause_message (self->priv->server, client->msg);
+  }
+}
+
+static void
+get_client_wrote_chunk_cb (SoupMessage *msg, gpointer data)
+{
+  struct get_client *client = (struct get_client *) data;
+
+  if (client->pending > 0) {
+    client->pending--;
+  }
+
+  get_client_flush (client);
+}
+
+static void
+get_client_finished_cb (SoupMessage *msg, gpointer data)
+{
+  struct get_client *client = (struct get_client *) data;
+  struct get_stream *stream = client->stream;
+
+  GST_DEBUG ("GET request %p finished", (gpointer) msg);
+
+  stream->clients = g_slist_remove (stream->clients, client);
+  get_client_destroy (client);
+
+  if (stream->clients != nullptr) {
+    return;
+  }
+
+  /* Nobody is watching, stop muxing until next client comes */
+  g_object_set (G_OBJECT (stream->httpep), "start", FALSE, NULL);
+  kms_http_ring_clear (stream->ring);
+
+  emit_expiration_signal (msg, stream->httpep);
+}
+
+static gboolean
+get_stream_flush_cb (struct get_stream *stream)
+{
+  g_atomic_int_set (&stream->flush_scheduled, FALSE);
+
+  if (!stream->closed) {
+    g_slist_foreach (stream->clients, (GFunc) get_client_flush, nullptr);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+get_stream_new_chunk_cb (GstElement *httpep, GstBuffer *buffer, gpointer data)
+{
+  struct get_stream *stream = (struct get_stream *) data;
+
+  /* Called from the streaming thread, clients are only fed from the loop */
+  kms_http_ring_push (stream->ring, buffer);
+
+  if (g_atomic_int_compare_and_exchange (&stream->flush_scheduled, FALSE,
+                                         TRUE) ) {
+    kms_loop_idle_add_full (stream->loop, G_PRIORITY_DEFAULT,
+                            (GSourceFunc) get_stream_flush_cb,
+                            get_stream_ref (stream),
+                            (GDestroyNotify) get_stream_unref);
+  }
+}
+
+static void
+get_stream_close (struct get_stream *stream)
+{
+  stream->closed = TRUE;
+
+  g_signal_handler_disconnect (stream->httpep, stream->chunk_handler_id);
+
+  while (stream->clients != nullptr) {
+    struct get_client *client = (struct get_client *) stream->clients->data;
+
+    stream->clients = g_slist_delete_link (stream->clients, stream->clients);
+
+    soup_message_body_complete (client->msg->response_body);
+    soup_server_unpause_message (stream->server->priv->server, client->msg);
+    get_client_destroy (client);
+  }
+
+  g_object_set (G_OBJECT (stream->httpep), "start", FALSE, NULL);
+
+  get_stream_unref (stream);
+}
+
+static struct get_stream *
+get_stream_new (KmsHttpEPServer *self, GstElement *httpep)
+{
+  struct get_stream *stream = g_slice_new0 (struct get_stream);
+
+  stream->ref = 1;
+  stream->server = self;
+  stream->loop = (KmsLoop *) g_object_ref (self->priv->loop);
+  stream->httpep = httpep;
+  stream->ring = kms_http_ring_new (KMS_HTTP_RING_DEFAULT_MAX_CHUNKS,
+                                    KMS_HTTP_RING_DEFAULT_MAX_BYTES);
+  stream->chunk_handler_id = g_signal_connect_data (httpep, "new-chunk",
+                             G_CALLBACK (get_stream_new_chunk_cb),
+                             get_stream_ref (stream),
+                             (GClosureNotify) get_stream_unref, (GConnectFlags) 0);
+
+  return stream;
+}
+
+static gboolean
+kms_http_ep_server_get_handler (KmsHttpEPServer *self, SoupMessage *msg,
+                                GstElement *httpep)
+{
+  struct get_stream *stream;
+  struct get_client *client;
+  gchar *content_type = nullptr;
+  gboolean first;
+
+  if (g_signal_lookup ("new-chunk", G_OBJECT_TYPE (httpep) ) == 0) {
+    /* Not a GET end point */
+    return FALSE;
+  }
+
+  stream = (struct get_stream *) g_object_get_qdata (G_OBJECT (httpep),
+           key_get_stream_quark () );
+
+  if (stream == nullptr) {
+    stream = get_stream_new (self, httpep);
+    g_object_set_qdata_full (G_OBJECT (httpep), key_get_stream_quark (), stream,
+                             (GDestroyNotify) get_stream_close);
+  }
+
+  g_object_get (G_OBJECT (httpep), "content-type", &content_type, NULL);
+
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_headers_set_encoding (msg->response_headers,
+                                     SOUP_ENCODING_CHUNKED);
+
+  if (content_type != nullptr) {
+    soup_message_headers_set_content_type (msg->response_headers,
+                                           content_type, nullptr);
+    g_free (content_type);
+  }
+
+  soup_message_headers_append (msg->response_headers, "Cache-Control",
+                               "no-cache");
+  add_access_control_headers (msg);
+
+  /* Chunks are released as soon as they are written */
+  soup_message_body_set_accumulate (msg->response_body, FALSE);
+
+  client = g_slice_new0 (struct get_client);
+  client->stream = stream;
+  client->msg = SOUP_MESSAGE (g_object_ref (msg) );
+  client->cursor = kms_http_ring_cursor_new (stream->ring);
+  client->wrote_chunk_handler_id = g_signal_connect (msg, "wrote-chunk",
+                                   G_CALLBACK (get_client_wrote_chunk_cb), client);
+  client->finished_handler_id = g_signal_connect (msg, "finished",
+                                G_CALLBACK (get_client_finished_cb), client);
+
+  first = stream->clients == nullptr;
+  stream->clients = g_slist_prepend (stream->clients, client);
+
+  GST_DEBUG ("New GET client %p, %u clients", (gpointer) msg,
+             g_slist_length (stream->clients) );
+
+  if (first) {
+    /* Media is muxed only once, no matter how many clients are connected */
+    g_object_set (G_OBJECT (httpep), "start", TRUE, NULL);
+  }
+
+  get_client_flush (client);
+
+  return TRUE;
+}
+
 static void
 emit_removed_url_signal (KmsHttpEPServer *self, gchar *uri)
 {
@@ -476,6 +772,10 @@ kms_http_ep_server_clean_http_end_point (KmsHttpEPServer *self,
 
   kms_http_ep_server_remove_timeout (self, httpep);
 
+  /* Disconnect all the GET clients */
+  g_object_set_qdata_full (G_OBJECT (httpep), key_get_stream_quark (), nullptr,
+                           nullptr);
+
   /* Cancel current transtacion */
   g_object_set_qdata_full(G_OBJECT(httpep), key_message_quark(), nullptr,
                           nullptr);
@@ -749,7 +1049,9 @@ kms_http_ep_server_manage_cookie_session (KmsHttpEPServer *self,
 
   g_object_get (G_OBJECT (msg), "method", &method, NULL);
 
-  if (g_strcmp0 (method, SOUP_METHOD_OPTIONS) == 0) {
+  /* A GET end point is shared by any number of clients */
+  if (g_strcmp0 (method, SOUP_METHOD_OPTIONS) == 0 ||
+      g_strcmp0 (method, SOUP_METHOD_GET) == 0) {
     g_free (method);
     return TRUE;
   }
@@ -804,15 +1106,29 @@ got_headers_handler (SoupMessage *msg, gpointer data)
 
   kms_http_ep_server_remove_timeout (self, httpep);
 
+  /* Common parameters used for both, get and post operations */
+  g_object_set_qdata_full (G_OBJECT (msg), key_http_ep_server_quark (),
+                           g_object_ref (self), g_object_unref);
+
+  if (msg->method == SOUP_METHOD_GET) {
+    /* Each client has its own message, they are not bound to the end point */
+    if (!kms_http_ep_server_get_handler (self, msg, httpep) ) {
+      GST_WARNING ("HTTP operation %s is not allowed", msg->method);
+      soup_message_set_status_full (msg, SOUP_STATUS_METHOD_NOT_ALLOWED,
+                                    "Not allowed");
+      return;
+    }
+
+    g_signal_emit (G_OBJECT (self), obj_signals[ACTION_REQUESTED], 0, path,
+                   KMS_HTTP_END_POINT_ACTION_GET);
+    return;
+  }
+
   /* Bind message life cicle to this httpendpoint */
   g_object_set_qdata_full (G_OBJECT (httpep), key_message_quark (),
                            g_object_ref (G_OBJECT (msg) ),
                            (GDestroyNotify) destroy_pending_message);
 
-  /* Common parameters used for both, get and post operations */
-  g_object_set_qdata_full (G_OBJECT (msg), key_http_ep_server_quark (),
-                           g_object_ref (self), g_object_unref);
-
   if (msg->method == SOUP_METHOD_POST) {
     kms_http_ep_server_post_handler (self, msg, httpep);
     action = KMS_HTTP_END_POINT_ACTION_POST;
@@ -1014,14 +1330,55 @@ register_end_point_cb (struct tmp_register_data *tdata)
   return G_SOURCE_REMOVE;
 }
 
-static void
-kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
-    GstElement *endpoint, guint timeout, KmsHttpEPRegisterCallback cb,
-    gpointer user_data, GDestroyNotify notify)
+static gboolean
+process_pending_registrations (KmsHttpEPServer *self)
 {
   struct tmp_register_data *tdata;
-  GError *gerr = nullptr;
+  GQueue *pending;
+  guint n;
+
+  g_mutex_lock (&self->priv->pending_mutex);
+  pending = self->priv->pending_registrations;
+  self->priv->pending_registrations = g_queue_new ();
+  self->priv->registrations_scheduled = FALSE;
+  g_mutex_unlock (&self->priv->pending_mutex);
+
+  n = g_queue_get_length (pending);
 
+  while ( (tdata = (struct tmp_register_data *) g_queue_pop_head (pending) ) !=
+          nullptr) {
+    register_end_point_cb (tdata);
+    destroy_tmp_register_data (tdata);
+  }
+
+  g_queue_free (pending);
+
+  GST_DEBUG_OBJECT (self, "Registered %u end points", n);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Must be called with pending_mutex held */
+static void
+kms_http_ep_server_enqueue_registration (KmsHttpEPServer *self,
+    struct tmp_register_data *tdata)
+{
+  g_queue_push_tail (self->priv->pending_registrations, tdata);
+
+  if (self->priv->registrations_scheduled) {
+    /* Will be processed along with the rest of pending registrations */
+    return;
+  }
+
+  self->priv->registrations_scheduled = TRUE;
+  kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
+                          (GSourceFunc) process_pending_registrations, g_object_ref (self),
+                          g_object_unref);
+}
+
+static gboolean
+kms_http_ep_server_check_end_point (GstElement *endpoint, GError **err)
+{
   /* Check whether this is really an httpendpoint element */
   if (http_t == G_TYPE_INVALID) {
     GstElementFactory *http_f;
@@ -1029,10 +1386,10 @@ kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
     http_f = gst_element_factory_find ("httpendpoint");
 
     if (http_f == nullptr) {
-      g_set_error (&gerr, KMS_HTTP_EP_SERVER_ERROR,
+      g_set_error (err, KMS_HTTP_EP_SERVER_ERROR,
                    HTTPEPSERVER_UNEXPECTED_ERROR,
                    "No httpendpoint factory found");
-      goto error;
+      return FALSE;
     }
 
     http_t = gst_element_factory_get_element_type (http_f);
@@ -1040,12 +1397,22 @@ kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
   }
 
   if (!KMS_IS_EXPECTED_TYPE (endpoint, http_t) ) {
-    g_set_error (&gerr, KMS_HTTP_EP_SERVER_ERROR,
+    g_set_error (err, KMS_HTTP_EP_SERVER_ERROR,
                  HTTPEPSERVER_UNEXPECTED_ERROR,
                  "Element is not an httpendpoint");
-    goto error;
+    return FALSE;
   }
 
+  return TRUE;
+}
+
+static struct tmp_register_data *
+create_tmp_register_data (KmsHttpEPServer *self, GstElement *endpoint,
+                          guint timeout, KmsHttpEPRegisterCallback cb, gpointer user_data,
+                          GDestroyNotify notify)
+{
+  struct tmp_register_data *tdata;
+
   tdata = g_slice_new (struct tmp_register_data);
   tdata->endpoint = GST_ELEMENT ( gst_object_ref (endpoint) );
   tdata->timeout = timeout;
@@ -1054,13 +1421,32 @@ kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
   tdata->notify = notify;
   tdata->server = KMS_HTTP_EP_SERVER ( g_object_ref (self) );
 
+  return tdata;
+}
+
+static void
+kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
+    GstElement *endpoint, guint timeout, KmsHttpEPRegisterCallback cb,
+    gpointer user_data, GDestroyNotify notify)
+{
+  struct tmp_register_data *tdata;
+  GError *gerr = nullptr;
+
+  if (!kms_http_ep_server_check_end_point (endpoint, &gerr) ) {
+    goto error;
+  }
+
+  tdata = create_tmp_register_data (self, endpoint, timeout, cb, user_data,
+                                    notify);
+
   if (KMS_LOOP_IS_CURRENT_THREAD (self->priv->loop) ) {
     register_end_point_cb (tdata);
     destroy_tmp_register_data (tdata);
-  } else
-    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
-                            (GSourceFunc) register_end_point_cb, tdata,
-                            (GDestroyNotify) destroy_tmp_register_data);
+  } else {
+    g_mutex_lock (&self->priv->pending_mutex);
+    kms_http_ep_server_enqueue_registration (self, tdata);
+    g_mutex_unlock (&self->priv->pending_mutex);
+  }
 
   return;
 
@@ -1195,6 +1581,10 @@ kms_http_ep_server_finalize (GObject *obj)
     self->priv->rand = nullptr;
   }
 
+  /* The idle source holds a reference, so nothing can be pending here */
+  g_queue_free (self->priv->pending_registrations);
+  g_mutex_clear (&self->priv->pending_mutex);
+
   /* Chain up to the parent class */
   G_OBJECT_CLASS (kms_http_ep_server_parent_class)->finalize (obj);
 }
@@ -1352,6 +1742,10 @@ kms_http_ep_server_init (KmsHttpEPServer *self)
 
   self->priv->rand = g_rand_new();
   self->priv->loop = kms_loop_new ();
+
+  g_mutex_init (&self->priv->pending_mutex);
+  self->priv->pending_registrations = g_queue_new ();
+  self->priv->registrations_scheduled = FALSE;
 }
 
 /* Virtual public methods */
@@ -0,0 +1,347 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "KmsHttpRing.h"
+
+#define OBJECT_NAME "HttpRing"
+
+#define GST_CAT_DEFAULT kms_http_ring_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+/* Cursor position while waiting for the first keyframe */
+#define NO_SEQ G_MAXUINT64
+
+struct _KmsHttpChunk {
+  gint ref;
+  GstBuffer *buffer;
+  GstMapInfo info;
+  gboolean keyframe;
+};
+
+struct _KmsHttpRing {
+  gint ref;
+  GMutex mutex;
+
+  /* Chunk with sequence number N is stored in slots[N % max_chunks] */
+  KmsHttpChunk **slots;
+  guint max_chunks;
+  gsize max_bytes;
+  gsize bytes;
+  guint64 first_seq;
+  guint64 next_seq;
+  guint64 last_keyframe;
+
+  GPtrArray *header;
+
+  /* Incremented each time the ring is reset */
+  guint generation;
+};
+
+struct _KmsHttpRingCursor {
+  KmsHttpRing *ring;
+  guint generation;
+  guint header_pos;
+  guint64 seq;
+};
+
+static void
+debug_init ()
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done) ) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, OBJECT_NAME, 0,
+                             "debug category for " OBJECT_NAME);
+    g_once_init_leave (&done, 1);
+  }
+}
+
+static KmsHttpChunk *
+kms_http_chunk_new (GstBuffer *buffer)
+{
+  KmsHttpChunk *chunk = g_slice_new0 (KmsHttpChunk);
+
+  chunk->ref = 1;
+  chunk->buffer = gst_buffer_ref (buffer);
+  chunk->keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)
+                    && !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER);
+
+  /* Mapped once, all the clients read from the same memory */
+  if (!gst_buffer_map (buffer, &chunk->info, GST_MAP_READ) ) {
+    GST_ERROR ("Can not map buffer %" GST_PTR_FORMAT, (gpointer) buffer);
+    chunk->info.data = nullptr;
+    chunk->info.size = 0;
+  }
+
+  return chunk;
+}
+
+KmsHttpChunk *
+kms_http_chunk_ref (KmsHttpChunk *chunk)
+{
+  g_atomic_int_inc (&chunk->ref);
+
+  return chunk;
+}
+
+void
+kms_http_chunk_unref (KmsHttpChunk *chunk)
+{
+  if (!g_atomic_int_dec_and_test (&chunk->ref) ) {
+    return;
+  }
+
+  if (chunk->info.data != nullptr) {
+    gst_buffer_unmap (chunk->buffer, &chunk->info);
+  }
+
+  gst_buffer_unref (chunk->buffer);
+  g_slice_free (KmsHttpChunk, chunk);
+}
+
+const guint8 *
+kms_http_chunk_get_data (KmsHttpChunk *chunk)
+{
+  return chunk->info.data;
+}
+
+gsize
+kms_http_chunk_get_size (KmsHttpChunk *chunk)
+{
+  return chunk->info.size;
+}
+
+gboolean
+kms_http_chunk_is_keyframe (KmsHttpChunk *chunk)
+{
+  return chunk->keyframe;
+}
+
+KmsHttpRing *
+kms_http_ring_new (guint max_chunks, gsize max_bytes)
+{
+  KmsHttpRing *ring;
+
+  debug_init ();
+
+  ring = g_slice_new0 (KmsHttpRing);
+  ring->ref = 1;
+  g_mutex_init (&ring->mutex);
+  ring->max_chunks = MAX (max_chunks, 1);
+  ring->max_bytes = max_bytes;
+  ring->slots = g_new0 (KmsHttpChunk *, ring->max_chunks);
+  ring->last_keyframe = NO_SEQ;
+  ring->header = g_ptr_array_new_with_free_func ( (GDestroyNotify)
+                 kms_http_chunk_unref);
+
+  return ring;
+}
+
+KmsHttpRing *
+kms_http_ring_ref (KmsHttpRing *ring)
+{
+  g_atomic_int_inc (&ring->ref);
+
+  return ring;
+}
+
+static void
+kms_http_ring_drop_oldest (KmsHttpRing *ring)
+{
+  guint slot = ring->first_seq % ring->max_chunks;
+  KmsHttpChunk *chunk = ring->slots[slot];
+
+  ring->slots[slot] = nullptr;
+  ring->bytes -= kms_http_chunk_get_size (chunk);
+
+  if (ring->last_keyframe == ring->first_seq) {
+    /* A single GOP does not fit in the ring */
+    GST_WARNING ("Dropping last keyframe, ring is too small");
+    ring->last_keyframe = NO_SEQ;
+  }
+
+  ring->first_seq++;
+  kms_http_chunk_unref (chunk);
+}
+
+static void
+kms_http_ring_clear_unlocked (KmsHttpRing *ring)
+{
+  while (ring->first_seq < ring->next_seq) {
+    kms_http_ring_drop_oldest (ring);
+  }
+
+  g_ptr_array_set_size (ring->header, 0);
+  ring->last_keyframe = NO_SEQ;
+  ring->generation++;
+}
+
+void
+kms_http_ring_unref (KmsHttpRing *ring)
+{
+  if (!g_atomic_int_dec_and_test (&ring->ref) ) {
+    return;
+  }
+
+  kms_http_ring_clear_unlocked (ring);
+  g_ptr_array_unref (ring->header);
+  g_free (ring->slots);
+  g_mutex_clear (&ring->mutex);
+  g_slice_free (KmsHttpRing, ring);
+}
+
+void
+kms_http_ring_clear (KmsHttpRing *ring)
+{
+  g_mutex_lock (&ring->mutex);
+  kms_http_ring_clear_unlocked (ring);
+  g_mutex_unlock (&ring->mutex);
+}
+
+void
+kms_http_ring_push (KmsHttpRing *ring, GstBuffer *buffer)
+{
+  KmsHttpChunk *chunk = kms_http_chunk_new (buffer);
+
+  g_mutex_lock (&ring->mutex);
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER) ) {
+    if (ring->next_seq > ring->first_seq) {
+      GST_DEBUG ("New stream header, resetting ring");
+      kms_http_ring_clear_unlocked (ring);
+    }
+
+    g_ptr_array_add (ring->header, chunk);
+    goto end;
+  }
+
+  while (ring->next_seq - ring->first_seq >= ring->max_chunks ||
+         (ring->bytes + kms_http_chunk_get_size (chunk) > ring->max_bytes
+          && ring->next_seq > ring->first_seq) ) {
+    kms_http_ring_drop_oldest (ring);
+  }
+
+  if (chunk->keyframe) {
+    ring->last_keyframe = ring->next_seq;
+  }
+
+  ring->slots[ring->next_seq % ring->max_chunks] = chunk;
+  ring->bytes += kms_http_chunk_get_size (chunk);
+  ring->next_seq++;
+
+end:
+  g_mutex_unlock (&ring->mutex);
+}
+
+void
+kms_http_ring_get_usage (KmsHttpRing *ring, guint *chunks, gsize *bytes)
+{
+  g_mutex_lock (&ring->mutex);
+
+  if (chunks != nullptr) {
+    *chunks = ring->next_seq - ring->first_seq;
+  }
+
+  if (bytes != nullptr) {
+    *bytes = ring->bytes;
+  }
+
+  g_mutex_unlock (&ring->mutex);
+}
+
+KmsHttpRingCursor *
+kms_http_ring_cursor_new (KmsHttpRing *ring)
+{
+  KmsHttpRingCursor *cursor = g_slice_new0 (KmsHttpRingCursor);
+
+  cursor->ring = kms_http_ring_ref (ring);
+  cursor->seq = NO_SEQ;
+
+  g_mutex_lock (&ring->mutex);
+  cursor->generation = ring->generation;
+  g_mutex_unlock (&ring->mutex);
+
+  return cursor;
+}
+
+void
+kms_http_ring_cursor_free (KmsHttpRingCursor *cursor)
+{
+  kms_http_ring_unref (cursor->ring);
+  g_slice_free (KmsHttpRingCursor, cursor);
+}
+
+KmsHttpChunk *
+kms_http_ring_cursor_next (KmsHttpRingCursor *cursor, gboolean *skipped)
+{
+  KmsHttpRing *ring = cursor->ring;
+  KmsHttpChunk *chunk = nullptr;
+
+  if (skipped != nullptr) {
+    *skipped = FALSE;
+  }
+
+  g_mutex_lock (&ring->mutex);
+
+  if (cursor->generation != ring->generation) {
+    /* The muxer was restarted, the client needs the new header */
+    cursor->generation = ring->generation;
+    cursor->header_pos = 0;
+    cursor->seq = NO_SEQ;
+  }
+
+  if (cursor->header_pos < ring->header->len) {
+    chunk = (KmsHttpChunk *) g_ptr_array_index (ring->header,
+            cursor->header_pos++);
+    goto end;
+  }
+
+  if (cursor->seq != NO_SEQ && cursor->seq < ring->first_seq) {
+    GST_DEBUG ("Cursor %p is too slow, moving it to the last keyframe",
+               (gpointer) cursor);
+    cursor->seq = NO_SEQ;
+
+    if (skipped != nullptr) {
+      *skipped = TRUE;
+    }
+  }
+
+  if (cursor->seq == NO_SEQ) {
+    if (ring->last_keyframe == NO_SEQ) {
+      goto end;
+    }
+
+    cursor->seq = ring->last_keyframe;
+  }
+
+  if (cursor->seq >= ring->next_seq) {
+    goto end;
+  }
+
+  chunk = ring->slots[cursor->seq % ring->max_chunks];
+  cursor->seq++;
+
+end:
+
+  if (chunk != nullptr) {
+    kms_http_chunk_ref (chunk);
+  }
+
+  g_mutex_unlock (&ring->mutex);
+
+  return chunk;
+}
@@ -0,0 +1,72 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* inclusion guard */
+#ifndef __KMS_HTTP_RING_H__
+#define __KMS_HTTP_RING_H__
+
+#include <gst/gst.h>
+
+/*
+ * Ring of muxed chunks shared by all the clients of an HTTP GET end point.
+ *
+ * Chunks are pushed once, from the muxer's streaming thread, and read by any
+ * number of cursors. Readers get a reference to the chunk, never a copy, so
+ * the memory used by each client does not depend on the amount of data it is
+ * waiting to receive. The ring never blocks the writer: when it is full, the
+ * oldest chunks are dropped and the cursors still pointing to them are moved
+ * ahead to the most recent keyframe.
+ */
+
+typedef struct _KmsHttpRing KmsHttpRing;
+typedef struct _KmsHttpRingCursor KmsHttpRingCursor;
+typedef struct _KmsHttpChunk KmsHttpChunk;
+
+#define KMS_HTTP_RING_DEFAULT_MAX_CHUNKS 4096
+#define KMS_HTTP_RING_DEFAULT_MAX_BYTES (8 * 1024 * 1024)
+
+KmsHttpRing *kms_http_ring_new (guint max_chunks, gsize max_bytes);
+KmsHttpRing *kms_http_ring_ref (KmsHttpRing * ring);
+void kms_http_ring_unref (KmsHttpRing * ring);
+
+/* Buffers flagged as GST_BUFFER_FLAG_HEADER are the stream header, sent to
+ * every new client before any other chunk. A header pushed after media
+ * chunks means that the muxer was restarted, so the ring is reset. Buffers
+ * not flagged as GST_BUFFER_FLAG_DELTA_UNIT are the points where new
+ * clients can start. */
+void kms_http_ring_push (KmsHttpRing * ring, GstBuffer * buffer);
+void kms_http_ring_clear (KmsHttpRing * ring);
+void kms_http_ring_get_usage (KmsHttpRing * ring, guint * chunks,
+    gsize * bytes);
+
+/* New cursors start with the header, followed by the last keyframe */
+KmsHttpRingCursor *kms_http_ring_cursor_new (KmsHttpRing * ring);
+void kms_http_ring_cursor_free (KmsHttpRingCursor * cursor);
+
+/* Returns a new reference to the next chunk or NULL if there is nothing new.
+ * @skipped is set to TRUE when the chunks the cursor was waiting for have
+ * already been dropped and it has been moved ahead */
+KmsHttpChunk *kms_http_ring_cursor_next (KmsHttpRingCursor * cursor,
+    gboolean * skipped);
+
+KmsHttpChunk *kms_http_chunk_ref (KmsHttpChunk * chunk);
+void kms_http_chunk_unref (KmsHttpChunk * chunk);
+const guint8 *kms_http_chunk_get_data (KmsHttpChunk * chunk);
+gsize kms_http_chunk_get_size (KmsHttpChunk * chunk);
+gboolean kms_http_chunk_is_keyframe (KmsHttpChunk * chunk);
+
+#endif /* __KMS_HTTP_RING_H__ */
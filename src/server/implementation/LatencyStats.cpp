@@ -0,0 +1,75 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "LatencyStats.hpp"
+#include "LatencyPercentiles.hpp"
+#include "StatsType.hpp"
+#include <commons/kmsutils.h>
+#include <kmslatencysampler.h>
+
+namespace kurento
+{
+
+static double
+nsToMillis (guint64 value)
+{
+  return (double) value / GST_MSECOND;
+}
+
+void
+fillLatencyPercentilesReport (std::map <std::string, std::shared_ptr<Stats>>
+                              &report, const std::string &prefix,
+                              const GstStructure *stats, double timestamp,
+                              int64_t timestampMillis)
+{
+  const GstStructure *percentiles;
+  gint i, n;
+
+  percentiles = kms_utils_get_structure_by_name (stats,
+                KMS_LATENCY_PERCENTILES_FIELD);
+
+  if (percentiles == nullptr) {
+    return;
+  }
+
+  n = gst_structure_n_fields (percentiles);
+
+  for (i = 0; i < n; i++) {
+    const gchar *name = gst_structure_nth_field_name (percentiles, i);
+    const GValue *value = gst_structure_get_value (percentiles, name);
+    const GstStructure *stream;
+    guint64 samples = 0, p50 = 0, p95 = 0, p99 = 0;
+    std::string id;
+
+    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
+      continue;
+    }
+
+    stream = gst_value_get_structure (value);
+    gst_structure_get (stream, "samples", G_TYPE_UINT64, &samples,
+                       "p50", G_TYPE_UINT64, &p50, "p95", G_TYPE_UINT64, &p95,
+                       "p99", G_TYPE_UINT64, &p99, NULL);
+
+    id = prefix + name;
+    report[id] = std::make_shared <LatencyPercentiles> (id,
+                 std::make_shared <StatsType> (StatsType::element), timestamp,
+                 timestampMillis, name, samples, nsToMillis (p50),
+                 nsToMillis (p95), nsToMillis (p99) );
+  }
+}
+
+} /* kurento */
@@ -0,0 +1,55 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "RetransmissionStats.hpp"
+#include "RetransmissionCacheStats.hpp"
+#include "StatsType.hpp"
+#include <commons/kmsutils.h>
+#include <webrtcendpoint/kmswebrtcrtxcache.h>
+
+namespace kurento
+{
+
+void
+fillRetransmissionCacheReport (std::map <std::string, std::shared_ptr<Stats>>
+                               &report, const std::string &id,
+                               const GstStructure *stats, double timestamp,
+                               int64_t timestampMillis)
+{
+  const GstStructure *cache_stats;
+  guint64 hits = 0, misses = 0, tooOld = 0, bytes = 0;
+  guint packets = 0;
+
+  cache_stats = kms_utils_get_structure_by_name (stats,
+                KMS_WEBRTC_RTX_CACHE_STATS_FIELD);
+
+  if (cache_stats == nullptr) {
+    return;
+  }
+
+  gst_structure_get (cache_stats, "hits", G_TYPE_UINT64, &hits,
+                     "misses", G_TYPE_UINT64, &misses,
+                     "too-old", G_TYPE_UINT64, &tooOld,
+                     "packets", G_TYPE_UINT, &packets,
+                     "bytes", G_TYPE_UINT64, &bytes, NULL);
+
+  report[id] = std::make_shared <RetransmissionCacheStats> (id,
+               std::make_shared <StatsType> (StatsType::element), timestamp,
+               timestampMillis, hits, misses, tooOld, packets, bytes);
+}
+
+} /* kurento */
@@ -0,0 +1,67 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "StatsSnapshot.hpp"
+
+namespace kurento
+{
+
+StatsSnapshotCollector::StatsSnapshotCollector ()
+{
+  poller = kms_stats_snapshot_poller_new ();
+}
+
+StatsSnapshotCollector::~StatsSnapshotCollector ()
+{
+  kms_stats_snapshot_poller_free (poller);
+}
+
+guint
+StatsSnapshotCollector::collect (GstBin *pipeline,
+                                 const std::function<void (const KmsStatsSnapshot &) > &func)
+{
+  guint children, n;
+
+  GST_OBJECT_LOCK (pipeline);
+  children = GST_BIN_NUMCHILDREN (pipeline);
+  GST_OBJECT_UNLOCK (pipeline);
+
+  if (snapshots.size () < children) {
+    snapshots.resize (children, KmsStatsSnapshot () );
+  }
+
+  n = kms_stats_snapshot_poller_collect (poller, pipeline, snapshots.data (),
+                                         snapshots.size () );
+
+  for (guint i = 0; i < n; i++) {
+    try {
+      func (snapshots[i]);
+    } catch (...) {
+      for (; i < n; i++) {
+        kms_stats_snapshot_clear (&snapshots[i]);
+      }
+
+      throw;
+    }
+
+    kms_stats_snapshot_clear (&snapshots[i]);
+  }
+
+  return n;
+}
+
+} /* kurento */
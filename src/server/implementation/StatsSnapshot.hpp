@@ -0,0 +1,57 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef __STATS_SNAPSHOT_HPP__
+#define __STATS_SNAPSHOT_HPP__
+
+#include <gst/gst.h>
+#include <kmsstatssnapshot.h>
+#include <functional>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Polls the flat stats of all the elements of a pipeline in one go, see
+ * kmsstatssnapshot.h. Each collector reports the changes since its own
+ * previous call. Snapshots are kept between calls, so once they have grown to
+ * the number of elements polling does not allocate.
+ */
+class StatsSnapshotCollector
+{
+public:
+  StatsSnapshotCollector ();
+  ~StatsSnapshotCollector ();
+  StatsSnapshotCollector (const StatsSnapshotCollector &) = delete;
+  StatsSnapshotCollector &operator= (const StatsSnapshotCollector &) = delete;
+
+  /* Calls @func for each element whose counters changed since the previous
+   * call, only the counters in KmsStatsSnapshot::changed are meaningful.
+   * Snapshots are only valid during the call. Returns the number of them */
+  guint collect (GstBin *pipeline,
+                 const std::function<void (const KmsStatsSnapshot &) > &func);
+
+private:
+  KmsStatsSnapshotPoller *poller;
+  std::vector<KmsStatsSnapshot> snapshots;
+};
+
+} /* kurento */
+
+#endif /* __STATS_SNAPSHOT_HPP__ */
@@ -33,6 +33,7 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define FACTORY_NAME "alphablending"
 #define MASTER_PORT "set-master"
 #define SET_PORT_PROPERTIES "set-port-properties"
+#define BLEND_THREADS "blend-threads"
 
 namespace kurento
 {
@@ -81,6 +82,26 @@ void AlphaBlendingImpl::setPortProperties (float relativeX, float relativeY,
   gst_structure_free (data);
 }
 
+int AlphaBlendingImpl::getBlendThreads ()
+{
+  guint threads;
+
+  g_object_get (G_OBJECT (element), BLEND_THREADS, &threads, NULL);
+
+  return threads;
+}
+
+void AlphaBlendingImpl::setBlendThreads (int blendThreads)
+{
+  if (blendThreads < 0) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "blendThreads can not be negative");
+  }
+
+  g_object_set (G_OBJECT (element), BLEND_THREADS, (guint) blendThreads,
+                NULL);
+}
+
 MediaObjectImpl *
 AlphaBlendingImplFactory::createObject (const boost::property_tree::ptree &conf,
                                         std::shared_ptr<MediaPipeline>
@@ -46,6 +46,9 @@ public:
   void setPortProperties (float relativeX, float relativeY, int zOrder,
                           float relativeWidth, float relativeHeight, std::shared_ptr<HubPort> port);
 
+  int getBlendThreads ();
+  void setBlendThreads (int blendThreads);
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler);
@@ -16,10 +16,13 @@
  */
 #include <gst/gst.h>
 #include "MediaPipeline.hpp"
+#include "HubPort.hpp"
+#include "HubPortImpl.hpp"
 #include <CompositeImplFactory.hpp>
 #include "CompositeImpl.hpp"
 #include <jsonrpc/JsonSerializer.hpp>
 #include <KurentoException.hpp>
+#include <SignalHandler.hpp>
 #include <gst/gst.h>
 
 #define GST_CAT_DEFAULT kurento_composite_impl
@@ -27,6 +30,17 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoCompositeImpl"
 
 #define FACTORY_NAME "compositemixer"
+#define SET_PORT_PROPERTIES "set-port-properties"
+#define BLEND_THREADS "blend-threads"
+#define VISIBLE_INPUTS "visible-inputs"
+#define BLENDED_INPUTS "blended-inputs"
+#define SKIP_DUPLICATES "skip-duplicates"
+#define OUTPUT_FRAMES "output-frames"
+#define DUPLICATE_FRAMES "duplicate-frames"
+#define ADAPTIVE_QUALITY "adaptive-quality"
+#define QUALITY_LEVEL "quality-level"
+#define SKIP_SILENT_AUDIO "skip-silent-audio"
+#define MIXED_AUDIO_INPUTS "mixed-audio-inputs"
 
 namespace kurento
 {
@@ -37,6 +51,177 @@ CompositeImpl::CompositeImpl (const boost::property_tree::ptree &conf,
 {
 }
 
+CompositeImpl::~CompositeImpl ()
+{
+  if (handlerOnQualityChanged > 0) {
+    unregister_signal_handler (element, handlerOnQualityChanged);
+  }
+}
+
+void
+CompositeImpl::postConstructor ()
+{
+  HubImpl::postConstructor ();
+
+  handlerOnQualityChanged = register_signal_handler (G_OBJECT (element),
+                            "quality-changed",
+                            std::function <void (GstElement *, GstStructure *) >
+                            (std::bind (&CompositeImpl::onQualityChanged, this,
+                                        std::placeholders::_2) ),
+                            std::dynamic_pointer_cast<CompositeImpl>
+                            (shared_from_this() ) );
+}
+
+void
+CompositeImpl::onQualityChanged (const GstStructure *quality)
+{
+  guint level = 0;
+  gint width = 0, height = 0, maxFramerate = 0;
+
+  gst_structure_get (quality, "level", G_TYPE_UINT, &level,
+                     "width", G_TYPE_INT, &width, "height", G_TYPE_INT, &height,
+                     "max-framerate", G_TYPE_INT, &maxFramerate, NULL);
+
+  try {
+    CompositeQualityChanged event (shared_from_this (),
+                                   CompositeQualityChanged::getName (), level, width, height,
+                                   maxFramerate);
+    sigcSignalEmit (signalCompositeQualityChanged, event);
+  } catch (const std::bad_weak_ptr &e) {
+    // shared_from_this()
+    GST_ERROR ("BUG creating %s: %s",
+               CompositeQualityChanged::getName ().c_str (), e.what ());
+  }
+}
+
+void CompositeImpl::setHidden (std::shared_ptr<HubPort> port, bool hidden)
+{
+  GstStructure *data;
+  std::shared_ptr<HubPortImpl> mixerPort =
+    std::dynamic_pointer_cast<HubPortImpl> (port);
+
+  data = gst_structure_new ("data",
+                            "port", G_TYPE_INT, mixerPort->getHandlerId(),
+                            "hidden", G_TYPE_BOOLEAN, hidden,
+                            NULL);
+
+  g_signal_emit_by_name (element, SET_PORT_PROPERTIES, data);
+  gst_structure_free (data);
+}
+
+int CompositeImpl::getVisibleInputs ()
+{
+  guint inputs;
+
+  g_object_get (G_OBJECT (element), VISIBLE_INPUTS, &inputs, NULL);
+
+  return inputs;
+}
+
+int CompositeImpl::getBlendedInputs ()
+{
+  guint inputs;
+
+  g_object_get (G_OBJECT (element), BLENDED_INPUTS, &inputs, NULL);
+
+  return inputs;
+}
+
+bool CompositeImpl::getSkipDuplicateFrames ()
+{
+  gboolean skip;
+
+  g_object_get (G_OBJECT (element), SKIP_DUPLICATES, &skip, NULL);
+
+  return skip;
+}
+
+void CompositeImpl::setSkipDuplicateFrames (bool skipDuplicateFrames)
+{
+  g_object_set (G_OBJECT (element), SKIP_DUPLICATES, skipDuplicateFrames,
+                NULL);
+}
+
+double CompositeImpl::getSkippedFrameRatio ()
+{
+  guint64 output, duplicates;
+
+  g_object_get (G_OBJECT (element), OUTPUT_FRAMES, &output,
+                DUPLICATE_FRAMES, &duplicates, NULL);
+
+  if (output == 0) {
+    return 0.0;
+  }
+
+  return (double) duplicates / output;
+}
+
+bool CompositeImpl::getAdaptiveQuality ()
+{
+  gboolean adaptive;
+
+  g_object_get (G_OBJECT (element), ADAPTIVE_QUALITY, &adaptive, NULL);
+
+  return adaptive;
+}
+
+void CompositeImpl::setAdaptiveQuality (bool adaptiveQuality)
+{
+  g_object_set (G_OBJECT (element), ADAPTIVE_QUALITY, adaptiveQuality, NULL);
+}
+
+int CompositeImpl::getQualityLevel ()
+{
+  guint level;
+
+  g_object_get (G_OBJECT (element), QUALITY_LEVEL, &level, NULL);
+
+  return level;
+}
+
+bool CompositeImpl::getSkipSilentAudio ()
+{
+  gboolean skip;
+
+  g_object_get (G_OBJECT (element), SKIP_SILENT_AUDIO, &skip, NULL);
+
+  return skip;
+}
+
+void CompositeImpl::setSkipSilentAudio (bool skipSilentAudio)
+{
+  g_object_set (G_OBJECT (element), SKIP_SILENT_AUDIO, skipSilentAudio, NULL);
+}
+
+int CompositeImpl::getMixedAudioInputs ()
+{
+  guint mixed;
+
+  g_object_get (G_OBJECT (element), MIXED_AUDIO_INPUTS, &mixed, NULL);
+
+  return mixed;
+}
+
+int CompositeImpl::getBlendThreads ()
+{
+  guint threads;
+
+  g_object_get (G_OBJECT (element), BLEND_THREADS, &threads, NULL);
+
+  return threads;
+}
+
+void CompositeImpl::setBlendThreads (int blendThreads)
+{
+  if (blendThreads < 0) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "blendThreads can not be negative");
+  }
+
+  g_object_set (G_OBJECT (element), BLEND_THREADS, (guint) blendThreads,
+                NULL);
+}
+
 MediaObjectImpl *
 CompositeImplFactory::createObject (const boost::property_tree::ptree &conf,
                                     std::shared_ptr<MediaPipeline> mediaPipeline) const
@@ -25,6 +25,7 @@ namespace kurento
 {
 
 class MediaPipeline;
+class HubPort;
 class CompositeImpl;
 
 void Serialize (std::shared_ptr<CompositeImpl> &object,
@@ -38,7 +39,29 @@ public:
   CompositeImpl (const boost::property_tree::ptree &conf,
                  std::shared_ptr<MediaPipeline> mediaPipeline);
 
-  virtual ~CompositeImpl () {};
+  virtual ~CompositeImpl ();
+
+  void setHidden (std::shared_ptr<HubPort> port, bool hidden);
+
+  int getVisibleInputs ();
+  int getBlendedInputs ();
+
+  bool getSkipDuplicateFrames ();
+  void setSkipDuplicateFrames (bool skipDuplicateFrames);
+  double getSkippedFrameRatio ();
+
+  bool getAdaptiveQuality ();
+  void setAdaptiveQuality (bool adaptiveQuality);
+  int getQualityLevel ();
+
+  bool getSkipSilentAudio ();
+  void setSkipSilentAudio (bool skipSilentAudio);
+  int getMixedAudioInputs ();
+
+  int getBlendThreads ();
+  void setBlendThreads (int blendThreads);
+
+  sigc::signal<void, CompositeQualityChanged> signalCompositeQualityChanged;
 
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
@@ -50,8 +73,14 @@ public:
 
   virtual void Serialize (JsonSerializer &serializer);
 
+protected:
+  virtual void postConstructor ();
+
 private:
 
+  gulong handlerOnQualityChanged = 0;
+  void onQualityChanged (const GstStructure *quality);
+
   class StaticConstructor
   {
   public:
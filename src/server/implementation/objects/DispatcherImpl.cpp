@@ -19,6 +19,7 @@
 #include "HubPortImpl.hpp"
 #include <DispatcherImplFactory.hpp>
 #include "DispatcherImpl.hpp"
+#include "DispatcherRoute.hpp"
 #include <jsonrpc/JsonSerializer.hpp>
 #include <KurentoException.hpp>
 #include <gst/gst.h>
@@ -57,6 +58,43 @@ void DispatcherImpl::connect (std::shared_ptr<HubPort> source,
   }
 }
 
+int64_t DispatcherImpl::applyRouting (
+  const std::vector<std::shared_ptr<DispatcherRoute>> &routes)
+{
+  GArray *table = g_array_sized_new (FALSE, FALSE, sizeof (gint),
+                                     routes.size () * 2);
+  bool applied;
+  guint64 duration;
+
+  for (auto route : routes) {
+    std::shared_ptr<HubPortImpl> sinkPort =
+      std::dynamic_pointer_cast<HubPortImpl> (route->getSink () );
+    gint sink = sinkPort->getHandlerId ();
+    gint source = -1;
+
+    if (route->isSetSource () ) {
+      source = std::dynamic_pointer_cast<HubPortImpl>
+               (route->getSource () )->getHandlerId ();
+    }
+
+    g_array_append_val (table, sink);
+    g_array_append_val (table, source);
+  }
+
+  g_signal_emit_by_name (G_OBJECT (element), "apply-routing", table, &applied);
+  g_array_unref (table);
+
+  if (!applied) {
+    throw KurentoException (CONNECT_ERROR, "Can not apply routing table");
+  }
+
+  g_object_get (G_OBJECT (element), "last-routing-duration", &duration, NULL);
+  GST_DEBUG_OBJECT (element, "Routing table with %zu routes applied in %"
+                    G_GUINT64_FORMAT " us", routes.size (), duration);
+
+  return duration;
+}
+
 MediaObjectImpl *
 DispatcherImplFactory::createObject (const boost::property_tree::ptree &conf,
                                      std::shared_ptr<MediaPipeline> mediaPipeline) const
@@ -30,6 +30,11 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define FACTORY_NAME "dispatcheronetomany"
 #define MAIN_PORT "main"
+#define GOP_CACHE_SIZE "gop-cache-size"
+#define LAST_SWITCH_DURATION "last-switch-duration"
+
+#define PARAM_GOP_CACHE_SIZE "gopCacheSize"
+#define DEFAULT_GOP_CACHE_SIZE (2 * 1024 * 1024)
 
 namespace kurento
 {
@@ -39,6 +44,12 @@ DispatcherOneToManyImpl::DispatcherOneToManyImpl (const
     std::shared_ptr<MediaPipeline> mediaPipeline) : HubImpl (conf,
           std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline), FACTORY_NAME)
 {
+  uint gopCacheSize;
+
+  getConfigValue <uint, DispatcherOneToMany> (&gopCacheSize,
+      PARAM_GOP_CACHE_SIZE, DEFAULT_GOP_CACHE_SIZE);
+
+  g_object_set (G_OBJECT (element), GOP_CACHE_SIZE, gopCacheSize, NULL);
 }
 
 void DispatcherOneToManyImpl::setSource (std::shared_ptr<HubPort> source)
@@ -54,6 +65,15 @@ void DispatcherOneToManyImpl::removeSource ()
   g_object_set (G_OBJECT (element), MAIN_PORT, -1, NULL);
 }
 
+int64_t DispatcherOneToManyImpl::getLastSwitchDuration ()
+{
+  guint64 duration;
+
+  g_object_get (G_OBJECT (element), LAST_SWITCH_DURATION, &duration, NULL);
+
+  return duration;
+}
+
 MediaObjectImpl *
 DispatcherOneToManyImplFactory::createObject (const boost::property_tree::ptree
     &conf, std::shared_ptr<MediaPipeline> mediaPipeline) const
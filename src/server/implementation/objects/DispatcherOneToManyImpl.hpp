@@ -45,6 +45,8 @@ public:
   void setSource (std::shared_ptr<HubPort> source);
   void removeSource ();
 
+  int64_t getLastSwitchDuration () override;
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler);
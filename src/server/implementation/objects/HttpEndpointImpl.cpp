@@ -20,7 +20,7 @@
 #include <KurentoException.hpp>
 #include <gst/gst.h>
 #include "HttpServer/HttpEndPointServer.hpp"
-#include <condition_variable>
+#include <chrono>
 
 #define GST_CAT_DEFAULT kurento_http_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -29,6 +29,9 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 static const std::string HTTP_SERVICE_ADDRESS = "serverAddress";
 static const std::string HTTP_SERVICE_PORT = "serverPort";
 static const std::string HTTP_SERVICE_ANNOUNCED_ADDRESS = "announcedAddress";
+static const std::string HTTP_REGISTRATION_TIMEOUT = "registrationTimeout";
+
+static const uint DEFAULT_REGISTRATION_TIMEOUT = 5000; /* milliseconds */
 
 namespace kurento
 {
@@ -113,98 +116,133 @@ unregister_end_point_adaptor_function (KmsHttpEPServer *self, GError *err,
   (*handler) (err);
 }
 
+template <typename T>
+static void
+destroy_handler (gpointer data)
+{
+  delete reinterpret_cast<T *> (data);
+}
+
 void
 HttpEndpointImpl::unregister_end_point ()
 {
-  std::string uri = getUriFromUrl (url);
-  std::condition_variable cond;
-  std::mutex mutex;
-  bool finish = FALSE;
+  std::string uri;
+
+  if (registration) {
+    /* Registration callback must not touch this object from now on */
+    std::unique_lock<std::mutex> lock (registration->mutex);
+
+    registration->endpoint = nullptr;
+  }
 
   if (!urlSet) {
     return;
   }
 
-  std::function<void(GError * err)> aux = [&](GError *err) {
+  uri = getUriFromUrl (url);
+  url = "";
+  urlSet = false;
+
+  /* Do not wait for the server, the callback only logs the result */
+  auto aux = new std::function<void (GError * err) > ([uri] (GError * err) {
     if (err != nullptr) {
       GST_ERROR ("Could not unregister uri %s: %s", uri.c_str(), err->message);
     }
+  });
 
-    url = "";
-    urlSet = false;
-
-    std::unique_lock<std::mutex> lock (mutex);
-
-    finish = TRUE;
-    cond.notify_all ();
-  };
-
-  server->unregisterEndPoint(uri, unregister_end_point_adaptor_function, &aux,
-                             nullptr);
+  server->unregisterEndPoint (uri, unregister_end_point_adaptor_function, aux,
+                              destroy_handler<std::function<void (GError *) >>);
+}
 
-  std::unique_lock<std::mutex> lock (mutex);
+void
+HttpEndpointImpl::onEndPointRegistered (const gchar *uri, GError *err)
+{
+  std::string addr;
+  guint port;
+  gchar *url_tmp;
 
-  while (!finish) {
-    cond.wait (lock);
+  if (err != nullptr) {
+    GST_ERROR ("Can not register end point: %s", err->message);
+    return;
   }
+
+  actionRequestedHandlerId =
+    server->connectSignal ("action-requested",
+                           G_CALLBACK (action_requested_adaptor_function),
+                           &actionRequestedLambda);
+  urlRemovedHandlerId =
+    server->connectSignal ("url-removed",
+                           G_CALLBACK (session_terminated_adaptor_function),
+                           &sessionTerminatedLambda);
+  urlExpiredHandlerId =
+    server->connectSignal ("url-expired",
+                           G_CALLBACK (session_terminated_adaptor_function),
+                           &sessionTerminatedLambda);
+
+  addr = server->getAnnouncedAddress();
+  port = server->getPort();
+
+  url_tmp = g_strdup_printf ("http://%s:%d%s", addr.c_str (), port, uri);
+  url = std::string (url_tmp);
+  g_free (url_tmp);
+  urlSet = true;
 }
 
 void
 HttpEndpointImpl::register_end_point ()
 {
-  std::condition_variable cond;
-  std::mutex mutex;
-  bool done = FALSE;
-
-  std::function <void (const gchar *, GError *err) > aux = [&] (const gchar * uri,
-  GError * err) {
-    std::string addr;
-    guint port;
-    gchar *url_tmp;
+  std::shared_ptr<Registration> reg = std::make_shared<Registration> ();
+  std::shared_ptr<HttpEndPointServer> srv = server;
+
+  reg->endpoint = this;
+  registration = reg;
+  registered = reg->promise.get_future ().share ();
+
+  /* The object is not kept alive until the server processes the request,
+   * so the callback goes through the registration, which is detached when
+   * this endpoint is unregistered */
+  auto aux = new std::function <void (const gchar *, GError *err) > ([reg, srv] (
+  const gchar * uri, GError * err) {
+    std::unique_lock<std::mutex> lock (reg->mutex);
+
+    if (reg->endpoint == nullptr) {
+      if (uri != nullptr) {
+        GST_DEBUG ("Endpoint released before being registered, removing %s",
+                   uri);
+        srv->unregisterEndPoint (uri, nullptr, nullptr, nullptr);
+      }
+    } else {
+      reg->endpoint->onEndPointRegistered (uri, err);
+    }
 
     if (err != nullptr) {
-      GST_ERROR ("Can not register end point: %s", err->message);
-      goto do_signal;
+      reg->promise.set_exception (std::make_exception_ptr (KurentoException (
+                                    HTTP_END_POINT_REGISTRATION_ERROR, err->message) ) );
+    } else {
+      reg->promise.set_value ();
     }
+  });
 
-    actionRequestedHandlerId =
-      server->connectSignal ("action-requested",
-                             G_CALLBACK (action_requested_adaptor_function),
-                             &actionRequestedLambda);
-    urlRemovedHandlerId =
-      server->connectSignal ("url-removed",
-                             G_CALLBACK (session_terminated_adaptor_function),
-                             &sessionTerminatedLambda);
-    urlExpiredHandlerId =
-      server->connectSignal ("url-expired",
-                             G_CALLBACK (session_terminated_adaptor_function),
-                             &sessionTerminatedLambda);
-
-    addr = server->getAnnouncedAddress();
-    port = server->getPort();
-
-    url_tmp = g_strdup_printf ("http://%s:%d%s", addr.c_str (), port, uri);
-    url = std::string (url_tmp);
-    g_free (url_tmp);
-    urlSet = true;
-
-do_signal:
-
-    std::unique_lock<std::mutex> lock (mutex);
-
-    done = TRUE;
-    cond.notify_all ();
-
-  };
-
-  server->registerEndPoint(element, disconnectionTimeout,
-                           register_end_point_adaptor_function, &aux, nullptr);
+  server->registerEndPoint (element, disconnectionTimeout,
+                            register_end_point_adaptor_function, aux,
+                            destroy_handler<std::function<void (const gchar *, GError *) >>);
+}
 
-  std::unique_lock<std::mutex> lock (mutex);
+void
+HttpEndpointImpl::wait_registration ()
+{
+  if (!registered.valid () ) {
+    return;
+  }
 
-  while (!done) {
-    cond.wait (lock);
+  if (registered.wait_for (std::chrono::milliseconds (registrationTimeout) ) !=
+      std::future_status::ready) {
+    throw KurentoException (HTTP_END_POINT_REGISTRATION_ERROR,
+                            "Timeout registering HttpEndpoint");
   }
+
+  /* Rethrows the registration error, if any */
+  registered.get ();
 }
 
 bool
@@ -332,6 +370,9 @@ HttpEndpointImpl::HttpEndpointImpl (const boost::property_tree::ptree &conf,
   getConfigValue <std::string, HttpEndpoint> (&httpServiceAnnouncedAddress,
       HTTP_SERVICE_ANNOUNCED_ADDRESS, std::string());
 
+  getConfigValue <uint, HttpEndpoint> (&registrationTimeout,
+      HTTP_REGISTRATION_TIMEOUT, DEFAULT_REGISTRATION_TIMEOUT);
+
   server = HttpEndPointServer::getHttpEndPointServer (httpServicePort,
       httpServiceAddress, httpServiceAnnouncedAddress);
 
@@ -343,6 +384,12 @@ HttpEndpointImpl::HttpEndpointImpl (const boost::property_tree::ptree &conf,
 
 HttpEndpointImpl::~HttpEndpointImpl()
 {
+  if (registration) {
+    std::unique_lock<std::mutex> lock (registration->mutex);
+
+    registration->endpoint = nullptr;
+  }
+
   if (actionRequestedHandlerId > 0) {
     server->disconnectSignal (
       actionRequestedHandlerId);
@@ -363,6 +410,8 @@ HttpEndpointImpl::~HttpEndpointImpl()
 
 std::string HttpEndpointImpl::getUrl ()
 {
+  wait_registration ();
+
   return url;
 }
 
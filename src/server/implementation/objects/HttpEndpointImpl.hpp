@@ -21,6 +21,7 @@
 #include "HttpEndpoint.hpp"
 #include <EventHandler.hpp>
 #include "HttpServer/HttpEndPointServer.hpp"
+#include <future>
 
 namespace kurento
 {
@@ -56,15 +57,28 @@ public:
 
 protected:
   void unregister_end_point ();
+  /* Asynchronous, getUrl () waits until the registration is completed */
   void register_end_point ();
+  void wait_registration ();
   bool is_registered();
 
 private:
+  struct Registration {
+    std::mutex mutex;
+    HttpEndpointImpl *endpoint;
+    std::promise<void> promise;
+  };
+
+  void onEndPointRegistered (const gchar *uri, GError *err);
+
   std::shared_ptr<HttpEndPointServer> server;
 
   std::string url;
   bool urlSet = false;
   guint disconnectionTimeout;
+  uint registrationTimeout;
+  std::shared_ptr<Registration> registration;
+  std::shared_future<void> registered;
 
   class StaticConstructor
   {
@@ -74,9 +88,9 @@ private:
 
   static StaticConstructor staticConstructor;
 
-  gulong actionRequestedHandlerId;
-  gulong urlRemovedHandlerId;
-  gulong urlExpiredHandlerId;
+  gulong actionRequestedHandlerId = 0;
+  gulong urlRemovedHandlerId = 0;
+  gulong urlExpiredHandlerId = 0;
   gint sessionStarted = 0;
 
   std::function<void (const gchar *uri, KmsHttpEndPointAction action) >
@@ -0,0 +1,72 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __HTTP_GET_ENDPOINT_IMPL_HPP__
+#define __HTTP_GET_ENDPOINT_IMPL_HPP__
+
+#include "HttpEndpointImpl.hpp"
+#include "HttpGetEndpoint.hpp"
+#include <EventHandler.hpp>
+
+namespace kurento
+{
+
+class MediaPipeline;
+class MediaProfileSpecType;
+class HttpGetEndpointImpl;
+
+void Serialize (std::shared_ptr<HttpGetEndpointImpl> &object,
+                JsonSerializer &serializer);
+
+class HttpGetEndpointImpl : public HttpEndpointImpl,
+  public virtual HttpGetEndpoint
+{
+
+public:
+
+  HttpGetEndpointImpl (const boost::property_tree::ptree &conf,
+                       std::shared_ptr<MediaPipeline> mediaPipeline,
+                       int disconnectionTimeout,
+                       std::shared_ptr<MediaProfileSpecType> mediaProfile);
+
+  virtual ~HttpGetEndpointImpl () = default;
+
+  /* Next methods are automatically implemented by code generator */
+  using HttpEndpointImpl::connect;
+  virtual bool connect (const std::string &eventType,
+                        std::shared_ptr<EventHandler> handler) override;
+
+  virtual void invoke (std::shared_ptr<MediaObjectImpl> obj,
+                       const std::string &methodName, const Json::Value &params,
+                       Json::Value &response) override;
+
+  virtual void Serialize (JsonSerializer &serializer) override;
+
+private:
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+
+};
+
+} /* kurento */
+
+#endif /*  __HTTP_GET_ENDPOINT_IMPL_HPP__ */
@@ -70,11 +70,6 @@ HttpPostEndpointImpl::HttpPostEndpointImpl (const boost::property_tree::ptree
   g_object_set ( G_OBJECT (element), "accept-eos", false, NULL);
 
   register_end_point();
-
-  if (!is_registered() ) {
-    throw KurentoException (HTTP_END_POINT_REGISTRATION_ERROR,
-                            "Cannot register HttpPostEndPoint");
-  }
 }
 
 HttpPostEndpointImpl::~HttpPostEndpointImpl ()
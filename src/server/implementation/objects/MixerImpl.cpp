@@ -29,6 +29,8 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMixerImpl"
 
 #define FACTORY_NAME "selectablemixer"
+#define SKIP_SILENT_AUDIO "skip-silent-audio"
+#define MIXED_AUDIO_INPUTS "mixed-audio-inputs"
 
 namespace kurento
 {
@@ -106,6 +108,29 @@ void MixerImpl::disconnect (std::shared_ptr<MediaType> media,
   }
 }
 
+bool MixerImpl::getSkipSilentAudio ()
+{
+  gboolean skip;
+
+  g_object_get (G_OBJECT (element), SKIP_SILENT_AUDIO, &skip, NULL);
+
+  return skip;
+}
+
+void MixerImpl::setSkipSilentAudio (bool skipSilentAudio)
+{
+  g_object_set (G_OBJECT (element), SKIP_SILENT_AUDIO, skipSilentAudio, NULL);
+}
+
+int MixerImpl::getMixedAudioInputs ()
+{
+  guint mixed;
+
+  g_object_get (G_OBJECT (element), MIXED_AUDIO_INPUTS, &mixed, NULL);
+
+  return mixed;
+}
+
 MediaObjectImpl *
 MixerImplFactory::createObject (const boost::property_tree::ptree &conf,
                                 std::shared_ptr<MediaPipeline> mediaPipeline) const
@@ -48,6 +48,10 @@ public:
   virtual void disconnect (std::shared_ptr<MediaType> media,
       std::shared_ptr<HubPort> source, std::shared_ptr<HubPort> sink) override;
 
+  bool getSkipSilentAudio () override;
+  void setSkipSilentAudio (bool skipSilentAudio) override;
+  int getMixedAudioInputs () override;
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
       std::shared_ptr<EventHandler> handler) override;
@@ -17,6 +17,9 @@
 #include <gst/gst.h>
 #include "MediaPipeline.hpp"
 #include "VideoInfo.hpp"
+#include "SeekMode.hpp"
+#include "PlayerStats.hpp"
+#include "StatsType.hpp"
 #include <PlayerEndpointImplFactory.hpp>
 #include "PlayerEndpointImpl.hpp"
 #include <DotGraph.hpp>
@@ -25,6 +28,9 @@
 #include <memory>
 #include <gst/gst.h>
 #include "SignalHandler.hpp"
+#include <commons/kmsutils.h>
+#include "CpuStats.hpp"
+#include <kmslatencysampler.h>
 
 #define GST_CAT_DEFAULT kurento_player_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -35,8 +41,12 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define POSITION "position"
 #define PIPELINE "pipeline"
 #define SET_POSITION "set-position"
+#define SEEK_MODE "seek-mode"
+#define PLAYER_STATS_FIELD "player-stats"
 #define NS_TO_MS 1000000
 #define RTSP_CLIENT_PORT_RANGE "rtspClientPortRange"
+#define PARAM_LATENCY_SAMPLE_EVERY "latencySampleEvery"
+#define PARAM_LATENCY_SAMPLE_INTERVAL "latencySampleInterval"
 
 namespace kurento
 {
@@ -117,6 +127,18 @@ PlayerEndpointImpl::PlayerEndpointImpl (const boost::property_tree::ptree &conf,
       RTSP_CLIENT_PORT_RANGE)) {
     g_object_set (G_OBJECT (element), "port-range", portRange.c_str(), NULL);
   }
+
+  uint latencySampleEvery, latencySampleInterval;
+
+  getConfigValue <uint, PlayerEndpoint> (&latencySampleEvery,
+      PARAM_LATENCY_SAMPLE_EVERY, KMS_LATENCY_SAMPLE_EVERY_DEFAULT);
+  getConfigValue <uint, PlayerEndpoint> (&latencySampleInterval,
+      PARAM_LATENCY_SAMPLE_INTERVAL,
+      KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND);
+
+  g_object_set (G_OBJECT (element), KMS_LATENCY_SAMPLE_EVERY,
+                latencySampleEvery, KMS_LATENCY_SAMPLE_INTERVAL,
+                latencySampleInterval, NULL);
 }
 
 PlayerEndpointImpl::~PlayerEndpointImpl()
@@ -190,6 +212,60 @@ void PlayerEndpointImpl::setPosition (int64_t position)
   }
 }
 
+std::shared_ptr<SeekMode> PlayerEndpointImpl::getSeekMode ()
+{
+  gint mode;
+
+  g_object_get (G_OBJECT (element), SEEK_MODE, &mode, NULL);
+
+  switch (mode) {
+  case SeekMode::KEYFRAME:
+    return std::make_shared<SeekMode> (SeekMode::KEYFRAME);
+
+  default:
+    return std::make_shared<SeekMode> (SeekMode::ACCURATE);
+  }
+}
+
+void PlayerEndpointImpl::setSeekMode (std::shared_ptr<SeekMode> seekMode)
+{
+  /* Values match KmsPlayerSeekMode */
+  g_object_set (G_OBJECT (element), SEEK_MODE, (gint) seekMode->getValue (),
+                NULL);
+}
+
+void
+PlayerEndpointImpl::fillStatsReport (std::map
+                                     <std::string, std::shared_ptr<Stats>>
+                                     &report, const GstStructure *stats,
+                                     double timestamp, int64_t timestampMillis)
+{
+  const GstStructure *p_stats;
+  guint64 seekCount = 0, indexHits = 0, lastLatency = 0, avgLatency = 0;
+  std::string id = getId () + "_player";
+
+  UriEndpointImpl::fillStatsReport (report, stats, timestamp, timestampMillis);
+
+  fillCpuStatsReport (report, getId () + "_cpu", stats, timestamp,
+                      timestampMillis);
+
+  p_stats = kms_utils_get_structure_by_name (stats, PLAYER_STATS_FIELD);
+
+  if (p_stats == nullptr) {
+    return;
+  }
+
+  gst_structure_get (p_stats, "seek-count", G_TYPE_UINT64, &seekCount,
+                     "keyframe-index-hits", G_TYPE_UINT64, &indexHits,
+                     "last-seek-latency", G_TYPE_UINT64, &lastLatency,
+                     "avg-seek-latency", G_TYPE_UINT64, &avgLatency, NULL);
+
+  report[id] = std::make_shared <PlayerStats> (id,
+               std::make_shared <StatsType> (StatsType::endpoint), timestamp,
+               timestampMillis, seekCount, indexHits,
+               (double) lastLatency / NS_TO_MS, (double) avgLatency / NS_TO_MS);
+}
+
 void PlayerEndpointImpl::play ()
 {
   start();
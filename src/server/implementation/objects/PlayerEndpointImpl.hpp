@@ -26,6 +26,7 @@ namespace kurento
 {
 
 class MediaPipeline;
+class SeekMode;
 class PlayerEndpointImpl;
 
 void Serialize (std::shared_ptr<PlayerEndpointImpl> &object,
@@ -50,6 +51,9 @@ public:
   virtual int64_t getPosition() override;
   virtual void setPosition (int64_t position) override;
 
+  virtual std::shared_ptr<SeekMode> getSeekMode () override;
+  virtual void setSeekMode (std::shared_ptr<SeekMode> seekMode) override;
+
   virtual std::string getElementGstreamerDot() override;
 
   /* Next methods are automatically implemented by code generator */
@@ -68,6 +72,10 @@ public:
 protected:
   virtual void postConstructor () override;
 
+  virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+                                &report, const GstStructure *stats,
+                                double timestamp, int64_t timestampMillis) override;
+
 private:
 
   gulong signalEOS = 0;
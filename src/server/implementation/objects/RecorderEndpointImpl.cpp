@@ -18,6 +18,8 @@
 #include "MediaType.hpp"
 #include "MediaPipeline.hpp"
 #include "MediaProfileSpecType.hpp"
+#include "RecorderPassthroughMode.hpp"
+#include "RecorderStreamStats.hpp"
 #include <RecorderEndpointImplFactory.hpp>
 #include "RecorderEndpointImpl.hpp"
 #include <jsonrpc/JsonSerializer.hpp>
@@ -29,6 +31,8 @@
 #include "EndpointStats.hpp"
 #include <commons/kmsutils.h>
 #include <commons/kmsstats.h>
+#include "CpuStats.hpp"
+#include "LatencyStats.hpp"
 
 #include <SignalHandler.hpp>
 #include <functional>
@@ -41,6 +45,9 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define TIMEOUT 4 /* seconds */
 
+#define PASSTHROUGH_MODE "passthrough-mode"
+#define RECORDER_STREAMS_FIELD "recorder-streams"
+
 namespace kurento
 {
 
@@ -144,6 +151,13 @@ RecorderEndpointImpl::RecorderEndpointImpl (const boost::property_tree::ptree
     g_object_set ( G_OBJECT (element), "profile", KMS_RECORDING_PROFILE_KSR, NULL);
     GST_INFO ("Set KSR profile");
     break;
+
+  case MediaProfileSpecType::RTP_DUMP:
+    /* The muxing profile is not used, only the packets are written */
+    g_object_set ( G_OBJECT (element), "rtp-dump", TRUE, "profile",
+                   KMS_RECORDING_PROFILE_WEBM, NULL);
+    GST_INFO ("Set RTP dump profile");
+    break;
   }
 }
 
@@ -265,6 +279,32 @@ void RecorderEndpointImpl::stopAndWait ()
   waitForStateChange (KMS_URI_END_POINT_STATE_STOP);
 }
 
+std::shared_ptr<RecorderPassthroughMode>
+RecorderEndpointImpl::getPassthroughMode ()
+{
+  gint mode;
+
+  g_object_get (G_OBJECT (element), PASSTHROUGH_MODE, &mode, NULL);
+
+  switch (mode) {
+  case RecorderPassthroughMode::STRICT:
+    return std::make_shared<RecorderPassthroughMode>
+           (RecorderPassthroughMode::STRICT);
+
+  default:
+    return std::make_shared<RecorderPassthroughMode>
+           (RecorderPassthroughMode::FALLBACK);
+  }
+}
+
+void RecorderEndpointImpl::setPassthroughMode (
+  std::shared_ptr<RecorderPassthroughMode> passthroughMode)
+{
+  /* Values match KmsRecorderPassthroughMode */
+  g_object_set (G_OBJECT (element), PASSTHROUGH_MODE,
+                (gint) passthroughMode->getValue (), NULL);
+}
+
 static void
 setDeprecatedProperties (std::shared_ptr<EndpointStats> eStats)
 {
@@ -308,6 +348,49 @@ RecorderEndpointImpl::collectEndpointStats (std::map
   statsReport[id] = endpointStats;
 }
 
+void
+RecorderEndpointImpl::collectStreamStats (std::map
+    <std::string, std::shared_ptr<Stats>>
+    &statsReport, const GstStructure *stats,
+    double timestamp, int64_t timestampMillis)
+{
+  gint i, n;
+
+  n = gst_structure_n_fields (stats);
+
+  for (i = 0; i < n; i++) {
+    const gchar *name = gst_structure_nth_field_name (stats, i);
+    const GValue *value = gst_structure_get_value (stats, name);
+    const GstStructure *stream;
+    const gchar *type, *codec, *sourceCodec;
+    gboolean transcoded = FALSE, rejected = FALSE;
+    std::shared_ptr<MediaType> mediaType;
+    std::string id = getId () + "_" + name;
+
+    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
+      continue;
+    }
+
+    stream = gst_value_get_structure (value);
+    type = gst_structure_get_string (stream, "type");
+    codec = gst_structure_get_string (stream, "codec");
+    sourceCodec = gst_structure_get_string (stream, "source-codec");
+    gst_structure_get_boolean (stream, "transcoded", &transcoded);
+    gst_structure_get_boolean (stream, "rejected", &rejected);
+
+    if (g_strcmp0 (type, "audio") == 0) {
+      mediaType = std::make_shared <MediaType> (MediaType::AUDIO);
+    } else {
+      mediaType = std::make_shared <MediaType> (MediaType::VIDEO);
+    }
+
+    statsReport[id] = std::make_shared <RecorderStreamStats> (id,
+                      std::make_shared <StatsType> (StatsType::endpoint), timestamp,
+                      timestampMillis, mediaType, codec != nullptr ? codec : "",
+                      sourceCodec != nullptr ? sourceCodec : "", transcoded, rejected);
+  }
+}
+
 void
 RecorderEndpointImpl::fillStatsReport (std::map
                                        <std::string, std::shared_ptr<Stats>>
@@ -323,6 +406,17 @@ RecorderEndpointImpl::fillStatsReport (std::map
   }
 
   UriEndpointImpl::fillStatsReport (report, stats, timestamp, timestampMillis);
+
+  fillCpuStatsReport (report, getId () + "_cpu", stats, timestamp,
+                      timestampMillis);
+  fillLatencyPercentilesReport (report, getId () + "_latency_", stats,
+                                timestamp, timestampMillis);
+
+  e_stats = kms_utils_get_structure_by_name (stats, RECORDER_STREAMS_FIELD);
+
+  if (e_stats != nullptr) {
+    collectStreamStats (report, e_stats, timestamp, timestampMillis);
+  }
 }
 
 MediaObjectImpl *
@@ -27,6 +27,7 @@ namespace kurento
 
 class MediaPipeline;
 class MediaProfileSpecType;
+class RecorderPassthroughMode;
 class RecorderEndpointImpl;
 
 void Serialize (std::shared_ptr<RecorderEndpointImpl> &object,
@@ -47,6 +48,11 @@ public:
   void record () override;
   virtual void stopAndWait () override;
 
+  virtual std::shared_ptr<RecorderPassthroughMode> getPassthroughMode ()
+  override;
+  virtual void setPassthroughMode (std::shared_ptr<RecorderPassthroughMode>
+                                   passthroughMode) override;
+
   /* Next methods are automatically implemented by code generator */
   using UriEndpointImpl::connect;
   virtual bool connect (const std::string &eventType,
@@ -83,6 +89,9 @@ private:
   void collectEndpointStats (std::map <std::string, std::shared_ptr<Stats>>
                              &statsReport, std::string id, const GstStructure *stats,
                              double timestamp, int64_t timestampMillis);
+  void collectStreamStats (std::map <std::string, std::shared_ptr<Stats>>
+                           &statsReport, const GstStructure *stats,
+                           double timestamp, int64_t timestampMillis);
 
   class StaticConstructor
   {
@@ -24,6 +24,7 @@
 #include <CryptoSuite.hpp>
 #include <SDES.hpp>
 #include <SignalHandler.hpp>
+#include <kmslatencysampler.h>
 #include <memory>
 #include <string>
 
@@ -33,6 +34,9 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define FACTORY_NAME "rtpendpoint"
 
+#define PARAM_LATENCY_SAMPLE_EVERY "latencySampleEvery"
+#define PARAM_LATENCY_SAMPLE_INTERVAL "latencySampleInterval"
+
 /* In theory the Master key can be shorter than the maximum length, but
  * the GStreamer's SRTP plugin enforces using the maximum length possible
  * for the type of cypher used (in file 'gstsrtpenc.c'). So, KMS also expects
@@ -50,6 +54,18 @@ RtpEndpointImpl::RtpEndpointImpl (const boost::property_tree::ptree &conf,
                          std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline),
                          FACTORY_NAME, useIpv6)
 {
+  uint latencySampleEvery, latencySampleInterval;
+
+  getConfigValue <uint, RtpEndpoint> (&latencySampleEvery,
+      PARAM_LATENCY_SAMPLE_EVERY, KMS_LATENCY_SAMPLE_EVERY_DEFAULT);
+  getConfigValue <uint, RtpEndpoint> (&latencySampleInterval,
+      PARAM_LATENCY_SAMPLE_INTERVAL,
+      KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND);
+
+  g_object_set (G_OBJECT (element), KMS_LATENCY_SAMPLE_EVERY,
+                latencySampleEvery, KMS_LATENCY_SAMPLE_INTERVAL,
+                latencySampleInterval, NULL);
+
   if (!crypto->isSetCrypto() ) {
     return;
   }
@@ -116,6 +132,10 @@ RtpEndpointImpl::~RtpEndpointImpl()
   if (handlerOnKeySoftLimit > 0) {
     unregister_signal_handler (element, handlerOnKeySoftLimit);
   }
+
+  if (handlerVoiceActivityChanged > 0) {
+    unregister_signal_handler (element, handlerVoiceActivityChanged);
+  }
 }
 
 void
@@ -130,6 +150,14 @@ RtpEndpointImpl::postConstructor ()
                                       std::placeholders::_2) ),
                           std::dynamic_pointer_cast<RtpEndpointImpl>
                           (shared_from_this() ) );
+
+  handlerVoiceActivityChanged = register_signal_handler (G_OBJECT (element),
+                                "voice-activity-changed",
+                                std::function <void (GstElement *, gboolean) >
+                                (std::bind (&RtpEndpointImpl::onVoiceActivityChanged, this,
+                                    std::placeholders::_2) ),
+                                std::dynamic_pointer_cast<RtpEndpointImpl>
+                                (shared_from_this() ) );
 }
 
 void
@@ -159,6 +187,48 @@ RtpEndpointImpl::onKeySoftLimit (gchar *media)
   }
 }
 
+void
+RtpEndpointImpl::onVoiceActivityChanged (gboolean active)
+{
+  try {
+    VoiceActivityChanged event (shared_from_this (),
+        VoiceActivityChanged::getName (), active);
+    sigcSignalEmit(signalVoiceActivityChanged, event);
+  } catch (const std::bad_weak_ptr &e) {
+    // shared_from_this()
+    GST_ERROR ("BUG creating %s: %s", VoiceActivityChanged::getName ().c_str (),
+        e.what ());
+  }
+}
+
+int
+RtpEndpointImpl::getAudioLevel ()
+{
+  guint level;
+
+  g_object_get (G_OBJECT (element), "audio-level", &level, NULL);
+
+  return level;
+}
+
+int
+RtpEndpointImpl::getFecOverhead ()
+{
+  guint overhead;
+
+  g_object_get (G_OBJECT (element), "fec-overhead", &overhead, NULL);
+
+  return overhead;
+}
+
+void
+RtpEndpointImpl::setFecOverhead (int fecOverhead)
+{
+  GST_INFO ("Set FEC overhead: %d", fecOverhead);
+  g_object_set (G_OBJECT (element), "fec-overhead",
+      (guint) CLAMP (fecOverhead, 0, 100), NULL);
+}
+
 MediaObjectImpl *
 RtpEndpointImplFactory::createObject (const boost::property_tree::ptree &conf,
                                       std::shared_ptr<MediaPipeline> mediaPipeline,
@@ -41,7 +41,13 @@ public:
 
   virtual ~RtpEndpointImpl ();
 
+  int getAudioLevel () override;
+
+  int getFecOverhead () override;
+  void setFecOverhead (int fecOverhead) override;
+
   sigc::signal<void, OnKeySoftLimit> signalOnKeySoftLimit;
+  sigc::signal<void, VoiceActivityChanged> signalVoiceActivityChanged;
 
   /* Next methods are automatically implemented by code generator */
   using BaseRtpEndpointImpl::connect;
@@ -62,6 +68,9 @@ private:
   gulong handlerOnKeySoftLimit = 0;
   void onKeySoftLimit (gchar *media);
 
+  gulong handlerVoiceActivityChanged = 0;
+  void onVoiceActivityChanged (gboolean active);
+
   class StaticConstructor
   {
   public:
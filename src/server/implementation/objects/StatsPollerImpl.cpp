@@ -0,0 +1,113 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/gst.h>
+#include "MediaPipeline.hpp"
+#include "MediaPipelineImpl.hpp"
+#include <StatsPollerImplFactory.hpp>
+#include "StatsPollerImpl.hpp"
+#include "ElementCounters.hpp"
+#include <jsonrpc/JsonSerializer.hpp>
+#include <KurentoException.hpp>
+
+#define GST_CAT_DEFAULT kurento_stats_poller_impl
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoStatsPollerImpl"
+
+namespace kurento
+{
+
+StatsPollerImpl::StatsPollerImpl (const boost::property_tree::ptree &conf,
+                                  std::shared_ptr<MediaPipeline> mediaPipeline) : MediaObjectImpl (conf,
+                                        std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline) )
+{
+  pipeline = std::dynamic_pointer_cast<MediaPipelineImpl>
+             (mediaPipeline)->getPipeline ();
+}
+
+std::vector<std::shared_ptr<ElementCounters>>
+StatsPollerImpl::poll ()
+{
+  std::vector<std::shared_ptr<ElementCounters>> counters;
+  std::unique_lock<std::mutex> lock (mutex);
+  /* Snapshot timestamps are monotonic */
+  gint64 offset = g_get_real_time () - g_get_monotonic_time ();
+
+  collector.collect (GST_BIN (pipeline),
+  [&] (const KmsStatsSnapshot & snapshot) {
+    std::shared_ptr<ElementCounters> entry;
+    gchar *name = gst_element_get_name (snapshot.element);
+
+    entry = std::make_shared<ElementCounters> (name,
+            (snapshot.timestamp + offset) / 1000);
+    g_free (name);
+
+    if (snapshot.changed & KMS_STATS_COUNTER_MASK (
+          KMS_STATS_COUNTER_PACKETS_RECEIVED) ) {
+      entry->setPacketsReceived (
+        snapshot.values[KMS_STATS_COUNTER_PACKETS_RECEIVED]);
+    }
+
+    if (snapshot.changed & KMS_STATS_COUNTER_MASK (
+          KMS_STATS_COUNTER_BYTES_RECEIVED) ) {
+      entry->setBytesReceived (
+        snapshot.values[KMS_STATS_COUNTER_BYTES_RECEIVED]);
+    }
+
+    if (snapshot.changed & KMS_STATS_COUNTER_MASK (
+          KMS_STATS_COUNTER_PACKETS_SENT) ) {
+      entry->setPacketsSent (snapshot.values[KMS_STATS_COUNTER_PACKETS_SENT]);
+    }
+
+    if (snapshot.changed & KMS_STATS_COUNTER_MASK (
+          KMS_STATS_COUNTER_BYTES_SENT) ) {
+      entry->setBytesSent (snapshot.values[KMS_STATS_COUNTER_BYTES_SENT]);
+    }
+
+    if (snapshot.changed & KMS_STATS_COUNTER_MASK (
+          KMS_STATS_COUNTER_CPU_TIME) ) {
+      entry->setCpuTime (snapshot.values[KMS_STATS_COUNTER_CPU_TIME]);
+    }
+
+    if (snapshot.changed & KMS_STATS_COUNTER_MASK (
+          KMS_STATS_COUNTER_THREADS) ) {
+      entry->setThreads (snapshot.values[KMS_STATS_COUNTER_THREADS]);
+    }
+
+    counters.push_back (entry);
+  });
+
+  GST_TRACE ("Polled %zu elements", counters.size () );
+
+  return counters;
+}
+
+MediaObjectImpl *
+StatsPollerImplFactory::createObject (const boost::property_tree::ptree &conf,
+                                      std::shared_ptr<MediaPipeline> mediaPipeline) const
+{
+  return new StatsPollerImpl (conf, mediaPipeline);
+}
+
+StatsPollerImpl::StaticConstructor StatsPollerImpl::staticConstructor;
+
+StatsPollerImpl::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
@@ -35,13 +35,22 @@
 #include <RTCDataChannelStats.hpp>
 #include <RTCPeerConnectionStats.hpp>
 #include <commons/kmsstats.h>
+#include "BandwidthStats.hpp"
+#include "CpuStats.hpp"
+#include "LatencyStats.hpp"
+#include <kmslatencysampler.h>
+#include "RetransmissionStats.hpp"
 #include <commons/kmsutils.h>
 #include <commons/gstsdpdirection.h>
 
 #include "webrtcendpoint/kmswebrtcdatachannelstate.h"
+#include "webrtcendpoint/kmswebrtcrtxcache.h"
 #include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+#include <cstdlib>
 
 #include <CertificateManager.hpp>
+#include <CertificateService.hpp>
 
 #define GST_CAT_DEFAULT kurento_web_rtc_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -52,16 +61,40 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define CONFIG_PATH "configPath"
 #define DEFAULT_PATH "/etc/kurento"
 
+#define MODULES_CONFIG_PATH_ENV "KURENTO_MODULES_CONFIG_PATH"
+#define DEFAULT_MODULES_CONFIG_PATH "/etc/kurento/modules"
+#define MODULE_CONFIG_FILE "kurento/WebRtcEndpoint.conf.ini"
+
 #define PARAM_EXTERNAL_ADDRESS "externalAddress"
 #define PARAM_NETWORK_INTERFACES "networkInterfaces"
 
+#define PARAM_CERTIFICATE_CACHE_DIR "certificateCacheDir"
+#define PARAM_CERTIFICATE_ROTATION_INTERVAL "certificateRotationInterval"
+#define PARAM_CERTIFICATE_POOL_SIZE "certificatePoolSize"
+
+#define PARAM_RTX_CACHE_TIME "rtxCacheTime"
+#define PARAM_RTX_CACHE_SIZE "rtxCacheSize"
+#define PARAM_RTX_CACHE_PROCESS_SIZE "rtxCacheProcessSize"
+#define PARAM_LATENCY_SAMPLE_EVERY "latencySampleEvery"
+#define PARAM_LATENCY_SAMPLE_INTERVAL "latencySampleInterval"
+
 #define PROP_EXTERNAL_ADDRESS "external-address"
 #define PROP_NETWORK_INTERFACES "network-interfaces"
+#define PROP_AUDIO_LEVEL "audio-level"
+#define PROP_SIMULCAST_LAYER "simulcast-layer"
+#define PROP_SIMULCAST_LAYERS "simulcast-layers"
+#define PROP_SIMULCAST_MAX_BITRATE "simulcast-max-bitrate"
+#define PROP_RTX_CACHE_TIME "rtx-cache-time"
+#define PROP_RTX_CACHE_SIZE "rtx-cache-size"
+#define PROP_RTX_CACHE_PROCESS_SIZE "rtx-cache-process-size"
+#define PROP_FEC_OVERHEAD "fec-overhead"
 
 namespace kurento
 {
 
 static const uint DEFAULT_STUN_PORT = 3478;
+static const uint DEFAULT_CERTIFICATE_POOL_SIZE = 0;
+static const uint DEFAULT_CERTIFICATE_ROTATION_INTERVAL = 0;
 
 static std::once_flag check_openh264, certificates_flag;
 static std::string defaultCertificateRSA, defaultCertificateECDSA;
@@ -138,12 +171,89 @@ check_support_for_h264 ()
   gst_object_unref (plugin);
 }
 
+/* Endpoints only get their settings once they are created, too late to have
+ * the keys of the first one ready. The certificate settings are read from the
+ * module configuration file instead, so that the service starts filling its
+ * pool when the module is loaded. Without the file, the first endpoint
+ * starts it */
+static void
+start_certificate_service ()
+{
+  const char *env = getenv (MODULES_CONFIG_PATH_ENV);
+  std::vector<std::string> paths;
+  boost::property_tree::ptree config;
+  std::string file;
+
+  boost::split (paths, std::string (env != nullptr ? env :
+                                    DEFAULT_MODULES_CONFIG_PATH), boost::is_any_of (":") );
+
+  for (const std::string &path : paths) {
+    boost::filesystem::path candidate =
+      boost::filesystem::path (path) / MODULE_CONFIG_FILE;
+
+    if (boost::filesystem::exists (candidate) ) {
+      file = candidate.string ();
+      break;
+    }
+  }
+
+  if (file.empty () ) {
+    GST_INFO ("%s not found, certificates are generated with the first"
+              " WebRtcEndpoint", MODULE_CONFIG_FILE);
+    return;
+  }
+
+  try {
+    boost::property_tree::ini_parser::read_ini (file, config);
+  } catch (boost::property_tree::ini_parser_error &e) {
+    GST_WARNING ("Cannot read %s: %s", file.c_str (), e.what () );
+    return;
+  }
+
+  std::string cacheDir = config.get <std::string>
+                         (PARAM_CERTIFICATE_CACHE_DIR, "");
+
+  if (!cacheDir.empty () && !boost::starts_with (cacheDir, "/") ) {
+    cacheDir = config.get <std::string> (CONFIG_PATH, DEFAULT_PATH) + "/" +
+               cacheDir;
+  }
+
+  CertificateService::getInstance ().configure (cacheDir,
+      std::chrono::seconds (config.get <uint>
+                            (PARAM_CERTIFICATE_ROTATION_INTERVAL,
+                             DEFAULT_CERTIFICATE_ROTATION_INTERVAL) ),
+      config.get <uint> (PARAM_CERTIFICATE_POOL_SIZE,
+                         DEFAULT_CERTIFICATE_POOL_SIZE) );
+}
+
 void
 WebRtcEndpointImpl::generateDefaultCertificates ()
 {
+  std::string cacheDir;
+  uint rotationInterval = DEFAULT_CERTIFICATE_ROTATION_INTERVAL;
+  uint poolSize = DEFAULT_CERTIFICATE_POOL_SIZE;
+
   defaultCertificateECDSA = "";
   defaultCertificateRSA = "";
 
+  /* Certificates not loaded from a file are taken from the certificate
+   * service, which generates them in background. It is usually started
+   * already, from the module configuration file */
+  getConfigValue <std::string, WebRtcEndpoint> (&cacheDir,
+      PARAM_CERTIFICATE_CACHE_DIR);
+
+  if (!cacheDir.empty () ) {
+    checkUri (cacheDir);
+  }
+
+  getConfigValue <uint, WebRtcEndpoint> (&rotationInterval,
+                                         PARAM_CERTIFICATE_ROTATION_INTERVAL, DEFAULT_CERTIFICATE_ROTATION_INTERVAL);
+  getConfigValue <uint, WebRtcEndpoint> (&poolSize,
+                                         PARAM_CERTIFICATE_POOL_SIZE, DEFAULT_CERTIFICATE_POOL_SIZE);
+
+  CertificateService::getInstance ().configure (cacheDir,
+      std::chrono::seconds (rotationInterval), poolSize);
+
   std::string pemUriRSA;
   if (getConfigValue <std::string, WebRtcEndpoint> (&pemUriRSA,
       "pemCertificateRSA")) {
@@ -156,7 +266,6 @@ WebRtcEndpointImpl::generateDefaultCertificates ()
       defaultCertificateRSA = getCerficateFromFile (pemUri);
     } else {
       GST_INFO ("Unable to load the RSA certificate from file. Using the default certificate.");
-      defaultCertificateRSA = CertificateManager::generateRSACertificate ();
     }
   }
 
@@ -166,7 +275,6 @@ WebRtcEndpointImpl::generateDefaultCertificates ()
     defaultCertificateECDSA = getCerficateFromFile (pemUriECDSA);
   } else {
     GST_INFO ("Unable to load the ECDSA certificate from file. Using the default certificate.");
-    defaultCertificateECDSA = CertificateManager::generateECDSACertificate ();
   }
 }
 
@@ -402,6 +510,20 @@ WebRtcEndpointImpl::onDataChannelClosed (gchar *sessId, guint stream_id)
   }
 }
 
+void
+WebRtcEndpointImpl::onVoiceActivityChanged (gboolean active)
+{
+  try {
+    VoiceActivityChanged event (shared_from_this (),
+        VoiceActivityChanged::getName (), active);
+    sigcSignalEmit(signalVoiceActivityChanged, event);
+  } catch (const std::bad_weak_ptr &e) {
+    // shared_from_this()
+    GST_ERROR ("BUG creating %s: %s", VoiceActivityChanged::getName ().c_str (),
+        e.what ());
+  }
+}
+
 void WebRtcEndpointImpl::postConstructor ()
 {
   BaseRtpEndpointImpl::postConstructor ();
@@ -456,6 +578,14 @@ void WebRtcEndpointImpl::postConstructor ()
                                    std::placeholders::_2, std::placeholders::_3) ),
                                std::dynamic_pointer_cast<WebRtcEndpointImpl>
                                (shared_from_this() ) );
+
+  handlerVoiceActivityChanged = register_signal_handler (G_OBJECT (element),
+                                "voice-activity-changed",
+                                std::function <void (GstElement *, gboolean) >
+                                (std::bind (&WebRtcEndpointImpl::onVoiceActivityChanged, this,
+                                    std::placeholders::_2) ),
+                                std::dynamic_pointer_cast<WebRtcEndpointImpl>
+                                (shared_from_this() ) );
 }
 
 std::string
@@ -554,6 +684,32 @@ WebRtcEndpointImpl::WebRtcEndpointImpl (const boost::property_tree::ptree &conf,
     g_object_set (G_OBJECT (element), "stun-server", stunAddress.c_str(), NULL);
   }
 
+  uint rtxCacheTime, rtxCacheSize, rtxCacheProcessSize;
+
+  getConfigValue <uint, WebRtcEndpoint> (&rtxCacheTime, PARAM_RTX_CACHE_TIME,
+                                         KMS_WEBRTC_RTX_CACHE_DEFAULT_TIME);
+  getConfigValue <uint, WebRtcEndpoint> (&rtxCacheSize, PARAM_RTX_CACHE_SIZE,
+                                         KMS_WEBRTC_RTX_CACHE_DEFAULT_SIZE);
+  getConfigValue <uint, WebRtcEndpoint> (&rtxCacheProcessSize,
+                                         PARAM_RTX_CACHE_PROCESS_SIZE, KMS_WEBRTC_RTX_CACHE_DEFAULT_PROCESS_SIZE);
+
+  /* Set where the element accounts it */
+  g_object_set (G_OBJECT (element), PROP_RTX_CACHE_TIME, rtxCacheTime,
+                PROP_RTX_CACHE_SIZE, rtxCacheSize, PROP_RTX_CACHE_PROCESS_SIZE,
+                rtxCacheProcessSize, NULL);
+
+  uint latencySampleEvery, latencySampleInterval;
+
+  getConfigValue <uint, WebRtcEndpoint> (&latencySampleEvery,
+      PARAM_LATENCY_SAMPLE_EVERY, KMS_LATENCY_SAMPLE_EVERY_DEFAULT);
+  getConfigValue <uint, WebRtcEndpoint> (&latencySampleInterval,
+      PARAM_LATENCY_SAMPLE_INTERVAL,
+      KMS_LATENCY_SAMPLE_INTERVAL_DEFAULT / GST_MSECOND);
+
+  g_object_set (G_OBJECT (element), KMS_LATENCY_SAMPLE_EVERY,
+                latencySampleEvery, KMS_LATENCY_SAMPLE_INTERVAL,
+                latencySampleInterval, NULL);
+
   std::string turnURL;
   if (getConfigValue <std::string, WebRtcEndpoint> (&turnURL, "turnURL")) {
     std::string safeURL = "<user:password>";
@@ -571,22 +727,26 @@ WebRtcEndpointImpl::WebRtcEndpointImpl (const boost::property_tree::ptree &conf,
               " remember that NAT traversal requires STUN or TURN");
   }
 
+  std::string certificate;
+
   switch (certificateKeyType->getValue () ) {
   case CertificateKeyType::RSA: {
-    if (defaultCertificateRSA != "") {
-      g_object_set ( G_OBJECT (element), "pem-certificate",
-                     defaultCertificateRSA.c_str(),
-                     NULL);
+    certificate = defaultCertificateRSA;
+
+    if (certificate == "") {
+      certificate = CertificateService::getInstance ().getCertificate (
+                      CertificateService::KeyType::RSA);
     }
 
     break;
   }
 
   case CertificateKeyType::ECDSA: {
-    if (defaultCertificateECDSA != "") {
-      g_object_set ( G_OBJECT (element), "pem-certificate",
-                     defaultCertificateECDSA.c_str(),
-                     NULL);
+    certificate = defaultCertificateECDSA;
+
+    if (certificate == "") {
+      certificate = CertificateService::getInstance ().getCertificate (
+                      CertificateService::KeyType::ECDSA);
     }
 
     break;
@@ -595,6 +755,11 @@ WebRtcEndpointImpl::WebRtcEndpointImpl (const boost::property_tree::ptree &conf,
   default:
     GST_ERROR ("Certificate key not supported");
   }
+
+  if (certificate != "") {
+    g_object_set ( G_OBJECT (element), "pem-certificate", certificate.c_str(),
+                   NULL);
+  }
 }
 
 WebRtcEndpointImpl::~WebRtcEndpointImpl()
@@ -622,6 +787,84 @@ WebRtcEndpointImpl::~WebRtcEndpointImpl()
   if (handlerNewSelectedPairFull > 0) {
     unregister_signal_handler (element, handlerNewSelectedPairFull);
   }
+
+  if (handlerVoiceActivityChanged > 0) {
+    unregister_signal_handler (element, handlerVoiceActivityChanged);
+  }
+}
+
+int
+WebRtcEndpointImpl::getAudioLevel ()
+{
+  guint level;
+
+  g_object_get (G_OBJECT (element), PROP_AUDIO_LEVEL, &level, NULL);
+
+  return level;
+}
+
+int
+WebRtcEndpointImpl::getFecOverhead ()
+{
+  guint overhead;
+
+  g_object_get (G_OBJECT (element), PROP_FEC_OVERHEAD, &overhead, NULL);
+
+  return overhead;
+}
+
+void
+WebRtcEndpointImpl::setFecOverhead (int fecOverhead)
+{
+  GST_INFO ("Set FEC overhead: %d", fecOverhead);
+  g_object_set (G_OBJECT (element), PROP_FEC_OVERHEAD,
+      (guint) CLAMP (fecOverhead, 0, 100), NULL);
+}
+
+int
+WebRtcEndpointImpl::getSimulcastLayer ()
+{
+  gint layer;
+
+  g_object_get (G_OBJECT (element), PROP_SIMULCAST_LAYER, &layer, NULL);
+
+  return layer;
+}
+
+void
+WebRtcEndpointImpl::setSimulcastLayer (int simulcastLayer)
+{
+  GST_INFO ("Set simulcast layer: %d", simulcastLayer);
+  g_object_set (G_OBJECT (element), PROP_SIMULCAST_LAYER,
+      MAX (simulcastLayer, -1), NULL);
+}
+
+int
+WebRtcEndpointImpl::getSimulcastLayers ()
+{
+  guint layers;
+
+  g_object_get (G_OBJECT (element), PROP_SIMULCAST_LAYERS, &layers, NULL);
+
+  return layers;
+}
+
+int
+WebRtcEndpointImpl::getSimulcastMaxBitrate ()
+{
+  guint bitrate;
+
+  g_object_get (G_OBJECT (element), PROP_SIMULCAST_MAX_BITRATE, &bitrate,
+      NULL);
+
+  return bitrate;
+}
+
+void
+WebRtcEndpointImpl::setSimulcastMaxBitrate (int simulcastMaxBitrate)
+{
+  g_object_set (G_OBJECT (element), PROP_SIMULCAST_MAX_BITRATE,
+      (guint) MAX (simulcastMaxBitrate, 0), NULL);
 }
 
 std::string
@@ -1047,6 +1290,15 @@ WebRtcEndpointImpl::fillStatsReport (std::map
   BaseRtpEndpointImpl::fillStatsReport (report, stats, timestamp,
       timestampMillis);
 
+  fillCpuStatsReport (report, getId () + "_cpu", stats, timestamp,
+                      timestampMillis);
+  fillLatencyPercentilesReport (report, getId () + "_latency_", stats,
+                                timestamp, timestampMillis);
+  fillBandwidthEstimationReport (report, getId () + "_bwe_", stats,
+                                 timestamp, timestampMillis);
+  fillRetransmissionCacheReport (report, getId () + "_rtx_cache", stats,
+                                 timestamp, timestampMillis);
+
   data_stats = kms_utils_get_structure_by_name (stats,
                KMS_DATA_SESSION_STATISTICS_FIELD);
 
@@ -1073,6 +1325,8 @@ WebRtcEndpointImpl::StaticConstructor::StaticConstructor()
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
                            GST_DEFAULT_NAME);
+
+  start_certificate_service ();
 }
 
 } /* kurento */
@@ -65,6 +65,19 @@ public:
 
   std::vector<std::shared_ptr<IceConnection>> getIceConnectionState () override;
 
+  int getAudioLevel () override;
+
+  int getFecOverhead () override;
+  void setFecOverhead (int fecOverhead) override;
+
+  int getSimulcastLayer () override;
+  void setSimulcastLayer (int simulcastLayer) override;
+
+  int getSimulcastLayers () override;
+
+  int getSimulcastMaxBitrate () override;
+  void setSimulcastMaxBitrate (int simulcastMaxBitrate) override;
+
   void gatherCandidates () override;
   void addIceCandidate (std::shared_ptr<IceCandidate> candidate) override;
 
@@ -98,6 +111,8 @@ public:
   sigc::signal<void, OnDataChannelClosed> signalOnDataChannelClosed;
   sigc::signal<void, DataChannelClose> signalDataChannelClose;
 
+  sigc::signal<void, VoiceActivityChanged> signalVoiceActivityChanged;
+
   virtual void invoke (std::shared_ptr<MediaObjectImpl> obj,
                        const std::string &methodName, const Json::Value &params,
                        Json::Value &response) override;
@@ -118,6 +133,7 @@ private:
   gulong handlerOnDataChannelOpened = 0;
   gulong handlerOnDataChannelClosed = 0;
   gulong handlerNewSelectedPairFull = 0;
+  gulong handlerVoiceActivityChanged = 0;
 
   void onIceCandidate (gchar *sessId, KmsIceCandidate *candidate);
   void onIceGatheringDone (gchar *sessId);
@@ -128,6 +144,7 @@ private:
                             KmsIceCandidate *remoteCandidate);
   void onDataChannelOpened (gchar *sessId, guint stream_id);
   void onDataChannelClosed (gchar *sessId, guint stream_id);
+  void onVoiceActivityChanged (gboolean active);
   void checkUri (std::string &uri);
   std::string getCerficateFromFile (std::string &path);
   void generateDefaultCertificates ();
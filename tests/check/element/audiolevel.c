@@ -0,0 +1,177 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <kmsaudiolevel.h>
+
+#define SSRC 0x1234abcd
+#define PACKETS 20
+#define EXPIRE_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+typedef struct _Activity
+{
+  GMutex mutex;
+  GCond cond;
+  guint changes;
+  gboolean active;
+} Activity;
+
+static void
+activity_changed (gboolean active, Activity * activity)
+{
+  g_mutex_lock (&activity->mutex);
+  activity->changes++;
+  activity->active = active;
+  g_cond_signal (&activity->cond);
+  g_mutex_unlock (&activity->mutex);
+}
+
+static gboolean
+wait_changes (Activity * activity, guint changes)
+{
+  gint64 end = g_get_monotonic_time () + EXPIRE_TIMEOUT;
+  gboolean done;
+
+  g_mutex_lock (&activity->mutex);
+
+  while (activity->changes < changes) {
+    if (!g_cond_wait_until (&activity->cond, &activity->mutex, end)) {
+      break;
+    }
+  }
+
+  done = activity->changes >= changes;
+  g_mutex_unlock (&activity->mutex);
+
+  return done;
+}
+
+static GstFlowReturn
+discard_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static GstPad *
+create_linked_src (void)
+{
+  GstPad *src, *sink;
+
+  src = gst_pad_new ("src", GST_PAD_SRC);
+  sink = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sink, discard_chain);
+
+  fail_unless (gst_pad_link (src, sink) == GST_PAD_LINK_OK);
+  gst_pad_set_active (sink, TRUE);
+  gst_pad_set_active (src, TRUE);
+
+  /* The sink pad stays alive as long as it is linked */
+  g_object_set_data_full (G_OBJECT (src), "peer", sink, gst_object_unref);
+
+  return src;
+}
+
+static GstBuffer *
+create_rtp (guint16 seq, guint8 level)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (160, 4, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 111);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  fail_unless (gst_rtp_buffer_add_extension_onebyte_header (&rtp,
+          KMS_AUDIO_LEVEL_EXT_ID, &level, 1));
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+/* A sender that stops sending, e.g. using DTX, is not active forever */
+GST_START_TEST (source_expires)
+{
+  KmsAudioLevel *audio_level;
+  Activity activity;
+  GstPad *src;
+  guint i;
+
+  g_mutex_init (&activity.mutex);
+  g_cond_init (&activity.cond);
+  activity.changes = 0;
+  activity.active = FALSE;
+
+  audio_level = kms_audio_level_new (NULL,
+      (KmsAudioLevelFunc) activity_changed, &activity);
+  src = create_linked_src ();
+  kms_audio_level_watch_pad (audio_level, src, KMS_AUDIO_LEVEL_EXT_ID);
+
+  for (i = 0; i < PACKETS; i++) {
+    fail_unless (gst_pad_push (src, create_rtp (i, 10)) == GST_FLOW_OK);
+  }
+
+  fail_unless (wait_changes (&activity, 1));
+  fail_unless (activity.active);
+  fail_unless (kms_audio_level_is_active (audio_level));
+  fail_unless (kms_audio_level_get_level (audio_level) <= 40);
+
+  /* No more packets: only the timer can notice it */
+  fail_unless (wait_changes (&activity, 2));
+  fail_if (activity.active);
+  fail_if (kms_audio_level_is_active (audio_level));
+  fail_unless (kms_audio_level_get_level (audio_level) ==
+      KMS_AUDIO_LEVEL_SILENCE);
+
+  /* The source was removed, a new packet starts it from silence */
+  fail_unless (gst_pad_push (src, create_rtp (i, 10)) == GST_FLOW_OK);
+  fail_unless (kms_audio_level_get_level (audio_level) > 40);
+
+  gst_pad_set_active (src, FALSE);
+  g_object_unref (src);
+  kms_audio_level_free (audio_level);
+
+  g_cond_clear (&activity.cond);
+  g_mutex_clear (&activity.mutex);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+audiolevel_suite (void)
+{
+  Suite *s = suite_create ("audiolevel");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, source_expires);
+
+  return s;
+}
+
+GST_CHECK_MAIN (audiolevel);
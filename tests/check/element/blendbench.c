@@ -0,0 +1,236 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <math.h>
+
+/*
+ * Frames per second composed by kmsstripecompositor, the compositor of the
+ * mixers, for several numbers of inputs and blending threads at 1080p.
+ * Inputs are frozen images and nothing is synchronized, so blending is the
+ * only bottleneck. Every thread count must compose the same picture.
+ */
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+#define WARMUP_TIME (500 * GST_MSECOND)
+#define MEASURE_TIME (1 * GST_SECOND)
+
+/* 0 is one thread per CPU */
+static const guint threads[] = { 1, 2, 4, 0 };
+
+typedef struct _BenchData
+{
+  gint frames;                  /* Atomic */
+  GMutex mutex;
+  gchar *checksum;
+} BenchData;
+
+static GstPadProbeReturn
+count_frames (GstPad * pad, GstPadProbeInfo * info, BenchData * data)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstMapInfo map;
+
+  g_atomic_int_inc (&data->frames);
+
+  g_mutex_lock (&data->mutex);
+
+  /* Inputs do not change, so any output frame can be compared */
+  if (data->checksum == NULL && gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    data->checksum = g_compute_checksum_for_data (G_CHECKSUM_MD5, map.data,
+        map.size);
+    gst_buffer_unmap (buffer, &map);
+  }
+
+  g_mutex_unlock (&data->mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+add_input (GstElement * pipeline, GstElement * compositor, gint n, gint xpos,
+    gint ypos, gint width, gint height)
+{
+  GstElement *src, *capsfilter, *freeze;
+  GstPad *sinkpad;
+  GstCaps *caps;
+
+  src = gst_element_factory_make ("videotestsrc", NULL);
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  freeze = gst_element_factory_make ("imagefreeze", NULL);
+
+  /* Deterministic patterns only */
+  g_object_set (src, "num-buffers", 1, "pattern", n % 8, NULL);
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+      "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, capsfilter, freeze, NULL);
+  fail_unless (gst_element_link_many (src, capsfilter, freeze, NULL));
+
+  /* Some tiles are translucent, so that the blending path is measured too */
+  sinkpad = gst_element_get_request_pad (compositor, "sink_%u");
+  g_object_set (sinkpad, "xpos", xpos, "ypos", ypos, "alpha",
+      n % 3 == 0 ? 0.5 : 1.0, NULL);
+  fail_unless (gst_element_link_pads (freeze, NULL, compositor,
+          GST_OBJECT_NAME (sinkpad)));
+  g_object_unref (sinkpad);
+}
+
+/* Returns the frames per second composed and the checksum of a frame */
+static gdouble
+measure (guint n_inputs, guint n_threads, gchar ** checksum)
+{
+  GstElement *pipeline, *compositor, *capsfilter, *sink;
+  gint n_columns, n_rows, width, height, i;
+  BenchData data = { 0, };
+  gint frames;
+  GstPad *pad;
+  GstCaps *caps;
+  gint64 start;
+
+  g_mutex_init (&data.mutex);
+
+  pipeline = gst_pipeline_new (NULL);
+  compositor = gst_element_factory_make ("kmsstripecompositor", NULL);
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  fail_unless (compositor != NULL);
+
+  g_object_set (compositor, "background", 1 /* black */ , "blend-threads",
+      n_threads, NULL);
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, OUTPUT_WIDTH, "height", G_TYPE_INT, OUTPUT_HEIGHT,
+      NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), compositor, capsfilter, sink, NULL);
+  fail_unless (gst_element_link_many (compositor, capsfilter, sink, NULL));
+
+  /* Same grid the composite mixer builds */
+  n_columns = (gint) ceil (sqrt (n_inputs));
+  n_rows = (gint) ceil ((float) n_inputs / (float) n_columns);
+  width = (OUTPUT_WIDTH / n_columns) & ~1;
+  height = (OUTPUT_HEIGHT / n_rows) & ~1;
+
+  for (i = 0; i < n_inputs; i++) {
+    add_input (pipeline, compositor, i, (i % n_columns) * width,
+        (i / n_columns) * height, width, height);
+  }
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) count_frames, &data, NULL);
+  g_object_unref (pad);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_usleep (GST_TIME_AS_USECONDS (WARMUP_TIME));
+  frames = g_atomic_int_get (&data.frames);
+  start = g_get_monotonic_time ();
+  g_usleep (GST_TIME_AS_USECONDS (MEASURE_TIME));
+  frames = g_atomic_int_get (&data.frames) - frames;
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  *checksum = data.checksum;
+  g_mutex_clear (&data.mutex);
+
+  return (gdouble) frames * G_USEC_PER_SEC / (g_get_monotonic_time () - start);
+}
+
+static void
+run_benchmark (guint n_inputs)
+{
+  gchar *reference = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+    gchar *checksum;
+    gdouble fps;
+
+    fps = measure (n_inputs, threads[i], &checksum);
+
+    GST_INFO ("%u inputs, %u threads: %.1f fps", n_inputs,
+        threads[i] == 0 ? g_get_num_processors () : threads[i], fps);
+
+    fail_unless (fps > 0.0);
+    fail_unless (checksum != NULL);
+
+    if (reference == NULL) {
+      reference = checksum;
+      continue;
+    }
+
+    fail_unless (g_strcmp0 (reference, checksum) == 0,
+        "%u threads composed a different picture", threads[i]);
+    g_free (checksum);
+  }
+
+  g_free (reference);
+}
+
+GST_START_TEST (blend_4_inputs)
+{
+  run_benchmark (4);
+}
+
+GST_END_TEST
+GST_START_TEST (blend_9_inputs)
+{
+  run_benchmark (9);
+}
+
+GST_END_TEST
+GST_START_TEST (blend_16_inputs)
+{
+  run_benchmark (16);
+}
+
+GST_END_TEST
+GST_START_TEST (blend_25_inputs)
+{
+  run_benchmark (25);
+}
+
+GST_END_TEST
+/*
+ * End of test cases
+ */
+static Suite *
+blend_bench_suite (void)
+{
+  Suite *s = suite_create ("blendbench");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, blend_4_inputs);
+  tcase_add_test (tc_chain, blend_9_inputs);
+  tcase_add_test (tc_chain, blend_16_inputs);
+  tcase_add_test (tc_chain, blend_25_inputs);
+
+  return s;
+}
+
+GST_CHECK_MAIN (blend_bench);
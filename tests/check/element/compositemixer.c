@@ -27,6 +27,8 @@
 #define SINK_VIDEO_STREAM "sink_video_default"
 #define SINK_AUDIO_STREAM "sink_audio_default"
 
+#define INPUTS_TIMEOUT (5 * G_USEC_PER_SEC)
+
 GstElement *pipeline;
 GMainLoop *loop;
 GstElement *hubport1, *hubport2, *hubport3;
@@ -79,7 +81,9 @@ srcpad_added (GstElement * hubport, GstPad * new_pad, gpointer user_data)
     audiosrc = gst_element_factory_make ("audiotestsrc", NULL);
     sinkpad = gst_element_get_static_pad (audiosrc, "src");
 
-    g_object_set (G_OBJECT (audiosrc), "is-live", TRUE, NULL);
+    g_object_set (G_OBJECT (audiosrc), "is-live", TRUE, "wave",
+        GPOINTER_TO_INT (g_object_get_data (G_OBJECT (hubport), "wave")),
+        NULL);
 
     gst_bin_add (GST_BIN (pipeline), audiosrc);
 
@@ -190,6 +194,362 @@ GST_START_TEST (connection)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST
+static void
+set_hidden (GstElement * mixer, gint port, gboolean hidden)
+{
+  GstStructure *data;
+
+  data = gst_structure_new ("data", "port", G_TYPE_INT, port,
+      "hidden", G_TYPE_BOOLEAN, hidden, NULL);
+  g_signal_emit_by_name (mixer, "set-port-properties", data);
+  gst_structure_free (data);
+}
+
+/* Waits until the mixer reports the expected inputs */
+static gboolean
+wait_inputs (GstElement * mixer, guint expected_visible,
+    guint expected_blended)
+{
+  gint64 end = g_get_monotonic_time () + INPUTS_TIMEOUT;
+  guint visible, blended;
+
+  do {
+    g_object_get (mixer, "visible-inputs", &visible, "blended-inputs",
+        &blended, NULL);
+
+    if (visible == expected_visible && blended == expected_blended) {
+      return TRUE;
+    }
+
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  } while (g_get_monotonic_time () < end);
+
+  GST_ERROR ("%u visible and %u blended inputs, expected %u and %u", visible,
+      blended, expected_visible, expected_blended);
+
+  return FALSE;
+}
+
+GST_START_TEST (hidden_ports)
+{
+  gint handlerId1, handlerId2;
+  gchar *no_output = NULL;
+  GstElement *mixer = gst_element_factory_make ("compositemixer", NULL);
+
+  hubport1 = gst_element_factory_make ("hubport", NULL);
+  hubport2 = gst_element_factory_make ("hubport", NULL);
+  pipeline = gst_pipeline_new ("pipeline");
+
+  /* Test sources are linked to the sink pads of the ports when handled */
+  g_signal_connect (hubport1, "pad-added", G_CALLBACK (srcpad_added),
+      &no_output);
+  g_signal_connect (hubport2, "pad-added", G_CALLBACK (srcpad_added),
+      &no_output);
+
+  gst_bin_add_many (GST_BIN (pipeline), hubport1, hubport2, mixer, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* No media was received, nothing is composed yet */
+  fail_unless (wait_inputs (mixer, 0, 0));
+
+  g_signal_emit_by_name (mixer, "handle-port", hubport1, &handlerId1);
+  g_signal_emit_by_name (mixer, "handle-port", hubport2, &handlerId2);
+
+  fail_unless (wait_inputs (mixer, 2, 2));
+
+  set_hidden (mixer, handlerId1, TRUE);
+  fail_unless (wait_inputs (mixer, 1, 1));
+
+  /* Unknown ports are ignored */
+  set_hidden (mixer, handlerId2 + 1, TRUE);
+  fail_unless (wait_inputs (mixer, 1, 1));
+
+  set_hidden (mixer, handlerId1, FALSE);
+  fail_unless (wait_inputs (mixer, 2, 2));
+
+  g_signal_emit_by_name (mixer, "unhandle-port", handlerId1);
+  g_signal_emit_by_name (mixer, "unhandle-port", handlerId2);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+}
+
+GST_END_TEST
+GST_START_TEST (duplicate_frames)
+{
+  gint handlerId;
+  guint64 output, duplicates;
+  GstElement *mixer = gst_element_factory_make ("compositemixer", NULL);
+
+  hubport1 = gst_element_factory_make ("hubport", NULL);
+  pipeline = gst_pipeline_new ("pipeline");
+
+  gst_bin_add_many (GST_BIN (pipeline), hubport1, mixer, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (mixer, "handle-port", hubport1, &handlerId);
+
+  /* Only the background is composed, output does not change after the first
+   * frame */
+  g_usleep (2 * G_USEC_PER_SEC);
+
+  g_object_get (mixer, "output-frames", &output, "duplicate-frames",
+      &duplicates, NULL);
+  GST_INFO ("%" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " duplicated",
+      output, duplicates);
+
+  fail_unless (output > 1);
+  fail_unless_equals_uint64 (duplicates, output - 1);
+
+  g_signal_emit_by_name (mixer, "unhandle-port", handlerId);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+}
+
+GST_END_TEST
+static void
+quality_changed_cb (GstElement * mixer, GstStructure * quality, gpointer data)
+{
+  guint level;
+
+  fail_unless (gst_structure_get_uint (quality, "level", &level));
+  GST_INFO ("Quality changed: %" GST_PTR_FORMAT, quality);
+  g_atomic_int_set ((gint *) data, level);
+}
+
+static GstElement *
+get_child (GstElement * mixer, const gchar * factory_name)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (mixer));
+  GValue item = G_VALUE_INIT;
+  GstElement *child = NULL;
+
+  while (child == NULL && gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstElement *element = g_value_get_object (&item);
+    GstElementFactory *factory = gst_element_get_factory (element);
+
+    if (factory != NULL && g_strcmp0 (GST_OBJECT_NAME (factory),
+            factory_name) == 0) {
+      child = g_object_ref (element);
+    }
+
+    g_value_reset (&item);
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  return child;
+}
+
+GST_START_TEST (adaptive_quality)
+{
+  gint handlerId, notified = -1;
+  guint level;
+  GstElement *compositor;
+  GstPad *src;
+  GstElement *mixer = gst_element_factory_make ("compositemixer", NULL);
+
+  hubport1 = gst_element_factory_make ("hubport", NULL);
+  pipeline = gst_pipeline_new ("pipeline");
+
+  gst_bin_add_many (GST_BIN (pipeline), hubport1, mixer, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_connect (mixer, "quality-changed", G_CALLBACK (quality_changed_cb),
+      &notified);
+  g_signal_emit_by_name (mixer, "handle-port", hubport1, &handlerId);
+  g_object_set (mixer, "adaptive-quality", TRUE, NULL);
+
+  /* Composing the background alone does not overload */
+  g_usleep (2 * G_USEC_PER_SEC);
+  g_object_get (mixer, "quality-level", &level, NULL);
+  fail_unless_equals_int (level, 0);
+  fail_unless_equals_int (g_atomic_int_get (&notified), -1);
+
+  /* Downstream reports it can not keep up */
+  compositor = get_child (mixer, "compositor");
+  fail_unless (compositor != NULL);
+  src = gst_element_get_static_pad (compositor, "src");
+  gst_pad_send_event (src, gst_event_new_qos (GST_QOS_TYPE_OVERFLOW, 2.0,
+          100 * GST_MSECOND, 0));
+  g_object_unref (src);
+  g_object_unref (compositor);
+
+  g_usleep (2 * G_USEC_PER_SEC);
+  g_object_get (mixer, "quality-level", &level, NULL);
+  fail_unless (level > 0);
+  fail_unless_equals_int (g_atomic_int_get (&notified), level);
+
+  /* Disabling it restores the full quality */
+  g_object_set (mixer, "adaptive-quality", FALSE, NULL);
+  g_object_get (mixer, "quality-level", &level, NULL);
+  fail_unless_equals_int (level, 0);
+  fail_unless_equals_int (g_atomic_int_get (&notified), 0);
+
+  g_signal_emit_by_name (mixer, "unhandle-port", handlerId);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+}
+
+GST_END_TEST
+#define WAVE_SILENCE 4
+#define MAX_INPUTS 2
+
+/* Buffers reaching each audio mixer input, gaps are skipped by the mixer */
+typedef struct _MixedBuffers
+{
+  GstPad *pads[MAX_INPUTS];
+  gint summed[MAX_INPUTS];
+  gint skipped[MAX_INPUTS];
+} MixedBuffers;
+
+static GstPadProbeReturn
+count_mixed_buffers (GstPad * pad, GstPadProbeInfo * info,
+    MixedBuffers * counts)
+{
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  guint i;
+
+  for (i = 0; i < MAX_INPUTS; i++) {
+    if (counts->pads[i] != pad) {
+      continue;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP)) {
+      g_atomic_int_inc (&counts->skipped[i]);
+    } else {
+      g_atomic_int_inc (&counts->summed[i]);
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Added after the gate, so buffers are seen the way the mixer gets them */
+static void
+watch_mixed_buffers (GstElement * mixer, MixedBuffers * counts)
+{
+  GstElement *audiomixer = get_child (mixer, "kmsaudiomixer");
+  GValue item = G_VALUE_INIT;
+  GstIterator *it;
+  guint n = 0;
+
+  fail_unless (audiomixer != NULL);
+  it = gst_element_iterate_sink_pads (audiomixer);
+
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstPad *pad = g_value_get_object (&item);
+
+    fail_unless (n < MAX_INPUTS);
+    counts->pads[n++] = pad;
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) count_mixed_buffers, counts, NULL);
+    g_value_reset (&item);
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  g_object_unref (audiomixer);
+
+  fail_unless_equals_int (n, MAX_INPUTS);
+}
+
+static void
+reset_mixed_buffers (MixedBuffers * counts)
+{
+  guint i;
+
+  for (i = 0; i < MAX_INPUTS; i++) {
+    g_atomic_int_set (&counts->summed[i], 0);
+    g_atomic_int_set (&counts->skipped[i], 0);
+  }
+}
+
+GST_START_TEST (silent_audio)
+{
+  gint handlerId1, handlerId2;
+  gchar *padname = NULL;
+  MixedBuffers counts = { {NULL} };
+  gboolean skip;
+  guint mixed, i, voice = MAX_INPUTS;
+  GstElement *mixer = gst_element_factory_make ("compositemixer", NULL);
+
+  hubport1 = gst_element_factory_make ("hubport", NULL);
+  hubport2 = gst_element_factory_make ("hubport", NULL);
+  pipeline = gst_pipeline_new ("pipeline");
+
+  /* Only the first port has voice */
+  g_object_set_data (G_OBJECT (hubport2), "wave",
+      GINT_TO_POINTER (WAVE_SILENCE));
+
+  gst_bin_add_many (GST_BIN (pipeline), hubport1, hubport2, mixer, NULL);
+
+  g_signal_connect (hubport1, "pad-added", G_CALLBACK (srcpad_added),
+      &padname);
+  g_signal_connect (hubport2, "pad-added", G_CALLBACK (srcpad_added),
+      &padname);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (mixer, "handle-port", hubport1, &handlerId1);
+  g_signal_emit_by_name (mixer, "handle-port", hubport2, &handlerId2);
+
+  watch_mixed_buffers (mixer, &counts);
+
+  /* Past the hangover, the silent input only sends gaps to the mixer */
+  g_usleep (G_USEC_PER_SEC);
+  reset_mixed_buffers (&counts);
+  g_usleep (G_USEC_PER_SEC / 2);
+
+  g_object_get (mixer, "skip-silent-audio", &skip, "mixed-audio-inputs",
+      &mixed, NULL);
+  fail_unless (skip);
+  fail_unless_equals_int (mixed, 1);
+
+  for (i = 0; i < MAX_INPUTS; i++) {
+    gint summed = g_atomic_int_get (&counts.summed[i]);
+    gint skipped = g_atomic_int_get (&counts.skipped[i]);
+
+    GST_INFO ("Input %u: %d buffers summed, %d skipped", i, summed, skipped);
+
+    if (summed > 0) {
+      fail_unless_equals_int (skipped, 0);
+      fail_unless (voice == MAX_INPUTS);
+      voice = i;
+    } else {
+      fail_unless (skipped > 0);
+    }
+  }
+
+  fail_if (voice == MAX_INPUTS);
+
+  /* Silence is still tracked when every input is mixed */
+  g_object_set (mixer, "skip-silent-audio", FALSE, NULL);
+  g_usleep (G_USEC_PER_SEC / 10);
+  reset_mixed_buffers (&counts);
+  g_usleep (G_USEC_PER_SEC / 2);
+
+  g_object_get (mixer, "skip-silent-audio", &skip, "mixed-audio-inputs",
+      &mixed, NULL);
+  fail_if (skip);
+  fail_unless_equals_int (mixed, 1);
+
+  for (i = 0; i < MAX_INPUTS; i++) {
+    fail_unless (g_atomic_int_get (&counts.summed[i]) > 0);
+    fail_unless_equals_int (g_atomic_int_get (&counts.skipped[i]), 0);
+  }
+
+  g_signal_emit_by_name (mixer, "unhandle-port", handlerId1);
+  g_signal_emit_by_name (mixer, "unhandle-port", handlerId2);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+}
+
 GST_END_TEST
 /*
  * End of test cases
@@ -202,6 +562,10 @@ composite_mixer_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, connection);
+  tcase_add_test (tc_chain, hidden_ports);
+  tcase_add_test (tc_chain, duplicate_frames);
+  tcase_add_test (tc_chain, adaptive_quality);
+  tcase_add_test (tc_chain, silent_audio);
 
   return s;
 }
@@ -168,6 +168,235 @@ GST_START_TEST (connection)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST
+
+/* Solid colours, so that every frame of a port has the same checksum */
+#define RED_PATTERN 4
+#define GREEN_PATTERN 5
+#define BLUE_PATTERN 6
+
+#define ROUTE_TIMEOUT (5 * G_USEC_PER_SEC)
+#define ROUTE_POLL (10 * G_USEC_PER_SEC / 1000)
+
+typedef struct _RoutedPort
+{
+  GstElement *hubport;
+  gchar *padname;
+  gint pattern;
+  GMutex mutex;
+  gchar *produced;              /* Checksum of the frames fed to the hub */
+  gchar *received;              /* Checksum of the last frame got back */
+} RoutedPort;
+
+static gchar *
+buffer_checksum (GstBuffer * buffer)
+{
+  GstMapInfo map;
+  gchar *checksum;
+
+  fail_unless (gst_buffer_map (buffer, &map, GST_MAP_READ));
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_MD5, map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+
+  return checksum;
+}
+
+static GstPadProbeReturn
+produced_probe (GstPad * pad, GstPadProbeInfo * info, RoutedPort * port)
+{
+  g_mutex_lock (&port->mutex);
+
+  if (port->produced == NULL) {
+    port->produced = buffer_checksum (GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+
+  g_mutex_unlock (&port->mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+received_handoff (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    RoutedPort * port)
+{
+  gchar *checksum = buffer_checksum (buffer);
+
+  g_mutex_lock (&port->mutex);
+  g_free (port->received);
+  port->received = checksum;
+  g_mutex_unlock (&port->mutex);
+}
+
+static void
+routed_pad_added (GstElement * hubport, GstPad * new_pad, RoutedPort * port)
+{
+  GstElement *element;
+  GstPad *pad;
+
+  GST_INFO_OBJECT (hubport, "Pad added %" GST_PTR_FORMAT, new_pad);
+
+  if (g_strcmp0 (GST_OBJECT_NAME (new_pad), SINK_VIDEO_STREAM) == 0) {
+    element = gst_element_factory_make ("videotestsrc", NULL);
+    g_object_set (element, "pattern", port->pattern, NULL);
+    gst_bin_add (GST_BIN (pipeline), element);
+
+    pad = gst_element_get_static_pad (element, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) produced_probe, port, NULL);
+    fail_if (gst_pad_link (pad, new_pad) != GST_PAD_LINK_OK);
+  } else if (g_strcmp0 (GST_OBJECT_NAME (new_pad), port->padname) == 0) {
+    element = gst_element_factory_make ("fakesink", NULL);
+    g_object_set (element, "async", FALSE, "sync", FALSE,
+        "signal-handoffs", TRUE, NULL);
+    g_signal_connect (element, "handoff", G_CALLBACK (received_handoff), port);
+    gst_bin_add (GST_BIN (pipeline), element);
+
+    pad = gst_element_get_static_pad (element, "sink");
+    fail_if (gst_pad_link (new_pad, pad) != GST_PAD_LINK_OK);
+  } else {
+    return;
+  }
+
+  gst_element_sync_state_with_parent (element);
+  g_object_unref (pad);
+}
+
+static void
+routed_port_init (RoutedPort * port, gint pattern)
+{
+  port->hubport = gst_element_factory_make ("hubport", NULL);
+  port->pattern = pattern;
+  g_mutex_init (&port->mutex);
+
+  gst_bin_add (GST_BIN (pipeline), port->hubport);
+  g_signal_connect (port->hubport, "pad-added",
+      G_CALLBACK (routed_pad_added), port);
+
+  g_signal_emit_by_name (port->hubport, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &port->padname);
+  fail_if (port->padname == NULL);
+}
+
+static void
+routed_port_clear (RoutedPort * port)
+{
+  g_free (port->padname);
+  g_free (port->produced);
+  g_free (port->received);
+  g_mutex_clear (&port->mutex);
+}
+
+/* Waits until the frames @sink gets back are the ones @source feeds */
+static gboolean
+wait_for_route (RoutedPort * sink, RoutedPort * source)
+{
+  gint64 end = g_get_monotonic_time () + ROUTE_TIMEOUT;
+  gboolean routed = FALSE;
+  gchar *produced;
+
+  do {
+    g_mutex_lock (&source->mutex);
+    produced = g_strdup (source->produced);
+    g_mutex_unlock (&source->mutex);
+
+    g_mutex_lock (&sink->mutex);
+    routed = produced != NULL && g_strcmp0 (sink->received, produced) == 0;
+    g_mutex_unlock (&sink->mutex);
+
+    g_free (produced);
+
+    if (!routed) {
+      g_usleep (ROUTE_POLL);
+    }
+  } while (!routed && g_get_monotonic_time () < end);
+
+  return routed;
+}
+
+static void
+append_route (GArray * routes, gint sink, gint source)
+{
+  g_array_append_val (routes, sink);
+  g_array_append_val (routes, source);
+}
+
+static gboolean
+set_routing (GstElement * mixer, gint sink1, gint source1, gint sink2,
+    gint source2, gint sink3, gint source3)
+{
+  GArray *routes = g_array_new (FALSE, FALSE, sizeof (gint));
+  gboolean applied;
+
+  append_route (routes, sink1, source1);
+  append_route (routes, sink2, source2);
+  append_route (routes, sink3, source3);
+  g_signal_emit_by_name (G_OBJECT (mixer), "apply-routing", routes, &applied);
+  g_array_unref (routes);
+
+  return applied;
+}
+
+GST_START_TEST (apply_routing)
+{
+  GstElement *mixer = gst_element_factory_make ("dispatcher", NULL);
+  RoutedPort port1 = { 0, }, port2 = { 0, }, port3 = { 0, };
+  gint id1, id2, id3;
+  guint64 duration;
+
+  pipeline = gst_pipeline_new ("pipeline");
+  gst_bin_add (GST_BIN (pipeline), mixer);
+
+  routed_port_init (&port1, RED_PATTERN);
+  routed_port_init (&port2, GREEN_PATTERN);
+  routed_port_init (&port3, BLUE_PATTERN);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (mixer, "handle-port", port1.hubport, &id1);
+  g_signal_emit_by_name (mixer, "handle-port", port2.hubport, &id2);
+  g_signal_emit_by_name (mixer, "handle-port", port3.hubport, &id3);
+
+  /* A table with an unknown port is rejected as a whole */
+  fail_if (set_routing (mixer, id2, id1, id1, id3 + 100, id3, id3));
+
+  fail_unless (set_routing (mixer, id2, id1, id1, id3, id3, id3));
+
+  g_object_get (mixer, "last-routing-duration", &duration, NULL);
+  GST_INFO ("Routing applied in %" G_GUINT64_FORMAT " us", duration);
+
+  fail_unless (wait_for_route (&port2, &port1));
+  fail_unless (wait_for_route (&port1, &port3));
+  fail_unless (wait_for_route (&port3, &port3));
+
+  /* Every sink switches to its new source */
+  fail_unless (set_routing (mixer, id1, id2, id2, id3, id3, id1));
+
+  fail_unless (wait_for_route (&port1, &port2));
+  fail_unless (wait_for_route (&port2, &port3));
+  fail_unless (wait_for_route (&port3, &port1));
+
+  /* A sink routed twice is rejected and the previous routing is kept */
+  fail_if (set_routing (mixer, id1, id1, id2, id2, id1, id3));
+
+  fail_unless (wait_for_route (&port1, &port2));
+  fail_unless (wait_for_route (&port2, &port3));
+  fail_unless (wait_for_route (&port3, &port1));
+
+  /* Disconnecting is also part of a routing table */
+  fail_unless (set_routing (mixer, id1, -1, id2, -1, id3, -1));
+
+  g_signal_emit_by_name (mixer, "unhandle-port", id1);
+  g_signal_emit_by_name (mixer, "unhandle-port", id2);
+  g_signal_emit_by_name (mixer, "unhandle-port", id3);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+
+  routed_port_clear (&port1);
+  routed_port_clear (&port2);
+  routed_port_clear (&port3);
+}
+
 GST_END_TEST
 /*
  * End of test cases
@@ -180,6 +409,7 @@ dispatcher_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, connection);
+  tcase_add_test (tc_chain, apply_routing);
 
   return s;
 }
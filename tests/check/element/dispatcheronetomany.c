@@ -233,6 +233,246 @@ GST_START_TEST (connection)
   g_mutex_clear (&mutex);
 }
 
+GST_END_TEST
+
+#define KEYFRAME_DISTANCE 90    /* frames, 3 seconds */
+#define LINK_DELAY 1            /* seconds */
+#define GOP_CACHE_SIZE (2 * 1024 * 1024)
+#define CHECKED_BUFFERS 10      /* live ones, encoded after the link */
+
+typedef struct _FirstFrameData
+{
+  GMainLoop *loop;
+  GstElement *pipeline;
+  GstElement *mixer;
+  GstElement *source_port;
+  GstElement *sink_port;
+  gchar *sink_padname;
+  gint source_id;
+  gint sink_id;
+  gint64 link_time;
+  gint64 first_frame_time;
+  gint sent;                    /* buffers produced by the encoder */
+  gint sent_at_link;
+  GArray *received;             /* GstBuffer offsets, from first keyframe */
+  GstClockTime last_pts;
+  gboolean first_discont;
+} FirstFrameData;
+
+static GstPadProbeReturn
+drop_force_key_unit (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+  /* Behave like a remote sender that is slow to honour keyframe requests */
+  if (gst_event_has_name (event, "GstForceKeyUnit")) {
+    return GST_PAD_PROBE_DROP;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+number_buffer (GstPad * pad, GstPadProbeInfo * info, FirstFrameData * data)
+{
+  GstBuffer *buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER
+      (info));
+
+  /* Lets the sink tell which encoded frame it got */
+  GST_BUFFER_OFFSET (buffer) = g_atomic_int_add (&data->sent, 1);
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+first_frame_handoff_cb (GstElement * fakesink, GstBuffer * buffer,
+    GstPad * pad, FirstFrameData * data)
+{
+  guint64 offset = GST_BUFFER_OFFSET (buffer);
+
+  if (data->received->len == 0) {
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+      return;
+    }
+
+    data->first_frame_time = g_get_monotonic_time ();
+    data->first_discont = GST_BUFFER_FLAG_IS_SET (buffer,
+        GST_BUFFER_FLAG_DISCONT);
+  } else {
+    /* Replayed buffers must keep their order, with no frame sent twice */
+    fail_unless (offset > g_array_index (data->received, guint64,
+            data->received->len - 1), "Frame %" G_GUINT64_FORMAT " received"
+        " out of order or twice", offset);
+    fail_unless (GST_BUFFER_PTS (buffer) > data->last_pts,
+        "Timestamp went from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (data->last_pts), GST_TIME_ARGS (GST_BUFFER_PTS
+            (buffer)));
+  }
+
+  data->last_pts = GST_BUFFER_PTS (buffer);
+  g_array_append_val (data->received, offset);
+
+  /* Past the point where the replayed GOP joins the live stream */
+  if (offset >= (guint64) data->sent_at_link + CHECKED_BUFFERS) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (quit_main_loop_idle, data->loop);
+  }
+}
+
+static void
+first_frame_pad_added (GstElement * hubport, GstPad * new_pad,
+    FirstFrameData * data)
+{
+  GstElement *element;
+  GstPad *pad;
+
+  if (hubport == data->source_port
+      && g_strcmp0 (GST_OBJECT_NAME (new_pad), SINK_VIDEO_STREAM) == 0) {
+    GstElement *videosrc, *encoder;
+
+    videosrc = gst_element_factory_make ("videotestsrc", NULL);
+    encoder = gst_element_factory_make ("vp8enc", NULL);
+    g_object_set (videosrc, "is-live", TRUE, NULL);
+    g_object_set (encoder, "keyframe-max-dist", KEYFRAME_DISTANCE,
+        "deadline", G_GINT64_CONSTANT (1), NULL);
+
+    pad = gst_element_get_static_pad (encoder, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+        drop_force_key_unit, NULL, NULL);
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) number_buffer, data, NULL);
+
+    gst_bin_add_many (GST_BIN (data->pipeline), videosrc, encoder, NULL);
+    gst_element_link (videosrc, encoder);
+    fail_if (gst_pad_link (pad, new_pad) != GST_PAD_LINK_OK);
+    g_object_unref (pad);
+
+    gst_element_sync_state_with_parent (encoder);
+    gst_element_sync_state_with_parent (videosrc);
+
+    return;
+  }
+
+  if (hubport != data->sink_port
+      || g_strcmp0 (GST_OBJECT_NAME (new_pad), data->sink_padname) != 0) {
+    return;
+  }
+
+  element = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (element, "async", FALSE, "sync", FALSE, "signal-handoffs",
+      TRUE, NULL);
+  g_signal_connect (element, "handoff", G_CALLBACK (first_frame_handoff_cb),
+      data);
+  gst_bin_add (GST_BIN (data->pipeline), element);
+
+  pad = gst_element_get_static_pad (element, "sink");
+  fail_if (gst_pad_link (new_pad, pad) != GST_PAD_LINK_OK);
+  g_object_unref (pad);
+
+  gst_element_sync_state_with_parent (element);
+}
+
+static gboolean
+link_sink_port (FirstFrameData * data)
+{
+  data->link_time = g_get_monotonic_time ();
+  data->sent_at_link = g_atomic_int_get (&data->sent);
+
+  g_signal_emit_by_name (data->sink_port, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &data->sink_padname);
+  fail_if (data->sink_padname == NULL);
+
+  g_signal_emit_by_name (data->mixer, "handle-port", data->sink_port,
+      &data->sink_id);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+check_replayed_gop (FirstFrameData * data)
+{
+  guint64 first = g_array_index (data->received, guint64, 0);
+  guint i;
+
+  /* The keyframe was encoded before the sink was linked */
+  fail_unless (first < data->sent_at_link);
+  fail_unless (data->first_discont);
+
+  /* Followed by the rest of its GOP and the live stream, with no gaps */
+  for (i = 1; i < data->received->len; i++) {
+    fail_unless_equals_uint64 (g_array_index (data->received, guint64, i),
+        first + i);
+  }
+}
+
+static gint64
+measure_time_to_first_frame (guint gop_cache_size)
+{
+  FirstFrameData data = { 0 };
+  gulong id1, id2;
+
+  data.received = g_array_new (FALSE, FALSE, sizeof (guint64));
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.pipeline = gst_pipeline_new (NULL);
+  data.mixer = gst_element_factory_make ("dispatcheronetomany", NULL);
+  data.source_port = gst_element_factory_make ("hubport", NULL);
+  data.sink_port = gst_element_factory_make ("hubport", NULL);
+
+  g_object_set (data.mixer, "gop-cache-size", gop_cache_size, NULL);
+
+  gst_bin_add_many (GST_BIN (data.pipeline), data.mixer, data.source_port,
+      data.sink_port, NULL);
+
+  id1 = g_signal_connect (data.source_port, "pad-added",
+      G_CALLBACK (first_frame_pad_added), &data);
+  id2 = g_signal_connect (data.sink_port, "pad-added",
+      G_CALLBACK (first_frame_pad_added), &data);
+
+  g_signal_emit_by_name (data.mixer, "handle-port", data.source_port,
+      &data.source_id);
+  g_object_set (data.mixer, "main", data.source_id, NULL);
+
+  gst_element_set_state (data.pipeline, GST_STATE_PLAYING);
+
+  /* Link the sink in the middle of a GOP */
+  g_timeout_add_seconds (LINK_DELAY, (GSourceFunc) link_sink_port, &data);
+
+  g_main_loop_run (data.loop);
+
+  if (gop_cache_size > 0) {
+    check_replayed_gop (&data);
+  }
+
+  g_signal_emit_by_name (data.mixer, "unhandle-port", data.sink_id);
+  g_signal_emit_by_name (data.mixer, "unhandle-port", data.source_id);
+
+  g_signal_handler_disconnect (data.source_port, id1);
+  g_signal_handler_disconnect (data.sink_port, id2);
+
+  gst_element_set_state (data.pipeline, GST_STATE_NULL);
+  gst_object_unref (data.pipeline);
+  g_main_loop_unref (data.loop);
+  g_free (data.sink_padname);
+  g_array_unref (data.received);
+
+  return data.first_frame_time - data.link_time;
+}
+
+GST_START_TEST (time_to_first_frame)
+{
+  gint64 without_cache, with_cache;
+
+  without_cache = measure_time_to_first_frame (0);
+  with_cache = measure_time_to_first_frame (GOP_CACHE_SIZE);
+
+  GST_INFO ("Time to first frame: %" G_GINT64_FORMAT " ms without GOP cache, %"
+      G_GINT64_FORMAT " ms with GOP cache", without_cache / 1000,
+      with_cache / 1000);
+
+  fail_unless (with_cache < without_cache);
+}
+
 GST_END_TEST
 /*
  * End of test cases
@@ -245,6 +485,7 @@ dispatcher_one_to_many_suite (void)
 
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, connection);
+  tcase_add_test (tc_chain, time_to_first_frame);
 
   return s;
 }
@@ -353,6 +353,77 @@ GST_START_TEST (check_emit_encoded_media)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST
+/* End of test check_emit_encoded_media */
+static void
+get_new_chunk_cb (GstElement * httpep, GstBuffer * buffer, gpointer data)
+{
+  gboolean *header_received = data;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER)) {
+    *header_received = TRUE;
+    return;
+  }
+
+  /* Stream header is always sent before any cluster */
+  fail_unless (*header_received);
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    GST_INFO ("Keyframe chunk received");
+    g_signal_handlers_disconnect_by_data (httpep, data);
+    g_idle_add ((GSourceFunc) g_main_loop_quit, loop);
+  }
+}
+
+GST_START_TEST (check_get_new_chunk)
+{
+  GstElement *videotestsrc;
+  gboolean header_received = FALSE;
+  gchar *content_type;
+  guint bus_watch_id;
+  GstBus *testbus;
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  test_pipeline = gst_pipeline_new ("test-pipeline");
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  httpep = gst_element_factory_make ("httpgetendpoint", NULL);
+
+  g_object_set (videotestsrc, "is-live", TRUE, NULL);
+
+  testbus = gst_pipeline_get_bus (GST_PIPELINE (test_pipeline));
+  bus_watch_id = gst_bus_add_watch (testbus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (testbus, "message", G_CALLBACK (bus_msg_cb), test_pipeline);
+  g_object_unref (testbus);
+
+  g_object_get (G_OBJECT (httpep), "http-method", &method, "content-type",
+      &content_type, NULL);
+  ck_assert_int_eq (method, KMS_HTTP_ENDPOINT_METHOD_GET);
+  ck_assert_str_eq (content_type, "video/webm");
+  g_free (content_type);
+
+  g_signal_connect (httpep, "new-chunk", G_CALLBACK (get_new_chunk_cb),
+      &header_received);
+
+  gst_bin_add_many (GST_BIN (test_pipeline), videotestsrc, httpep, NULL);
+  gst_element_link_pads (videotestsrc, "src", httpep, "sink_video_default");
+
+  gst_element_set_state (test_pipeline, GST_STATE_PLAYING);
+
+  /* Muxing starts with the first client */
+  g_object_set (httpep, "start", TRUE, NULL);
+
+  g_main_loop_run (loop);
+
+  g_object_set (httpep, "start", FALSE, NULL);
+
+  gst_element_set_state (test_pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (test_pipeline));
+
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+}
+
 GST_END_TEST
 /******************************/
 /* HttpEndpoint test suit */
@@ -371,6 +442,9 @@ httpendpoint_suite (void)
   /* Simulates POST behaviour with encoded media */
   tcase_add_test (tc_chain, check_emit_encoded_media);
 
+  /* Simulates GET behaviour */
+  tcase_add_test (tc_chain, check_get_new_chunk);
+
   return s;
 }
 
@@ -0,0 +1,171 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <kmstestutils.h>
+
+#define N_IDLE_PORTS 50
+
+/* Per port cost of the hub alone, far below the one of an agnosticbin */
+#define MAX_IDLE_PORT_MEMORY (32 * 1024)
+
+/* Makes the hub build the branches of port @id, fed to port @first */
+typedef void (*UsePortFunc) (GstElement * hub, gint first, gint id);
+
+static void
+dispatcher_use_port (GstElement * hub, gint first, gint id)
+{
+  gboolean connected;
+
+  g_signal_emit_by_name (hub, "connect", id, first, &connected);
+  fail_unless (connected);
+}
+
+static void
+selectablemixer_use_port (GstElement * hub, gint first, gint id)
+{
+  gboolean connected;
+
+  g_signal_emit_by_name (hub, "connect-video", id, first, &connected);
+  fail_unless (connected);
+  g_signal_emit_by_name (hub, "connect-audio", id, first, &connected);
+  fail_unless (connected);
+}
+
+static void
+dispatcheronetomany_use_port (GstElement * hub, gint first, gint id)
+{
+  g_object_set (hub, "main", id, NULL);
+}
+
+/*
+ * Handles N_IDLE_PORTS ports that never receive media nor get connected and
+ * checks that the hub does not build any element for them. Elements created
+ * along with the first port are shared, so it is taken as the reference.
+ * When @use_port is given, the ports are then used and must cost more than
+ * they did while idle.
+ */
+static void
+check_idle_ports (const gchar * factory, UsePortFunc use_port)
+{
+  GstElement *pipeline, *hub;
+  GstElement *hubports[N_IDLE_PORTS];
+  gint ids[N_IDLE_PORTS];
+  guint first_children, children;
+  glong first_rss, rss, idle_cost, used_cost;
+  gint i;
+
+  pipeline = gst_pipeline_new (NULL);
+  hub = gst_element_factory_make (factory, NULL);
+  gst_bin_add (GST_BIN (pipeline), hub);
+
+  for (i = 0; i < N_IDLE_PORTS; i++) {
+    hubports[i] = gst_element_factory_make ("hubport", NULL);
+    gst_bin_add (GST_BIN (pipeline), hubports[i]);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_signal_emit_by_name (hub, "handle-port", hubports[0], &ids[0]);
+
+  first_children = GST_BIN_NUMCHILDREN (hub);
+  first_rss = kms_test_get_resident_memory ();
+
+  for (i = 1; i < N_IDLE_PORTS; i++) {
+    g_signal_emit_by_name (hub, "handle-port", hubports[i], &ids[i]);
+  }
+
+  children = GST_BIN_NUMCHILDREN (hub);
+  rss = kms_test_get_resident_memory ();
+  idle_cost = (rss - first_rss) / (N_IDLE_PORTS - 1);
+
+  GST_INFO ("%s: %u elements with one port, %u with %d idle ports, %ld bytes "
+      "per idle port", factory, first_children, children, N_IDLE_PORTS,
+      idle_cost);
+
+  fail_unless_equals_int (children, first_children);
+  fail_if (first_rss == 0);
+  fail_unless (idle_cost < MAX_IDLE_PORT_MEMORY);
+
+  if (use_port != NULL) {
+    for (i = 1; i < N_IDLE_PORTS; i++) {
+      use_port (hub, ids[0], ids[i]);
+    }
+
+    children = GST_BIN_NUMCHILDREN (hub);
+    used_cost = (kms_test_get_resident_memory () - rss) / (N_IDLE_PORTS - 1);
+
+    GST_INFO ("%s: %u elements with %d used ports, %ld bytes per used port",
+        factory, children, N_IDLE_PORTS, used_cost);
+
+    fail_unless (children > first_children);
+    fail_unless (used_cost > idle_cost);
+  }
+
+  for (i = 0; i < N_IDLE_PORTS; i++) {
+    g_signal_emit_by_name (hub, "unhandle-port", ids[i]);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_START_TEST (dispatcher_idle_ports)
+{
+  check_idle_ports ("dispatcher", dispatcher_use_port);
+}
+
+GST_END_TEST
+GST_START_TEST (dispatcheronetomany_idle_ports)
+{
+  check_idle_ports ("dispatcheronetomany", dispatcheronetomany_use_port);
+}
+
+GST_END_TEST
+GST_START_TEST (selectablemixer_idle_ports)
+{
+  check_idle_ports ("selectablemixer", selectablemixer_use_port);
+}
+
+GST_END_TEST
+/* Branches are built on the first media of a port, which is not sent here */
+GST_START_TEST (compositemixer_idle_ports)
+{
+  check_idle_ports ("compositemixer", NULL);
+}
+
+GST_END_TEST
+/*
+ * End of test cases
+ */
+static Suite *
+hub_footprint_suite (void)
+{
+  Suite *s = suite_create ("hubfootprint");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, dispatcher_idle_ports);
+  tcase_add_test (tc_chain, dispatcheronetomany_idle_ports);
+  tcase_add_test (tc_chain, selectablemixer_idle_ports);
+  tcase_add_test (tc_chain, compositemixer_idle_ports);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hub_footprint);
@@ -0,0 +1,231 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include <kmslatencysampler.h>
+
+static GstFlowReturn
+drop_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static void
+count_latency_cb (GstPad * pad, KmsMediaType type, GstClockTimeDiff t,
+    KmsList * mdata, gpointer user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+}
+
+GST_START_TEST (histogram_percentiles)
+{
+  KmsLatencyHistogram *histogram = kms_latency_histogram_new ();
+  GstClockTime p50, p99;
+  GstStructure *s;
+  guint64 samples;
+  gint i;
+
+  fail_unless (kms_latency_histogram_get_count (histogram) == 0);
+  fail_unless (kms_latency_histogram_get_percentile (histogram, 50.0) == 0);
+
+  /* 1 ms to 100 ms */
+  for (i = 1; i <= 100; i++) {
+    kms_latency_histogram_record (histogram, i * GST_MSECOND);
+  }
+
+  fail_unless (kms_latency_histogram_get_count (histogram) == 100);
+
+  /* Buckets are 1/16 of a power of two wide */
+  p50 = kms_latency_histogram_get_percentile (histogram, 50.0);
+  fail_unless (p50 > 47 * GST_MSECOND && p50 < 53 * GST_MSECOND,
+      "Wrong p50 %" GST_TIME_FORMAT, GST_TIME_ARGS (p50));
+
+  p99 = kms_latency_histogram_get_percentile (histogram, 99.0);
+  fail_unless (p99 > 94 * GST_MSECOND && p99 < 104 * GST_MSECOND,
+      "Wrong p99 %" GST_TIME_FORMAT, GST_TIME_ARGS (p99));
+
+  /* Negative latencies are clock skew, they count as 0 */
+  kms_latency_histogram_record (histogram, -GST_SECOND);
+  fail_unless (kms_latency_histogram_get_percentile (histogram, 0.0) == 0);
+
+  s = kms_latency_histogram_to_structure (histogram, "stream");
+  fail_unless (gst_structure_get_uint64 (s, "samples", &samples));
+  fail_unless (samples == 101);
+  fail_unless (gst_structure_has_field_typed (s, "p95", G_TYPE_UINT64));
+  gst_structure_free (s);
+
+  kms_latency_histogram_reset (histogram);
+  fail_unless (kms_latency_histogram_get_count (histogram) == 0);
+
+  kms_latency_histogram_free (histogram);
+}
+
+GST_END_TEST
+
+GST_START_TEST (sample_every)
+{
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  guint count = 0;
+  gint i;
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, drop_chain);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_pad_set_active (srcpad, TRUE);
+
+  kms_latency_sampler_add_meta_probe (srcpad, TRUE, KMS_MEDIA_TYPE_VIDEO, 4,
+      0);
+  kms_stats_add_buffer_latency_notification_probe (sinkpad, count_latency_cb,
+      FALSE, &count, NULL);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("sampler")));
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  for (i = 0; i < 20; i++) {
+    fail_unless (gst_pad_push (srcpad, gst_buffer_new ()) == GST_FLOW_OK);
+  }
+
+  /* Only one of every four buffers carries a latency meta */
+  fail_unless_equals_int (count, 5);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+}
+
+GST_END_TEST
+
+GST_START_TEST (sample_interval)
+{
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  guint count = 0;
+  gint i;
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, drop_chain);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_pad_set_active (srcpad, TRUE);
+
+  kms_latency_sampler_add_meta_probe (srcpad, TRUE, KMS_MEDIA_TYPE_AUDIO, 0,
+      GST_SECOND);
+  kms_stats_add_buffer_latency_notification_probe (sinkpad, count_latency_cb,
+      FALSE, &count, NULL);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("sampler")));
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  /* A burst well within the window, only its first buffer is sampled */
+  for (i = 0; i < 50; i++) {
+    fail_unless (gst_pad_push (srcpad, gst_buffer_new ()) == GST_FLOW_OK);
+  }
+
+  fail_unless_equals_int (count, 1);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (sinkpad);
+}
+
+GST_END_TEST
+
+GST_START_TEST (element_settings)
+{
+  GstElement *endpoint, *element;
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  guint count = 0;
+  gint i;
+
+  /* Pads inside an endpoint are sampled as the endpoint is configured */
+  endpoint = gst_element_factory_make ("rtpendpoint", NULL);
+  element = gst_element_factory_make ("identity", NULL);
+  gst_bin_add (GST_BIN (endpoint), element);
+  g_object_set (endpoint, KMS_LATENCY_SAMPLE_INTERVAL, 0,
+      KMS_LATENCY_SAMPLE_EVERY, 5, NULL);
+
+  srcpad = gst_pad_new ("sampled", GST_PAD_SRC);
+  gst_element_add_pad (element, srcpad);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, drop_chain);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_pad_set_active (srcpad, TRUE);
+
+  kms_latency_sampler_add_element_meta_probe (srcpad, TRUE,
+      KMS_MEDIA_TYPE_VIDEO);
+  kms_stats_add_buffer_latency_notification_probe (sinkpad, count_latency_cb,
+      FALSE, &count, NULL);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("sampler")));
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  for (i = 0; i < 20; i++) {
+    fail_unless (gst_pad_push (srcpad, gst_buffer_new ()) == GST_FLOW_OK);
+  }
+
+  fail_unless_equals_int (count, 4);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_object_unref (sinkpad);
+  gst_object_unref (endpoint);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+latencysampler_suite (void)
+{
+  Suite *s = suite_create ("latencysampler");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, histogram_percentiles);
+  tcase_add_test (tc_chain, sample_every);
+  tcase_add_test (tc_chain, sample_interval);
+  tcase_add_test (tc_chain, element_settings);
+
+  return s;
+}
+
+GST_CHECK_MAIN (latencysampler);
@@ -32,6 +32,8 @@
 #define KMS_ELEMENT_PAD_TYPE_AUDIO 1
 #define KMS_ELEMENT_PAD_TYPE_VIDEO 2
 
+#define KMS_PLAYER_SEEK_MODE_KEYFRAME 1
+
 #define KMS_VIDEO_PREFIX "video_src_"
 #define KMS_AUDIO_PREFIX "audio_src_"
 
@@ -487,6 +489,163 @@ GST_START_TEST (check_eos)
 
 GST_END_TEST
 
+static gboolean
+seek_player (gpointer loop)
+{
+  gboolean ret;
+
+  g_signal_emit_by_name (player, "set-position", 2 * GST_SECOND, &ret);
+  fail_unless (ret);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+check_seek_stats (gpointer loop)
+{
+  const GstStructure *player_stats;
+  GstStructure *stats;
+  guint64 count, hits, latency;
+
+  g_signal_emit_by_name (player, "stats", NULL, &stats);
+  fail_if (stats == NULL);
+
+  player_stats = gst_value_get_structure (gst_structure_get_value (stats,
+          "player-stats"));
+  fail_if (player_stats == NULL);
+
+  fail_unless (gst_structure_get (player_stats,
+          "seek-count", G_TYPE_UINT64, &count,
+          "keyframe-index-hits", G_TYPE_UINT64, &hits,
+          "last-seek-latency", G_TYPE_UINT64, &latency, NULL));
+
+  GST_DEBUG ("Seeks: %" G_GUINT64_FORMAT ", index hits: %" G_GUINT64_FORMAT
+      ", last latency: %" GST_TIME_FORMAT, count, hits,
+      GST_TIME_ARGS (latency));
+
+  fail_unless (count == 2);
+  fail_unless (hits <= count);
+  fail_unless (latency > 0);
+
+  gst_structure_free (stats);
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+GST_START_TEST (check_seek_keyframe)
+{
+  guint bus_watch_id;
+  GstBus *bus;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  g_object_set (G_OBJECT (player), "uri", VIDEO_PATH2, "seek-mode",
+      KMS_PLAYER_SEEK_MODE_KEYFRAME, NULL);
+
+  gst_bin_add (GST_BIN (pipeline), player);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  /* The second seek goes to an already played position */
+  g_timeout_add_seconds (1, seek_player, loop);
+  g_timeout_add_seconds (3, seek_player, loop);
+  g_timeout_add_seconds (4, check_seek_stats, loop);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+
+static gboolean
+check_cpu_stats (gpointer loop)
+{
+  const GstStructure *cpu_stats;
+  GstStructure *stats;
+  guint64 cpu_time;
+  gdouble cpu_usage;
+  guint threads;
+
+  g_signal_emit_by_name (player, "stats", NULL, &stats);
+  fail_if (stats == NULL);
+
+  cpu_stats = gst_value_get_structure (gst_structure_get_value (stats,
+          "cpu-stats"));
+  fail_if (cpu_stats == NULL);
+
+  fail_unless (gst_structure_get (cpu_stats,
+          "cpu-time", G_TYPE_UINT64, &cpu_time,
+          "cpu-usage", G_TYPE_DOUBLE, &cpu_usage,
+          "threads", G_TYPE_UINT, &threads, NULL));
+
+  GST_DEBUG ("CPU time: %" G_GUINT64_FORMAT " us, usage: %f us/s, threads: %u",
+      cpu_time, cpu_usage, threads);
+
+  /* At least the decoding pipeline source and queues are running */
+  fail_unless (threads > 0);
+  fail_unless (cpu_time > 0);
+  fail_unless (cpu_usage > 0.0);
+
+  gst_structure_free (stats);
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+GST_START_TEST (check_cpu_stats_enabled)
+{
+  guint bus_watch_id;
+  GstStructure *stats;
+  GstBus *bus;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  player = gst_element_factory_make ("playerendpoint", NULL);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_cb), pipeline);
+  g_object_unref (bus);
+
+  g_object_set (G_OBJECT (player), "uri", VIDEO_PATH2, NULL);
+
+  gst_bin_add (GST_BIN (pipeline), player);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_object_set (G_OBJECT (player), "state", KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  /* Nothing is reported until stats are enabled */
+  g_signal_emit_by_name (player, "stats", NULL, &stats);
+  fail_if (gst_structure_has_field (stats, "cpu-stats"));
+  gst_structure_free (stats);
+
+  g_object_set (G_OBJECT (player), "media-stats", TRUE, NULL);
+
+  g_timeout_add_seconds (2, check_cpu_stats, loop);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+
 #ifdef ENABLE_EXPERIMENTAL_TESTS
 
 GST_START_TEST (check_set_encoded_media)
@@ -549,6 +708,8 @@ playerendpoint_suite (void)
   tcase_add_test (tc_chain, check_states);
   tcase_add_test (tc_chain, check_live_stream);
   tcase_add_test (tc_chain, check_eos);
+  tcase_add_test (tc_chain, check_seek_keyframe);
+  tcase_add_test (tc_chain, check_cpu_stats_enabled);
 #ifdef ENABLE_EXPERIMENTAL_TESTS
   tcase_add_test (tc_chain, check_set_encoded_media);
 #endif
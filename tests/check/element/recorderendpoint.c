@@ -28,6 +28,9 @@
 #define KMS_ELEMENT_PAD_TYPE_AUDIO 1
 #define KMS_ELEMENT_PAD_TYPE_VIDEO 2
 
+/* KmsRecorderPassthroughMode */
+#define PASSTHROUGH_MODE_STRICT 1
+
 gboolean set_state_start (gpointer *);
 gboolean set_state_pause (gpointer *);
 gboolean set_state_stop (gpointer *);
@@ -545,6 +548,183 @@ GST_START_TEST (check_video_only)
 
 GST_END_TEST;
 
+static void
+check_video_stream (gboolean rejected)
+{
+  const GstStructure *streams, *stream;
+  gboolean is_transcoded, is_rejected;
+  GstStructure *stats;
+
+  g_signal_emit_by_name (recorder, "stats", NULL, &stats);
+  fail_unless (stats != NULL);
+
+  GST_DEBUG ("Stats: %" GST_PTR_FORMAT, stats);
+
+  streams = gst_value_get_structure (gst_structure_get_value (stats,
+          "recorder-streams"));
+  fail_unless (streams != NULL);
+  stream = gst_value_get_structure (gst_structure_get_value (streams,
+          SINK_VIDEO_STREAM));
+  fail_unless (stream != NULL);
+
+  fail_unless (gst_structure_get_boolean (stream, "transcoded",
+          &is_transcoded));
+  fail_unless (gst_structure_get_boolean (stream, "rejected", &is_rejected));
+  fail_unless (is_rejected == rejected);
+
+  if (!rejected) {
+    fail_if (is_transcoded);
+  }
+
+  gst_structure_free (stats);
+}
+
+static gboolean
+check_passthrough_and_stop (gpointer data)
+{
+  check_video_stream (FALSE);
+
+  return stop_recorder (data);
+}
+
+static void
+state_changed_passthrough (GstElement * recorder, KmsUriEndpointState newState,
+    gpointer loop)
+{
+  GST_DEBUG ("State changed %s.", state2string (newState));
+
+  if (newState == KMS_URI_ENDPOINT_STATE_START) {
+    g_timeout_add (RUNNING_ON_VALGRIND ? 15000 : 3000,
+        check_passthrough_and_stop, NULL);
+  } else if (newState == KMS_URI_ENDPOINT_STATE_STOP) {
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+}
+
+GST_START_TEST (check_passthrough_strict)
+{
+  GstElement *pipeline, *videotestsrc, *vencoder;
+  guint bus_watch_id;
+  GstBus *bus;
+
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  expected_warnings = FALSE;
+
+  pipeline = gst_pipeline_new ("recorderendpoint0-test");
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  vencoder = gst_element_factory_make ("vp8enc", NULL);
+  recorder = gst_element_factory_make ("recorderendpoint", NULL);
+
+  /* VP8 is recorded in WEBM as it arrives, so strict mode lets it through */
+  g_object_set (G_OBJECT (recorder), "uri",
+      "file:///tmp/check_passthrough_strict.webm", "profile",
+      KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY, "passthrough-mode",
+      PASSTHROUGH_MODE_STRICT, NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+  g_object_unref (bus);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, vencoder, recorder,
+      NULL);
+  gst_element_link (videotestsrc, vencoder);
+
+  link_to_recorder (recorder, vencoder, pipeline, SINK_VIDEO_STREAM);
+
+  g_signal_connect (recorder, "state-changed",
+      G_CALLBACK (state_changed_passthrough), loop);
+
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp", TRUE,
+      "pattern", 18, NULL);
+
+  g_object_set (G_OBJECT (recorder), "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+static void
+bus_msg_rejected (GstBus * bus, GstMessage * msg, gpointer loop)
+{
+  GError *err = NULL;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ERROR) {
+    return;
+  }
+
+  gst_message_parse_error (msg, &err, NULL);
+  GST_INFO ("Expected error: %s", err->message);
+
+  fail_unless (GST_MESSAGE_SRC (msg) == GST_OBJECT (recorder));
+  fail_unless (g_error_matches (err, GST_STREAM_ERROR,
+          GST_STREAM_ERROR_WRONG_TYPE));
+  g_error_free (err);
+
+  check_video_stream (TRUE);
+
+  g_idle_add (quit_main_loop_idle, loop);
+}
+
+GST_START_TEST (check_passthrough_rejected)
+{
+  GstElement *pipeline, *videotestsrc;
+  guint bus_watch_id;
+  GstBus *bus;
+
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  pipeline = gst_pipeline_new ("recorderendpoint0-test");
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  recorder = gst_element_factory_make ("recorderendpoint", NULL);
+
+  /* Raw video would have to be encoded by the agnosticbin */
+  g_object_set (G_OBJECT (recorder), "uri",
+      "file:///tmp/check_passthrough_rejected.webm", "profile",
+      KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY, "passthrough-mode",
+      PASSTHROUGH_MODE_STRICT, NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg_rejected), loop);
+  g_object_unref (bus);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, recorder, NULL);
+
+  link_to_recorder (recorder, videotestsrc, pipeline, SINK_VIDEO_STREAM);
+
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, "do-timestamp", TRUE,
+      NULL);
+
+  g_object_set (G_OBJECT (recorder), "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_main_loop_run (loop);
+
+  g_object_set (G_OBJECT (recorder), "state", KMS_URI_ENDPOINT_STATE_STOP,
+      NULL);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (check_audio_only)
 {
   GstElement *pipeline, *audiotestsrc, *encoder;
@@ -738,6 +918,8 @@ recorderendpoint_suite (void)
 /* Enable test when recorder is able to emit dropable buffers for the muxer */
   tcase_add_test (tc_chain, check_video_only);
   tcase_add_test (tc_chain, check_audio_only);
+  tcase_add_test (tc_chain, check_passthrough_strict);
+  tcase_add_test (tc_chain, check_passthrough_rejected);
   tcase_add_test (tc_chain, check_states_pipeline);
   tcase_add_test (tc_chain, warning_pipeline);
 
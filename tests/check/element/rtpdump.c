@@ -0,0 +1,439 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+#include <gst/sdp/gstsdpmessage.h>
+
+#include <commons/kmselementpadtype.h>
+#include <commons/kmsrecordingprofile.h>
+#include <commons/kmsuriendpointstate.h>
+
+#include <kmsrtpdump.h>
+#include <kmsthreadcpu.h>
+
+#define START (1450000000 * GST_SECOND + 123456 * GST_USECOND)
+#define PAYLOAD_SIZE 1000
+#define PACKETS 100000
+
+#define SINK_VIDEO_STREAM "sink_video_default"
+#define VIDEO_SRC_PREFIX "video_src_"
+#define WARM_UP_TIME 1
+#define RECORD_TIME 4
+
+static GstBuffer *
+create_rtp (guint16 seq)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_ssrc (&rtp, 0x1234abcd);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+static GstBuffer *
+create_rtcp (void)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  GstBuffer *buffer;
+
+  buffer = gst_rtcp_buffer_new (1400);
+  gst_rtcp_buffer_map (buffer, GST_MAP_READWRITE, &rtcp);
+  gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RR, &packet);
+  gst_rtcp_packet_rr_set_ssrc (&packet, 0x1234abcd);
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  return buffer;
+}
+
+static void
+check_record (const guint8 * data, GstBuffer * packet, gboolean is_rtcp,
+    GstClockTime offset)
+{
+  GstClockTime parsed_offset;
+  gboolean rtcp;
+  gsize size;
+
+  fail_unless (kms_rtp_dump_parse_record_header (data, &size, &rtcp,
+          &parsed_offset));
+  fail_unless (size == gst_buffer_get_size (packet));
+  fail_unless (rtcp == is_rtcp);
+  fail_unless (parsed_offset == offset);
+  fail_unless (gst_buffer_memcmp (packet, 0,
+          data + KMS_RTP_DUMP_RECORD_HEADER_SIZE, size) == 0);
+}
+
+GST_START_TEST (round_trip)
+{
+  GstBuffer *file, *rtp, *rtcp;
+  GstClockTime start;
+  GstMapInfo info;
+  gsize header_size, pos;
+
+  rtp = create_rtp (1);
+  rtcp = create_rtcp ();
+
+  file = kms_rtp_dump_new_file_header (START);
+  file = gst_buffer_append (file, kms_rtp_dump_new_record (rtp, 0));
+  file = gst_buffer_append (file, kms_rtp_dump_new_record (rtcp,
+          20 * GST_MSECOND));
+
+  gst_buffer_map (file, &info, GST_MAP_READ);
+
+  fail_unless (g_str_has_prefix ((const gchar *) info.data, "#!rtpplay1.0 "));
+  fail_unless (kms_rtp_dump_parse_file_header (info.data, info.size,
+          &header_size, &start, NULL));
+  fail_unless (start == START);
+
+  pos = header_size;
+  check_record (info.data + pos, rtp, FALSE, 0);
+  pos += KMS_RTP_DUMP_RECORD_HEADER_SIZE + gst_buffer_get_size (rtp);
+  check_record (info.data + pos, rtcp, TRUE, 20 * GST_MSECOND);
+  pos += KMS_RTP_DUMP_RECORD_HEADER_SIZE + gst_buffer_get_size (rtcp);
+  fail_unless (pos == info.size);
+
+  gst_buffer_unmap (file, &info);
+
+  gst_buffer_unref (file);
+  gst_buffer_unref (rtp);
+  gst_buffer_unref (rtcp);
+}
+
+GST_END_TEST
+
+GST_START_TEST (partial_header)
+{
+  GstBuffer *header = kms_rtp_dump_new_file_header (START);
+  GError *err = NULL;
+  GstClockTime start;
+  GstMapInfo info;
+  gsize size;
+
+  gst_buffer_map (header, &info, GST_MAP_READ);
+
+  /* Not enough data yet is not an error */
+  fail_if (kms_rtp_dump_parse_file_header (info.data, info.size - 1, &size,
+          &start, &err));
+  fail_unless (err == NULL);
+
+  fail_if (kms_rtp_dump_parse_file_header ((const guint8 *) "RIFF....WEBM",
+          12, &size, &start, &err));
+  fail_unless (err != NULL);
+  g_clear_error (&err);
+
+  gst_buffer_unmap (header, &info);
+  gst_buffer_unref (header);
+}
+
+GST_END_TEST
+
+GST_START_TEST (out_of_range)
+{
+  GstBuffer *packet = create_rtp (1);
+
+  fail_unless (kms_rtp_dump_new_record (packet,
+          KMS_RTP_DUMP_MAX_OFFSET + GST_MSECOND) == NULL);
+  gst_buffer_unref (packet);
+
+  packet = gst_buffer_new_allocate (NULL, G_MAXUINT16, NULL);
+  gst_buffer_memset (packet, 0, 0x80, G_MAXUINT16);
+  fail_unless (kms_rtp_dump_new_record (packet, 0) == NULL);
+  gst_buffer_unref (packet);
+}
+
+GST_END_TEST
+
+/* Cost of writing the packets of a recording, to compare with muxing them */
+GST_START_TEST (throughput)
+{
+  GstBuffer *packet = create_rtp (1);
+  gsize written = 0;
+  gint64 begin, elapsed;
+  guint i;
+
+  begin = g_get_monotonic_time ();
+
+  for (i = 0; i < PACKETS; i++) {
+    GstBuffer *record;
+
+    record = kms_rtp_dump_new_record (packet, i * 10 * GST_MSECOND);
+    written += gst_buffer_get_size (record);
+    gst_buffer_unref (record);
+  }
+
+  elapsed = g_get_monotonic_time () - begin;
+
+  GST_INFO ("%u records, %" G_GSIZE_FORMAT " bytes in %" G_GINT64_FORMAT
+      " us: %.1f records/ms", PACKETS, written, elapsed,
+      PACKETS * 1000.0 / MAX (elapsed, 1));
+
+  gst_buffer_unref (packet);
+}
+
+GST_END_TEST
+
+static gboolean
+quit_main_loop (gpointer loop)
+{
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+bus_msg (GstBus * bus, GstMessage * msg, gpointer pipe)
+{
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    GST_ERROR ("Error: %" GST_PTR_FORMAT, msg);
+    fail ("Error received on bus");
+  }
+}
+
+static void
+sink_pad_added (GstElement * element, GstPad * pad, GstElement * src)
+{
+  if (GST_PAD_IS_SRC (pad) || gst_pad_is_linked (pad) ||
+      g_strcmp0 (GST_OBJECT_NAME (pad), SINK_VIDEO_STREAM) != 0) {
+    return;
+  }
+
+  gst_element_link_pads (src, NULL, element, GST_OBJECT_NAME (pad));
+  gst_element_sync_state_with_parent (src);
+}
+
+/* Links @src to the video sink of @element, now or once it is added */
+static void
+link_video_sink (GstElement * src, GstElement * element)
+{
+  GstPad *pad;
+
+  g_signal_connect (element, "pad-added", G_CALLBACK (sink_pad_added), src);
+
+  pad = gst_element_get_static_pad (element, SINK_VIDEO_STREAM);
+  if (pad != NULL) {
+    sink_pad_added (element, pad, src);
+    g_object_unref (pad);
+  }
+}
+
+/* Straight to the recorder: the packets are taken from the element linked */
+static void
+video_src_added (GstElement * element, GstPad * pad, GstElement * recorder)
+{
+  GstPad *sinkpad;
+
+  if (!g_str_has_prefix (GST_OBJECT_NAME (pad), VIDEO_SRC_PREFIX)) {
+    return;
+  }
+
+  sinkpad = gst_element_get_static_pad (recorder, SINK_VIDEO_STREAM);
+  fail_unless (sinkpad != NULL);
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  g_object_unref (sinkpad);
+}
+
+static GArray *
+create_vp8_codecs (void)
+{
+  GArray *codecs = g_array_new (FALSE, TRUE, sizeof (GValue));
+  GValue v = G_VALUE_INIT;
+  GstStructure *s;
+
+  g_value_init (&v, GST_TYPE_STRUCTURE);
+  s = gst_structure_new_empty ("VP8/90000");
+  gst_value_set_structure (&v, s);
+  gst_structure_free (s);
+  g_array_append_val (codecs, v);
+
+  return codecs;
+}
+
+static void
+negotiate (GstElement * sender, GstElement * receiver)
+{
+  gchar *sender_sess_id, *receiver_sess_id;
+  GstSDPMessage *offer, *answer;
+  gboolean answer_ok;
+
+  g_signal_emit_by_name (sender, "create-session", &sender_sess_id);
+  g_signal_emit_by_name (receiver, "create-session", &receiver_sess_id);
+
+  g_signal_emit_by_name (sender, "generate-offer", sender_sess_id, &offer);
+  fail_unless (offer != NULL);
+  g_signal_emit_by_name (receiver, "process-offer", receiver_sess_id, offer,
+      &answer);
+  fail_unless (answer != NULL);
+  g_signal_emit_by_name (sender, "process-answer", sender_sess_id, answer,
+      &answer_ok);
+  fail_unless (answer_ok);
+
+  gst_sdp_message_free (offer);
+  gst_sdp_message_free (answer);
+  g_free (sender_sess_id);
+  g_free (receiver_sess_id);
+}
+
+static gdouble
+get_cpu_usage (GstElement * recorder)
+{
+  GstStructure *stats, *cpu_stats;
+  gdouble usage = 0.0;
+  guint threads = 0;
+
+  g_signal_emit_by_name (recorder, "stats", NULL, &stats);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get (stats, KMS_THREAD_CPU_STATS_FIELD,
+          GST_TYPE_STRUCTURE, &cpu_stats, NULL));
+  fail_unless (gst_structure_get (cpu_stats, "cpu-usage", G_TYPE_DOUBLE,
+          &usage, "threads", G_TYPE_UINT, &threads, NULL));
+  fail_unless (threads > 0);
+
+  gst_structure_free (cpu_stats);
+  gst_structure_free (stats);
+
+  return usage;
+}
+
+/* CPU microseconds per second used by a recorder fed by an RtpEndpoint,
+ * once the recording is running */
+static gdouble
+record_cpu_usage (gboolean rtp_dump)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  GstElement *pipeline, *videotestsrc, *agnosticbin, *sender, *receiver,
+      *recorder;
+  gchar *uri, *padname;
+  guint bus_watch_id;
+  GArray *codecs;
+  gdouble usage;
+  GstBus *bus;
+
+  pipeline = gst_pipeline_new (__FUNCTION__);
+  videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  sender = gst_element_factory_make ("rtpendpoint", NULL);
+  receiver = gst_element_factory_make ("rtpendpoint", NULL);
+  recorder = gst_element_factory_make ("recorderendpoint", NULL);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  bus_watch_id = gst_bus_add_watch (bus, gst_bus_async_signal_func, NULL);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+  g_object_unref (bus);
+
+  g_object_set (videotestsrc, "is-live", TRUE, "do-timestamp", TRUE, NULL);
+
+  codecs = create_vp8_codecs ();
+  g_object_set (sender, "num-video-medias", 1, "video-codecs",
+      g_array_ref (codecs), NULL);
+  g_object_set (receiver, "num-video-medias", 1, "video-codecs",
+      g_array_ref (codecs), NULL);
+  g_array_unref (codecs);
+
+  /* The same VP8 stream either muxed or written as it arrived */
+  uri = g_strdup_printf ("file:///tmp/rtpdump_cpu.%s",
+      rtp_dump ? "rtpdump" : "webm");
+  g_object_set (recorder, "uri", uri, "rtp-dump", rtp_dump, NULL);
+  g_object_set (recorder, "profile", KMS_RECORDING_PROFILE_WEBM_VIDEO_ONLY,
+      NULL);
+  g_free (uri);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, agnosticbin, sender,
+      receiver, recorder, NULL);
+  gst_element_link (videotestsrc, agnosticbin);
+
+  link_video_sink (agnosticbin, sender);
+
+  g_signal_connect (receiver, "pad-added", G_CALLBACK (video_src_added),
+      recorder);
+  g_signal_emit_by_name (receiver, "request-new-pad",
+      KMS_ELEMENT_PAD_TYPE_VIDEO, NULL, GST_PAD_SRC, &padname);
+  fail_unless (padname != NULL);
+  g_free (padname);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  negotiate (sender, receiver);
+
+  g_object_set (recorder, "media-stats", TRUE, "state",
+      KMS_URI_ENDPOINT_STATE_START, NULL);
+
+  /* Usage is reported since the previous call: skip the start up */
+  g_timeout_add_seconds (WARM_UP_TIME, quit_main_loop, loop);
+  g_main_loop_run (loop);
+  get_cpu_usage (recorder);
+
+  g_timeout_add_seconds (RECORD_TIME, quit_main_loop, loop);
+  g_main_loop_run (loop);
+  usage = get_cpu_usage (recorder);
+
+  g_object_set (recorder, "state", KMS_URI_ENDPOINT_STATE_STOP, NULL);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_source_remove (bus_watch_id);
+  g_main_loop_unref (loop);
+
+  return usage;
+}
+
+/* Cost of the whole recorder, next to the WebM one, from its "cpu-stats" */
+GST_START_TEST (recorder_cpu)
+{
+  gdouble webm, dump;
+
+  webm = record_cpu_usage (FALSE);
+  dump = record_cpu_usage (TRUE);
+
+  GST_INFO ("Recorder CPU: %.0f us/s muxing WebM, %.0f us/s writing rtpdump "
+      "(%.0f%%)", webm, dump, dump * 100 / MAX (webm, 1.0));
+
+  fail_unless (webm > 0.0);
+  fail_unless (dump > 0.0);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+rtpdump_suite (void)
+{
+  Suite *s = suite_create ("rtpdump");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, round_trip);
+  tcase_add_test (tc_chain, partial_header);
+  tcase_add_test (tc_chain, out_of_range);
+  tcase_add_test (tc_chain, throughput);
+  tcase_add_test (tc_chain, recorder_cpu);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtpdump);
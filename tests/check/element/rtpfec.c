@@ -0,0 +1,478 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <time.h>
+
+#include <kmsrtpfec.h>
+
+#define MEDIA_PT 96
+#define FEC_PT 100
+#define MEDIA_SSRC 0x1234abcd
+#define PACKETS_PER_FRAME 10
+#define FRAMES 400
+#define PACKETS (PACKETS_PER_FRAME * FRAMES)
+#define LOSS_DATA "loss-data"
+
+typedef struct _LossData
+{
+  GstBuffer *sent[PACKETS];
+  guint received;
+  guint fec;
+  guint corrupted;
+} LossData;
+
+static GstSDPMedia *
+create_video_media (gboolean fec)
+{
+  GstSDPMedia *media;
+
+  gst_sdp_media_new (&media);
+  gst_sdp_media_set_media (media, "video");
+  gst_sdp_media_set_port_info (media, 9, 1);
+  gst_sdp_media_set_proto (media, "RTP/AVPF");
+  gst_sdp_media_add_format (media, "96");
+  gst_sdp_media_add_attribute (media, "rtpmap", "96 VP8/90000");
+
+  if (fec) {
+    gst_sdp_media_add_format (media, "100");
+    gst_sdp_media_add_attribute (media, "rtpmap", "100 flexfec-03/90000");
+  }
+
+  return media;
+}
+
+static gboolean
+media_has_attribute (const GstSDPMedia * media, const gchar * key,
+    const gchar * prefix)
+{
+  guint i, len = gst_sdp_media_attributes_len (media);
+
+  for (i = 0; i < len; i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+
+    if (g_strcmp0 (attr->key, key) == 0 &&
+        g_str_has_prefix (attr->value, prefix)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static guint64
+get_fec_stat (KmsRtpFec * fec, const gchar * name)
+{
+  GstStructure *stats, *fec_stats;
+  guint64 value = 0;
+
+  stats = gst_structure_new_empty ("stats");
+  kms_rtp_fec_add_stats (fec, stats);
+  fail_unless (gst_structure_get (stats, KMS_RTP_FEC_STATS_FIELD,
+          GST_TYPE_STRUCTURE, &fec_stats, NULL));
+  fail_unless (gst_structure_get_uint64 (fec_stats, name, &value));
+  gst_structure_free (fec_stats);
+  gst_structure_free (stats);
+
+  return value;
+}
+
+static GstBuffer *
+create_packet (GRand * rand, guint i)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+  guint8 *payload;
+  guint size, j;
+
+  /* The last packet of a frame is shorter */
+  size = (i + 1) % PACKETS_PER_FRAME == 0 ? g_rand_int_range (rand, 50, 600) :
+      1100;
+
+  buffer = gst_rtp_buffer_new_allocate (size, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, MEDIA_PT);
+  gst_rtp_buffer_set_seq (&rtp, i);
+  gst_rtp_buffer_set_timestamp (&rtp, (i / PACKETS_PER_FRAME) * 3000);
+  gst_rtp_buffer_set_ssrc (&rtp, MEDIA_SSRC);
+  gst_rtp_buffer_set_marker (&rtp, (i + 1) % PACKETS_PER_FRAME == 0);
+
+  payload = gst_rtp_buffer_get_payload (&rtp);
+  for (j = 0; j < size; j++) {
+    payload[j] = g_rand_int (rand);
+  }
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+static GstFlowReturn
+receive_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  LossData *data = g_object_get_data (G_OBJECT (pad), LOSS_DATA);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstMapInfo info;
+  GstBuffer *sent;
+
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+
+  if (gst_rtp_buffer_get_payload_type (&rtp) != MEDIA_PT) {
+    data->fec++;
+  } else {
+    /* Recovered packets must be identical to the ones sent */
+    sent = data->sent[gst_rtp_buffer_get_seq (&rtp)];
+    gst_buffer_map (sent, &info, GST_MAP_READ);
+    if (gst_buffer_get_size (buffer) != info.size ||
+        gst_buffer_memcmp (buffer, 0, info.data, info.size) != 0) {
+      data->corrupted++;
+    }
+    gst_buffer_unmap (sent, &info);
+    data->received++;
+  }
+
+  gst_rtp_buffer_unmap (&rtp);
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+/* Sends the packets through an identity element dropping @loss of them,
+ * with FEC added before it and recovered after it */
+static void
+run_with_loss (KmsRtpFec * fec, gfloat loss, LossData * data)
+{
+  GstElement *pipeline, *impairment;
+  GstPad *srcpad, *sinkpad, *pad;
+  GstSegment segment;
+  GstCaps *caps;
+  GRand *rand;
+  clock_t cpu;
+  guint i;
+
+  pipeline = gst_pipeline_new (NULL);
+  impairment = gst_element_factory_make ("identity", NULL);
+  g_object_set (impairment, "drop-probability", loss, NULL);
+  gst_bin_add (GST_BIN (pipeline), impairment);
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  pad = gst_element_get_static_pad (impairment, "sink");
+  fail_unless (gst_pad_link (srcpad, pad) == GST_PAD_LINK_OK);
+  kms_rtp_fec_watch_rtp_sink (fec, pad);
+  g_object_unref (pad);
+
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, receive_chain);
+  g_object_set_data (G_OBJECT (sinkpad), LOSS_DATA, data);
+  pad = gst_element_get_static_pad (impairment, "src");
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  kms_rtp_fec_watch_rtp_src (fec, pad);
+  g_object_unref (pad);
+
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_pad_set_active (srcpad, TRUE);
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_stream_start ("fec")));
+  caps = gst_caps_new_empty_simple ("application/x-rtp");
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  /* Same losses on every run */
+  g_random_set_seed (42);
+  rand = g_rand_new_with_seed (7);
+
+  for (i = 0; i < PACKETS; i++) {
+    data->sent[i] = create_packet (rand, i);
+  }
+
+  cpu = clock ();
+  for (i = 0; i < PACKETS; i++) {
+    fail_unless (gst_pad_push (srcpad,
+            gst_buffer_ref (data->sent[i])) == GST_FLOW_OK);
+  }
+  cpu = clock () - cpu;
+
+  GST_INFO ("%u packets with %.0f%% loss: %.2f us of CPU per packet",
+      PACKETS, loss * 100, (gdouble) cpu * G_USEC_PER_SEC / CLOCKS_PER_SEC /
+      PACKETS);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  g_object_unref (srcpad);
+  g_object_unref (sinkpad);
+  g_object_unref (pipeline);
+  g_rand_free (rand);
+
+  for (i = 0; i < PACKETS; i++) {
+    gst_buffer_unref (data->sent[i]);
+  }
+}
+
+static KmsRtpFec *
+create_fec (guint overhead)
+{
+  GstSDPMedia *local, *remote;
+  KmsRtpFec *fec;
+
+  fec = kms_rtp_fec_new ();
+  kms_rtp_fec_set_overhead (fec, overhead);
+
+  local = create_video_media (TRUE);
+  remote = create_video_media (TRUE);
+  kms_rtp_fec_configure (fec, local, remote);
+  gst_sdp_media_free (local);
+  gst_sdp_media_free (remote);
+
+  return fec;
+}
+
+GST_START_TEST (negotiation)
+{
+  GstSDPMessage *offer;
+  GstSDPMedia *media;
+  KmsRtpFec *fec;
+
+  fec = kms_rtp_fec_new ();
+
+  /* Disabled by default */
+  media = create_video_media (FALSE);
+  kms_rtp_fec_configure_media (fec, NULL, media);
+  fail_unless_equals_int (gst_sdp_media_formats_len (media), 1);
+  gst_sdp_media_free (media);
+
+  /* Offer */
+  kms_rtp_fec_set_overhead (fec, 20);
+  media = create_video_media (FALSE);
+  gst_sdp_media_add_attribute (media, "ssrc", "1111 cname:test");
+  kms_rtp_fec_configure_media (fec, NULL, media);
+  fail_unless_equals_int (gst_sdp_media_formats_len (media), 2);
+  fail_unless (media_has_attribute (media, "rtpmap", "97 flexfec-03/90000"));
+  fail_unless (media_has_attribute (media, "fmtp", "97 repair-window="));
+  fail_unless (media_has_attribute (media, "ssrc-group", "FEC-FR 1111 "));
+  gst_sdp_media_free (media);
+
+  /* Answer to an offer with FEC, with its payload type */
+  gst_sdp_message_new (&offer);
+  media = create_video_media (TRUE);
+  gst_sdp_message_add_media (offer, media);
+  gst_sdp_media_free (media);
+
+  media = create_video_media (FALSE);
+  kms_rtp_fec_configure_media (fec, offer, media);
+  fail_unless (media_has_attribute (media, "rtpmap", "100 flexfec-03/90000"));
+  gst_sdp_media_free (media);
+  gst_sdp_message_free (offer);
+
+  /* Answer to an offer without FEC */
+  gst_sdp_message_new (&offer);
+  media = create_video_media (FALSE);
+  gst_sdp_message_add_media (offer, media);
+  gst_sdp_media_free (media);
+
+  media = create_video_media (FALSE);
+  kms_rtp_fec_configure_media (fec, offer, media);
+  fail_unless_equals_int (gst_sdp_media_formats_len (media), 1);
+  gst_sdp_media_free (media);
+  gst_sdp_message_free (offer);
+
+  kms_rtp_fec_free (fec);
+}
+
+GST_END_TEST
+
+GST_START_TEST (no_loss)
+{
+  KmsRtpFec *fec = create_fec (20);
+  LossData *data = g_new0 (LossData, 1);
+
+  run_with_loss (fec, 0.0, data);
+
+  /* Two FEC packets per frame of 10, none of them delivered */
+  fail_unless_equals_int (data->received, PACKETS);
+  fail_unless_equals_int (data->fec, 0);
+  fail_unless_equals_int (data->corrupted, 0);
+  fail_unless (get_fec_stat (fec, "packets-protected") == PACKETS);
+  fail_unless (get_fec_stat (fec, "fec-packets-sent") == 2 * FRAMES);
+  fail_unless (get_fec_stat (fec, "fec-packets-received") == 2 * FRAMES);
+  fail_unless (get_fec_stat (fec, "packets-recovered") == 0);
+
+  g_free (data);
+  kms_rtp_fec_free (fec);
+}
+
+GST_END_TEST
+
+GST_START_TEST (recover_losses)
+{
+  KmsRtpFec *fec = create_fec (20);
+  LossData *data = g_new0 (LossData, 1);
+  guint64 recovered;
+  guint lost;
+  gdouble ratio;
+
+  run_with_loss (fec, 0.05, data);
+
+  recovered = get_fec_stat (fec, "packets-recovered");
+  lost = PACKETS - (data->received - recovered);
+  ratio = lost > 0 ? (gdouble) recovered / lost : 1.0;
+
+  GST_INFO ("Lost %u packets, recovered %" G_GUINT64_FORMAT " (%.0f%%)",
+      lost, recovered, ratio * 100);
+
+  /* A FEC packet covers 5 packets: a loss is repaired if the other 4 and
+   * the FEC packet arrive, 77% of the times */
+  fail_unless (lost > 0);
+  fail_unless (ratio > 0.6, "Recovered only %.0f%%", ratio * 100);
+  fail_unless_equals_int (data->fec, 0);
+  fail_unless_equals_int (data->corrupted, 0);
+
+  g_free (data);
+  kms_rtp_fec_free (fec);
+}
+
+GST_END_TEST
+
+GST_START_TEST (no_overhead)
+{
+  KmsRtpFec *fec = create_fec (0);
+  LossData *data = g_new0 (LossData, 1);
+
+  run_with_loss (fec, 0.05, data);
+
+  fail_unless (data->received < PACKETS);
+  fail_unless (get_fec_stat (fec, "fec-packets-sent") == 0);
+  fail_unless (get_fec_stat (fec, "packets-recovered") == 0);
+
+  g_free (data);
+  kms_rtp_fec_free (fec);
+}
+
+GST_END_TEST
+
+static GstPadProbeReturn
+record_order (GstPad * pad, GstPadProbeInfo * info, GArray * order)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  gint seq = -1;
+
+  /* Media packets by sequence number, FEC packets as -1 */
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  if (gst_rtp_buffer_get_payload_type (&rtp) == MEDIA_PT) {
+    seq = gst_rtp_buffer_get_seq (&rtp);
+  }
+  gst_rtp_buffer_unmap (&rtp);
+
+  g_array_append_val (order, seq);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstFlowReturn
+discard_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+GST_START_TEST (fec_ahead_of_batch_end)
+{
+  KmsRtpFec *fec = create_fec (20);
+  GArray *order = g_array_new (FALSE, FALSE, sizeof (gint));
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  GstCaps *caps;
+  GRand *rand;
+  guint i;
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sinkpad, discard_chain);
+
+  /* Added before, and run before, the probe of the FEC */
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) record_order, order, NULL);
+  kms_rtp_fec_watch_rtp_sink (fec, sinkpad);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_pad_set_active (srcpad, TRUE);
+
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_stream_start ("fec")));
+  caps = gst_caps_new_empty_simple ("application/x-rtp");
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  rand = g_rand_new_with_seed (7);
+  for (i = 0; i < PACKETS_PER_FRAME; i++) {
+    fail_unless (gst_pad_push (srcpad, create_packet (rand, i)) ==
+        GST_FLOW_OK);
+  }
+  g_rand_free (rand);
+
+  /* Every packet seen once, the two FEC packets right before the marker */
+  fail_unless_equals_int (order->len, PACKETS_PER_FRAME + 2);
+  for (i = 0; i < PACKETS_PER_FRAME - 1; i++) {
+    fail_unless_equals_int (g_array_index (order, gint, i), i);
+  }
+  fail_unless_equals_int (g_array_index (order, gint, i), -1);
+  fail_unless_equals_int (g_array_index (order, gint, i + 1), -1);
+  fail_unless_equals_int (g_array_index (order, gint, i + 2),
+      PACKETS_PER_FRAME - 1);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  g_object_unref (srcpad);
+  g_object_unref (sinkpad);
+  g_array_unref (order);
+  kms_rtp_fec_free (fec);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+rtpfec_suite (void)
+{
+  Suite *s = suite_create ("rtpfec");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, negotiation);
+  tcase_add_test (tc_chain, no_loss);
+  tcase_add_test (tc_chain, recover_losses);
+  tcase_add_test (tc_chain, no_overhead);
+  tcase_add_test (tc_chain, fec_ahead_of_batch_end);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtpfec);
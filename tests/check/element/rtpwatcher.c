@@ -0,0 +1,190 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include <kmsrtpwatcher.h>
+
+#define MARK_DATA "rtp-watcher-test"
+
+static GstFlowReturn
+count_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  guint *received = g_object_get_data (G_OBJECT (pad), "received");
+
+  (*received)++;
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static GstPad *
+create_linked_src (guint * received)
+{
+  GstPad *src, *sink;
+
+  src = gst_pad_new ("src", GST_PAD_SRC);
+  sink = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_chain_function (sink, count_chain);
+  g_object_set_data (G_OBJECT (sink), "received", received);
+
+  fail_unless (gst_pad_link (src, sink) == GST_PAD_LINK_OK);
+  gst_pad_set_active (sink, TRUE);
+  gst_pad_set_active (src, TRUE);
+
+  /* The sink pad stays alive as long as it is linked */
+  g_object_set_data_full (G_OBJECT (src), "peer", sink, gst_object_unref);
+
+  return src;
+}
+
+static GstPadProbeReturn
+first_func (GstPad * pad, GstPadProbeInfo * info, GString * calls)
+{
+  g_string_append_c (calls, 'a');
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+second_func (GstPad * pad, GstPadProbeInfo * info, GString * calls)
+{
+  g_string_append_c (calls, 'b');
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+drop_func (GstPad * pad, GstPadProbeInfo * info, GString * calls)
+{
+  g_string_append_c (calls, 'd');
+
+  return GST_PAD_PROBE_DROP;
+}
+
+static GstPadProbeReturn
+list_func (GstPad * pad, GstPadProbeInfo * info, GString * calls)
+{
+  g_string_append_c (calls, 'l');
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Functions watch a pad once each, in the order they were added */
+GST_START_TEST (pad_funcs_in_order)
+{
+  GString *calls = g_string_new (NULL);
+  GstBufferList *list;
+  guint received = 0;
+  GstPad *src;
+
+  src = create_linked_src (&received);
+
+  fail_unless (kms_rtp_watcher_add_pad_func (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) first_func, calls, NULL));
+  fail_unless (kms_rtp_watcher_add_pad_func (src,
+          GST_PAD_PROBE_TYPE_BUFFER_LIST, (GstPadProbeCallback) list_func,
+          calls, NULL));
+  fail_unless (kms_rtp_watcher_add_pad_func (src,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          (GstPadProbeCallback) second_func, calls, NULL));
+
+  /* As a renegotiation does */
+  fail_if (kms_rtp_watcher_add_pad_func (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) first_func, calls, NULL));
+  fail_unless (kms_rtp_watcher_get_pad_data (src,
+          (GstPadProbeCallback) first_func) == calls);
+  fail_unless (kms_rtp_watcher_get_pad_data (src,
+          (GstPadProbeCallback) drop_func) == NULL);
+
+  fail_unless (gst_pad_push (src, gst_buffer_new ()) == GST_FLOW_OK);
+  fail_unless_equals_string (calls->str, "ab");
+
+  g_string_truncate (calls, 0);
+  list = gst_buffer_list_new ();
+  gst_buffer_list_add (list, gst_buffer_new ());
+  gst_buffer_list_add (list, gst_buffer_new ());
+  fail_unless (gst_pad_push_list (src, list) == GST_FLOW_OK);
+  fail_unless_equals_string (calls->str, "lb");
+
+  fail_unless_equals_int (received, 3);
+
+  gst_pad_set_active (src, FALSE);
+  g_object_unref (src);
+  g_string_free (calls, TRUE);
+}
+
+GST_END_TEST
+/* Functions added after one that drops the data do not see it */
+GST_START_TEST (drop_stops_pad_funcs)
+{
+  GString *calls = g_string_new (NULL);
+  guint received = 0;
+  GstPad *src;
+
+  src = create_linked_src (&received);
+
+  fail_unless (kms_rtp_watcher_add_pad_func (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) first_func, calls, NULL));
+  fail_unless (kms_rtp_watcher_add_pad_func (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) drop_func, calls, NULL));
+  fail_unless (kms_rtp_watcher_add_pad_func (src, GST_PAD_PROBE_TYPE_BUFFER,
+          (GstPadProbeCallback) second_func, calls, NULL));
+
+  fail_unless (gst_pad_push (src, gst_buffer_new ()) == GST_FLOW_OK);
+  fail_unless_equals_string (calls->str, "ad");
+  fail_unless_equals_int (received, 0);
+
+  gst_pad_set_active (src, FALSE);
+  g_object_unref (src);
+  g_string_free (calls, TRUE);
+}
+
+GST_END_TEST
+GST_START_TEST (mark_once)
+{
+  GstPad *pad = gst_pad_new ("src", GST_PAD_SRC);
+
+  fail_unless (kms_rtp_watcher_mark (pad, MARK_DATA));
+  fail_if (kms_rtp_watcher_mark (pad, MARK_DATA));
+
+  g_object_unref (pad);
+}
+
+GST_END_TEST
+/*
+ * End of test cases
+ */
+static Suite *
+rtp_watcher_suite (void)
+{
+  Suite *s = suite_create ("rtpwatcher");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, pad_funcs_in_order);
+  tcase_add_test (tc_chain, drop_stops_pad_funcs);
+  tcase_add_test (tc_chain, mark_once);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtp_watcher);
@@ -0,0 +1,182 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include <kmsstatssnapshot.h>
+
+#define PACKETS_KEY "snapshot-packets"
+
+/* Reports the packets set in the element data */
+static void
+fill_snapshot (GstElement * element, KmsStatsSnapshot * snapshot)
+{
+  snapshot->values[KMS_STATS_COUNTER_PACKETS_SENT] =
+      GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (element), PACKETS_KEY));
+}
+
+static GstElement *
+create_provider (GstElement * pipeline, const gchar * name)
+{
+  GstElement *element = gst_element_factory_make ("identity", name);
+
+  gst_bin_add (GST_BIN (pipeline), element);
+
+  return element;
+}
+
+GST_START_TEST (collect_changed)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *e1, *e2, *sink;
+  KmsStatsSnapshotPoller *poller = kms_stats_snapshot_poller_new ();
+  KmsStatsSnapshot snapshots[3] = { {0} };
+  guint n;
+
+  e1 = create_provider (pipeline, "e1");
+  e2 = create_provider (pipeline, "e2");
+  sink = gst_element_factory_make ("fakesink", NULL);
+  gst_bin_add (GST_BIN (pipeline), sink);
+
+  kms_stats_snapshot_set_fill_func (G_OBJECT_TYPE (e1), fill_snapshot);
+
+  /* Nothing changed yet */
+  n = kms_stats_snapshot_poller_collect (poller, GST_BIN (pipeline),
+      snapshots, 3);
+  fail_unless_equals_int (n, 0);
+
+  g_object_set_data (G_OBJECT (e2), PACKETS_KEY, GUINT_TO_POINTER (10));
+
+  n = kms_stats_snapshot_poller_collect (poller, GST_BIN (pipeline),
+      snapshots, 3);
+  fail_unless_equals_int (n, 1);
+  fail_unless (snapshots[0].element == e2);
+  fail_unless (snapshots[0].changed ==
+      KMS_STATS_COUNTER_MASK (KMS_STATS_COUNTER_PACKETS_SENT));
+  fail_unless (snapshots[0].values[KMS_STATS_COUNTER_PACKETS_SENT] == 10);
+  fail_unless (snapshots[1].element == NULL);
+  kms_stats_snapshot_clear (&snapshots[0]);
+
+  /* Only changes since the previous snapshot are reported */
+  n = kms_stats_snapshot_poller_collect (poller, GST_BIN (pipeline),
+      snapshots, 3);
+  fail_unless_equals_int (n, 0);
+
+  g_object_set_data (G_OBJECT (e1), PACKETS_KEY, GUINT_TO_POINTER (1));
+  g_object_set_data (G_OBJECT (e2), PACKETS_KEY, GUINT_TO_POINTER (11));
+
+  n = kms_stats_snapshot_poller_collect (poller, GST_BIN (pipeline),
+      snapshots, 3);
+  fail_unless_equals_int (n, 2);
+  kms_stats_snapshot_clear (&snapshots[0]);
+  kms_stats_snapshot_clear (&snapshots[1]);
+
+  fail_unless_equals_string (kms_stats_snapshot_get_counter_name
+      (KMS_STATS_COUNTER_BYTES_RECEIVED), "bytes-received");
+
+  kms_stats_snapshot_set_fill_func (G_OBJECT_TYPE (e1), NULL);
+  kms_stats_snapshot_poller_free (poller);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST
+
+GST_START_TEST (independent_pollers)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  KmsStatsSnapshotPoller *p1, *p2;
+  KmsStatsSnapshot snapshots[2] = { {0} };
+  GstElement *e1, *e2;
+  guint n;
+
+  e1 = create_provider (pipeline, "e1");
+  e2 = create_provider (pipeline, "e2");
+  kms_stats_snapshot_set_fill_func (G_OBJECT_TYPE (e1), fill_snapshot);
+
+  p1 = kms_stats_snapshot_poller_new ();
+  p2 = kms_stats_snapshot_poller_new ();
+
+  g_object_set_data (G_OBJECT (e1), PACKETS_KEY, GUINT_TO_POINTER (5));
+
+  n = kms_stats_snapshot_poller_collect (p1, GST_BIN (pipeline), snapshots,
+      2);
+  fail_unless_equals_int (n, 1);
+  fail_unless (snapshots[0].element == e1);
+  kms_stats_snapshot_clear (&snapshots[0]);
+
+  /* A poll by one poller does not hide the change from the other one */
+  n = kms_stats_snapshot_poller_collect (p2, GST_BIN (pipeline), snapshots,
+      2);
+  fail_unless_equals_int (n, 1);
+  fail_unless (snapshots[0].element == e1);
+  fail_unless (snapshots[0].values[KMS_STATS_COUNTER_PACKETS_SENT] == 5);
+  kms_stats_snapshot_clear (&snapshots[0]);
+
+  n = kms_stats_snapshot_poller_collect (p1, GST_BIN (pipeline), snapshots,
+      2);
+  fail_unless_equals_int (n, 0);
+
+  /* An element added again is reported as new */
+  gst_object_ref (e1);
+  gst_bin_remove (GST_BIN (pipeline), e1);
+  n = kms_stats_snapshot_poller_collect (p1, GST_BIN (pipeline), snapshots,
+      2);
+  fail_unless_equals_int (n, 0);
+  gst_bin_add (GST_BIN (pipeline), e1);
+  gst_object_unref (e1);
+
+  n = kms_stats_snapshot_poller_collect (p1, GST_BIN (pipeline), snapshots,
+      2);
+  fail_unless_equals_int (n, 1);
+  fail_unless (snapshots[0].element == e1);
+  kms_stats_snapshot_clear (&snapshots[0]);
+
+  g_object_set_data (G_OBJECT (e2), PACKETS_KEY, GUINT_TO_POINTER (1));
+  n = kms_stats_snapshot_poller_collect (p2, GST_BIN (pipeline), snapshots,
+      2);
+  fail_unless_equals_int (n, 1);
+  fail_unless (snapshots[0].element == e2);
+  kms_stats_snapshot_clear (&snapshots[0]);
+
+  kms_stats_snapshot_set_fill_func (G_OBJECT_TYPE (e1), NULL);
+  kms_stats_snapshot_poller_free (p1);
+  kms_stats_snapshot_poller_free (p2);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST
+/*
+ * End of test cases
+ */
+static Suite *
+statssnapshot_suite (void)
+{
+  Suite *s = suite_create ("statssnapshot");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, collect_changed);
+  tcase_add_test (tc_chain, independent_pollers);
+
+  return s;
+}
+
+GST_CHECK_MAIN (statssnapshot);
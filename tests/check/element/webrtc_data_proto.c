@@ -356,6 +356,238 @@ GST_START_TEST (destroy_channels)
   g_main_loop_unref (loop);
 }
 
+GST_END_TEST
+#define BURST_SIZE 32
+typedef struct _BurstTest
+{
+  gint received;
+  GMainLoop *loop;
+  KmsWebRtcDataChannel *sender;
+} BurstTest;
+
+static GstFlowReturn
+burst_buffer_received_cb (GObject * obj, GstBuffer * buffer,
+    gpointer user_data)
+{
+  BurstTest *test = user_data;
+
+  fail_unless (gst_buffer_get_size (buffer) == strlen (TEST_MESSAGE));
+
+  if (g_atomic_int_add (&test->received, 1) == BURST_SIZE - 1) {
+    g_idle_add (quit_main_loop_idle, test->loop);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void
+burst_data_channel_opened_cb (KmsWebRtcDataSessionBin * self, guint stream_id,
+    BurstTest * test)
+{
+  KmsWebRtcDataChannel *channel;
+  gboolean is_client;
+  gint i;
+
+  g_signal_emit_by_name (self, "get-data-channel", stream_id, &channel);
+  g_object_get (self, "dtls-client-mode", &is_client, NULL);
+
+  if (!is_client) {
+    kms_webrtc_data_channel_set_new_buffer_callback (channel,
+        burst_buffer_received_cb, test, NULL);
+    return;
+  }
+
+  test->sender = channel;
+
+  /* Faster than SCTP sends them, so they queue up in the channel */
+  for (i = 0; i < BURST_SIZE; i++) {
+    gchar *msg = g_strdup (TEST_MESSAGE);
+    GstBuffer *buffer = gst_buffer_new_wrapped (msg, strlen (msg));
+
+    fail_unless (kms_webrtc_data_channel_push_buffer (channel, buffer,
+            FALSE) == GST_FLOW_OK);
+    gst_buffer_unref (buffer);
+  }
+}
+
+GST_START_TEST (burst_send)
+{
+  GstElement *session1, *session2, *udpsrc1, *udpsink1, *udpsrc2, *udpsink2;
+  GstElement *pipeline;
+  BurstTest test;
+  gint stream_id;
+  gulong id1, id2;
+
+  test.received = 0;
+  test.sender = NULL;
+  test.loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new ("pipeline");
+
+  udpsink1 = gst_element_factory_make ("udpsink", NULL);
+  udpsrc1 = gst_element_factory_make ("udpsrc", NULL);
+  session1 = GST_ELEMENT (kms_webrtc_data_session_bin_new (TRUE));
+  id1 = g_signal_connect (session1, "data-channel-opened",
+      G_CALLBACK (burst_data_channel_opened_cb), &test);
+
+  udpsink2 = gst_element_factory_make ("udpsink", NULL);
+  udpsrc2 = gst_element_factory_make ("udpsrc", NULL);
+  session2 = GST_ELEMENT (kms_webrtc_data_session_bin_new (FALSE));
+  id2 = g_signal_connect (session2, "data-channel-opened",
+      G_CALLBACK (burst_data_channel_opened_cb), &test);
+
+  g_object_set (udpsink1, "host", "127.0.0.1", "port", 5555, "sync", FALSE,
+      "async", FALSE, NULL);
+  g_object_set (udpsrc1, "port", 6666, NULL);
+  g_object_set (session1, "sctp-local-port", 9999, "sctp-remote-port", 9999,
+      NULL);
+
+  g_object_set (udpsink2, "host", "127.0.0.1", "port", 6666, "sync", FALSE,
+      "async", FALSE, NULL);
+  g_object_set (udpsrc2, "port", 5555, NULL);
+  g_object_set (session2, "sctp-local-port", 9999, "sctp-remote-port", 9999,
+      NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), session1, session2, udpsink1, udpsrc1,
+      udpsink2, udpsrc2, NULL);
+
+  gst_element_link_many (udpsrc1, session1, udpsink1, NULL);
+  gst_element_link_many (udpsrc2, session2, udpsink2, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (1, print_timedout_pipeline, pipeline);
+
+  g_signal_emit_by_name (session1, "create-data-channel", TRUE, -1, -1,
+      "TestChannel", "webrtc-datachannel", &stream_id);
+
+  g_main_loop_run (test.loop);
+
+  GST_DEBUG ("Finished test");
+
+  /* Everything was delivered, so nothing can remain queued */
+  fail_unless (test.sender != NULL);
+  fail_unless (kms_webrtc_data_channel_get_buffered_amount (test.sender) == 0);
+
+  g_signal_handler_disconnect (session1, id1);
+  g_signal_handler_disconnect (session2, id2);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_main_loop_unref (test.loop);
+}
+
+GST_END_TEST
+#define LARGE_MESSAGE_SIZE (1024 * 1024)
+static GstFlowReturn
+large_message_received_cb (GObject * obj, GstBuffer * buffer,
+    gpointer user_data)
+{
+  GstMapInfo info;
+  gsize i;
+
+  /* SCTP splits it in chunks, but it is delivered as a single message */
+  fail_unless (gst_buffer_get_size (buffer) == LARGE_MESSAGE_SIZE);
+  fail_unless (gst_buffer_map (buffer, &info, GST_MAP_READ));
+
+  for (i = 0; i < info.size; i++) {
+    fail_unless (info.data[i] == (guint8) (i & 0xff));
+  }
+
+  gst_buffer_unmap (buffer, &info);
+
+  g_idle_add (quit_main_loop_idle, user_data);
+
+  return GST_FLOW_OK;
+}
+
+static void
+large_message_channel_opened_cb (KmsWebRtcDataSessionBin * self,
+    guint stream_id, gpointer user_data)
+{
+  KmsWebRtcDataChannel *channel;
+  gboolean is_client;
+  guint8 *data;
+  guint i;
+
+  g_signal_emit_by_name (self, "get-data-channel", stream_id, &channel);
+  g_object_get (self, "dtls-client-mode", &is_client, NULL);
+
+  if (!is_client) {
+    kms_webrtc_data_channel_set_new_buffer_callback (channel,
+        large_message_received_cb, user_data, NULL);
+    return;
+  }
+
+  data = g_malloc (LARGE_MESSAGE_SIZE);
+
+  for (i = 0; i < LARGE_MESSAGE_SIZE; i++) {
+    data[i] = i & 0xff;
+  }
+
+  kms_webrtc_data_channel_push_buffer (channel,
+      gst_buffer_new_wrapped (data, LARGE_MESSAGE_SIZE), TRUE);
+}
+
+GST_START_TEST (large_message)
+{
+  GstElement *session1, *session2, *udpsrc1, *udpsink1, *udpsrc2, *udpsink2;
+  GstElement *pipeline;
+  gint stream_id;
+  GMainLoop *loop;
+  gulong id1, id2;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  pipeline = gst_pipeline_new ("pipeline");
+
+  udpsink1 = gst_element_factory_make ("udpsink", NULL);
+  udpsrc1 = gst_element_factory_make ("udpsrc", NULL);
+  session1 = GST_ELEMENT (kms_webrtc_data_session_bin_new (TRUE));
+  id1 = g_signal_connect (session1, "data-channel-opened",
+      G_CALLBACK (large_message_channel_opened_cb), loop);
+
+  udpsink2 = gst_element_factory_make ("udpsink", NULL);
+  udpsrc2 = gst_element_factory_make ("udpsrc", NULL);
+  session2 = GST_ELEMENT (kms_webrtc_data_session_bin_new (FALSE));
+  id2 = g_signal_connect (session2, "data-channel-opened",
+      G_CALLBACK (large_message_channel_opened_cb), loop);
+
+  g_object_set (udpsink1, "host", "127.0.0.1", "port", 5555, "sync", FALSE,
+      "async", FALSE, NULL);
+  g_object_set (udpsrc1, "port", 6666, NULL);
+  g_object_set (session1, "sctp-local-port", 9999, "sctp-remote-port", 9999,
+      NULL);
+
+  g_object_set (udpsink2, "host", "127.0.0.1", "port", 6666, "sync", FALSE,
+      "async", FALSE, NULL);
+  g_object_set (udpsrc2, "port", 5555, NULL);
+  g_object_set (session2, "sctp-local-port", 9999, "sctp-remote-port", 9999,
+      NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), session1, session2, udpsink1, udpsrc1,
+      udpsink2, udpsrc2, NULL);
+
+  gst_element_link_many (udpsrc1, session1, udpsink1, NULL);
+  gst_element_link_many (udpsrc2, session2, udpsink2, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_timeout_add_seconds (1, print_timedout_pipeline, pipeline);
+
+  g_signal_emit_by_name (session1, "create-data-channel", TRUE, -1, -1,
+      "TestChannel", "webrtc-datachannel", &stream_id);
+
+  g_main_loop_run (loop);
+
+  GST_DEBUG ("Finished test");
+
+  g_signal_handler_disconnect (session1, id1);
+  g_signal_handler_disconnect (session2, id2);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (GST_OBJECT (pipeline));
+  g_main_loop_unref (loop);
+}
+
 GST_END_TEST static Suite *
 webrtc_data_protocol_suite (void)
 {
@@ -367,6 +599,8 @@ webrtc_data_protocol_suite (void)
   tcase_add_test (tc_chain, data_session_established);
   tcase_add_test (tc_chain, connection);
   tcase_add_test (tc_chain, destroy_channels);
+  tcase_add_test (tc_chain, burst_send);
+  tcase_add_test (tc_chain, large_message);
 
   return s;
 }
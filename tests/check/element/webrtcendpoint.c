@@ -17,7 +17,9 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/sdp/gstsdpmessage.h>
+#include <kmstestutils.h>
 #include <webrtcendpoint/kmsicecandidate.h>
+#include <webrtcendpoint/kmswebrtcrtxcache.h>
 
 #include <commons/kmselementpadtype.h>
 
@@ -1665,6 +1667,13 @@ test_offerer_audio_video_answerer_video_sendrecv (const gchar * audio_enc_name,
 
 #define TEST_MESSAGE "Hello world!"
 
+/* KmsWebRtcDataChannelBin plus its appsrc and appsink. The session appsrc
+ * and appsink are shared, so channels do not add their own pair */
+#define ELEMENTS_PER_DATA_CHANNEL 3
+
+/* Resident memory added by each channel after the first one, in bytes */
+#define MAX_MEMORY_PER_DATA_CHANNEL (256 * 1024)
+
 static void
 feed_data_channel (GstElement * appsrc, guint unused_size, gpointer data)
 {
@@ -1767,10 +1776,16 @@ static void
 data_session_established_cb (GstElement * self, const gchar * sess_id,
     gboolean connected, gpointer data)
 {
+  guint i, num_channels = GPOINTER_TO_UINT (data);
+
   GST_DEBUG_OBJECT (self, "Data session %s",
       (connected) ? "established" : "finished");
 
-  if (connected) {
+  if (!connected) {
+    return;
+  }
+
+  for (i = 0; i < num_channels; i++) {
     gint stream_id;
 
     g_signal_emit_by_name (self, "create-data-channel", sess_id, TRUE, -1, -1,
@@ -1782,8 +1797,72 @@ data_session_established_cb (GstElement * self, const gchar * sess_id,
   }
 }
 
+typedef struct _DataChannelsCounter
+{
+  GMainLoop *loop;
+  guint expected;
+  guint opened;
+  guint first_elements;
+  glong first_rss;
+  guint last_elements;
+  glong last_rss;
+} DataChannelsCounter;
+
+static guint
+count_elements (GstElement * element)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+  guint count = 0;
+
+  it = gst_bin_iterate_recurse (GST_BIN (element));
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        count++;
+        g_value_reset (&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        count = 0;
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  return count;
+}
+
+static void
+data_channel_opened_cb (GstElement * self, const gchar * sess_id,
+    guint stream_id, DataChannelsCounter * counter)
+{
+  counter->opened++;
+
+  GST_DEBUG_OBJECT (self, "Data channel %u opened (%u/%u)", stream_id,
+      counter->opened, counter->expected);
+
+  if (counter->opened == 1) {
+    counter->first_elements = count_elements (self);
+    counter->first_rss = kms_test_get_resident_memory ();
+  }
+
+  if (counter->opened == counter->expected) {
+    counter->last_elements = count_elements (self);
+    counter->last_rss = kms_test_get_resident_memory ();
+    g_idle_add (quit_main_loop_idle, counter->loop);
+  }
+}
+
 static void
-test_data_channels (gboolean bundle)
+test_data_channels (gboolean bundle, guint num_channels)
 {
   gchar *sender_sess_id, *receiver_sess_id;
   OnIceCandidateData *sender_cand_data, *receiver_cand_data;
@@ -1801,6 +1880,7 @@ test_data_channels (gboolean bundle)
   gboolean ret;
   TmpCallbackData tmp;
   gboolean answer_ok;
+  DataChannelsCounter counter = { 0 };
 
   GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
 
@@ -1808,7 +1888,8 @@ test_data_channels (gboolean bundle)
   g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
 
   g_signal_connect (sender, "data-session-established",
-      G_CALLBACK (data_session_established_cb), NULL);
+      G_CALLBACK (data_session_established_cb),
+      GUINT_TO_POINTER (num_channels));
 
   /* Session creation */
   g_signal_emit_by_name (sender, "create-session", &sender_sess_id);
@@ -1848,8 +1929,16 @@ test_data_channels (gboolean bundle)
   tmp.pipeline = pipeline;
   tmp.loop = loop;
 
-  g_signal_connect (receiver, "pad-added",
-      G_CALLBACK (webrtc_receiver_pad_added), &tmp);
+  if (num_channels > 1) {
+    /* Finish once all the channels are opened instead of on first data */
+    counter.loop = loop;
+    counter.expected = num_channels;
+    g_signal_connect (receiver, "data-channel-opened",
+        G_CALLBACK (data_channel_opened_cb), &counter);
+  } else {
+    g_signal_connect (receiver, "pad-added",
+        G_CALLBACK (webrtc_receiver_pad_added), &tmp);
+  }
 
   g_signal_emit_by_name (receiver, "request-new-pad",
       KMS_ELEMENT_PAD_TYPE_DATA, NULL, GST_PAD_SRC, &padname);
@@ -1928,6 +2017,23 @@ test_data_channels (gboolean bundle)
   GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (pipeline),
       GST_DEBUG_GRAPH_SHOW_ALL, "test_data_channels_end");
 
+  if (num_channels > 1) {
+    glong memory_per_channel = (counter.last_rss - counter.first_rss) /
+        (glong) (num_channels - 1);
+
+    GST_INFO ("%u channels opened, elements: %u -> %u, memory per channel: "
+        "%ld bytes", counter.opened, counter.first_elements,
+        counter.last_elements, memory_per_channel);
+
+    /* Only the channel bin of the SCTP stream is added for each channel */
+    fail_unless (counter.opened == num_channels);
+    fail_unless (counter.last_elements - counter.first_elements ==
+        (num_channels - 1) * ELEMENTS_PER_DATA_CHANNEL);
+    fail_unless (memory_per_channel <= MAX_MEMORY_PER_DATA_CHANNEL,
+        "%ld bytes per data channel, expected at most %d", memory_per_channel,
+        MAX_MEMORY_PER_DATA_CHANNEL);
+  }
+
   GST_WARNING ("Finishing test");
 
   gst_element_set_state (pipeline, GST_STATE_NULL);
@@ -1944,10 +2050,18 @@ test_data_channels (gboolean bundle)
 GST_START_TEST (test_webrtc_data_channel)
 {
   /* Check data channels in a bundle connection */
-  test_data_channels (TRUE);
+  test_data_channels (TRUE, 1);
 
   /* Check data channels in a dedicated connection */
-  test_data_channels (FALSE);
+  test_data_channels (FALSE, 1);
+}
+GST_END_TEST
+
+#define MULTIPLE_DATA_CHANNELS 64
+
+GST_START_TEST (test_webrtc_multiple_data_channels)
+{
+  test_data_channels (TRUE, MULTIPLE_DATA_CHANNELS);
 }
 GST_END_TEST
 
@@ -2624,6 +2738,218 @@ GST_START_TEST (set_external_address_test)
 }
 GST_END_TEST
 
+GST_START_TEST (audio_level_extmap_offer)
+{
+  GArray *codecs_array;
+  gchar *codecs[] = { "opus/48000/2", NULL };
+  GstElement *offerer = gst_element_factory_make ("webrtcendpoint", NULL);
+  const GstSDPMedia *media;
+  GstSDPMessage *offer;
+  gchar *offerer_sess_id;
+  gboolean voice;
+  guint i, level;
+  gboolean found = FALSE;
+
+  codecs_array = create_codecs_array (codecs);
+  g_object_set (offerer, "num-audio-medias", 1, "audio-codecs",
+      g_array_ref (codecs_array), NULL);
+  g_array_unref (codecs_array);
+
+  /* Nothing received yet */
+  g_object_get (offerer, "audio-level", &level, "voice-activity", &voice,
+      NULL);
+  fail_unless_equals_int (level, 127);
+  fail_if (voice);
+
+  g_signal_emit_by_name (offerer, "create-session", &offerer_sess_id);
+  g_signal_emit_by_name (offerer, "generate-offer", offerer_sess_id, &offer);
+  fail_unless (offer != NULL);
+
+  media = gst_sdp_message_get_media (offer, 0);
+
+  for (i = 0; i < gst_sdp_media_attributes_len (media); i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+
+    if (g_strcmp0 (attr->key, "extmap") == 0 && attr->value != NULL &&
+        g_strstr_len (attr->value, -1,
+            "urn:ietf:params:rtp-hdrext:ssrc-audio-level") != NULL) {
+      found = TRUE;
+    }
+  }
+
+  fail_unless (found);
+
+  gst_sdp_message_free (offer);
+  g_object_unref (offerer);
+  g_free (offerer_sess_id);
+}
+GST_END_TEST
+
+static gboolean
+media_has_attribute (const GstSDPMedia * media, const gchar * key,
+    const gchar * value)
+{
+  guint i;
+
+  for (i = 0; i < gst_sdp_media_attributes_len (media); i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (media, i);
+
+    if (g_strcmp0 (attr->key, key) == 0 && g_strcmp0 (attr->value,
+            value) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+GST_START_TEST (simulcast_answer)
+{
+  GArray *codecs_array;
+  gchar *codecs[] = { "VP8/90000", NULL };
+  GstElement *offerer = gst_element_factory_make ("webrtcendpoint", NULL);
+  GstElement *answerer = gst_element_factory_make ("webrtcendpoint", NULL);
+  GstSDPMedia *media;
+  GstSDPMessage *offer, *answer;
+  gchar *offerer_sess_id, *answerer_sess_id;
+  guint layers;
+  gint layer;
+
+  codecs_array = create_codecs_array (codecs);
+  g_object_set (offerer, "num-video-medias", 1, "video-codecs",
+      g_array_ref (codecs_array), NULL);
+  g_object_set (answerer, "num-video-medias", 1, "video-codecs",
+      g_array_ref (codecs_array), NULL);
+  g_array_unref (codecs_array);
+
+  g_object_get (answerer, "simulcast-layer", &layer, "simulcast-layers",
+      &layers, NULL);
+  fail_unless_equals_int (layer, -1);
+  fail_unless_equals_int (layers, 0);
+
+  g_signal_emit_by_name (offerer, "create-session", &offerer_sess_id);
+  g_signal_emit_by_name (answerer, "create-session", &answerer_sess_id);
+
+  g_signal_emit_by_name (offerer, "generate-offer", offerer_sess_id, &offer);
+  fail_unless (offer != NULL);
+
+  /* Make it look like a browser sending two layers */
+  media = (GstSDPMedia *) gst_sdp_message_get_media (offer, 0);
+  fail_unless (media_has_attribute (media, "extmap",
+          "2 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id"));
+  gst_sdp_media_add_attribute (media, "rid", "lo send");
+  gst_sdp_media_add_attribute (media, "rid", "hi send");
+  gst_sdp_media_add_attribute (media, "simulcast", "send lo;hi");
+
+  g_signal_emit_by_name (answerer, "process-offer", answerer_sess_id, offer,
+      &answer);
+  fail_unless (answer != NULL);
+
+  media = (GstSDPMedia *) gst_sdp_message_get_media (answer, 0);
+  fail_unless (media_has_attribute (media, "rid", "lo recv"));
+  fail_unless (media_has_attribute (media, "rid", "hi recv"));
+  fail_unless (media_has_attribute (media, "simulcast", "recv lo;hi"));
+
+  gst_sdp_message_free (offer);
+  gst_sdp_message_free (answer);
+  g_object_unref (offerer);
+  g_object_unref (answerer);
+  g_free (offerer_sess_id);
+  g_free (answerer_sess_id);
+}
+GST_END_TEST
+
+GST_START_TEST (transport_cc_negotiation)
+{
+  GArray *codecs_array;
+  gchar *codecs[] = { "VP8/90000", NULL };
+  GstElement *offerer = gst_element_factory_make ("webrtcendpoint", NULL);
+  GstElement *answerer = gst_element_factory_make ("webrtcendpoint", NULL);
+  const GstSDPMedia *media;
+  GstSDPMessage *offer, *answer;
+  gchar *offerer_sess_id, *answerer_sess_id, *fb;
+
+  codecs_array = create_codecs_array (codecs);
+  g_object_set (offerer, "num-video-medias", 1, "video-codecs",
+      g_array_ref (codecs_array), NULL);
+  g_object_set (answerer, "num-video-medias", 1, "video-codecs",
+      g_array_ref (codecs_array), NULL);
+  g_array_unref (codecs_array);
+
+  g_signal_emit_by_name (offerer, "create-session", &offerer_sess_id);
+  g_signal_emit_by_name (answerer, "create-session", &answerer_sess_id);
+
+  g_signal_emit_by_name (offerer, "generate-offer", offerer_sess_id, &offer);
+  fail_unless (offer != NULL);
+
+  media = gst_sdp_message_get_media (offer, 0);
+  fail_unless (media_has_attribute (media, "extmap",
+          "5 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"));
+  fb = g_strdup_printf ("%s transport-cc", gst_sdp_media_get_format (media,
+          0));
+  fail_unless (media_has_attribute (media, "rtcp-fb", fb));
+
+  g_signal_emit_by_name (answerer, "process-offer", answerer_sess_id, offer,
+      &answer);
+  fail_unless (answer != NULL);
+
+  media = gst_sdp_message_get_media (answer, 0);
+  fail_unless (media_has_attribute (media, "rtcp-fb", fb));
+
+  g_free (fb);
+  gst_sdp_message_free (offer);
+  gst_sdp_message_free (answer);
+  g_object_unref (offerer);
+  g_object_unref (answerer);
+  g_free (offerer_sess_id);
+  g_free (answerer_sess_id);
+}
+GST_END_TEST
+
+GST_START_TEST (rtx_cache_stats)
+{
+  GstElement *webrtcendpoint = gst_element_factory_make ("webrtcendpoint",
+      NULL);
+  const GstStructure *cache_stats;
+  GstStructure *stats;
+  guint64 hits, misses, too_old;
+  guint time, size;
+
+  g_object_get (webrtcendpoint, "rtx-cache-time", &time, "rtx-cache-size",
+      &size, NULL);
+  fail_unless_equals_int (time, 1000);
+  fail_unless_equals_int (size, 4 * 1024 * 1024);
+
+  g_object_set (webrtcendpoint, "rtx-cache-time", 500, NULL);
+  g_object_get (webrtcendpoint, "rtx-cache-time", &time, NULL);
+  fail_unless_equals_int (time, 500);
+
+  /* Shared by all the endpoints */
+  g_object_get (webrtcendpoint, "rtx-cache-process-size", &size, NULL);
+  fail_unless_equals_int (size, 256 * 1024 * 1024);
+  g_object_set (webrtcendpoint, "rtx-cache-process-size", 1024, NULL);
+  fail_unless_equals_int (kms_webrtc_rtx_cache_get_process_size (), 1024);
+  g_object_set (webrtcendpoint, "rtx-cache-process-size", 256 * 1024 * 1024,
+      NULL);
+
+  g_signal_emit_by_name (webrtcendpoint, "stats", NULL, &stats);
+  fail_unless (stats != NULL);
+
+  cache_stats = gst_value_get_structure (gst_structure_get_value (stats,
+          "rtx-cache-stats"));
+  fail_unless (cache_stats != NULL);
+  fail_unless (gst_structure_get (cache_stats, "hits", G_TYPE_UINT64, &hits,
+          "misses", G_TYPE_UINT64, &misses, "too-old", G_TYPE_UINT64,
+          &too_old, NULL));
+  fail_unless_equals_uint64 (hits, 0);
+  fail_unless_equals_uint64 (misses, 0);
+  fail_unless_equals_uint64 (too_old, 0);
+
+  gst_structure_free (stats);
+  g_object_unref (webrtcendpoint);
+}
+GST_END_TEST
+
 /*
  * End of test cases
  */
@@ -2663,12 +2989,16 @@ webrtcendpoint_test_suite (void)
   tcase_add_test (tc_chain, test_port_range);
   tcase_add_test (tc_chain, test_not_enough_ports);
 
-  // FIXME fails with libnice 0.1.13 on trusty (timeout)
-  //tcase_add_test (tc_chain, test_webrtc_data_channel);
+  tcase_add_test (tc_chain, test_webrtc_data_channel);
+  tcase_add_test (tc_chain, test_webrtc_multiple_data_channels);
 
   tcase_add_test (tc_chain, process_mid_no_bundle_offer);
   tcase_add_test (tc_chain, set_network_interfaces_test);
   tcase_add_test (tc_chain, set_external_address_test);
+  tcase_add_test (tc_chain, audio_level_extmap_offer);
+  tcase_add_test (tc_chain, simulcast_answer);
+  tcase_add_test (tc_chain, transport_cc_negotiation);
+  tcase_add_test (tc_chain, rtx_cache_stats);
 
   return s;
 }
@@ -0,0 +1,410 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#include <webrtcendpoint/kmswebrtcrtxcache.h>
+
+#define SSRC 0x1234abcd
+#define PAYLOAD_SIZE 1000
+#define RECEIVED_DATA "received"
+
+/* Pads of a connection: media and retransmissions go into the encoder,
+ * NACKs come out of the decoder */
+typedef struct _Connection
+{
+  KmsWebrtcRtxCache *cache;
+  GstElement *encoder;
+  GstPad *media;
+  GstPad *rtx_sink;
+  GstPad *rtcp_src;
+  GstPad *rtcp_sink;
+} Connection;
+
+static GstFlowReturn
+collect_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GPtrArray *received = g_object_get_data (G_OBJECT (pad), RECEIVED_DATA);
+
+  g_ptr_array_add (received, buffer);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+collect_chain_list (GstPad * pad, GstObject * parent, GstBufferList * list)
+{
+  guint i;
+
+  for (i = 0; i < gst_buffer_list_length (list); i++) {
+    collect_chain (pad, parent, gst_buffer_ref (gst_buffer_list_get (list,
+                i)));
+  }
+
+  gst_buffer_list_unref (list);
+
+  return GST_FLOW_OK;
+}
+
+static GstPad *
+create_collector (const gchar * name)
+{
+  GstPad *sink = gst_pad_new (name, GST_PAD_SINK);
+
+  g_object_set_data_full (G_OBJECT (sink), RECEIVED_DATA,
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref),
+      (GDestroyNotify) g_ptr_array_unref);
+  gst_pad_set_chain_function (sink, collect_chain);
+  gst_pad_set_chain_list_function (sink, collect_chain_list);
+  gst_pad_set_active (sink, TRUE);
+
+  return sink;
+}
+
+static GPtrArray *
+get_received (GstPad * sink)
+{
+  return g_object_get_data (G_OBJECT (sink), RECEIVED_DATA);
+}
+
+static GstPad *
+create_src (const gchar * name, GstPad * sink, const gchar * media_type)
+{
+  GstPad *src = gst_pad_new (name, GST_PAD_SRC);
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *stream_id;
+
+  fail_unless (gst_pad_link (src, sink) == GST_PAD_LINK_OK);
+  gst_pad_set_active (src, TRUE);
+
+  stream_id = g_strdup_printf ("rtx-cache-test-%p", src);
+  gst_pad_push_event (src, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  caps = gst_caps_new_empty_simple (media_type);
+  gst_pad_push_event (src, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (src, gst_event_new_segment (&segment));
+
+  return src;
+}
+
+static void
+connection_init (Connection * conn)
+{
+  GstPad *sink;
+
+  conn->cache = kms_webrtc_rtx_cache_new ();
+  conn->encoder = gst_object_ref_sink (gst_bin_new (NULL));
+
+  sink = create_collector ("rtp_sink_0");
+  gst_element_add_pad (conn->encoder, sink);
+  conn->media = create_src ("media", sink, "application/x-rtp");
+
+  conn->rtx_sink = create_collector ("rtp_sink_1");
+  gst_element_add_pad (conn->encoder, conn->rtx_sink);
+
+  conn->rtcp_sink = create_collector ("rtcp_sink");
+  conn->rtcp_src = create_src ("rtcp_src", conn->rtcp_sink,
+      "application/x-rtcp");
+
+  kms_webrtc_rtx_cache_watch_pads (conn->cache, conn->rtx_sink,
+      conn->rtcp_src);
+}
+
+static void
+connection_clear (Connection * conn)
+{
+  kms_webrtc_rtx_cache_free (conn->cache);
+  g_object_unref (conn->media);
+  g_object_unref (conn->rtcp_src);
+  g_object_unref (conn->rtcp_sink);
+  gst_object_unref (conn->encoder);
+}
+
+static GstBuffer *
+create_rtp (guint16 seq)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+static gsize
+get_packet_size (void)
+{
+  GstBuffer *buffer = create_rtp (0);
+  gsize size = gst_buffer_get_size (buffer);
+
+  gst_buffer_unref (buffer);
+
+  return size;
+}
+
+static void
+send_rtp (Connection * conn, guint16 first, guint16 last)
+{
+  guint16 seq;
+
+  for (seq = first; seq != (guint16) (last + 1); seq++) {
+    fail_unless (gst_pad_push (conn->media, create_rtp (seq)) == GST_FLOW_OK);
+  }
+}
+
+/* Generic NACK for @pid and the following packets set in @blp. Returns the
+ * sequence numbers retransmitted because of it */
+static GArray *
+send_nack (Connection * conn, guint32 media_ssrc, guint16 pid, guint16 blp)
+{
+  GPtrArray *received = get_received (conn->rtx_sink);
+  GArray *resent = g_array_new (FALSE, FALSE, sizeof (guint16));
+  guint8 *data = g_malloc0 (16);
+  guint before = received->len, i;
+
+  data[0] = 0x80 | 1;
+  data[1] = GST_RTCP_TYPE_RTPFB;
+  GST_WRITE_UINT16_BE (data + 2, 3);
+  GST_WRITE_UINT32_BE (data + 4, 1);
+  GST_WRITE_UINT32_BE (data + 8, media_ssrc);
+  GST_WRITE_UINT16_BE (data + 12, pid);
+  GST_WRITE_UINT16_BE (data + 14, blp);
+
+  fail_unless (gst_pad_push (conn->rtcp_src, gst_buffer_new_wrapped (data,
+              16)) == GST_FLOW_OK);
+
+  for (i = before; i < received->len; i++) {
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    guint16 seq;
+
+    fail_unless (gst_rtp_buffer_map (g_ptr_array_index (received, i),
+            GST_MAP_READ, &rtp));
+    seq = gst_rtp_buffer_get_seq (&rtp);
+    g_array_append_val (resent, seq);
+    gst_rtp_buffer_unmap (&rtp);
+  }
+
+  return resent;
+}
+
+static void
+check_nack (Connection * conn, guint16 pid, guint16 blp, guint n, ...)
+{
+  GArray *resent = send_nack (conn, SSRC, pid, blp);
+  va_list args;
+  guint i;
+
+  fail_unless_equals_int (resent->len, n);
+  va_start (args, n);
+
+  for (i = 0; i < n; i++) {
+    fail_unless_equals_int (g_array_index (resent, guint16, i),
+        va_arg (args, guint));
+  }
+
+  va_end (args);
+  g_array_unref (resent);
+}
+
+static guint64
+get_stat (Connection * conn, const gchar * name)
+{
+  GstStructure *stats = gst_structure_new_empty ("stats");
+  GstStructure *cache_stats = NULL;
+  guint64 value = 0;
+  guint packets;
+
+  kms_webrtc_rtx_cache_add_stats (conn->cache, stats);
+  fail_unless (gst_structure_get (stats, KMS_WEBRTC_RTX_CACHE_STATS_FIELD,
+          GST_TYPE_STRUCTURE, &cache_stats, NULL));
+
+  if (g_strcmp0 (name, "packets") == 0) {
+    fail_unless (gst_structure_get_uint (cache_stats, name, &packets));
+    value = packets;
+  } else {
+    fail_unless (gst_structure_get_uint64 (cache_stats, name, &value));
+  }
+
+  gst_structure_free (cache_stats);
+  gst_structure_free (stats);
+
+  return value;
+}
+
+GST_START_TEST (hits_and_misses)
+{
+  Connection conn;
+  GArray *resent;
+
+  connection_init (&conn);
+  send_rtp (&conn, 100, 109);
+  fail_unless_equals_int (get_stat (&conn, "packets"), 10);
+
+  /* 100, and 102 and 105 from the bitmask */
+  check_nack (&conn, 100, 0x0002 | 0x0010, 3, 100, 102, 105);
+  fail_unless_equals_int (get_stat (&conn, "hits"), 3);
+
+  /* Never sent */
+  check_nack (&conn, 110, 0, 0);
+  fail_unless_equals_int (get_stat (&conn, "misses"), 1);
+
+  /* Just resent, its retransmission might still arrive */
+  check_nack (&conn, 100, 0, 0);
+  fail_unless_equals_int (get_stat (&conn, "hits"), 4);
+
+  /* Not ours */
+  resent = send_nack (&conn, SSRC + 1, 101, 0);
+  fail_unless_equals_int (resent->len, 0);
+  g_array_unref (resent);
+
+  /* Retransmissions are not cached again */
+  fail_unless_equals_int (get_stat (&conn, "packets"), 10);
+  fail_unless_equals_int (get_stat (&conn, "misses"), 1);
+  fail_unless_equals_int (get_stat (&conn, "too-old"), 0);
+
+  connection_clear (&conn);
+}
+
+GST_END_TEST
+
+GST_START_TEST (time_eviction)
+{
+  Connection conn;
+
+  connection_init (&conn);
+  kms_webrtc_rtx_cache_set_time (conn.cache, 50);
+
+  send_rtp (&conn, 65530, 4);
+  g_usleep (80 * G_TIME_SPAN_MILLISECOND);
+
+  /* Storing a packet drops the ones kept for too long */
+  send_rtp (&conn, 5, 5);
+  fail_unless_equals_int (get_stat (&conn, "packets"), 1);
+
+  check_nack (&conn, 65533, 0x0040, 0);
+  fail_unless_equals_int (get_stat (&conn, "too-old"), 2);
+  check_nack (&conn, 5, 0, 1, 5);
+  fail_unless_equals_int (get_stat (&conn, "misses"), 0);
+
+  /* Nothing is kept when disabled */
+  kms_webrtc_rtx_cache_set_time (conn.cache, 0);
+  send_rtp (&conn, 6, 6);
+  fail_unless_equals_int (get_stat (&conn, "packets"), 0);
+  fail_unless_equals_int (get_stat (&conn, "bytes"), 0);
+
+  connection_clear (&conn);
+}
+
+GST_END_TEST
+
+GST_START_TEST (endpoint_size)
+{
+  gsize size = get_packet_size ();
+  Connection conn;
+
+  connection_init (&conn);
+  kms_webrtc_rtx_cache_set_size (conn.cache, 3 * size);
+
+  send_rtp (&conn, 1, 5);
+  fail_unless_equals_int (get_stat (&conn, "packets"), 3);
+  fail_unless_equals_int (get_stat (&conn, "bytes"), 3 * size);
+
+  /* Dropped for the size, the oldest first, they are not too old */
+  check_nack (&conn, 1, 0x0001, 0);
+  fail_unless_equals_int (get_stat (&conn, "misses"), 2);
+  fail_unless_equals_int (get_stat (&conn, "too-old"), 0);
+  check_nack (&conn, 3, 0x0003, 3, 3, 4, 5);
+
+  /* Shrinking drops the oldest ones at once */
+  kms_webrtc_rtx_cache_set_size (conn.cache, size);
+  fail_unless_equals_int (get_stat (&conn, "packets"), 1);
+  fail_unless_equals_int (get_stat (&conn, "bytes"), size);
+
+  connection_clear (&conn);
+}
+
+GST_END_TEST
+
+GST_START_TEST (process_size)
+{
+  gsize size = get_packet_size ();
+  Connection first, second;
+
+  kms_webrtc_rtx_cache_set_process_size (4 * size);
+  connection_init (&first);
+  connection_init (&second);
+
+  send_rtp (&first, 1, 3);
+  fail_unless_equals_int (get_stat (&first, "packets"), 3);
+
+  /* Only the room left, and a cache only drops its own packets */
+  send_rtp (&second, 1, 3);
+  fail_unless_equals_int (get_stat (&second, "packets"), 1);
+  fail_unless_equals_int (get_stat (&first, "packets"), 3);
+  check_nack (&second, 1, 0x0003, 1, 3);
+
+  /* Freed caches give their room back */
+  connection_clear (&first);
+  send_rtp (&second, 4, 6);
+  fail_unless_equals_int (get_stat (&second, "packets"), 4);
+  fail_unless_equals_int (get_stat (&second, "bytes"), 4 * size);
+
+  /* Nothing fits */
+  kms_webrtc_rtx_cache_set_process_size (size - 1);
+  send_rtp (&second, 7, 7);
+  fail_unless_equals_int (get_stat (&second, "packets"), 0);
+
+  connection_clear (&second);
+  kms_webrtc_rtx_cache_set_process_size
+      (KMS_WEBRTC_RTX_CACHE_DEFAULT_PROCESS_SIZE);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+webrtcrtxcache_suite (void)
+{
+  Suite *s = suite_create ("webrtcrtxcache");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, hits_and_misses);
+  tcase_add_test (tc_chain, time_eviction);
+  tcase_add_test (tc_chain, endpoint_size);
+  tcase_add_test (tc_chain, process_size);
+
+  return s;
+}
+
+GST_CHECK_MAIN (webrtcrtxcache);
@@ -0,0 +1,376 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+#include <gst/sdp/gstsdpmessage.h>
+
+#include <webrtcendpoint/kmswebrtcsimulcast.h>
+
+#define VP8_PT 96
+#define RTX_PT 97
+#define PAYLOAD_SIZE 100
+#define RECEIVED_DATA "received"
+
+typedef enum
+{
+  FRAME_KEY,
+  FRAME_DELTA
+} FrameType;
+
+static GstFlowReturn
+collect_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GPtrArray *received = g_object_get_data (G_OBJECT (pad), RECEIVED_DATA);
+
+  g_ptr_array_add (received, buffer);
+
+  return GST_FLOW_OK;
+}
+
+/* Sink pad keeping whatever it gets */
+static GstPad *
+create_collector (const gchar * name)
+{
+  GstPad *sink = gst_pad_new (name, GST_PAD_SINK);
+
+  g_object_set_data_full (G_OBJECT (sink), RECEIVED_DATA,
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref),
+      (GDestroyNotify) g_ptr_array_unref);
+  gst_pad_set_chain_function (sink, collect_chain);
+  gst_pad_set_active (sink, TRUE);
+
+  return sink;
+}
+
+static GPtrArray *
+get_received (GstPad * sink)
+{
+  return g_object_get_data (G_OBJECT (sink), RECEIVED_DATA);
+}
+
+/* Stands for the rtp_src pad of a connection */
+static GstPad *
+create_rtp_src (GstPad * sink)
+{
+  GstPad *src = gst_pad_new ("rtp_src", GST_PAD_SRC);
+  GstSegment segment;
+  GstCaps *caps;
+
+  fail_unless (gst_pad_link (src, sink) == GST_PAD_LINK_OK);
+  gst_pad_set_active (src, TRUE);
+
+  gst_pad_push_event (src, gst_event_new_stream_start ("simulcast-test"));
+  caps = gst_caps_new_empty_simple ("application/x-rtp");
+  gst_pad_push_event (src, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (src, gst_event_new_segment (&segment));
+
+  return src;
+}
+
+static GstSDPMedia *
+create_video_media (void)
+{
+  GstSDPMedia *media;
+
+  gst_sdp_media_new (&media);
+  gst_sdp_media_set_media (media, "video");
+  gst_sdp_media_set_port_info (media, 9, 1);
+  gst_sdp_media_set_proto (media, "UDP/TLS/RTP/SAVPF");
+  gst_sdp_media_add_format (media, "96");
+  gst_sdp_media_add_format (media, "97");
+  gst_sdp_media_add_attribute (media, "mid", "video0");
+  gst_sdp_media_add_attribute (media, "rtpmap", "96 VP8/90000");
+  gst_sdp_media_add_attribute (media, "rtpmap", "97 rtx/90000");
+  gst_sdp_media_add_attribute (media, "fmtp", "97 apt=96");
+
+  return media;
+}
+
+static GstBuffer *
+create_rtp (guint32 ssrc, guint8 pt, guint16 seq, guint32 ts,
+    const gchar * rid, guint8 rid_ext_id)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_ssrc (&rtp, ssrc);
+  gst_rtp_buffer_set_payload_type (&rtp, pt);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_timestamp (&rtp, ts);
+  memset (gst_rtp_buffer_get_payload (&rtp), 0, PAYLOAD_SIZE);
+
+  if (rid != NULL) {
+    fail_unless (gst_rtp_buffer_add_extension_onebyte_header (&rtp,
+            rid_ext_id, rid, strlen (rid)));
+  }
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+static GstBuffer *
+create_vp8 (guint32 ssrc, guint16 seq, guint32 ts, FrameType type,
+    const gchar * rid)
+{
+  GstBuffer *buffer = create_rtp (ssrc, VP8_PT, seq, ts, rid,
+      KMS_WEBRTC_SIMULCAST_RID_EXT_ID);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 *payload;
+
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  payload = gst_rtp_buffer_get_payload (&rtp);
+
+  /* Start of the first partition, then the P bit of the frame header */
+  payload[0] = 0x10;
+  payload[1] = type == FRAME_KEY ? 0x00 : 0x01;
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+/* Retransmission of @osn, as in RFC 4588 */
+static GstBuffer *
+create_rtx (guint32 ssrc, guint16 seq, guint32 ts, guint16 osn,
+    const gchar * rid)
+{
+  GstBuffer *buffer = create_rtp (ssrc, RTX_PT, seq, ts, rid,
+      KMS_WEBRTC_SIMULCAST_RRID_EXT_ID);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  GST_WRITE_UINT16_BE (gst_rtp_buffer_get_payload (&rtp), osn);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+/* Pushes @buffer and returns what went through, NULL if it was dropped */
+static GstBuffer *
+push (GstPad * src, GstPad * sink, GstBuffer * buffer)
+{
+  GPtrArray *received = get_received (sink);
+  guint before = received->len;
+
+  fail_unless (gst_pad_push (src, buffer) == GST_FLOW_OK);
+
+  if (received->len == before) {
+    return NULL;
+  }
+
+  fail_unless_equals_int (received->len, before + 1);
+
+  return g_ptr_array_index (received, before);
+}
+
+static void
+check_rtp (GstBuffer * buffer, guint32 ssrc, guint16 seq)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  fail_unless (buffer != NULL);
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless_equals_int (gst_rtp_buffer_get_ssrc (&rtp), ssrc);
+  fail_unless_equals_int (gst_rtp_buffer_get_seq (&rtp), seq);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static void
+check_rtx (GstBuffer * buffer, guint32 ssrc, guint16 osn)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  fail_unless (buffer != NULL);
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless_equals_int (gst_rtp_buffer_get_ssrc (&rtp), ssrc);
+  fail_unless_equals_int (GST_READ_UINT16_BE (gst_rtp_buffer_get_payload
+          (&rtp)), osn);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+/* Media SSRC of the last PLI received by @sink */
+static guint32
+get_last_pli (GstPad * sink)
+{
+  GPtrArray *received = get_received (sink);
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  guint32 media = 0;
+
+  if (received->len == 0) {
+    return 0;
+  }
+
+  gst_rtcp_buffer_map (g_ptr_array_index (received, received->len - 1),
+      GST_MAP_READ, &rtcp);
+
+  if (gst_rtcp_buffer_get_first_packet (&rtcp, &packet)) {
+    do {
+      if (gst_rtcp_packet_get_type (&packet) == GST_RTCP_TYPE_PSFB &&
+          gst_rtcp_packet_fb_get_type (&packet) == GST_RTCP_PSFB_TYPE_PLI) {
+        media = gst_rtcp_packet_fb_get_media_ssrc (&packet);
+      }
+    } while (gst_rtcp_packet_move_to_next (&packet));
+  }
+
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  return media;
+}
+
+GST_START_TEST (ssrc_group_switch)
+{
+  KmsWebrtcSimulcast *simulcast = kms_webrtc_simulcast_new (NULL);
+  GstPad *sink = create_collector ("sink");
+  GstPad *feedback = create_collector ("rtcp_sink");
+  GstPad *src = create_rtp_src (sink);
+  GstSDPMedia *media = create_video_media ();
+
+  /* Layers 1 and 2, repaired by 11 and 12 */
+  gst_sdp_media_add_attribute (media, "ssrc-group", "SIM 1 2");
+  gst_sdp_media_add_attribute (media, "ssrc-group", "FID 1 11");
+  gst_sdp_media_add_attribute (media, "ssrc-group", "FID 2 12");
+
+  kms_webrtc_simulcast_set_layer (simulcast, 0);
+  kms_webrtc_simulcast_watch_media (simulcast, media, src, NULL, feedback);
+
+  /* The first layer is forwarded as it is */
+  check_rtp (push (src, sink, create_vp8 (1, 100, 3000, FRAME_KEY, NULL)), 1,
+      100);
+  fail_if (push (src, sink, create_vp8 (2, 5000, 3000, FRAME_KEY, NULL)));
+  check_rtp (push (src, sink, create_vp8 (1, 101, 6000, FRAME_DELTA, NULL)),
+      1, 101);
+
+  /* Only retransmissions of the forwarded layer go through */
+  fail_if (push (src, sink, create_rtx (12, 1, 3000, 5000, NULL)));
+  check_rtx (push (src, sink, create_rtx (11, 1, 3000, 100, NULL)), 11, 100);
+
+  fail_unless_equals_int (kms_webrtc_simulcast_get_layers (simulcast), 2);
+
+  /* The switch waits for a keyframe of the new layer, and asks for it */
+  kms_webrtc_simulcast_set_layer (simulcast, 1);
+  fail_if (push (src, sink, create_vp8 (2, 5001, 6000, FRAME_DELTA, NULL)));
+  fail_unless_equals_int (get_last_pli (feedback), 2);
+  check_rtp (push (src, sink, create_vp8 (1, 102, 9000, FRAME_DELTA, NULL)),
+      1, 102);
+
+  /* Same SSRC, and sequence numbers go on */
+  check_rtp (push (src, sink, create_vp8 (2, 5002, 9000, FRAME_KEY, NULL)), 1,
+      103);
+  check_rtp (push (src, sink, create_vp8 (2, 5003, 12000, FRAME_DELTA,
+              NULL)), 1, 104);
+  fail_if (push (src, sink, create_vp8 (1, 103, 12000, FRAME_DELTA, NULL)));
+
+  /* Retransmissions follow: SSRC and original sequence number translated */
+  check_rtx (push (src, sink, create_rtx (12, 2, 9000, 5002, NULL)), 11, 103);
+  fail_if (push (src, sink, create_rtx (11, 2, 9000, 102, NULL)));
+
+  gst_sdp_media_free (media);
+  kms_webrtc_simulcast_free (simulcast);
+  g_object_unref (src);
+  g_object_unref (sink);
+  g_object_unref (feedback);
+}
+
+GST_END_TEST
+
+GST_START_TEST (rid_streams)
+{
+  KmsWebrtcSimulcast *simulcast = kms_webrtc_simulcast_new (NULL);
+  GstPad *sink = create_collector ("sink");
+  GstPad *src = create_rtp_src (sink);
+  GstSDPMedia *media = create_video_media ();
+  gchar *extmap;
+
+  extmap = g_strdup_printf ("%u %s", KMS_WEBRTC_SIMULCAST_RID_EXT_ID,
+      KMS_WEBRTC_SIMULCAST_RID_EXT_URI);
+  gst_sdp_media_add_attribute (media, "extmap", extmap);
+  g_free (extmap);
+  extmap = g_strdup_printf ("%u %s", KMS_WEBRTC_SIMULCAST_RRID_EXT_ID,
+      KMS_WEBRTC_SIMULCAST_RRID_EXT_URI);
+  gst_sdp_media_add_attribute (media, "extmap", extmap);
+  g_free (extmap);
+  gst_sdp_media_add_attribute (media, "rid", "lo send");
+  gst_sdp_media_add_attribute (media, "rid", "hi send");
+  gst_sdp_media_add_attribute (media, "simulcast", "send lo;hi");
+
+  /* What the rest of the endpoint expects */
+  gst_sdp_media_add_attribute (media, "ssrc", "1000 cname:test");
+  gst_sdp_media_add_attribute (media, "ssrc-group", "FID 1000 2000");
+
+  kms_webrtc_simulcast_set_layer (simulcast, 0);
+  kms_webrtc_simulcast_watch_media (simulcast, media, src, NULL, NULL);
+
+  /* Not part of the simulcast stream */
+  check_rtp (push (src, sink, create_vp8 (999, 7, 3000, FRAME_DELTA, NULL)),
+      999, 7);
+
+  /* SSRCs are learned from the RIDs */
+  check_rtp (push (src, sink, create_vp8 (500, 10, 3000, FRAME_KEY, "lo")),
+      1000, 10);
+  fail_if (push (src, sink, create_vp8 (600, 20, 3000, FRAME_KEY, "hi")));
+  check_rtp (push (src, sink, create_vp8 (500, 11, 6000, FRAME_DELTA, NULL)),
+      1000, 11);
+  fail_unless_equals_int (kms_webrtc_simulcast_get_layers (simulcast), 2);
+
+  /* And the retransmission SSRCs from the repaired RIDs */
+  check_rtx (push (src, sink, create_rtx (501, 1, 3000, 10, "lo")), 2000, 10);
+  fail_if (push (src, sink, create_rtx (601, 1, 3000, 20, "hi")));
+  check_rtx (push (src, sink, create_rtx (501, 2, 6000, 11, NULL)), 2000, 11);
+
+  /* Values above the highest layer select it */
+  kms_webrtc_simulcast_set_layer (simulcast, 5);
+  check_rtp (push (src, sink, create_vp8 (600, 21, 9000, FRAME_KEY, NULL)),
+      1000, 12);
+  check_rtx (push (src, sink, create_rtx (601, 2, 9000, 21, NULL)), 2000, 12);
+  fail_if (push (src, sink, create_rtx (501, 3, 9000, 11, NULL)));
+
+  gst_sdp_media_free (media);
+  kms_webrtc_simulcast_free (simulcast);
+  g_object_unref (src);
+  g_object_unref (sink);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+webrtcsimulcast_suite (void)
+{
+  Suite *s = suite_create ("webrtcsimulcast");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, ssrc_group_switch);
+  tcase_add_test (tc_chain, rid_streams);
+
+  return s;
+}
+
+GST_CHECK_MAIN (webrtcsimulcast);
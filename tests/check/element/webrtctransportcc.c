@@ -0,0 +1,343 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#include <webrtcendpoint/kmswebrtctransportcc.h>
+
+#define SSRC 0x1234abcd
+#define START (10 * G_USEC_PER_SEC)
+#define MS G_TIME_SPAN_MILLISECOND
+#define PAYLOAD_SIZE 60
+#define FEEDBACK_HEADER_SIZE (8 + 20)
+
+static KmsWebrtcTransportCc *
+create_transport_cc (void)
+{
+  KmsWebrtcTransportCc *cc = kms_webrtc_transport_cc_new ();
+
+  kms_webrtc_transport_cc_set_ext_id (cc, KMS_WEBRTC_TRANSPORT_CC_EXT_ID);
+
+  return cc;
+}
+
+/* A packet stamped by @sender at @send_time */
+static GstBuffer *
+create_rtp (KmsWebrtcTransportCc * sender, gint64 send_time)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  gst_rtp_buffer_unmap (&rtp);
+
+  kms_webrtc_transport_cc_stamp (sender, &buffer, send_time);
+
+  return buffer;
+}
+
+/* Sends a packet that arrives @delay after @send_time. The feedback it
+ * triggers, if any, is read by @sender when it arrives. Returns the RTCP
+ * the sender hands to the rest of the endpoint then */
+static GstBuffer *
+transmit (KmsWebrtcTransportCc * sender, KmsWebrtcTransportCc * receiver,
+    gint64 send_time, gint64 delay)
+{
+  GstBuffer *packet, *feedback;
+
+  packet = create_rtp (sender, send_time);
+  feedback = kms_webrtc_transport_cc_receive (receiver, packet,
+      send_time + delay);
+  gst_buffer_unref (packet);
+
+  if (feedback == NULL) {
+    return NULL;
+  }
+
+  return kms_webrtc_transport_cc_process_rtcp (sender, feedback,
+      send_time + delay);
+}
+
+static GstStructure *
+get_stats (KmsWebrtcTransportCc * cc)
+{
+  GstStructure *stats = gst_structure_new_empty ("stats");
+  GstStructure *cc_stats = NULL;
+
+  kms_webrtc_transport_cc_add_stats (cc, stats, "transport-cc");
+  fail_unless (gst_structure_get (stats, "transport-cc", GST_TYPE_STRUCTURE,
+          &cc_stats, NULL));
+  gst_structure_free (stats);
+
+  return cc_stats;
+}
+
+static guint64
+get_uint64_stat (KmsWebrtcTransportCc * cc, const gchar * name)
+{
+  GstStructure *stats = get_stats (cc);
+  guint64 value = 0;
+
+  fail_unless (gst_structure_get_uint64 (stats, name, &value));
+  gst_structure_free (stats);
+
+  return value;
+}
+
+/* Bitrate of the REMB in @rtcp, 0 if there is none */
+static guint
+get_remb (GstBuffer * rtcp)
+{
+  GstMapInfo info;
+  guint offset, bitrate = 0;
+
+  gst_buffer_map (rtcp, &info, GST_MAP_READ);
+
+  for (offset = 0; offset + 4 <= info.size;) {
+    const guint8 *packet = info.data + offset;
+    guint len = (GST_READ_UINT16_BE (packet + 2) + 1) * 4;
+
+    if (offset + len > info.size) {
+      break;
+    }
+
+    if (packet[1] == GST_RTCP_TYPE_PSFB && (packet[0] & 0x1f) == 15 &&
+        len >= 20 && memcmp (packet + 12, "REMB", 4) == 0) {
+      guint32 mantissa = ((packet[17] & 0x03) << 16) |
+          GST_READ_UINT16_BE (packet + 18);
+
+      bitrate = mantissa << (packet[17] >> 2);
+    }
+
+    offset += len;
+  }
+
+  gst_buffer_unmap (rtcp, &info);
+
+  return bitrate;
+}
+
+/* Arrival times of each packet, -1 for the lost ones */
+static const gint64 arrivals[] = {
+  /* One byte deltas */
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+  /* A run of losses */
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  /* Two bytes deltas, one of them negative */
+  90, 89,
+  91, 92, 93, 94, 95, 96, 97, 100
+};
+
+#define ROUND_TRIP_PACKETS G_N_ELEMENTS (arrivals)
+
+GST_START_TEST (feedback_round_trip)
+{
+  KmsWebrtcTransportCc *sender = create_transport_cc ();
+  KmsWebrtcTransportCc *receiver = create_transport_cc ();
+  GstBuffer *packets[ROUND_TRIP_PACKETS], *feedback = NULL;
+  GstMapInfo info;
+  guint i, order[ROUND_TRIP_PACKETS], n = 0;
+
+  for (i = 0; i < ROUND_TRIP_PACKETS; i++) {
+    packets[i] = create_rtp (sender, START + i * MS);
+  }
+
+  /* In order of arrival, 31 before 30 */
+  for (i = 0; i < ROUND_TRIP_PACKETS; i++) {
+    if (arrivals[i] >= 0 && i != 30) {
+      order[n++] = i;
+    }
+    if (i == 31) {
+      order[n++] = 30;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    GstBuffer *buffer;
+
+    buffer = kms_webrtc_transport_cc_receive (receiver, packets[order[i]],
+        START + arrivals[order[i]] * MS);
+
+    /* Due 100 ms after the first arrival */
+    if (buffer != NULL) {
+      fail_unless (order[i] == ROUND_TRIP_PACKETS - 1);
+      feedback = buffer;
+    }
+  }
+
+  fail_unless (feedback != NULL);
+
+  /* One bit symbols, a run of losses, two bits symbols and one bit again */
+  gst_buffer_map (feedback, &info, GST_MAP_READ);
+  fail_unless ((GST_READ_UINT16_BE (info.data + FEEDBACK_HEADER_SIZE) >> 14)
+      == 2);
+  fail_unless (GST_READ_UINT16_BE (info.data + FEEDBACK_HEADER_SIZE + 2) ==
+      16);
+  fail_unless ((GST_READ_UINT16_BE (info.data + FEEDBACK_HEADER_SIZE + 4) >>
+          14) == 3);
+  fail_unless ((GST_READ_UINT16_BE (info.data + FEEDBACK_HEADER_SIZE + 6) >>
+          14) == 2);
+  gst_buffer_unmap (feedback, &info);
+
+  feedback = kms_webrtc_transport_cc_process_rtcp (sender, feedback,
+      START + 100 * MS);
+
+  fail_unless (get_uint64_stat (sender, "feedback-packets") == 1);
+  fail_unless (get_uint64_stat (sender, "packets-sent") ==
+      ROUND_TRIP_PACKETS);
+  fail_unless (get_uint64_stat (sender, "packets-acked") == 20);
+  fail_unless (get_uint64_stat (sender, "packets-lost") == 20);
+  fail_unless (kms_webrtc_transport_cc_get_estimate (sender) > 0);
+  fail_unless (get_remb (feedback) ==
+      kms_webrtc_transport_cc_get_estimate (sender));
+
+  gst_buffer_unref (feedback);
+
+  for (i = 0; i < ROUND_TRIP_PACKETS; i++) {
+    gst_buffer_unref (packets[i]);
+  }
+
+  kms_webrtc_transport_cc_unref (sender);
+  kms_webrtc_transport_cc_unref (receiver);
+}
+
+GST_END_TEST
+
+/* The arrival times decoded give back the rate they were received at */
+GST_START_TEST (feedback_arrival_times)
+{
+  KmsWebrtcTransportCc *sender = create_transport_cc ();
+  KmsWebrtcTransportCc *receiver = create_transport_cc ();
+  GstStructure *stats;
+  GstBuffer *packet;
+  guint acked, size, i;
+
+  /* Size of the packets once stamped */
+  packet = create_rtp (receiver, 0);
+  size = gst_buffer_get_size (packet);
+  gst_buffer_unref (packet);
+
+  /* Every 10 ms, over several feedbacks. Acked rate is measured on 500 ms */
+  for (i = 0; i <= 50; i++) {
+    GstBuffer *rtcp = transmit (sender, receiver, START + i * 10 * MS,
+        20 * MS);
+
+    if (rtcp != NULL) {
+      gst_buffer_unref (rtcp);
+    }
+  }
+
+  stats = get_stats (sender);
+  fail_unless (gst_structure_get_uint (stats, "acked-bitrate", &acked));
+  gst_structure_free (stats);
+
+  GST_INFO ("Acked %u bps, packets of %u bytes", acked, size);
+  fail_unless (acked == (guint64) 51 * size * 8 * G_USEC_PER_SEC / (500 * MS));
+  fail_unless (get_uint64_stat (sender, "packets-lost") == 0);
+
+  kms_webrtc_transport_cc_unref (sender);
+  kms_webrtc_transport_cc_unref (receiver);
+}
+
+GST_END_TEST
+
+/* Queues building up along the path lower the estimate */
+GST_START_TEST (estimate_drops_on_delay_growth)
+{
+  KmsWebrtcTransportCc *sender = create_transport_cc ();
+  KmsWebrtcTransportCc *receiver = create_transport_cc ();
+  guint stable, congested, remb = 0, i;
+  gboolean overusing;
+  GstStructure *stats;
+  gint64 now = START;
+
+  /* Constant delay */
+  for (i = 0; i < 300; i++, now += 10 * MS) {
+    GstBuffer *rtcp = transmit (sender, receiver, now, 20 * MS);
+
+    if (rtcp != NULL) {
+      gst_buffer_unref (rtcp);
+    }
+  }
+
+  stable = kms_webrtc_transport_cc_get_estimate (sender);
+  stats = get_stats (sender);
+  fail_unless (gst_structure_get_boolean (stats, "overusing", &overusing));
+  fail_if (overusing);
+  gst_structure_free (stats);
+
+  /* Each packet waits 2 ms more than the previous one */
+  for (i = 0; i < 100; i++, now += 10 * MS) {
+    GstBuffer *rtcp = transmit (sender, receiver, now, (20 + 2 * i) * MS);
+
+    if (rtcp != NULL) {
+      guint bitrate = get_remb (rtcp);
+
+      if (bitrate != 0) {
+        remb = bitrate;
+      }
+
+      gst_buffer_unref (rtcp);
+    }
+  }
+
+  congested = kms_webrtc_transport_cc_get_estimate (sender);
+  stats = get_stats (sender);
+  fail_unless (gst_structure_get_boolean (stats, "overusing", &overusing));
+  fail_unless (overusing);
+  gst_structure_free (stats);
+
+  GST_INFO ("Estimate %u bps with a stable delay, %u bps with a growing one",
+      stable, congested);
+  fail_unless (stable > 0);
+  fail_unless (congested < stable);
+  fail_unless (remb > 0 && remb < stable);
+
+  kms_webrtc_transport_cc_unref (sender);
+  kms_webrtc_transport_cc_unref (receiver);
+}
+
+GST_END_TEST
+
+/*
+ * End of test cases
+ */
+static Suite *
+webrtctransportcc_suite (void)
+{
+  Suite *s = suite_create ("webrtctransportcc");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, feedback_round_trip);
+  tcase_add_test (tc_chain, feedback_arrival_times);
+  tcase_add_test (tc_chain, estimate_drops_on_delay_growth);
+
+  return s;
+}
+
+GST_CHECK_MAIN (webrtctransportcc);
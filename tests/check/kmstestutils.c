@@ -16,6 +16,9 @@
  */
 #include "kmstestutils.h"
 
+#include <stdio.h>
+#include <unistd.h>
+
 #define GST_CAT_DEFAULT kms_utils
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "kms_utils"
@@ -149,6 +152,27 @@ kms_element_link_pads (GstElement * src, const gchar * src_pad_name,
   }
 }
 
+glong
+kms_test_get_resident_memory (void)
+{
+  glong size, resident = 0;
+  FILE *f;
+
+  f = fopen ("/proc/self/statm", "r");
+
+  if (f == NULL) {
+    return 0;
+  }
+
+  if (fscanf (f, "%ld %ld", &size, &resident) != 2) {
+    resident = 0;
+  }
+
+  fclose (f);
+
+  return resident * sysconf (_SC_PAGESIZE);
+}
+
 static void init_debug (void) __attribute__ ((constructor));
 
 static void
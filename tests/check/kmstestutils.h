@@ -22,4 +22,7 @@
 void kms_element_link_pads (GstElement * src, const gchar * src_pad_name,
     GstElement * sink, const gchar * sink_pad_name);
 
+/* Resident memory of the process in bytes, 0 if it can not be read */
+glong kms_test_get_resident_memory (void);
+
 #endif /* __KMS_TEST_UTILS_H__ */
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <gst/gst.h>
+#include <CertificateManager.hpp>
+#include <CertificateService.hpp>
+
+#include <fstream>
+#include <sstream>
+
+using namespace kurento;
+using namespace boost::unit_test;
+
+static std::string
+readFile (const boost::filesystem::path &path)
+{
+  std::ifstream inFile (path.string () );
+  std::stringstream strStream;
+
+  strStream << inFile.rdbuf ();
+
+  return strStream.str ();
+}
+
+static void
+cached_certificate_is_reused ()
+{
+  boost::filesystem::path cacheDir = boost::filesystem::temp_directory_path ()
+                                     / boost::filesystem::unique_path ();
+  std::string cached = CertificateManager::generateRSACertificate ();
+  std::string ecdsa;
+
+  boost::filesystem::create_directories (cacheDir);
+  std::ofstream ( (cacheDir / "dtls-rsa.pem").string () ) << cached;
+
+  /* The service must not generate anything before knowing the cache */
+  CertificateService::getInstance ().configure (cacheDir.string (),
+      std::chrono::seconds (0), 0);
+
+  BOOST_CHECK_EQUAL (CertificateService::getInstance ().getCertificate (
+                       CertificateService::KeyType::RSA), cached);
+
+  /* No cached ECDSA certificate, a new one is generated and cached */
+  ecdsa = CertificateService::getInstance ().getCertificate (
+            CertificateService::KeyType::ECDSA);
+  BOOST_CHECK (CertificateManager::isCertificateValid (ecdsa) );
+
+  CertificateService::getInstance ().stop ();
+
+  BOOST_CHECK_EQUAL (readFile (cacheDir / "dtls-ecdsa.pem"), ecdsa);
+  BOOST_CHECK_EQUAL (readFile (cacheDir / "dtls-rsa.pem"), cached);
+
+  boost::filesystem::remove_all (cacheDir);
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "CertificateService" );
+
+  gst_init (nullptr, nullptr);
+
+  test->add (BOOST_TEST_CASE ( &cached_certificate_is_reused ), 0,
+             /* timeout */ 60);
+
+  return test;
+}
@@ -22,6 +22,8 @@
 #include <KurentoException.hpp>
 #include <jsonrpc/JsonSerializer.hpp>
 #include <MediaSet.hpp>
+#include <StatsPollerImpl.hpp>
+#include <ElementCounters.hpp>
 #include <gst/gst.h>
 #include <config.h>
 
@@ -41,6 +43,20 @@ testHttpPostEndPoint (kurento::ModuleManager &moduleManager,
   kurento::MediaSet::getMediaSet()->release (object);
 }
 
+void
+testHttpGetEndPoint (kurento::ModuleManager &moduleManager,
+                     std::shared_ptr <kurento::MediaObjectImpl> mediaPipeline)
+{
+  kurento::JsonSerializer w (true);
+
+  w.SerializeNVP (mediaPipeline);
+
+  std::shared_ptr <kurento::MediaObjectImpl >  object =
+    moduleManager.getFactory ("HttpGetEndpoint")->createObject (config, "",
+        w.JsonValue);
+  kurento::MediaSet::getMediaSet()->release (object);
+}
+
 void
 testPlayerEndPoint (kurento::ModuleManager &moduleManager,
                     std::shared_ptr <kurento::MediaObjectImpl> mediaPipeline)
@@ -154,6 +170,21 @@ testComposite (kurento::ModuleManager &moduleManager,
   kurento::MediaSet::getMediaSet()->release (object);
 }
 
+void
+testStatsPoller (kurento::ModuleManager &moduleManager,
+                 std::shared_ptr <kurento::MediaObjectImpl> mediaPipeline)
+{
+  kurento::JsonSerializer w (true);
+
+  w.SerializeNVP (mediaPipeline);
+
+  std::shared_ptr <kurento::MediaObjectImpl >  object =
+    moduleManager.getFactory ("StatsPoller")->createObject (config, "",
+        w.JsonValue);
+  std::dynamic_pointer_cast <kurento::StatsPollerImpl> (object)->poll ();
+  kurento::MediaSet::getMediaSet()->release (object);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -177,6 +208,7 @@ main (int argc, char **argv)
   config.add ("modules.kurento.SdpEndpoint.videoCodecs", "[]");
 
   testHttpPostEndPoint (moduleManager, mediaPipeline);
+  testHttpGetEndPoint (moduleManager, mediaPipeline);
   testPlayerEndPoint (moduleManager, mediaPipeline);
   testRecorderEndPoint (moduleManager, mediaPipeline);
   testRtpEndpoint (moduleManager, mediaPipeline);
@@ -185,6 +217,7 @@ main (int argc, char **argv)
   testDispatcher (moduleManager, mediaPipeline);
   testDispatcherOneToMany (moduleManager, mediaPipeline);
   testComposite (moduleManager, mediaPipeline);
+  testStatsPoller (moduleManager, mediaPipeline);
 
   kurento::MediaSet::getMediaSet()->release (mediaPipeline);
 
@@ -0,0 +1,144 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <gst/gst.h>
+#include <KmsHttpEPServer.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace boost::unit_test;
+
+#define THREADS 8
+#define ENDPOINTS_PER_THREAD 50
+#define ENDPOINTS (THREADS * ENDPOINTS_PER_THREAD)
+#define TIMEOUT 10
+
+struct Registrations {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::set<std::string> uris;
+  std::set<std::thread::id> threads;
+  guint errors = 0;
+  guint done = 0;
+};
+
+static void
+registered (KmsHttpEPServer *server, const gchar *uri, GstElement *endpoint,
+            GError *err, gpointer data)
+{
+  Registrations *regs = (Registrations *) data;
+  std::unique_lock<std::mutex> lock (regs->mutex);
+
+  if (err != nullptr || uri == nullptr) {
+    regs->errors++;
+  } else {
+    regs->uris.insert (uri);
+  }
+
+  regs->threads.insert (std::this_thread::get_id () );
+  regs->done++;
+  regs->cond.notify_all ();
+}
+
+static void
+started (KmsHttpEPServer *server, GError *err, gpointer data)
+{
+  BOOST_REQUIRE (err == nullptr);
+}
+
+static void
+concurrent_registrations ()
+{
+  KmsHttpEPServer *server;
+  std::vector<GstElement *> endpoints;
+  std::vector<std::thread> threads;
+  Registrations regs;
+
+  server = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, 0, NULL);
+  kms_http_ep_server_start (server, started, nullptr, nullptr);
+
+  for (guint i = 0; i < ENDPOINTS; i++) {
+    GstElement *endpoint = gst_element_factory_make ("httppostendpoint",
+                           nullptr);
+
+    BOOST_REQUIRE (endpoint != nullptr);
+    endpoints.push_back (endpoint);
+  }
+
+  /* Endpoints are created from several API threads at the same time */
+  for (guint t = 0; t < THREADS; t++) {
+    threads.push_back (std::thread ([&, t] () {
+      for (guint i = 0; i < ENDPOINTS_PER_THREAD; i++) {
+        kms_http_ep_server_register_end_point (server,
+                                               endpoints[t * ENDPOINTS_PER_THREAD + i], TIMEOUT,
+                                               registered, &regs, nullptr);
+      }
+    }) );
+  }
+
+  for (auto &thread : threads) {
+    thread.join ();
+  }
+
+  std::unique_lock<std::mutex> lock (regs.mutex);
+
+  BOOST_REQUIRE (regs.cond.wait_for (lock, std::chrono::seconds (10),
+  [&] () {
+    return regs.done == ENDPOINTS;
+  }) );
+
+  BOOST_CHECK_EQUAL (regs.errors, 0);
+  BOOST_CHECK_EQUAL (regs.uris.size (), ENDPOINTS);
+  /* Registrations are run by the server loop, never by the callers */
+  BOOST_CHECK_EQUAL (regs.threads.size (), 1);
+
+  lock.unlock ();
+
+  for (auto uri : regs.uris) {
+    kms_http_ep_server_unregister_end_point (server, uri.c_str (), nullptr,
+        nullptr, nullptr);
+  }
+
+  kms_http_ep_server_stop (server, nullptr, nullptr, nullptr);
+  g_object_unref (server);
+
+  for (auto endpoint : endpoints) {
+    gst_object_unref (endpoint);
+  }
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpEPServerRegistration" );
+
+  gst_init (nullptr, nullptr);
+
+  test->add (BOOST_TEST_CASE ( &concurrent_registrations ), 0,
+             /* timeout */ 30);
+
+  return test;
+}
@@ -0,0 +1,360 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <gst/gst.h>
+#include <KmsHttpEPServer.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace boost::unit_test;
+
+#define CLIENTS 500
+#define CHUNKS 300
+#define CHUNK_SIZE 4096
+#define CHUNK_PERIOD (10 * G_TIME_SPAN_MILLISECOND)
+#define GOP 30
+#define TIMEOUT 10
+#define MAX_MEMORY_PER_CLIENT (256 * 1024)
+
+struct Clients {
+  std::vector<int> fds;
+  std::vector<std::atomic<gsize>> received;
+  std::atomic<bool> measuring {false};
+  std::atomic<bool> stop {false};
+  struct rusage start_usage;
+  struct rusage end_usage;
+};
+
+struct Registration {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::string uri;
+  bool started = false;
+  bool done = false;
+};
+
+static void
+started (KmsHttpEPServer *server, GError *err, gpointer data)
+{
+  Registration *reg = (Registration *) data;
+  std::unique_lock<std::mutex> lock (reg->mutex);
+
+  BOOST_REQUIRE (err == nullptr);
+  reg->started = true;
+  reg->cond.notify_all ();
+}
+
+static void
+registered (KmsHttpEPServer *server, const gchar *uri, GstElement *endpoint,
+            GError *err, gpointer data)
+{
+  Registration *reg = (Registration *) data;
+  std::unique_lock<std::mutex> lock (reg->mutex);
+
+  BOOST_REQUIRE (err == nullptr);
+  reg->uri = uri;
+  reg->done = true;
+  reg->cond.notify_all ();
+}
+
+static gint64
+getRss ()
+{
+  std::ifstream status ("/proc/self/status");
+  std::string line;
+
+  while (std::getline (status, line) ) {
+    if (line.compare (0, 6, "VmRSS:") == 0) {
+      return std::stoll (line.substr (6) ) * 1024;
+    }
+  }
+
+  return 0;
+}
+
+static gint64
+cpuTime (const struct rusage &usage)
+{
+  return usage.ru_utime.tv_sec * G_USEC_PER_SEC + usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_sec * G_USEC_PER_SEC + usage.ru_stime.tv_usec;
+}
+
+static void
+pushChunk (GstElement *endpoint, gboolean header, gboolean keyframe)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (nullptr, CHUNK_SIZE, nullptr);
+
+  gst_buffer_memset (buffer, 0, 0, CHUNK_SIZE);
+
+  if (header) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_HEADER);
+  } else if (!keyframe) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+
+  /* What the muxer of the end point emits */
+  g_signal_emit_by_name (endpoint, "new-chunk", buffer);
+  gst_buffer_unref (buffer);
+}
+
+static int
+connectClient (int port, const std::string &uri)
+{
+  struct sockaddr_in addr;
+  std::string request;
+  int fd;
+
+  fd = socket (AF_INET, SOCK_STREAM, 0);
+  BOOST_REQUIRE (fd >= 0);
+
+  memset (&addr, 0, sizeof (addr) );
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+  BOOST_REQUIRE (connect (fd, (struct sockaddr *) &addr, sizeof (addr) ) == 0);
+
+  request = "GET " + uri + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  BOOST_REQUIRE (write (fd, request.c_str (), request.size () ) ==
+                 (ssize_t) request.size () );
+
+  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+  return fd;
+}
+
+/* Reads every socket in a single thread, like many light clients would */
+static void
+readClients (Clients *data)
+{
+  std::vector<struct pollfd> fds (data->fds.size () );
+  bool measuring = false;
+  char buffer[64 * 1024];
+
+  for (guint i = 0; i < fds.size (); i++) {
+    fds[i].fd = data->fds[i];
+    fds[i].events = POLLIN;
+  }
+
+  while (!data->stop) {
+    if (!measuring && data->measuring) {
+      measuring = true;
+      getrusage (RUSAGE_THREAD, &data->start_usage);
+    }
+
+    if (poll (fds.data (), fds.size (), 100) <= 0) {
+      continue;
+    }
+
+    for (guint i = 0; i < fds.size (); i++) {
+      ssize_t n;
+
+      if (! (fds[i].revents & POLLIN) ) {
+        continue;
+      }
+
+      while ( (n = read (fds[i].fd, buffer, sizeof (buffer) ) ) > 0) {
+        data->received[i] += n;
+      }
+    }
+  }
+
+  getrusage (RUSAGE_THREAD, &data->end_usage);
+}
+
+static bool
+waitForBytes (Clients *data, gsize bytes)
+{
+  gint64 end = g_get_monotonic_time () + TIMEOUT * G_USEC_PER_SEC;
+
+  while (g_get_monotonic_time () < end) {
+    bool all = true;
+
+    for (auto &received : data->received) {
+      if (received < bytes) {
+        all = false;
+        break;
+      }
+    }
+
+    if (all) {
+      return true;
+    }
+
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  }
+
+  return false;
+}
+
+static void
+raiseFileLimit ()
+{
+  struct rlimit limit;
+
+  /* Two descriptors per client, the server and the client side */
+  getrlimit (RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit (RLIMIT_NOFILE, &limit);
+
+  BOOST_REQUIRE (limit.rlim_cur > 2 * CLIENTS + 64);
+}
+
+static void
+many_clients ()
+{
+  KmsHttpEPServer *server;
+  GstElement *endpoint;
+  Registration reg;
+  Clients data;
+  std::thread reader;
+  struct rusage before, after;
+  gint64 rss_before, rss_after, server_cpu, reader_cpu;
+  gsize start_bytes;
+  int port;
+
+  raiseFileLimit ();
+
+  server = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, 0, NULL);
+  kms_http_ep_server_start (server, started, &reg, nullptr);
+
+  endpoint = gst_element_factory_make ("httpgetendpoint", nullptr);
+  BOOST_REQUIRE (endpoint != nullptr);
+
+  {
+    std::unique_lock<std::mutex> lock (reg.mutex);
+
+    BOOST_REQUIRE (reg.cond.wait_for (lock, std::chrono::seconds (TIMEOUT),
+    [&] () {
+      return reg.started;
+    }) );
+  }
+
+  kms_http_ep_server_register_end_point (server, endpoint, TIMEOUT,
+                                         registered, &reg, nullptr);
+
+  {
+    std::unique_lock<std::mutex> lock (reg.mutex);
+
+    BOOST_REQUIRE (reg.cond.wait_for (lock, std::chrono::seconds (TIMEOUT),
+    [&] () {
+      return reg.done;
+    }) );
+  }
+
+  g_object_get (G_OBJECT (server), KMS_HTTP_EP_SERVER_PORT, &port, NULL);
+
+  /* The first client creates the shared stream, the rest join it */
+  data.received = std::vector<std::atomic<gsize>> (CLIENTS);
+  data.fds.push_back (connectClient (port, reg.uri) );
+  g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+  pushChunk (endpoint, TRUE, FALSE);
+  pushChunk (endpoint, FALSE, TRUE);
+
+  rss_before = getRss ();
+
+  for (guint i = 1; i < CLIENTS; i++) {
+    data.fds.push_back (connectClient (port, reg.uri) );
+  }
+
+  reader = std::thread (readClients, &data);
+
+  /* Every client gets the header and the keyframe before measuring */
+  BOOST_REQUIRE (waitForBytes (&data, 2 * CHUNK_SIZE) );
+  rss_after = getRss ();
+
+  start_bytes = G_MAXSIZE;
+
+  for (auto &received : data.received) {
+    start_bytes = MIN (start_bytes, (gsize) received);
+  }
+
+  data.measuring = true;
+  getrusage (RUSAGE_SELF, &before);
+
+  for (guint i = 1; i <= CHUNKS; i++) {
+    pushChunk (endpoint, FALSE, i % GOP == 0);
+    g_usleep (CHUNK_PERIOD);
+  }
+
+  BOOST_CHECK (waitForBytes (&data, start_bytes + CHUNKS * CHUNK_SIZE) );
+
+  getrusage (RUSAGE_SELF, &after);
+  data.stop = true;
+  reader.join ();
+
+  /* Process time minus the time spent reading on the client side */
+  reader_cpu = cpuTime (data.end_usage) - cpuTime (data.start_usage);
+  server_cpu = cpuTime (after) - cpuTime (before) - reader_cpu;
+
+  BOOST_TEST_MESSAGE (CLIENTS << " clients, " << CHUNKS << " chunks of "
+                      << CHUNK_SIZE << " bytes every "
+                      << CHUNK_PERIOD / G_TIME_SPAN_MILLISECOND << " ms");
+  BOOST_TEST_MESSAGE ("Server CPU: " << server_cpu << " us, "
+                      << (double) server_cpu / CLIENTS << " us per client, "
+                      << (double) server_cpu * 1000 / (CLIENTS * CHUNKS)
+                      << " ns per delivered chunk. Client reads: "
+                      << reader_cpu << " us");
+  BOOST_TEST_MESSAGE ("Memory: " << rss_after - rss_before << " bytes for "
+                      << CLIENTS - 1 << " clients, "
+                      << (rss_after - rss_before) / (CLIENTS - 1)
+                      << " bytes per client");
+
+  BOOST_CHECK ( (rss_after - rss_before) / (CLIENTS - 1) <
+                MAX_MEMORY_PER_CLIENT);
+
+  for (auto fd : data.fds) {
+    close (fd);
+  }
+
+  kms_http_ep_server_unregister_end_point (server, reg.uri.c_str (), nullptr,
+      nullptr, nullptr);
+  kms_http_ep_server_stop (server, nullptr, nullptr, nullptr);
+  g_object_unref (server);
+  gst_object_unref (endpoint);
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpGetClients" );
+
+  gst_init (nullptr, nullptr);
+
+  test->add (BOOST_TEST_CASE ( &many_clients ), 0, /* timeout */ 60);
+
+  return test;
+}
@@ -0,0 +1,199 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <gst/gst.h>
+#include <KmsHttpRing.h>
+
+#include <vector>
+
+using namespace boost::unit_test;
+
+#define CLIENTS 500
+#define SLOW_CLIENTS 10
+#define CHUNKS 3000
+#define CHUNK_SIZE 4096
+#define GOP 30
+#define SLOW_CLIENT_PERIOD 10
+
+static GstBuffer *
+createChunk (gboolean header, gboolean keyframe)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (nullptr, CHUNK_SIZE, nullptr);
+
+  gst_buffer_memset (buffer, 0, 0, CHUNK_SIZE);
+
+  if (header) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_HEADER);
+  } else if (!keyframe) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+
+  return buffer;
+}
+
+static void
+pushChunk (KmsHttpRing *ring, gboolean header, gboolean keyframe)
+{
+  GstBuffer *buffer = createChunk (header, keyframe);
+
+  kms_http_ring_push (ring, buffer);
+  gst_buffer_unref (buffer);
+}
+
+static guint
+drain (KmsHttpRingCursor *cursor, guint max, gboolean *skipped,
+       const guint8 **first)
+{
+  KmsHttpChunk *chunk;
+  gboolean skip;
+  guint n = 0;
+
+  while (n < max && (chunk = kms_http_ring_cursor_next (cursor, &skip) ) ) {
+    if (skip && skipped != nullptr) {
+      *skipped = TRUE;
+      /* Slow clients are moved to a point where they can start decoding */
+      BOOST_CHECK (kms_http_chunk_is_keyframe (chunk) );
+    }
+
+    if (n == 0 && first != nullptr) {
+      *first = kms_http_chunk_get_data (chunk);
+    }
+
+    kms_http_chunk_unref (chunk);
+    n++;
+  }
+
+  return n;
+}
+
+static void
+new_client_starts_at_keyframe ()
+{
+  KmsHttpRing *ring = kms_http_ring_new (64, 64 * CHUNK_SIZE);
+  KmsHttpRingCursor *cursor;
+  KmsHttpChunk *chunk;
+
+  pushChunk (ring, TRUE, FALSE);
+
+  for (guint i = 0; i < 2 * GOP + 5; i++) {
+    pushChunk (ring, FALSE, i % GOP == 0);
+  }
+
+  cursor = kms_http_ring_cursor_new (ring);
+
+  /* Header first */
+  chunk = kms_http_ring_cursor_next (cursor, nullptr);
+  BOOST_REQUIRE (chunk != nullptr);
+  BOOST_CHECK (!kms_http_chunk_is_keyframe (chunk) );
+  kms_http_chunk_unref (chunk);
+
+  /* Then the last keyframe and what comes after it */
+  chunk = kms_http_ring_cursor_next (cursor, nullptr);
+  BOOST_REQUIRE (chunk != nullptr);
+  BOOST_CHECK (kms_http_chunk_is_keyframe (chunk) );
+  kms_http_chunk_unref (chunk);
+
+  BOOST_CHECK_EQUAL (drain (cursor, G_MAXUINT, nullptr, nullptr), 4);
+
+  /* A new header means the muxer was restarted */
+  pushChunk (ring, TRUE, FALSE);
+  pushChunk (ring, FALSE, TRUE);
+  BOOST_CHECK_EQUAL (drain (cursor, G_MAXUINT, nullptr, nullptr), 2);
+
+  kms_http_ring_cursor_free (cursor);
+  kms_http_ring_unref (ring);
+}
+
+/* Socket and CPU costs are measured in httpGetClients.cpp */
+static void
+shared_ring ()
+{
+  KmsHttpRing *ring = kms_http_ring_new (KMS_HTTP_RING_DEFAULT_MAX_CHUNKS,
+                                         256 * CHUNK_SIZE);
+  std::vector<KmsHttpRingCursor *> cursors;
+  std::vector<guint> received (CLIENTS, 0);
+  const guint8 *data, *first = nullptr;
+  gboolean skipped = FALSE;
+  gsize bytes;
+
+  for (guint i = 0; i < CLIENTS; i++) {
+    cursors.push_back (kms_http_ring_cursor_new (ring) );
+  }
+
+  pushChunk (ring, TRUE, FALSE);
+
+  for (guint i = 0; i < CHUNKS; i++) {
+    pushChunk (ring, FALSE, i % GOP == 0);
+
+    for (guint c = 0; c < CLIENTS; c++) {
+      guint n;
+
+      if (c < SLOW_CLIENTS) {
+        if (i % SLOW_CLIENT_PERIOD != 0) {
+          continue;
+        }
+
+        n = drain (cursors[c], 1, &skipped, nullptr);
+      } else {
+        n = drain (cursors[c], G_MAXUINT, nullptr, &data);
+
+        if (n > 0 && c == SLOW_CLIENTS) {
+          first = data;
+        } else if (n > 0 && c == CLIENTS - 1) {
+          /* All the clients read the same memory */
+          BOOST_CHECK (data == first);
+        }
+      }
+
+      received[c] += n;
+    }
+  }
+
+  kms_http_ring_get_usage (ring, nullptr, &bytes);
+
+  /* Fast clients get the header and every chunk, slow ones skip ahead */
+  for (guint c = SLOW_CLIENTS; c < CLIENTS; c++) {
+    BOOST_CHECK_EQUAL (received[c], CHUNKS + 1);
+  }
+
+  BOOST_CHECK (skipped);
+  BOOST_CHECK (bytes <= 256 * CHUNK_SIZE);
+
+  for (auto cursor : cursors) {
+    kms_http_ring_cursor_free (cursor);
+  }
+
+  kms_http_ring_unref (ring);
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpGetRing" );
+
+  gst_init (nullptr, nullptr);
+
+  test->add (BOOST_TEST_CASE ( &new_client_starts_at_keyframe ), 0,
+             /* timeout */ 20);
+  test->add (BOOST_TEST_CASE ( &shared_ring ), 0, /* timeout */ 60);
+
+  return test;
+}